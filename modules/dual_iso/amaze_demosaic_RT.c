@@ -32,6 +32,9 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "amaze-port.c"
 
@@ -46,8 +49,13 @@ void amaze_demosaic_RT(
 {
     printf ("AMaZE interpolation ...\n");
 
+#ifdef _OPENMP
+    /* clock() adds up the time of all threads */
+    double t1 = omp_get_wtime();
+#else
     clock_t	t1,t2;
     t1 = clock();
+#endif
 
 #define HCLIP(x) x //is this still necessary???
 	//min(clip_pt,x)
@@ -91,16 +99,24 @@ void amaze_demosaic_RT(
 
 	//~ volatile double progress = 0.0;
 
-	// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-
-// Issue 1676
-// Moved from inside the parallel section
+	// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+// Issue 1676
+// Moved from inside the parallel section
 	struct s_hv {
 		float h;
 		float v;
 	};
 
-//~ #pragma omp parallel
+	//determine GRBG coset; (ey,ex) is the offset of the R subarray
+	if (FC(0,0)==1) {//first pixel is G
+		if (FC(0,1)==0) {ey=0; ex=1;} else {ey=1; ex=0;}
+	} else {//first pixel is R or B
+		if (FC(0,0)==0) {ey=0; ex=0;} else {ey=1; ex=1;}
+	}
+
+	// every thread gets its own tile buffer below, the tiles only share the (read only) input
+#pragma omp parallel
 {
 	//position of top/left corner of the tile
 	int top, left;
@@ -200,20 +216,14 @@ void amaze_demosaic_RT(
 	// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 
-	//determine GRBG coset; (ey,ex) is the offset of the R subarray
-	if (FC(0,0)==1) {//first pixel is G
-		if (FC(0,1)==0) {ey=0; ex=1;} else {ey=1; ex=0;}
-	} else {//first pixel is R or B
-		if (FC(0,0)==0) {ey=0; ex=0;} else {ey=1; ex=1;}
-	}
 
 	// Main algorithm: Tile loop
 	//#pragma omp parallel for shared(rawData,height,width,red,green,blue) private(top,left) schedule(dynamic)
-	//code is openmp ready; just have to pull local tile variable declarations inside the tile loop
-
-// Issue 1676
-// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling
-//~ #pragma omp for schedule(dynamic) collapse(2) nowait
+	//code is openmp ready; just have to pull local tile variable declarations inside the tile loop
+
+// Issue 1676
+// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling
+#pragma omp for schedule(dynamic) collapse(2) nowait
 	for (top=winy-16; top < winy+height; top += TS-32)
 		for (left=winx-16; left < winx+width; left += TS-32) {
 			memset(nyquist, 0, sizeof(char)*TS*TSH);
@@ -1406,7 +1416,11 @@ void amaze_demosaic_RT(
 
 #undef TS
 
+#ifdef _OPENMP
+printf("Amaze took %.2f s\n", omp_get_wtime() - t1);
+#else
 t2 = clock() - t1;
 printf("Amaze took %.2f s\n", (double)t2 / CLOCKS_PER_SEC);
+#endif
 
 }
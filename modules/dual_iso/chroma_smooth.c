@@ -2,40 +2,102 @@
 #define CHROMA_SMOOTH_FUNC chroma_smooth_2x2
 #define CHROMA_SMOOTH_MAX_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 5
-#define CHROMA_SMOOTH_MEDIAN opt_med5
 #elif defined(CHROMA_SMOOTH_3X3)
 #define CHROMA_SMOOTH_FUNC chroma_smooth_3x3
 #define CHROMA_SMOOTH_MAX_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 9
-#define CHROMA_SMOOTH_MEDIAN opt_med9
 #else
 #define CHROMA_SMOOTH_FUNC chroma_smooth_5x5
 #define CHROMA_SMOOTH_MAX_IJ 4
 #define CHROMA_SMOOTH_FILTER_SIZE 25
-#define CHROMA_SMOOTH_MEDIAN opt_med25
+#endif
+
+#ifndef CHROMA_SMOOTH_CELLS
+#define CHROMA_SMOOTH_CELLS
+
+/* rows of RG/GB cells per parallel job */
+#define CHROMA_SMOOTH_BAND 32
+
+/**
+ * the interpolated green and the red and blue differences from it only depend on one RG/GB cell,
+ * so they are computed once per cell instead of once for every window the cell is part of.
+ * a window needs CHROMA_SMOOTH_MAX_IJ + 1 rows of cells, they are kept in a ring of cell rows.
+ */
+struct chroma_cells
+{
+    int32_t * ge;
+    int32_t * dr;
+    int32_t * db;
+};
+
+/* cells of row 'y' with their red pixel at x0, x0 + 2, ... */
+static void chroma_smooth_cells(int w, uint32_t * inp, int* raw2ev, int x0, int y, int count, struct chroma_cells * cells)
+{
+    for (int n = 0; n < count; n++)
+    {
+        int x = x0 + 2 * n;
+        int r  = inp[x   +   y * w];
+        int g1 = inp[x+1 +   y * w];
+        int g2 = inp[x   + (y+1) * w];
+        int b  = inp[x+1 + (y+1) * w];
+
+        int ge = (raw2ev[g1] + raw2ev[g2]) / 2;
+        cells->ge[n] = ge;
+        cells->dr[n] = raw2ev[r] - ge;
+        cells->db[n] = raw2ev[b] - ge;
+    }
+}
+
 #endif
 
 static void CHROMA_SMOOTH_FUNC(uint32_t * inp, uint32_t * out, int* raw2ev, int* ev2raw)
 {
     int w = raw_info.width;
     int h = raw_info.height;
-    int x,y;
+    const int m = CHROMA_SMOOTH_MAX_IJ;
+    const int ring = CHROMA_SMOOTH_MAX_IJ + 1;
+    int count = (w-4 - 4 + 1) / 2;
+    int cell_count = count + m;
+    int bands = (h-5 - 4 + 2*CHROMA_SMOOTH_BAND - 1) / (2*CHROMA_SMOOTH_BAND);
 
-    for (y = 4; y < h-5; y += 2)
+    if (count <= 0 || bands <= 0)
+        return;
+
+    /* every pixel pair only reads from 'inp' and writes its own 'out' pixels, so bands of rows can run in parallel */
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < bands; band++)
     {
-        for (x = 4; x < w-4; x += 2)
+        int y_start = 4 + band * 2*CHROMA_SMOOTH_BAND;
+        int y_end = MIN(h-5, y_start + 2*CHROMA_SMOOTH_BAND);
+
+        int32_t * buf = malloc((3 * ring * cell_count + 2 * count) * sizeof(int32_t));
+        if (!buf)
+            continue;
+
+        struct chroma_cells cells[CHROMA_SMOOTH_MAX_IJ + 1];
+        for (int n = 0; n < ring; n++)
         {
-            int g1 = inp[x+1 +     y * w];
-            int g2 = inp[x   + (y+1) * w];
-            int ge = (raw2ev[g1] + raw2ev[g2]) / 2;
-            
-            /* looks ugly in darkness */
-            if (ge < 2*EV_RESOLUTION) continue;
+            int32_t * row = buf + 3 * n * cell_count;
+            struct chroma_cells c = { row, row + cell_count, row + 2 * cell_count };
+            cells[n] = c;
+        }
+        int32_t * med_dr = buf + 3 * ring * cell_count;
+        int32_t * med_db = med_dr + count;
+
+        /* cell rows are computed once, when the first window of the band reaches them */
+        int next = y_start - m;
+
+        for (int y = y_start; y < y_end; y += 2)
+        {
+            for (; next <= y + m; next += 2)
+            {
+                chroma_smooth_cells(w, inp, raw2ev, 4 - m, next, cell_count, &cells[(next / 2) % ring]);
+            }
 
             int i,j;
             int k = 0;
-            int med_r[CHROMA_SMOOTH_FILTER_SIZE];
-            int med_b[CHROMA_SMOOTH_FILTER_SIZE];
+            const int32_t * med_r[CHROMA_SMOOTH_FILTER_SIZE];
+            const int32_t * med_b[CHROMA_SMOOTH_FILTER_SIZE];
             for (i = -CHROMA_SMOOTH_MAX_IJ; i <= CHROMA_SMOOTH_MAX_IJ; i += 2)
             {
                 for (j = -CHROMA_SMOOTH_MAX_IJ; j <= CHROMA_SMOOTH_MAX_IJ; j += 2)
@@ -44,31 +106,43 @@ static void CHROMA_SMOOTH_FUNC(uint32_t * inp, uint32_t * out, int* raw2ev, int*
                     if (ABS(i) + ABS(j) == 4)
                         continue;
                     #endif
-                    
-                    int r  = inp[x+i   +   (y+j) * w];
-                    int g1 = inp[x+i+1 +   (y+j) * w];
-                    int g2 = inp[x+i   + (y+j+1) * w];
-                    int b  = inp[x+i+1 + (y+j+1) * w];
-                    
-                    int ge = (raw2ev[g1] + raw2ev[g2]) / 2;
-                    med_r[k] = raw2ev[r] - ge;
-                    med_b[k] = raw2ev[b] - ge;
+
+                    struct chroma_cells * c = &cells[((y + j) / 2) % ring];
+                    med_r[k] = c->dr + (i + m) / 2;
+                    med_b[k] = c->db + (i + m) / 2;
                     k++;
                 }
             }
-            int dr = CHROMA_SMOOTH_MEDIAN(med_r);
-            int db = CHROMA_SMOOTH_MEDIAN(med_b);
 
-            if (ge + dr <= EV_RESOLUTION) continue;
-            if (ge + db <= EV_RESOLUTION) continue;
+            /* medians of the whole row at once */
+            median_rows(med_r, k, count, med_dr);
+            median_rows(med_b, k, count, med_db);
 
-            out[x   +     y * w] = ev2raw[COERCE(ge + dr, 0, 14*EV_RESOLUTION-1)];
-            out[x+1 + (y+1) * w] = ev2raw[COERCE(ge + db, 0, 14*EV_RESOLUTION-1)];
+            const int32_t * center = cells[(y / 2) % ring].ge + m / 2;
+
+            for (int n = 0; n < count; n++)
+            {
+                int x = 4 + 2 * n;
+                int ge = center[n];
+                
+                /* looks ugly in darkness */
+                if (ge < 2*EV_RESOLUTION) continue;
+
+                int dr = med_dr[n];
+                int db = med_db[n];
+
+                if (ge + dr <= EV_RESOLUTION) continue;
+                if (ge + db <= EV_RESOLUTION) continue;
+
+                out[x   +     y * w] = ev2raw[COERCE(ge + dr, 0, 14*EV_RESOLUTION-1)];
+                out[x+1 + (y+1) * w] = ev2raw[COERCE(ge + db, 0, 14*EV_RESOLUTION-1)];
+            }
         }
+
+        free(buf);
     }
 }
 
 #undef CHROMA_SMOOTH_FUNC
 #undef CHROMA_SMOOTH_MAX_IJ
 #undef CHROMA_SMOOTH_FILTER_SIZE
-#undef CHROMA_SMOOTH_MEDIAN
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * In-process CR2 reader: TIFF structure, EXIF, the few Canon maker notes cr2hdr uses,
+ * and the lossless JPEG raw data (decoded with lj92 from mlv_dump).
+ *
+ * Only what cr2hdr needs is parsed; anything unexpected makes cr2_read_info fail,
+ * so the caller can fall back to dcraw and exiftool.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mlv_rec/lj92.h"
+#include "cr2-reader.h"
+
+/** Compute the number of entries in a static array */
+#define COUNT(x)        ((int)(sizeof(x)/sizeof((x)[0])))
+
+#define MAX_IFD_ENTRIES 1000
+
+/* TIFF tags */
+#define TAG_COMPRESSION     0x0103
+#define TAG_MAKE            0x010F
+#define TAG_MODEL           0x0110
+#define TAG_STRIP_OFFSETS   0x0111
+#define TAG_STRIP_BYTES     0x0117
+#define TAG_EXIF_IFD        0x8769
+#define TAG_CR2_SLICES      0xC640
+
+/* EXIF tags */
+#define TAG_EXPOSURE_TIME   0x829A
+#define TAG_FNUMBER         0x829D
+#define TAG_ISO             0x8827
+#define TAG_DATETIME_ORIG   0x9003
+#define TAG_FOCAL_LENGTH    0x920A
+#define TAG_MAKERNOTE       0x927C
+#define TAG_SUBSEC_ORIG     0x9291
+#define TAG_LENS_MODEL      0xA434
+
+/* Canon maker notes */
+#define TAG_CANON_SHOTINFO  0x0004
+#define TAG_CANON_SENSOR    0x00E0
+#define TAG_CANON_COLORDATA 0x4001
+
+/* the IFD with the raw data */
+#define CR2_RAW_IFD 3
+
+struct tiff_file
+{
+    FILE* f;
+    int big_endian;
+};
+
+struct tiff_entry
+{
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    uint8_t value[4];           /* the data if it fits, otherwise its offset */
+};
+
+static uint16_t get2(struct tiff_file* t, const uint8_t* p)
+{
+    return t->big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static uint32_t get4(struct tiff_file* t, const uint8_t* p)
+{
+    return t->big_endian ?
+        ((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]) :
+        ((uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+static int read_at(struct tiff_file* t, uint32_t offset, void* buf, int size)
+{
+    if (fseek(t->f, offset, SEEK_SET))
+        return 0;
+    return (int) fread(buf, 1, size, t->f) == size;
+}
+
+static int type_size(int type)
+{
+    switch (type)
+    {
+        case 3: case 8:         return 2;   /* SHORT, SSHORT */
+        case 4: case 9: case 11: return 4;  /* LONG, SLONG, FLOAT */
+        case 5: case 10: case 12: return 8; /* RATIONAL, SRATIONAL, DOUBLE */
+        default:                return 1;   /* BYTE, ASCII, UNDEFINED... */
+    }
+}
+
+/* reads an IFD; returns the number of entries (0 on error) and the offset of the next IFD */
+static int read_ifd(struct tiff_file* t, uint32_t offset, struct tiff_entry** entries, uint32_t* next)
+{
+    uint8_t buf[12];
+    *entries = 0;
+
+    if (!read_at(t, offset, buf, 2))
+        return 0;
+
+    int num = get2(t, buf);
+    if (num == 0 || num > MAX_IFD_ENTRIES)
+        return 0;
+
+    struct tiff_entry* e = malloc(num * sizeof(e[0]));
+    if (!e)
+        return 0;
+
+    for (int i = 0; i < num; i++)
+    {
+        if (fread(buf, 1, 12, t->f) != 12)
+        {
+            free(e);
+            return 0;
+        }
+        e[i].tag = get2(t, buf);
+        e[i].type = get2(t, buf + 2);
+        e[i].count = get4(t, buf + 4);
+        memcpy(e[i].value, buf + 8, 4);
+    }
+
+    *next = 0;
+    if (fread(buf, 1, 4, t->f) == 4)
+        *next = get4(t, buf);
+
+    *entries = e;
+    return num;
+}
+
+/* copies up to 'size' bytes of the entry data into 'buf'; returns how many */
+static int read_entry(struct tiff_file* t, struct tiff_entry* e, void* buf, int size)
+{
+    uint32_t total = e->count * type_size(e->type);
+    if (e->count > 0x10000000 || total == 0)
+        return 0;
+
+    if ((uint32_t) size > total)
+        size = total;
+
+    if (total <= 4)
+    {
+        memcpy(buf, e->value, size);
+        return size;
+    }
+
+    return read_at(t, get4(t, e->value), buf, size) ? size : 0;
+}
+
+/* first value of a SHORT or LONG entry */
+static uint32_t entry_int(struct tiff_file* t, struct tiff_entry* e)
+{
+    return e->type == 3 ? get2(t, e->value) : get4(t, e->value);
+}
+
+static void entry_rational(struct tiff_file* t, struct tiff_entry* e, int* value)
+{
+    uint8_t buf[8];
+    if (read_entry(t, e, buf, 8) == 8)
+    {
+        value[0] = get4(t, buf);
+        value[1] = get4(t, buf + 4);
+    }
+}
+
+static void entry_string(struct tiff_file* t, struct tiff_entry* e, char* str, int size)
+{
+    int len = read_entry(t, e, str, size - 1);
+    str[len] = 0;
+
+    /* EXIF strings are often padded with spaces */
+    while (len > 0 && str[len-1] == ' ')
+        str[--len] = 0;
+}
+
+/* reads up to 'count' SHORT values; returns how many */
+static int entry_shorts(struct tiff_file* t, struct tiff_entry* e, int* values, int count)
+{
+    if (e->type != 3 && e->type != 8)
+        return 0;
+
+    uint8_t buf[32];
+    int n = read_entry(t, e, buf, 2 * count) / 2;
+    for (int i = 0; i < n; i++)
+        values[i] = get2(t, buf + 2*i);
+    return n;
+}
+
+/* crop table, copied straight from dcraw.c (identify, Canon section) */
+/* raw size, then left, top, right and bottom margins */
+static const struct {
+    short raw_width, raw_height;
+    short left, top, right, bottom;
+} canon_crop[] = {
+    { 4352, 2874,  62, 18,  0,  0 },      /* 1100D */
+    { 4832, 3204,  62, 26,  0,  0 },      /* 500D */
+    { 4832, 3228,  62, 51,  0,  0 },      /* 50D */
+    { 5280, 3528,  72, 52,  0,  0 },      /* 650D, 700D, 100D, EOS M */
+    { 5344, 3516, 142, 51,  0,  0 },      /* 7D, 60D, 550D, 600D */
+    { 5568, 3708,  72, 38,  0,  0 },      /* 6D, 70D */
+    { 5792, 3804, 158, 51,  0,  0 },      /* 5D Mark II */
+    { 5920, 3950, 122, 80,  2,  0 },      /* 5D Mark III */
+};
+
+static void parse_makernote(struct tiff_file* t, uint32_t offset, struct cr2_info* info, int* sensor)
+{
+    struct tiff_entry* entries;
+    uint32_t next;
+    int num = read_ifd(t, offset, &entries, &next);
+
+    for (int i = 0; i < num; i++)
+    {
+        struct tiff_entry* e = &entries[i];
+        switch (e->tag)
+        {
+            case TAG_CANON_SHOTINFO:
+            {
+                int shot_info[8];
+                if (entry_shorts(t, e, shot_info, 8) == 8)
+                    info->wb_mode = shot_info[7];
+                break;
+            }
+            case TAG_CANON_SENSOR:
+            {
+                /* width, height, left, top, right, bottom (the last two are inclusive) */
+                int sensor_info[9];
+                if (entry_shorts(t, e, sensor_info, 9) == 9)
+                {
+                    sensor[0] = sensor_info[1];
+                    sensor[1] = sensor_info[2];
+                    sensor[2] = sensor_info[5];
+                    sensor[3] = sensor_info[6];
+                    sensor[4] = sensor_info[7];
+                    sensor[5] = sensor_info[8];
+                }
+                break;
+            }
+            case TAG_CANON_COLORDATA:
+            {
+                /* WB_RGGBLevelsAsShot, same offsets as dcraw */
+                if (e->type != 3 || e->count <= 500)
+                    break;
+                int pos = e->count == 582 ? 50 : e->count == 653 ? 68 : e->count == 5120 ? 142 : 126;
+                uint8_t buf[8];
+                if (read_at(t, get4(t, e->value) + pos, buf, 8))
+                {
+                    for (int c = 0; c < 4; c++)
+                        info->wb_rggb_as_shot[c] = get2(t, buf + 2*c);
+                }
+                break;
+            }
+        }
+    }
+
+    free(entries);
+}
+
+static void parse_exif(struct tiff_file* t, uint32_t offset, struct cr2_info* info, int* sensor)
+{
+    struct tiff_entry* entries;
+    uint32_t next;
+    int num = read_ifd(t, offset, &entries, &next);
+
+    for (int i = 0; i < num; i++)
+    {
+        struct tiff_entry* e = &entries[i];
+        switch (e->tag)
+        {
+            case TAG_EXPOSURE_TIME:
+                entry_rational(t, e, info->shutter);
+                break;
+            case TAG_FNUMBER:
+                entry_rational(t, e, info->aperture);
+                break;
+            case TAG_FOCAL_LENGTH:
+                entry_rational(t, e, info->focal);
+                break;
+            case TAG_ISO:
+                info->iso = entry_int(t, e);
+                break;
+            case TAG_DATETIME_ORIG:
+                entry_string(t, e, info->datetime, sizeof(info->datetime));
+                break;
+            case TAG_SUBSEC_ORIG:
+                entry_string(t, e, info->subsectime, sizeof(info->subsectime));
+                break;
+            case TAG_LENS_MODEL:
+                entry_string(t, e, info->lens_model, sizeof(info->lens_model));
+                break;
+            case TAG_MAKERNOTE:
+                /* Canon maker notes are a plain IFD, with offsets from the TIFF header */
+                parse_makernote(t, get4(t, e->value), info, sensor);
+                break;
+        }
+    }
+
+    free(entries);
+}
+
+/* size of the raw data, from the lossless JPEG header */
+static int parse_raw_size(struct tiff_file* t, struct cr2_info* info)
+{
+    uint8_t header[4096];
+    int size = info->raw_size < sizeof(header) ? (int) info->raw_size : (int) sizeof(header);
+    if (!read_at(t, info->raw_offset, header, size))
+        return 0;
+
+    lj92 handle;
+    int width, height, bitdepth, components;
+    if (lj92_open(&handle, header, size, &width, &height, &bitdepth, &components) != LJ92_ERROR_NONE)
+        return 0;
+    lj92_close(handle);
+
+    info->raw_width = width * components;
+    info->raw_height = height;
+
+    /* some cameras store two rows in one JPEG row (from dcraw) */
+    if (info->raw_width > 4 * info->raw_height && !(components & 1))
+    {
+        info->raw_width /= 2;
+        info->raw_height *= 2;
+    }
+
+    return 1;
+}
+
+int cr2_read_info(const char* filename, struct cr2_info* info)
+{
+    memset(info, 0, sizeof(*info));
+    info->wb_mode = -1;
+
+    struct tiff_file t;
+    t.f = fopen(filename, "rb");
+    if (!t.f)
+        return 0;
+
+    int ok = 0;
+    int sensor[6] = {0, 0, 0, 0, 0, 0};
+    char make[32] = "";
+    int compression = 0;
+    uint8_t header[12];
+
+    if (!read_at(&t, 0, header, sizeof(header)))
+        goto end;
+
+    if (header[0] == 'I' && header[1] == 'I')
+        t.big_endian = 0;
+    else if (header[0] == 'M' && header[1] == 'M')
+        t.big_endian = 1;
+    else
+        goto end;
+
+    if (get2(&t, header + 2) != 42 || header[8] != 'C' || header[9] != 'R' || header[10] != 2)
+        goto end;
+
+    uint32_t offset = get4(&t, header + 4);
+    for (int ifd = 0; ifd <= CR2_RAW_IFD && offset; ifd++)
+    {
+        struct tiff_entry* entries;
+        uint32_t next = 0;
+        int num = read_ifd(&t, offset, &entries, &next);
+        if (num == 0)
+            goto end;
+
+        for (int i = 0; i < num; i++)
+        {
+            struct tiff_entry* e = &entries[i];
+
+            if (ifd == 0)
+            {
+                switch (e->tag)
+                {
+                    case TAG_MAKE:
+                        entry_string(&t, e, make, sizeof(make));
+                        break;
+                    case TAG_MODEL:
+                        entry_string(&t, e, info->model, sizeof(info->model));
+                        break;
+                    case TAG_EXIF_IFD:
+                        parse_exif(&t, entry_int(&t, e), info, sensor);
+                        break;
+                }
+            }
+            else if (ifd == CR2_RAW_IFD)
+            {
+                switch (e->tag)
+                {
+                    case TAG_COMPRESSION:
+                        compression = entry_int(&t, e);
+                        break;
+                    case TAG_STRIP_OFFSETS:
+                        info->raw_offset = entry_int(&t, e);
+                        break;
+                    case TAG_STRIP_BYTES:
+                        info->raw_size = entry_int(&t, e);
+                        break;
+                    case TAG_CR2_SLICES:
+                        entry_shorts(&t, e, info->slices, 3);
+                        break;
+                }
+            }
+        }
+
+        free(entries);
+        offset = next;
+    }
+
+    /* only lossless JPEG raw data from Canon (no sRAW or mRAW) */
+    if (strncmp(make, "Canon", 5) != 0 || compression != 6 || !info->raw_offset || !info->raw_size)
+        goto end;
+
+    if (!parse_raw_size(&t, info))
+        goto end;
+
+    if (info->slices[0] && info->slices[0] * info->slices[1] + info->slices[2] != info->raw_width)
+        goto end;
+
+    if (strncmp(info->model, "Canon ", 6) == 0)
+        memmove(info->model, info->model + 6, strlen(info->model + 6) + 1);
+
+    /* active area: dcraw crop table first (so the results match the dcraw code path), maker notes otherwise */
+    for (int i = 0; i < COUNT(canon_crop); i++)
+    {
+        if (canon_crop[i].raw_width == info->raw_width && canon_crop[i].raw_height == info->raw_height)
+        {
+            info->out_width = info->raw_width - canon_crop[i].left - canon_crop[i].right;
+            info->out_height = info->raw_height - canon_crop[i].top - canon_crop[i].bottom;
+            break;
+        }
+    }
+
+    if (!info->out_width && sensor[0] == info->raw_width && sensor[1] == info->raw_height)
+    {
+        info->out_width = info->raw_width - sensor[2] - (info->raw_width - 1 - sensor[4]);
+        info->out_height = info->raw_height - sensor[3] - (info->raw_height - 1 - sensor[5]);
+    }
+
+    ok = info->out_width > 0 && info->out_width <= info->raw_width &&
+         info->out_height > 0 && info->out_height <= info->raw_height;
+
+end:
+    fclose(t.f);
+    return ok;
+}
+
+int cr2_read_raw(const char* filename, const struct cr2_info* info, uint16_t* buffer)
+{
+    int ok = 0;
+    uint8_t* data = 0;
+    uint16_t* sliced = 0;
+    lj92 handle = 0;
+
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        return 0;
+
+    data = malloc(info->raw_size);
+    if (!data)
+        goto end;
+
+    if (fseek(f, info->raw_offset, SEEK_SET) || fread(data, 1, info->raw_size, f) != info->raw_size)
+        goto end;
+
+    int width, height, bitdepth, components;
+    if (lj92_open(&handle, data, info->raw_size, &width, &height, &bitdepth, &components) != LJ92_ERROR_NONE)
+    {
+        handle = 0;
+        goto end;
+    }
+
+    if (width * components * height != info->raw_width * info->raw_height)
+        goto end;
+
+    if (!info->slices[0])
+    {
+        /* the JPEG rows are the raw rows */
+        ok = lj92_decode(handle, buffer, 0, 0, 0, 0) == LJ92_ERROR_NONE;
+        goto end;
+    }
+
+    /* sliced: the JPEG data fills the image in vertical strips, each of them top to bottom */
+    sliced = malloc(info->raw_width * info->raw_height * sizeof(sliced[0]));
+    if (!sliced)
+        goto end;
+
+    if (lj92_decode(handle, sliced, 0, 0, 0, 0) != LJ92_ERROR_NONE)
+        goto end;
+
+    uint16_t* src = sliced;
+    for (int s = 0; s <= info->slices[0]; s++)
+    {
+        int x0 = s * info->slices[1];
+        int w = s < info->slices[0] ? info->slices[1] : info->slices[2];
+        for (int y = 0; y < info->raw_height; y++)
+        {
+            memcpy(buffer + y * info->raw_width + x0, src, w * sizeof(buffer[0]));
+            src += w;
+        }
+    }
+    ok = 1;
+
+end:
+    if (handle) lj92_close(handle);
+    free(sliced);
+    free(data);
+    fclose(f);
+    return ok;
+}
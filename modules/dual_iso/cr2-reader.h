@@ -0,0 +1,36 @@
+#ifndef _CR2_READER_H
+#define _CR2_READER_H
+
+#include <stdint.h>
+
+/* what cr2hdr needs from a CR2 file, read without dcraw or exiftool */
+struct cr2_info
+{
+    char model[64];                 /* EXIF Model, without the "Canon " prefix */
+    int raw_width, raw_height;      /* full sensor area, including the black borders ("Full size" in dcraw) */
+    int out_width, out_height;      /* like dcraw "Output size": without the left/top borders and the cropped right/bottom edges */
+
+    int iso;
+    int shutter[2];                 /* rationals, as stored in EXIF (0/0 if missing) */
+    int aperture[2];
+    int focal[2];
+    char datetime[20];              /* DateTimeOriginal, "YYYY:MM:DD HH:MM:SS" */
+    char subsectime[4];
+    char lens_model[64];
+
+    int wb_mode;                    /* Canon WhiteBalance (0 = auto), -1 if unknown */
+    int wb_rggb_as_shot[4];         /* WB_RGGBLevelsAsShot, all 0 if unknown */
+
+    /* lossless JPEG raw data */
+    uint32_t raw_offset;
+    uint32_t raw_size;
+    int slices[3];                  /* CR2 slices: count, width, width of the last one (count 0: not sliced) */
+};
+
+/* parse the TIFF structure, EXIF and Canon maker notes; returns 1 on success, 0 if this is not a CR2 we can decode */
+int cr2_read_info(const char* filename, struct cr2_info* info);
+
+/* decode the raw data into 'buffer' (raw_width x raw_height, 16 bits per pixel, native byte order); returns 1 on success */
+int cr2_read_raw(const char* filename, const struct cr2_info* info, uint16_t* buffer);
+
+#endif
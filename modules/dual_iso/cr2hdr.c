@@ -39,15 +39,21 @@ static int is_bright[4];
 #include <fcntl.h>
 #include <limits.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "../../src/raw.h"
 #include "../../src/chdk-dng.h"
 #include "qsort.h"  /* much faster than standard C qsort */
 
 #include "wirth.h"  /* fast median, generic implementation (also kth_smallest) */
 #include "optmed.h" /* fast median for small common array sizes (3, 7, 9...) */
+#include "../mlv_rec/raw_proc/median.h" /* the same medians for whole rows, vectorized */
 
 #include "dcraw-bridge.h"
 #include "exiftool-bridge.h"
+#include "cr2-reader.h"
 #include "adobedng-bridge.h"
 #include "dither.h"
 #include "timing.h"
@@ -95,6 +101,9 @@ int skip_existing = 0;
 int embed_original = 0;
 
 int shortcut_fast = 0;
+int num_threads = 0;            /* 0: one per CPU core (OpenMP default) */
+int use_dcraw = 0;              /* read CR2 files with dcraw/exiftool instead of the built-in reader */
+int basic_exif = 0;             /* do not run exiftool to copy all EXIF tags from CR2 files */
 
 void check_shortcuts()
 {
@@ -213,6 +222,10 @@ struct cmd_group options[] = {
                                     "                  To recover the original: exiftool IMG_1234.DNG -OriginalRawFileData -b > IMG_1234.CR2" },
             { &embed_original, 2, "--embed-original-copy",  "\n"
                                     "                  Similar to --embed-original, but without deleting the original.\n" },
+            { &num_threads,    1, "--threads=%d",     "Number of threads used for processing (default: one per CPU core)" },
+            { &basic_exif,     1, "--basic-exif",     "Only write the basic EXIF info read from CR2 files (camera, exposure, lens, date),\n"
+                                    "                  without copying all tags with exiftool (no external programs needed)" },
+            { &use_dcraw,      1, "--dcraw",          "Read the input files with dcraw and exiftool instead of the built-in CR2 reader" },
             OPTION_EOL
         },
     },
@@ -567,6 +580,103 @@ static int is_file(const char* filename)
     }
 }
 
+/* raw size and active area from "dcraw -v -i"; returns 1 on success */
+static int dcraw_read_info(const char* filename, int* raw_width, int* raw_height, int* out_width, int* out_height)
+{
+    char dcraw_cmd[1000];
+    snprintf(dcraw_cmd, sizeof(dcraw_cmd), "dcraw -v -i -t 0 \"%s\"", filename);
+    FILE* t = popen(dcraw_cmd, "r");
+    CHECK(t, "%s", filename);
+
+    char line[100];
+    while (fgets(line, sizeof(line), t))
+    {
+        if (startswith(line, "Full size: "))
+        {
+            int r = sscanf(line, "Full size: %d x %d\n", raw_width, raw_height);
+            CHECK(r == 2, "sscanf");
+        }
+        else if (startswith(line, "Output size: "))
+        {
+            int r = sscanf(line, "Output size: %d x %d\n", out_width, out_height);
+            CHECK(r == 2, "sscanf");
+        }
+    }
+    pclose(t);
+
+    return *raw_width != 0;
+}
+
+/* raw data from "dcraw -4 -E", into buf (width x height, native byte order); returns 1 on success */
+static int dcraw_read_raw(const char* filename, void* buf, int width, int height)
+{
+    char dcraw_cmd[1000];
+    snprintf(dcraw_cmd, sizeof(dcraw_cmd), "dcraw -4 -E -c -t 0 \"%s\"", filename);
+    FILE* fp = popen(dcraw_cmd, "r");
+    CHECK(fp, "%s", filename);
+    #ifdef _O_BINARY
+    _setmode(_fileno(fp), _O_BINARY);
+    #endif
+
+    /* PGM read code from dcraw */
+      int dim[3]={0,0,0}, comment=0, number=0, error=0, nd=0, c;
+
+      if (fgetc(fp) != 'P' || fgetc(fp) != '5') error = 1;
+      while (!error && nd < 3 && (c = fgetc(fp)) != EOF) {
+        if (c == '#')  comment = 1;
+        if (c == '\n') comment = 0;
+        if (comment) continue;
+        if (isdigit(c)) number = 1;
+        if (number) {
+          if (isdigit(c)) dim[nd] = dim[nd]*10 + c -'0';
+          else if (isspace(c)) {
+        number = 0;  nd++;
+          } else error = 1;
+        }
+      }
+
+    if (error || nd < 3)
+    {
+        pclose(fp);
+        return 0;
+    }
+
+    CHECK(dim[0] == width, "pgm width");
+    CHECK(dim[1] == height, "pgm height");
+
+    int size = fread(buf, 1, width * height * 2, fp);
+    CHECK(size == width * height * 2, "fread");
+    pclose(fp);
+
+    /* PGM is big endian, need to reverse it */
+    reverse_bytes_order(buf, width * height * 2);
+    return 1;
+}
+
+/* basic EXIF info from the built-in CR2 reader (exiftool will copy the rest, unless --basic-exif) */
+static void set_dng_exif(struct cr2_info* cr2)
+{
+    char camname[100];
+    snprintf(camname, sizeof(camname), "Canon %s", cr2->model);
+    dng_set_camname(camname);
+    dng_set_iso(cr2->iso);
+    dng_set_lensmodel(cr2->lens_model);
+    dng_set_datetime(cr2->datetime, cr2->subsectime);
+
+    if (cr2->shutter[1])
+    {
+        dng_set_shutter(cr2->shutter[0], cr2->shutter[1]);
+    }
+    if (cr2->aperture[1])
+    {
+        dng_set_aperture(cr2->aperture[0], cr2->aperture[1]);
+    }
+    if (cr2->focal[1])
+    {
+        dng_set_focal(cr2->focal[0], cr2->focal[1]);
+    }
+}
+
 int main(int argc, char** argv)
 {
     printf("cr2hdr: a post processing tool for Dual ISO images\n\n");
@@ -582,8 +692,6 @@ int main(int argc, char** argv)
         return 0;
     }
     
-    int r;
-
     /* parse all command-line options */
     for (int k = 1; k < argc; k++)
         if (argv[k][0] == '-')
@@ -591,6 +699,18 @@ int main(int argc, char** argv)
     
     solve_commandline_deps();
     show_active_options();
+
+#ifdef _OPENMP
+    if (num_threads > 0)
+    {
+        omp_set_num_threads(num_threads);
+    }
+#else
+    if (num_threads > 1)
+    {
+        printf("Threads         : compiled without OpenMP, using 1\n");
+    }
+#endif
     
     /* keep track of black and white levels (useful for deflicker) */
     /* (we will not have more than "argc" files) */
@@ -656,34 +776,24 @@ int main(int argc, char** argv)
             continue;
         }
 
-        char dcraw_cmd[1000];
-        snprintf(dcraw_cmd, sizeof(dcraw_cmd), "dcraw -v -i -t 0 \"%s\"", filename);
-        FILE* t = popen(dcraw_cmd, "r");
-        CHECK(t, "%s", filename);
-        
-        const char * model = get_camera_model(filename);
+        /* built-in CR2 reader first; dcraw and exiftool for anything else (or if asked to) */
+        struct cr2_info cr2;
+        int native = !use_dcraw && cr2_read_info(filename, &cr2);
+
+        const char * model = native ? cr2.model : get_camera_model(filename);
         get_raw_info(model, &raw_info);
 
         int raw_width = 0, raw_height = 0;
         int out_width = 0, out_height = 0;
-        
-        char line[100];
-        while (fgets(line, sizeof(line), t))
+
+        if (native)
         {
-            if (startswith(line, "Full size: "))
-            {
-                r = sscanf(line, "Full size: %d x %d\n", &raw_width, &raw_height);
-                CHECK(r == 2, "sscanf");
-            }
-            else if (startswith(line, "Output size: "))
-            {
-                r = sscanf(line, "Output size: %d x %d\n", &out_width, &out_height);
-                CHECK(r == 2, "sscanf");
-            }
+            raw_width = cr2.raw_width;
+            raw_height = cr2.raw_height;
+            out_width = cr2.out_width;
+            out_height = cr2.out_height;
         }
-        pclose(t);
-        
-        if (raw_width == 0)
+        else if (!dcraw_read_info(filename, &raw_width, &raw_height, &out_width, &out_height))
         {
             printf("dcraw could not open this file\n");
             continue;
@@ -695,53 +805,20 @@ int main(int argc, char** argv)
         int left_margin = raw_width - out_width;
         int top_margin = raw_height - out_height;
 
-        snprintf(dcraw_cmd, sizeof(dcraw_cmd), "dcraw -4 -E -c -t 0 \"%s\"", filename);
-        FILE* fp = popen(dcraw_cmd, "r");
-        CHECK(fp, "%s", filename);
-        #ifdef _O_BINARY
-        _setmode(_fileno(fp), _O_BINARY);
-        #endif
-
-        /* PGM read code from dcraw */
-          int dim[3]={0,0,0}, comment=0, number=0, error=0, nd=0, c;
-
-          if (fgetc(fp) != 'P' || fgetc(fp) != '5') error = 1;
-          while (!error && nd < 3 && (c = fgetc(fp)) != EOF) {
-            if (c == '#')  comment = 1;
-            if (c == '\n') comment = 0;
-            if (comment) continue;
-            if (isdigit(c)) number = 1;
-            if (number) {
-              if (isdigit(c)) dim[nd] = dim[nd]*10 + c -'0';
-              else if (isspace(c)) {
-            number = 0;  nd++;
-              } else error = 1;
-            }
-          }
+        int width = raw_width;
+        int height = raw_height;
+        void* buf = malloc_or_die(width * (height+1) * 2); /* 1 extra line for handling GBRG easier */
 
-        if (error || nd < 3)
+        if (native ? !cr2_read_raw(filename, &cr2, buf) : !dcraw_read_raw(filename, buf, width, height))
         {
-            pclose(fp);
-            printf("dcraw output is not a valid PGM file\n");
+            printf("%s\n", native ? "Could not decode the raw data" : "dcraw output is not a valid PGM file");
+            free(buf);
             continue;
         }
 
-        int width = dim[0];
-        int height = dim[1];
-        CHECK(width == raw_width, "pgm width");
-        CHECK(height == raw_height, "pgm height");
-
-        void* buf = malloc(width * (height+1) * 2); /* 1 extra line for handling GBRG easier */
-        int size = fread(buf, 1, width * height * 2, fp);
-        CHECK(size == width * height * 2, "fread");
-        pclose(fp);
-
-        /* PGM is big endian, need to reverse it */
-        reverse_bytes_order(buf, width * height * 2);
-
         raw_info.buffer = buf;
         
-        /* did we read the PGM correctly? (right byte order etc) */
+        /* did we read the raw data correctly? (right byte order etc) */
         //~ for (int i = 0; i < 10; i++)
             //~ printf("%d ", raw_get_pixel16(i, 0));
         //~ printf("\n");
@@ -778,7 +855,17 @@ int main(int argc, char** argv)
                 if (exif_wb)
                 {
                     float red_balance = -1, blue_balance = -1;
-                    read_white_balance(filename, &red_balance, &blue_balance);
+                    if (native && cr2.wb_mode > 0 && cr2.wb_rggb_as_shot[1] && cr2.wb_rggb_as_shot[2])
+                    {
+                        /* same as read_white_balance, for the non-auto modes */
+                        printf("White balance   : from WB_RGGBLevelsAsShot\n");
+                        red_balance = (float) cr2.wb_rggb_as_shot[0] / cr2.wb_rggb_as_shot[1];
+                        blue_balance = (float) cr2.wb_rggb_as_shot[3] / cr2.wb_rggb_as_shot[2];
+                    }
+                    else
+                    {
+                        read_white_balance(filename, &red_balance, &blue_balance);
+                    }
                     if ((red_balance > 0) && (blue_balance > 0))
                     {
                         dng_set_wbgain(1000000, red_balance*1000000, 1, 1, 1000000, blue_balance*1000000);
@@ -812,9 +899,17 @@ int main(int argc, char** argv)
                 }
 
                 printf("Output file     : %s %s\n", out_filename, is_file(out_filename) ? "(already exists, overwriting)" : "");
+                if (native)
+                {
+                    set_dng_exif(&cr2);
+                }
+
                 save_dng(out_filename);
 
-                copy_tags_from_source(filename, out_filename);
+                if (!native || !basic_exif)
+                {
+                    copy_tags_from_source(filename, out_filename);
+                }
 
                 if (orig_filename[0])
                 {
@@ -1886,6 +1981,8 @@ static void find_and_fix_bad_pixels(int dark_noise, int bright_noise, int* raw2e
     int cold_thr = MAX(0, black - dark_noise*8);
     int maybe_cold_thr = black + dark_noise*2;
 
+    /* rows are independent, only the counters need to be summed up */
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:hot_pixels,cold_pixels)
     for (int y = 6; y < h-6; y ++)
     {
         for (int x = 6; x < w-6; x ++)
@@ -1964,6 +2061,7 @@ static void find_and_fix_bad_pixels(int dark_noise, int bright_noise, int* raw2e
     }
 
     /* apply the correction */
+    #pragma omp parallel for
     for (int y = 0; y < h; y ++)
         for (int x = 0; x < w; x ++)
             if (hotpixel[x + y*w])
@@ -2050,6 +2148,7 @@ static int hdr_interpolate()
     /* handle sub-black values (negative EV) */
     int* ev2raw = ev2raw_0 + 10*EV_RESOLUTION;
 
+    #pragma omp parallel for
     for (int i = 0; i < 1<<20; i++)
     {
         double signal = MAX(i/64.0 - black/64.0, -1023);
@@ -2109,6 +2208,7 @@ static int hdr_interpolate()
     void* raw_buffer_16 = raw_info.buffer;
     uint32_t * raw_buffer_32 = malloc(w * h * sizeof(raw_buffer_32[0]));
     
+    #pragma omp parallel for
     for (int y = 0; y < h; y ++)
         for (int x = 0; x < w; x ++)
             raw_buffer_32[x + y*w] = raw_get_pixel_14to20(x, y);
@@ -2153,6 +2253,7 @@ static int hdr_interpolate()
     const double fullres_transition = 4;
     const double fullres_thr = 0.8;
     
+    #pragma omp parallel for
     for (int i = 0; i < (1<<20); i++)
     {
         double ev2 = log2(MAX(i/64.0 - black/64.0, 1));
@@ -2303,6 +2404,7 @@ static int hdr_interpolate()
         amaze_demosaic_RT(rawData, red, green, blue, 0, 0, w, h);
 
         /* undo green channel scaling and clamp the other channels */
+        #pragma omp parallel for
         for (int y = 0; y < h; y ++)
         {
             for (int x = 0; x < w; x ++)
@@ -2340,6 +2442,7 @@ static int hdr_interpolate()
         //~ printf("Grayscale...\n");
         /* convert to grayscale and de-squeeze for easier processing */
         uint32_t * gray = malloc(w * h * sizeof(gray[0]));
+        #pragma omp parallel for
         for (int y = 0; y < h; y ++)
             for (int x = 0; x < w; x ++)
                 gray[x + y*w] = green[squeezed[y]][x]/2 + red[squeezed[y]][x]/4 + blue[squeezed[y]][x]/4;
@@ -2389,6 +2492,7 @@ static int hdr_interpolate()
         int deep_shadow = 0;
         int not_shadow = 0;
         
+        #pragma omp parallel for schedule(dynamic, 16) reduction(+:semi_overexposed,not_overexposed,deep_shadow,not_shadow)
         for (int y = 5; y < h-5; y ++)
         {
             int s = (is_bright[y%4] == is_bright[(y+1)%4]) ? -1 : 1;    /* points to the closest row having different exposure */
@@ -2535,6 +2639,7 @@ static int hdr_interpolate()
         
         //~ printf("Actual interpolation...\n");
 
+        #pragma omp parallel for
         for (int y = 2; y < h-2; y ++)
         {
             uint32_t* native = BRIGHT_ROW ? bright : dark;
@@ -2553,26 +2658,23 @@ static int hdr_interpolate()
 
                     int dir = edge_direction[x + y*w];
                     
-                    int edge_interp(int dir)
+                    /* vary the interpolation direction and average the result (reduces aliasing) */
+                    /* (no nested function here, GCC cannot outline those into OpenMP threads) */
+                    int dirs[3] = { dir, MIN(dir+1, COUNT(edge_directions)-1), MAX(dir-1,0) };
+                    int pi[3];
+                    
+                    for (int i = 0; i < 3; i++)
                     {
-                        
-                        int dxa = edge_directions[dir].a.x;
-                        int dya = edge_directions[dir].a.y * s;
+                        int dxa = edge_directions[dirs[i]].a.x;
+                        int dya = edge_directions[dirs[i]].a.y * s;
                         int pa = COERCE((int)plane[squeezed[y+dya]][x+dxa], 0, 0xFFFFF);
-                        int dxb = edge_directions[dir].b.x;
-                        int dyb = edge_directions[dir].b.y * s;
+                        int dxb = edge_directions[dirs[i]].b.x;
+                        int dyb = edge_directions[dirs[i]].b.y * s;
                         int pb = COERCE((int)plane[squeezed[y+dyb]][x+dxb], 0, 0xFFFFF);
-                        int pi = (raw2ev[pa] * 2 + raw2ev[pb]) / 3;
-                        
-                        return pi;
+                        pi[i] = (raw2ev[pa] * 2 + raw2ev[pb]) / 3;
                     }
                     
-                    /* vary the interpolation direction and average the result (reduces aliasing) */
-                    int pi0 = edge_interp(dir);
-                    int pip = edge_interp(MIN(dir+1, COUNT(edge_directions)-1));
-                    int pim = edge_interp(MAX(dir-1,0));
-                    
-                    interp[x   + y * w] = ev2raw[(2*pi0+pip+pim)/4];
+                    interp[x   + y * w] = ev2raw[(2*pi[0]+pi[1]+pi[2])/4];
                     native[x   + y * w] = raw_get_pixel32(x, y);
                 }
                 x -= 2;
@@ -2598,6 +2700,7 @@ static int hdr_interpolate()
     else /* mean23 */
     {
         printf("Interpolation   : mean23\n");
+        #pragma omp parallel for
         for (int y = 2; y < h-2; y ++)
         {
             uint32_t* native = BRIGHT_ROW ? bright : dark;
@@ -2694,45 +2797,50 @@ static int hdr_interpolate()
     if (use_stripe_fix)
     {
         printf("Horizontal stripe fix...\n");
-        int* delta = malloc(w * sizeof(delta[0]));
 
         /* adjust dark lines to match the bright ones */
-        for (int y = raw_info.active_area.y1; y < raw_info.active_area.y2; y ++)
+        #pragma omp parallel
         {
-            /* apply a constant offset (estimated from unclipped areas) */
-            int delta_num = 0;
-            for (int x = raw_info.active_area.x1; x < raw_info.active_area.x2; x ++)
+            int* delta = malloc(w * sizeof(delta[0]));
+
+            #pragma omp for schedule(dynamic, 16)
+            for (int y = raw_info.active_area.y1; y < raw_info.active_area.y2; y ++)
             {
-                int b = bright[x + y*w];
-                int d = dark[x + y*w];
-                if (MAX(b,d) < white_darkened)
+                /* apply a constant offset (estimated from unclipped areas) */
+                int delta_num = 0;
+                for (int x = raw_info.active_area.x1; x < raw_info.active_area.x2; x ++)
                 {
-                    delta[delta_num++] = b - d;
+                    int b = bright[x + y*w];
+                    int d = dark[x + y*w];
+                    if (MAX(b,d) < white_darkened)
+                    {
+                        delta[delta_num++] = b - d;
+                    }
                 }
-            }
 
-            if (delta_num < 200)
-            {
-                //~ printf("%d: too few points (%d)\n", y, delta_num);
-                continue;
-            }
+                if (delta_num < 200)
+                {
+                    //~ printf("%d: too few points (%d)\n", y, delta_num);
+                    continue;
+                }
 
-            /* compute median difference */
-            int med_delta = median_int_wirth(delta, delta_num);
+                /* compute median difference */
+                int med_delta = median_int_wirth(delta, delta_num);
 
-            if (ABS(med_delta) > 200*16)
-            {
-                printf("%d: offset too large (%d)\n", y, med_delta);
-                continue;
-            }
+                if (ABS(med_delta) > 200*16)
+                {
+                    printf("%d: offset too large (%d)\n", y, med_delta);
+                    continue;
+                }
 
-            /* shift the dark lines */
-            for (int x = 0; x < w; x ++)
-            {
-                dark[x + y*w] = COERCE(dark[x + y*w] + med_delta, 0, 0xFFFFF);
+                /* shift the dark lines */
+                for (int x = 0; x < w; x ++)
+                {
+                    dark[x + y*w] = COERCE(dark[x + y*w] + med_delta, 0, 0xFFFFF);
+                }
             }
+            free(delta);
         }
-        free(delta);
     }
 
     /* reconstruct a full-resolution image (discard interpolated fields whenever possible) */
@@ -2740,6 +2848,7 @@ static int hdr_interpolate()
     if (use_fullres)
     {
         printf("Full-res reconstruction...\n");
+        #pragma omp parallel for
         for (int y = 0; y < h; y ++)
         {
             for (int x = 0; x < w; x ++)
@@ -2794,6 +2903,7 @@ static int hdr_interpolate()
     double max_ev = log2(white/64 - black/64);
     static double mix_curve[1<<20];
     
+    #pragma omp parallel for
     for (int i = 0; i < 1<<20; i++)
     {
         double ev = log2(MAX(i/64.0 - black/64.0, 1)) + corr_ev;
@@ -2824,6 +2934,7 @@ static int hdr_interpolate()
         if(system("octave --persist mix-curve.m"));
     }
     
+    #pragma omp parallel for
     for (int y = 0; y < h; y ++)
     {
         for (int x = 0; x < w; x ++)
@@ -2926,6 +3037,7 @@ static int hdr_interpolate()
         /* build the aliasing maps (where it's likely to get aliasing) */
         /* do this by comparing fullres and halfres images */
         /* if the difference is small, we'll prefer halfres for less noise, otherwise fullres for less aliasing */
+        #pragma omp parallel for
         for (int y = 0; y < h; y ++)
         {
             for (int x = 0; x < w; x ++)
@@ -2956,6 +3068,7 @@ static int hdr_interpolate()
         memcpy(alias_aux, alias_map, w * h * sizeof(uint16_t));
 
         printf("Filtering alias map...\n");
+        #pragma omp parallel for schedule(dynamic, 16)
         for (int y = 6; y < h-6; y ++)
         {
             for (int x = 6; x < w-6; x ++)
@@ -3006,6 +3119,7 @@ static int hdr_interpolate()
 
         printf("Smoothing alias map...\n");
         /* gaussian blur */
+        #pragma omp parallel for
         for (int y = 6; y < h-6; y ++)
         {
             for (int x = 6; x < w-6; x ++)
@@ -3064,6 +3178,7 @@ static int hdr_interpolate()
         }
 
         /* make it grayscale */
+        #pragma omp parallel for
         for (int y = 2; y < h-2; y += 2)
         {
             for (int x = 2; x < w-2; x += 2)
@@ -3098,6 +3213,7 @@ static int hdr_interpolate()
     overexposed = malloc(w * h * sizeof(uint16_t));
     memset(overexposed, 0, w * h * sizeof(uint16_t));
 
+    #pragma omp parallel for
     for (int y = 0; y < h; y ++)
     {
         for (int x = 0; x < w; x ++)
@@ -3110,6 +3226,7 @@ static int hdr_interpolate()
     uint16_t* over_aux = malloc(w * h * sizeof(uint16_t));
     memcpy(over_aux, overexposed, w * h * sizeof(uint16_t));
 
+    #pragma omp parallel for
     for (int y = 3; y < h-3; y ++)
     {
         for (int x = 3; x < w-3; x ++)
@@ -3138,6 +3255,7 @@ static int hdr_interpolate()
     double ideal_noise_std = noise_std[0];
 
     printf("Final blending...\n");
+    #pragma omp parallel for
     for (int y = 0; y < h; y ++)
     {
         for (int x = 0; x < w; x ++)
@@ -3223,6 +3341,7 @@ static int hdr_interpolate()
     raw_info.black_level /= 16;
     raw_info.white_level /= 16;
 
+    /* stays serial, the dithering noise comes from a single random sequence */
     for (int y = 0; y < h; y++)
         for (int x = 0; x < w; x++)
             raw_set_pixel_20to16_rand(x, y, raw_buffer_32[x + y*w]);
@@ -3308,6 +3427,7 @@ static int hdr_interpolate()
             if(system("octave --persist soft-film.m"));
         }
 
+        /* serial as well, soft_film_bakedwb adds dithering noise */
         for (int y = 0; y < h; y++)
         {
             for (int x = 0; x < w; x++)
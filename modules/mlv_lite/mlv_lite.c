@@ -4220,6 +4220,14 @@ unsigned int raw_rec_update_preview(unsigned int ctx)
     raw_set_preview_rect(skip_x, skip_y, res_x, res_y, 1);
     raw_force_aspect_ratio(0, 0);
 
+    /* when the recorder is busy, let the preview pick a quarter resolution quality from the CPU time
+     * it takes on this camera, within half of a frame interval; it doesn't sleep, as we hold settings_sem */
+    int fps = fps_get_current_x1000();
+    if (need_for_speed && fps)
+    {
+        raw_preview_set_budget(500000000 / fps);
+    }
+
     /* when recording, preview both full-size buffers,
      * to make sure it's not recording every other frame */
     static int fi = 0; fi = !fi;
@@ -4229,7 +4237,7 @@ unsigned int raw_rec_update_preview(unsigned int ctx)
         -1,
         -1,
         (need_for_speed && !get_halfshutter_pressed())
-            ? RAW_PREVIEW_GRAY_ULTRA_FAST
+            ? RAW_PREVIEW_ADAPTIVE
             : RAW_PREVIEW_COLOR_HALFRES
     );
 
@@ -42,6 +42,7 @@
 #include "../ime_base/ime_base.h"
 #include "../trace/trace.h"
 #include "../mlv_rec/mlv.h"
+#include "../mlv_rec/mlv_index.h"
 #include "../file_man/file_man.h"
 #include "../lv_rec/lv_rec.h"
 #include "../raw_twk/raw_twk.h"
@@ -111,15 +112,6 @@ static uint32_t mlv_play_info = 1;
 static uint32_t mlv_play_timer_stop = 1;
 static uint32_t mlv_play_frames_skipped = 0;
 
-/* this structure is used to build the mlv_xref_t table */
-typedef struct 
-{
-    uint64_t    frameTime;
-    uint64_t    frameOffset;
-    uint16_t    fileNumber;
-    uint16_t    frameType;
-} frame_xref_t;
-
 typedef struct
 {
     char fullPath[MAX_PATH];
@@ -898,343 +890,61 @@ static void mlv_play_osd_task(void *priv)
 }
 
 
-static void mlv_play_xref_resize(frame_xref_t **table, uint32_t entries, uint32_t *allocated)
+static int mlv_play_index_progress(uint32_t chunk, uint32_t chunk_count, uint32_t pct)
 {
-    /* make sure there is no crappy pointer before using */
-    if(*allocated == 0)
+    if(pct == 0)
     {
-        *table = NULL;
+        mlv_play_progressbar(0, "");
     }
-    
-    /* only resize if the buffer is too small */
-    if(entries * sizeof(frame_xref_t) > *allocated)
+    else
     {
-        *allocated += (entries + 1) * sizeof(frame_xref_t);
-        *table = realloc(*table, *allocated);
+        char msg[100];
+
+        snprintf(msg, sizeof(msg), "Building index... (%d/%d)", chunk + 1, chunk_count);
+        mlv_play_progressbar(pct, msg);
     }
-}
 
-static void mlv_play_xref_sort(frame_xref_t *table, uint32_t entries)
-{
-    if (!entries) return;
-    
-    uint32_t n = entries;
-    do
-    {
-        uint32_t newn = 1;
-        for (uint32_t i = 0; i < n-1; ++i)
-        {
-            if (table[i].frameTime > table[i+1].frameTime)
-            {
-                frame_xref_t tmp = table[i+1];
-                table[i+1] = table[i];
-                table[i] = tmp;
-                newn = i + 1;
-            }
-        }
-        n = newn;
-    } while (n > 1);
+    return ml_shutdown_requested;
 }
 
-static mlv_xref_hdr_t *mlv_play_load_index(char *base_filename)
+static mlv_index_t *mlv_play_get_index(char *filename, FILE **chunk_files, uint32_t chunk_count)
 {
-    mlv_xref_hdr_t *block_hdr = NULL;
-    char filename[128];
-    FILE *in_file = NULL;
+    mlv_index_t *index = mlv_index_load(filename);
 
-    strncpy(filename, base_filename, sizeof(filename));
-    strcpy(&filename[strlen(filename) - 3], "IDX");
-    
-    in_file = FIO_OpenFile(filename, O_RDONLY | O_SYNC);
-    
-    if (!in_file)
-    {
-        return NULL;
-    }
-    
-    TASK_LOOP
+    if(!index)
     {
-        mlv_hdr_t buf;
-        int64_t position = 0;
-        
-        position = FIO_SeekSkipFile(in_file, 0, SEEK_CUR);
-        
-        if(FIO_ReadFile(in_file, &buf, sizeof(mlv_hdr_t)) != sizeof(mlv_hdr_t))
-        {
-            break;
-        }
-        
-        /* jump back to the beginning of the block just read */
-        FIO_SeekSkipFile(in_file, position, SEEK_SET);
-
-        /* we should check the MLVI header for matching UID value to make sure its the right index... */
-        if(!memcmp(buf.blockType, "XREF", 4))
-        {
-            block_hdr = fio_malloc(buf.blockSize);
-
-            if(FIO_ReadFile(in_file, block_hdr, buf.blockSize) != (int32_t)buf.blockSize)
-            {
-                free(block_hdr);
-                block_hdr = NULL;
-            }
-        }
-        else
-        {
-            FIO_SeekSkipFile(in_file, position + buf.blockSize, SEEK_SET);
-        }
-        
-        /* we are at the same position as before, so abort */
-        if(position == FIO_SeekSkipFile(in_file, 0, SEEK_CUR))
+        index = mlv_index_create();
+        if(!index)
         {
-            break;
+            return NULL;
         }
     }
-    
-    FIO_CloseFile(in_file);
-    
-    return block_hdr;
-}
 
-static void mlv_play_save_index(char *base_filename, mlv_file_hdr_t *ref_file_hdr, int fileCount, frame_xref_t *index, int entries)
-{
-    char filename[128];
-    FILE *out_file = NULL;
+    /* only scans what is missing, so files still being written or with chunks added later are cheap to update */
+    bmp_printf(FONT_LARGE, 30, 100, "Preparing:", filename);
+    bmp_printf(FONT_MED, 40, 100 + font_large.height + 1, filename);
 
-    strncpy(filename, base_filename, sizeof(filename));
-    strcpy(&filename[strlen(filename) - 3], "IDX");
-    
-    out_file = FIO_CreateFile(filename);
-    
-    if (!out_file)
-    {
-        return;
-    }
-    
-    /* first write MLVI header */
-    mlv_file_hdr_t file_hdr = *ref_file_hdr;
-    
-    /* update fields */
-    file_hdr.blockSize = sizeof(mlv_file_hdr_t);
-    file_hdr.videoFrameCount = 0;
-    file_hdr.audioFrameCount = 0;
-    file_hdr.fileNum = fileCount + 1;
-    
-    FIO_WriteFile(out_file, &file_hdr, sizeof(mlv_file_hdr_t));
+    int ret = mlv_index_update(index, chunk_files, chunk_count, &mlv_play_index_progress);
 
-    /* now write XREF block */
-    mlv_xref_hdr_t hdr;
-    
-    memset(&hdr, 0x00, sizeof(mlv_xref_hdr_t));
-    memcpy(hdr.blockType, "XREF", 4);
-    hdr.blockSize = sizeof(mlv_xref_hdr_t) + entries * sizeof(mlv_xref_t);
-    hdr.entryCount = entries;
-    
-    if(FIO_WriteFile(out_file, &hdr, sizeof(mlv_xref_hdr_t)) != sizeof(mlv_xref_hdr_t))
-    {
-        FIO_CloseFile(out_file);
-        return;
-    }
-    
-    uint32_t last_pct = 0;
-    mlv_play_progressbar(0, "");
-    
-    /* allocate at least 512 byte */
-    uint32_t entry_count = (512 / sizeof(mlv_xref_t)) + 1;
-    mlv_xref_t *buffer = malloc(sizeof(mlv_xref_t) * entry_count);
-    
-    if(!buffer)
+    if(ret == MLV_INDEX_UPDATED)
     {
-        FIO_CloseFile(out_file);
-        return;
-    }
-    
-    /* and then the single entries */
-    for(int entry = 0; entry < entries; entry++)
-    {
-        uint32_t buffer_pos = entry % entry_count;
-        mlv_xref_t *field = &buffer[buffer_pos];
-        uint32_t pct = (entry * 100) / entries;
-        
-        if(last_pct != pct)
-        {
-            char msg[36];
-            
-            snprintf(msg, sizeof(msg), "Saving index (%d entries)...", entries);
-            mlv_play_progressbar(pct, msg);
-            last_pct = pct;
-        }
-        memset(field, 0x00, sizeof(mlv_xref_t));
-        
-        field->frameOffset = index[entry].frameOffset;
-        field->fileNumber = index[entry].fileNumber;
-        field->frameType = index[entry].frameType;
-        
-        if((buffer_pos + 1) == entry_count || ((entry + 1) == entries))
-        {
-            int32_t write_size = (buffer_pos + 1) * sizeof(mlv_xref_t);
-            
-            if(FIO_WriteFile(out_file, buffer, write_size) != write_size)
-            {
-                free(buffer);
-                FIO_CloseFile(out_file);
-                return;
-            }
-        }
+        mlv_play_progressbar(0, "");
+        mlv_play_progressbar(100, "Saving index...");
+        mlv_index_save(index, filename);
     }
-    
-    free(buffer);
-    FIO_CloseFile(out_file);
-}
-
-static void mlv_play_build_index(char *filename, FILE **chunk_files, uint32_t chunk_count)
-{
-    frame_xref_t *frame_xref_table = NULL;
-    uint32_t frame_xref_entries = 0;
-    uint32_t frame_xref_allocated = 0;
-    mlv_file_hdr_t main_header;
-    
-    for(uint32_t chunk = 0; chunk < chunk_count; chunk++)
+    else if(ret != MLV_INDEX_OK)
     {
-        uint32_t last_pct = 0;
-        int64_t size = 0;
-        int64_t position = 0;
-        
-        size = FIO_SeekSkipFile(chunk_files[chunk], 0, SEEK_END);
-        FIO_SeekSkipFile(chunk_files[chunk], 0, SEEK_SET);
-        
-        mlv_play_progressbar(0, "");
-        
-        while(1)
+        if(ret != MLV_INDEX_CANCELLED)
         {
-            if(ml_shutdown_requested)
-            {
-                break;
-            }
-            
-            mlv_hdr_t buf;
-            uint64_t timestamp = 0;
-            
-            uint32_t pct = ((position / 10) / (size / 1000));
-            
-            if(last_pct != pct)
-            {
-                char msg[100];
-                
-                snprintf(msg, sizeof(msg), "Building index... (%d/%d)", chunk + 1, chunk_count);
-                mlv_play_progressbar(pct, msg);
-                last_pct = pct;
-            }
-            
-            int read = FIO_ReadFile(chunk_files[chunk], &buf, sizeof(mlv_hdr_t));
-            
-            if(read != sizeof(mlv_hdr_t))
-            {
-                if(read <= 0)
-                {
-                    break;
-                }
-                else
-                {
-                    bmp_printf(FONT_MED, 30, 190, "File #%d ends prematurely, %d bytes read", chunk, read);
-                    beep();
-                    msleep(2000);
-                    return;
-                }
-            }
-            
-            /* unexpected block header size? */
-            if(buf.blockSize < sizeof(mlv_hdr_t) || buf.blockSize > 50 * 1024 * 1024)
-            {
-                bmp_printf(FONT_MED, 30, 190, "Invalid header size: %d bytes at 0x%08X", buf.blockSize, position);
-                beep();
-                msleep(2000);
-                return;
-            }
-
-            /* file header */
-            if(!memcmp(buf.blockType, "MLVI", 4))
-            {
-                mlv_file_hdr_t file_hdr;
-                uint32_t hdr_size = MIN(sizeof(mlv_file_hdr_t), buf.blockSize);
-                
-                FIO_SeekSkipFile(chunk_files[chunk], position, SEEK_SET);
-                
-                /* read the whole header block, but limit size to either our local type size or the written block size */
-                if(FIO_ReadFile(chunk_files[chunk], &file_hdr, hdr_size) != (int32_t)hdr_size)
-                {
-                    bmp_printf(FONT_MED, 30, 190, "File ends prematurely during MLVI");
-                    beep();
-                    msleep(2000);
-                    return;
-                }
-
-                /* is this the first file? */
-                if(file_hdr.fileNum == 0)
-                {
-                    memcpy(&main_header, &file_hdr, sizeof(mlv_file_hdr_t));
-                }
-                else
-                {
-                    /* no, its another chunk */
-                    if(main_header.fileGuid != file_hdr.fileGuid)
-                    {
-                        bmp_printf(FONT_MED, 30, 190, "Error: GUID within the file chunks mismatch!");
-                        beep();
-                        msleep(2000);
-                        return;
-                    }
-                }
-                
-                /* emulate timestamp zero (will overwrite version string) */
-                timestamp = 0;
-            }
-            else
-            {
-                /* all other blocks have a timestamp */
-                timestamp = buf.timestamp;
-            }
-            
-            /* dont index NULL blocks */
-            if(memcmp(buf.blockType, "NULL", 4))
-            {
-                mlv_play_xref_resize(&frame_xref_table, frame_xref_entries + 1, &frame_xref_allocated);
-                
-                /* add xref data */
-                frame_xref_table[frame_xref_entries].frameTime = timestamp;
-                frame_xref_table[frame_xref_entries].frameOffset = position;
-                frame_xref_table[frame_xref_entries].fileNumber = chunk;
-                frame_xref_table[frame_xref_entries].frameType =
-                    !memcmp(buf.blockType, "VIDF", 4) ? MLV_FRAME_VIDF :
-                    !memcmp(buf.blockType, "AUDF", 4) ? MLV_FRAME_AUDF :
-                    MLV_FRAME_UNSPECIFIED;
-                
-                frame_xref_entries++;
-            }
-            
-            position += buf.blockSize;
-            FIO_SeekSkipFile(chunk_files[chunk], position, SEEK_SET);
+            bmp_printf(FONT_MED, 30, 190, "Failed to index file (%d)", ret);
+            beep();
+            msleep(2000);
         }
+        mlv_index_free(index);
+        return NULL;
     }
-    
-    mlv_play_xref_sort(frame_xref_table, frame_xref_entries);
-    mlv_play_save_index(filename, &main_header, chunk_count, frame_xref_table, frame_xref_entries);
-}
 
-static mlv_xref_hdr_t *mlv_play_get_index(char *filename, FILE **chunk_files, uint32_t chunk_count)
-{
-    mlv_xref_hdr_t *table = NULL;
-    
-    table = mlv_play_load_index(filename);
-    if(table)
-    {
-        return table;
-    }
-    
-    bmp_printf(FONT_LARGE, 30, 100, "Preparing:", filename);
-    bmp_printf(FONT_MED, 40, 100 + font_large.height + 1, filename);
-    mlv_play_build_index(filename, chunk_files, chunk_count);
-    
-    return mlv_play_load_index(filename);
+    return index;
 }
 
 static unsigned int mlv_play_is_raw(FILE *f)
@@ -1704,7 +1414,7 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
     uint32_t fps_timer_started = 0;
     uint32_t frame_size = 0;
     uint32_t frame_count = 0;
-    mlv_xref_hdr_t *block_xref = NULL;
+    mlv_index_t *block_xref = NULL;
     mlv_lens_hdr_t lens_block = {0};
     mlv_rawi_hdr_t rawi_block = {0};
     mlv_wavi_hdr_t wavi_block = {0};
@@ -1731,8 +1441,6 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
         return;
     }
 
-    mlv_xref_t *xrefs = (mlv_xref_t *)&(((uint8_t*)block_xref)[sizeof(mlv_xref_hdr_t)]);
-    
     /* index building would print on screen */
     mlv_play_clear_screen();
     
@@ -1740,7 +1448,7 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
     while(1)
     {
         /* after playback is finished, return to beginning and put into pause */
-        if (block_xref_pos == block_xref->entryCount)
+        if (block_xref_pos == mlv_index_count(block_xref))
         {
             /* reset counter */
             block_xref_pos = 0;
@@ -1767,7 +1475,7 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
         /* if in exact playback and this is a skippable VIDF frame */
         if(mlv_play_exact_fps)
         {
-            if (xrefs[block_xref_pos].frameType == MLV_FRAME_VIDF)
+            if (mlv_index_entry(block_xref, block_xref_pos)->frameType == MLV_FRAME_VIDF)
             {
                 uint32_t frames_to_skip = 0;
                 msg_queue_count(mlv_play_queue_fps, &frames_to_skip);
@@ -1791,8 +1499,9 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
         }
 
         /* get the file and position of the next block */
-        uint32_t in_file_num = xrefs[block_xref_pos].fileNumber;
-        int64_t position = xrefs[block_xref_pos].frameOffset;
+        const mlv_index_entry_t *entry = mlv_index_entry(block_xref, block_xref_pos);
+        uint32_t in_file_num = entry->fileNumber;
+        int64_t position = entry->offset;
         
         /* select file and seek to the right position */
         FILE *in_file = chunk_files[in_file_num];
@@ -2117,7 +1826,7 @@ static void mlv_play_mlv(char *filename, FILE **chunk_files, uint32_t chunk_coun
     {
         mlv_play_stop_fps_timer();
     }
-    free(block_xref);
+    mlv_index_free(block_xref);
     
     /* free decompression stuff if needed */
     if(mlv_play_decomp_buf)
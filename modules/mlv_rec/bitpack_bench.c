@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  raw bit packing kernel benchmark.
+
+  unpacks, packs (camera and DNG format) and converts a synthetic frame of random pixels
+  over and over, for every bit depth and every instruction set the CPU supports, and prints
+  the throughput in GB/s of unpacked 16 bit data. the checksum has to be the same for all
+  instruction sets of a bit depth, else a kernel is broken.
+
+  bitpack_bench [-b bpp] [-r repeats] [-s WxH]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "raw_proc/bitpack.h"
+
+enum kernel
+{
+    KERNEL_UNPACK = 0,
+    KERNEL_PACK,
+    KERNEL_PACK_BE,
+    KERNEL_CONVERT,
+    KERNEL_COUNT
+};
+
+static const char *kernel_names[KERNEL_COUNT] = { "unpack", "pack", "pack_be", "convert" };
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t checksum_update(uint32_t checksum, const uint8_t *data, uint32_t size)
+{
+    for(uint32_t pos = 0; pos < size; pos++)
+    {
+        checksum = (checksum ^ data[pos]) * 16777619;
+    }
+    return checksum;
+}
+
+/* the depth 'convert' targets, the next common one below or 14 bit for the lowest */
+static uint32_t convert_depth(uint32_t bpp)
+{
+    return bpp > 10 ? bpp - 2 : 14;
+}
+
+static void bench_kernel(enum kernel kernel, uint32_t bpp, uint32_t pixels, int repeats, uint16_t *unpacked, uint16_t *packed, uint16_t *output)
+{
+    uint32_t out_size = 0;
+    double start = get_time();
+
+    for(int run = 0; run < repeats; run++)
+    {
+        switch(kernel)
+        {
+            case KERNEL_UNPACK:
+                bitpack_unpack(packed, output, pixels, bpp);
+                out_size = pixels * 2;
+                break;
+            case KERNEL_PACK:
+                bitpack_pack(unpacked, output, pixels, bpp);
+                out_size = (pixels * bpp + 15) / 16 * 2;
+                break;
+            case KERNEL_PACK_BE:
+                bitpack_pack_be(unpacked, (uint8_t *)output, pixels, bpp);
+                out_size = (pixels * bpp + 7) / 8;
+                break;
+            default:
+                bitpack_convert(packed, bpp, output, convert_depth(bpp), pixels);
+                out_size = (pixels * convert_depth(bpp) + 15) / 16 * 2;
+                break;
+        }
+    }
+
+    double duration = get_time() - start;
+
+    printf("  %-8s %6.2f GB/s  %08X\n", kernel_names[kernel], (double)pixels * 2 * repeats / duration / 1000000000.0, checksum_update(2166136261U, (uint8_t *)output, out_size));
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats = 100;
+    int width = 1920;
+    int height = 1080;
+    uint32_t depths[] = { 10, 12, 14 };
+    uint32_t depth_count = 3;
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-b") && pos + 1 < argc)
+        {
+            depths[0] = atoi(argv[++pos]);
+            depth_count = 1;
+        }
+        else if(!strcmp(argv[pos], "-r") && pos + 1 < argc)
+        {
+            repeats = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-s") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-b bpp] [-r repeats] [-s WxH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(repeats < 1 || width < 1 || height < 1 || depths[0] < 1 || depths[0] > 16)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    uint32_t pixels = width * height;
+    uint16_t *unpacked = malloc(pixels * sizeof(uint16_t));
+    uint16_t *packed = malloc(pixels * sizeof(uint16_t));
+    uint16_t *output = malloc(pixels * sizeof(uint16_t));
+
+    if(!unpacked || !packed || !output)
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        return 1;
+    }
+
+    enum bitpack_isa best = bitpack_set_isa(BITPACK_AVX2);
+
+    printf("Frame:      %dx%d, %d runs, best kernels: %s\n", width, height, repeats, bitpack_isa_name(best));
+
+    for(uint32_t depth = 0; depth < depth_count; depth++)
+    {
+        uint32_t bpp = depths[depth];
+
+        srand(bpp);
+        for(uint32_t pixel = 0; pixel < pixels; pixel++)
+        {
+            unpacked[pixel] = (uint16_t)(rand() & ((1 << bpp) - 1));
+        }
+
+        for(int isa = BITPACK_SCALAR; isa <= (int)best; isa++)
+        {
+            bitpack_set_isa((enum bitpack_isa)isa);
+
+            /* the source for unpack and convert */
+            bitpack_pack(unpacked, packed, pixels, bpp);
+
+            printf("%d bit, %s:\n", bpp, bitpack_isa_name((enum bitpack_isa)isa));
+            for(int kernel = 0; kernel < KERNEL_COUNT; kernel++)
+            {
+                bench_kernel((enum kernel)kernel, bpp, pixels, repeats, unpacked, packed, output);
+            }
+        }
+    }
+
+    free(unpacked);
+    free(packed);
+    free(output);
+
+    return 0;
+}
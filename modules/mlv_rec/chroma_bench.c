@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  chroma smoothing and median kernel benchmark.
+
+  smooths a synthetic 14 bit bayer frame (color gradients with noise) with every kernel size
+  (2x2, 3x3, 5x5) over and over, and computes the medians of 5, 9 and 25 random values the
+  kernels use, for every instruction set the CPU supports. prints the throughput in Mpix/s
+  (medians: million windows per second). the checksum has to be the same for all instruction
+  sets of a kernel, else a kernel is broken.
+
+  chroma_bench [-k 2|3|5] [-r repeats] [-s WxH]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "raw_proc/pixel_proc.h"
+#include "raw_proc/median.h"
+
+#define BENCH_BLACK     2048
+#define BENCH_WHITE     15000
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t checksum_update(uint32_t checksum, const uint8_t *data, uint32_t size)
+{
+    for(uint32_t pos = 0; pos < size; pos++)
+    {
+        checksum = (checksum ^ data[pos]) * 16777619;
+    }
+    return checksum;
+}
+
+/* RGGB frame with a different gradient per channel, so red and blue really differ from green, plus noise */
+static void synthetic_frame(uint16_t *frame, int width, int height)
+{
+    srand(1);
+    for(int y = 0; y < height; y++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            int color = (y & 1) + (x & 1);
+            int level = color == 0 ? x * 8000 / width : color == 2 ? y * 8000 / height : (x + y) * 4000 / (width + height) + 1000;
+            int noise = rand() % 129 - 64;
+            int value = BENCH_BLACK + 16 + level + noise;
+
+            frame[x + y * width] = (uint16_t)(value < 0 ? 0 : value > 16383 ? 16383 : value);
+        }
+    }
+}
+
+static void bench_chroma(int method, int width, int height, int repeats, const uint16_t *frame, uint16_t *output)
+{
+    uint32_t pixels = width * height;
+    double duration = 0;
+
+    for(int run = 0; run < repeats; run++)
+    {
+        memcpy(output, frame, pixels * sizeof(uint16_t));
+
+        double start = get_time();
+        chroma_smooth(output, width, height, BENCH_BLACK, BENCH_WHITE, method);
+        duration += get_time() - start;
+    }
+
+    printf("  cs%dx%d    %8.2f Mpix/s  %08X\n", method, method, (double)pixels * repeats / duration / 1000000.0, checksum_update(2166136261U, (uint8_t *)output, pixels * sizeof(uint16_t)));
+}
+
+static void bench_median(int size, int count, int repeats, const int32_t **rows, int32_t *result)
+{
+    double start = get_time();
+
+    for(int run = 0; run < repeats; run++)
+    {
+        median_rows(rows, size, count, result);
+    }
+
+    double duration = get_time() - start;
+
+    printf("  median%-3d %8.2f Mwin/s  %08X\n", size, (double)count * repeats / duration / 1000000.0, checksum_update(2166136261U, (uint8_t *)result, count * sizeof(int32_t)));
+}
+
+int main(int argc, char *argv[])
+{
+    int repeats = 10;
+    int width = 1920;
+    int height = 1080;
+    int methods[] = { 2, 3, 5 };
+    int method_count = 3;
+    int median_sizes[] = { 5, 9, 25 };
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-k") && pos + 1 < argc)
+        {
+            methods[0] = atoi(argv[++pos]);
+            method_count = 1;
+        }
+        else if(!strcmp(argv[pos], "-r") && pos + 1 < argc)
+        {
+            repeats = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-s") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-k 2|3|5] [-r repeats] [-s WxH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(repeats < 1 || width < 16 || height < 16 || (methods[0] != 2 && methods[0] != 3 && methods[0] != 5))
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    uint32_t pixels = width * height;
+    uint16_t *frame = malloc(pixels * sizeof(uint16_t));
+    uint16_t *output = malloc(pixels * sizeof(uint16_t));
+
+    /* median input: 25 rows of one frame row of random values, EV differences are in this range */
+    int32_t *values = malloc(25 * width * sizeof(int32_t));
+    int32_t *result = malloc(width * sizeof(int32_t));
+    const int32_t *rows[25];
+
+    if(!frame || !output || !values || !result)
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        return 1;
+    }
+
+    synthetic_frame(frame, width, height);
+    for(int pos = 0; pos < 25 * width; pos++)
+    {
+        values[pos] = rand() % (1 << 20) - (1 << 19);
+    }
+    for(int row = 0; row < 25; row++)
+    {
+        rows[row] = &values[row * width];
+    }
+
+    enum median_isa best = median_set_isa(MEDIAN_AVX2);
+
+    printf("Frame:      %dx%d, %d runs, best kernels: %s\n", width, height, repeats, median_isa_name(best));
+
+    for(int isa = MEDIAN_SCALAR; isa <= (int)best; isa++)
+    {
+        median_set_isa((enum median_isa)isa);
+
+        printf("%s:\n", median_isa_name((enum median_isa)isa));
+        for(int method = 0; method < method_count; method++)
+        {
+            bench_chroma(methods[method], width, height, repeats, frame, output);
+        }
+
+        /* the medians the kernels take per output pixel: 5 (2x2), 9 (3x3) and 25 (5x5) values */
+        for(int size = 0; size < 3; size++)
+        {
+            bench_median(median_sizes[size], width, repeats * height, rows, result);
+        }
+    }
+
+    free(frame);
+    free(output);
+    free(values);
+    free(result);
+
+    return 0;
+}
@@ -38,6 +38,7 @@
 #include "../raw_proc/stripes.h"
 #include "../raw_proc/patternnoise.h"
 #include "../raw_proc/histogram.h"
+#include "../raw_proc/bitpack.h"
 
 #define IFD0_COUNT 42
 #define EXIF_IFD_COUNT 11
@@ -48,6 +49,7 @@
 #define RATIONAL_ENTRY2(a,b,c,d) 1, add_rational(a, b, c, d)
 #define ARRAY_ENTRY(a,b,c,d) d, add_array(a, b, c, d)
 #define HEADER_SIZE 1536
+#define DNG_BAND_SIZE (256 * 1024) // image data is packed and written in bands of this size, so they stay in cache
 #define COUNT(x) ((int)(sizeof(x)/sizeof((x)[0])))
 
 #define SOFTWARE_NAME "MLV_DUMP CDNG"
@@ -336,6 +338,27 @@ static void get_white_balance(mlv_wbal_hdr_t wbal_hdr, int32_t *wbal, camera_id_
     }
 }
 
+void dng_get_wb_multipliers(mlv_idnt_hdr_t * idnt_hdr, mlv_wbal_hdr_t * wbal_hdr, double multipliers[3])
+{
+    mlv_wbal_hdr_t wbal_info = *wbal_hdr;
+    int32_t wbal[6];
+
+    /* no WBAL block or auto WB without a temperature */
+    if((wbal_info.wb_mode == WB_AUTO || wbal_info.wb_mode == WB_KELVIN) && !wbal_info.kelvin)
+    {
+        wbal_info.kelvin = 5500;
+    }
+
+    get_white_balance(wbal_info, wbal, &camera_id[camera_id_get_current_cam(idnt_hdr->cameraModel)]);
+
+    /* the inverse of AsShotNeutral, unknown cameras have no color matrix to get it from */
+    for (int c = 0; c < 3; c++)
+    {
+        double multiplier = wbal[2 * c] ? (double)wbal[2 * c + 1] / wbal[2 * c] : 0;
+        multipliers[c] = (multiplier > 0 && multiplier < 100) ? multiplier : 1;
+    }
+}
+
 /*****************************************************************************************************/
 
 
@@ -720,27 +743,7 @@ static void dng_fill_header(struct frame_info * frame_info, struct dng_data * dn
 */
 void dng_unpack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, size_t max_size, uint32_t bpp)
 {
-    uint32_t pixel_end = (uint32_t)(max_size / 2);
-    uint32_t mask = (1 << bpp) - 1;
-
-    uint16_t *packed_bits = input_buffer;
-    uint16_t *unpacked_bits = output_buffer;
-
-    for (uint32_t pixel_index = 0; pixel_index < pixel_end; pixel_index++)
-    {
-        uint32_t bits_offset = pixel_index * bpp;
-        uint32_t bits_address = bits_offset / 16;
-        uint32_t bits_shift = bits_offset % 16;
-
-        /* fetch two 16 bit words into a 32 bit register and correct it plus shift it as needed.
-        after the 32 bit fetch, the two 16 bit words will be swapped, so use a ROR to align them correctly.
-        ROR by 16 to swap 16 bit words plus the bits needed to put the needed pixel bits to right position */
-        uint32_t rotate_value = 16 + ((32 - bpp) - bits_shift);
-        uint32_t uncorrected_data = *((uint32_t *)&packed_bits[bits_address]);
-        uint32_t data = ROR32(uncorrected_data, rotate_value);
-
-        unpacked_bits[pixel_index] = (uint16_t)(data & mask);
-    }
+    bitpack_unpack(input_buffer, output_buffer, (uint32_t)(max_size / 2), bpp);
 }
 
 /* pack bits to 16 bit little endian and convert to big endian (raw payload DNG spec)
@@ -750,60 +753,113 @@ void dng_unpack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, si
    bpp - raw data bits per pixel 
 */
 void dng_pack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, size_t max_size, uint32_t bpp)
+{
+    bitpack_pack_be(input_buffer, (uint8_t *)output_buffer, (uint32_t)(max_size / 2), bpp);
+}
+
+/* changes endianness of the 16 bit values while copying them
+   DNG spec: 10/12/14bit raw should be big endian, 8/16/32bit raw can be little endian
+   input_buffer - pointer to the source buffer
+   output_buffer - pointer to the destination buffer
+   max_size - the size of the buffer in bytes
+*/
+static void dng_reverse_byte_order(const uint16_t * input_buffer, uint16_t * output_buffer, size_t max_size)
 {
     uint32_t pixel_end = (uint32_t)(max_size / 2);
-    uint32_t bits_free = 16 - bpp;
 
-    uint16_t *unpacked_bits = input_buffer;
-    uint16_t *packed_bits = output_buffer;
+    for (uint32_t pixel_index = 0; pixel_index < pixel_end; pixel_index++)
+    {
+        output_buffer[pixel_index] = ROL16(input_buffer[pixel_index], 8);
+    }
+}
+
+/* write the image data in bands of DNG_BAND_SIZE bytes, packed or byte swapped right before they get written.
+   that way the data stays in cache and no frame sized buffer is needed for the converted image
+   dngf - the DNG file, NULL to convert into 'memory' instead
+   memory - destination when there is no file, 'band' is not used then
+   image - unpacked 16 bit pixels when packing, 16 bit words to byte swap otherwise
+   size - the size in bytes of 'image'
+   bpp - bits per pixel to pack, 0 to only swap the byte order
+   band - buffer of DNG_BAND_SIZE bytes
+*/
+static int dng_write_bands(FILE * dngf, uint8_t * memory, const uint16_t * image, size_t size, uint32_t bpp, uint8_t * band)
+{
+    /* 8 pixels take 'bpp' bytes when packed, so every band ends on a word boundary */
+    size_t band_input = bpp ? (DNG_BAND_SIZE / bpp) * 8 * sizeof(uint16_t) : DNG_BAND_SIZE;
 
-    packed_bits[0] = unpacked_bits[0] << bits_free;
-    for (uint32_t pixel_index = 1; pixel_index < pixel_end; pixel_index++)
+    for (size_t offset = 0; offset < size; offset += band_input)
     {
-        uint32_t bits_offset = (pixel_index * bits_free) % 16;
-        uint32_t bits_to_rol = bits_free + bits_offset + (bits_offset > 0) * 16;
-
-        /* increment pointer by two bytes but fetch 32 bit words from input and outbut buffers.
-        after the 32 bit fetch, the two 16 bit words will be swapped, so use a ROL by 16 to swap
-        16 bit words plus shift to the left to put the needed pixel bits to right position.
-        mask/zero high 16 bits of 32 bit word of packed buffer and do logical OR to ROLed unpacked one.
-        make current packed 16 bit word big endian to satisfy DNG spec */
-        uint32_t data = ROL32((uint32_t)unpacked_bits[pixel_index], bits_to_rol);
-        *(uint32_t *)packed_bits = (*(uint32_t *)packed_bits & 0x0000FFFF) | data;
-
-        if(bits_offset > 0 && bits_offset <= bpp)
+        size_t input_size = MIN(band_input, size - offset);
+        const uint16_t * input = &image[offset / 2];
+        uint8_t * output = dngf ? band : memory;
+        size_t output_size = input_size;
+
+        if (bpp)
         {
-            *(uint16_t *)packed_bits = ROL16(*(uint16_t *)packed_bits, 8);
-            packed_bits++;
+            dng_pack_image_bits((uint16_t *)input, (uint16_t *)output, input_size, bpp);
+            output_size = (input_size / 2 * bpp + 7) / 8;
+        }
+        else
+        {
+            dng_reverse_byte_order(input, (uint16_t *)output, input_size);
+        }
+
+        if (!dngf)
+        {
+            memory += output_size;
+        }
+        else if (fwrite(band, output_size, 1, dngf) != 1)
+        {
+            return 0;
         }
     }
+
+    return 1;
 }
 
-/* changes endianness of the 16 bit buffer values
-   DNG spec: 10/12/14bit raw should be big endian, 8/16/32bit raw can be little endian
-   input_buffer - pointer to the buffer
+/* returns non-zero if any raw processing is enabled and the frame has to be unpacked for it */
+static int dng_needs_processing(struct frame_info * frame_info)
+{
+    return frame_info->vertical_stripes || frame_info->pattern_noise || frame_info->focus_pixels ||
+           frame_info->bad_pixels || frame_info->chroma_smooth || frame_info->deflicker_target;
+}
+
+/* raw processing may leave values out of range, e.g. negative ones that wrapped around.
+   clip them, neither bit packing nor the LJ92 encoder can store them
+   image_buffer - the unpacked image
    max_size - the size of the buffer in bytes
+   bpp - raw data bits per pixel, below 16
 */
-static void dng_reverse_byte_order(uint16_t * input_buffer, size_t max_size)
+static void dng_clip_image(uint16_t * image_buffer, size_t max_size, uint32_t bpp)
 {
     uint32_t pixel_end = (uint32_t)(max_size / 2);
+    int32_t max_value = (1 << bpp) - 1;
 
     for (uint32_t pixel_index = 0; pixel_index < pixel_end; pixel_index++)
     {
-        input_buffer[pixel_index] = ROL16(input_buffer[pixel_index], 8);
+        int32_t value = (int16_t)image_buffer[pixel_index];
+        image_buffer[pixel_index] = (uint16_t)COERCE(value, 0, max_value);
     }
 }
 
 /* fill DNG header buffer */
 void dng_init_header(struct frame_info * frame_info, struct dng_data * dng_data)
 {
-    static int first_time = 1;
-    
-    if (first_time)
+    /* buffers belong to 'dng_data', so every worker thread can have its own set */
+    if (!dng_data->header_buf)
     {
         dng_data->header_size = HEADER_SIZE;
         dng_data->header_buf = (uint8_t*)malloc(dng_data->header_size);
-        first_time = 0;
+    }
+
+    /* the image size is known without any image data, so a header can be made on its own */
+    if (!dng_data->image_size_bitpacked)
+    {
+        dng_data->image_size_bitpacked = dng_get_image_size(frame_info, IMG_SIZE_AUTO);
+    }
+    if (!dng_data->image_size)
+    {
+        dng_data->image_size = dng_get_image_size(frame_info, IMG_SIZE_MAX);
     }
 
     dng_fill_header(frame_info, dng_data);
@@ -812,26 +868,29 @@ void dng_init_header(struct frame_info * frame_info, struct dng_data * dng_data)
 /* fill DNG image data buffer */
 void dng_init_data(struct frame_info * frame_info, struct dng_data * dng_data)
 {
-    static int first_time = 1;
-    
-    if (first_time)
+    if (!dng_data->image_buf_bak)
     {
         dng_data->image_size = dng_get_image_size(frame_info, IMG_SIZE_MAX);
         dng_data->image_buf = (uint16_t*)malloc(dng_data->image_size);
     
         dng_data->image_size_bitpacked = dng_get_image_size(frame_info, IMG_SIZE_AUTO);
-        /* add extra padding at the end so dng_pack_image_bits can write 32-bits at a time */
-        dng_data->image_buf_bitpacked = (uint16_t*)malloc(dng_data->image_size_bitpacked + sizeof(uint16_t));
 
         /* backup size and pointer of the original image buffer
            it might change later if raw compression is enabled 
            restoring from backup takes place in dng_save() routine */
         dng_data->image_size_bak = dng_data->image_size;
-        dng_data->image_buf_bak = dng_data->image_buf;        
-        
-        first_time = 0;
+        dng_data->image_buf_bak = dng_data->image_buf;
     }
     
+    /* nothing to fix, dng_save() writes the packed frame with swapped byte order, which is the same as unpacking and packing it */
+    dng_data->image_packed = (frame_info->rawi_hdr.raw_info.bits_per_pixel < 16 && frame_info->raw_state == UNCOMPRESSED_RAW &&
+                              frame_info->pack_bits && !dng_needs_processing(frame_info));
+
+    if(dng_data->image_packed)
+    {
+        return;
+    }
+
     if(frame_info->rawi_hdr.raw_info.bits_per_pixel < 16)
     {
         dng_unpack_image_bits(frame_info->frame_buffer,
@@ -872,10 +931,22 @@ void dng_process_data(struct frame_info * frame_info, struct dng_data * dng_data
         {
             printf("\nFixing pattern noise...\n");
         }
-        fix_pattern_noise((int16_t *)dng_data->image_buf,
-                          frame_info->rawi_hdr.xRes,
-                          frame_info->rawi_hdr.yRes,
-                          frame_info->rawi_hdr.raw_info.white_level, 0);
+        if (frame_info->pattern_noise_profile)
+        {
+            fpn_profile_process(frame_info->pattern_noise_profile,
+                                (int16_t *)dng_data->image_buf,
+                                frame_info->rawi_hdr.xRes,
+                                frame_info->rawi_hdr.yRes,
+                                frame_info->rawi_hdr.raw_info.white_level,
+                                frame_info->pattern_noise_sample);
+        }
+        else
+        {
+            fix_pattern_noise((int16_t *)dng_data->image_buf,
+                              frame_info->rawi_hdr.xRes,
+                              frame_info->rawi_hdr.yRes,
+                              frame_info->rawi_hdr.raw_info.white_level, 0);
+        }
     }
 
     /* set crop_rec flag from MLV or CLI */
@@ -883,7 +954,7 @@ void dng_process_data(struct frame_info * frame_info, struct dng_data * dng_data
     /* if crop_rec 720 mode is not detected try to set crop_rec flag from CLI */
     if(!crop_rec) crop_rec = frame_info->crop_rec;
     /* detect if raw data is restricted to 8-12bit lossless */
-    int restricted_lossless = ( (frame_info->file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) && (frame_info->rawi_hdr.raw_info.white_level < 15000) );
+    int restricted_lossless = ( (frame_info->file_hdr.videoClass & (MLV_VIDEO_CLASS_FLAG_LJ92 | MLV_VIDEO_CLASS_FLAG_INTER)) && (frame_info->rawi_hdr.raw_info.white_level < 15000) );
     /* set parameters for bad/focus pixel processing */
     struct parameter_list par = 
     {
@@ -903,7 +974,9 @@ void dng_process_data(struct frame_info * frame_info, struct dng_data * dng_data
         frame_info->vidf_hdr.panPosY,
         frame_info->rawi_hdr.raw_info.width,
         frame_info->rawi_hdr.raw_info.height,
-        frame_info->rawi_hdr.raw_info.black_level
+        frame_info->rawi_hdr.raw_info.black_level,
+        (char *)frame_info->idnt_hdr.cameraSerial,
+        frame_info->pixel_cache
     };
     /* fix focus pixels */
     if (frame_info->focus_pixels)
@@ -945,54 +1018,104 @@ void dng_process_data(struct frame_info * frame_info, struct dng_data * dng_data
                   dng_data->image_size);
     }
 
+    if (frame_info->rawi_hdr.raw_info.bits_per_pixel < 16 && dng_needs_processing(frame_info))
+    {
+        dng_clip_image(dng_data->image_buf, dng_data->image_size, frame_info->rawi_hdr.raw_info.bits_per_pixel);
+    }
+
     first_time = 0;
 }
 
-/* save DNG file */
-int dng_save(struct frame_info * frame_info, struct dng_data * dng_data)
+/* write header and image data into 'dngf', or into 'memory' if there is no file */
+static int dng_write(struct frame_info * frame_info, struct dng_data * dng_data, FILE * dngf, uint8_t * memory)
 {
-    static uint32_t frame_count = 0;
-
-    FILE* dngf = fopen(frame_info->dng_filename, "wb");
-    if (!dngf)
+    /* write DNG header */
+    if (dngf)
     {
-        return 0;
+        if (fwrite(dng_data->header_buf, dng_data->header_size, 1, dngf) != 1)
+        {
+            return 0;
+        }
     }
-    
-    /* write DNG header */
-    if (fwrite(dng_data->header_buf, dng_data->header_size, 1, dngf) != 1)
+    else if (memory)
     {
-        fclose(dngf);
-        return 0;
+        memcpy(memory, dng_data->header_buf, dng_data->header_size);
+        memory += dng_data->header_size;
     }
-    
+
+    /* packing and byte swapping happen band by band while writing */
+    int convert = (frame_info->raw_state == UNCOMPRESSED_RAW && frame_info->pack_bits) ||
+                  (frame_info->raw_state == UNCOMPRESSED_ORIG && frame_info->rawi_hdr.raw_info.bits_per_pixel != 16);
+
+    if (dngf && convert && !dng_data->image_buf_bitpacked)
+    {
+        dng_data->image_buf_bitpacked = (uint16_t*)malloc(DNG_BAND_SIZE);
+        if (!dng_data->image_buf_bitpacked)
+        {
+            return 0;
+        }
+    }
+
     /* write DNG image data */
+    int written = 0;
     /* if raw is uncompressed and 16 bit unpacked DNGs are not requested with "--no-bitpack" */
     if(frame_info->raw_state == UNCOMPRESSED_RAW && frame_info->pack_bits)
     {
-        /* pack bits and make raw data big endian before saving to the dng file */
-        dng_pack_image_bits(dng_data->image_buf, dng_data->image_buf_bitpacked, dng_data->image_size, frame_info->rawi_hdr.raw_info.bits_per_pixel);
-
-        if (fwrite(dng_data->image_buf_bitpacked, dng_data->image_size_bitpacked, 1, dngf) != 1)
+        if(dng_data->image_packed)
         {
-            fclose(dngf);
-            return 0;
+            /* the unprocessed frame is already packed, it only needs to be big endian */
+            written = dng_write_bands(dngf, memory, frame_info->frame_buffer, dng_data->image_size_bitpacked, 0, (uint8_t *)dng_data->image_buf_bitpacked);
+        }
+        else
+        {
+            /* pack bits and make raw data big endian before saving to the dng file */
+            written = dng_write_bands(dngf, memory, dng_data->image_buf, dng_data->image_size, frame_info->rawi_hdr.raw_info.bits_per_pixel, (uint8_t *)dng_data->image_buf_bitpacked);
         }
     }
     else // a) when "--no-bitpack" specified, b) when passing through uncompressed/lossless raw, c) when raw is compressed by "-c"
     {
         if(frame_info->raw_state == UNCOMPRESSED_ORIG && (frame_info->rawi_hdr.raw_info.bits_per_pixel != 16))
         {
-            dng_reverse_byte_order(dng_data->image_buf, dng_data->image_size);
+            written = dng_write_bands(dngf, memory, dng_data->image_buf, dng_data->image_size, 0, (uint8_t *)dng_data->image_buf_bitpacked);
         }
-
-        if (fwrite(dng_data->image_buf, dng_data->image_size, 1, dngf) != 1)
+        else if (dngf)
         {
-            fclose(dngf);
-            return 0;
+            written = (fwrite(dng_data->image_buf, dng_data->image_size, 1, dngf) == 1);
+        }
+        else if (memory)
+        {
+            memcpy(memory, dng_data->image_buf, dng_data->image_size);
+            written = 1;
         }
     }
 
+    /* restore size and pointer of the original uncompressed image buffer from backup made in dng_init_data() */
+    if(dng_data->image_buf != dng_data->image_buf_bak)
+    {
+        dng_data->image_size = dng_data->image_size_bak;
+        dng_data->image_buf = dng_data->image_buf_bak;
+    }
+
+    return written;
+}
+
+/* save DNG file */
+int dng_save(struct frame_info * frame_info, struct dng_data * dng_data)
+{
+    static uint32_t frame_count = 0;
+
+    FILE* dngf = fopen(frame_info->dng_filename, "wb");
+    if (!dngf)
+    {
+        return 0;
+    }
+
+    if (!dng_write(frame_info, dng_data, dngf, NULL))
+    {
+        fclose(dngf);
+        return 0;
+    }
+
     fclose(dngf);
 
     /* show writing progress */
@@ -1014,24 +1137,40 @@ int dng_save(struct frame_info * frame_info, struct dng_data * dng_data)
             }
         }
         if (frame_info->raw_state != COMPRESSED_RAW) printf("\rCurrent frame '%s' (frames saved: %d)", frame_info->dng_filename, frame_count+1);
-    }
-    
-    /* restore size and pointer of the original uncompressed image buffer from backup made in dng_init_data() */
-    if(dng_data->image_buf != dng_data->image_buf_bak)
-    {
-        dng_data->image_size = dng_data->image_size_bak;
-        dng_data->image_buf = dng_data->image_buf_bak;
+
+        /* only counted for progress output, so worker threads (show_progress = 0) never touch it */
+        frame_count++;
     }
 
-    frame_count++;
     return 1;
 }
 
-/* free all buffers used for DNG creation and RAW processing */
-void dng_free_data(struct dng_data * dng_data)
+/* same as dng_save(), but into memory */
+int dng_save_buffer(struct frame_info * frame_info, struct dng_data * dng_data, uint8_t * buffer)
+{
+    return dng_write(frame_info, dng_data, NULL, buffer);
+}
+
+/* size of the DNG file with uncompressed raw, without processing any image data. the header size depends on its strings */
+size_t dng_get_file_size(struct frame_info * frame_info, struct dng_data * dng_data)
+{
+    int packed = frame_info->pack_bits && frame_info->rawi_hdr.raw_info.bits_per_pixel < 16;
+
+    return dng_data->header_size + dng_get_image_size(frame_info, packed ? IMG_SIZE_AUTO : IMG_SIZE_MAX);
+}
+
+/* free the buffers of one 'dng_data' set, e.g. the one of a worker thread */
+void dng_free_buffers(struct dng_data * dng_data)
 {
     if(dng_data->header_buf) free(dng_data->header_buf);
-    if(dng_data->image_buf) free(dng_data->image_buf);
+    if(dng_data->image_buf_bak) free(dng_data->image_buf_bak);
     if(dng_data->image_buf_bitpacked) free(dng_data->image_buf_bitpacked);
+    memset(dng_data, 0, sizeof(struct dng_data));
+}
+
+/* free all buffers used for DNG creation and RAW processing */
+void dng_free_data(struct dng_data * dng_data)
+{
+    dng_free_buffers(dng_data);
     free_pixel_maps();
 }
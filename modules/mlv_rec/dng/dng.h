@@ -45,12 +45,15 @@ struct frame_info
 {
     char * mlv_filename;
     char * dng_filename;
-    int fps_override;     // switch "-A fpsx1000"
+    char * pixel_cache;   // "--pixel-cache[=dir]" directory for cached focus/bad pixel maps, NULL - no cache (default)
+    struct fpn_profile * pattern_noise_profile; // "--fixpn-clip" per clip pattern noise profile, NULL - estimate every frame
 
     /* buffer where the image is stored as the camera-written RAWI isn't suitable for x64 systems */
     void *frame_buffer;
     int frame_buffer_size;
 
+    int fps_override;     // switch "-A fpsx1000"
+
     /* flags */
     int deflicker_target; // "--deflicker=value"
     int vertical_stripes; // 0 - "--no-stripes", 1 - no switch (default), 2 - "--force-stripes"
@@ -66,6 +69,7 @@ struct frame_info
     int fpi_method;       // 0 - "--fpi 0" mlvfs focus pixel interpolation  (default), "--fpi 1" raw2dng focus pixel interpolation
     int bpi_method;       // 0 - "--bpi 0" mlvfs bad pixel interpolation (default), "--bpi 1" raw2dng bad pixel interpolation
     int crop_rec;         // 0 - no crop_rec, 1 - crop_rec
+    int pattern_noise_sample; // "--fixpn-clip" this frame refines the profile
 
     /* block headers */
     mlv_vidf_hdr_t vidf_hdr;
@@ -85,13 +89,15 @@ struct dng_data
 {
     size_t header_size;             // dng header size
     size_t image_size;              // raw image buffer size
-    size_t image_size_bitpacked;    // bit packed raw image buffer size
+    size_t image_size_bitpacked;    // bit packed raw image size
     size_t image_size_bak;          // image size backup (needed to restore original size)
 
     uint8_t * header_buf;           // pointer to header buffer
     uint16_t * image_buf;           // pointer to image buffer
-    uint16_t * image_buf_bitpacked; // pointer to bit packed image buffer
+    uint16_t * image_buf_bitpacked; // pointer to the buffer where one band of the image gets packed or byte swapped before writing
     uint16_t * image_buf_bak;       // backup of pointer to image buffer (needed to restore pointer to original buffer)
+    int image_packed;               // image_buf was not filled, the packed frame_buffer gets written as it is (no raw processing enabled)
+    int reserved;                   // padding
 };
 
 /* routines to initialize, process and free raw image buffers of 'dng_data' struct */
@@ -99,12 +105,22 @@ void dng_init_header(struct frame_info * frame_info, struct dng_data * dng_data)
 void dng_init_data(struct frame_info * frame_info, struct dng_data * dng_data);
 void dng_process_data(struct frame_info * frame_info, struct dng_data * dng_data);
 void dng_free_data(struct dng_data * dng_data);
+void dng_free_buffers(struct dng_data * dng_data);
 
 /* routines to unpack and pack bits */
 void dng_unpack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, size_t max_size, uint32_t bpp);
 void dng_pack_image_bits(uint16_t * input_buffer, uint16_t * output_buffer, size_t max_size, uint32_t bpp);
 
+/* R, G and B white balance multipliers for the WBAL block, the same white balance as in the DNG */
+void dng_get_wb_multipliers(mlv_idnt_hdr_t * idnt_hdr, mlv_wbal_hdr_t * wbal_hdr, double multipliers[3]);
+
 /* routine to save cdng file */
 int dng_save(struct frame_info * frame_info, struct dng_data * dng_data);
 
+/* the same DNG into memory, only for uncompressed raw (UNCOMPRESSED_RAW). 'buffer' must hold dng_get_file_size() bytes */
+int dng_save_buffer(struct frame_info * frame_info, struct dng_data * dng_data, uint8_t * buffer);
+
+/* size of the DNG with uncompressed raw after dng_init_header(), no image data needed */
+size_t dng_get_file_size(struct frame_info * frame_info, struct dng_data * dng_data);
+
 #endif
@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lj92.h"
+#include "interframe.h"
+
+/*
+  predicted frames: the difference to the keyframe is mapped to unsigned (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+  and written as Golomb-Rice code, MSB first. the Rice parameter adapts per bayer channel like in LOCO-I:
+  it is the smallest k with N << k >= A, where A is the sum of the last coded values and N their count.
+  k follows from the bit lengths of A and N, searching it would mispredict a branch or two per pixel on noisy data.
+  values with a quotient of INTER_RICE_LIMIT or more are escaped and written with bpp + 1 bits.
+
+  the LJ92 encoder only knows predictor 6, which is a bad fit for temporal residuals that are mostly
+  sensor noise, so they get their own coder. it is also a lot faster to decode than huffman.
+*/
+#define INTER_RICE_LIMIT    24
+#define INTER_RICE_RESET    64
+#define INTER_RICE_A_INIT   32
+
+/* predicted frames larger than this fraction of the packed frame size are also tried as intra frame */
+#define INTER_INTRA_CHECK   60
+
+struct inter_encoder
+{
+    lj92_encoder lj92;
+    uint8_t *buffer;
+    uint32_t buffer_size;
+    uint32_t reserved;  /* padding */
+};
+
+typedef struct
+{
+    uint32_t a;
+    uint32_t n;
+} rice_ctx_t;
+
+typedef struct
+{
+    uint8_t *out;
+    uint64_t acc;
+    uint32_t pos;
+    int bits;
+} bit_writer_t;
+
+typedef struct
+{
+    const uint8_t *in;
+    uint64_t buf;
+    uint32_t size;
+    uint32_t pos;
+    int bits;
+    int reserved;       /* padding */
+} bit_reader_t;
+
+static inline int count_zeros32(uint32_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clz(value);
+#else
+    int zeros = 0;
+    while(!(value & 0x80000000))
+    {
+        value <<= 1;
+        zeros++;
+    }
+    return zeros;
+#endif
+}
+
+/* N << k has the bit length of A or is shifted one further. A may get down to zero, then k is 0 anyway */
+static inline int rice_k(const rice_ctx_t *ctx)
+{
+    int k = count_zeros32(ctx->n) - count_zeros32(ctx->a | 1);
+
+    k = (k < 0) ? 0 : k;
+    return k + ((ctx->n << k) < ctx->a);
+}
+
+static inline void rice_update(rice_ctx_t *ctx, uint32_t value)
+{
+    ctx->a += value;
+    ctx->n++;
+
+    if(ctx->n == INTER_RICE_RESET)
+    {
+        ctx->a >>= 1;
+        ctx->n >>= 1;
+    }
+}
+
+static void rice_init(rice_ctx_t ctx[4])
+{
+    for(int c = 0; c < 4; c++)
+    {
+        ctx[c].a = INTER_RICE_A_INIT;
+        ctx[c].n = 1;
+    }
+}
+
+/* write up to 32 bits */
+static inline void put_bits(bit_writer_t *bw, uint32_t value, int count)
+{
+    bw->acc = (bw->acc << count) | value;
+    bw->bits += count;
+
+    while(bw->bits >= 8)
+    {
+        bw->bits -= 8;
+        bw->out[bw->pos++] = (uint8_t)(bw->acc >> bw->bits);
+    }
+}
+
+static void flush_bits(bit_writer_t *bw)
+{
+    if(bw->bits)
+    {
+        put_bits(bw, 0, 8 - bw->bits);
+    }
+}
+
+/* make sure there are at least 57 valid bits, reading past the end returns zeros */
+static inline void refill_bits(bit_reader_t *br)
+{
+    if(br->bits > 56)
+    {
+        return;
+    }
+
+    /* load 8 bytes at once and keep the whole ones that fit. the bits behind them are the same ones the next refill loads again */
+    if(br->pos + 8 <= br->size)
+    {
+        const uint8_t *in = &br->in[br->pos];
+        uint64_t word = ((uint64_t)in[0] << 56) | ((uint64_t)in[1] << 48) | ((uint64_t)in[2] << 40) | ((uint64_t)in[3] << 32) |
+                        ((uint64_t)in[4] << 24) | ((uint64_t)in[5] << 16) | ((uint64_t)in[6] << 8) | (uint64_t)in[7];
+        int bytes = (63 - br->bits) >> 3;
+
+        br->buf |= word >> br->bits;
+        br->pos += bytes;
+        br->bits += bytes * 8;
+        return;
+    }
+
+    while(br->bits <= 56)
+    {
+        uint64_t byte = (br->pos < br->size) ? br->in[br->pos] : 0;
+        br->buf |= byte << (56 - br->bits);
+        br->pos++;
+        br->bits += 8;
+    }
+}
+
+static inline uint32_t get_bits(bit_reader_t *br, int count)
+{
+    if(!count)
+    {
+        return 0;
+    }
+
+    uint32_t value = (uint32_t)(br->buf >> (64 - count));
+    br->buf <<= count;
+    br->bits -= count;
+    return value;
+}
+
+static inline int count_zeros(uint64_t value)
+{
+    if(!value)
+    {
+        return 64;
+    }
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(value);
+#else
+    int zeros = 0;
+    while(!(value & 0x8000000000000000ULL))
+    {
+        value <<= 1;
+        zeros++;
+    }
+    return zeros;
+#endif
+}
+
+/* code the difference to 'ref', returns the size in bytes. 'out' must hold 6 bytes per pixel */
+static uint32_t rice_encode(const uint16_t *frame, const uint16_t *ref, int xRes, int yRes, int bpp, uint8_t *out)
+{
+    bit_writer_t bw = { .out = out };
+    rice_ctx_t ctx[4];
+
+    rice_init(ctx);
+
+    for(int y = 0; y < yRes; y++)
+    {
+        const uint16_t *src = &frame[y * xRes];
+        const uint16_t *prev = &ref[y * xRes];
+        rice_ctx_t *line_ctx = &ctx[(y & 1) * 2];
+
+        for(int x = 0; x < xRes; x++)
+        {
+            int32_t diff = (int32_t)src[x] - (int32_t)prev[x];
+            uint32_t value = (diff >= 0) ? ((uint32_t)diff << 1) : (((uint32_t)-diff << 1) - 1);
+            rice_ctx_t *c = &line_ctx[x & 1];
+            int k = rice_k(c);
+            uint32_t quotient = value >> k;
+
+            if(quotient < INTER_RICE_LIMIT)
+            {
+                put_bits(&bw, 1, quotient + 1);
+                put_bits(&bw, value & ((1U << k) - 1), k);
+            }
+            else
+            {
+                put_bits(&bw, 1, INTER_RICE_LIMIT + 1);
+                put_bits(&bw, value, bpp + 1);
+            }
+
+            rice_update(c, value);
+        }
+    }
+
+    flush_bits(&bw);
+    return bw.pos;
+}
+
+static inline uint32_t rice_decode_value(bit_reader_t *br, const rice_ctx_t *ctx, int bpp)
+{
+    int k = rice_k(ctx);
+
+    refill_bits(br);
+
+    int zeros = count_zeros(br->buf);
+
+    if(zeros < INTER_RICE_LIMIT)
+    {
+        /* unary part, stop bit and remainder in one go. shifting by 63 - k instead of 64 - k keeps k = 0 defined */
+        uint64_t rest = br->buf << (zeros + 1);
+
+        br->buf = rest << k;
+        br->bits -= zeros + 1 + k;
+        return ((uint32_t)zeros << k) | (uint32_t)((rest >> 1) >> (63 - k));
+    }
+
+    get_bits(br, INTER_RICE_LIMIT + 1);
+    return get_bits(br, bpp + 1);
+}
+
+static inline uint32_t rice_decode_pixel(bit_reader_t *br, rice_ctx_t *ctx, int bpp, uint16_t ref, uint16_t *dst)
+{
+    uint32_t value = rice_decode_value(br, ctx, bpp);
+    int32_t diff = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    int32_t pixel = (int32_t)ref + diff;
+
+    rice_update(ctx, value);
+    *dst = (uint16_t)pixel;
+
+    /* out of range means the data is corrupt, it is checked once per line */
+    return (uint32_t)pixel >> bpp;
+}
+
+static int rice_decode(const uint8_t *in, uint32_t size, const uint16_t *ref, uint16_t *frame, int xRes, int yRes, int bpp)
+{
+    bit_reader_t br = { .in = in, .size = size };
+    rice_ctx_t ctx[4];
+
+    rice_init(ctx);
+
+    for(int y = 0; y < yRes; y++)
+    {
+        const uint16_t *prev = &ref[y * xRes];
+        uint16_t *dst = &frame[y * xRes];
+        rice_ctx_t *line_ctx = &ctx[(y & 1) * 2];
+
+        /* local copies of both bayer channels of this line, so they can stay in registers */
+        rice_ctx_t even = line_ctx[0];
+        rice_ctx_t odd = line_ctx[1];
+        uint32_t invalid = 0;
+        int x = 0;
+
+        for(; x + 1 < xRes; x += 2)
+        {
+            invalid |= rice_decode_pixel(&br, &even, bpp, prev[x], &dst[x]);
+            invalid |= rice_decode_pixel(&br, &odd, bpp, prev[x + 1], &dst[x + 1]);
+        }
+        if(x < xRes)
+        {
+            invalid |= rice_decode_pixel(&br, &even, bpp, prev[x], &dst[x]);
+        }
+
+        if(invalid)
+        {
+            return LJ92_ERROR_CORRUPT;
+        }
+
+        line_ctx[0] = even;
+        line_ctx[1] = odd;
+    }
+
+    /* everything that was consumed must have been in the payload */
+    if(br.pos - (uint32_t)(br.bits / 8) > size)
+    {
+        return LJ92_ERROR_CORRUPT;
+    }
+
+    return LJ92_ERROR_NONE;
+}
+
+/* same layout as mlv_dump and the camera use: two lines merged into one, split into 'components' */
+static void lj92_layout(int xRes, int yRes, int components, int *width, int *height, int *lj92_components)
+{
+    if(yRes & 1)
+    {
+        *lj92_components = 1;
+        *width = xRes;
+        *height = yRes;
+        return;
+    }
+
+    *lj92_components = ((xRes * 2) % components) ? 1 : components;
+    *width = xRes * 2 / *lj92_components;
+    *height = yRes / 2;
+}
+
+static int lj92_decode_frame(const uint8_t *in, uint32_t size, uint16_t *frame, int xRes, int yRes)
+{
+    lj92 handle;
+    int width = 0;
+    int height = 0;
+    int bitdepth = 0;
+    int components = 0;
+
+    int ret = lj92_open(&handle, (uint8_t *)in, size, &width, &height, &bitdepth, &components);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    if(width * height * components != xRes * yRes)
+    {
+        lj92_close(handle);
+        return LJ92_ERROR_CORRUPT;
+    }
+
+    ret = lj92_decode(handle, frame, xRes * yRes, 0, NULL, 0);
+    lj92_close(handle);
+
+    return ret;
+}
+
+int inter_encoder_open(inter_encoder_t **encoder)
+{
+    inter_encoder_t *enc = calloc(1, sizeof(inter_encoder_t));
+
+    if(!enc)
+    {
+        return LJ92_ERROR_NO_MEMORY;
+    }
+
+    int ret = lj92_encoder_open(&enc->lj92);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        free(enc);
+        return ret;
+    }
+
+    *encoder = enc;
+    return LJ92_ERROR_NONE;
+}
+
+void inter_encoder_close(inter_encoder_t *encoder)
+{
+    if(!encoder)
+    {
+        return;
+    }
+
+    lj92_encoder_close(encoder->lj92);
+    free(encoder->buffer);
+    free(encoder);
+}
+
+static int inter_encode_lj92(inter_encoder_t *encoder, const uint16_t *frame, int frame_type, int xRes, int yRes, int bpp, int lj92_components, uint8_t **encoded, int *encoded_size)
+{
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    uint8_t *compressed = NULL;
+    int compressed_size = 0;
+
+    lj92_layout(xRes, yRes, lj92_components, &width, &height, &components);
+
+    int ret = lj92_encoder_encode(encoder->lj92, (uint16_t *)frame, width, height, bpp, components, width * height * components, 0, NULL, 0, &compressed, &compressed_size);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    uint32_t needed = sizeof(inter_hdr_t) + compressed_size;
+
+    if(encoder->buffer_size < needed)
+    {
+        free(encoder->buffer);
+        encoder->buffer = malloc(needed);
+        encoder->buffer_size = encoder->buffer ? needed : 0;
+
+        if(!encoder->buffer)
+        {
+            return LJ92_ERROR_NO_MEMORY;
+        }
+    }
+
+    inter_hdr_t hdr;
+
+    memset(&hdr, 0x00, sizeof(hdr));
+    hdr.frameType = frame_type;
+    memcpy(encoder->buffer, &hdr, sizeof(hdr));
+    memcpy(&encoder->buffer[sizeof(hdr)], compressed, compressed_size);
+
+    *encoded = encoder->buffer;
+    *encoded_size = needed;
+    return LJ92_ERROR_NONE;
+}
+
+int inter_encode(inter_encoder_t *encoder, const uint16_t *frame, const inter_ref_t *ref, uint32_t key_distance,
+                 int xRes, int yRes, int bpp, int lj92_components, uint8_t **encoded, int *encoded_size)
+{
+    if(!key_distance)
+    {
+        return inter_encode_lj92(encoder, frame, INTER_FRAME_KEY, xRes, yRes, bpp, lj92_components, encoded, encoded_size);
+    }
+
+    if(!ref || !ref->valid || ref->xRes != xRes || ref->yRes != yRes)
+    {
+        return INTER_ERROR_NO_KEYFRAME;
+    }
+
+    uint32_t pixels = (uint32_t)xRes * yRes;
+    uint32_t needed = sizeof(inter_hdr_t) + pixels * 6 + 16;
+
+    if(encoder->buffer_size < needed)
+    {
+        free(encoder->buffer);
+        encoder->buffer = malloc(needed);
+        encoder->buffer_size = encoder->buffer ? needed : 0;
+
+        if(!encoder->buffer)
+        {
+            return LJ92_ERROR_NO_MEMORY;
+        }
+    }
+
+    uint32_t size = rice_encode(frame, ref->data, xRes, yRes, bpp, &encoder->buffer[sizeof(inter_hdr_t)]);
+
+    /* when the scene changed too much, a spatial prediction may do better. this only depends on the frame itself,
+       so the result is the same no matter in which order or on which thread frames get encoded */
+    uint32_t packed_size = (pixels * bpp + 7) / 8;
+
+    if((uint64_t)size * 100 > (uint64_t)packed_size * INTER_INTRA_CHECK)
+    {
+        uint8_t *intra = NULL;
+        int intra_size = 0;
+
+        int width = 0;
+        int height = 0;
+        int components = 0;
+
+        /* the LJ92 encoder has its own buffer, so the predicted frame is still there afterwards */
+        lj92_layout(xRes, yRes, lj92_components, &width, &height, &components);
+        int ret = lj92_encoder_encode(encoder->lj92, (uint16_t *)frame, width, height, bpp, components, width * height * components, 0, NULL, 0, &intra, &intra_size);
+
+        if(ret == LJ92_ERROR_NONE && (uint32_t)intra_size < size)
+        {
+            inter_hdr_t hdr;
+
+            memset(&hdr, 0x00, sizeof(hdr));
+            hdr.frameType = INTER_FRAME_INTRA;
+            memcpy(encoder->buffer, &hdr, sizeof(hdr));
+            memcpy(&encoder->buffer[sizeof(hdr)], intra, intra_size);
+
+            *encoded = encoder->buffer;
+            *encoded_size = sizeof(hdr) + intra_size;
+            return LJ92_ERROR_NONE;
+        }
+    }
+
+    inter_hdr_t hdr;
+
+    memset(&hdr, 0x00, sizeof(hdr));
+    hdr.frameType = INTER_FRAME_PRED;
+    hdr.bitDepth = bpp;
+    hdr.keyDistance = key_distance;
+    memcpy(encoder->buffer, &hdr, sizeof(hdr));
+
+    *encoded = encoder->buffer;
+    *encoded_size = sizeof(hdr) + size;
+    return LJ92_ERROR_NONE;
+}
+
+/* copies the header out of the payload, which is not necessarily aligned, and checks it */
+static int inter_read_hdr(const uint8_t *payload, uint32_t size, uint32_t frame_number, inter_hdr_t *hdr, uint32_t *key_frame)
+{
+    if(size < sizeof(*hdr))
+    {
+        return LJ92_ERROR_CORRUPT;
+    }
+
+    memcpy(hdr, payload, sizeof(*hdr));
+
+    switch(hdr->frameType)
+    {
+        case INTER_FRAME_KEY:
+        case INTER_FRAME_INTRA:
+            *key_frame = frame_number;
+            return LJ92_ERROR_NONE;
+
+        case INTER_FRAME_PRED:
+            if(!hdr->keyDistance || hdr->keyDistance > frame_number)
+            {
+                return LJ92_ERROR_CORRUPT;
+            }
+            *key_frame = frame_number - hdr->keyDistance;
+            return LJ92_ERROR_NONE;
+
+        default:
+            return LJ92_ERROR_CORRUPT;
+    }
+}
+
+int inter_frame_info(const uint8_t *payload, uint32_t size, uint32_t frame_number, int *frame_type, uint32_t *key_frame)
+{
+    inter_hdr_t hdr;
+    int ret = inter_read_hdr(payload, size, frame_number, &hdr, key_frame);
+
+    if(ret == LJ92_ERROR_NONE)
+    {
+        *frame_type = hdr.frameType;
+    }
+
+    return ret;
+}
+
+int inter_ref_alloc(inter_ref_t *ref, int xRes, int yRes)
+{
+    uint32_t pixels = (uint32_t)xRes * yRes;
+
+    ref->valid = 0;
+
+    if(ref->data_size < pixels)
+    {
+        free(ref->data);
+        ref->data = malloc(pixels * sizeof(uint16_t));
+        ref->data_size = ref->data ? pixels : 0;
+
+        if(!ref->data)
+        {
+            return LJ92_ERROR_NO_MEMORY;
+        }
+    }
+
+    ref->xRes = xRes;
+    ref->yRes = yRes;
+    return LJ92_ERROR_NONE;
+}
+
+int inter_ref_set(inter_ref_t *ref, const uint16_t *frame, uint32_t frame_number, int xRes, int yRes)
+{
+    int ret = inter_ref_alloc(ref, xRes, yRes);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    memcpy(ref->data, frame, (size_t)xRes * yRes * sizeof(uint16_t));
+    ref->frame_number = frame_number;
+    ref->valid = 1;
+    return LJ92_ERROR_NONE;
+}
+
+int inter_decode_key(const uint8_t *payload, uint32_t size, uint32_t frame_number, inter_ref_t *ref, int xRes, int yRes)
+{
+    int frame_type = 0;
+    uint32_t key_frame = 0;
+
+    int ret = inter_frame_info(payload, size, frame_number, &frame_type, &key_frame);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    if(frame_type != INTER_FRAME_KEY)
+    {
+        return INTER_ERROR_NO_KEYFRAME;
+    }
+
+    ret = inter_ref_alloc(ref, xRes, yRes);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    ret = lj92_decode_frame(&payload[sizeof(inter_hdr_t)], size - sizeof(inter_hdr_t), ref->data, xRes, yRes);
+
+    if(ret == LJ92_ERROR_NONE)
+    {
+        ref->frame_number = frame_number;
+        ref->valid = 1;
+    }
+
+    return ret;
+}
+
+int inter_decode(const uint8_t *payload, uint32_t size, uint32_t frame_number, const inter_ref_t *ref, uint16_t *frame, int xRes, int yRes)
+{
+    inter_hdr_t hdr;
+    uint32_t key_frame = 0;
+
+    int ret = inter_read_hdr(payload, size, frame_number, &hdr, &key_frame);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        return ret;
+    }
+
+    int have_ref = ref && ref->valid && ref->frame_number == key_frame && ref->xRes == xRes && ref->yRes == yRes;
+    const uint8_t *data = &payload[sizeof(inter_hdr_t)];
+    uint32_t data_size = size - sizeof(inter_hdr_t);
+
+    switch(hdr.frameType)
+    {
+        case INTER_FRAME_KEY:
+            if(have_ref)
+            {
+                memcpy(frame, ref->data, (size_t)xRes * yRes * sizeof(uint16_t));
+                return LJ92_ERROR_NONE;
+            }
+            return lj92_decode_frame(data, data_size, frame, xRes, yRes);
+
+        case INTER_FRAME_INTRA:
+            return lj92_decode_frame(data, data_size, frame, xRes, yRes);
+
+        case INTER_FRAME_PRED:
+            if(!have_ref)
+            {
+                return INTER_ERROR_NO_KEYFRAME;
+            }
+            if(hdr.bitDepth < 1 || hdr.bitDepth > 16)
+            {
+                return LJ92_ERROR_CORRUPT;
+            }
+            return rice_decode(data, data_size, ref->data, frame, xRes, yRes, hdr.bitDepth);
+
+        default:
+            return LJ92_ERROR_CORRUPT;
+    }
+}
+
+void inter_ref_free(inter_ref_t *ref)
+{
+    free(ref->data);
+    ref->data = NULL;
+    ref->data_size = 0;
+    ref->valid = 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _interframe_h
+#define _interframe_h
+
+#include <stdint.h>
+
+/*
+  inter-frame predictive lossless codec for VIDF payloads (MLV_VIDEO_CLASS_FLAG_INTER).
+
+  every payload starts with an inter_hdr_t:
+    - keyframes are LJ92 compressed like with MLV_VIDEO_CLASS_FLAG_LJ92 and are the reference for the following frames
+    - predicted frames store the difference to their keyframe, coded with an adaptive Golomb-Rice code
+    - intra frames are LJ92 compressed too, but no reference. used when prediction would be larger
+  a predicted frame only depends on its keyframe, which is 'keyDistance' frames before it. so any frame
+  decodes after at most one keyframe, and all frames between two keyframes can be decoded in parallel.
+*/
+
+#define INTER_FRAME_KEY     0
+#define INTER_FRAME_INTRA   1
+#define INTER_FRAME_PRED    2
+
+/* in addition to the LJ92 error codes */
+#define INTER_ERROR_NO_KEYFRAME  -16
+
+typedef struct
+{
+    uint8_t     frameType;      /* INTER_FRAME_* */
+    uint8_t     bitDepth;       /* predicted frames: bit depth the differences were coded with */
+    uint8_t     reserved[2];
+    uint32_t    keyDistance;    /* predicted frames: frameNumber of this frame minus the one of its keyframe */
+} inter_hdr_t;
+
+/* a decoded keyframe, unpacked to 16 bits per pixel */
+typedef struct
+{
+    uint16_t   *data;
+    uint32_t    data_size;      /* allocated pixels */
+    uint32_t    frame_number;
+    int         xRes;
+    int         yRes;
+    int         valid;
+    int         reserved;       /* padding */
+} inter_ref_t;
+
+typedef struct inter_encoder inter_encoder_t;
+
+/* one encoder per thread, keeps its buffers between frames */
+int inter_encoder_open(inter_encoder_t **encoder);
+void inter_encoder_close(inter_encoder_t *encoder);
+
+/*
+  encode an unpacked frame. with 'key_distance' 0 it becomes a keyframe, 'ref' is not used then.
+  otherwise it gets predicted from 'ref', the unpacked keyframe 'key_distance' frames before.
+  the result is owned by the encoder and stays valid until the next call.
+*/
+int inter_encode(inter_encoder_t *encoder, const uint16_t *frame, const inter_ref_t *ref, uint32_t key_distance,
+                 int xRes, int yRes, int bpp, int lj92_components, uint8_t **encoded, int *encoded_size);
+
+/* read the header of a payload: the frame type and the number of the keyframe it needs (its own for key and intra frames) */
+int inter_frame_info(const uint8_t *payload, uint32_t size, uint32_t frame_number, int *frame_type, uint32_t *key_frame);
+
+/* make 'ref' hold a xRes * yRes frame. it is invalid until the caller filled it and set frame_number and valid */
+int inter_ref_alloc(inter_ref_t *ref, int xRes, int yRes);
+
+/* copy an unpacked keyframe into 'ref', for encoding the following frames */
+int inter_ref_set(inter_ref_t *ref, const uint16_t *frame, uint32_t frame_number, int xRes, int yRes);
+
+/* decode a keyframe payload into 'ref' */
+int inter_decode_key(const uint8_t *payload, uint32_t size, uint32_t frame_number, inter_ref_t *ref, int xRes, int yRes);
+
+/*
+  decode any payload into 'frame' (xRes * yRes unpacked pixels).
+  predicted frames need the 'ref' of their keyframe, keyframes are copied from 'ref' when it already holds them.
+*/
+int inter_decode(const uint8_t *payload, uint32_t size, uint32_t frame_number, const inter_ref_t *ref, uint16_t *frame, int xRes, int yRes);
+
+void inter_ref_free(inter_ref_t *ref);
+
+#endif
@@ -25,19 +25,50 @@ SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "lj92.h"
 
 typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
-//#define SLOW_HUFF
 //#define DEBUG
 
+/* Bits looked up at once by the fast Huffman table */
+#define LJ92_FASTBITS 12
+/* Fast table entry contains the complete difference, not only code length and ssss */
+#define LJ92_FAST_FULL 0x80
+
+typedef struct _ljh {
+    u16* hufflut;
+    // First LJ92_FASTBITS bits of the code: difference<<16 | LJ92_FAST_FULL | total bits,
+    // ssss<<8 | code bits if the difference does not fit, or 0 if the code is longer
+    u32* fastlut;
+    int huffbits;
+    int reserved; // Padding
+} ljh;
+
 typedef struct _ljp {
     u8* data;
     u8* dataend;
+    u16* linearize; // Linearization table
+
+    // Huffman tables by id, the scan header picks one for each component
+    ljh huff[4];
+
+    // Parse state
+    u64 b;
+    u16* image;
+    u16* rowcache;
+    u16* outrow[2];
+    int* diffs; // Differences of the current row
+
     int datalen;
     int scanstart;
     int ix;
@@ -47,28 +78,10 @@ typedef struct _ljp {
     int components;  // Components(Nf)
     int writelen; // Write rows this long
     int skiplen; // Skip this many values after each row
-    u16* linearize; // Linearization table
     int linlen;
-    int sssshist[16];
-
-    // Huffman table - only one supported, and probably needed
-#ifdef SLOW_HUFF
-    int* maxcode;
-    int* mincode;
-    int* valptr;
-    u8* huffval;
-    int* huffsize;
-    int* huffcode;
-#else
-    u16* hufflut;
-    int huffbits;
-#endif
-    // Parse state
-    int cnt;
-    u32 b;
-    u16* image;
-    u16* rowcache;
-    u16* outrow[2];
+    int comphuff[4];
+    int onehuff; // All components use the same table
+    int cnt; // Bits left in b
 } ljp;
 
 static int find(ljp* self) {
@@ -85,148 +98,26 @@ static int find(ljp* self) {
 
 #define BEH(ptr) ((((int)(*&ptr))<<8)|(*(&ptr+1)))
 
-static int parseHuff(ljp* self) {
-    int ret = LJ92_ERROR_CORRUPT;
-    u8* huffhead = &self->data[self->ix]; // xstruct.unpack('>HB16B',self.data[self.ix:self.ix+19])
-    u8* bits = &huffhead[2];
+/* Build the lookup tables of one Huffman table from its 16 code counts and the values */
+static int buildHuff(ljh* h, const u8* counts, const u8* huffvals) {
+    u8 bits[17]; // local copy, the input data may be read-only (e.g. memory mapped)
+    memcpy(&bits[1], counts, 16);
     bits[0] = 0; // Because table starts from 1
-    int hufflen = BEH(huffhead[0]);
-    if ((self->ix + hufflen) >= self->datalen) return ret;
-#ifdef SLOW_HUFF
-    u8* huffval = calloc(hufflen - 19,sizeof(u8));
-    if (huffval == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->huffval = huffval;
-    for (int hix=0;hix<(hufflen-19);hix++) {
-        huffval[hix] = self->data[self->ix+19+hix];
-#ifdef DEBUG
-        printf("huffval[%d]=%d\n",hix,huffval[hix]);
-#endif
-    }
-    self->ix += hufflen;
-    // Generate huffman table
-    int k = 0;
-    int i = 1;
-    int j = 1;
-    int huffsize_needed = 1;
-    // First calculate how long huffsize needs to be
-    while (i<=16) {
-        while (j<=bits[i]) {
-            huffsize_needed++;
-            k = k+1;
-            j = j+1;
-        }
-        i = i+1;
-        j = 1;
-    }
-    // Now allocate and do it
-    int* huffsize = calloc(huffsize_needed,sizeof(int));
-    if (huffsize == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->huffsize = huffsize;
-    k = 0;
-    i = 1;
-    j = 1;
-    // First calculate how long huffsize needs to be
-    int hsix = 0;
-    while (i<=16) {
-        while (j<=bits[i]) {
-            huffsize[hsix++] = i;
-            k = k+1;
-            j = j+1;
-        }
-        i = i+1;
-        j = 1;
-    }
-    huffsize[hsix++] = 0;
-
-    // Calculate the size of huffcode array
-    int huffcode_needed = 0;
-    k = 0;
-    int code = 0;
-    int si = huffsize[0];
-    while (1) {
-        while (huffsize[k] == si) {
-            huffcode_needed++;
-            code = code+1;
-            k = k+1;
-        }
-        if (huffsize[k] == 0)
-            break;
-        while (huffsize[k] != si) {
-            code = code << 1;
-            si = si + 1;
-        }
-    }
-    // Now fill it
-    int* huffcode = calloc(huffcode_needed,sizeof(int));
-    if (huffcode == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->huffcode = huffcode;
-    int hcix = 0;
-    k = 0;
-    code = 0;
-    si = huffsize[0];
-    while (1) {
-        while (huffsize[k] == si) {
-            huffcode[hcix++] = code;
-            code = code+1;
-            k = k+1;
-        }
-        if (huffsize[k] == 0)
-            break;
-        while (huffsize[k] != si) {
-            code = code << 1;
-            si = si + 1;
-        }
-    }
-
-    i = 0;
-    j = 0;
-
-    int* maxcode = calloc(17,sizeof(int));
-    if (maxcode == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->maxcode = maxcode;
-    int* mincode = calloc(17,sizeof(int));
-    if (mincode == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->mincode = mincode;
-    int* valptr = calloc(17,sizeof(int));
-    if (valptr == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->valptr = valptr;
-
-    while (1) {
-        while (1) {
-            i++;
-            if (i>16)
-                break;
-            if (bits[i]!=0)
-                break;
-            maxcode[i] = -1;
-        }
-        if (i>16)
-            break;
-        valptr[i] = j;
-        mincode[i] = huffcode[j];
-        j = j+bits[i]-1;
-        maxcode[i] = huffcode[j];
-        j++;
-    }
-    free(huffsize);
-    self->huffsize = NULL;
-    free(huffcode);
-    self->huffcode = NULL;
-    ret = LJ92_ERROR_NONE;
-#else
     /* Calculate huffman direct lut */
     // How many bits in the table - find highest entry
-    u8* huffvals = &self->data[self->ix+19];
     int maxbits = 16;
     while (maxbits>0) {
         if (bits[maxbits]) break;
         maxbits--;
     }
-    self->huffbits = maxbits;
-    /* Now fill the lut */
-    u16* hufflut = malloc((1<<maxbits) * sizeof(u16));
+    h->huffbits = maxbits;
+    /* Now fill the lut. A table redefined with the same id replaces the previous one */
+    free(h->hufflut);
+    free(h->fastlut);
+    h->fastlut = NULL;
+    u16* hufflut = calloc(1<<maxbits, sizeof(u16));
     if (hufflut == NULL) return LJ92_ERROR_NO_MEMORY;
-    self->hufflut = hufflut;
+    h->hufflut = hufflut;
     int i = 0;
     int hv = 0;
     int rv = 0;
@@ -260,17 +151,62 @@ static int parseHuff(ljp* self) {
         i++;
         rv++;
     }
-    ret = LJ92_ERROR_NONE;
-#endif
-    return ret;
+
+    /* Derive the fast table from the direct lut. Most codes and their
+       difference bits fit into LJ92_FASTBITS, so a single lookup decodes them */
+    u32* fastlut = calloc(1<<LJ92_FASTBITS, sizeof(u32));
+    if (fastlut == NULL) return LJ92_ERROR_NO_MEMORY;
+    h->fastlut = fastlut;
+    for (i=0;i<1<<LJ92_FASTBITS;i++) {
+        u16 ssssused;
+        if (maxbits >= LJ92_FASTBITS)
+            ssssused = hufflut[i<<(maxbits-LJ92_FASTBITS)];
+        else
+            ssssused = hufflut[i>>(LJ92_FASTBITS-maxbits)];
+        int usedbits = ssssused&0xFF;
+        int t = ssssused>>8;
+        if (usedbits == 0 || usedbits > LJ92_FASTBITS) continue; // Long code, use hufflut
+        if (t == 0) {
+            fastlut[i] = LJ92_FAST_FULL | usedbits;
+        } else if (t <= 16 && usedbits + t <= LJ92_FASTBITS) {
+            int diff = (i >> (LJ92_FASTBITS - usedbits - t)) & ((1 << t) - 1);
+            if (diff < (1 << (t-1)))
+                diff += 1 - (1 << t);
+            fastlut[i] = ((u32)diff << 16) | LJ92_FAST_FULL | (usedbits + t);
+        } else {
+            fastlut[i] = (t << 8) | usedbits;
+        }
+    }
+    return LJ92_ERROR_NONE;
+}
+
+/* A DHT segment holds one or more tables (Canon CR2 has one per component in a single segment) */
+static int parseHuff(ljp* self) {
+    int hufflen = BEH(self->data[self->ix]);
+    int end = self->ix + hufflen;
+    if (end >= self->datalen) return LJ92_ERROR_CORRUPT;
+    int ix = self->ix + 2;
+    while (ix + 17 <= end) {
+        int id = self->data[ix] & 0x0F;
+        const u8* counts = &self->data[ix+1];
+        int count = 0;
+        for (int i=0;i<16;i++) count += counts[i];
+        if (id > 3 || ix + 17 + count > end) return LJ92_ERROR_CORRUPT;
+        int ret = buildHuff(&self->huff[id], counts, &self->data[ix+17]);
+        if (ret != LJ92_ERROR_NONE) return ret;
+        ix += 17 + count;
+    }
+    self->ix = end;
+    return LJ92_ERROR_NONE;
 }
 
 static int parseSof3(ljp* self) {
-    if (self->ix+6 >= self->datalen) return LJ92_ERROR_CORRUPT;
+    if (self->ix+7 >= self->datalen) return LJ92_ERROR_CORRUPT;
     self->y = BEH(self->data[self->ix+3]);
     self->x = BEH(self->data[self->ix+5]);
     self->bits = self->data[self->ix+2];
     self->components = self->data[self->ix + 7];
+    if (self->components < 1 || self->components > 4) return LJ92_ERROR_CORRUPT;
     self->ix += BEH(self->data[self->ix]);
     return LJ92_ERROR_NONE;
 }
@@ -281,312 +217,308 @@ static int parseBlock(ljp* self) {
     return LJ92_ERROR_NONE;
 }
 
-#ifdef SLOW_HUFF
-static int nextbit(ljp* self) {
-    u32 b = self->b;
-    if (self->cnt == 0) {
-        u8* data = &self->data[self->ix];
-        u32 next = *data++;
-        b = next;
-        if (next == 0xff) {
-            data++;
-            self->ix++;
+/* Make sure at least 32 bits are buffered in b. Every 0xFF byte is followed by a
+   stuffed byte that gets skipped. Past the end of the data zeros are shifted in and
+   ix keeps counting, so parseScan can tell if the stream was truncated */
+inline static void fillBits(const u8* data, int datalen, u64* pb, int* pcnt, int* pix) {
+    u64 b = *pb;
+    int cnt = *pcnt;
+    int ix = *pix;
+    if (ix + 8 <= datalen) {
+        // Take as many whole bytes as fit, if none of them is 0xFF
+        int bytes = (63 - cnt) >> 3;
+        u64 word = 0;
+        for (int i=0;i<8;i++)
+            word = (word << 8) | data[ix+i];
+        u64 top = word >> (64 - 8*bytes);
+        u64 inv = ~top; // 0xFF bytes are zero now
+        if (((inv - 0x0101010101010101ULL) & ~inv & 0x8080808080808080ULL) == 0) {
+            *pb = (b << (8*bytes)) | top;
+            *pcnt = cnt + 8*bytes;
+            *pix = ix + bytes;
+            return;
         }
-        self->ix++;
-        self->cnt = 8;
     }
-    int bit = b >> 7;
-    self->cnt--;
-    self->b = (b << 1)&0xFF;
-    return bit;
-}
-
-static int decode(ljp* self) {
-    int i = 1;
-    int code = nextbit(self);
-    while (code > self->maxcode[i]) {
-        i++;
-        code = (code << 1) + nextbit(self);
+    while (cnt <= 56) {
+        u32 next = 0;
+        if (ix < datalen) {
+            next = data[ix];
+            if (next == 0xFF) ix++;
+        }
+        ix++;
+        b = (b << 8) | next;
+        cnt += 8;
     }
-    int j = self->valptr[i];
-    j = j + code - self->mincode[i];
-    int value = self->huffval[j];
-    return value;
+    *pb = b;
+    *pcnt = cnt;
+    *pix = ix;
 }
 
-static int receive(ljp* self,int ssss) {
-    int i = 0;
-    int v = 0;
-    while (i != ssss) {
-        i++;
-        v = (v<<1) + nextbit(self);
+/* Huffman decode one difference with table h, returns LJ92_ERROR_CORRUPT for a bad code */
+static inline __attribute__((always_inline)) int decodeDiff(const ljh* h, const u8* data, int datalen, u64* pb, int* pcnt, int* pix, int* pdiff) {
+    // Code and difference are 32 bits at most
+    if (*pcnt < 32) fillBits(data, datalen, pb, pcnt, pix);
+    u64 b = *pb;
+    int cnt = *pcnt;
+    u32 e = h->fastlut[(b >> (cnt - LJ92_FASTBITS)) & ((1 << LJ92_FASTBITS) - 1)];
+    if (e & LJ92_FAST_FULL) {
+        *pcnt = cnt - (e & 0x1F);
+        *pdiff = (int32_t)e >> 16;
+        return LJ92_ERROR_NONE;
     }
-    return v;
-}
-
-static int extend(ljp* self,int v,int t) {
-    int vt = 1<<(t-1);
-    if (v < vt) {
-        vt = (-1 << t) + 1;
-        v = v + vt;
+    int t;
+    if (e) {
+        cnt -= e & 0x1F;
+        t = e >> 8;
+    } else {
+        u16 ssssused = h->hufflut[(b >> (cnt - h->huffbits)) & ((1 << h->huffbits) - 1)];
+        cnt -= ssssused & 0xFF;
+        t = ssssused >> 8;
     }
-    return v;
+    if (t == 0) {
+        *pcnt = cnt;
+        *pdiff = 0;
+        return LJ92_ERROR_NONE;
+    }
+    if (t > 16) return LJ92_ERROR_CORRUPT;
+    cnt -= t;
+    int diff = (b >> cnt) & ((1 << t) - 1);
+    if (diff < (1 << (t-1)))
+        diff += 1 - (1 << t);
+    *pcnt = cnt;
+    *pdiff = diff;
+    return LJ92_ERROR_NONE;
 }
-#endif
 
-inline static int nextdiff(ljp* self) {
-#ifdef SLOW_HUFF
-    int t = decode(self);
-    int diff = receive(self,t);
-    diff = extend(self,diff,t);
-#else
-    u32 b = self->b;
+/* Huffman decode count differences into diffs, the components are interleaved */
+static int decodeDiffs(ljp* self, int* diffs, int count) {
+    const u8* data = self->data;
+    int datalen = self->datalen;
+    int C = self->components;
+    u64 b = self->b;
     int cnt = self->cnt;
-    int huffbits = self->huffbits;
     int ix = self->ix;
-    int next;
-    while (cnt < huffbits) {
-        next = *(u16*)&self->data[ix];
-        int one = next&0xFF;
-        int two = next>>8;
-        b = (b<<16)|(one<<8)|two;
-        cnt += 16;
-        ix += 2;
-        if (one==0xFF) {
-            //printf("%x %x %x %x %d\n",one,two,b,b>>8,cnt);
-            b >>= 8;
-            cnt -= 8;
-        } else if (two==0xFF) ix++;
-    }
-    int index = b >> (cnt - huffbits);
-    u16 ssssused = self->hufflut[index];
-    int usedbits = ssssused&0xFF;
-    int t = ssssused>>8;
-    self->sssshist[t]++;
-    cnt -= usedbits;
-    int keepbitsmask = (1 << cnt)-1;
-    b &= keepbitsmask;
-    while (cnt < t) {
-        next = *(u16*)&self->data[ix];
-        int one = next&0xFF;
-        int two = next>>8;
-        b = (b<<16)|(one<<8)|two;
-        cnt += 16;
-        ix += 2;
-        if (one==0xFF) {
-            b >>= 8;
-            cnt -= 8;
-        } else if (two==0xFF) ix++;
-    }
-    cnt -= t;
-    int diff = b >> cnt;
-    int vt = 1<<(t-1);
-    if (diff < vt) {
-        vt = (-1 << t) + 1;
-        diff += vt;
+
+    if (self->onehuff) {
+        // Same table for all components, the common case
+        const ljh* h = &self->huff[self->comphuff[0]];
+        for (int i=0;i<count;i++) {
+            if (decodeDiff(h, data, datalen, &b, &cnt, &ix, &diffs[i]) != LJ92_ERROR_NONE)
+                return LJ92_ERROR_CORRUPT;
+        }
+    } else {
+        const ljh* h[4];
+        for (int c=0;c<C;c++) h[c] = &self->huff[self->comphuff[c]];
+        for (int i=0;i<count;i+=C) {
+            for (int c=0;c<C && i+c<count;c++) {
+                if (decodeDiff(h[c], data, datalen, &b, &cnt, &ix, &diffs[i+c]) != LJ92_ERROR_NONE)
+                    return LJ92_ERROR_CORRUPT;
+            }
+        }
     }
-    keepbitsmask = (1 << cnt)-1;
-    self->b = b & keepbitsmask;
+
+    self->b = b;
     self->cnt = cnt;
     self->ix = ix;
-    //printf("%d %d\n",t,diff);
-#ifdef DEBUG
-#endif
-#endif
-    return diff;
+    return LJ92_ERROR_NONE;
 }
 
-static int parsePred6(ljp* self) {
-    int ret = LJ92_ERROR_CORRUPT;
-    self->ix = self->scanstart;
-    //int compcount = self->data[self->ix+2];
-    self->ix += BEH(self->data[self->ix]);
-    self->cnt = 0;
-    self->b = 0;
-    int write = self->writelen;
-    // Now need to decode huffman coded values
-    int c = 0;
-    int pixels = self->y * self->x;
-    u16* out = self->image;
-    u16* temprow;
-    u16* thisrow = self->outrow[0];
-    u16* lastrow = self->outrow[1];
-
-    // First pixel predicted from base value
-    int diff;
-    int Px;
-    int col = 0;
-    int row = 0;
-    int left = 0;
-    int linear;
-
-    // First pixel
-    diff = nextdiff(self);
-    Px = 1 << (self->bits-1);
-    left = Px + diff;
-    if (self->linearize)
-        linear = self->linearize[left];
+#if defined(__SSE2__)
+/* Prediction from the left is a running sum of every C'th difference.
+   Sums of four values at once, C must be 1, 2 or 4 */
+static void predictLeftSSE2(const int* v, u16* thisrow, int n, int C) {
+    int k = C;
+    // Last value of each component, repeated over the four lanes
+    __m128i carry;
+    if (C == 1)
+        carry = _mm_set1_epi32(thisrow[0]);
+    else if (C == 2)
+        carry = _mm_setr_epi32(thisrow[0], thisrow[1], thisrow[0], thisrow[1]);
     else
-        linear = left;
-    thisrow[col++] = left;
-    out[c++] = linear;
-    if (self->ix >= self->datalen) return ret;
-    --write;
-    int rowcount = self->x-1;
-    while (rowcount--) {
-        diff = nextdiff(self);
-        Px = left;
-        left = Px + diff;
-        if (self->linearize)
-            linear = self->linearize[left];
-        else
-            linear = left;
-        thisrow[col++] = left;
-        out[c++] = linear;
-        //printf("%d %d %d %d %x\n",col-1,diff,left,thisrow[col-1],&thisrow[col-1]);
-        if (self->ix >= self->datalen) return ret;
-        if (--write==0) {
-            out += self->skiplen;
-            write = self->writelen;
+        carry = _mm_setr_epi32(thisrow[0], thisrow[1], thisrow[2], thisrow[3]);
+
+    for (; k + 8 <= n; k += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)&v[k]);
+        __m128i hi = _mm_loadu_si128((const __m128i*)&v[k+4]);
+        if (C == 1) {
+            lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+            hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+        }
+        if (C <= 2) {
+            lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+            hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
         }
+        lo = _mm_add_epi32(lo, carry);
+        if (C == 1) carry = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3,3,3,3));
+        else if (C == 2) carry = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3,2,3,2));
+        else carry = lo;
+        hi = _mm_add_epi32(hi, carry);
+        if (C == 1) carry = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3,3,3,3));
+        else if (C == 2) carry = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3,2,3,2));
+        else carry = hi;
+        // Keep the low 16 bits, like storing to thisrow does
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i*)&thisrow[k], _mm_packs_epi32(lo, hi));
     }
-    temprow = lastrow;
-    lastrow = thisrow;
-    thisrow = temprow;
-    row++;
-    //printf("%x %x\n",thisrow,lastrow);
-    while (c<pixels) {
-        col = 0;
-        diff = nextdiff(self);
-        Px = lastrow[col]; // Use value above for first pixel in row
-        left = Px + diff;
+    for (; k < n; k++)
+        thisrow[k] = thisrow[k - C] + v[k];
+}
+#endif
+
+/* Turn the differences of a row into values. On return v holds the values
+   (unless linearization is off and the SSE2 path was taken) and thisrow the same as 16 bit */
+static void predictRow(ljp* self, int pred, int row, int* v, u16* thisrow, const u16* lastrow) {
+    int C = self->components;
+    int n = self->x * C;
+    int k;
+
+    // First column is predicted from the base value in the first row, from the value above otherwise
+    for (k=0;k<C && k<n;k++) {
+        v[k] += row ? lastrow[k] : 1 << (self->bits-1);
+        thisrow[k] = v[k];
+    }
+    // The first row always uses the value to the left
+    if (row == 0) pred = 1;
+
+    switch (pred) {
+        case 0: // No prediction... should not be used
+            for (k=C;k<n;k++) thisrow[k] = v[k];
+            break;
+        case 1:
+#if defined(__SSE2__)
+            if (!self->linearize && (C == 1 || C == 2 || C == 4)) {
+                predictLeftSSE2(v, thisrow, n, C);
+                break;
+            }
+#endif
+            for (k=C;k<n;k++) {
+                v[k] += thisrow[k-C];
+                thisrow[k] = v[k];
+            }
+            break;
+        case 2:
+            for (k=C;k<n;k++) {
+                v[k] += lastrow[k];
+                thisrow[k] = v[k];
+            }
+            break;
+        case 3:
+            for (k=C;k<n;k++) {
+                v[k] += lastrow[k-C];
+                thisrow[k] = v[k];
+            }
+            break;
+        case 4:
+            for (k=C;k<n;k++) {
+                v[k] += v[k-C] + lastrow[k] - lastrow[k-C];
+                thisrow[k] = v[k];
+            }
+            break;
+        case 5:
+            for (k=C;k<n;k++) {
+                v[k] += v[k-C] + ((lastrow[k] - lastrow[k-C]) >> 1);
+                thisrow[k] = v[k];
+            }
+            break;
+        case 6:
+            for (k=C;k<n;k++) {
+                v[k] += lastrow[k] + ((v[k-C] - lastrow[k-C]) >> 1);
+                thisrow[k] = v[k];
+            }
+            break;
+        case 7:
+            for (k=C;k<n;k++) {
+                v[k] += (v[k-C] + lastrow[k]) >> 1;
+                thisrow[k] = v[k];
+            }
+            break;
+    }
+}
+
+/* Copy or linearize a row to the target, skipping skiplen values after every writelen values */
+static int writeRow(ljp* self, const int* v, const u16* thisrow, int n, u16** pout, int* pwrite, int writelen) {
+    u16* out = *pout;
+    int write = *pwrite;
+    int k = 0;
+    while (k < n) {
+        int m = n - k < write ? n - k : write;
         if (self->linearize) {
-            if (left>self->linlen) return LJ92_ERROR_CORRUPT;
-            linear = self->linearize[left];
-        } else
-            linear = left;
-        thisrow[col++] = left;
-        //printf("%d %d %d %d\n",col,diff,left,lastrow[col]);
-        out[c++] = linear;
-        if (self->ix >= self->datalen) break;
-        rowcount = self->x-1;
-        if (--write==0) {
-            out += self->skiplen;
-            write = self->writelen;
-        }
-        while (rowcount--) {
-            diff = nextdiff(self);
-            Px = lastrow[col] + ((left - lastrow[col-1])>>1);
-            left = Px + diff;
-            //printf("%d %d %d %d %d %x\n",col,diff,left,lastrow[col],lastrow[col-1],&lastrow[col]);
-            if (self->linearize) {
-                if (left>self->linlen) return LJ92_ERROR_CORRUPT;
-                linear = self->linearize[left];
-            } else
-                linear = left;
-            thisrow[col++] = left;
-            out[c++] = linear;
-            if (--write==0) {
-                out += self->skiplen;
-                write = self->writelen;
+            for (int i=0;i<m;i++) {
+                int left = v[k+i];
+                if (left < 0 || left > self->linlen) return LJ92_ERROR_CORRUPT;
+                out[i] = self->linearize[left];
             }
+        } else {
+            memcpy(out, &thisrow[k], m * sizeof(u16));
+        }
+        out += m;
+        k += m;
+        write -= m;
+        if (write == 0) {
+            out += self->skiplen;
+            write = writelen;
         }
-        temprow = lastrow;
-        lastrow = thisrow;
-        thisrow = temprow;
-        if (self->ix >= self->datalen) break;
     }
-    if (c >= pixels) ret = LJ92_ERROR_NONE;
-    return ret;
+    *pout = out;
+    *pwrite = write;
+    return LJ92_ERROR_NONE;
 }
 
 static int parseScan(ljp* self) {
     int ret = LJ92_ERROR_CORRUPT;
-    memset(self->sssshist,0,sizeof(self->sssshist));
     self->ix = self->scanstart;
     int compcount = self->data[self->ix+2];
     int pred = self->data[self->ix+3+2*compcount];
     if (pred<0 || pred>7) return ret;
-    if (pred==6) return parsePred6(self); // Fast path
+    if (compcount != self->components) return ret;
+    // Table selector of each component
+    self->onehuff = 1;
+    for (int c=0;c<compcount;c++) {
+        int id = self->data[self->ix+4+2*c] >> 4;
+        if (id > 3 || self->huff[id].hufflut == NULL || self->huff[id].fastlut == NULL) return ret;
+        self->comphuff[c] = id;
+        if (id != self->comphuff[0]) self->onehuff = 0;
+    }
     self->ix += BEH(self->data[self->ix]);
     self->cnt = 0;
     self->b = 0;
+
+    // Each row is Huffman decoded first and then predicted as a whole
+    int rowlen = self->x * self->components;
+    // Predictor 6 always honoured writeLength, the others skip after each row
+    int writelen = (pred == 6) ? self->writelen : rowlen;
+    if (writelen <= 0) writelen = INT_MAX;
+    int write = writelen;
     u16* out = self->image;
-    u16* thisrow = self->outrow[0];
-    u16* lastrow = self->outrow[1];
+    u16* lastrow = NULL;
 
-    // First pixel predicted from base value
-    int diff;
-    int Px = 0;
-    int left = 0;
     for (int row = 0; row < self->y; row++) {
-        for (int col = 0; col < self->x; col++) {
-            int colx = col * self->components;
-            for (int c = 0; c < self->components; c++) {
-                if ((col==0)&&(row==0)) {
-                    Px = 1 << (self->bits-1);
-                } else if (row==0) {
-                    // Px = left;
-                    Px = thisrow[(col - 1) * self->components + c];
-                } else if (col==0) {
-                    Px = lastrow[c];  // Use value above for first pixel in row
-                } else {
-                    int prev_colx = (col - 1) * self->components;
-   
-                    switch (pred) {
-                        case 0:
-                          Px = 0;
-                          break;  // No prediction... should not be used
-                        case 1:
-                          Px = thisrow[prev_colx + c];
-                          break;
-                        case 2:
-                          Px = lastrow[colx + c];
-                          break;
-                        case 3:
-                          Px = lastrow[prev_colx + c];
-                          break;
-                        case 4:
-                          Px = left + lastrow[colx + c] - lastrow[prev_colx + c];
-                          break;
-                        case 5:
-                          Px = left + ((lastrow[colx + c] - lastrow[prev_colx + c]) >> 1);
-                          break;
-                        case 6:
-                          Px = lastrow[colx + c] + ((left - lastrow[prev_colx + c]) >> 1);
-                          break;
-                        case 7:
-                          Px = (left + lastrow[colx + c]) >> 1;
-                          break;
-                    }
-                }
-                
-                diff = nextdiff(self);
-                left = Px + diff;
-                //printf("%d %d %d\n",c,diff,left);
-                int linear;
-                if (self->linearize) {
-                    if (left>self->linlen) return LJ92_ERROR_CORRUPT;
-                    linear = self->linearize[left];
-                } else
-                    linear = left;
-
-                thisrow[colx + c] = left;
-                out[colx + c] = linear; // HACK
-            } // c
-        } // col
-
-        u16* temprow = lastrow;
+        ret = decodeDiffs(self, self->diffs, rowlen);
+        if (ret != LJ92_ERROR_NONE) return ret;
+
+        // Without linearization the row is predicted right into the target, unless a skip splits it
+        int direct = !self->linearize && write >= rowlen;
+        u16* thisrow = direct ? out : (lastrow == self->outrow[0] ? self->outrow[1] : self->outrow[0]);
+        predictRow(self, pred, row, self->diffs, thisrow, lastrow);
+        if (direct) {
+            out += rowlen;
+            write -= rowlen;
+            if (write == 0) {
+                out += self->skiplen;
+                write = writelen;
+            }
+        } else {
+            ret = writeRow(self, self->diffs, thisrow, rowlen, &out, &write, writelen);
+            if (ret != LJ92_ERROR_NONE) return ret;
+        }
         lastrow = thisrow;
-        thisrow = temprow;
-
-        out += self->x * self->components + self->skiplen;
-    } // row
+    }
 
-    ret = LJ92_ERROR_NONE;
-    return ret;
+    // Used more bits than the stream has, it was truncated
+    if (self->ix - (self->cnt >> 3) > self->datalen) return LJ92_ERROR_CORRUPT;
+    return LJ92_ERROR_NONE;
 }
-
 static int parseImage(ljp* self) {
     int ret = LJ92_ERROR_NONE;
     while (1) {
@@ -621,25 +553,16 @@ static int findSoI(ljp* self) {
 }
 
 static void free_memory(ljp* self) {
-#ifdef SLOW_HUFF
-    free(self->maxcode);
-    self->maxcode = NULL;
-    free(self->mincode);
-    self->mincode = NULL;
-    free(self->valptr);
-    self->valptr = NULL;
-    free(self->huffval);
-    self->huffval = NULL;
-    free(self->huffsize);
-    self->huffsize = NULL;
-    free(self->huffcode);
-    self->huffcode = NULL;
-#else
-    free(self->hufflut);
-    self->hufflut = NULL;
-#endif
+    for (int i=0;i<4;i++) {
+        free(self->huff[i].hufflut);
+        self->huff[i].hufflut = NULL;
+        free(self->huff[i].fastlut);
+        self->huff[i].fastlut = NULL;
+    }
     free(self->rowcache);
     self->rowcache = NULL;
+    free(self->diffs);
+    self->diffs = NULL;
 }
 
 int lj92_open(lj92* lj,
@@ -656,11 +579,13 @@ int lj92_open(lj92* lj,
 
     if (ret == LJ92_ERROR_NONE) {
         u16* rowcache = (u16*)calloc(self->x * self->components * 2, sizeof(u16));
-        if (rowcache == NULL) ret = LJ92_ERROR_NO_MEMORY;
+        int* diffs = (int*)calloc(self->x * self->components, sizeof(int));
+        self->rowcache = rowcache;
+        self->diffs = diffs;
+        if (rowcache == NULL || diffs == NULL) ret = LJ92_ERROR_NO_MEMORY;
         else {
-            self->rowcache = rowcache;
             self->outrow[0] = rowcache;
-            self->outrow[1] = &rowcache[self->x];
+            self->outrow[1] = &rowcache[self->x * self->components];
         }
     }
 
@@ -704,99 +629,125 @@ void lj92_close(lj92 lj) {
 
 typedef struct _lje {
     uint16_t* image;
+    uint16_t* delinearize;
+    uint8_t* encoded;
+    // Buffers kept between frames
+    u16* rowcache; // Previous and current row
+    int* diffs; // Differences of the current row
+    u32* symbols; // Per value: ssss | extended difference << 5
+    size_t symbolsLength;
     int width;
     int height;
     int bitdepth;
     int components;
     int readLength;
     int skipLength;
-    uint16_t* delinearize;
     int delinearizeLength;
-    uint8_t* encoded;
     int encodedWritten;
     int encodedLength;
+    int rowcacheLength;
     int hist[17]; // SSSS frequency histogram
     int bits[17];
     int huffval[17];
+    int huffsym[17];
     u16 huffenc[17];
     u16 huffbits[17];
-    int huffsym[17];
+    int reserved; // Padding
 } lje;
 
-int frequencyScan(lje* self) {
-    // Scan through the tile using the standard type 6 prediction
-    // Need to cache the previous 2 row in target coordinates because of tiling
+/* Make sure the encoded buffer has room for needed more bytes */
+static int reserveEncoded(lje* self, int needed) {
+    if (self->encodedLength - self->encodedWritten >= needed) return LJ92_ERROR_NONE;
+    int length = self->encodedLength * 2;
+    if (length < self->encodedWritten + needed) length = self->encodedWritten + needed;
+    uint8_t* encoded = realloc(self->encoded, length);
+    if (encoded == NULL) return LJ92_ERROR_NO_MEMORY;
+    self->encoded = encoded;
+    self->encodedLength = length;
+    return LJ92_ERROR_NONE;
+}
+
+static int frequencyScan(lje* self) {
+    // Scan through the tile using the standard type 6 prediction, per component.
+    // Prediction, the ssss histogram and the bits to emit are done in one pass,
+    // writeBody only has to look up the Huffman codes afterwards.
+    // Need to cache the previous row in target coordinates because of tiling
+    int C = self->components;
+    int rowlen = self->width * C;
     uint16_t* pixel = self->image;
-    int pixcount = self->width*self->height;
-    int scan = self->readLength;
-    uint16_t* rowcache = (uint16_t*)calloc(1, self->width * self->components * 4);
-    uint16_t* rows[2];
-    rows[0] = rowcache;
-    rows[1] = &rowcache[self->width];
-
-    int col = 0;
-    int row = 0;
-    int Px = 0;
-    int32_t diff = 0;
+    int readLength = self->readLength > 0 ? self->readLength : INT_MAX;
+    int scan = readLength;
+    u16* lastrow = self->rowcache;
+    u16* thisrow = self->rowcache + rowlen;
+    int* d = self->diffs;
+    u32* sym = self->symbols;
     int maxval = (1 << self->bitdepth);
-    while (pixcount--) {
-        uint16_t p = *pixel;
-        if (self->delinearize) {
-            if (p>=self->delinearizeLength) {
-                free(rowcache);
-                return LJ92_ERROR_TOO_WIDE;
+
+    memset(self->hist,0,sizeof(self->hist));
+    for (int row=0;row<self->height;row++) {
+        // Fetch the row, a skip may split it
+        for (int k=0;k<rowlen;) {
+            int m = rowlen - k < scan ? rowlen - k : scan;
+            if (self->delinearize) {
+                for (int i=0;i<m;i++) {
+                    uint16_t p = pixel[i];
+                    if (p>=self->delinearizeLength) return LJ92_ERROR_TOO_WIDE;
+                    thisrow[k+i] = self->delinearize[p];
+                }
+            } else {
+                memcpy(&thisrow[k], pixel, m * sizeof(u16));
             }
-            p = self->delinearize[p];
+            pixel += m;
+            k += m;
+            scan -= m;
+            if (scan==0) { pixel += self->skipLength; scan = readLength; }
         }
-        if (p>=maxval) {
-            free(rowcache);
-            return LJ92_ERROR_TOO_WIDE;
+        int maxp = 0;
+        for (int k=0;k<rowlen;k++)
+            maxp = thisrow[k] > maxp ? thisrow[k] : maxp;
+        if (maxp>=maxval) return LJ92_ERROR_TOO_WIDE;
+
+        // First column from the base value or the value above, then the
+        // predictor for the rest. Plain loops, the compiler vectorizes them
+        for (int k=0;k<C;k++)
+            d[k] = thisrow[k] - (row ? lastrow[k] : 1 << (self->bitdepth-1));
+        if (row == 0) {
+            for (int k=C;k<rowlen;k++)
+                d[k] = thisrow[k] - thisrow[k-C];
+        } else {
+            for (int k=C;k<rowlen;k++)
+                d[k] = thisrow[k] - (lastrow[k] + ((thisrow[k-C] - lastrow[k-C])>>1));
         }
-        rows[1][col] = p;
-
-        if ((row == 0)&&(col == 0))
-            Px = 1 << (self->bitdepth-1);
-        else if (row == 0)
-            Px = rows[1][col-1];
-        else if (col == 0)
-            Px = rows[0][col];
-        else
-            Px = rows[0][col] + ((rows[1][col-1] - rows[0][col-1])>>1);
-        diff = rows[1][col] - Px;
-        int ssss = 32 - __builtin_clz(abs(diff));
-        if (diff==0) ssss=0;
-        self->hist[ssss]++;
-        //printf("%d %d %d %d %d %d\n",col,row,p,Px,diff,ssss);
-        pixel++;
-        scan--;
-        col++;
-        if (scan==0) { pixel += self->skipLength; scan = self->readLength; }
-        if (col==self->width) {
-            uint16_t* tmprow = rows[1];
-            rows[1] = rows[0];
-            rows[0] = tmprow;
-            col=0;
-            row++;
+
+        for (int k=0;k<rowlen;k++) {
+            int diff = d[k];
+            int ssss = diff ? 32 - __builtin_clz(abs(diff)) : 0;
+            if (ssss>16) return LJ92_ERROR_TOO_WIDE;
+            self->hist[ssss]++;
+            if (diff<0) diff += (1 << ssss)-1;
+            sym[k] = ssss | ((u32)diff << 5);
         }
+        sym += rowlen;
+
+        u16* tmprow = lastrow;
+        lastrow = thisrow;
+        thisrow = tmprow;
     }
 #ifdef DEBUG
-    int sort[17];
     for (int h=0;h<17;h++) {
-        sort[h] = h;
         printf("%d:%d\n",h,self->hist[h]);
     }
 #endif
-    free(rowcache);
     return LJ92_ERROR_NONE;
 }
 
-void createEncodeTable(lje* self) {
+static void createEncodeTable(lje* self) {
     float freq[18];
     int codesize[18];
     int others[18];
 
     // Calculate frequencies
-    float totalpixels = self->width * self->height;
+    float totalpixels = (float)self->width * self->height * self->components;
     for (int i=0;i<17;i++) {
         freq[i] = (float)(self->hist[i])/totalpixels;
 #ifdef DEBUG
@@ -941,7 +892,7 @@ void createEncodeTable(lje* self) {
 #endif
 }
 
-void writeHeader(lje* self) {
+static void writeHeader(lje* self) {
     int w = self->encodedWritten;
     uint8_t* e = self->encoded;
     e[w++] = 0xff; e[w++] = 0xd8; //SOI
@@ -961,159 +912,127 @@ void writeHeader(lje* self) {
         }
     e[w++] = 0xff; e[w++] = 0xc3; //SOF3
         // Write SOF
-        e[w++] = 0x0; e[w++] = 11; //Lf, frame header length
+        e[w++] = 0x0; e[w++] = 8+3*self->components; //Lf, frame header length
         e[w++] = self->bitdepth;
         e[w++] = self->height>>8; e[w++] = self->height&0xFF;
         e[w++] = self->width>>8; e[w++] = self->width&0xFF;
-        e[w++] = 1; // Components
-        e[w++] = 0; // Component ID
-        e[w++] = 0x11; // Component X/Y
-        e[w++] = 0; // Unused (Quantisation)
+        e[w++] = self->components; // Components
+        for (int c=0;c<self->components;c++) {
+            e[w++] = c; // Component ID
+            e[w++] = 0x11; // Component X/Y
+            e[w++] = 0; // Unused (Quantisation)
+        }
     e[w++] = 0xff; e[w++] = 0xda; //SCAN
     // Write SCAN
-        e[w++] = 0x0; e[w++] = 8; //Ls, scan header length
-        e[w++] = 1; // Components
-        e[w++] = 0; //
-        e[w++] = 0; //
+        e[w++] = 0x0; e[w++] = 6+2*self->components; //Ls, scan header length
+        e[w++] = self->components; // Components
+        for (int c=0;c<self->components;c++) {
+            e[w++] = c; // Component ID
+            e[w++] = 0; // Huffman table 0
+        }
         e[w++] = 6; // Predictor
         e[w++] = 0; //
         e[w++] = 0; //
     self->encodedWritten = w;
 }
 
-void writePost(lje* self) {
+static void writePost(lje* self) {
     int w = self->encodedWritten;
     uint8_t* e = self->encoded;
     e[w++] = 0xff; e[w++] = 0xd9; //EOI
     self->encodedWritten = w;
 }
 
-void writeBody(lje* self) {
-    // Scan through the tile using the standard type 6 prediction
-    // Need to cache the previous 2 row in target coordinates because of tiling
-    uint16_t* pixel = self->image;
-    int pixcount = self->width*self->height;
-    int scan = self->readLength;
-    uint16_t* rowcache = (uint16_t*)calloc(1, self->width * self->components * 4);
-    uint16_t* rows[2];
-    rows[0] = rowcache;
-    rows[1] = &rowcache[self->width];
-
-    int col = 0;
-    int row = 0;
-    int Px = 0;
-    int32_t diff = 0;
-    int bitcount = 0;
-    uint8_t* out = self->encoded;
-    int w = self->encodedWritten;
-    uint8_t next = 0;
-    uint8_t nextbits = 8;
-    while (pixcount--) {
-        uint16_t p = *pixel;
-        if (self->delinearize) p = self->delinearize[p];
-        rows[1][col] = p;
-
-        if ((row == 0)&&(col == 0))
-            Px = 1 << (self->bitdepth-1);
-        else if (row == 0)
-            Px = rows[1][col-1];
-        else if (col == 0)
-            Px = rows[0][col];
-        else
-            Px = rows[0][col] + ((rows[1][col-1] - rows[0][col-1])>>1);
-        diff = rows[1][col] - Px;
-        int ssss = 32 - __builtin_clz(abs(diff));
-        if (diff==0) ssss=0;
-        //printf("%d %d %d %d %d\n",col,row,Px,diff,ssss);
-
-        // Write the huffman code for the ssss value
-        int huffcode = self->huffsym[ssss];
-        int huffenc = self->huffenc[huffcode];
-        int huffbits = self->huffbits[huffcode];
-        bitcount += huffbits + ssss;
-
-        int vt = ssss>0?(1<<(ssss-1)):0;
-        //printf("%d %d %d %d\n",rows[1][col],Px,diff,Px+diff);
-#ifdef DEBUG
-#endif
-        if (diff < vt)
-            diff += (1 << (ssss))-1;
-
-        // Write the ssss
-        while (huffbits>0) {
-            int usebits = huffbits>nextbits?nextbits:huffbits;
-            // Add top usebits from huffval to next usebits of nextbits
-            int tophuff = huffenc >> (huffbits - usebits);
-            next |= (tophuff << (nextbits-usebits));
-            nextbits -= usebits;
-            huffbits -= usebits;
-            huffenc &= (1<<huffbits)-1;
-            if (nextbits==0) {
-                out[w++] = next;
-                if (next==0xff) out[w++] = 0x0;
-                next = 0;
-                nextbits = 8;
-            }
-        }
-        // Write the rest of the bits for the value
-
-        while (ssss>0) {
-            int usebits = ssss>nextbits?nextbits:ssss;
-            // Add top usebits from huffval to next usebits of nextbits
-            int tophuff = diff >> (ssss - usebits);
-            next |= (tophuff << (nextbits-usebits));
-            nextbits -= usebits;
-            ssss -= usebits;
-            diff &= (1<<ssss)-1;
-            if (nextbits==0) {
-                out[w++] = next;
-                if (next==0xff) out[w++] = 0x0;
-                next = 0;
-                nextbits = 8;
-            }
-        }
+static int writeBody(lje* self) {
+    // Huffman code and its length for every ssss
+    u32 code[17];
+    int codelen[17];
+    for (int s=0;s<17;s++) {
+        int huffcode = self->huffsym[s];
+        code[s] = self->huffenc[huffcode];
+        codelen[s] = self->huffbits[huffcode];
+    }
 
-        //printf("%d %d\n",diff,ssss);
-        pixel++;
-        scan--;
-        col++;
-        if (scan==0) { pixel += self->skipLength; scan = self->readLength; }
-        if (col==self->width) {
-            uint16_t* tmprow = rows[1];
-            rows[1] = rows[0];
-            rows[0] = tmprow;
-            col=0;
-            row++;
+    int rowlen = self->width * self->components;
+    const u32* sym = self->symbols;
+    u64 acc = 0; // Pending bits, the lowest cnt bits are valid
+    int cnt = 0;
+    for (int row=0;row<self->height;row++) {
+        // At most 32 bits per value, stuffing may double that
+        int ret = reserveEncoded(self, rowlen * 8 + 16);
+        if (ret != LJ92_ERROR_NONE) return ret;
+        uint8_t* out = self->encoded;
+        int w = self->encodedWritten;
+
+        for (int k=0;k<rowlen;k++) {
+            u32 s = sym[k];
+            int ssss = s & 0x1F;
+            acc = (acc << (codelen[ssss] + ssss)) | ((u64)code[ssss] << ssss) | (s >> 5);
+            cnt += codelen[ssss] + ssss;
+            if (cnt >= 32) {
+                // Four bytes at once, unless one of them needs a stuffed zero
+                cnt -= 32;
+                u32 word = (u32)(acc >> cnt);
+                u32 inv = ~word;
+                if (((inv - 0x01010101u) & ~inv & 0x80808080u) == 0) {
+                    out[w++] = word >> 24;
+                    out[w++] = word >> 16;
+                    out[w++] = word >> 8;
+                    out[w++] = word;
+                } else {
+                    for (int shift=24;shift>=0;shift-=8) {
+                        uint8_t next = word >> shift;
+                        out[w++] = next;
+                        if (next==0xff) out[w++] = 0x0;
+                    }
+                }
+            }
         }
+        sym += rowlen;
+        self->encodedWritten = w;
     }
-    // Flush the final bits
-    if (nextbits<8) {
+
+    // Flush the final bits, padded with zeros
+    uint8_t* out = self->encoded;
+    int w = self->encodedWritten;
+    while (cnt > 0) {
+        uint8_t next = cnt >= 8 ? (uint8_t)(acc >> (cnt - 8)) : (uint8_t)(acc << (8 - cnt));
         out[w++] = next;
         if (next==0xff) out[w++] = 0x0;
+        cnt -= 8;
     }
-#ifdef DEBUG
-    int sort[17];
-    for (int h=0;h<17;h++) {
-        sort[h] = h;
-        printf("%d:%d\n",h,self->hist[h]);
-    }
-    printf("Total bytes: %d\n",bitcount>>3);
-#endif
-    free(rowcache);
     self->encodedWritten = w;
+    return LJ92_ERROR_NONE;
 }
-/* Encoder
- * Read tile from an image and encode in one shot
- * Return the encoded data
- */
-int lj92_encode(uint16_t* image, int width, int height, int bitdepth, int components,
-                int readLength, int skipLength,
-                uint16_t* delinearize,int delinearizeLength,
-                uint8_t** encoded, int* encodedLength) {
-    int ret = LJ92_ERROR_NONE;
 
+int lj92_encoder_open(lj92_encoder* enc) {
     lje* self = (lje*)calloc(sizeof(lje),1);
+    *enc = self;
     if (self==NULL) return LJ92_ERROR_NO_MEMORY;
+    return LJ92_ERROR_NONE;
+}
+
+void lj92_encoder_close(lj92_encoder enc) {
+    lje* self = enc;
+    if (self == NULL) return;
+    free(self->encoded);
+    free(self->rowcache);
+    free(self->diffs);
+    free(self->symbols);
+    free(self);
+}
+
+int lj92_encoder_encode(lj92_encoder enc,
+                        uint16_t* image, int width, int height, int bitdepth, int components,
+                        int readLength, int skipLength,
+                        uint16_t* delinearize,int delinearizeLength,
+                        uint8_t** encoded, int* encodedLength) {
+    int ret = LJ92_ERROR_NONE;
+    lje* self = enc;
+    if (self == NULL) return LJ92_ERROR_BAD_HANDLE;
+    if (width < 1 || width > 0xFFFF || height < 1 || height > 0xFFFF) return LJ92_ERROR_TOO_WIDE;
+    if (bitdepth < 1 || bitdepth > 16 || components < 1 || components > 4) return LJ92_ERROR_TOO_WIDE;
+
     self->image = image;
     self->width = width;
     self->height = height;
@@ -1123,35 +1042,75 @@ int lj92_encode(uint16_t* image, int width, int height, int bitdepth, int compon
     self->delinearize = delinearize;
     self->delinearizeLength = delinearizeLength;
     self->components = components;
-    self->encodedLength = width*height*components+200;
-    self->encoded = malloc(self->encodedLength);
-    if (self->encoded==NULL) { free(self); return LJ92_ERROR_NO_MEMORY; }
+
+    // Grow the buffers if this frame is larger than the previous ones
+    int rowlen = width * components;
+    if (self->rowcacheLength < rowlen) {
+        free(self->rowcache);
+        free(self->diffs);
+        self->rowcache = (u16*)malloc(rowlen * 2 * sizeof(u16));
+        self->diffs = (int*)malloc(rowlen * sizeof(int));
+        self->rowcacheLength = (self->rowcache && self->diffs) ? rowlen : 0;
+        if (!self->rowcacheLength) return LJ92_ERROR_NO_MEMORY;
+    }
+    size_t values = (size_t)rowlen * height;
+    if (self->symbolsLength < values) {
+        free(self->symbols);
+        self->symbols = (u32*)malloc(values * sizeof(u32));
+        self->symbolsLength = self->symbols ? values : 0;
+        if (self->symbols == NULL) return LJ92_ERROR_NO_MEMORY;
+    }
+    self->encodedWritten = 0;
+    // Room for the headers, writeBody grows it as needed
+    ret = reserveEncoded(self, 1024);
+    if (ret != LJ92_ERROR_NONE) return ret;
+
     // Scan through data to gather frequencies of ssss prefixes
     ret = frequencyScan(self);
-    if (ret != LJ92_ERROR_NONE) {
-        free(self->encoded);
-        free(self);
-        return ret;
-    }
+    if (ret != LJ92_ERROR_NONE) return ret;
 
     createEncodeTable(self);
     // Write JPEG head and scan header
     writeHeader(self);
     // Scan through and do the compression
-    writeBody(self);
+    ret = writeBody(self);
+    if (ret != LJ92_ERROR_NONE) return ret;
     // Finish
+    ret = reserveEncoded(self, 2);
+    if (ret != LJ92_ERROR_NONE) return ret;
     writePost(self);
 #ifdef DEBUG
     printf("written:%d\n",self->encodedWritten);
 #endif
-    self->encoded = realloc(self->encoded,self->encodedWritten);
-    self->encodedLength = self->encodedWritten;
     *encoded = self->encoded;
-    *encodedLength = self->encodedLength;
-
-    free(self);
-
+    *encodedLength = self->encodedWritten;
     return ret;
 }
 
-
+/* Encoder
+ * Read tile from an image and encode in one shot
+ * Return the encoded data
+ */
+int lj92_encode(uint16_t* image, int width, int height, int bitdepth, int components,
+                int readLength, int skipLength,
+                uint16_t* delinearize,int delinearizeLength,
+                uint8_t** encoded, int* encodedLength) {
+    lj92_encoder enc;
+    int ret = lj92_encoder_open(&enc);
+    if (ret != LJ92_ERROR_NONE) return ret;
+
+    uint8_t* data = NULL;
+    int length = 0;
+    ret = lj92_encoder_encode(enc, image, width, height, bitdepth, components,
+                              readLength, skipLength, delinearize, delinearizeLength,
+                              &data, &length);
+    if (ret == LJ92_ERROR_NONE) {
+        // Hand the buffer over to the caller
+        uint8_t* shrunk = realloc(data, length);
+        *encoded = shrunk ? shrunk : data;
+        *encodedLength = length;
+        enc->encoded = NULL;
+    }
+    lj92_encoder_close(enc);
+    return ret;
+}
@@ -57,14 +57,35 @@ int lj92_decode(lj92 lj,
                 uint16_t* target, int writeLength, int skipLength, // The image is written to target as a tile
                 uint16_t* linearize, int linearizeLength); // If not null, linearize the data using this table
 
+typedef struct _lje* lj92_encoder;
+
 /*
- * Encode a grayscale image supplied as 16bit values within the given bitdepth
- * Read from tile in the image
+ * Encode an image supplied as 16bit values within the given bitdepth
+ * Width is in pixels, each pixel has components interleaved values (1 to 4)
+ * Read from tile in the image: readLength 16bit values, then skip skipLength values
  * Apply delinearization if given
- * Return the encoded lossless JPEG stream
+ * Return the encoded lossless JPEG stream, to be freed by the caller
  */
 int lj92_encode(uint16_t* image, int width, int height, int bitdepth, int components,
                 int readLength, int skipLength,
                 uint16_t* delinearize,int delinearizeLength,
                 uint8_t** encoded, int* encodedLength);
+
+/* Create an encoder that keeps its buffers between frames.
+ * Use one encoder per thread, it must be closed with lj92_encoder_close
+ */
+int lj92_encoder_open(lj92_encoder* enc);
+
+/* Release an encoder and its buffers */
+void lj92_encoder_close(lj92_encoder enc);
+
+/*
+ * Same as lj92_encode, but the encoded stream belongs to the encoder
+ * and stays valid until the next call or until it is closed
+ */
+int lj92_encoder_encode(lj92_encoder enc,
+                        uint16_t* image, int width, int height, int bitdepth, int components,
+                        int readLength, int skipLength,
+                        uint16_t* delinearize, int delinearizeLength,
+                        uint8_t** encoded, int* encodedLength);
 #endif
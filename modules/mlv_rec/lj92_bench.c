@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  LJ92 decoder and encoder throughput benchmark.
+
+  decodes the LJ92 compressed frames of a .MLV file (or synthetic frames encoded with
+  lj92_encode if no file is given) over and over and prints the throughput.
+  with -e the decoded frames get encoded instead, using 'components' interleaved components.
+  with -i the decoded frames get encoded with the inter-frame codec (mlv_dump -e), a keyframe every
+  'keyframes' frames, and its size and decoding speed are compared with the LJ92 frames. the synthetic
+  frames are a static scene then, only the noise changes like with a camera on a tripod.
+  the checksum of the decoded frames or encoded streams allows comparing the output of two builds.
+
+  lj92_bench [-e] [-i keyframes] [-c components] [-n frames] [-r repeats] [-s WxH] [file.mlv]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <raw.h>
+#include "mlv.h"
+#include "lj92.h"
+#include "interframe.h"
+
+typedef struct
+{
+    uint8_t *data;
+    int size;
+    int reserved;   /* padding */
+} bench_frame_t;
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* read up to max_frames LJ92 compressed VIDF payloads of the given file */
+static int load_frames(char *filename, bench_frame_t *frames, int max_frames)
+{
+    FILE *in_file = fopen(filename, "rb");
+    mlv_file_hdr_t file_hdr;
+    int count = 0;
+
+    if(!in_file)
+    {
+        fprintf(stderr, "Failed to open '%s'\n", filename);
+        return -1;
+    }
+
+    if(fread(&file_hdr, sizeof(file_hdr), 1, in_file) != 1 || memcmp(file_hdr.fileMagic, "MLVI", 4))
+    {
+        fprintf(stderr, "'%s' is no MLV file\n", filename);
+        fclose(in_file);
+        return -1;
+    }
+
+    if(!(file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92))
+    {
+        fprintf(stderr, "'%s' has no LJ92 compressed frames\n", filename);
+        fclose(in_file);
+        return -1;
+    }
+
+    fseeko(in_file, file_hdr.blockSize, SEEK_SET);
+
+    while(count < max_frames)
+    {
+        mlv_vidf_hdr_t vidf_hdr;
+        mlv_hdr_t hdr;
+        int64_t position = ftello(in_file);
+
+        if(fread(&hdr, sizeof(hdr), 1, in_file) != 1 || hdr.blockSize < sizeof(hdr))
+        {
+            break;
+        }
+
+        if(!memcmp(hdr.blockType, "VIDF", 4) && hdr.blockSize > sizeof(vidf_hdr))
+        {
+            fseeko(in_file, position, SEEK_SET);
+            if(fread(&vidf_hdr, sizeof(vidf_hdr), 1, in_file) != 1 || vidf_hdr.frameSpace > vidf_hdr.blockSize - sizeof(vidf_hdr))
+            {
+                break;
+            }
+
+            int size = vidf_hdr.blockSize - sizeof(vidf_hdr) - vidf_hdr.frameSpace;
+            uint8_t *data = malloc(size);
+
+            fseeko(in_file, vidf_hdr.frameSpace, SEEK_CUR);
+            if(!data || fread(data, size, 1, in_file) != 1)
+            {
+                free(data);
+                break;
+            }
+
+            frames[count].data = data;
+            frames[count].size = size;
+            count++;
+        }
+
+        fseeko(in_file, position + hdr.blockSize, SEEK_SET);
+    }
+
+    fclose(in_file);
+    return count;
+}
+
+/* 14 bit bayer data with some structure and noise, laid out like mlv_dump compresses it. the structure moves unless 'still' */
+static int synth_frames(int width, int height, bench_frame_t *frames, int count, int still)
+{
+    uint16_t *image = malloc(width * height * sizeof(uint16_t));
+    uint32_t seed = 0x4C4A3932;
+
+    if(!image)
+    {
+        return -1;
+    }
+
+    for(int frame = 0; frame < count; frame++)
+    {
+        for(int y = 0; y < height; y++)
+        {
+            for(int x = 0; x < width; x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                int base = 2048 + ((x * 7 + y * 3 + (still ? 0 : frame * 64)) % 4096) + ((x & 1) ^ (y & 1)) * 1500;
+                int noise = (int)((seed >> 16) % 257) - 128;
+                image[y * width + x] = (base + noise) & 0x3FFF;
+            }
+        }
+
+        if(lj92_encode(image, width * 2, height / 2, 14, 1, width * height, 0, NULL, 0, &frames[frame].data, &frames[frame].size) != LJ92_ERROR_NONE)
+        {
+            free(image);
+            return -1;
+        }
+    }
+
+    free(image);
+    return count;
+}
+
+/* FNV-1a hash, to compare the output of different builds */
+static uint32_t checksum_update(uint32_t checksum, const uint8_t *data, size_t size)
+{
+    for(size_t pos = 0; pos < size; pos++)
+    {
+        checksum = (checksum ^ data[pos]) * 16777619u;
+    }
+    return checksum;
+}
+
+/* decode a frame into a newly allocated buffer */
+static uint16_t *decode_frame(bench_frame_t *frame, int *width, int *height, int *bitdepth, int *components)
+{
+    lj92 handle;
+
+    if(lj92_open(&handle, frame->data, frame->size, width, height, bitdepth, components) != LJ92_ERROR_NONE)
+    {
+        return NULL;
+    }
+
+    int values = *width * *height * *components;
+    uint16_t *decoded = malloc(values * sizeof(uint16_t));
+
+    if(decoded && lj92_decode(handle, decoded, values, 0, NULL, 0) != LJ92_ERROR_NONE)
+    {
+        free(decoded);
+        decoded = NULL;
+    }
+    lj92_close(handle);
+
+    return decoded;
+}
+
+static int bench_decode(bench_frame_t *frames, int frame_count, int repeats)
+{
+    /* all frames are decoded into one buffer, sized for the largest */
+    size_t buffer_size = 0;
+    uint64_t compressed = 0;
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        lj92 handle;
+        int lj92_width = 0, lj92_height = 0, lj92_bitdepth = 0, lj92_components = 0;
+
+        if(lj92_open(&handle, frames[frame].data, frames[frame].size, &lj92_width, &lj92_height, &lj92_bitdepth, &lj92_components) != LJ92_ERROR_NONE)
+        {
+            fprintf(stderr, "Frame %d: lj92_open failed\n", frame);
+            return 1;
+        }
+        lj92_close(handle);
+
+        size_t size = (size_t)lj92_width * lj92_height * lj92_components;
+        if(size > buffer_size)
+        {
+            buffer_size = size;
+        }
+        compressed += frames[frame].size;
+    }
+
+    uint16_t *decoded = malloc(buffer_size * sizeof(uint16_t));
+    uint64_t pixels = 0;
+    uint32_t checksum = 2166136261u;
+    double start = get_time();
+
+    for(int run = 0; run < repeats; run++)
+    {
+        for(int frame = 0; frame < frame_count; frame++)
+        {
+            lj92 handle;
+            int lj92_width = 0, lj92_height = 0, lj92_bitdepth = 0, lj92_components = 0;
+
+            lj92_open(&handle, frames[frame].data, frames[frame].size, &lj92_width, &lj92_height, &lj92_bitdepth, &lj92_components);
+
+            int values = lj92_width * lj92_height * lj92_components;
+            int ret = lj92_decode(handle, decoded, values, 0, NULL, 0);
+            lj92_close(handle);
+
+            if(ret != LJ92_ERROR_NONE)
+            {
+                fprintf(stderr, "Frame %d: lj92_decode failed (%d)\n", frame, ret);
+                free(decoded);
+                return 1;
+            }
+
+            /* the first run provides the checksum */
+            if(run == 0)
+            {
+                checksum = checksum_update(checksum, (uint8_t *)decoded, values * sizeof(uint16_t));
+            }
+            pixels += values;
+        }
+    }
+
+    double duration = get_time() - start;
+
+    printf("Compressed: %.2f MiB per run\n", compressed / 1048576.0);
+    printf("Time:       %.3f s\n", duration);
+    printf("Throughput: %.1f Mpixel/s, %.1f MiB/s compressed, %.1f fps\n",
+           pixels / duration / 1000000.0, compressed * repeats / duration / 1048576.0, frame_count * repeats / duration);
+    printf("Checksum:   %08X\n", checksum);
+
+    free(decoded);
+    return 0;
+}
+
+static int bench_encode(bench_frame_t *frames, int frame_count, int repeats, int components)
+{
+    uint16_t **images = calloc(frame_count, sizeof(uint16_t *));
+    int *widths = calloc(frame_count, sizeof(int));
+    int *heights = calloc(frame_count, sizeof(int));
+    int *bitdepths = calloc(frame_count, sizeof(int));
+    uint64_t pixels = 0;
+    uint64_t compressed = 0;
+    uint32_t checksum = 2166136261u;
+    lj92_encoder encoder = NULL;
+    int ret = 1;
+
+    if(!images || !widths || !heights || !bitdepths || lj92_encoder_open(&encoder) != LJ92_ERROR_NONE)
+    {
+        goto done;
+    }
+
+    /* decode the frames once, the row length (two bayer lines) stays the same for any component count */
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        int lj92_components = 0;
+
+        images[frame] = decode_frame(&frames[frame], &widths[frame], &heights[frame], &bitdepths[frame], &lj92_components);
+        if(!images[frame])
+        {
+            fprintf(stderr, "Frame %d: decoding failed\n", frame);
+            goto done;
+        }
+
+        widths[frame] *= lj92_components;
+        if(widths[frame] % components)
+        {
+            fprintf(stderr, "Frame %d: %d values per row cannot be split into %d components\n", frame, widths[frame], components);
+            goto done;
+        }
+        widths[frame] /= components;
+    }
+
+    double start = get_time();
+
+    for(int run = 0; run < repeats; run++)
+    {
+        for(int frame = 0; frame < frame_count; frame++)
+        {
+            uint8_t *encoded = NULL;
+            int encoded_size = 0;
+            int values = widths[frame] * heights[frame] * components;
+
+            if(lj92_encoder_encode(encoder, images[frame], widths[frame], heights[frame], bitdepths[frame], components, values, 0, NULL, 0, &encoded, &encoded_size) != LJ92_ERROR_NONE)
+            {
+                fprintf(stderr, "Frame %d: lj92_encoder_encode failed\n", frame);
+                goto done;
+            }
+
+            if(run == 0)
+            {
+                checksum = checksum_update(checksum, encoded, encoded_size);
+                compressed += encoded_size;
+                pixels += values;
+            }
+        }
+    }
+
+    double duration = get_time() - start;
+
+    printf("Encoded:    %.2f MiB per run, %.2f bits per pixel, %d components\n", compressed / 1048576.0, compressed * 8.0 / pixels, components);
+    printf("Time:       %.3f s\n", duration);
+    printf("Throughput: %.1f Mpixel/s, %.1f fps\n", pixels * repeats / duration / 1000000.0, frame_count * repeats / duration);
+    printf("Checksum:   %08X\n", checksum);
+    ret = 0;
+
+done:
+    for(int frame = 0; images && frame < frame_count; frame++)
+    {
+        free(images[frame]);
+    }
+    free(images);
+    free(widths);
+    free(heights);
+    free(bitdepths);
+    lj92_encoder_close(encoder);
+    return ret;
+}
+
+/* size and decoding speed of the inter-frame codec compared to the LJ92 frames */
+static int bench_inter(bench_frame_t *frames, int frame_count, int repeats, uint32_t keyframes, int components)
+{
+    uint16_t **images = calloc(frame_count, sizeof(uint16_t *));
+    bench_frame_t *inter = calloc(frame_count, sizeof(bench_frame_t));
+    inter_encoder_t *encoder = NULL;
+    inter_ref_t ref = { 0 };
+    uint16_t *decoded = NULL;
+    int xRes = 0;
+    int yRes = 0;
+    int bitdepth = 0;
+    int types[3] = { 0, 0, 0 };
+    uint64_t lj92_size = 0;
+    uint64_t inter_size = 0;
+    uint32_t checksum = 2166136261u;
+    int ret = 1;
+
+    if(!images || !inter || inter_encoder_open(&encoder) != LJ92_ERROR_NONE)
+    {
+        goto done;
+    }
+
+    /* two bayer lines per LJ92 row, the inter-frame codec works on the bayer frame */
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        int width = 0, height = 0, lj92_components = 0;
+
+        images[frame] = decode_frame(&frames[frame], &width, &height, &bitdepth, &lj92_components);
+        if(!images[frame] || (frame && (width * lj92_components / 2 != xRes || height * 2 != yRes)))
+        {
+            fprintf(stderr, "Frame %d: decoding failed\n", frame);
+            goto done;
+        }
+        xRes = width * lj92_components / 2;
+        yRes = height * 2;
+        lj92_size += frames[frame].size;
+    }
+
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        uint32_t key_distance = frame % keyframes;
+        uint8_t *encoded = NULL;
+        int encoded_size = 0;
+
+        if(inter_encode(encoder, images[frame], &ref, key_distance, xRes, yRes, bitdepth, components, &encoded, &encoded_size) != LJ92_ERROR_NONE ||
+           (!key_distance && inter_ref_set(&ref, images[frame], frame, xRes, yRes) != LJ92_ERROR_NONE))
+        {
+            fprintf(stderr, "Frame %d: inter_encode failed\n", frame);
+            goto done;
+        }
+
+        inter[frame].data = malloc(encoded_size);
+        inter[frame].size = encoded_size;
+        if(!inter[frame].data)
+        {
+            goto done;
+        }
+        memcpy(inter[frame].data, encoded, encoded_size);
+        inter_size += encoded_size;
+        checksum = checksum_update(checksum, encoded, encoded_size);
+    }
+
+    /* decode like mlv_dump does, every keyframe once into the reference */
+    decoded = malloc(xRes * yRes * sizeof(uint16_t));
+    inter_ref_free(&ref);
+    if(!decoded)
+    {
+        goto done;
+    }
+
+    double start = get_time();
+
+    for(int run = 0; run < repeats; run++)
+    {
+        for(int frame = 0; frame < frame_count; frame++)
+        {
+            int frame_type = 0;
+            uint32_t key_frame = 0;
+            int err = inter_frame_info(inter[frame].data, inter[frame].size, frame, &frame_type, &key_frame);
+
+            if(!err && frame_type == INTER_FRAME_KEY)
+            {
+                err = inter_decode_key(inter[frame].data, inter[frame].size, frame, &ref, xRes, yRes);
+            }
+            if(!err)
+            {
+                err = inter_decode(inter[frame].data, inter[frame].size, frame, &ref, decoded, xRes, yRes);
+            }
+            if(err)
+            {
+                fprintf(stderr, "Frame %d: inter_decode failed (%d)\n", frame, err);
+                goto done;
+            }
+
+            if(run == 0)
+            {
+                types[frame_type]++;
+                if(memcmp(decoded, images[frame], xRes * yRes * sizeof(uint16_t)))
+                {
+                    fprintf(stderr, "Frame %d: decoded frame differs\n", frame);
+                    goto done;
+                }
+            }
+        }
+    }
+
+    double inter_duration = get_time() - start;
+
+    start = get_time();
+    for(int run = 0; run < repeats; run++)
+    {
+        for(int frame = 0; frame < frame_count; frame++)
+        {
+            lj92 handle;
+            int width = 0, height = 0, lj92_bitdepth = 0, lj92_components = 0;
+
+            lj92_open(&handle, frames[frame].data, frames[frame].size, &width, &height, &lj92_bitdepth, &lj92_components);
+            lj92_decode(handle, decoded, width * height * lj92_components, 0, NULL, 0);
+            lj92_close(handle);
+        }
+    }
+    double lj92_duration = get_time() - start;
+
+    uint64_t pixels = (uint64_t)xRes * yRes * frame_count;
+
+    printf("Frame size: %dx%d, %d bpp, keyframe every %d frames (%d key, %d intra, %d predicted)\n", xRes, yRes, bitdepth, keyframes, types[INTER_FRAME_KEY], types[INTER_FRAME_INTRA], types[INTER_FRAME_PRED]);
+    printf("LJ92:       %.2f MiB, %.2f bits per pixel, decoding %.1f Mpixel/s, %.1f fps\n",
+           lj92_size / 1048576.0, lj92_size * 8.0 / pixels, pixels * repeats / lj92_duration / 1000000.0, frame_count * repeats / lj92_duration);
+    printf("Inter:      %.2f MiB, %.2f bits per pixel, decoding %.1f Mpixel/s, %.1f fps\n",
+           inter_size / 1048576.0, inter_size * 8.0 / pixels, pixels * repeats / inter_duration / 1000000.0, frame_count * repeats / inter_duration);
+    printf("Ratio:      %.1f%% of LJ92, lossless\n", inter_size * 100.0 / lj92_size);
+    printf("Checksum:   %08X\n", checksum);
+    ret = 0;
+
+done:
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        if(images)
+        {
+            free(images[frame]);
+        }
+        if(inter)
+        {
+            free(inter[frame].data);
+        }
+    }
+    free(images);
+    free(inter);
+    free(decoded);
+    inter_ref_free(&ref);
+    inter_encoder_close(encoder);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_frames = 50;
+    int repeats = 10;
+    int width = 1920;
+    int height = 1080;
+    int encode = 0;
+    int keyframes = 0;
+    int components = 1;
+    char *filename = NULL;
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-e"))
+        {
+            encode = 1;
+        }
+        else if(!strcmp(argv[pos], "-i") && pos + 1 < argc)
+        {
+            keyframes = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-c") && pos + 1 < argc)
+        {
+            components = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-n") && pos + 1 < argc)
+        {
+            max_frames = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-r") && pos + 1 < argc)
+        {
+            repeats = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-s") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else if(argv[pos][0] != '-' && !filename)
+        {
+            filename = argv[pos];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-e] [-i keyframes] [-c components] [-n frames] [-r repeats] [-s WxH] [file.mlv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(max_frames < 1 || repeats < 1 || keyframes < 0 || (components != 1 && components != 2 && components != 4) || width < 2 || height < 2 || (height & 1))
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    bench_frame_t *frames = calloc(max_frames, sizeof(bench_frame_t));
+    int frame_count = filename ? load_frames(filename, frames, max_frames) : synth_frames(width, height, frames, max_frames, keyframes > 0);
+
+    if(frame_count <= 0)
+    {
+        fprintf(stderr, "No frames to decode\n");
+        return 1;
+    }
+
+    printf("Frames:     %d%s, %d runs\n", frame_count, filename ? "" : " (synthetic)", repeats);
+
+    int ret = 0;
+
+    if(keyframes)
+    {
+        ret = bench_inter(frames, frame_count, repeats, keyframes, components);
+    }
+    else
+    {
+        ret = encode ? bench_encode(frames, frame_count, repeats, components) : bench_decode(frames, frame_count, repeats);
+    }
+
+    for(int frame = 0; frame < frame_count; frame++)
+    {
+        free(frames[frame].data);
+    }
+    free(frames);
+
+    return ret;
+}
@@ -0,0 +1,1000 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua_hooks.h"
+
+#if defined(USE_LUA)
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#include "raw_proc/bitpack.h"
+
+/* LuaJIT has the LUA 5.1 API */
+#if LUA_VERSION_NUM < 502
+#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#endif
+
+#define LUA_HOOKS_BUFFER    "mlv.buffer"
+#define LUA_HOOKS_TYPES     32
+
+/* a view of mlv_dump's memory, or a buffer owned by LUA with the data right behind this struct */
+struct lua_buffer
+{
+    uint8_t *data;
+    size_t size;
+    int writable;
+};
+
+struct lua_hook
+{
+    int func;                       /* registry reference, 0 if not hooked */
+    int strings;                    /* handle_* function, gets copies as strings */
+    uint32_t batch;
+
+    /* views passed to func. they are never released, a script may replace its hook while it runs */
+    int hdr_view;
+    int data_view;
+    int batch_views;
+    uint32_t batch_view_count;
+    struct lua_buffer **batch_view_ptrs;
+
+    /* copies of the blocks of the current batch */
+    uint32_t pending;
+    uint32_t slot_count;
+    size_t slot_size;
+    size_t hdr_max;
+    uint8_t *slots;
+    size_t *hdr_len;
+    size_t *data_len;
+};
+
+struct lua_hook_type
+{
+    uint8_t type[4];
+    struct lua_hook stage[LUA_HOOK_STAGES];
+};
+
+struct lua_hooks
+{
+    lua_State *L;
+    lua_hooks_log_t log;
+    int dng_saved;
+
+    /* fixed size, so hooks don't move when a script adds some while being called */
+    uint32_t type_count;
+    struct lua_hook_type types[LUA_HOOKS_TYPES];
+};
+
+static const char *stage_names[LUA_HOOK_STAGES] = { "block", "data_read", "data_write", "data_write_raw", "data_write_dng", "data_write_mlv" };
+
+static void hooks_error(struct lua_hooks *hooks, const char *what, const char *func)
+{
+    char msg[512];
+    const char *err = lua_isstring(hooks->L, -1) ? lua_tostring(hooks->L, -1) : "no error message";
+
+    snprintf(msg, sizeof(msg), "LUA: %s '%s': '%s'\n", what, func, err);
+    hooks->log(msg);
+    lua_pop(hooks->L, 1);
+}
+
+static void hook_name(const uint8_t *type, enum lua_hook_stage stage, int strings, char *name, size_t size)
+{
+    if(strings)
+    {
+        snprintf(name, size, "handle_%.4s%s%s", (const char *)type, stage ? "_" : "", stage ? stage_names[stage] : "");
+    }
+    else
+    {
+        snprintf(name, size, "mlv.hook('%.4s', '%s')", (const char *)type, stage_names[stage]);
+    }
+}
+
+static struct lua_hook *hooks_find(struct lua_hooks *hooks, const uint8_t *type, enum lua_hook_stage stage)
+{
+    for(uint32_t pos = 0; pos < hooks->type_count; pos++)
+    {
+        if(!memcmp(hooks->types[pos].type, type, 4))
+        {
+            return &hooks->types[pos].stage[stage];
+        }
+    }
+    return NULL;
+}
+
+/* buffers and views */
+
+static struct lua_buffer *buffer_new(lua_State *L, size_t size)
+{
+    struct lua_buffer *buf = lua_newuserdata(L, sizeof(struct lua_buffer) + size);
+
+    buf->data = size ? (uint8_t *)(buf + 1) : NULL;
+    buf->size = size;
+    buf->writable = 1;
+    if(size)
+    {
+        memset(buf->data, 0, size);
+    }
+
+    luaL_getmetatable(L, LUA_HOOKS_BUFFER);
+    lua_setmetatable(L, -2);
+    return buf;
+}
+
+/* an empty view, pointed at memory before every call */
+static struct lua_buffer *view_new(lua_State *L)
+{
+    struct lua_buffer *view = buffer_new(L, 0);
+
+    view->writable = 0;
+    return view;
+}
+
+static struct lua_buffer *buffer_check(lua_State *L, int arg)
+{
+    return luaL_checkudata(L, arg, LUA_HOOKS_BUFFER);
+}
+
+static size_t buffer_offset(lua_State *L, struct lua_buffer *buf, int arg, size_t bytes)
+{
+    lua_Integer offset = luaL_checkinteger(L, arg);
+
+    luaL_argcheck(L, offset >= 0 && (size_t)offset + bytes <= buf->size, arg, "offset out of range");
+    return (size_t)offset;
+}
+
+static struct lua_buffer *buffer_check_writable(lua_State *L, int arg)
+{
+    struct lua_buffer *buf = buffer_check(L, arg);
+
+    luaL_argcheck(L, buf->writable, arg, "read only buffer");
+    return buf;
+}
+
+static uint32_t buffer_check_bpp(lua_State *L, int arg)
+{
+    lua_Integer bpp = luaL_checkinteger(L, arg);
+
+    luaL_argcheck(L, bpp >= 1 && bpp <= 16, arg, "bits per pixel must be 1 to 16");
+    return (uint32_t)bpp;
+}
+
+static uint32_t get_le(const uint8_t *data, size_t bytes)
+{
+    uint32_t value = 0;
+
+    for(size_t pos = bytes; pos > 0; pos--)
+    {
+        value = (value << 8) | data[pos - 1];
+    }
+    return value;
+}
+
+static void set_le(uint8_t *data, size_t bytes, uint32_t value)
+{
+    for(size_t pos = 0; pos < bytes; pos++)
+    {
+        data[pos] = (uint8_t)(value >> (8 * pos));
+    }
+}
+
+static int buffer_get(lua_State *L, size_t bytes)
+{
+    struct lua_buffer *buf = buffer_check(L, 1);
+    size_t offset = buffer_offset(L, buf, 2, bytes);
+
+    uint32_t value = get_le(&buf->data[offset], bytes);
+
+    /* LuaJIT and 32 bit builds of LUA 5.1 may have 32 bit signed integers */
+    if(sizeof(lua_Integer) > 4)
+    {
+        lua_pushinteger(L, (lua_Integer)value);
+    }
+    else
+    {
+        lua_pushnumber(L, value);
+    }
+    return 1;
+}
+
+static int buffer_set(lua_State *L, size_t bytes)
+{
+    struct lua_buffer *buf = buffer_check_writable(L, 1);
+    size_t offset = buffer_offset(L, buf, 2, bytes);
+
+    set_le(&buf->data[offset], bytes, (uint32_t)(int64_t)luaL_checknumber(L, 3));
+    return 0;
+}
+
+static int buffer_u8(lua_State *L) { return buffer_get(L, 1); }
+static int buffer_u16(lua_State *L) { return buffer_get(L, 2); }
+static int buffer_u32(lua_State *L) { return buffer_get(L, 4); }
+static int buffer_set_u8(lua_State *L) { return buffer_set(L, 1); }
+static int buffer_set_u16(lua_State *L) { return buffer_set(L, 2); }
+static int buffer_set_u32(lua_State *L) { return buffer_set(L, 4); }
+
+/* packed raw is a stream of 16 bit little endian words, filled from the MSB. a pixel spans at most two words */
+static size_t buffer_pixel(lua_State *L, struct lua_buffer *buf, uint32_t *shift, uint32_t *words)
+{
+    lua_Integer pixel = luaL_checkinteger(L, 2);
+    uint32_t bpp = buffer_check_bpp(L, 3);
+    uint64_t bit = (uint64_t)pixel * bpp;
+
+    luaL_argcheck(L, pixel >= 0 && bit + bpp <= (uint64_t)buf->size * 8, 2, "pixel out of range");
+
+    *shift = 32 - (uint32_t)(bit & 15) - bpp;
+    *words = ((bit & 15) + bpp > 16) ? 2 : 1;
+    return (size_t)(bit >> 4) * 2;
+}
+
+static int buffer_get_pixel(lua_State *L)
+{
+    struct lua_buffer *buf = buffer_check(L, 1);
+    uint32_t shift = 0;
+    uint32_t words = 0;
+    size_t offset = buffer_pixel(L, buf, &shift, &words);
+    uint32_t bpp = (uint32_t)lua_tointeger(L, 3);
+    uint32_t data = get_le(&buf->data[offset], 2) << 16;
+
+    if(words > 1)
+    {
+        data |= get_le(&buf->data[offset + 2], 2);
+    }
+
+    lua_pushinteger(L, (data >> shift) & ((1 << bpp) - 1));
+    return 1;
+}
+
+static int buffer_set_pixel(lua_State *L)
+{
+    struct lua_buffer *buf = buffer_check_writable(L, 1);
+    uint32_t shift = 0;
+    uint32_t words = 0;
+    size_t offset = buffer_pixel(L, buf, &shift, &words);
+    uint32_t bpp = (uint32_t)lua_tointeger(L, 3);
+    uint32_t mask = ((1 << bpp) - 1) << shift;
+    uint32_t value = (uint32_t)luaL_checkinteger(L, 4) << shift;
+    uint32_t data = get_le(&buf->data[offset], 2) << 16;
+
+    if(words > 1)
+    {
+        data |= get_le(&buf->data[offset + 2], 2);
+    }
+
+    data = (data & ~mask) | (value & mask);
+
+    set_le(&buf->data[offset], 2, data >> 16);
+    if(words > 1)
+    {
+        set_le(&buf->data[offset + 2], 2, data & 0xFFFF);
+    }
+    return 0;
+}
+
+static int buffer_string(lua_State *L)
+{
+    struct lua_buffer *buf = buffer_check(L, 1);
+    lua_Integer offset = luaL_optinteger(L, 2, 0);
+    lua_Integer length = luaL_optinteger(L, 3, (lua_Integer)buf->size - offset);
+
+    luaL_argcheck(L, offset >= 0 && (size_t)offset <= buf->size, 2, "offset out of range");
+    luaL_argcheck(L, length >= 0 && (size_t)(offset + length) <= buf->size, 3, "length out of range");
+
+    lua_pushlstring(L, (const char *)buf->data + offset, (size_t)length);
+    return 1;
+}
+
+static int buffer_ptr(lua_State *L)
+{
+    lua_pushlightuserdata(L, buffer_check(L, 1)->data);
+    return 1;
+}
+
+static int buffer_len(lua_State *L)
+{
+    lua_pushinteger(L, (lua_Integer)buffer_check(L, 1)->size);
+    return 1;
+}
+
+static int buffer_tostring(lua_State *L)
+{
+    lua_pushfstring(L, LUA_HOOKS_BUFFER " (%d bytes)", (int)buffer_check(L, 1)->size);
+    return 1;
+}
+
+static const luaL_Reg buffer_methods[] =
+{
+    { "u8", buffer_u8 },
+    { "u16", buffer_u16 },
+    { "u32", buffer_u32 },
+    { "set_u8", buffer_set_u8 },
+    { "set_u16", buffer_set_u16 },
+    { "set_u32", buffer_set_u32 },
+    { "pixel", buffer_get_pixel },
+    { "set_pixel", buffer_set_pixel },
+    { "string", buffer_string },
+    { "ptr", buffer_ptr },
+    { NULL, NULL }
+};
+
+/* the mlv table */
+
+static int mlv_unpack(lua_State *L)
+{
+    struct lua_buffer *packed = buffer_check(L, 1);
+    uint32_t bpp = buffer_check_bpp(L, 2);
+    lua_Integer count = luaL_optinteger(L, 3, (lua_Integer)(packed->size * 8 / bpp));
+
+    luaL_argcheck(L, count >= 0 && (uint64_t)count * bpp <= (uint64_t)packed->size * 8, 3, "more pixels than in the buffer");
+
+    struct lua_buffer *pixels = buffer_new(L, (size_t)count * 2);
+
+    if(bpp == 16)
+    {
+        memcpy(pixels->data, packed->data, pixels->size);
+    }
+    else
+    {
+        bitpack_unpack((const uint16_t *)packed->data, (uint16_t *)pixels->data, (uint32_t)count, bpp);
+    }
+    return 1;
+}
+
+static int mlv_pack(lua_State *L)
+{
+    struct lua_buffer *pixels = buffer_check(L, 1);
+    struct lua_buffer *packed = buffer_check_writable(L, 2);
+    uint32_t bpp = buffer_check_bpp(L, 3);
+    uint32_t count = (uint32_t)(pixels->size / 2);
+
+    luaL_argcheck(L, (uint64_t)count * bpp <= (uint64_t)packed->size * 8, 2, "buffer too small");
+
+    if(bpp == 16)
+    {
+        memcpy(packed->data, pixels->data, (size_t)count * 2);
+    }
+    else
+    {
+        bitpack_pack((const uint16_t *)pixels->data, (uint16_t *)packed->data, count, bpp);
+    }
+    return 0;
+}
+
+static int mlv_buffer(lua_State *L)
+{
+    lua_Integer size = luaL_checkinteger(L, 1);
+
+    luaL_argcheck(L, size >= 0, 1, "negative size");
+    buffer_new(L, (size_t)size);
+    return 1;
+}
+
+static const luaL_Reg mlv_functions[] =
+{
+    { "unpack", mlv_unpack },
+    { "pack", mlv_pack },
+    { "buffer", mlv_buffer },
+    { NULL, NULL }
+};
+
+static void hooks_register(lua_State *L, const luaL_Reg *functions)
+{
+    for(; functions->name; functions++)
+    {
+        lua_pushcfunction(L, functions->func);
+        lua_setfield(L, -2, functions->name);
+    }
+}
+
+/* hook calls */
+
+static void hook_flush(struct lua_hooks *hooks, struct lua_hook *hook, const uint8_t *type, enum lua_hook_stage stage)
+{
+    lua_State *L = hooks->L;
+    uint32_t count = hook->pending;
+
+    if(!count)
+    {
+        return;
+    }
+
+    /* cleared before the call, a script that replaces its hook flushes it too */
+    hook->pending = 0;
+
+    /* two views per slot, kept in a table of their own so the arrays passed can be changed by the script */
+    if(hook->batch_view_count < count * 2)
+    {
+        struct lua_buffer **ptrs = realloc(hook->batch_view_ptrs, count * 2 * sizeof(struct lua_buffer *));
+
+        if(!ptrs)
+        {
+            hooks->log("LUA: Failed to allocate batch views\n");
+            return;
+        }
+        hook->batch_view_ptrs = ptrs;
+
+        if(!hook->batch_views)
+        {
+            lua_newtable(L);
+            hook->batch_views = luaL_ref(L, LUA_REGISTRYINDEX);
+        }
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, hook->batch_views);
+        for(uint32_t pos = hook->batch_view_count; pos < count * 2; pos++)
+        {
+            hook->batch_view_ptrs[pos] = view_new(L);
+            lua_rawseti(L, -2, pos + 1);
+        }
+        lua_pop(L, 1);
+        hook->batch_view_count = count * 2;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, hook->func);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, hook->batch_views);
+
+    lua_createtable(L, count, 0);
+    for(uint32_t pos = 0; pos < count; pos++)
+    {
+        struct lua_buffer *view = hook->batch_view_ptrs[pos];
+
+        view->data = &hook->slots[pos * hook->slot_size];
+        view->size = hook->hdr_len[pos];
+        lua_rawgeti(L, -2, pos + 1);
+        lua_rawseti(L, -2, pos + 1);
+    }
+
+    if(stage != LUA_HOOK_BLOCK)
+    {
+        lua_createtable(L, count, 0);
+        for(uint32_t pos = 0; pos < count; pos++)
+        {
+            struct lua_buffer *view = hook->batch_view_ptrs[count + pos];
+
+            view->data = &hook->slots[pos * hook->slot_size + hook->hdr_max];
+            view->size = hook->data_len[pos];
+            lua_rawgeti(L, -3, count + pos + 1);
+            lua_rawseti(L, -2, pos + 1);
+        }
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+
+    /* the table of all views is not an argument */
+    lua_remove(L, -3);
+    lua_pushinteger(L, count);
+
+    int ret = lua_pcall(L, 3, 0, 0);
+
+    /* the script may keep views around, they must not point to the slots anymore */
+    for(uint32_t pos = 0; pos < count * 2; pos++)
+    {
+        hook->batch_view_ptrs[pos]->data = NULL;
+        hook->batch_view_ptrs[pos]->size = 0;
+    }
+
+    if(ret)
+    {
+        char name[64];
+        hook_name(type, stage, 0, name, sizeof(name));
+        hooks_error(hooks, "Error while calling", name);
+    }
+}
+
+static void hook_collect(struct lua_hooks *hooks, struct lua_hook *hook, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len)
+{
+    size_t hdr_max = (hdr_len > hook->hdr_max) ? hdr_len : hook->hdr_max;
+    size_t data_max = (data_len > hook->slot_size - hook->hdr_max) ? data_len : hook->slot_size - hook->hdr_max;
+
+    if(hdr_max != hook->hdr_max || hdr_max + data_max != hook->slot_size || hook->slot_count < hook->batch)
+    {
+        hook_flush(hooks, hook, type, stage);
+
+        free(hook->slots);
+        free(hook->hdr_len);
+        free(hook->data_len);
+        hook->slots = malloc(hook->batch * (hdr_max + data_max));
+        hook->hdr_len = malloc(hook->batch * sizeof(size_t));
+        hook->data_len = malloc(hook->batch * sizeof(size_t));
+
+        if(!hook->slots || !hook->hdr_len || !hook->data_len)
+        {
+            hooks->log("LUA: Failed to allocate batch buffers\n");
+            free(hook->slots);
+            free(hook->hdr_len);
+            free(hook->data_len);
+            hook->slots = NULL;
+            hook->hdr_len = NULL;
+            hook->data_len = NULL;
+            hook->slot_count = 0;
+            hook->slot_size = 0;
+            hook->hdr_max = 0;
+            return;
+        }
+
+        hook->slot_count = hook->batch;
+        hook->slot_size = hdr_max + data_max;
+        hook->hdr_max = hdr_max;
+    }
+
+    uint8_t *slot = &hook->slots[hook->pending * hook->slot_size];
+
+    memcpy(slot, hdr, hdr_len);
+    if(data_len)
+    {
+        memcpy(&slot[hook->hdr_max], data, data_len);
+    }
+    hook->hdr_len[hook->pending] = hdr_len;
+    hook->data_len[hook->pending] = data_len;
+
+    if(++hook->pending >= hook->batch)
+    {
+        hook_flush(hooks, hook, type, stage);
+    }
+}
+
+static struct lua_buffer *hook_view(lua_State *L, int *ref, void *data, size_t size)
+{
+    struct lua_buffer *view = NULL;
+
+    if(*ref)
+    {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, *ref);
+        view = lua_touserdata(L, -1);
+    }
+    else
+    {
+        view = view_new(L);
+        lua_pushvalue(L, -1);
+        *ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    view->data = data;
+    view->size = size;
+    view->writable = 1;
+    return view;
+}
+
+static void hook_call_views(struct lua_hooks *hooks, struct lua_hook *hook, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len)
+{
+    lua_State *L = hooks->L;
+    struct lua_buffer *data_view = NULL;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, hook->func);
+    struct lua_buffer *hdr_view = hook_view(L, &hook->hdr_view, hdr, hdr_len);
+    if(data)
+    {
+        data_view = hook_view(L, &hook->data_view, data, data_len);
+    }
+
+    int ret = lua_pcall(L, data ? 2 : 1, 0, 0);
+
+    /* the script may keep the views, they must not point to our buffers anymore */
+    hdr_view->data = NULL;
+    hdr_view->size = 0;
+    hdr_view->writable = 0;
+    if(data_view)
+    {
+        data_view->data = NULL;
+        data_view->size = 0;
+        data_view->writable = 0;
+    }
+
+    if(ret)
+    {
+        char name[64];
+        hook_name(type, stage, 0, name, sizeof(name));
+        hooks_error(hooks, "Error while calling", name);
+    }
+}
+
+/* a string returned by a handle_* function replaces the header or data if it has the same size */
+static void hook_replace(struct lua_hooks *hooks, const char *func, int index, const char *what, void *dst, size_t dst_len)
+{
+    char msg[256];
+    size_t len = 0;
+
+    if(lua_type(hooks->L, index) != LUA_TSTRING)
+    {
+        return;
+    }
+
+    const char *src = lua_tolstring(hooks->L, index, &len);
+
+    if(len == dst_len)
+    {
+        snprintf(msg, sizeof(msg), "LUA: Function '%s' updated %s\n", func, what);
+        memcpy(dst, src, len);
+    }
+    else
+    {
+        snprintf(msg, sizeof(msg), "LUA: Error while calling '%s': Returned %s size mismatch - %d instead of %d\n", func, what, (int)len, (int)dst_len);
+    }
+    hooks->log(msg);
+}
+
+static void hook_call_strings(struct lua_hooks *hooks, struct lua_hook *hook, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len)
+{
+    lua_State *L = hooks->L;
+    int args = data ? 2 : 1;
+    char name[64];
+
+    hook_name(type, stage, 1, name, sizeof(name));
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, hook->func);
+    lua_pushlstring(L, hdr, hdr_len);
+    if(data)
+    {
+        lua_pushlstring(L, data, data_len);
+    }
+
+    if(lua_pcall(L, args, args, 0))
+    {
+        hooks_error(hooks, "Error while calling", name);
+        return;
+    }
+
+    hook_replace(hooks, name, -args, "hdr data", hdr, hdr_len);
+    if(data)
+    {
+        hook_replace(hooks, name, -1, "block data", data, data_len);
+    }
+    lua_pop(L, args);
+}
+
+/* expects the function on top of the stack */
+static int hooks_set(struct lua_hooks *hooks, const uint8_t *type, enum lua_hook_stage stage, int strings, uint32_t batch)
+{
+    lua_State *L = hooks->L;
+    struct lua_hook *hook = hooks_find(hooks, type, stage);
+
+    if(!hook)
+    {
+        if(hooks->type_count >= LUA_HOOKS_TYPES)
+        {
+            lua_pop(L, 1);
+            return 0;
+        }
+
+        struct lua_hook_type *entry = &hooks->types[hooks->type_count++];
+        memcpy(entry->type, type, 4);
+        hook = &entry->stage[stage];
+    }
+
+    /* a replaced hook still gets the blocks it collected */
+    hook_flush(hooks, hook, type, stage);
+
+    if(hook->func)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, hook->func);
+    }
+    hook->func = luaL_ref(L, LUA_REGISTRYINDEX);
+    hook->strings = strings;
+    hook->batch = batch;
+    return 1;
+}
+
+/* mlv.hook(type, stage, func [, batch]) */
+static int mlv_hook(lua_State *L)
+{
+    struct lua_hooks *hooks = lua_touserdata(L, lua_upvalueindex(1));
+    size_t type_len = 0;
+    const char *type = luaL_checklstring(L, 1, &type_len);
+    const char *stage_name = luaL_checkstring(L, 2);
+    lua_Integer batch = luaL_optinteger(L, 4, 1);
+    int stage = 0;
+
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    luaL_argcheck(L, type_len == 4, 1, "block types have 4 characters");
+    luaL_argcheck(L, batch >= 1, 4, "batch must be at least 1");
+
+    while(stage < LUA_HOOK_STAGES && strcmp(stage_name, stage_names[stage]))
+    {
+        stage++;
+    }
+    luaL_argcheck(L, stage < LUA_HOOK_STAGES, 2, "unknown stage");
+
+    lua_pushvalue(L, 3);
+    if(!hooks_set(hooks, (const uint8_t *)type, stage, 0, (uint32_t)batch))
+    {
+        return luaL_error(L, "too many block types hooked");
+    }
+    return 0;
+}
+
+/* global handle_<TYPE><suffix> functions, unless mlv.hook() was used for the same */
+static void hooks_find_globals(struct lua_hooks *hooks)
+{
+    lua_State *L = hooks->L;
+
+    lua_pushglobaltable(L);
+    lua_pushnil(L);
+    while(lua_next(L, -2))
+    {
+        /* lua_tostring() on a number key would confuse lua_next() */
+        if(lua_type(L, -2) == LUA_TSTRING && lua_isfunction(L, -1))
+        {
+            const char *name = lua_tostring(L, -2);
+
+            if(!strncmp(name, "handle_", 7) && strlen(name) >= 11)
+            {
+                const uint8_t *type = (const uint8_t *)&name[7];
+                const char *suffix = &name[11];
+                int stage = LUA_HOOK_BLOCK;
+
+                if(*suffix)
+                {
+                    for(stage = 1; stage < LUA_HOOK_STAGES; stage++)
+                    {
+                        if(suffix[0] == '_' && !strcmp(&suffix[1], stage_names[stage]))
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                if(stage < LUA_HOOK_STAGES && !lua_hooks_active(hooks, type, stage))
+                {
+                    lua_pushvalue(L, -1);
+                    if(!hooks_set(hooks, type, stage, 1, 1))
+                    {
+                        hooks->log("LUA: Too many block types hooked\n");
+                    }
+                }
+            }
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "dng_saved");
+    if(lua_isfunction(L, -1))
+    {
+        hooks->dng_saved = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    else
+    {
+        lua_pop(L, 1);
+    }
+}
+
+lua_hooks_t *lua_hooks_load(const char *filename, lua_hooks_log_t log)
+{
+    struct lua_hooks *hooks = calloc(1, sizeof(struct lua_hooks));
+
+    if(!hooks)
+    {
+        return NULL;
+    }
+
+    hooks->log = log;
+    hooks->L = luaL_newstate();
+    if(!hooks->L)
+    {
+        free(hooks);
+        return NULL;
+    }
+
+    lua_State *L = hooks->L;
+    luaL_openlibs(L);
+
+    /* views and buffers, their methods are found through __index */
+    luaL_newmetatable(L, LUA_HOOKS_BUFFER);
+    lua_newtable(L);
+    hooks_register(L, buffer_methods);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, buffer_len);
+    lua_setfield(L, -2, "__len");
+    lua_pushcfunction(L, buffer_tostring);
+    lua_setfield(L, -2, "__tostring");
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    hooks_register(L, mlv_functions);
+    lua_pushlightuserdata(L, hooks);
+    lua_pushcclosure(L, mlv_hook, 1);
+    lua_setfield(L, -2, "hook");
+    lua_setglobal(L, "mlv");
+
+    if(luaL_loadfile(L, filename) || lua_pcall(L, 0, 0, 0))
+    {
+        hooks_error(hooks, "Failed to load", filename);
+        lua_hooks_free(hooks);
+        return NULL;
+    }
+
+    /* init() may add hooks too */
+    lua_getglobal(L, "init");
+    if(lua_isfunction(L, -1))
+    {
+        if(lua_pcall(L, 0, 0, 0))
+        {
+            hooks_error(hooks, "Error while calling", "init");
+            lua_hooks_free(hooks);
+            return NULL;
+        }
+    }
+    else
+    {
+        lua_pop(L, 1);
+    }
+
+    hooks_find_globals(hooks);
+    return hooks;
+}
+
+void lua_hooks_free(lua_hooks_t *hooks)
+{
+    if(!hooks)
+    {
+        return;
+    }
+
+    for(uint32_t pos = 0; pos < hooks->type_count; pos++)
+    {
+        for(int stage = 0; stage < LUA_HOOK_STAGES; stage++)
+        {
+            hook_flush(hooks, &hooks->types[pos].stage[stage], hooks->types[pos].type, stage);
+        }
+    }
+
+    lua_close(hooks->L);
+
+    for(uint32_t pos = 0; pos < hooks->type_count; pos++)
+    {
+        for(int stage = 0; stage < LUA_HOOK_STAGES; stage++)
+        {
+            struct lua_hook *hook = &hooks->types[pos].stage[stage];
+
+            free(hook->batch_view_ptrs);
+            free(hook->slots);
+            free(hook->hdr_len);
+            free(hook->data_len);
+        }
+    }
+    free(hooks);
+}
+
+int lua_hooks_active(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage)
+{
+    if(!hooks)
+    {
+        return 0;
+    }
+
+    struct lua_hook *hook = hooks_find(hooks, type, stage);
+    return hook && hook->func;
+}
+
+int lua_hooks_frames(lua_hooks_t *hooks)
+{
+    if(!hooks)
+    {
+        return 0;
+    }
+
+    for(int stage = 0; stage < LUA_HOOK_STAGES; stage++)
+    {
+        if(lua_hooks_active(hooks, (const uint8_t *)"VIDF", stage))
+        {
+            return 1;
+        }
+    }
+    return hooks->dng_saved != 0;
+}
+
+void lua_hooks_call(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len)
+{
+    if(!hooks)
+    {
+        return;
+    }
+
+    struct lua_hook *hook = hooks_find(hooks, type, stage);
+
+    if(!hook || !hook->func)
+    {
+        return;
+    }
+
+    if(hook->strings)
+    {
+        hook_call_strings(hooks, hook, type, stage, hdr, hdr_len, data, data_len);
+    }
+    else if(hook->batch > 1)
+    {
+        hook_collect(hooks, hook, type, stage, hdr, hdr_len, data, data_len);
+    }
+    else
+    {
+        hook_call_views(hooks, hook, type, stage, hdr, hdr_len, data, data_len);
+    }
+}
+
+void lua_hooks_dng_saved(lua_hooks_t *hooks, const char *filename, uint32_t frame_number)
+{
+    if(!hooks || !hooks->dng_saved)
+    {
+        return;
+    }
+
+    lua_rawgeti(hooks->L, LUA_REGISTRYINDEX, hooks->dng_saved);
+    lua_pushstring(hooks->L, filename);
+    lua_pushinteger(hooks->L, frame_number);
+
+    if(lua_pcall(hooks->L, 2, 0, 0))
+    {
+        hooks_error(hooks, "Error while calling", "dng_saved");
+    }
+}
+
+#else
+
+lua_hooks_t *lua_hooks_load(const char *filename, lua_hooks_log_t log)
+{
+    (void)filename;
+    (void)log;
+    return NULL;
+}
+
+void lua_hooks_free(lua_hooks_t *hooks)
+{
+    (void)hooks;
+}
+
+int lua_hooks_active(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage)
+{
+    (void)hooks;
+    (void)type;
+    (void)stage;
+    return 0;
+}
+
+int lua_hooks_frames(lua_hooks_t *hooks)
+{
+    (void)hooks;
+    return 0;
+}
+
+void lua_hooks_call(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len)
+{
+    (void)hooks;
+    (void)type;
+    (void)stage;
+    (void)hdr;
+    (void)hdr_len;
+    (void)data;
+    (void)data_len;
+}
+
+void lua_hooks_dng_saved(lua_hooks_t *hooks, const char *filename, uint32_t frame_number)
+{
+    (void)hooks;
+    (void)filename;
+    (void)frame_number;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _lua_hooks_h
+#define _lua_hooks_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  LUA scripts hooked into mlv_dump ("--lua"). the hooks are looked up once after the script was loaded,
+  so blocks without a hook cost a table lookup and no call into LUA at all.
+
+  there are two ways to hook a block type:
+
+  1. global functions named handle_<TYPE><suffix>, e.g. handle_RTCI(hdr) or handle_VIDF_data_read(hdr, data).
+     they get copies of the header and data as strings. returning a string of the same size replaces the
+     header or data, see mlv.lua.
+
+  2. mlv.hook(type, stage, func [, batch]) with stage "block", "data_read", "data_write", "data_write_raw",
+     "data_write_dng" or "data_write_mlv". func(hdr, data) gets views of mlv_dump's own buffers instead of
+     copies, they are changed in place and are only valid during the call. with 'batch' > 1, func(hdrs, datas, count)
+     gets called once for up to 'batch' blocks with arrays of read only views of copies, for scripts that only look
+     at the data, e.g. for statistics. the last blocks are passed when mlv_dump finishes.
+
+  views (and buffers from mlv.unpack/mlv.buffer) have these methods, offsets are in bytes and start at 0:
+    #v, v:u8(ofs), v:u16(ofs), v:u32(ofs), v:set_u8(ofs, x), v:set_u16(ofs, x), v:set_u32(ofs, x)  (little endian)
+    v:pixel(n, bpp), v:set_pixel(n, bpp, x)      n-th pixel of packed raw data
+    v:string([first, last])                     copy into a string
+    v:ptr()                                     address as light userdata, with LuaJIT: ffi.cast("uint16_t *", v:ptr())
+  and the mlv table has
+    mlv.unpack(v, bpp [, count])    new buffer with the pixels of 'v' as 16 bit values
+    mlv.pack(pixels, v, bpp)        the other way round, into 'v'
+    mlv.buffer(size)                new zeroed buffer
+
+  "block" hooks get the whole block (header and payload) for every block in the file. global init() gets called
+  once after loading and dng_saved(filename, frame_number) after every DNG written by the main loop.
+*/
+
+enum lua_hook_stage
+{
+    LUA_HOOK_BLOCK = 0,
+    LUA_HOOK_DATA_READ,
+    LUA_HOOK_DATA_WRITE,
+    LUA_HOOK_DATA_WRITE_RAW,
+    LUA_HOOK_DATA_WRITE_DNG,
+    LUA_HOOK_DATA_WRITE_MLV,
+    LUA_HOOK_STAGES
+};
+
+typedef struct lua_hooks lua_hooks_t;
+
+/* error messages of scripts go through 'log' */
+typedef void (*lua_hooks_log_t)(const char *msg);
+
+/* load and run a script, then call its init(). returns NULL on errors, or when built without USE_LUA */
+lua_hooks_t *lua_hooks_load(const char *filename, lua_hooks_log_t log);
+
+/* passes the pending batches and closes the script */
+void lua_hooks_free(lua_hooks_t *hooks);
+
+/* non-zero if there is a hook for that block type and stage */
+int lua_hooks_active(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage);
+
+/* non-zero if any VIDF hook or dng_saved() exists, then the frames have to be processed one after the other */
+int lua_hooks_frames(lua_hooks_t *hooks);
+
+/* call the hook of a block type and stage, if there is one. 'hdr' and 'data' may get changed by the script */
+void lua_hooks_call(lua_hooks_t *hooks, const uint8_t *type, enum lua_hook_stage stage, void *hdr, size_t hdr_len, void *data, size_t data_len);
+
+/* call dng_saved(filename, frame_number), if there is one */
+void lua_hooks_dng_saved(lua_hooks_t *hooks, const char *filename, uint32_t frame_number);
+
+#endif
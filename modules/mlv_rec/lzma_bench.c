@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  LZMA frame compression benchmark, the way mlv_dump --lzma compresses VIDF payloads.
+
+  compresses synthetic packed 14 bit frames (gradients with noise) with every LZMA preset,
+  one frame per job on a thread pool like mlv_dump --threads does, then decompresses them
+  again and compares with the original. prints the ratio and the compression and decompression
+  throughput in MB/s of raw data. the checksum covers the compressed payloads, so two builds
+  can be compared. with more than one thread, every preset also runs on a single worker and
+  the speedup over that gets printed, which is what mlv_dump --lzma gains from --threads.
+
+  lzma_bench [-l level] [-t threads] [-n frames] [-s WxH]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "lzma_frame.h"
+#include "thread_pool.h"
+#include "raw_proc/bitpack.h"
+
+#define BENCH_BLACK     2048
+#define BENCH_BPP       14
+
+typedef struct
+{
+    pool_job_t pool_job;              /* must be first, see thread_pool.h */
+    const uint8_t *frame;
+    uint8_t *payload;
+    size_t payload_size;
+    uint8_t *decoded;
+    uint32_t frame_size;
+    int decode;
+    int level;
+    int failed;
+} bench_job_t;
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t checksum_update(uint32_t checksum, const uint8_t *data, uint32_t size)
+{
+    for(uint32_t pos = 0; pos < size; pos++)
+    {
+        checksum = (checksum ^ data[pos]) * 16777619;
+    }
+    return checksum;
+}
+
+/* RGGB frame with a gradient per channel plus noise, packed like a VIDF payload */
+static void synthetic_frame(uint8_t *frame, int width, int height, int seed)
+{
+    uint16_t *line = malloc(width * sizeof(uint16_t));
+
+    srand(seed);
+    for(int y = 0; y < height; y++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            int color = (y & 1) + (x & 1);
+            int level = color == 0 ? x * 6000 / width : color == 2 ? y * 6000 / height : (x + y) * 3000 / (width + height) + 1000;
+            int noise = rand() % 65 - 32;
+
+            line[x] = (uint16_t)(BENCH_BLACK + level + noise);
+        }
+        bitpack_pack(line, (uint16_t *)&frame[y * width * BENCH_BPP / 8], width, BENCH_BPP);
+    }
+
+    free(line);
+}
+
+static void bench_job_process(pool_job_t *pool_job, int worker, void *ctx)
+{
+    bench_job_t *job = (bench_job_t *)pool_job;
+
+    (void)worker;
+    (void)ctx;
+
+    if(job->decode)
+    {
+        job->failed = lzma_frame_size(job->payload, job->payload_size) != job->frame_size ||
+                      lzma_frame_decompress(job->payload, job->payload_size, job->decoded, job->frame_size) ||
+                      memcmp(job->decoded, job->frame, job->frame_size);
+    }
+    else
+    {
+        job->payload_size = lzma_frame_compress(job->frame, job->frame_size, job->level, job->payload);
+        job->failed = !job->payload_size;
+    }
+}
+
+/* run all jobs once and return the time it took */
+static double bench_run(thread_pool_t *pool, bench_job_t *jobs, int count, int decode)
+{
+    double start = get_time();
+
+    for(int pos = 0; pos < count; pos++)
+    {
+        jobs[pos].decode = decode;
+        pool_submit(pool, &jobs[pos].pool_job);
+    }
+    for(int pos = 0; pos < count; pos++)
+    {
+        pool_wait(pool, &jobs[pos].pool_job);
+    }
+
+    return get_time() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    int first_level = 0;
+    int last_level = 9;
+    int threads = pool_cpu_count();
+    int frames = 8;
+    int width = 1920;
+    int height = 1080;
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-l") && pos + 1 < argc)
+        {
+            first_level = last_level = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-t") && pos + 1 < argc)
+        {
+            threads = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-n") && pos + 1 < argc)
+        {
+            frames = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-s") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-l level] [-t threads] [-n frames] [-s WxH]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(first_level < 0 || last_level > 9 || threads < 1 || frames < 1 || width < 16 || height < 16 || width % 8)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    uint32_t frame_size = width * height * BENCH_BPP / 8;
+    size_t bound = lzma_frame_bound(frame_size);
+    bench_job_t *jobs = calloc(frames, sizeof(bench_job_t));
+    thread_pool_t *pool = pool_create(threads, &bench_job_process, NULL);
+    thread_pool_t *single = threads > 1 ? pool_create(1, &bench_job_process, NULL) : NULL;
+
+    if(!jobs || !pool || (threads > 1 && !single))
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        return 1;
+    }
+
+    for(int pos = 0; pos < frames; pos++)
+    {
+        uint8_t *frame = malloc(frame_size);
+
+        jobs[pos].frame = frame;
+        jobs[pos].frame_size = frame_size;
+        jobs[pos].payload = malloc(bound);
+        jobs[pos].decoded = malloc(frame_size);
+
+        if(!frame || !jobs[pos].payload || !jobs[pos].decoded)
+        {
+            fprintf(stderr, "Failed to allocate buffers\n");
+            return 1;
+        }
+        synthetic_frame(frame, width, height, pos + 1);
+    }
+
+    printf("Frames:     %d x %dx%d %d bpp, %d threads\n", frames, width, height, BENCH_BPP, threads);
+    printf("Preset      ratio   compress  decompress  checksum%s\n", single ? "  speedup over 1 thread" : "");
+
+    double raw_mb = (double)frame_size * frames / 1000000.0;
+
+    for(int level = first_level; level <= last_level; level++)
+    {
+        for(int pos = 0; pos < frames; pos++)
+        {
+            jobs[pos].level = level;
+        }
+
+        double encode_single = single ? bench_run(single, jobs, frames, 0) : 0;
+        double decode_single = single ? bench_run(single, jobs, frames, 1) : 0;
+        double encode_time = bench_run(pool, jobs, frames, 0);
+        double decode_time = bench_run(pool, jobs, frames, 1);
+        uint32_t checksum = 2166136261U;
+        size_t compressed = 0;
+        int failed = 0;
+
+        for(int pos = 0; pos < frames; pos++)
+        {
+            checksum = checksum_update(checksum, jobs[pos].payload, jobs[pos].payload_size);
+            compressed += jobs[pos].payload_size;
+            failed |= jobs[pos].failed;
+        }
+
+        printf("  %d       %6.2f%%  %6.2f MB/s %6.2f MB/s  %08X", level, compressed * 100.0 / ((double)frame_size * frames),
+               raw_mb / encode_time, raw_mb / decode_time, checksum);
+        if(single)
+        {
+            printf("  %5.2fx %5.2fx", encode_single / encode_time, decode_single / decode_time);
+        }
+        printf("%s\n", failed ? "  FAILED" : "");
+    }
+
+    pool_destroy(pool);
+    if(single)
+    {
+        pool_destroy(single);
+    }
+    for(int pos = 0; pos < frames; pos++)
+    {
+        free((void *)jobs[pos].frame);
+        free(jobs[pos].payload);
+        free(jobs[pos].decoded);
+    }
+    free(jobs);
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <LzmaLib.h>
+#include "lzma_frame.h"
+
+size_t lzma_frame_bound(size_t size)
+{
+    /* see LzmaLib.h, plus our header */
+    return LZMA_FRAME_HEADER + size + size / 3 + 128;
+}
+
+size_t lzma_frame_compress(const uint8_t *src, size_t size, int level, uint8_t *dst)
+{
+    if(size > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    /*
+      the default dictionary of the level, but no larger than the payload: the encoder allocates
+      about 11.5 times the dictionary size, and a dictionary larger than the data doesn't improve
+      the ratio. keeps level 9 at ~40 MB per thread for a 3 MB frame instead of ~750 MB.
+    */
+    uint32_t dict_size = (level <= 5) ? (1u << (level * 2 + 14)) : (level <= 7) ? (1u << 25) : (1u << 26);
+    uint32_t needed = 1u << 12;
+
+    while(needed < size && needed < dict_size)
+    {
+        needed <<= 1;
+    }
+
+    size_t props_size = LZMA_PROPS_SIZE;
+    size_t dst_size = lzma_frame_bound(size) - LZMA_FRAME_HEADER;
+    uint32_t uncompressed_size = (uint32_t)size;
+
+    int ret = LzmaCompress(&dst[LZMA_FRAME_HEADER], &dst_size, src, size, &dst[4], &props_size,
+                           level, needed, -1, -1, -1, -1, 1);
+
+    if(ret != SZ_OK || props_size != LZMA_PROPS_SIZE)
+    {
+        return 0;
+    }
+
+    memcpy(dst, &uncompressed_size, sizeof(uint32_t));
+
+    return LZMA_FRAME_HEADER + dst_size;
+}
+
+size_t lzma_frame_size(const uint8_t *src, size_t src_size)
+{
+    uint32_t size;
+
+    if(src_size < LZMA_FRAME_HEADER)
+    {
+        return 0;
+    }
+
+    memcpy(&size, src, sizeof(uint32_t));
+    return size;
+}
+
+int lzma_frame_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size)
+{
+    if(lzma_frame_size(src, src_size) != size)
+    {
+        return -1;
+    }
+
+    size_t out_size = size;
+    SizeT in_size = src_size - LZMA_FRAME_HEADER;
+    int ret = LzmaUncompress(dst, &out_size, &src[LZMA_FRAME_HEADER], &in_size, &src[4], LZMA_PROPS_SIZE);
+
+    return (ret == SZ_OK && out_size == size) ? 0 : -1;
+}
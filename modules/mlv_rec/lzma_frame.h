@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _lzma_frame_h
+#define _lzma_frame_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  LZMA compressed VIDF and AUDF payloads (MLV_VIDEO_CLASS_FLAG_LZMA, MLV_AUDIO_CLASS_FLAG_LZMA):
+    uint32_t   uncompressed size
+    5 bytes    LZMA properties
+    ...        LZMA stream
+  every payload is a stream on its own, so frames get compressed and decompressed in parallel by
+  running one payload per thread. the 7-zip code is built single threaded (_7ZIP_ST).
+*/
+
+#define LZMA_FRAME_HEADER       (4 + 5)
+#define LZMA_FRAME_LEVEL        5
+
+/* largest payload 'size' bytes can compress to */
+size_t lzma_frame_bound(size_t size);
+
+/* compress 'size' bytes with level 0 ... 9 into 'dst', which has lzma_frame_bound(size) bytes. returns the payload size, 0 on error */
+size_t lzma_frame_compress(const uint8_t *src, size_t size, int level, uint8_t *dst);
+
+/* uncompressed size stored in the payload, 0 if it is too short */
+size_t lzma_frame_size(const uint8_t *src, size_t src_size);
+
+/* decompress the payload into 'dst', which has 'size' bytes. returns 0 if it decoded to exactly 'size' bytes */
+int lzma_frame_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size);
+
+#endif
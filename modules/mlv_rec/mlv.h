@@ -30,6 +30,7 @@
 #define MLV_VIDEO_CLASS_FLAG_LZMA    0x80
 #define MLV_VIDEO_CLASS_FLAG_DELTA   0x40
 #define MLV_VIDEO_CLASS_FLAG_LJ92    0x20
+#define MLV_VIDEO_CLASS_FLAG_INTER   0x10
 
 #define MLV_AUDIO_CLASS_FLAG_LZMA    0x80
 
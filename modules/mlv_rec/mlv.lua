@@ -67,3 +67,19 @@ function handle_RTCI(hdr)
     return ret;
 end
 
+
+--
+-- mlv.hook() passes views of mlv_dump's buffers instead of copies, they are changed in place.
+-- with a batch size, the function gets arrays of up to that many read only views, e.g. for statistics.
+-- see lua_hooks.h for the methods of views.
+--
+-- mlv.hook("VIDF", "data_read", function(hdr, data)
+--     -- clip the first pixel of every frame to the white level of a 14 bit raw
+--     if data:pixel(0, 14) > 15000 then
+--         data:set_pixel(0, 14, 15000)
+--     end
+-- end)
+--
+-- mlv.hook("VIDF", "block", function(blocks, datas, count)
+--     print("  --  "..count.." VIDF blocks, first frame number "..blocks[1]:u32(16))
+-- end, 16)
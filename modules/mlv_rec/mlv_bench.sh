@@ -0,0 +1,170 @@
+#!/bin/bash
+
+# mlv_dump benchmark and regression suite.
+#
+# generates synthetic clips with mlv_synth (different resolutions and bit depths, audio, .M00 chunks),
+# runs every mlv_dump mode on them and compares the md5 of the outputs with mlv_bench.golden.
+# if vdng_bench was built, the virtual DNGs of mlv_vdng get checked too.
+# prints one CSV line per run on stdout: case,mode,frames,seconds,fps,mb_per_s,md5,result
+# where mb_per_s is uncompressed raw data per second and result is ok, FAIL, ERROR or new.
+#
+# usage: mlv_bench.sh [--update] [--keep] [mlv_dump] [mlv_synth] [vdng_bench]
+#   --update  write the hashes of this run into mlv_bench.golden
+#   --keep    do not delete the work directory
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+GOLDEN=$SCRIPT_DIR/mlv_bench.golden
+MLV_DUMP=$SCRIPT_DIR/mlv_dump
+MLV_SYNTH=$SCRIPT_DIR/mlv_synth
+VDNG_BENCH=$SCRIPT_DIR/vdng_bench
+UPDATE=0
+KEEP=0
+ARGS=()
+
+for ARG in "$@"; do
+    case $ARG in
+        --update) UPDATE=1 ;;
+        --keep) KEEP=1 ;;
+        *) ARGS+=("$ARG") ;;
+    esac
+done
+
+[ ${#ARGS[@]} -gt 0 ] && MLV_DUMP=$(cd "$(dirname "${ARGS[0]}")" && pwd)/$(basename "${ARGS[0]}")
+[ ${#ARGS[@]} -gt 1 ] && MLV_SYNTH=$(cd "$(dirname "${ARGS[1]}")" && pwd)/$(basename "${ARGS[1]}")
+[ ${#ARGS[@]} -gt 2 ] && VDNG_BENCH=$(cd "$(dirname "${ARGS[2]}")" && pwd)/$(basename "${ARGS[2]}")
+
+if [ ! -x "$MLV_DUMP" ] || [ ! -x "$MLV_SYNTH" ]; then
+    echo "mlv_dump or mlv_synth not found, run 'make mlv_dump mlv_synth' first" >&2
+    exit 1
+fi
+
+# name, frames, then the mlv_synth parameters. r10_eosm gets focus pixels fixed (EOS M 720p mode)
+CASES=(
+    "r14_720p_audio 16 -s 1280x720 -b 14 -a"
+    "r12_1080p 8 -s 1920x1080 -b 12"
+    "r10_eosm 8 -s 1736x694 -b 10 -m 80000331 -r 1808x727"
+    "r14_chunked_audio 30 -s 640x360 -b 14 -k 10 -a"
+)
+
+if command -v md5sum > /dev/null; then
+    hash_files() { cat "$@" | md5sum | cut -c1-32; }
+else
+    hash_files() { cat "$@" | md5 -q; }
+fi
+
+now_ns() { date +%s%N; }
+
+# a fixed thread count, so the outputs do not depend on the number of cores
+THREADS=--threads=4
+
+WORK_DIR=$(mktemp -d "${TMPDIR:-/tmp}/mlv_bench.XXXXXX")
+NEW_GOLDEN=$WORK_DIR/golden
+FAILED=0
+
+# run_mode <case> <mode> <frames> <output files or dirs> -- <command>
+run_mode()
+{
+    local CASE=$1 MODE=$2 FRAMES=$3
+    local OUTPUTS=()
+    shift 3
+    while [ "$1" != "--" ]; do
+        OUTPUTS+=("$1")
+        shift
+    done
+    shift
+
+    local START=$(now_ns)
+    "$@" > "$MODE.log" 2>&1
+    local STATUS=$?
+    local END=$(now_ns)
+
+    local FILES=()
+    for OUTPUT in "${OUTPUTS[@]}"; do
+        if [ -d "$OUTPUT" ]; then
+            FILES+=($(ls -d "$OUTPUT"/* 2> /dev/null | LC_ALL=C sort))
+        elif [ -e "$OUTPUT" ]; then
+            FILES+=("$OUTPUT")
+        fi
+    done
+
+    local HASH=none
+    [ ${#FILES[@]} -gt 0 ] && HASH=$(hash_files "${FILES[@]}")
+    local EXPECTED=$(awk -v c="$CASE" -v m="$MODE" '$1 == c && $2 == m { print $3 }' "$GOLDEN" 2> /dev/null)
+
+    local RESULT=ok
+    if [ $STATUS -ne 0 ] || [ "$HASH" = none ]; then
+        RESULT=ERROR
+        FAILED=1
+    elif [ -z "$EXPECTED" ]; then
+        RESULT=new
+    elif [ "$HASH" != "$EXPECTED" ]; then
+        RESULT=FAIL
+        FAILED=1
+    fi
+
+    echo "$CASE $MODE $HASH" >> "$NEW_GOLDEN"
+    awk -v c="$CASE" -v m="$MODE" -v f="$FRAMES" -v ns=$((END - START)) -v bytes="$FRAME_BYTES" -v h="$HASH" -v r="$RESULT" \
+        'BEGIN { s = ns / 1e9; if(s <= 0) s = 1e-9; printf("%s,%s,%d,%.3f,%.2f,%.2f,%s,%s\n", c, m, f, s, f / s, f * bytes / s / 1e6, h, r) }'
+}
+
+echo "case,mode,frames,seconds,fps,mb_per_s,md5,result"
+
+for ENTRY in "${CASES[@]}"; do
+    set -- $ENTRY
+    CASE=$1
+    FRAMES=$2
+    shift 2
+
+    mkdir -p "$WORK_DIR/$CASE"
+    cd "$WORK_DIR/$CASE"
+
+    CHUNK=
+    [[ " $* " == *" -k "* ]] && CHUNK=1
+    SIZE=$(echo " $* " | sed -n 's/.* -s \([0-9]*\)x\([0-9]*\) .*/\1 \2/p')
+    BPP=$(echo " $* " | sed -n 's/.* -b \([0-9]*\) .*/\1/p')
+    FRAME_BYTES=$(( ${SIZE% *} * ${SIZE#* } * BPP / 8 ))
+    HALF=$((FRAMES / 2))
+
+    mkdir -p dng dng_threads dng_lj92 fix vdng
+
+    run_mode $CASE synth $FRAMES in.MLV ${CHUNK:+in.M00 in.M01 in.M02} -- "$MLV_SYNTH" -n $FRAMES "$@" in.MLV
+    run_mode $CASE extract $((HALF + 1)) extract.mlv -- "$MLV_DUMP" -f 0-$HALF -o extract.mlv in.MLV
+    run_mode $CASE compress $FRAMES lj92.mlv -- "$MLV_DUMP" -c -o lj92.mlv in.MLV
+    run_mode $CASE compress_threads $FRAMES lj92_threads.mlv -- "$MLV_DUMP" -c $THREADS -o lj92_threads.mlv in.MLV
+    run_mode $CASE lzma $FRAMES lzma.mlv -- "$MLV_DUMP" --lzma=0 $THREADS -o lzma.mlv in.MLV
+    run_mode $CASE decompress $FRAMES lj92_single.mlv -- "$MLV_DUMP" -d -o lj92_single.mlv lj92.mlv
+    run_mode $CASE decompress_threads $FRAMES lj92_dec.mlv -- "$MLV_DUMP" -d $THREADS -o lj92_dec.mlv lj92.mlv
+    run_mode $CASE decompress_lzma $FRAMES lzma_dec.mlv -- "$MLV_DUMP" -d $THREADS -o lzma_dec.mlv lzma.mlv
+    run_mode $CASE dng $FRAMES dng -- "$MLV_DUMP" --dng -o dng/f_ in.MLV
+    run_mode $CASE dng_threads $FRAMES dng_threads -- "$MLV_DUMP" --dng $THREADS -o dng_threads/f_ in.MLV
+    run_mode $CASE dng_lj92 $FRAMES dng_lj92 -- "$MLV_DUMP" --dng $THREADS -o dng_lj92/f_ lj92.mlv
+    run_mode $CASE pixel_fixes $FRAMES fix -- "$MLV_DUMP" --dng $THREADS --fixcp2 --cs3x3 --fixpn-clip=2 -o fix/f_ in.MLV
+    run_mode $CASE average $FRAMES avg.mlv avg.noise.pgm avg.bpm -- "$MLV_DUMP" -a -o avg.mlv in.MLV
+    run_mode $CASE proxy $FRAMES proxy.y4m -- "$MLV_DUMP" --proxy $THREADS -o proxy.y4m in.MLV
+    [ -x "$VDNG_BENCH" ] && run_mode $CASE vdng $FRAMES vdng -- "$VDNG_BENCH" -t 4 -o vdng in.MLV
+
+    cd "$WORK_DIR"
+    [ $KEEP -eq 0 ] && rm -rf "$WORK_DIR/$CASE"
+done
+
+if [ $UPDATE -eq 1 ]; then
+    {
+        echo "# mlv_bench.sh reference hashes: case mode md5"
+        echo "# regenerate with './mlv_bench.sh --update' after intended output changes"
+        cat "$NEW_GOLDEN"
+    } > "$GOLDEN"
+    echo "[i] Updated $GOLDEN" >&2
+fi
+
+if [ $KEEP -eq 0 ]; then
+    rm -rf "$WORK_DIR"
+else
+    echo "[i] Outputs kept in $WORK_DIR" >&2
+fi
+
+if [ $FAILED -ne 0 ] && [ $UPDATE -eq 0 ]; then
+    echo "[!] Some outputs differ from $GOLDEN or mlv_dump failed" >&2
+    exit 1
+fi
+
+echo "[i] Done" >&2
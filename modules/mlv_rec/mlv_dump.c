@@ -31,6 +31,11 @@
 #include <time.h>
 #include <assert.h>
 
+#ifdef __WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 #define MODULE_STRINGS_PREFIX mlv_dump_strings
 #include "../module_strings_wrapper.h"
 #include "module_strings.h"
@@ -48,15 +53,6 @@ MODULE_STRINGS()
 #define ERR_INDEX_REQ       4
 #define ERR_MALLOC          5
 
-#if defined(USE_LUA)
-#define LUA_LIB
-#include "lua.h"
-#include "lualib.h"
-#include "lauxlib.h"
-#else
-typedef void lua_State;
-#endif
-
 /* helper macros */
 #define MAX(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -98,7 +94,7 @@ typedef void lua_State;
 char *strdup(const char *s);
 
 #ifdef MLV_USE_LZMA
-#include <LzmaLib.h>
+#include "lzma_frame.h"
 #endif
 
 #ifdef MLV_USE_LJ92
@@ -110,7 +106,16 @@ char *strdup(const char *s);
 #include "../../src/raw.h"
 #include "mlv.h"
 #include "dng/dng.h"
+#include "raw_proc/bitpack.h"
 #include "wav.h"
+#include "thread_pool.h"
+#include "mlv_reader.h"
+#include "mlv_index.h"
+#include "interframe.h"
+#include "stacker.h"
+#include "raw_proc/patternnoise.h"
+#include "raw_proc/proxy.h"
+#include "lua_hooks.h"
 
 enum bug_id
 {
@@ -138,24 +143,28 @@ enum bug_id
 
 int batch_mode = 0;
 
+/* messages go to stderr while the proxy video gets written to stdout */
+int msg_stderr = 0;
+
 void print_msg(uint32_t type, const char* format, ... )
 {
     va_list args;
     va_start( args, format );
     char *fmt_str = malloc(strlen(format) + 32);
+    FILE *msg_file = msg_stderr ? stderr : stdout;
 
     switch(type)
     {
         case MSG_INFO:
             if(!batch_mode)
             {
-                vfprintf(stdout, format, args);
+                vfprintf(msg_file, format, args);
             }
             else
             {
                 strcpy(fmt_str, "[I] ");
                 strcat(fmt_str, format);
-                vfprintf(stdout, fmt_str, args);
+                vfprintf(msg_file, fmt_str, args);
             }
             break;
 
@@ -170,8 +179,8 @@ void print_msg(uint32_t type, const char* format, ... )
             {
                 strcpy(fmt_str, "[E] ");
                 strcat(fmt_str, format);
-                vfprintf(stdout, fmt_str, args);
-                fflush(stdout);
+                vfprintf(msg_file, fmt_str, args);
+                fflush(msg_file);
             }
             break;
 
@@ -183,7 +192,7 @@ void print_msg(uint32_t type, const char* format, ... )
             {
                 strcpy(fmt_str, "[P] ");
                 strcat(fmt_str, format);
-                vfprintf(stdout, fmt_str, args);
+                vfprintf(msg_file, fmt_str, args);
             }
             break;
     }
@@ -193,250 +202,13 @@ void print_msg(uint32_t type, const char* format, ... )
 }
 
 
-/* based on http://www.lua.org/pil/25.3.html */
-int32_t lua_call_va(lua_State *L, const char *func, const char *sig, ...)
-{
-    va_list vl;
-
-    va_start(vl, sig);
-#if defined(USE_LUA)
-    int narg, nres;  /* number of arguments and results */
-    int verbose = 0;
-    
-    lua_getglobal(L, func);  /* get function */
-
-    /* push arguments */
-    narg = 0;
-    while (*sig)
-    {
-        /* push arguments */
-        switch (*sig++)
-        {
-            case 'v':
-                verbose = 1;
-                break;
-
-            case 'd':  /* double argument */
-                lua_pushnumber(L, va_arg(vl, double));
-                break;
-
-            case 'i':  /* int argument */
-                lua_pushnumber(L, va_arg(vl, int));
-                break;
-
-            case 's':  /* string argument */
-                lua_pushstring(L, va_arg(vl, char *));
-                break;
-
-            case 'l':  /* lstring argument */
-            {
-                char *ptr = va_arg(vl, char *);
-                int len = va_arg(vl, int);
-                lua_pushlstring(L, ptr, len);
-                break;
-            }
-
-            case '>':
-                goto endwhile;
-
-            default:
-                return -5;
-        }
-        narg++;
-        luaL_checkstack(L, 1, "too many arguments");
-    }
-    endwhile:
-
-    /* do the call */
-    nres = strlen(sig);  /* number of expected results */
-    int ret = lua_pcall(L, narg, nres, 0);
-
-    if (ret != 0)  /* do the call */
-    {
-        if (lua_isstring(L, -1))
-        {
-            //if(1 ||verbose)
-            {
-                print_msg(MSG_INFO, "LUA: Error while calling '%s': '%s'\n", func, lua_tostring(L, -1));
-            }
-        }
-        lua_pop(L, -1);
-        return -4;
-    }
-
-
-    /* retrieve results */
-    nres = -nres;  /* stack index of first result */
-    while (lua_gettop(L) && *sig)
-    {
-        /* get results */
-        switch (*sig++)
-        {
-            case 'd':  /* double result */
-                if (!lua_isnumber(L, nres))
-                {
-                    if(verbose)
-                    {
-                        print_msg(MSG_INFO, "LUA: Error while calling '%s': Expected double, got %d\n", func, lua_type(L, nres));
-                    }
-                    lua_pop(L, -1);
-                    break;
-                }
-                *va_arg(vl, double *) = lua_tonumber(L, nres);
-                lua_pop(L, -1);
-                break;
-
-            case 'i':  /* int result */
-                if (!lua_isnumber(L, nres))
-                {
-                    if(verbose)
-                    {
-                        print_msg(MSG_INFO, "LUA: Error while calling '%s': Expected number, got %d\n", func, lua_type(L, nres));
-                    }
-                    lua_pop(L, -1);
-                    break;
-                }
-                *va_arg(vl, int *) = (int)lua_tonumber(L, nres);
-                lua_pop(L, -1);
-                break;
-
-            case 's':  /* string result */
-                if (!lua_isstring(L, nres))
-                {
-                    if(verbose)
-                    {
-                        print_msg(MSG_INFO, "LUA: Error while calling '%s': Expected string, got %d\n", func, lua_type(L, nres));
-                    }
-                    lua_pop(L, -1);
-                    break;
-                }
-                *va_arg(vl, const char **) = lua_tostring(L, nres);
-                lua_pop(L, -1);
-                break;
-
-            case 'l':  /* lstring result */
-            {
-                if (!lua_isstring(L, nres))
-                {
-                    if(verbose)
-                    {
-                        print_msg(MSG_INFO, "LUA: Error while calling '%s': Expected string, got %d\n", func, lua_type(L, nres));
-                    }
-                    lua_pop(L, -1);
-                    break;
-                }
-                const char **ret_data = va_arg(vl, const char **);
-                size_t *ret_length = va_arg(vl, size_t *);
-
-                *ret_data = lua_tolstring(L, nres, ret_length);
-                lua_pop(L, -1);
-                break;
-            }
-
-            default:
-                print_msg(MSG_INFO, "LUA: Error while calling '%s': Expected unknown, got %d\n", func, lua_type(L, nres));
-                lua_pop(L, -1);
-                break;
-        }
-        nres++;
-    }
-#else
-    (void)L;
-    (void)func;
-    (void)sig;
-
-    /* consume all vararg arguments */
-    while (*sig)
-    {
-        switch (*sig++)
-        {
-            case 'd':
-                va_arg(vl, double);
-                break;
-            case 'i':
-                va_arg(vl, int);
-                break;
-            case 's':
-                va_arg(vl, char *);
-                break;
-            case 'l':
-                va_arg(vl, char *);
-                va_arg(vl, int);
-                break;
-            case '>':
-                break;
-        }
-    }
-#endif
-
-    va_end(vl);
-
-    return 0;
-}
-
-
-int32_t lua_handle_hdr_suffix(lua_State *lua_state, uint8_t *type, char *suffix, void *hdr, int hdr_len, void *data, int data_len)
-{
 #if defined(USE_LUA)
-    uint8_t *ret_hdr = NULL;
-    uint8_t *ret_data = NULL;
-    int ret_hdr_len = 0;
-    int ret_data_len = 0;
-    char func[128];
-
-    snprintf(func, sizeof(func), "handle_%.4s%s", type, suffix);
-
-    if(data)
-    {
-        lua_call_va(lua_state, func, "ll>ll", hdr, hdr_len, data, data_len, &ret_hdr, &ret_hdr_len, &ret_data, &ret_data_len);
-    }
-    else
-    {
-        lua_call_va(lua_state, func, "l>l", hdr, hdr_len, &ret_hdr, &ret_hdr_len);
-    }
-
-    /* callee updated block header */
-    if(ret_hdr_len > 0 && ret_hdr_len == hdr_len)
-    {
-        print_msg(MSG_INFO, "LUA: Function '%s' updated hdr data\n", func);
-        memcpy(hdr, ret_hdr, hdr_len);
-    }
-    else if(ret_hdr_len)
-    {
-        print_msg(MSG_INFO, "LUA: Error while calling '%s': Returned header size mismatch - %d instead of %d\n", func, ret_hdr_len, hdr_len);
-    }
-
-    /* callee updated block data */
-    if(ret_data_len > 0 && ret_data_len == data_len)
-    {
-        print_msg(MSG_INFO, "LUA: Function '%s' updated hdr data\n", func);
-        memcpy(data, ret_data, data_len);
-    }
-    else if(ret_data_len)
-    {
-        print_msg(MSG_INFO, "LUA: Error while calling '%s': Returned data size mismatch - %d instead of %d\n", func, ret_data_len, data_len);
-    }
-#else
-    (void)lua_state;
-    (void)type;
-    (void)suffix;
-    (void)hdr;
-    (void)hdr_len;
-    (void)data;
-    (void)data_len;
-#endif
-    return 0;
-}
-
-int32_t lua_handle_hdr(lua_State *lua_state, uint8_t *type, void *hdr, int hdr_len)
-{
-    return lua_handle_hdr_suffix(lua_state, type, "", hdr, hdr_len, NULL, 0);
-}
-
-int32_t lua_handle_hdr_data(lua_State *lua_state, uint8_t *type, char *suffix, void *hdr, int hdr_len, void *data, int data_len)
+/* LUA script errors */
+static void lua_log(const char *msg)
 {
-    return lua_handle_hdr_suffix(lua_state, type, suffix, hdr, hdr_len, data, data_len);
+    print_msg(MSG_INFO, "%s", msg);
 }
+#endif
 
 /* platform/target specific fseek/ftell functions go here */
 uint64_t file_get_pos(FILE *stream)
@@ -458,41 +230,18 @@ uint32_t file_set_pos(FILE *stream, uint64_t offset, int whence)
 }
 
 
-/* this structure is used to build the mlv_xref_t table */
-typedef struct
-{
-    uint64_t    frameTime;
-    uint64_t    frameOffset;
-    uint16_t    fileNumber;
-    uint16_t    frameType;
-} frame_xref_t;
-
-void xref_resize(frame_xref_t **table, int entries, int *allocated)
+void xref_dump(mlv_index_t *index)
 {
-    /* make sure there is no crappy pointer before using */
-    if(*allocated == 0)
-    {
-        *table = NULL;
-    }
+    uint32_t entries = mlv_index_count(index);
 
-    /* only resize if the buffer is too small */
-    if(entries * sizeof(frame_xref_t) > (uint32_t)(*allocated))
+    for(uint32_t pos = 0; pos < entries; pos++)
     {
-        *allocated += (entries + 1) * sizeof(frame_xref_t);
-        *table = realloc(*table, *allocated);
-    }
-}
+        const mlv_index_entry_t *entry = mlv_index_entry(index, pos);
 
-void xref_dump(mlv_xref_hdr_t *xref)
-{
-    mlv_xref_t *xrefs = (mlv_xref_t*)&(((unsigned char *)xref)[sizeof(mlv_xref_hdr_t)]);
-
-    for(uint32_t pos = 0; pos < xref->entryCount; pos++)
-    {
-        print_msg(MSG_INFO, "Entry %d/%d\n", pos + 1, xref->entryCount);
-        print_msg(MSG_INFO, "    File   #%d\n", xrefs[pos].fileNumber);
-        print_msg(MSG_INFO, "    Offset 0x%08X\n", xrefs[pos].frameOffset);
-        switch (xrefs[pos].frameType)
+        print_msg(MSG_INFO, "Entry %d/%d\n", pos + 1, entries);
+        print_msg(MSG_INFO, "    File   #%d\n", entry->fileNumber);
+        print_msg(MSG_INFO, "    Offset 0x%08" PRIX64 "\n", entry->offset);
+        switch (entry->frameType)
         {
             case MLV_FRAME_VIDF:
                 print_msg(MSG_INFO, "    Type   VIDF\n");
@@ -506,27 +255,6 @@ void xref_dump(mlv_xref_hdr_t *xref)
     }
 }
 
-
-void xref_sort(frame_xref_t *table, int entries)
-{
-    int n = entries;
-    do
-    {
-        int newn = 1;
-        for (int i = 0; i < n-1; ++i)
-        {
-            if (table[i].frameTime > table[i+1].frameTime)
-            {
-                frame_xref_t tmp = table[i+1];
-                table[i+1] = table[i];
-                table[i] = tmp;
-                newn = i + 1;
-            }
-        }
-        n = newn;
-    } while (n > 1);
-}
-
 void bitinsert(uint16_t *dst, int position, int depth, uint16_t new_value)
 {
     uint16_t old_value = 0;
@@ -697,155 +425,68 @@ load_frame_finish:
     return ret;
 }
 
-mlv_xref_hdr_t *load_index(char *base_filename)
+/* write the noise map of a stacked master frame as 16 bit PGM and its bad pixels as .bpm, both named like the output file */
+static void save_stack_maps(char *output_filename, const uint16_t *master, const uint16_t *noise, int xRes, int yRes, int pan_x, int pan_y, uint32_t frames)
 {
-    mlv_xref_hdr_t *block_hdr = NULL;
-    int max_name_len = strlen(base_filename) + 16;
-    char *filename = malloc(max_name_len);
-    FILE *in_file = NULL;
-
-    strncpy(filename, base_filename, max_name_len);
-    strcpy(&filename[strlen(filename) - 3], "IDX");
-
-    in_file = fopen(filename, "rb");
-
-    if(!in_file)
+    char *file_name = malloc(strlen(output_filename) + 16);
+    if(!file_name)
     {
-        free(filename);
-        return NULL;
+        return;
     }
 
-    print_msg(MSG_INFO, "File %s opened (XREF)\n", filename);
-
-    do
+    strcpy(file_name, output_filename);
+    char *ext_dot = strrchr(file_name, '.');
+    if(ext_dot)
     {
-        mlv_hdr_t buf;
-        uint64_t position = 0;
-
-        position = file_get_pos(in_file);
-
-        if(fread(&buf, sizeof(mlv_hdr_t), 1, in_file) != 1)
-        {
-            break;
-        }
-
-        /* jump back to the beginning of the block just read */
-        file_set_pos(in_file, position, SEEK_SET);
-
-        position = file_get_pos(in_file);
-
-        /* we should check the MLVI header for matching UID value to make sure its the right index... */
-        if(!memcmp(buf.blockType, "XREF", 4))
-        {
-            block_hdr = malloc(buf.blockSize);
-
-            if(fread(block_hdr, buf.blockSize, 1, in_file) != 1)
-            {
-                print_msg(MSG_ERROR, "File '%s' ends in the middle of a block\n", filename);
-                free(block_hdr);
-                block_hdr = NULL;
-            }
-        }
-        else
-        {
-            file_set_pos(in_file, position + buf.blockSize, SEEK_SET);
-        }
-
-        /* we are at the same position as before, so abort */
-        if(position == file_get_pos(in_file))
-        {
-            print_msg(MSG_ERROR, "File '%s' has invalid blocks\n", filename);
-            break;
-        }
+        *ext_dot = '\000';
     }
-    while(!feof(in_file));
-
-    fclose(in_file);
-
-    free(filename);
-    return block_hdr;
-}
-
-void save_index(char *base_filename, mlv_file_hdr_t *ref_file_hdr, int fileCount, frame_xref_t *index, int entries)
-{
-    int max_name_len = strlen(base_filename) + 16;
-    char *filename = malloc(max_name_len);
-    FILE *out_file = NULL;
-
-    strncpy(filename, base_filename, max_name_len);
-
-    strcpy(&filename[strlen(filename) - 3], "IDX");
+    char *ext = &file_name[strlen(file_name)];
 
-    out_file = fopen(filename, "wb+");
-
-    if(!out_file)
+    strcpy(ext, ".noise.pgm");
+    FILE *f = fopen(file_name, "wb");
+    if(f)
     {
-        free(filename);
-        print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
-        return;
+        fprintf(f, "P5\n# temporal noise of %u frames, sigma in 1/%d raw units\n%d %d\n65535\n", frames, STACK_NOISE_SCALE, xRes, yRes);
+        for(int pos = 0; pos < xRes * yRes; pos++)
+        {
+            fputc(noise[pos] >> 8, f);
+            fputc(noise[pos] & 0xFF, f);
+        }
+        fclose(f);
+        print_msg(MSG_INFO, "Noise map saved to '%s'\n", file_name);
     }
-
-    print_msg(MSG_INFO, "File %s opened for writing\n", filename);
-
-
-    /* first write MLVI header */
-    mlv_file_hdr_t file_hdr = *ref_file_hdr;
-
-    /* update fields */
-    file_hdr.blockSize = sizeof(mlv_file_hdr_t);
-    file_hdr.videoFrameCount = 0;
-    file_hdr.audioFrameCount = 0;
-    file_hdr.fileNum = fileCount + 1;
-
-    if(fwrite(&file_hdr, sizeof(mlv_file_hdr_t), 1, out_file) != 1)
+    else
     {
-        free(filename);
-        print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
-        fclose(out_file);
-        return;
+        print_msg(MSG_ERROR, "Failed to write noise map '%s'\n", file_name);
     }
 
-    /* now write XREF block */
-    mlv_xref_hdr_t hdr;
+    stacker_pixel_t *pixels = NULL;
+    int count = stacker_bad_pixels(master, noise, xRes, yRes, STACK_BAD_PIXEL_SIGMA, &pixels);
 
-    memset(&hdr, 0x00, sizeof(mlv_xref_hdr_t));
-    memcpy(hdr.blockType, "XREF", 4);
-    hdr.blockSize = sizeof(mlv_xref_hdr_t) + entries * sizeof(mlv_xref_t);
-    hdr.entryCount = entries;
-
-    if(fwrite(&hdr, sizeof(mlv_xref_hdr_t), 1, out_file) != 1)
-    {
-        free(filename);
-        print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
-        fclose(out_file);
-        return;
-    }
+    /* same coordinates as the bad pixel maps raw processing reads */
+    int crop_x = (pan_x + 7) & ~7;
+    int crop_y = pan_y & ~1;
 
-    /* and then the single entries */
-    for(int entry = 0; entry < entries; entry++)
+    strcpy(ext, ".bpm");
+    f = fopen(file_name, "w");
+    if(f)
     {
-        mlv_xref_t field;
-
-        memset(&field, 0x00, sizeof(mlv_xref_t));
-
-        field.frameOffset = index[entry].frameOffset;
-        field.fileNumber = index[entry].fileNumber;
-        field.frameType = index[entry].frameType;
-
-        if(fwrite(&field, sizeof(mlv_xref_t), 1, out_file) != 1)
+        for(int pos = 0; pos < count; pos++)
         {
-            free(filename);
-            print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
-            fclose(out_file);
-            return;
+            fprintf(f, "%d \t %d\n", pixels[pos].x + crop_x, pixels[pos].y + crop_y);
         }
+        fclose(f);
+        print_msg(MSG_INFO, "%d bad pixels saved to '%s'\n", count, file_name);
+    }
+    else
+    {
+        print_msg(MSG_ERROR, "Failed to write bad pixel map '%s'\n", file_name);
     }
 
-    free(filename);
-    fclose(out_file);
+    free(pixels);
+    free(file_name);
 }
 
-
 FILE **load_all_chunks(char *base_filename, int *entries)
 {
     int seq_number = 0;
@@ -926,10 +567,13 @@ void show_usage(char *executable)
     print_msg(MSG_INFO, "  --batch             format output message suitable for batch processing\n");
     print_msg(MSG_INFO, "  --relaxed           do not exit on every error, skip blocks that are erroneous\n");
     print_msg(MSG_INFO, "  --no-audio          for DNG output WAV not saved, for MLV output WAVI/AUDF blocks are not included in destination MLV\n");
+    print_msg(MSG_INFO, "  --no-mmap           read input files instead of memory mapping them\n");
     
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, "-- DNG output --\n");
     print_msg(MSG_INFO, "  --dng               output frames into separate .dng files. set prefix with -o\n");
+    print_msg(MSG_INFO, "  --dng-compressed    output LJ92 compressed .dng files. LJ92 input is passed through if no processing is enabled\n");
+    print_msg(MSG_INFO, "                      (--no-fixfp --no-fixcp --no-stripes), otherwise frames get processed and compressed like -c\n");
     print_msg(MSG_INFO, "  --no-cs             no chroma smoothing (default)\n");
     print_msg(MSG_INFO, "  --cs2x2             2x2 chroma smoothing\n");
     print_msg(MSG_INFO, "  --cs3x3             3x3 chroma smoothing\n");
@@ -943,17 +587,30 @@ void show_usage(char *executable)
     print_msg(MSG_INFO, "  --is-croprec        generate focus map for crop_rec mode\n");
     print_msg(MSG_INFO, "  --save-bpm          save bad pixels to .BPM file\n");
     print_msg(MSG_INFO, "  --fixpn             fix pattern noise\n");
+    print_msg(MSG_INFO, "  --fixpn-clip[=n]    fix pattern noise with one row/column profile for the whole clip, estimated from the first n frames (default 8)\n");
+    print_msg(MSG_INFO, "  --fixpn-refine=n    with --fixpn-clip, estimate again every n frames and follow the last estimates\n");
     print_msg(MSG_INFO, "  --deflicker=value   per-frame exposure compensation. value is target median in raw units ex: 3072 (default)\n");
     print_msg(MSG_INFO, "  --no-bitpack        write DNG files with unpacked to 16 bit raw data\n");
     print_msg(MSG_INFO, "  --show-progress     show DNG file creation progress. ignored when -v or --batch is specified\n");
     print_msg(MSG_INFO, "                      also works when compressing MLV to MLV and shows compression ratio for each frame\n");
     print_msg(MSG_INFO, "  --fpi <method>      focus pixel interpolation method: 0 (mlvfs), 1 (raw2dng), default is 0\n");
     print_msg(MSG_INFO, "  --bpi <method>      bad pixel interpolation method: 0 (mlvfs), 1 (raw2dng), default is 0\n");
+    print_msg(MSG_INFO, "  --pixel-cache[=dir] keep the generated focus and bad pixel maps in a cache directory and reuse them for the next files\n");
+    print_msg(MSG_INFO, "                      of the same camera and video mode. default is ~/.cache/mlv_dump (%%LOCALAPPDATA%%\\mlv_dump on windows)\n");
+    print_msg(MSG_INFO, "  --threads[=count]   process and save DNG frames using multiple threads. if no count given, use all CPU cores\n");
+    print_msg(MSG_INFO, "                      also compresses and decompresses MLV frames in parallel when used along with -c, -e, -d or --lzma\n");
 
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, "-- RAW output --\n");
     print_msg(MSG_INFO, "  -r                  output into a legacy raw file for e.g. raw2dng\n");
 
+    print_msg(MSG_INFO, "\n");
+    print_msg(MSG_INFO, "-- Proxy video output --\n");
+    print_msg(MSG_INFO, "  --proxy[=format]    8 bit video for piping into an encoder, use '-o -' for stdout. format is y4m (default),\n");
+    print_msg(MSG_INFO, "                      yuv (raw 4:2:0 planes) or rgb (raw RGB24). white balance is taken from the WBAL block, uses --threads\n");
+    print_msg(MSG_INFO, "  --proxy-debayer=m   'half' (default) makes one pixel of every 2x2 block, 'bilinear' keeps the full resolution\n");
+    print_msg(MSG_INFO, "  --proxy-gamma=x     gamma of the output (default 2.2)\n");
+
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, "-- MLV output --\n");
     print_msg(MSG_INFO, "  -b bits             convert image data to given bit depth per channel (1-16)\n");
@@ -984,6 +641,12 @@ void show_usage(char *executable)
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, "-- Image manipulation --\n");
     print_msg(MSG_INFO, "  -a                  average all frames in <inputfile> and output a single-frame MLV from it\n");
+    print_msg(MSG_INFO, "                      also writes a noise map (.noise.pgm, sigma in 1/%d raw units) and bad pixels (.bpm) next to it\n", STACK_NOISE_SCALE);
+    print_msg(MSG_INFO, "  --stack=mode        like -a, but combine the frames with 'mean' (same as -a), 'median' of block averages\n");
+    print_msg(MSG_INFO, "                      or 'sigma' clipped mean. works with any number of frames, uses --threads\n");
+    print_msg(MSG_INFO, "  --stack-block=n     [MEDIAN] frames averaged into one block (default 16)\n");
+    print_msg(MSG_INFO, "  --stack-kappa=x     [SIGMA] reject samples further than x sigma from the median (default 3.0)\n");
+    print_msg(MSG_INFO, "  --stack-mem=MiB     keep this much frame data in memory, the rest is spooled to a temporary file (default 1024)\n");
     print_msg(MSG_INFO, "  --avg-vertical      [DARKFRAME ONLY] average the resulting frame in vertical direction, so we will extract vertical banding\n");
     print_msg(MSG_INFO, "  --avg-horizontal    [DARKFRAME ONLY] average the resulting frame in horizontal direction, so we will extract horizontal banding\n");
     print_msg(MSG_INFO, "  -s mlv_file         subtract the reference frame in given file from every single frame during processing\n");
@@ -991,7 +654,10 @@ void show_usage(char *executable)
 
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, "-- Processing --\n");
-    print_msg(MSG_INFO, "  -e                  delta-encode frames to improve compression, but lose random access capabilities\n");
+#if defined(MLV_USE_LJ92)
+    print_msg(MSG_INFO, "  -e                  compress video frames using inter-frame prediction, frames store the difference to the last keyframe\n");
+    print_msg(MSG_INFO, "  --keyframes=n       with -e, store a keyframe every n frames (default 30). any frame decodes with at most one keyframe\n");
+#endif
 
     /* yet unclear which format to choose, so keep that as reminder */
     //print_msg(MSG_INFO, " -u lut_file         look-up table with 4 * xRes * yRes 16-bit words that is applied before bit depth conversion\n");
@@ -999,6 +665,12 @@ void show_usage(char *executable)
 #if defined(MLV_USE_LZMA) || defined(MLV_USE_LJ92)
     print_msg(MSG_INFO, "  -c                  compress video frames using LJ92. if input is lossless, then decompress and recompress again.\n");
     print_msg(MSG_INFO, "  -d                  decompress compressed video and audio frames using LZMA or LJ92\n");
+#if defined(MLV_USE_LZMA)
+    print_msg(MSG_INFO, "  --lzma[=level]      compress video and audio frames using LZMA with preset 0-9 (default %d), uses --threads\n", LZMA_FRAME_LEVEL);
+#endif
+#if defined(MLV_USE_LJ92)
+    print_msg(MSG_INFO, "  --lj92-components=n split the image into 1 (default), 2 or 4 interleaved LJ92 components when compressing\n");
+#endif
 #else
     print_msg(MSG_INFO, "  -c, -d              NOT AVAILABLE: compression support was not compiled into this release\n");
 #endif
@@ -1240,17 +912,1296 @@ static void fix_black_white_level(int32_t * black_level, int32_t * white_level,
 }
 
 
-int main (int argc, char *argv[])
+/* result of processing a single video frame */
+typedef enum
 {
-    char *input_filename = NULL;
-    char *output_filename = NULL;
-    char *subtract_filename = NULL;
-    char *flatfield_filename = NULL;
-    char *lut_filename = NULL;
-    char *extract_block = NULL;
-    char *inject_filename = NULL;
-    int blocks_processed = 0;
-
+    FRAME_OK,
+    FRAME_SKIP,     /* frame is corrupt, may get skipped in relaxed mode */
+    FRAME_ERROR     /* abort processing */
+} frame_result_e;
+
+/* decompress a LJ92, LZMA or inter-frame compressed VIDF payload into packed 'bpp' bit raw data.
+   'frame_buffer' must be able to hold 'frame_size' bytes, it may be the same buffer as 'payload'.
+   the payload itself is never written to, so it can point into the memory mapped file.
+   inter-frame compressed payloads need the decoded keyframe 'inter_ref' they depend on, see inter_prepare_ref(). */
+static frame_result_e decompress_frame(const uint8_t *payload, uint32_t read_size, uint8_t *frame_buffer, int frame_size, int compressed_lj92, int compressed_lzma,
+                                       int compressed_inter, const inter_ref_t *inter_ref, uint32_t frame_number, int xRes, int yRes, int bpp, int verbose)
+{
+    if(compressed_inter)
+    {
+#ifdef MLV_USE_LJ92
+        size_t out_size = xRes * yRes * sizeof(uint16_t);
+        uint16_t *decompressed = malloc(out_size);
+
+        if(!decompressed)
+        {
+            print_msg(MSG_ERROR, "    INTER: Failed to allocate "FMT_SIZE" byte\n", out_size);
+            return FRAME_ERROR;
+        }
+
+        int ret = inter_decode(payload, read_size, frame_number, inter_ref, decompressed, xRes, yRes);
+
+        if(ret != LJ92_ERROR_NONE)
+        {
+            print_msg(MSG_ERROR, "    INTER: Decompress failed (%d)\n", ret);
+            free(decompressed);
+            return FRAME_SKIP;
+        }
+
+        if(verbose)
+        {
+            print_msg(MSG_INFO, "    INTER: %d -> %d  (%2.2f%% ratio)\n", read_size, frame_size, ((float)read_size * 100.0f) / (float)frame_size);
+        }
+
+        /* repack the 16 bit words containing values with max 14 bit */
+        int orig_pitch = xRes * bpp / 8;
+
+        for(int y = 0; y < yRes; y++)
+        {
+            uint16_t *src_line = &decompressed[y * xRes];
+            void *dst_line = &frame_buffer[y * orig_pitch];
+
+            bitpack_pack(src_line, dst_line, xRes, bpp);
+        }
+
+        free(decompressed);
+#else
+        print_msg(MSG_INFO, "    INTER: not compiled into this release, aborting.\n");
+        return FRAME_ERROR;
+#endif
+    }
+    else if(compressed_lj92)
+    {
+#ifdef MLV_USE_LJ92
+        lj92 handle;
+        int lj92_width = 0;
+        int lj92_height = 0;
+        int lj92_bitdepth = 0;
+        int lj92_components = 0;
+
+        int ret = lj92_open(&handle, (uint8_t *)payload, read_size, &lj92_width, &lj92_height, &lj92_bitdepth, &lj92_components);
+
+        /* this is the raw data size with 16 bit words. it's just temporary */
+        size_t out_size = lj92_width * lj92_height * sizeof(uint16_t) * lj92_components;
+
+        if(ret == LJ92_ERROR_NONE)
+        {
+            if(verbose)
+            {
+                print_msg(MSG_INFO, "    LJ92: Decompressing\n");
+                print_msg(MSG_INFO, "    LJ92: %dx%dx%d %d bpp (%d bytes buffer)\n", lj92_width, lj92_height, lj92_components, lj92_bitdepth, out_size);
+            }
+        }
+        else
+        {
+            print_msg(MSG_ERROR, "    LJ92: Open failed (%d)\n", ret);
+            return FRAME_SKIP;
+        }
+
+        /* do a proper size check before we continue */
+        int lj92_frame_size = ((lj92_width * lj92_height * lj92_components * bpp + 7) / 8);
+
+        if(lj92_frame_size != frame_size)
+        {
+            print_msg(MSG_ERROR, "    LJ92: decompressed image size (%d) does not match size retrieved from RAWI (%d)\n", lj92_frame_size, frame_size);
+            lj92_close(handle);
+            return FRAME_ERROR;
+        }
+
+        /* we need a temporary buffer so we don't overwrite source data */
+        uint16_t *decompressed = malloc(out_size);
+
+        if(!decompressed)
+        {
+            print_msg(MSG_ERROR, "    LJ92: Failed to allocate "FMT_SIZE" byte\n", out_size);
+            lj92_close(handle);
+            return FRAME_ERROR;
+        }
+
+        ret = lj92_decode(handle, decompressed, lj92_width * lj92_height * lj92_components, 0, NULL, 0);
+        lj92_close(handle);
+
+        if(ret != LJ92_ERROR_NONE)
+        {
+            print_msg(MSG_ERROR, "    LJ92: Decompress failed (%d)\n", ret);
+            free(decompressed);
+            return FRAME_SKIP;
+        }
+
+        if(verbose)
+        {
+            print_msg(MSG_INFO, "    LJ92: %d -> %d  (%2.2f%% ratio)\n", read_size, frame_size, ((float)read_size * 100.0f) / (float)frame_size);
+        }
+
+        /* repack the 16 bit words containing values with max 14 bit */
+        int orig_pitch = xRes * bpp / 8;
+
+        for(int y = 0; y < yRes; y++)
+        {
+            uint16_t *src_line = &decompressed[y * xRes];
+            void *dst_line = &frame_buffer[y * orig_pitch];
+
+            bitpack_pack(src_line, dst_line, xRes, bpp);
+        }
+
+        free(decompressed);
+#else
+        print_msg(MSG_INFO, "    LJ92: not compiled into this release, aborting.\n");
+        return FRAME_ERROR;
+#endif
+    }
+    else if(compressed_lzma)
+    {
+#ifdef MLV_USE_LZMA
+        size_t lzma_out_size = lzma_frame_size(payload, read_size);
+
+        if(lzma_out_size != (size_t)frame_size)
+        {
+            print_msg(MSG_ERROR, "    LZMA: decompressed image size (%d) does not match size retrieved from RAWI (%d)\n", lzma_out_size, frame_size);
+            return FRAME_ERROR;
+        }
+
+        /* only need a temporary buffer when decompressing in place */
+        unsigned char *lzma_out = (payload == frame_buffer) ? malloc(lzma_out_size) : frame_buffer;
+
+        if(!lzma_out)
+        {
+            print_msg(MSG_ERROR, "    LZMA: Failed to allocate "FMT_SIZE" byte\n", lzma_out_size);
+            return FRAME_ERROR;
+        }
+
+        int ret = lzma_frame_decompress(payload, read_size, lzma_out, lzma_out_size);
+
+        if(!ret)
+        {
+            if(lzma_out != frame_buffer)
+            {
+                memcpy(frame_buffer, lzma_out, lzma_out_size);
+            }
+
+            if(verbose)
+            {
+                print_msg(MSG_INFO, "    LZMA: %d -> %d  (%2.2f%% ratio)\n", read_size, frame_size, ((float)read_size * 100.0f) / (float)frame_size);
+            }
+        }
+        else
+        {
+            print_msg(MSG_INFO, "    LZMA: Failed (%d)\n", ret);
+            if(lzma_out != frame_buffer)
+            {
+                free(lzma_out);
+            }
+            return FRAME_ERROR;
+        }
+
+        if(lzma_out != frame_buffer)
+        {
+            free(lzma_out);
+        }
+#else
+        print_msg(MSG_INFO, "    LZMA: not compiled into this release, aborting.\n");
+        return FRAME_ERROR;
+#endif
+    }
+
+    return FRAME_OK;
+}
+
+#ifdef MLV_USE_LJ92
+/*
+   compress an unpacked 16 bit raw frame with the same layout as the camera does.
+   the result is owned by the encoder and stays valid until it compresses the next frame.
+*/
+static int compress_frame_lj92(lj92_encoder encoder, int components, uint16_t *compress_buffer, int compress_buffer_size, int xRes, int yRes, int bpp, int frame_size, int verbose, uint8_t **compressed, int *compressed_size)
+{
+    /* trying to compress with the same properties as the camera compresses, but..
+       the camera uses multiple components, i.e. a line of RGRGRGRG... would be one component and the next line of GBGBGBGB the second.
+       unfortunately the image would have to get compressed a bit less efficient as a single-component image.
+       
+       a1ex had a good workaround that implies setting xres*2 and yres/2 which would help the compressor.
+       
+       canon compression:
+         1872x624x2 14 bpp
+         2348480 -> 4088448  (57.44% ratio)
+         
+       single component compression: 
+         1872x1248x1 14 bpp
+         3515085 -> 4088448  (85.98% ratio)
+
+       single component "x2" compression:
+         3744x624x1 14 bpp 
+         2353223 -> 4088448  (57.56% ratio)
+
+       so this method gets quite close to canon's in-camera compression.
+       while the resolution outputs differ, the real image data is the same.
+       
+       downside: we cannot double check if the lj92-reported resolution matches the RAWI information.
+
+       with --lj92-components the two lines get split into 2 or 4 interleaved components of xres*2/n columns.
+       the data stays the same, but not every decoder out there handles multi-component streams, so 1 is the default.
+    */
+    int lj92_components = ((xRes * 2) % components) ? 1 : components;
+    int lj92_width = xRes * 2 / lj92_components;
+    int lj92_height = yRes / 2;
+    int lj92_bitdepth = bpp;
+
+    if(verbose)
+    {
+        print_msg(MSG_INFO, "    LJ92: Compressing\n");
+        print_msg(MSG_INFO, "    LJ92: %dx%dx%d %d bpp (%d bytes buffer)\n", lj92_width, lj92_height, lj92_components, lj92_bitdepth, compress_buffer_size);
+    }
+
+    int ret = lj92_encoder_encode(encoder, compress_buffer, lj92_width, lj92_height, lj92_bitdepth, lj92_components, lj92_width * lj92_height * lj92_components, 0, NULL, 0, compressed, compressed_size);
+
+    if(ret == LJ92_ERROR_NONE)
+    {
+        if(verbose)
+        {
+            print_msg(MSG_INFO, "    LJ92: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_size, *compressed_size, ((float)*compressed_size * 100.0f) / (float)frame_size);
+        }
+    }
+    else
+    {
+        print_msg(MSG_ERROR, "    LJ92: Failed (%d)\n", ret);
+    }
+
+    return ret;
+}
+
+/*
+   inter-frame compression (-e), see interframe.h.
+   returns the distance of the frame to its keyframe in 'ref', or 0 if it has to become a keyframe itself.
+   that is every 'keyframes' frames, or when the keyframe can not be used for this frame.
+   the decision only depends on the order of the frames, so the output is the same with any number of threads.
+*/
+static uint32_t inter_key_distance(const inter_ref_t *ref, uint32_t *coded, uint32_t keyframes, uint32_t frame_number, int xRes, int yRes)
+{
+    if(!ref->valid || ref->xRes != xRes || ref->yRes != yRes || frame_number <= ref->frame_number || *coded >= keyframes)
+    {
+        *coded = 1;
+        return 0;
+    }
+
+    (*coded)++;
+    return frame_number - ref->frame_number;
+}
+
+/* like compress_frame_lj92(), but predict the frame from the keyframe in 'ref' unless 'key_distance' is 0 */
+static int compress_frame_inter(inter_encoder_t *encoder, const inter_ref_t *ref, uint32_t key_distance, int components, uint16_t *compress_buffer, int xRes, int yRes, int bpp, int frame_size, int verbose, uint8_t **compressed, int *compressed_size)
+{
+    if(verbose)
+    {
+        if(key_distance)
+        {
+            print_msg(MSG_INFO, "    INTER: Compressing, predicted from frame %d\n", ref->frame_number);
+        }
+        else
+        {
+            print_msg(MSG_INFO, "    INTER: Compressing keyframe\n");
+        }
+    }
+
+    int ret = inter_encode(encoder, compress_buffer, ref, key_distance, xRes, yRes, bpp, components, compressed, compressed_size);
+
+    if(ret == LJ92_ERROR_NONE)
+    {
+        if(verbose)
+        {
+            print_msg(MSG_INFO, "    INTER: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_size, *compressed_size, ((float)*compressed_size * 100.0f) / (float)frame_size);
+        }
+    }
+    else
+    {
+        print_msg(MSG_ERROR, "    INTER: Failed (%d)\n", ret);
+    }
+
+    return ret;
+}
+#endif
+
+/*
+   multithreaded DNG export (--threads).
+   the main loop keeps on parsing blocks and hands every selected VIDF along with a snapshot of its
+   metadata to the worker threads, which decompress, process, compress and save the DNG.
+   jobs are retired in the order they were submitted, so error handling and progress messages
+   behave like the single threaded code path.
+*/
+typedef struct
+{
+    pool_job_t pool_job;              /* must be first, see thread_pool.h */
+    struct frame_info frame_info;     /* info_str points to info_string below */
+    char info_string[1024];
+    char *dng_filename;
+
+    /* VIDF payload, either pointing into the memory mapped file or into frame_buffer */
+    const uint8_t *payload;
+
+    /* owned by the job and swapped with the main loop's frame buffer */
+    uint8_t *frame_buffer;
+    uint32_t frame_buffer_size;
+    uint32_t read_size;
+    int frame_size;
+
+    int compressed_lj92;
+    int compressed_lzma;
+    int compressed_inter;
+    const inter_ref_t *inter_ref;     /* keyframe of inter-frame compressed input, kept by the main loop until the job is retired */
+    uint32_t frame_number;
+    int run_decompressor;
+    int xRes;
+    int yRes;
+    int bpp;
+    int verbose;
+
+    /* filled by the worker */
+    frame_result_e result;
+    int compressed_size;
+} dng_job_t;
+
+typedef struct
+{
+    thread_pool_t *pool;
+    struct dng_data *dng_data;        /* one set of DNG buffers per worker thread */
+    dng_job_t *jobs;                  /* ring of jobs in flight */
+#ifdef MLV_USE_LJ92
+    lj92_encoder *encoders;           /* one LJ92 encoder per worker thread */
+#endif
+    int threads;
+    int job_count;
+    uint32_t submitted;
+    uint32_t retired;
+
+    int show_progress;
+    uint32_t frames_saved;
+#ifdef MLV_USE_LJ92
+    int lj92_components;
+    int reserved;                     /* padding */
+#endif
+} dng_pipeline_t;
+
+static void dng_job_process(pool_job_t *pool_job, int worker, void *ctx)
+{
+    dng_job_t *job = (dng_job_t *)pool_job;
+    dng_pipeline_t *pipeline = (dng_pipeline_t *)ctx;
+    struct dng_data *dng_data = &pipeline->dng_data[worker];
+    struct frame_info *frame_info = &job->frame_info;
+    const uint8_t *frame_data = job->payload;
+
+    job->compressed_size = 0;
+
+    if(job->run_decompressor)
+    {
+        /* when reading from the mapped file, the job's buffer may not be allocated yet */
+        if(job->frame_buffer_size < (uint32_t)job->frame_size)
+        {
+            free(job->frame_buffer);
+            job->frame_buffer_size = job->frame_size;
+            job->frame_buffer = malloc(job->frame_buffer_size);
+
+            if(!job->frame_buffer)
+            {
+                print_msg(MSG_ERROR, "VIDF: Failed to allocate %d byte\n", job->frame_size);
+                job->frame_buffer_size = 0;
+                job->result = FRAME_ERROR;
+                return;
+            }
+        }
+
+        job->result = decompress_frame(job->payload, job->read_size, job->frame_buffer, job->frame_size, job->compressed_lj92, job->compressed_lzma,
+                                       job->compressed_inter, job->inter_ref, job->frame_number, job->xRes, job->yRes, job->bpp, job->verbose);
+        if(job->result != FRAME_OK)
+        {
+            return;
+        }
+        frame_data = job->frame_buffer;
+    }
+
+    /* only read by dng_init_data(), the main loop never passes mapped 16 bpp frames which would get modified in place */
+    frame_info->frame_buffer = (void *)frame_data;
+    frame_info->frame_buffer_size = job->frame_size;
+    dng_init_data(frame_info, dng_data);
+    dng_process_data(frame_info, dng_data);
+
+    if(frame_info->raw_state == COMPRESSED_RAW)
+    {
+#ifdef MLV_USE_LJ92
+        uint8_t *compressed = NULL;
+
+        if(compress_frame_lj92(pipeline->encoders[worker], pipeline->lj92_components, dng_data->image_buf, dng_data->image_size, job->xRes, job->yRes, job->bpp, job->frame_size, job->verbose, &compressed, &job->compressed_size) != LJ92_ERROR_NONE)
+        {
+            job->result = FRAME_ERROR;
+            return;
+        }
+
+        /* dng_save() restores the original image buffer */
+        dng_data->image_buf = (uint16_t *)compressed;
+        dng_data->image_size = job->compressed_size;
+#endif
+    }
+
+    frame_info->dng_filename = job->dng_filename;
+    dng_init_header(frame_info, dng_data);
+
+    job->result = FRAME_OK;
+    if(!dng_save(frame_info, dng_data))
+    {
+        print_msg(MSG_ERROR, "VIDF: Failed writing into .DNG file\n");
+        job->result = FRAME_SKIP;
+    }
+}
+
+static dng_pipeline_t *dng_pipeline_create(int threads, int show_progress, int lj92_components)
+{
+    dng_pipeline_t *pipeline = calloc(1, sizeof(dng_pipeline_t));
+
+    if(!pipeline)
+    {
+        return NULL;
+    }
+
+    /* two jobs per worker, so there is always one queued while the other one gets saved */
+    pipeline->threads = threads;
+    pipeline->job_count = 2 * threads;
+    pipeline->show_progress = show_progress;
+    pipeline->dng_data = calloc(threads, sizeof(struct dng_data));
+    pipeline->jobs = calloc(pipeline->job_count, sizeof(dng_job_t));
+    int ok = pipeline->dng_data && pipeline->jobs;
+
+#ifdef MLV_USE_LJ92
+    pipeline->lj92_components = lj92_components;
+    pipeline->encoders = calloc(threads, sizeof(lj92_encoder));
+    ok = ok && pipeline->encoders;
+
+    for(int pos = 0; ok && pos < threads; pos++)
+    {
+        ok = lj92_encoder_open(&pipeline->encoders[pos]) == LJ92_ERROR_NONE;
+    }
+#endif
+
+    if(ok)
+    {
+        pipeline->pool = pool_create(threads, &dng_job_process, pipeline);
+    }
+
+    if(!pipeline->pool)
+    {
+#ifdef MLV_USE_LJ92
+        for(int pos = 0; pipeline->encoders && pos < threads; pos++)
+        {
+            lj92_encoder_close(pipeline->encoders[pos]);
+        }
+        free(pipeline->encoders);
+#endif
+        free(pipeline->dng_data);
+        free(pipeline->jobs);
+        free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+/* wait for the oldest job in flight and return its result */
+static frame_result_e dng_pipeline_retire(dng_pipeline_t *pipeline)
+{
+    dng_job_t *job = &pipeline->jobs[pipeline->retired % pipeline->job_count];
+
+    pool_wait(pipeline->pool, &job->pool_job);
+    pipeline->retired++;
+
+    if(job->result == FRAME_OK)
+    {
+        pipeline->frames_saved++;
+
+        if(pipeline->show_progress)
+        {
+            if(job->frame_info.raw_state != COMPRESSED_RAW)
+            {
+                print_msg(MSG_INFO, "\rCurrent frame '%s' (frames saved: %d)", job->dng_filename, pipeline->frames_saved);
+            }
+            else if(job->compressed_size != job->frame_size)
+            {
+                print_msg(MSG_INFO, "  saving: %d -> %d  (%2.2f%% ratio)\n", job->frame_size, job->compressed_size, ((float)job->compressed_size * 100.0f) / (float)job->frame_size);
+            }
+        }
+    }
+
+    free(job->dng_filename);
+    job->dng_filename = NULL;
+
+    return job->result;
+}
+
+/* get the next free job. if all are in flight, the oldest one gets retired and its result is returned in 'result' */
+static dng_job_t *dng_pipeline_get_job(dng_pipeline_t *pipeline, frame_result_e *result)
+{
+    *result = FRAME_OK;
+
+    if(pipeline->submitted - pipeline->retired >= (uint32_t)pipeline->job_count)
+    {
+        *result = dng_pipeline_retire(pipeline);
+    }
+
+    return &pipeline->jobs[pipeline->submitted % pipeline->job_count];
+}
+
+/*
+   queue the job. 'frame_data' is either the main loop's frame buffer, which then gets swapped with the job's one,
+   or points into the memory mapped file and is used as it is.
+*/
+static void dng_pipeline_submit(dng_pipeline_t *pipeline, dng_job_t *job, struct frame_info *frame_info, const uint8_t *frame_data, uint8_t **frame_buffer, uint32_t *frame_buffer_size)
+{
+    job->frame_info = *frame_info;
+    job->frame_info.show_progress = 0;
+    strncpy(job->info_string, frame_info->info_str, sizeof(job->info_string) - 1);
+    job->frame_info.info_str = job->info_string;
+    job->payload = frame_data;
+
+    if(frame_data == *frame_buffer)
+    {
+        /* the main loop grows its buffer on demand, so an empty or small one is fine */
+        uint8_t *buffer = job->frame_buffer;
+        uint32_t buffer_size = job->frame_buffer_size;
+        job->frame_buffer = *frame_buffer;
+        job->frame_buffer_size = *frame_buffer_size;
+        *frame_buffer = buffer;
+        *frame_buffer_size = buffer_size;
+    }
+
+    pool_submit(pipeline->pool, &job->pool_job);
+    pipeline->submitted++;
+}
+
+/* finish all jobs in flight and free the pipeline */
+static void dng_pipeline_finish(dng_pipeline_t *pipeline)
+{
+    while(pipeline->retired != pipeline->submitted)
+    {
+        dng_pipeline_retire(pipeline);
+    }
+
+    pool_destroy(pipeline->pool);
+
+    for(int pos = 0; pos < pipeline->job_count; pos++)
+    {
+        free(pipeline->jobs[pos].frame_buffer);
+    }
+
+    for(int pos = 0; pos < pipeline->threads; pos++)
+    {
+        dng_free_buffers(&pipeline->dng_data[pos]);
+#ifdef MLV_USE_LJ92
+        lj92_encoder_close(pipeline->encoders[pos]);
+#endif
+    }
+
+#ifdef MLV_USE_LJ92
+    free(pipeline->encoders);
+#endif
+    free(pipeline->jobs);
+    free(pipeline->dng_data);
+    free(pipeline);
+}
+
+#ifdef MLV_USE_LJ92
+/*
+   keyframes of inter-frame compressed input. every predicted frame only depends on its keyframe, so the main loop
+   decodes that once and the frames referring to it can then be decoded anywhere, also in the DNG worker threads.
+   there are two of them, so frames of the previous keyframe may still be in flight while the next one gets decoded.
+*/
+typedef struct
+{
+    inter_ref_t refs[2];
+    uint32_t ref_jobs[2];             /* number of DNG jobs submitted when the keyframe was used last */
+    int last;                         /* the one used last */
+    int reserved;                     /* padding */
+} inter_decoder_t;
+
+/* get the payload of a VIDF with given frame number using the index. 'buffer' gets allocated when not memory mapped */
+static const uint8_t *inter_read_frame(mlv_index_t *block_xref, FILE **in_files, int in_file_count, mlv_reader_t *mlv_reader, uint32_t frame_number, uint8_t **buffer, uint32_t *size)
+{
+    uint32_t pos = block_xref ? mlv_index_find_frame(block_xref, frame_number) : MLV_INDEX_NONE;
+
+    *buffer = NULL;
+
+    if(pos == MLV_INDEX_NONE)
+    {
+        return NULL;
+    }
+
+    const mlv_index_entry_t *entry = mlv_index_entry(block_xref, pos);
+    const uint8_t *block = NULL;
+
+    if(entry->fileNumber >= in_file_count || entry->blockSize < sizeof(mlv_vidf_hdr_t))
+    {
+        return NULL;
+    }
+
+    if(mlv_reader)
+    {
+        block = mlv_reader_get(mlv_reader, entry->fileNumber, entry->offset, entry->blockSize);
+    }
+    else
+    {
+        FILE *in_file = in_files[entry->fileNumber];
+        uint64_t position = file_get_pos(in_file);
+
+        *buffer = malloc(entry->blockSize);
+        file_set_pos(in_file, entry->offset, SEEK_SET);
+
+        if(*buffer && fread(*buffer, entry->blockSize, 1, in_file) == 1)
+        {
+            block = *buffer;
+        }
+        file_set_pos(in_file, position, SEEK_SET);
+    }
+
+    if(!block)
+    {
+        return NULL;
+    }
+
+    mlv_vidf_hdr_t vidf_hdr;
+    memcpy(&vidf_hdr, block, sizeof(mlv_vidf_hdr_t));
+
+    if(memcmp(vidf_hdr.blockType, "VIDF", 4) || vidf_hdr.blockSize != entry->blockSize || vidf_hdr.frameSpace > vidf_hdr.blockSize - sizeof(mlv_vidf_hdr_t))
+    {
+        return NULL;
+    }
+
+    *size = vidf_hdr.blockSize - sizeof(mlv_vidf_hdr_t) - vidf_hdr.frameSpace;
+    return &block[sizeof(mlv_vidf_hdr_t) + vidf_hdr.frameSpace];
+}
+
+/*
+   make sure the keyframe of an inter-frame compressed VIDF is decoded and return it in 'ref', NULL for intra frames.
+   a keyframe that was not read before, e.g. when only a range of frames gets processed, is looked up in the index.
+   DNG jobs still using the keyframe that gets replaced are retired first.
+*/
+static frame_result_e inter_prepare_ref(inter_decoder_t *decoder, dng_pipeline_t *dng_pipeline, int relaxed, const uint8_t *payload, uint32_t read_size, uint32_t frame_number, int xRes, int yRes,
+                                        mlv_index_t *block_xref, FILE **in_files, int in_file_count, mlv_reader_t *mlv_reader, const inter_ref_t **ref)
+{
+    int frame_type = 0;
+    uint32_t key_frame = 0;
+
+    *ref = NULL;
+
+    if(inter_frame_info(payload, read_size, frame_number, &frame_type, &key_frame) != LJ92_ERROR_NONE)
+    {
+        print_msg(MSG_ERROR, "    INTER: Invalid frame header\n");
+        return FRAME_SKIP;
+    }
+
+    if(frame_type == INTER_FRAME_INTRA)
+    {
+        return FRAME_OK;
+    }
+
+    for(int pos = 0; pos < 2; pos++)
+    {
+        inter_ref_t *cached = &decoder->refs[pos];
+
+        if(cached->valid && cached->frame_number == key_frame && cached->xRes == xRes && cached->yRes == yRes)
+        {
+            decoder->last = pos;
+            *ref = cached;
+            return FRAME_OK;
+        }
+    }
+
+    /* replace the other one, once no DNG job needs it anymore */
+    int pos = decoder->last ^ 1;
+
+    while(dng_pipeline && (int32_t)(decoder->ref_jobs[pos] - dng_pipeline->retired) > 0)
+    {
+        frame_result_e ret = dng_pipeline_retire(dng_pipeline);
+
+        if(ret == FRAME_ERROR || (ret == FRAME_SKIP && !relaxed))
+        {
+            return FRAME_ERROR;
+        }
+    }
+
+    const uint8_t *key_payload = payload;
+    uint32_t key_size = read_size;
+    uint8_t *key_buffer = NULL;
+
+    if(key_frame != frame_number)
+    {
+        key_payload = inter_read_frame(block_xref, in_files, in_file_count, mlv_reader, key_frame, &key_buffer, &key_size);
+
+        if(!key_payload)
+        {
+            print_msg(MSG_ERROR, "    INTER: Keyframe %d of frame %d not found%s\n", key_frame, frame_number, block_xref ? "" : ", try again with an index file (-x)");
+            free(key_buffer);
+            return FRAME_SKIP;
+        }
+    }
+
+    int ret = inter_decode_key(key_payload, key_size, key_frame, &decoder->refs[pos], xRes, yRes);
+    free(key_buffer);
+
+    if(ret != LJ92_ERROR_NONE)
+    {
+        print_msg(MSG_ERROR, "    INTER: Decompressing keyframe %d failed (%d)\n", key_frame, ret);
+        return (ret == LJ92_ERROR_NO_MEMORY) ? FRAME_ERROR : FRAME_SKIP;
+    }
+
+    decoder->last = pos;
+    *ref = &decoder->refs[pos];
+    return FRAME_OK;
+}
+
+/*
+   multithreaded LJ92 or LZMA compression of MLV output (--threads along with -c, -e, --lzma or -d).
+   the main loop still reads and processes the frames, the worker threads unpack and compress them.
+   compressed input the main loop doesn't need to look at gets decoded by the workers as well.
+   jobs are retired in the order they were submitted. every block the main loop writes while frames
+   are still in flight gets queued behind the latest one, so the output has the same block order
+   as the single threaded code path.
+*/
+typedef struct
+{
+    pool_job_t pool_job;              /* must be first, see thread_pool.h */
+
+    /* owned by the job and swapped with the main loop's frame buffer. holds the compressed frame when done */
+    uint8_t *frame_buffer;
+    uint32_t frame_buffer_size;
+    int frame_size;
+
+    /* blocks written by the main loop after this frame got submitted */
+    uint8_t *trailer;
+    uint32_t trailer_size;
+    uint32_t trailer_alloc;
+
+    /* inter-frame compression: the keyframe and the distance to it, 0 for a keyframe */
+    const inter_ref_t *inter_ref;
+    uint32_t key_distance;
+
+    int xRes;
+    int yRes;
+    int bpp;                          /* bit depth of the packed frame */
+    int lj92_bpp;                     /* bit depth to compress with */
+    int verbose;
+
+    /* the payload is still LJ92 or LZMA compressed with 'read_size' bytes and gets decoded first */
+    int compressed_lj92;
+    int compressed_lzma;
+    uint32_t read_size;
+
+    /* filled by the worker */
+    int result;
+    int compressed_size;
+
+    /* --lzma: audio frames get compressed too, this is an AUDF then */
+    int audio;
+    mlv_audf_hdr_t audf_hdr;
+    mlv_vidf_hdr_t vidf_hdr;
+} mlv_job_t;
+
+typedef struct
+{
+    lj92_encoder encoder;
+    inter_encoder_t *inter_encoder;
+    uint16_t *unpacked;
+    uint8_t *decoded;
+#ifdef MLV_USE_LZMA
+    uint8_t *lzma;
+    size_t lzma_size;
+#endif
+    uint32_t unpacked_size;
+    uint32_t decoded_size;
+} mlv_worker_t;
+
+typedef struct
+{
+    thread_pool_t *pool;
+    mlv_worker_t *workers;
+    mlv_job_t *jobs;                  /* ring of jobs in flight */
+    FILE *out_file;
+
+    int threads;
+    int job_count;
+    uint32_t submitted;
+    uint32_t retired;
+
+    int lj92;                         /* compress frames with LJ92 (-c) or inter-frame (-e) */
+    int lj92_components;
+    int lzma_level;                   /* compress frames and audio with LZMA if not negative (--lzma) */
+    int show_progress;
+    int failed;                       /* once writing failed, frames in flight are not written anymore */
+    uint32_t frames_written;
+
+    /* inter-frame compression (-e) if not zero. the main loop unpacks every keyframe, which the following jobs predict from */
+    uint32_t keyframes;
+    uint32_t keyframe_coded;
+    inter_ref_t refs[2];
+    uint32_t ref_jobs[2];             /* number of jobs submitted when the keyframe was used last */
+    int ref_pos;
+    int reserved;                     /* padding */
+} mlv_pipeline_t;
+
+static void mlv_job_process(pool_job_t *pool_job, int worker, void *ctx)
+{
+    mlv_job_t *job = (mlv_job_t *)pool_job;
+    mlv_pipeline_t *pipeline = (mlv_pipeline_t *)ctx;
+    mlv_worker_t *work = &pipeline->workers[worker];
+    uint32_t unpacked_size = job->xRes * job->yRes * sizeof(uint16_t);
+    uint8_t *frame = job->frame_buffer;
+    uint8_t *compressed = NULL;
+
+    job->result = LJ92_ERROR_NO_MEMORY;
+    job->compressed_size = 0;
+
+    /* compressed input the main loop passed on as it is */
+    if(job->compressed_lj92 || job->compressed_lzma)
+    {
+        if(work->decoded_size < (uint32_t)job->frame_size)
+        {
+            free(work->decoded);
+            work->decoded_size = job->frame_size;
+            work->decoded = malloc(job->frame_size);
+
+            if(!work->decoded)
+            {
+                work->decoded_size = 0;
+                return;
+            }
+        }
+
+        if(decompress_frame(job->frame_buffer, job->read_size, work->decoded, job->frame_size, job->compressed_lj92, job->compressed_lzma,
+                            0, NULL, job->vidf_hdr.frameNumber, job->xRes, job->yRes, job->bpp, job->verbose) != FRAME_OK)
+        {
+            job->result = LJ92_ERROR_CORRUPT;
+            return;
+        }
+        frame = work->decoded;
+    }
+
+    if(job->audio || pipeline->lzma_level >= 0)
+    {
+#ifdef MLV_USE_LZMA
+        size_t bound = lzma_frame_bound(job->frame_size);
+
+        if(work->lzma_size < bound)
+        {
+            free(work->lzma);
+            work->lzma_size = bound;
+            work->lzma = malloc(bound);
+
+            if(!work->lzma)
+            {
+                work->lzma_size = 0;
+                return;
+            }
+        }
+
+        job->compressed_size = lzma_frame_compress(frame, job->frame_size, pipeline->lzma_level, work->lzma);
+
+        if(!job->compressed_size)
+        {
+            print_msg(MSG_ERROR, "    LZMA: Failed to compress %s #%d\n", job->audio ? "AUDF" : "VIDF", job->audio ? job->audf_hdr.frameNumber : job->vidf_hdr.frameNumber);
+            job->result = LJ92_ERROR_CORRUPT;
+            return;
+        }
+        compressed = work->lzma;
+        job->result = LJ92_ERROR_NONE;
+#endif
+    }
+    else if(pipeline->lj92)
+    {
+        if(work->unpacked_size < unpacked_size)
+        {
+            free(work->unpacked);
+            work->unpacked_size = unpacked_size;
+            work->unpacked = malloc(unpacked_size);
+
+            if(!work->unpacked)
+            {
+                work->unpacked_size = 0;
+                return;
+            }
+        }
+
+        /* repack the 16 bit words containing values with max 14 bit */
+        int orig_pitch = job->xRes * job->bpp / 8;
+
+        for(int y = 0; y < job->yRes; y++)
+        {
+            void *src_line = &frame[y * orig_pitch];
+            uint16_t *dst_line = &work->unpacked[y * job->xRes];
+
+            bitpack_unpack(src_line, dst_line, job->xRes, job->bpp);
+        }
+
+        if(pipeline->keyframes)
+        {
+            job->result = compress_frame_inter(work->inter_encoder, job->inter_ref, job->key_distance, pipeline->lj92_components, work->unpacked, job->xRes, job->yRes, job->lj92_bpp, job->frame_size, job->verbose, &compressed, &job->compressed_size);
+        }
+        else
+        {
+            job->result = compress_frame_lj92(work->encoder, pipeline->lj92_components, work->unpacked, unpacked_size, job->xRes, job->yRes, job->lj92_bpp, job->frame_size, job->verbose, &compressed, &job->compressed_size);
+        }
+    }
+    else
+    {
+        /* only decoded (-d) */
+        compressed = frame;
+        job->compressed_size = job->frame_size;
+        job->result = LJ92_ERROR_NONE;
+    }
+
+    if(job->result != LJ92_ERROR_NONE || compressed == job->frame_buffer)
+    {
+        return;
+    }
+
+    /* the encoder's buffer gets reused for the next frame, so keep a copy until the main loop writes it */
+    if(job->frame_buffer_size < (uint32_t)job->compressed_size)
+    {
+        uint8_t *buffer = realloc(job->frame_buffer, job->compressed_size);
+
+        if(!buffer)
+        {
+            job->result = LJ92_ERROR_NO_MEMORY;
+            return;
+        }
+        job->frame_buffer = buffer;
+        job->frame_buffer_size = job->compressed_size;
+    }
+    memcpy(job->frame_buffer, compressed, job->compressed_size);
+}
+
+static mlv_pipeline_t *mlv_pipeline_create(int threads, FILE *out_file, int lj92, int lj92_components, uint32_t keyframes, int lzma_level, int show_progress)
+{
+    mlv_pipeline_t *pipeline = calloc(1, sizeof(mlv_pipeline_t));
+
+    if(!pipeline)
+    {
+        return NULL;
+    }
+
+    /* two jobs per worker, so there is always one queued while the other one gets compressed */
+    pipeline->threads = threads;
+    pipeline->job_count = 2 * threads;
+    pipeline->out_file = out_file;
+    pipeline->lj92 = lj92;
+    pipeline->lj92_components = lj92_components;
+    pipeline->keyframes = keyframes;
+    pipeline->lzma_level = lzma_level;
+    pipeline->show_progress = show_progress;
+    pipeline->workers = calloc(threads, sizeof(mlv_worker_t));
+    pipeline->jobs = calloc(pipeline->job_count, sizeof(mlv_job_t));
+    int ok = pipeline->workers && pipeline->jobs;
+
+    for(int pos = 0; ok && pos < threads; pos++)
+    {
+        if(lj92 && keyframes)
+        {
+            ok = inter_encoder_open(&pipeline->workers[pos].inter_encoder) == LJ92_ERROR_NONE;
+        }
+        else if(lj92)
+        {
+            ok = lj92_encoder_open(&pipeline->workers[pos].encoder) == LJ92_ERROR_NONE;
+        }
+    }
+
+    if(ok)
+    {
+        pipeline->pool = pool_create(threads, &mlv_job_process, pipeline);
+    }
+
+    if(!pipeline->pool)
+    {
+        for(int pos = 0; pipeline->workers && pos < threads; pos++)
+        {
+            lj92_encoder_close(pipeline->workers[pos].encoder);
+            inter_encoder_close(pipeline->workers[pos].inter_encoder);
+        }
+        free(pipeline->workers);
+        free(pipeline->jobs);
+        free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+/* wait for the oldest job in flight and write its frame along with the blocks queued behind it. returns 0 on failure */
+static int mlv_pipeline_retire(mlv_pipeline_t *pipeline)
+{
+    mlv_job_t *job = &pipeline->jobs[pipeline->retired % pipeline->job_count];
+    int ok = 1;
+
+    pool_wait(pipeline->pool, &job->pool_job);
+    pipeline->retired++;
+
+    if(pipeline->failed || job->result != LJ92_ERROR_NONE)
+    {
+        ok = 0;
+    }
+    else if(job->audio)
+    {
+        job->audf_hdr.blockSize = sizeof(mlv_audf_hdr_t) + job->compressed_size;
+        job->audf_hdr.frameSpace = 0;
+
+        if(fwrite(&job->audf_hdr, sizeof(mlv_audf_hdr_t), 1, pipeline->out_file) != 1 ||
+           fwrite(job->frame_buffer, job->compressed_size, 1, pipeline->out_file) != 1)
+        {
+            print_msg(MSG_ERROR, "AUDF: Failed writing into .MLV file\n");
+            ok = 0;
+        }
+    }
+    else
+    {
+        /* delete free space and correct header size */
+        job->vidf_hdr.blockSize = sizeof(mlv_vidf_hdr_t) + job->compressed_size;
+        job->vidf_hdr.frameSpace = 0;
+
+        if(fwrite(&job->vidf_hdr, sizeof(mlv_vidf_hdr_t), 1, pipeline->out_file) != 1 ||
+           fwrite(job->frame_buffer, job->compressed_size, 1, pipeline->out_file) != 1)
+        {
+            print_msg(MSG_ERROR, "VIDF: Failed writing into .MLV file\n");
+            ok = 0;
+        }
+        else if(pipeline->show_progress && job->compressed_size != job->frame_size)
+        {
+            if(!pipeline->frames_written)
+            {
+                print_msg(MSG_INFO, "\nWriting %s compressed frames...\n", pipeline->lzma_level >= 0 ? "LZMA" : "LJ92");
+            }
+            print_msg(MSG_INFO, "  saving: %d -> %d  (%2.2f%% ratio)\n", job->frame_size, job->compressed_size, ((float)job->compressed_size * 100.0f) / (float)job->frame_size);
+        }
+        pipeline->frames_written++;
+    }
+
+    if(ok && job->trailer_size && fwrite(job->trailer, job->trailer_size, 1, pipeline->out_file) != 1)
+    {
+        print_msg(MSG_ERROR, "Failed writing into .MLV file\n");
+        ok = 0;
+    }
+    job->trailer_size = 0;
+
+    if(!ok)
+    {
+        pipeline->failed = 1;
+    }
+
+    return ok;
+}
+
+/*
+   write a block into the output file. if there are frames in flight, it gets queued behind the latest one.
+   returns 0 on failure, like the fwrite() calls it replaces.
+*/
+static int mlv_pipeline_write(mlv_pipeline_t *pipeline, FILE *out_file, const void *data, uint32_t size)
+{
+    if(!pipeline || pipeline->submitted == pipeline->retired)
+    {
+        return fwrite(data, size, 1, out_file) == 1;
+    }
+
+    mlv_job_t *job = &pipeline->jobs[(pipeline->submitted - 1) % pipeline->job_count];
+
+    if(job->trailer_size + size > job->trailer_alloc)
+    {
+        uint32_t alloc = MAX(job->trailer_size + size, 2 * job->trailer_alloc);
+        uint8_t *trailer = realloc(job->trailer, alloc);
+
+        if(!trailer)
+        {
+            return 0;
+        }
+        job->trailer = trailer;
+        job->trailer_alloc = alloc;
+    }
+
+    memcpy(&job->trailer[job->trailer_size], data, size);
+    job->trailer_size += size;
+
+    return 1;
+}
+
+/*
+   queue a frame for compression. if all jobs are in flight, the oldest one gets written first.
+   the main loop's frame buffer is swapped with the job's one. returns 0 on failure
+*/
+static int mlv_pipeline_submit(mlv_pipeline_t *pipeline, mlv_vidf_hdr_t *vidf_hdr, uint8_t **frame_buffer, uint32_t *frame_buffer_size, int frame_size, int xRes, int yRes, int bpp, int lj92_bpp,
+                               int compressed_lj92, int compressed_lzma, uint32_t read_size, int verbose)
+{
+    if(pipeline->submitted - pipeline->retired >= (uint32_t)pipeline->job_count && !mlv_pipeline_retire(pipeline))
+    {
+        return 0;
+    }
+
+    mlv_job_t *job = &pipeline->jobs[pipeline->submitted % pipeline->job_count];
+    uint8_t *buffer = job->frame_buffer;
+    uint32_t buffer_size = job->frame_buffer_size;
+
+    if(pipeline->lj92 && pipeline->keyframes)
+    {
+        inter_ref_t *ref = &pipeline->refs[pipeline->ref_pos];
+        uint32_t key_distance = inter_key_distance(ref, &pipeline->keyframe_coded, pipeline->keyframes, vidf_hdr->frameNumber, xRes, yRes);
+
+        if(!key_distance)
+        {
+            /* the new keyframe replaces the one before the current one, once all frames predicted from that are written */
+            int pos = pipeline->ref_pos ^ 1;
+
+            while((int32_t)(pipeline->ref_jobs[pos] - pipeline->retired) > 0)
+            {
+                if(!mlv_pipeline_retire(pipeline))
+                {
+                    return 0;
+                }
+            }
+
+            ref = &pipeline->refs[pos];
+            if(inter_ref_alloc(ref, xRes, yRes) != LJ92_ERROR_NONE)
+            {
+                print_msg(MSG_ERROR, "    INTER: Failed to allocate keyframe\n");
+                return 0;
+            }
+
+            int orig_pitch = xRes * bpp / 8;
+
+            for(int y = 0; y < yRes; y++)
+            {
+                void *src_line = &(*frame_buffer)[y * orig_pitch];
+                uint16_t *dst_line = &ref->data[y * xRes];
+
+                bitpack_unpack(src_line, dst_line, xRes, bpp);
+            }
+
+            ref->frame_number = vidf_hdr->frameNumber;
+            ref->valid = 1;
+            pipeline->ref_pos = pos;
+        }
+
+        job->key_distance = key_distance;
+        job->inter_ref = ref;
+        pipeline->ref_jobs[pipeline->ref_pos] = pipeline->submitted + 1;
+    }
+
+    job->audio = 0;
+    job->vidf_hdr = *vidf_hdr;
+    job->frame_size = frame_size;
+    job->xRes = xRes;
+    job->yRes = yRes;
+    job->bpp = bpp;
+    job->lj92_bpp = lj92_bpp;
+    job->compressed_lj92 = compressed_lj92;
+    job->compressed_lzma = compressed_lzma;
+    job->read_size = read_size;
+    job->verbose = verbose;
+
+    /* the main loop grows its buffer on demand, so an empty or small one is fine */
+    job->frame_buffer = *frame_buffer;
+    job->frame_buffer_size = *frame_buffer_size;
+    *frame_buffer = buffer;
+    *frame_buffer_size = buffer_size;
+
+    pool_submit(pipeline->pool, &job->pool_job);
+    pipeline->submitted++;
+
+    return 1;
+}
+
+/* queue an audio frame for LZMA compression, the payload gets copied. returns 0 on failure */
+static int mlv_pipeline_submit_audio(mlv_pipeline_t *pipeline, mlv_audf_hdr_t *audf_hdr, const uint8_t *payload, uint32_t size)
+{
+    if(pipeline->submitted - pipeline->retired >= (uint32_t)pipeline->job_count && !mlv_pipeline_retire(pipeline))
+    {
+        return 0;
+    }
+
+    mlv_job_t *job = &pipeline->jobs[pipeline->submitted % pipeline->job_count];
+
+    if(job->frame_buffer_size < size)
+    {
+        uint8_t *buffer = realloc(job->frame_buffer, size);
+
+        if(!buffer)
+        {
+            return 0;
+        }
+        job->frame_buffer = buffer;
+        job->frame_buffer_size = size;
+    }
+    memcpy(job->frame_buffer, payload, size);
+
+    job->audio = 1;
+    job->audf_hdr = *audf_hdr;
+    job->frame_size = size;
+    job->compressed_lj92 = 0;
+    job->compressed_lzma = 0;
+
+    pool_submit(pipeline->pool, &job->pool_job);
+    pipeline->submitted++;
+
+    return 1;
+}
+
+/* write all frames in flight and free the pipeline. returns 0 if any of them failed */
+static int mlv_pipeline_finish(mlv_pipeline_t *pipeline)
+{
+    int ok = 1;
+
+    while(pipeline->retired != pipeline->submitted)
+    {
+        ok = mlv_pipeline_retire(pipeline) && ok;
+    }
+
+    pool_destroy(pipeline->pool);
+
+    for(int pos = 0; pos < pipeline->job_count; pos++)
+    {
+        free(pipeline->jobs[pos].frame_buffer);
+        free(pipeline->jobs[pos].trailer);
+    }
+
+    for(int pos = 0; pos < pipeline->threads; pos++)
+    {
+        lj92_encoder_close(pipeline->workers[pos].encoder);
+        inter_encoder_close(pipeline->workers[pos].inter_encoder);
+        free(pipeline->workers[pos].unpacked);
+        free(pipeline->workers[pos].decoded);
+#ifdef MLV_USE_LZMA
+        free(pipeline->workers[pos].lzma);
+#endif
+    }
+
+    inter_ref_free(&pipeline->refs[0]);
+    inter_ref_free(&pipeline->refs[1]);
+
+    free(pipeline->jobs);
+    free(pipeline->workers);
+    free(pipeline);
+
+    return ok;
+}
+#else
+/* without LJ92 there is nothing to compress in parallel, blocks get written right away */
+typedef void mlv_pipeline_t;
+
+static int mlv_pipeline_write(mlv_pipeline_t *pipeline, FILE *out_file, const void *data, uint32_t size)
+{
+    (void)pipeline;
+    return fwrite(data, size, 1, out_file) == 1;
+}
+#endif
+
+int main (int argc, char *argv[])
+{
+    char *input_filename = NULL;
+    char *output_filename = NULL;
+    char *subtract_filename = NULL;
+    char *flatfield_filename = NULL;
+    char *lut_filename = NULL;
+    char *extract_block = NULL;
+    char *inject_filename = NULL;
+    int blocks_processed = 0;
+
     int extract_frames = 0;
     uint32_t frame_start = 0;
     uint32_t frame_end = UINT32_MAX;
@@ -1259,14 +2210,18 @@ int main (int argc, char *argv[])
     uint32_t vidf_max_number = 0;
 
     int version = 0;
-    int delta_encode_mode = 0;
+    int inter_encode_mode = 0;
+    uint32_t inter_keyframes = 30;
     int xref_mode = 0;
     int average_mode = 0;
     int average_vert = 0;
     int average_hor = 0;
     int subtract_mode = 0;
     int flatfield_mode = 0;
-    int average_samples = 0;
+    int stack_mode = STACK_MEAN;
+    int stack_block = 16;
+    float stack_kappa = 3.0f;
+    int stack_memory = 1024;
     int relaxed = 0;
     int visualize = 0;
     int skip_xref = 0;
@@ -1277,6 +2232,10 @@ int main (int argc, char *argv[])
     int bit_zap = 0;
     int compress_output = 0;
     int decompress_input = 0;
+    int lzma_level = -1;
+    int proxy_output = 0;
+    struct proxy_params proxy_params = { .format = PROXY_Y4M, .debayer = PROXY_HALF, .gamma = 2.2 };
+    proxy_t *proxy = NULL;
     int verbose = 0;
     int alter_fps = 0;
     int pass_through = 0;
@@ -1285,13 +2244,15 @@ int main (int argc, char *argv[])
     int video_xRes = 0;
     int video_yRes = 0;
 
-    lua_State *lua_state = NULL;
+    lua_hooks_t *lua_hooks = NULL;
+    int lua_frames = 0;
 
     /* long options */
     int chroma_smooth_method = 0;
     int black_fix = 0;
     int white_fix = 0;
     int dng_output = 0;
+    int dng_compressed = 0;
     int dump_xrefs = 0;
     int fix_focus_pixels = 1;
     int fix_cold_pixels = 1;
@@ -1299,17 +2260,38 @@ int main (int argc, char *argv[])
     int is_dual_iso = 0;
     int save_bpm_file = 0;
     int fix_pattern_noise = 0;
+    int fpn_clip_samples = 0;
+    int fpn_clip_refine = 0;
+    fpn_profile_t *fpn_profile = NULL;
+    uint32_t fpn_frames = 0;
     int deflicker_target = 0;
     int show_progress = 0;
     int pack_dng_bits = 1;
     int no_audio = 0;
+    int no_mmap = 0;
     int fpi_method = 0; // default is 'mlvfs'
     int bpi_method = 0; // default is 'mlvfs'
     int crop_rec = 0;
+    int threads = 1;
+    int lj92_components = 1;
+    char *pixel_cache_dir = NULL;
     
     /* helper structs for DNG exporting */
     struct frame_info frame_info = { 0 };
-    struct dng_data dng_data = { 0, 0, 0, 0, NULL, NULL, NULL, NULL };
+    struct dng_data dng_data = { 0, 0, 0, 0, NULL, NULL, NULL, NULL, 0, 0 };
+    dng_pipeline_t *dng_pipeline = NULL;
+
+    /* threads compressing MLV output (--threads with -c) */
+    mlv_pipeline_t *mlv_pipeline = NULL;
+#ifdef MLV_USE_LJ92
+    lj92_encoder lj92_enc = NULL;
+
+    /* inter-frame compression of the single threaded code path, and keyframes of inter-frame compressed input */
+    inter_encoder_t *inter_enc = NULL;
+    inter_ref_t inter_enc_ref = { 0 };
+    uint32_t inter_enc_coded = 0;
+    inter_decoder_t inter_dec = { 0 };
+#endif
     
     enum bug_id fix_bug = BUG_ID_NONE;
     
@@ -1361,6 +2343,7 @@ int main (int argc, char *argv[])
         {"batch",  no_argument, &batch_mode,  1 },
         {"dump-xrefs",   no_argument, &dump_xrefs,  1 },
         {"dng",    no_argument, &dng_output,  1 },
+        {"dng-compressed",  no_argument, &dng_compressed,  1 },
         {"no-cs",  no_argument, &chroma_smooth_method,  0 },
         {"cs2x2",  no_argument, &chroma_smooth_method,  2 },
         {"cs3x3",  no_argument, &chroma_smooth_method,  3 },
@@ -1376,12 +2359,27 @@ int main (int argc, char *argv[])
         {"save-bpm",    no_argument, &save_bpm_file,  1 },
         {"force-stripes",  no_argument, &fix_vert_stripes,  2 },
         {"fixpn",  no_argument, &fix_pattern_noise,  1 },
+        {"fixpn-clip",  optional_argument, NULL,  'H' },
+        {"fixpn-refine",  required_argument, NULL,  'J' },
         {"deflicker",  optional_argument, NULL,  'D' },
         {"show-progress",  no_argument, &show_progress,  1 },
         {"no-bitpack",  no_argument, &pack_dng_bits,  0 },
         {"no-audio",  no_argument, &no_audio,  1 },
+        {"no-mmap",  no_argument, &no_mmap,  1 },
         {"fpi",     required_argument, NULL,  'i' },
         {"bpi",     required_argument, NULL,  'j' },
+        {"threads", optional_argument, NULL,  'N' },
+        {"lj92-components", required_argument, NULL,  'K' },
+        {"keyframes", required_argument, NULL,  'k' },
+        {"lzma",      optional_argument, NULL,  'R' },
+        {"proxy",     optional_argument, NULL,  'O' },
+        {"proxy-debayer", required_argument, NULL,  'Q' },
+        {"proxy-gamma", required_argument, NULL,  'E' },
+        {"stack",     required_argument, NULL,  'G' },
+        {"stack-block", required_argument, NULL,  'g' },
+        {"stack-kappa", required_argument, NULL,  'q' },
+        {"stack-mem", required_argument, NULL,  'm' },
+        {"pixel-cache", optional_argument, NULL,  'P' },
         
         /* MLV autopsy */
         {"relaxed",       no_argument, &relaxed,  1 },
@@ -1523,24 +2521,16 @@ int main (int argc, char *argv[])
                     print_msg(MSG_ERROR, "Error: Missing LUA script filename\n");
                     return ERR_PARAM;
                 }
-                lua_state = luaL_newstate();
-                if(!lua_state)
-                {
-                    print_msg(MSG_ERROR, "LUA: Failed to init LUA library\n");
-                    return ERR_PARAM;
-                }
-
-                luaL_openlibs(lua_state);
-
-                if(luaL_loadfile(lua_state, optarg) != 0 || lua_pcall(lua_state, 0, 0, 0) != 0)
+                lua_hooks_free(lua_hooks);
+                lua_hooks = lua_hooks_load(optarg, lua_log);
+                if(!lua_hooks)
                 {
                     print_msg(MSG_ERROR, "LUA: Failed to load script\n");
+                    return ERR_PARAM;
                 }
 
-                if(lua_call_va(lua_state, "init", "", 0) != 0)
-                {
-                    print_msg(MSG_ERROR, "LUA: Failed to call 'init' in script\n");
-                }
+                /* the scripts register all hooks while loading, only frame hooks prevent multithreading */
+                lua_frames = lua_hooks_frames(lua_hooks);
                 break;
 #else
                 print_msg(MSG_ERROR, "LUA support not compiled into this binary\n");
@@ -1552,7 +2542,12 @@ int main (int argc, char *argv[])
                 break;
 
             case 'e':
-                delta_encode_mode = 1;
+#if defined(MLV_USE_LJ92)
+                inter_encode_mode = 1;
+#else
+                print_msg(MSG_ERROR, "Error: Compression support was not compiled into this release\n");
+                return ERR_PARAM;
+#endif
                 break;
 
             case 'a':
@@ -1636,6 +2631,65 @@ int main (int argc, char *argv[])
 #endif
                 break;
 
+            case 'R':
+#if defined(MLV_USE_LZMA)
+                lzma_level = optarg ? COERCE(atoi(optarg), 0, 9) : LZMA_FRAME_LEVEL;
+                decompress_input = 1;
+#else
+                print_msg(MSG_ERROR, "Error: Compression support was not compiled into this release\n");
+                return ERR_PARAM;
+#endif
+                break;
+
+            case 'O':
+                proxy_output = 1;
+                if(optarg)
+                {
+                    if(!strcasecmp(optarg, "y4m"))
+                    {
+                        proxy_params.format = PROXY_Y4M;
+                    }
+                    else if(!strcasecmp(optarg, "yuv"))
+                    {
+                        proxy_params.format = PROXY_YUV;
+                    }
+                    else if(!strcasecmp(optarg, "rgb"))
+                    {
+                        proxy_params.format = PROXY_RGB;
+                    }
+                    else
+                    {
+                        print_msg(MSG_ERROR, "Error: Unknown proxy format '%s', use y4m, yuv or rgb\n", optarg);
+                        return ERR_PARAM;
+                    }
+                }
+                break;
+
+            case 'Q':
+                if(!strcasecmp(optarg, "half"))
+                {
+                    proxy_params.debayer = PROXY_HALF;
+                }
+                else if(!strcasecmp(optarg, "bilinear"))
+                {
+                    proxy_params.debayer = PROXY_BILINEAR;
+                }
+                else
+                {
+                    print_msg(MSG_ERROR, "Error: Unknown debayer '%s', use half or bilinear\n", optarg);
+                    return ERR_PARAM;
+                }
+                break;
+
+            case 'E':
+                proxy_params.gamma = atof(optarg);
+                if(proxy_params.gamma < 0.1 || proxy_params.gamma > 10)
+                {
+                    print_msg(MSG_ERROR, "Error: Gamma must be in the range 0.1 - 10\n");
+                    return ERR_PARAM;
+                }
+                break;
+
             case 'p':
                 pass_through = (!compress_output) ? 1 : 0;
                 break;
@@ -1676,12 +2730,104 @@ int main (int argc, char *argv[])
                 }
                 break;
 
-            case 'i':
-                fpi_method = MIN(1, MAX(0, atoi(optarg)));
+            case 'i':
+                fpi_method = MIN(1, MAX(0, atoi(optarg)));
+                break;
+
+            case 'j':
+                bpi_method = MIN(1, MAX(0, atoi(optarg)));
+                break;
+
+            case 'N':
+                if(!optarg)
+                {
+                    threads = pool_cpu_count();
+                }
+                else
+                {
+                    threads = MIN(256, MAX(1, atoi(optarg)));
+                }
+                break;
+
+            case 'H':
+                fix_pattern_noise = 1;
+                fpn_clip_samples = optarg ? MIN(256, MAX(1, atoi(optarg))) : 8;
+                break;
+
+            case 'J':
+                fpn_clip_refine = MAX(0, atoi(optarg));
+                break;
+
+            case 'K':
+                lj92_components = atoi(optarg);
+                if(lj92_components != 1 && lj92_components != 2 && lj92_components != 4)
+                {
+                    print_msg(MSG_ERROR, "Error: LJ92 component count must be 1, 2 or 4\n");
+                    return ERR_PARAM;
+                }
+                break;
+
+            case 'k':
+                inter_keyframes = MIN(INT32_MAX, MAX(1, atoi(optarg)));
+                break;
+
+            case 'G':
+                if(!strcasecmp(optarg, "mean"))
+                {
+                    stack_mode = STACK_MEAN;
+                }
+                else if(!strcasecmp(optarg, "median"))
+                {
+                    stack_mode = STACK_MEDIAN;
+                }
+                else if(!strcasecmp(optarg, "sigma"))
+                {
+                    stack_mode = STACK_SIGMA;
+                }
+                else
+                {
+                    print_msg(MSG_ERROR, "Error: Unknown stacking mode '%s', use mean, median or sigma\n", optarg);
+                    return ERR_PARAM;
+                }
+                average_mode = 1;
+                decompress_input = 1;
+                break;
+
+            case 'g':
+                stack_block = MAX(1, atoi(optarg));
+                break;
+
+            case 'q':
+                stack_kappa = MAX(0.5f, atof(optarg));
+                break;
+
+            case 'm':
+                stack_memory = MAX(16, atoi(optarg));
                 break;
 
-            case 'j':
-                bpi_method = MIN(1, MAX(0, atoi(optarg)));
+            case 'P':
+                if(optarg)
+                {
+                    pixel_cache_dir = strdup(optarg);
+                }
+                else
+                {
+                    /* per user cache directory */
+#if defined(__WIN32)
+                    const char *home = getenv("LOCALAPPDATA");
+                    const char *sub = "mlv_dump";
+#else
+                    const char *home = getenv("HOME");
+                    const char *sub = ".cache/mlv_dump";
+#endif
+                    if(!home)
+                    {
+                        print_msg(MSG_ERROR, "Error: no home directory for the pixel map cache, use --pixel-cache=dir\n");
+                        return ERR_PARAM;
+                    }
+                    pixel_cache_dir = malloc(strlen(home) + strlen(sub) + 2);
+                    sprintf(pixel_cache_dir, "%s/%s", home, sub);
+                }
                 break;
 
             case 'b':
@@ -1707,6 +2853,27 @@ int main (int argc, char *argv[])
         }
     }
 
+    /* LJ92 compressed DNGs. compress like -c, LJ92 input may get passed through later on, see MLVI handling */
+    if(dng_compressed)
+    {
+#if defined(MLV_USE_LJ92)
+        dng_output = 1;
+        if(!pass_through)
+        {
+            compress_output = 1;
+        }
+#else
+        print_msg(MSG_ERROR, "Error: Compression support was not compiled into this release\n");
+        return ERR_PARAM;
+#endif
+    }
+
+    /* keep stdout clean for the video */
+    if(proxy_output && output_filename && !strcmp(output_filename, "-"))
+    {
+        msg_stderr = 1;
+    }
+
     print_msg(MSG_INFO, "\n");
     print_msg(MSG_INFO, " MLV Dumper\n");
     print_msg(MSG_INFO, "-----------------\n");
@@ -1822,15 +2989,34 @@ int main (int argc, char *argv[])
         {
             print_msg(MSG_INFO, "   - Convert to DNG frames\n");
 
-            delta_encode_mode = 0;
+            inter_encode_mode = 0;
+            lzma_level = -1;
+            mlv_output = 0;
+            raw_output = 0;
+        }
+        else if(proxy_output)
+        {
+            print_msg(MSG_INFO, "   - Convert to %s proxy video, %s debayer, gamma %.2f\n", proxy_format_name(proxy_params.format),
+                      proxy_params.debayer == PROXY_HALF ? "half resolution" : "bilinear", proxy_params.gamma);
+
+            inter_encode_mode = 0;
+            lzma_level = -1;
+            compress_output = 0;
             mlv_output = 0;
             raw_output = 0;
+
+            if(average_mode)
+            {
+                print_msg(MSG_INFO, "   - disabled average mode, not possible\n");
+                average_mode = 0;
+            }
         }
         else if(raw_output)
         {
             print_msg(MSG_INFO, "   - Convert to legacy RAW\n");
 
-            delta_encode_mode = 0;
+            inter_encode_mode = 0;
+            lzma_level = -1;
             compress_output = 0;
             mlv_output = 0;
             dng_output = 0;
@@ -1855,14 +3041,24 @@ int main (int argc, char *argv[])
             {
                 print_msg(MSG_INFO, "   - Convert to %d bpp\n", bit_depth);
             }
-            if(delta_encode_mode)
+            if(inter_encode_mode)
             {
-                print_msg(MSG_INFO, "   - Only store changes to previous frame\n");
+                print_msg(MSG_INFO, "   - Only store changes to the last keyframe, a keyframe every %d frames\n", inter_keyframes);
+                compress_output = 1;
             }
             if(compress_output)
             {
                 print_msg(MSG_INFO, "   - Compress frame data\n");
             }
+            if(lzma_level >= 0)
+            {
+                if(compress_output)
+                {
+                    print_msg(MSG_ERROR, "Error: --lzma can not be combined with -c or -e\n");
+                    return ERR_PARAM;
+                }
+                print_msg(MSG_INFO, "   - Compress frame and audio data using LZMA preset %d\n", lzma_level);
+            }
             if(average_mode)
             {
                 print_msg(MSG_INFO, "   - Output only one frame with averaged pixel values\n");
@@ -1900,7 +3096,9 @@ int main (int argc, char *argv[])
     {
         /* those dont make sense then */
         raw_output = 0;
+        proxy_output = 0;
         compress_output = 0;
+        lzma_level = -1;
 
         print_msg(MSG_INFO, "   - Verify file structure\n");
         if(verbose)
@@ -1914,6 +3112,62 @@ int main (int argc, char *argv[])
         print_msg(MSG_INFO, "   - Output .idx file for faster processing\n");
     }
 
+    /* number of threads compressing MLV output, the pipeline gets started once the output file is open */
+    int mlv_threads = 0;
+
+    if(threads > 1)
+    {
+#ifdef MLV_USE_LJ92
+        /* only (de)compression runs in parallel, the frames still get processed in order by the main loop */
+        if(mlv_output && (compress_output || lzma_level >= 0 || decompress_input) && !dng_output && !lua_frames && !average_mode && autopsy_mode == AUTOPSY_OFF)
+        {
+            mlv_threads = threads;
+            print_msg(MSG_INFO, "   - %s MLV frames using %d threads\n", (compress_output || lzma_level >= 0) ? "Compress" : "Decompress", threads);
+        }
+        else
+#endif
+        if(proxy_output)
+        {
+            /* the rows of every frame get converted in parallel */
+            print_msg(MSG_INFO, "   - Convert proxy frames using %d threads\n", threads);
+        }
+        else
+        /* those modes depend on the previous frame or on the main loop's state, so keep them single threaded */
+        if(!dng_output || pass_through || subtract_mode || flatfield_mode || bit_depth || bit_zap || fix_vert_stripes == 2 || lua_frames)
+        {
+            print_msg(MSG_INFO, "   - Multithreading only supported for DNG output without -p, -s, -t, -b, -z, --force-stripes and LUA frame hooks, or for MLV output with -c, -e, -d or --lzma\n");
+        }
+        else
+        {
+            dng_pipeline = dng_pipeline_create(threads, show_progress, lj92_components);
+
+            if(!dng_pipeline)
+            {
+                print_msg(MSG_ERROR, "Error: Failed to start %d worker threads\n", threads);
+                return ERR_MALLOC;
+            }
+            print_msg(MSG_INFO, "   - Process DNG frames using %d threads\n", threads);
+        }
+    }
+
+    if(dng_output && fpn_clip_samples)
+    {
+        /* the estimation uses all threads, while the other frames wait for it */
+        fpn_profile = fpn_profile_create(fpn_clip_samples, fpn_clip_refine, threads);
+
+        if(!fpn_profile)
+        {
+            print_msg(MSG_ERROR, "Error: Failed to allocate pattern noise profile\n");
+            return ERR_MALLOC;
+        }
+        print_msg(MSG_INFO, "   - Pattern noise profile from %d frames", fpn_clip_samples);
+        if(fpn_clip_refine)
+        {
+            print_msg(MSG_INFO, ", refined every %d frames", fpn_clip_refine);
+        }
+        print_msg(MSG_INFO, "\n");
+    }
+
     /* start processing */
     lv_rec_file_footer_t lv_rec_footer;
     mlv_file_hdr_t main_header;
@@ -1941,16 +3195,17 @@ int main (int argc, char *argv[])
 
     char info_string[1024] = "";
 
-    /* this table contains the XREF chunk read from idx file, if existing */
-    mlv_xref_hdr_t *block_xref = NULL;
-    mlv_xref_t *xrefs = NULL;
+    /* this index was read from the .idx file, if existing */
+    mlv_index_t *block_xref = NULL;
     uint32_t block_xref_pos = 0;
 
     uint32_t frame_buffer_size = 1*1024*1024;
     uint32_t subtract_frame_buffer_size = 0;
     uint32_t flatfield_frame_buffer_size = 0;
 
-    uint32_t *frame_arith_buffer = NULL;
+    stacker_t *stacker = NULL;
+    uint16_t *stack_frame = NULL;
+    uint16_t *stack_noise = NULL;
     uint8_t *frame_sub_buffer = NULL;
     uint8_t *frame_flat_buffer = NULL;
     uint8_t *frame_buffer = NULL;
@@ -1960,6 +3215,7 @@ int main (int argc, char *argv[])
     FILE *out_file_wav = NULL;
     FILE **in_files = NULL;
     FILE *in_file = NULL;
+    mlv_reader_t *mlv_reader = NULL;
 
     int in_file_count = 0;
     int in_file_num = 0;
@@ -1968,9 +3224,7 @@ int main (int argc, char *argv[])
     uint32_t wav_header_size = 0;
 
     /* this is for our generated XREF table */
-    frame_xref_t *frame_xref_table = NULL;
-    int frame_xref_allocated = 0;
-    int frame_xref_entries = 0;
+    mlv_index_t *frame_xref_index = NULL;
 
     int total_vidf_count = 0;
     int total_audf_count = 0;
@@ -1988,22 +3242,65 @@ int main (int argc, char *argv[])
         in_file = in_files[in_file_num];
     }
 
+    /* blocks are accessed right in the mapped files, the FILE handles are still used for positioning */
+    if(!no_mmap)
+    {
+        mlv_reader = mlv_reader_open(in_files, in_file_count);
+
+        if(!mlv_reader)
+        {
+            print_msg(MSG_INFO, "Failed to memory map input files, reading them instead\n");
+        }
+    }
+
+    if(xref_mode)
+    {
+        frame_xref_index = mlv_index_create();
+
+        if(!frame_xref_index)
+        {
+            print_msg(MSG_ERROR, "Failed to alloc mem\n");
+            return ERR_MALLOC;
+        }
+    }
+
     if(!xref_mode && !skip_xref)
     {
-        block_xref = load_index(input_filename);
+        block_xref = mlv_index_load(input_filename);
+
+        if(block_xref)
+        {
+            /* only the blocks appended since the index was written get scanned. old .idx files get rebuilt */
+            int ret = mlv_index_update(block_xref, in_files, in_file_count, NULL);
+
+            if(ret == MLV_INDEX_UPDATED)
+            {
+                print_msg(MSG_INFO, "Index was outdated and got updated\n");
+
+                if(mlv_index_save(block_xref, input_filename))
+                {
+                    print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
+                }
+            }
+            else if(ret != MLV_INDEX_OK)
+            {
+                print_msg(MSG_ERROR, "Failed to update index (%d), will be ignored\n", ret);
+                mlv_index_free(block_xref);
+                block_xref = NULL;
+            }
+        }
 
         if(block_xref)
         {
-            if(block_xref->entryCount == 0)
+            if(mlv_index_count(block_xref) == 0)
             {
                 print_msg(MSG_INFO, "Empty XREF table, will be ignored\n");
-                free(block_xref);
-                block_xref= NULL;
+                mlv_index_free(block_xref);
+                block_xref = NULL;
             }
             else
             {
-                print_msg(MSG_INFO, "XREF table contains %d entries\n", block_xref->entryCount);
-                xrefs = (mlv_xref_t *)(block_xref + 1);
+                print_msg(MSG_INFO, "XREF table contains %d entries\n", mlv_index_count(block_xref));
 
                 if(dump_xrefs)
                 {
@@ -2011,14 +3308,6 @@ int main (int argc, char *argv[])
                 }
             }
         }
-        else
-        {
-            if(delta_encode_mode)
-            {
-                print_msg(MSG_ERROR, "Delta encoding is not possible without an index file. Please create one using -x option.\n");
-                return ERR_INDEX_REQ;
-            }
-        }
     }
 
     /* this block will load an image from a MLV file, so use its reported frame size for future use */
@@ -2047,7 +3336,7 @@ int main (int argc, char *argv[])
     }
 
     
-    if(output_filename || lua_state)
+    if(output_filename || lua_frames)
     {
         frame_buffer = malloc(frame_buffer_size);
         if(!frame_buffer)
@@ -2057,7 +3346,14 @@ int main (int argc, char *argv[])
         }
         memset(frame_buffer, 0x00, frame_buffer_size);
 
-        if(!dng_output && output_filename)
+        if(proxy_output && !strcmp(output_filename, "-"))
+        {
+#ifdef __WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            out_file = stdout;
+        }
+        else if(!dng_output && output_filename)
         {
             out_file = fopen(output_filename, "wb+");
             if(!out_file)
@@ -2065,12 +3361,28 @@ int main (int argc, char *argv[])
                 print_msg(MSG_ERROR, "Failed to open file '%s'\n", output_filename);
                 return ERR_FILE;
             }
+
+#ifdef MLV_USE_LJ92
+            if(mlv_threads)
+            {
+                mlv_pipeline = mlv_pipeline_create(mlv_threads, out_file, compress_output, lj92_components, inter_encode_mode ? inter_keyframes : 0, lzma_level, show_progress);
+
+                if(!mlv_pipeline)
+                {
+                    print_msg(MSG_ERROR, "Error: Failed to start %d worker threads\n", mlv_threads);
+                    return ERR_MALLOC;
+                }
+            }
+#endif
         }
     }
 
     print_msg(MSG_INFO, "Processing...\n");
+
+    /* block buffer, only used if the input isn't memory mapped or a block header needs to get patched */
     uint32_t mlv_block_size = 8192*1024;
-    mlv_hdr_t *mlv_block = malloc(mlv_block_size);
+    mlv_hdr_t *mlv_block_buf = malloc(mlv_block_size);
+    mlv_hdr_t *mlv_block = mlv_block_buf;
     
     do
     {
@@ -2079,13 +3391,36 @@ int main (int argc, char *argv[])
 
 read_headers:
 
-        print_msg(MSG_PROGRESS, "B:%d/%d V:%d/%d A:%d/%d\n", blocks_processed, block_xref?block_xref->entryCount:0, vidf_frames_processed, total_vidf_count, audf_frames_processed, total_audf_count);
+        print_msg(MSG_PROGRESS, "B:%d/%d V:%d/%d A:%d/%d\n", blocks_processed, block_xref?mlv_index_count(block_xref):0, vidf_frames_processed, total_vidf_count, audf_frames_processed, total_audf_count);
 
         if(block_xref)
         {
+            const mlv_index_entry_t *entry = mlv_index_entry(block_xref, block_xref_pos);
+
+            /*
+              frames outside of the extracted range do not have to be read at all.
+              modes that depend on previous frames still need every single one.
+            */
+            if(extract_frames && entry->frameType == MLV_FRAME_VIDF && (entry->frameNumber < frame_start || entry->frameNumber > frame_end) &&
+               !average_mode && !(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA) && !lua_frames && !visualize)
+            {
+                vidf_max_number = MAX(vidf_max_number, entry->frameNumber);
+                vidf_frames_processed++;
+                blocks_processed++;
+                block_xref_pos++;
+
+                if(block_xref_pos >= mlv_index_count(block_xref))
+                {
+                    print_msg(MSG_INFO, "\n");
+                    print_msg(MSG_INFO, "Reached end of all files after %i blocks\n", blocks_processed);
+                    break;
+                }
+                goto read_headers;
+            }
+
             /* get the file and position of the next block */
-            in_file_num = xrefs[block_xref_pos].fileNumber;
-            position = xrefs[block_xref_pos].frameOffset;
+            in_file_num = entry->fileNumber;
+            position = entry->offset;
 
             /* select file and seek to the right position */
             if(in_file_num >= in_file_count)
@@ -2099,7 +3434,22 @@ read_headers:
 
         position = file_get_pos(in_file);
 
-        if(fread(mlv_block, sizeof(mlv_hdr_t), 1, in_file) != 1)
+        /* when memory mapped, just point to the block in the file, else read its header */
+        if(mlv_reader)
+        {
+            /* the mapping is read-only, blocks are never written to. see below for the only exception */
+            mlv_block = (mlv_hdr_t *)mlv_reader_get(mlv_reader, in_file_num, position, sizeof(mlv_hdr_t));
+        }
+        else
+        {
+            mlv_block = mlv_block_buf;
+            if(fread(mlv_block, sizeof(mlv_hdr_t), 1, in_file) != 1)
+            {
+                mlv_block = NULL;
+            }
+        }
+
+        if(!mlv_block)
         {
             print_msg(MSG_INFO, "\n");
             
@@ -2131,6 +3481,13 @@ read_headers:
             if(fix_bug == BUG_ID_NULL_SIZE_ZERO && !memcmp(mlv_block->blockType, "NULL", 4))
             {
                 int padded_size = (position + sizeof(mlv_hdr_t) + 511) & ~511;
+
+                /* patch a copy, this block will then be read into the buffer */
+                if(mlv_block != mlv_block_buf)
+                {
+                    memcpy(mlv_block_buf, mlv_block, sizeof(mlv_hdr_t));
+                    mlv_block = mlv_block_buf;
+                }
                 mlv_block->blockSize = padded_size - position;
             }
             else
@@ -2140,30 +3497,68 @@ read_headers:
             }
         }
         
-        /* will the buffer fit its size? */
-        if(mlv_block->blockSize > mlv_block_size)
+        if(mlv_block != mlv_block_buf)
         {
-            mlv_block_size = mlv_block->blockSize;
-            mlv_block = realloc(mlv_block, mlv_block_size);
-            
-            if(!mlv_block)
+            /* memory mapped, just make sure the whole block is within the file */
+            if(!mlv_reader_get_block(mlv_reader, in_file_num, position))
             {
-                print_msg(MSG_ERROR, "Invalid block size of 0x%08X at position 0x%08" PRIx64 "\n", mlv_block_size, position);
+                print_msg(MSG_ERROR, "Invalid block size of 0x%08X at position 0x%08" PRIx64 ", file ended prematurely\n", mlv_block->blockSize, position);
                 goto abort;
             }
+
+            /* keep the file position where it would be after reading the block */
+            file_set_pos(in_file, position + mlv_block->blockSize, SEEK_SET);
         }
+        else
+        {
+            /* will the buffer fit its size? */
+            if(mlv_block->blockSize > mlv_block_size)
+            {
+                mlv_block_size = mlv_block->blockSize;
+                mlv_block_buf = realloc(mlv_block_buf, mlv_block_size);
+                mlv_block = mlv_block_buf;
+                
+                if(!mlv_block)
+                {
+                    print_msg(MSG_ERROR, "Invalid block size of 0x%08X at position 0x%08" PRIx64 "\n", mlv_block_size, position);
+                    goto abort;
+                }
+            }
 
-        /* jump back to the beginning of the block just read and read it all */
-        file_set_pos(in_file, position, SEEK_SET);
+            /* jump back to the beginning of the block just read and read it all */
+            file_set_pos(in_file, position, SEEK_SET);
+            
+            if(fread(mlv_block, mlv_block->blockSize, 1, in_file) != 1)
+            {
+                print_msg(MSG_ERROR, "Invalid block size of 0x%08X at position 0x%08" PRIx64 ", file ended prematurely\n", mlv_block->blockSize, position);
+                goto abort;
+            }
+        }
         
-        if(fread(mlv_block, mlv_block->blockSize, 1, in_file) != 1)
+        if(lua_hooks_active(lua_hooks, mlv_block->blockType, LUA_HOOK_BLOCK))
         {
-            print_msg(MSG_ERROR, "Invalid block size of 0x%08X at position 0x%08" PRIx64 ", file ended prematurely\n", mlv_block->blockSize, position);
-            goto abort;
+            /* the script may change the block, so it must not be the read only mapping */
+            if(mlv_block != mlv_block_buf)
+            {
+                if(mlv_block->blockSize > mlv_block_size)
+                {
+                    mlv_block_size = mlv_block->blockSize;
+                    free(mlv_block_buf);
+                    mlv_block_buf = malloc(mlv_block_size);
+
+                    if(!mlv_block_buf)
+                    {
+                        print_msg(MSG_ERROR, "Failed to allocate 0x%08X bytes for block\n", mlv_block_size);
+                        goto abort;
+                    }
+                }
+                memcpy(mlv_block_buf, mlv_block, mlv_block->blockSize);
+                mlv_block = mlv_block_buf;
+            }
+
+            lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_BLOCK, mlv_block, mlv_block->blockSize, NULL, 0);
         }
         
-        lua_handle_hdr(lua_state, mlv_block->blockType, &mlv_block, mlv_block->blockSize);
-        
         /* show all block types in a more convenient style, but needs little housekeeping code */
         if(visualize)
         {
@@ -2599,15 +3994,7 @@ read_headers:
             /* in xref mode, use every block and get its timestamp etc */
             if(xref_mode)
             {
-                xref_resize(&frame_xref_table, frame_xref_entries + 1, &frame_xref_allocated);
-
-                /* add xref data */
-                frame_xref_table[frame_xref_entries].frameTime = 0;
-                frame_xref_table[frame_xref_entries].frameOffset = position;
-                frame_xref_table[frame_xref_entries].fileNumber = in_file_num;
-                frame_xref_table[frame_xref_entries].frameType = MLV_FRAME_UNSPECIFIED;
-
-                frame_xref_entries++;
+                mlv_index_add(frame_xref_index, mlv_block, in_file_num, position);
             }
 
             /* is this the first file? */
@@ -2616,6 +4003,43 @@ read_headers:
                 /* correct header size if needed */
                 file_hdr.blockSize = sizeof(mlv_file_hdr_t);
 
+                /*
+                  with --dng-compressed, LJ92 frames that need no processing at all get their bitstream written into
+                  the DNG as it is, like -p does. that saves the decode and re-encode round trip.
+                */
+                if(dng_compressed && compress_output && (file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92) && !(file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA) &&
+                   !fix_vert_stripes && !fix_focus_pixels && !fix_cold_pixels && !chroma_smooth_method && !fix_pattern_noise && !deflicker_target &&
+                   !subtract_mode && !flatfield_mode && !average_mode && !bit_zap && !inter_encode_mode && !lua_frames)
+                {
+                    print_msg(MSG_INFO, "   - Passing through original LJ92 payload, no processing requested\n");
+                    compress_output = 0;
+                    pass_through = 1;
+
+                    /* nothing left for the worker threads to do, and nothing was submitted yet */
+                    if(dng_pipeline)
+                    {
+                        dng_pipeline_finish(dng_pipeline);
+                        dng_pipeline = NULL;
+                    }
+                }
+
+                /* inter-frame compressed frames are useless without their keyframe, so they never get passed through */
+                if(file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_INTER)
+                {
+                    if(dng_output && pass_through)
+                    {
+                        print_msg(MSG_INFO, "   - Inter-frame compressed input can not be passed through, decompressing it\n");
+                        pass_through = 0;
+                        decompress_input = 1;
+                        fix_vert_stripes = 0;
+                        fix_cold_pixels = 0;
+                    }
+                    if(mlv_output && !compress_output)
+                    {
+                        decompress_input = 1;
+                    }
+                }
+
                 memcpy(&main_header, &file_hdr, sizeof(mlv_file_hdr_t));
 
                 total_vidf_count = main_header.videoFrameCount;
@@ -2639,17 +4063,33 @@ read_headers:
                     {
                         file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LJ92;
                         file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LZMA;
+                        file_hdr.audioClass &= ~MLV_AUDIO_CLASS_FLAG_LZMA;
                     }
 
-                    if(delta_encode_mode)
+                    /* --lzma decodes the input first (decompress_input), then compresses video and audio again */
+                    if(lzma_level >= 0)
                     {
-                        file_hdr.videoClass |= MLV_VIDEO_CLASS_FLAG_DELTA;
+                        file_hdr.videoClass |= MLV_VIDEO_CLASS_FLAG_LZMA;
+                        if(file_hdr.audioClass)
+                        {
+                            file_hdr.audioClass |= MLV_AUDIO_CLASS_FLAG_LZMA;
+                        }
                     }
-                    else
+
+                    /* -e replaces LJ92, any other way of writing the frames drops inter-frame compression */
+                    if(inter_encode_mode)
+                    {
+                        file_hdr.videoClass |= MLV_VIDEO_CLASS_FLAG_INTER;
+                        file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LJ92;
+                    }
+                    else if(compress_output || decompress_input)
                     {
-                        file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_DELTA;
+                        file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_INTER;
                     }
 
+                    /* delta encoded input gets decoded while processing */
+                    file_hdr.videoClass &= ~MLV_VIDEO_CLASS_FLAG_DELTA;
+
                     if(!extract_block || !strncasecmp(extract_block, (char*)file_hdr.fileMagic, 4))
                     {
                         if(fwrite(&file_hdr, file_hdr.blockSize, 1, out_file) != 1)
@@ -2720,21 +4160,10 @@ read_headers:
         }
         else
         {
-            /* in xref mode, use every block and get its timestamp etc */
-            if(xref_mode && memcmp(mlv_block->blockType, "NULL", 4) && memcmp(mlv_block->blockType, "BKUP", 4))
+            /* in xref mode, use every block and get its timestamp etc. NULL and BKUP blocks are skipped there */
+            if(xref_mode)
             {
-                xref_resize(&frame_xref_table, frame_xref_entries + 1, &frame_xref_allocated);
-
-                /* add xref data */
-                frame_xref_table[frame_xref_entries].frameTime = mlv_block->timestamp;
-                frame_xref_table[frame_xref_entries].frameOffset = position;
-                frame_xref_table[frame_xref_entries].fileNumber = in_file_num;
-                frame_xref_table[frame_xref_entries].frameType =
-                    !memcmp(mlv_block->blockType, "VIDF", 4) ? MLV_FRAME_VIDF :
-                    !memcmp(mlv_block->blockType, "AUDF", 4) ? MLV_FRAME_AUDF :
-                    MLV_FRAME_UNSPECIFIED;
-
-                frame_xref_entries++;
+                mlv_index_add(frame_xref_index, mlv_block, in_file_num, position);
             }
 
             if(main_header.blockSize == 0)
@@ -2760,8 +4189,6 @@ read_headers:
             if(!memcmp(mlv_block->blockType, "AUDF", 4) && !no_audio)
             {
                 mlv_audf_hdr_t block_hdr = *(mlv_audf_hdr_t *)mlv_block;
-
-                lua_handle_hdr(lua_state, mlv_block->blockType, &block_hdr, sizeof(block_hdr));
                 if(verbose)
                 {
                     print_msg(MSG_INFO, "   Frame: #%04d\n", block_hdr.frameNumber);
@@ -2776,7 +4203,33 @@ read_headers:
 
                 int frame_size = block_hdr.blockSize - sizeof(mlv_audf_hdr_t) - block_hdr.frameSpace;
                 void *payload = BYTE_OFFSET(mlv_block, sizeof(mlv_audf_hdr_t) + block_hdr.frameSpace);
-                
+                uint8_t *audio_buffer = NULL;
+
+                /* LZMA compressed audio gets decoded for the WAV file and for MLV output that decompresses (-d, --lzma) */
+                if((main_header.audioClass & MLV_AUDIO_CLASS_FLAG_LZMA) && (out_file_wav || (mlv_output && decompress_input)))
+                {
+#ifdef MLV_USE_LZMA
+                    size_t audio_size = lzma_frame_size(payload, frame_size);
+
+                    audio_buffer = audio_size ? malloc(audio_size) : NULL;
+                    if(!audio_buffer || lzma_frame_decompress(payload, frame_size, audio_buffer, audio_size))
+                    {
+                        print_msg(MSG_ERROR, "AUDF: Failed to decompress LZMA audio frame #%d\n", block_hdr.frameNumber);
+                        free(audio_buffer);
+                        goto abort;
+                    }
+                    if(verbose)
+                    {
+                        print_msg(MSG_INFO, "    LZMA: %d -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_size, audio_size, ((float)frame_size * 100.0f) / (float)audio_size);
+                    }
+                    payload = audio_buffer;
+                    frame_size = audio_size;
+#else
+                    print_msg(MSG_ERROR, "AUDF: LZMA not compiled into this release, aborting.\n");
+                    goto abort;
+#endif
+                }
+
                 /* only write WAV if the WAVI header created a file */
                 if(out_file_wav)
                 {
@@ -2791,12 +4244,65 @@ read_headers:
                     if(fwrite(payload, frame_size, 1, out_file_wav) != 1)
                     {
                         print_msg(MSG_ERROR, "AUDF: Failed writing into .WAV file\n");
+                        free(audio_buffer);
                         return PROCESS_ERROR;
                     }
                 
                     wav_data_size += frame_size;
                 }
-                
+
+                /* decoded or (re)compressed audio replaces the original payload */
+                if(mlv_output && (audio_buffer || lzma_level >= 0) && (!extract_block || !strncasecmp(extract_block, "AUDF", 4)))
+                {
+                    handled_write = 1;
+#ifdef MLV_USE_LJ92
+                    if(mlv_pipeline && lzma_level >= 0)
+                    {
+                        if(!mlv_pipeline_submit_audio(mlv_pipeline, &block_hdr, payload, frame_size))
+                        {
+                            print_msg(MSG_ERROR, "AUDF: Failed to queue frame for compression\n");
+                            free(audio_buffer);
+                            goto abort;
+                        }
+                    }
+                    else
+#endif
+                    {
+                        void *data = payload;
+                        uint8_t *lzma_buffer = NULL;
+
+#ifdef MLV_USE_LZMA
+                        if(lzma_level >= 0)
+                        {
+                            lzma_buffer = malloc(lzma_frame_bound(frame_size));
+                            frame_size = lzma_buffer ? lzma_frame_compress(payload, frame_size, lzma_level, lzma_buffer) : 0;
+                            data = lzma_buffer;
+
+                            if(!frame_size)
+                            {
+                                print_msg(MSG_ERROR, "    LZMA: Failed to compress AUDF #%d\n", block_hdr.frameNumber);
+                                free(lzma_buffer);
+                                free(audio_buffer);
+                                goto abort;
+                            }
+                        }
+#endif
+                        block_hdr.blockSize = sizeof(mlv_audf_hdr_t) + frame_size;
+                        block_hdr.frameSpace = 0;
+
+                        if(!mlv_pipeline_write(mlv_pipeline, out_file, &block_hdr, sizeof(mlv_audf_hdr_t)) ||
+                           !mlv_pipeline_write(mlv_pipeline, out_file, data, frame_size))
+                        {
+                            print_msg(MSG_ERROR, "AUDF: Failed writing into .MLV file\n");
+                            free(lzma_buffer);
+                            free(audio_buffer);
+                            goto abort;
+                        }
+                        free(lzma_buffer);
+                    }
+                }
+                free(audio_buffer);
+
                 audf_frames_processed++;
             }
             else if(!memcmp(mlv_block->blockType, "VIDF", 4))
@@ -2838,12 +4344,13 @@ read_headers:
                     d) if LUA is enabled
                     e) but not if this block should be skipped (due to inconsistent header data)
                 */
-                if((raw_output || mlv_output || dng_output || lua_state) && !skip_block)
+                if((raw_output || mlv_output || dng_output || proxy_output || lua_frames) && !skip_block)
                 {
                     /* if already compressed, we have to decompress it first */
                     int compressed_lzma = main_header.videoClass & MLV_VIDEO_CLASS_FLAG_LZMA;
                     int compressed_lj92 = main_header.videoClass & MLV_VIDEO_CLASS_FLAG_LJ92;
-                    int compressed = compressed_lzma || compressed_lj92;
+                    int compressed_inter = main_header.videoClass & MLV_VIDEO_CLASS_FLAG_INTER;
+                    int compressed = compressed_lzma || compressed_lj92 || compressed_inter;
                     int recompress = compressed && compress_output;
                     int decompress = compressed && decompress_input;
                     
@@ -2853,7 +4360,7 @@ read_headers:
                         b) we shall de-compress the output (option -d)
                         c) we have compressed input and should write DNG or RAW
                     */
-                    int run_decompressor = recompress || decompress || ((raw_output || dng_output) && compressed);
+                    int run_decompressor = recompress || decompress || ((raw_output || dng_output || proxy_output) && compressed);
                     
                     /*
                       write this block when following conditions are true
@@ -2884,7 +4391,7 @@ read_headers:
                         assert(!flatfield_mode);
                         assert(!average_mode);
                         assert(!bit_zap);
-                        assert(!delta_encode_mode);
+                        assert(!inter_encode_mode);
                         assert(!raw_output);
                     }
                     
@@ -2902,13 +4409,65 @@ read_headers:
                     /* when the block is compressed, read the whole content, not just "frame_size" */
                     if(compressed)
                     {
-                        /* just read everything right behind the frameSpace */
-                        read_size = block_hdr.blockSize - sizeof(mlv_vidf_hdr_t) - block_hdr.frameSpace;
+                        /* just read everything right behind the frameSpace */
+                        read_size = block_hdr.blockSize - sizeof(mlv_vidf_hdr_t) - block_hdr.frameSpace;
+                    }
+                    
+                    /*
+                      hand the frame over to the DNG worker threads, which also decompress it.
+                      the first frame always takes the single threaded path, as it initializes pixel maps, stripe correction, LUTs etc.
+                    */
+                    int fpn_sample = fpn_profile && dng_output && fpn_profile_is_sample(fpn_profile, fpn_frames);
+                    int pipelined = dng_pipeline && dng_pipeline->frames_saved && !(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA) && !fpn_sample;
+
+                    /* frames sampled for the pattern noise profile update it, so all frames before them have to be done */
+                    while(fpn_sample && dng_pipeline && dng_pipeline->retired != dng_pipeline->submitted)
+                    {
+                        frame_result_e ret = dng_pipeline_retire(dng_pipeline);
+
+                        if(ret == FRAME_ERROR || (ret == FRAME_SKIP && !relaxed))
+                        {
+                            goto abort;
+                        }
+                    }
+
+                    /*
+                      MLV output: LJ92 or LZMA input that only gets rewritten is decoded by the compression threads (-d, --lzma).
+                      anything looking at the pixels in the main loop needs it decoded here.
+                    */
+                    int deferred_decode = mlv_pipeline && run_decompressor && write_block && (compressed_lj92 || compressed_lzma) && !compressed_inter &&
+                                          !relaxed && !raw_output && !dng_output && !lua_frames && !subtract_mode && !flatfield_mode && !average_mode &&
+                                          !bit_depth && !bit_zap && !inter_encode_mode && !(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA);
+
+                    /*
+                      use the payload in place instead of copying it into frame_buffer when
+                        a) nothing modifies the frame data before it gets written into DNG or RAW files
+                        b) the DNG worker threads get it from the memory mapped file, which stays valid until they are done
+                      16 bpp frames are excluded, dng_init_data() would process them in place.
+                    */
+                    int in_place = 0;
+                    if(pass_through)
+                    {
+                        /* the original payload only gets read by dng_save() */
+                        in_place = dng_output && !lua_frames;
                     }
-                    
+                    else if(lv_rec_footer.raw_info.bits_per_pixel < 16)
+                    {
+                        if(pipelined)
+                        {
+                            in_place = (mlv_reader != NULL);
+                        }
+                        else
+                        {
+                            in_place = (raw_output || dng_output || proxy_output) && !run_decompressor && !run_compressor && !lua_frames &&
+                                       !subtract_mode && !flatfield_mode && !average_mode && !bit_depth && !bit_zap &&
+                                       !(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA);
+                        }
+                    }
+
                     /* check if there is enough memory for that frame, compressed or uncompressed or with unexpected VIDF size */
                     uint32_t new_buffer_size = MAX((uint32_t)frame_size, (uint32_t)read_size);
-                    if(frame_buffer_size < new_buffer_size)
+                    if(!in_place && frame_buffer_size < new_buffer_size)
                     {
                         /* no, set new size */
                         frame_buffer_size = new_buffer_size;
@@ -2923,133 +4482,49 @@ read_headers:
                         }
                     }
                     
-                    /* copy data from read block */
-                    void *payload = BYTE_OFFSET(mlv_block, sizeof(mlv_vidf_hdr_t) + block_hdr.frameSpace);
-                    memcpy(frame_buffer, payload, read_size);
+                    /* the frame data that gets written. points either to the payload or to frame_buffer */
+                    uint8_t *payload = BYTE_OFFSET(mlv_block, sizeof(mlv_vidf_hdr_t) + block_hdr.frameSpace);
+                    uint8_t *frame_data = in_place ? payload : frame_buffer;
 
-                    lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_read", &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
-
-                    if(run_decompressor)
+                    /* copy data from read block, the decompressor reads from there directly */
+                    if(!in_place && (!run_decompressor || pipelined || deferred_decode))
                     {
-                        if(compressed_lj92)
-                        {
-#ifdef MLV_USE_LJ92
-                            lj92 handle;
-                            int lj92_width = 0;
-                            int lj92_height = 0;
-                            int lj92_bitdepth = 0;
-                            int lj92_components = 0;
-
-                            int ret = lj92_open(&handle, (uint8_t *)frame_buffer, read_size, &lj92_width, &lj92_height, &lj92_bitdepth, &lj92_components);
+                        memcpy(frame_buffer, payload, read_size);
+                    }
 
-                            /* this is the raw data size with 16 bit words. it's just temporary */
-                            size_t out_size = lj92_width * lj92_height * sizeof(uint16_t) * lj92_components;
-                            
-                            if(ret == LJ92_ERROR_NONE)
-                            {
-                                if(verbose)
-                                {
-                                    print_msg(MSG_INFO, "    LJ92: Decompressing\n");
-                                    print_msg(MSG_INFO, "    LJ92: %dx%dx%d %d bpp (%d bytes buffer)\n", lj92_width, lj92_height, lj92_components, lj92_bitdepth, out_size);
-                                }
-                            }
-                            else
-                            {
-                                print_msg(MSG_ERROR, "    LJ92: Open failed (%d)\n", ret);
-                                if(relaxed)
-                                {
-                                    goto skip_block;
-                                }
-                                goto abort;
-                            }
-                            
-                            /* do a proper size check before we continue */
-                            int lj92_frame_size = ((lj92_width * lj92_height * lj92_components * lv_rec_footer.raw_info.bits_per_pixel + 7) / 8);
-                            
-                            if(lj92_frame_size != frame_size)
-                            {
-                                print_msg(MSG_ERROR, "    LJ92: decompressed image size (%d) does not match size retrieved from RAWI (%d)\n", lj92_frame_size, frame_size);
-                                goto abort;
-                            }
-                            
-                            /* we need a temporary buffer so we don't overwrite source data */
-                            uint16_t *decompressed = malloc(out_size);
-                            
-                            ret = lj92_decode(handle, decompressed, lj92_width * lj92_height * lj92_components, 0, NULL, 0);
+                    lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_READ, &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
 
-                            if(ret != LJ92_ERROR_NONE)
-                            {
-                                print_msg(MSG_ERROR, "    LJ92: Decompress failed (%d)\n", ret);
-                                if(relaxed)
-                                {
-                                    goto skip_block;
-                                }
-                                goto abort;
-                            }
-                            
-                            if(verbose)
-                            {
-                                print_msg(MSG_INFO, "    LJ92: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_buffer_size, frame_size, ((float)frame_buffer_size * 100.0f) / (float)frame_size);
-                            }
-                            
-                            /* repack the 16 bit words containing values with max 14 bit */
-                            int orig_pitch = video_xRes * lv_rec_footer.raw_info.bits_per_pixel / 8;
+                    /* inter-frame compressed frames need their keyframe, which then stays around for the following frames */
+                    const inter_ref_t *inter_ref = NULL;
 
-                            for(int y = 0; y < video_yRes; y++)
-                            {
-                                uint16_t *src_line = &decompressed[y * video_xRes];
-                                void *dst_line = &frame_buffer[y * orig_pitch];
+                    if(run_decompressor && compressed_inter)
+                    {
+#ifdef MLV_USE_LJ92
+                        frame_result_e ret = inter_prepare_ref(&inter_dec, dng_pipeline, relaxed, payload, read_size, block_hdr.frameNumber, video_xRes, video_yRes, block_xref, in_files, in_file_count, mlv_reader, &inter_ref);
 
-                                for(int x = 0; x < video_xRes; x++)
-                                {
-                                    bitinsert(dst_line, x, lv_rec_footer.raw_info.bits_per_pixel, src_line[x]);
-                                }
-                            }
-                            
-                            free(decompressed);
-#else
-                            print_msg(MSG_INFO, "    LJ92: not compiled into this release, aborting.\n");
+                        if(ret == FRAME_SKIP && relaxed)
+                        {
+                            goto skip_block;
+                        }
+                        if(ret != FRAME_OK)
+                        {
                             goto abort;
+                        }
 #endif
+                    }
+
+                    if(run_decompressor && !pipelined && !deferred_decode)
+                    {
+                        frame_result_e ret = decompress_frame(payload, read_size, frame_buffer, frame_size, compressed_lj92, compressed_lzma,
+                                                              compressed_inter, inter_ref, block_hdr.frameNumber, video_xRes, video_yRes, lv_rec_footer.raw_info.bits_per_pixel, verbose);
+
+                        if(ret == FRAME_SKIP && relaxed)
+                        {
+                            goto skip_block;
                         }
-                        else if(compressed_lzma)
+                        if(ret != FRAME_OK)
                         {
-#ifdef MLV_USE_LZMA
-                            size_t lzma_out_size = *(uint32_t *)frame_buffer;
-                            size_t lzma_in_size = frame_buffer_size - LZMA_PROPS_SIZE - 4;
-                            size_t lzma_props_size = LZMA_PROPS_SIZE;
-                            unsigned char *lzma_out = malloc(lzma_out_size);
-
-                            int ret = LzmaUncompress(
-                                lzma_out, &lzma_out_size,
-                                (unsigned char *)&frame_buffer[4 + LZMA_PROPS_SIZE], &lzma_in_size,
-                                (unsigned char *)&frame_buffer[4], lzma_props_size
-                                );
-                                
-                            if(lzma_out_size != frame_size)
-                            {
-                                print_msg(MSG_ERROR, "    LZMA: decompressed image size (%d) does not match size retrieved from RAWI (%d)\n", lzma_out_size, frame_size);
-                                goto abort;
-                            }
-                            
-                            if(ret == SZ_OK)
-                            {
-                                memcpy(frame_buffer, lzma_out, lzma_out_size);
-                                
-                                if(verbose)
-                                {
-                                    print_msg(MSG_INFO, "    LZMA: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%%)\n", lzma_in_size, lzma_out_size, ((float)lzma_out_size * 100.0f) / (float)lzma_in_size);
-                                }
-                            }
-                            else
-                            {
-                                print_msg(MSG_INFO, "    LZMA: Failed (%d)\n", ret);
-                                goto abort;
-                            }
-#else
-                            print_msg(MSG_INFO, "    LZMA: not compiled into this release, aborting.\n");
                             goto abort;
-#endif
                         }
                     }
 
@@ -3201,31 +4676,40 @@ read_headers:
                             }
                         }
                     }
-                    static int countzz = 1;
-                    /* in average mode, sum up all pixel values of a pixel position */
+                    /* in average mode, add the frame to the stack */
                     if(average_mode)
                     {
                         int pitch = video_xRes * current_depth / 8;
 
-                        for(int y = 0; y < video_yRes; y++)
+                        if(!stacker)
                         {
-                            uint16_t *src_line = (uint16_t *)&frame_buffer[y * pitch];
+                            stacker_params_t params = { stack_mode, stack_block, stack_kappa, 5, (uint64_t)stack_memory * 1024 * 1024, threads, 0 };
 
-                            for(int x = 0; x < video_xRes; x++)
+                            stacker = stacker_create(&params, video_xRes, video_yRes);
+                            stack_frame = malloc(video_xRes * video_yRes * sizeof(uint16_t));
+                            stack_noise = malloc(video_xRes * video_yRes * sizeof(uint16_t));
+                            if(!stacker || !stack_frame || !stack_noise)
                             {
-                                uint16_t value = bitextract(src_line, x, current_depth);
+                                print_msg(MSG_ERROR, "Failed to allocate frame stacking buffers\n");
+                                goto abort;
+                            }
+                        }
 
-                                frame_arith_buffer[y * video_xRes + x] += value;
+                        for(int y = 0; y < video_yRes; y++)
+                        {
+                            bitpack_unpack((uint16_t *)&frame_buffer[y * pitch], &stack_frame[y * video_xRes], video_xRes, current_depth);
+                        }
 
-                                if(countzz)
-                                {
-                                    printf("#%u avg[0] = %u, unpacked[0] = %u\n", average_samples, frame_arith_buffer[0], value);
-                                    countzz = 0;
-                                }
-                            }
+                        int spooled = stacker_spooled(stacker);
+                        if(stacker_add(stacker, stack_frame))
+                        {
+                            print_msg(MSG_ERROR, "Failed to stack frame %d, out of memory or disk space\n", block_hdr.frameNumber);
+                            goto abort;
+                        }
+                        if(!spooled && stacker_spooled(stacker))
+                        {
+                            print_msg(MSG_INFO, "Frames exceed --stack-mem=%d, spooling them to a temporary file\n", stack_memory);
                         }
-                        countzz = 1;
-                        average_samples++;
                     }
 
                     /* now resample bit depth if requested */
@@ -3254,21 +4738,8 @@ read_headers:
                             uint16_t *src_line = (uint16_t *)&frame_buffer[y * old_pitch];
                             uint16_t *dst_line = (uint16_t *)&new_buffer[y * new_pitch];
 
-                            for(int x = 0; x < video_xRes; x++)
-                            {
-                                uint16_t value = bitextract(src_line, x, old_depth);
-
-                                /* normalize the old value to 16 bits, minimizing the roundoff error */
-                                /* assume the bit depth reduction simply discarded the lower bits */
-                                /* => we have a bias of 0.5 LSB that can be corrected here. */
-                                value <<= (16-old_depth);
-                                value += (1 << (15-old_depth));
-
-                                /* convert the old value to destination depth */
-                                value >>= (16-new_depth);
-
-                                bitinsert(dst_line, x, new_depth, value);
-                            }
+                            /* rescale with a 0.5 LSB bias correction, see bitpack_convert */
+                            bitpack_convert(src_line, old_depth, dst_line, new_depth, video_xRes);
                         }
 
                         /* update uncompressed frame and buffer size */
@@ -3309,90 +4780,42 @@ read_headers:
                         }
                     }
 
-                    if(delta_encode_mode)
+                    /* delta decode, if input data is encoded. writing delta encoded frames was replaced by inter-frame compression (-e) */
+                    if(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA)
                     {
-                        /* only delta encode, if not already encoded */
-                        if(!(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA))
-                        {
-                            uint8_t *current_frame_buffer = malloc(frame_size);
-                            int pitch = video_xRes * current_depth / 8;
-
-                            /* backup current frame for later */
-                            memcpy(current_frame_buffer, frame_buffer, frame_size);
-
-                            for(int y = 0; y < video_yRes; y++)
-                            {
-                                uint16_t *src_line = (uint16_t *)&frame_buffer[y * pitch];
-                                uint16_t *ref_line = (uint16_t *)&prev_frame_buffer[y * pitch];
-                                int32_t offset = 1 << (current_depth - 1);
-                                int32_t max_val = (1 << current_depth) - 1;
-
-                                for(int x = 0; x < video_xRes; x++)
-                                {
-                                    int32_t value = bitextract(src_line, x, current_depth);
-                                    int32_t ref_value = bitextract(ref_line, x, current_depth);
-
-                                    /* when e.g. using 16 bit values:
-                                           delta =  1      -> encode to 0x8001
-                                           delta =  0      -> encode to 0x8000
-                                           delta = -1      -> encode to 0x7FFF
-                                           delta = -0xFFFF -> encode to 0x0001
-                                           delta =  0xFFFF -> encode to 0x7FFF
-                                       so this is basically a signed int with overflow and a max/2 offset.
-                                       this offset makes the frames uniform grey when viewing non-decoded frames and improves compression rate a bit.
-                                    */
-                                    int32_t delta = offset + value - ref_value;
-
-                                    uint16_t new_value = (uint16_t)(delta & max_val);
-
-                                    bitinsert(src_line, x, current_depth, new_value);
-                                }
-                            }
+                        int pitch = video_xRes * current_depth / 8;
 
-                            /* save current original frame to prev buffer */
-                            memcpy(prev_frame_buffer, current_frame_buffer, frame_size);
-                            free(current_frame_buffer);
-                        }
-                    }
-                    else
-                    {
-                        /* delta decode, if input data is encoded */
-                        if(main_header.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA)
+                        for(int y = 0; y < video_yRes; y++)
                         {
-                            int pitch = video_xRes * current_depth / 8;
+                            uint16_t *src_line = (uint16_t *)&frame_buffer[y * pitch];
+                            uint16_t *ref_line = (uint16_t *)&prev_frame_buffer[y * pitch];
+                            int32_t offset = 1 << (current_depth - 1);
+                            int32_t max_val = (1 << current_depth) - 1;
 
-                            for(int y = 0; y < video_yRes; y++)
+                            for(int x = 0; x < video_xRes; x++)
                             {
-                                uint16_t *src_line = (uint16_t *)&frame_buffer[y * pitch];
-                                uint16_t *ref_line = (uint16_t *)&prev_frame_buffer[y * pitch];
-                                int32_t offset = 1 << (current_depth - 1);
-                                int32_t max_val = (1 << current_depth) - 1;
-
-                                for(int x = 0; x < video_xRes; x++)
-                                {
-                                    int32_t value = bitextract(src_line, x, current_depth);
-                                    int32_t ref_value = bitextract(ref_line, x, current_depth);
-
-                                    /* when e.g. using 16 bit values:
-                                           delta =  1      -> encode to 0x8001
-                                           delta =  0      -> encode to 0x8000
-                                           delta = -1      -> encode to 0x7FFF
-                                           delta = -0xFFFF -> encode to 0x0001
-                                           delta =  0xFFFF -> encode to 0x7FFF
-                                       so this is basically a signed int with overflow and a max/2 offset.
-                                       this offset makes the frames uniform grey when viewing non-decoded frames and improves compression rate a bit.
-                                    */
-                                    int32_t delta = offset + value + ref_value;
-
-                                    uint16_t new_value = (uint16_t)(delta & max_val);
-
-                                    bitinsert(src_line, x, current_depth, new_value);
-                                }
+                                int32_t value = bitextract(src_line, x, current_depth);
+                                int32_t ref_value = bitextract(ref_line, x, current_depth);
+
+                                /* when e.g. using 16 bit values:
+                                       delta =  1      -> encode to 0x8001
+                                       delta =  0      -> encode to 0x8000
+                                       delta = -1      -> encode to 0x7FFF
+                                       delta = -0xFFFF -> encode to 0x0001
+                                       delta =  0xFFFF -> encode to 0x7FFF
+                                   so this is basically a signed int with overflow and a max/2 offset.
+                                   this offset makes the frames uniform grey when viewing non-decoded frames and improves compression rate a bit.
+                                */
+                                int32_t delta = offset + value + ref_value;
+
+                                uint16_t new_value = (uint16_t)(delta & max_val);
+
+                                bitinsert(src_line, x, current_depth, new_value);
                             }
-
-                            /* save current original frame to prev buffer */
-                            memcpy(prev_frame_buffer, frame_buffer, frame_size);
                         }
+
+                        /* save current original frame to prev buffer */
+                        memcpy(prev_frame_buffer, frame_buffer, frame_size);
                     }
 
                     /* when no end was specified, save all frames */
@@ -3400,7 +4823,7 @@ read_headers:
 
                     if(frame_selected)
                     {
-                        lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_write", &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
+                        lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_WRITE, &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
 
                         if(raw_output)
                         {
@@ -3409,22 +4832,57 @@ read_headers:
                                 lv_rec_footer.frameSize = frame_size;
                             }
 
-                            lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_write_raw", &block_hdr, sizeof(block_hdr), frame_buffer, frame_size);
+                            lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_WRITE_RAW, &block_hdr, sizeof(block_hdr), frame_buffer, frame_size);
 
                             file_set_pos(out_file, (uint64_t)block_hdr.frameNumber * (uint64_t)frame_size, SEEK_SET);
-                            if(fwrite(frame_buffer, frame_size, 1, out_file) != 1)
+                            if(fwrite(frame_data, frame_size, 1, out_file) != 1)
                             {
                                 print_msg(MSG_ERROR, "VIDF: Failed writing into .RAW file\n");
                                 goto abort;
                             }
                         }
+
+                        if(proxy_output)
+                        {
+                            /* set up with the first frame, the WBAL block comes before it */
+                            if(!proxy)
+                            {
+                                proxy_params.width = video_xRes;
+                                proxy_params.height = video_yRes;
+                                proxy_params.bpp = current_depth;
+                                proxy_params.black = lv_rec_footer.raw_info.black_level;
+                                proxy_params.white = lv_rec_footer.raw_info.white_level;
+                                proxy_params.cfa_pattern = lv_rec_footer.raw_info.cfa_pattern ? lv_rec_footer.raw_info.cfa_pattern : 0x02010100;
+                                proxy_params.fps_nom = alter_fps ? (uint32_t)alter_fps : main_header.sourceFpsNom;
+                                proxy_params.fps_denom = alter_fps ? 1000 : main_header.sourceFpsDenom;
+                                dng_get_wb_multipliers(&idnt_info, &wbal_info, proxy_params.wb);
+
+                                proxy = proxy_create(&proxy_params, threads);
+                                if(!proxy)
+                                {
+                                    print_msg(MSG_ERROR, "VIDF: Failed to set up proxy conversion for %dx%d, %d bpp\n", video_xRes, video_yRes, current_depth);
+                                    goto abort;
+                                }
+
+                                int proxy_width = 0;
+                                int proxy_height = 0;
+                                proxy_size(proxy, &proxy_width, &proxy_height);
+                                print_msg(MSG_INFO, "Proxy video: %dx%d, WB multipliers %.3f %.3f %.3f\n", proxy_width, proxy_height, proxy_params.wb[0], proxy_params.wb[1], proxy_params.wb[2]);
+                            }
+
+                            if(proxy_write_frame(proxy, frame_data, out_file))
+                            {
+                                print_msg(MSG_ERROR, "VIDF: Failed writing proxy frame\n");
+                                goto abort;
+                            }
+                        }
                         
                         /* before compressing do stuff necessary for DNG output */
                         if(dng_output)
                         {
                             struct raw_info raw_info;
 
-                            lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_write_dng", &block_hdr, sizeof(block_hdr), frame_buffer, frame_size);
+                            lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_WRITE_DNG, &block_hdr, sizeof(block_hdr), frame_buffer, frame_size);
 
                             /* copy over raw info from camera type to native (potentially x64) type */
                             raw_info_from_camera(&raw_info, &lv_rec_footer.raw_info);
@@ -3457,6 +4915,10 @@ read_headers:
                             frame_info.fpi_method           = fpi_method;
                             frame_info.bpi_method           = bpi_method;
                             frame_info.crop_rec             = crop_rec;
+                            frame_info.pixel_cache          = pixel_cache_dir;
+                            frame_info.pattern_noise_profile = fpn_profile;
+                            frame_info.pattern_noise_sample = fpn_sample;
+                            fpn_frames++;
 
                             frame_info.file_hdr             = main_header;
                             frame_info.vidf_hdr             = last_vidf;
@@ -3474,28 +4936,85 @@ read_headers:
                             raw_info_to_camera(&frame_info.rawi_hdr.raw_info, &raw_info);
                             /******************************************************/
 
-                            /* init and process 'dng_data' raw buffers or use original compressed/uncompressed ones */
-                            switch(raw_state)
+                            if(pipelined)
                             {
-                                /* if raw input lossless/uncompressed should stay 
-                                   uncompressed or is going to be compressed/recompressed */
-                                case UNCOMPRESSED_RAW:
-                                case COMPRESSED_RAW:
-                                    frame_info.frame_buffer = frame_buffer;
-                                    frame_info.frame_buffer_size = frame_buffer_size;
-                                    dng_init_data(&frame_info, &dng_data);
-                                    dng_process_data(&frame_info, &dng_data);
-                                    break;
-                                /* if passing through original uncompressed/lossless raw */
-                                case UNCOMPRESSED_ORIG:
-                                case COMPRESSED_ORIG:
-                                    dng_data.image_buf = (uint16_t *)frame_buffer;
-                                    dng_data.image_size = frame_buffer_size;
-                                    break;
+                                frame_result_e ret = FRAME_OK;
+                                dng_job_t *job = dng_pipeline_get_job(dng_pipeline, &ret);
+
+                                /* the oldest frame in flight had an error, behave like the single threaded path would have done */
+                                if(ret == FRAME_ERROR || (ret == FRAME_SKIP && !relaxed))
+                                {
+                                    goto abort;
+                                }
+
+                                int frame_filename_len = strlen(output_filename) + 32;
+                                job->dng_filename = malloc(frame_filename_len);
+                                snprintf(job->dng_filename, frame_filename_len, "%s%06d.dng", output_filename, block_hdr.frameNumber);
+
+                                job->read_size = read_size;
+                                job->frame_size = frame_size;
+                                job->compressed_lj92 = compressed_lj92;
+                                job->compressed_lzma = compressed_lzma;
+                                job->compressed_inter = compressed_inter;
+                                job->inter_ref = inter_ref;
+                                job->frame_number = block_hdr.frameNumber;
+                                job->run_decompressor = run_decompressor;
+                                job->xRes = video_xRes;
+                                job->yRes = video_yRes;
+                                job->bpp = lv_rec_footer.raw_info.bits_per_pixel;
+                                job->verbose = verbose;
+
+                                dng_pipeline_submit(dng_pipeline, job, &frame_info, frame_data, &frame_buffer, &frame_buffer_size);
+
+#ifdef MLV_USE_LJ92
+                                /* the keyframe must not be replaced until this job is done */
+                                if(inter_ref)
+                                {
+                                    inter_dec.ref_jobs[inter_ref - inter_dec.refs] = dng_pipeline->submitted;
+                                }
+#endif
+                            }
+                            else
+                            {
+                                /* init and process 'dng_data' raw buffers or use original compressed/uncompressed ones */
+                                switch(raw_state)
+                                {
+                                    /* if raw input lossless/uncompressed should stay 
+                                       uncompressed or is going to be compressed/recompressed */
+                                    case UNCOMPRESSED_RAW:
+                                    case COMPRESSED_RAW:
+                                        frame_info.frame_buffer = frame_data;
+                                        frame_info.frame_buffer_size = frame_buffer_size;
+                                        dng_init_data(&frame_info, &dng_data);
+                                        dng_process_data(&frame_info, &dng_data);
+                                        break;
+                                    /* if passing through original uncompressed/lossless raw */
+                                    case UNCOMPRESSED_ORIG:
+                                    case COMPRESSED_ORIG:
+                                        dng_data.image_buf = (uint16_t *)frame_data;
+                                        dng_data.image_size = read_size;
+                                        break;
+                                }
+                            }
+                        }
+
+#ifdef MLV_USE_LJ92
+                        /* hand the frame over to the compression threads, they also write it */
+                        if((run_compressor || lzma_level >= 0 || deferred_decode) && mlv_pipeline && write_block)
+                        {
+                            block_hdr.frameNumber -= frame_start;
+
+                            if(!mlv_pipeline_submit(mlv_pipeline, &block_hdr, &frame_buffer, &frame_buffer_size, frame_size, video_xRes, video_yRes, lv_rec_footer.raw_info.bits_per_pixel, old_depth,
+                                                    deferred_decode && compressed_lj92, deferred_decode && compressed_lzma, read_size, verbose))
+                            {
+                                goto abort;
                             }
+                            write_block = 0;
+                            run_compressor = 0;
                         }
+#endif
 
-                        if(run_compressor)
+                        if(run_compressor && !pipelined)
                         {
 #ifdef MLV_USE_LJ92
                             uint8_t *compressed = NULL;
@@ -3523,57 +5042,44 @@ read_headers:
                                     void *src_line = &frame_buffer[y * orig_pitch];
                                     uint16_t *dst_line = &compress_buffer[y * video_xRes];
 
-                                    for(int x = 0; x < video_xRes; x++)
-                                    {
-                                        dst_line[x] = bitextract(src_line, x, lv_rec_footer.raw_info.bits_per_pixel);
-                                    }
+                                    bitpack_unpack(src_line, dst_line, video_xRes, lv_rec_footer.raw_info.bits_per_pixel);
                                 }
                             }
                             
-                            /* trying to compress with the same properties as the camera compresses, but..
-                               a small problem here, the compress part of the lj92 lib currently used seems not to allow multiple components.
-                               i.e. a line of RGRGRGRG... would be one component and the next line of GBGBGBGB the second.
-                               unfortunately the image would have to get compressed a bit less efficient as a single-component image.
-                               
-                               a1ex had a good workaround that implies setting xres*2 and yres/2 which would help the compressor.
-                               
-                               canon compression:
-                                 1872x624x2 14 bpp
-                                 2348480 -> 4088448  (57.44% ratio)
-                                 
-                               single component compression: 
-                                 1872x1248x1 14 bpp
-                                 3515085 -> 4088448  (85.98% ratio)
-
-                               single component "x2" compression:
-                                 3744x624x1 14 bpp 
-                                 2353223 -> 4088448  (57.56% ratio)
-
-                               so this method gets quite close to canon's in-camera compression.
-                               while the resolution outputs differ, the real image data is the same.
-                               
-                               downside: we cannot double check if the lj92-reported resolution matches the RAWI information.
-                            */
-                            int lj92_components = 1;
-                            int lj92_width = video_xRes * 2;
-                            int lj92_height = video_yRes / 2;
-                            int lj92_bitdepth = old_depth;
-                            
-                            if(verbose)
+                            int ret = LJ92_ERROR_NONE;
+
+                            if(inter_encode_mode)
                             {
-                                print_msg(MSG_INFO, "    LJ92: Compressing\n");
-                                print_msg(MSG_INFO, "    LJ92: %dx%dx%d %d bpp (%d bytes buffer)\n", lj92_width, lj92_height, lj92_components, lj92_bitdepth, compress_buffer_size);
-                            }
-                            
-                            int ret = lj92_encode(compress_buffer, lj92_width, lj92_height, lj92_bitdepth, 2, lj92_width * lj92_height, 0, NULL, 0, &compressed, &compressed_size);
+                                /* frame numbers get rebased when written, keyframes are referred to by them */
+                                uint32_t frame_number = block_hdr.frameNumber - frame_start;
+                                uint32_t key_distance = inter_key_distance(&inter_enc_ref, &inter_enc_coded, inter_keyframes, frame_number, video_xRes, video_yRes);
 
-                            if(ret == LJ92_ERROR_NONE)
+                                if(!inter_enc && inter_encoder_open(&inter_enc) != LJ92_ERROR_NONE)
+                                {
+                                    print_msg(MSG_ERROR, "    INTER: Failed to allocate encoder\n");
+                                    goto abort;
+                                }
+
+                                ret = compress_frame_inter(inter_enc, &inter_enc_ref, key_distance, lj92_components, compress_buffer, video_xRes, video_yRes, old_depth, frame_size, verbose, &compressed, &compressed_size);
+
+                                if(ret == LJ92_ERROR_NONE && !key_distance)
+                                {
+                                    ret = inter_ref_set(&inter_enc_ref, compress_buffer, frame_number, video_xRes, video_yRes);
+                                }
+                            }
+                            else
                             {
-                                if(verbose)
+                                if(!lj92_enc && lj92_encoder_open(&lj92_enc) != LJ92_ERROR_NONE)
                                 {
-                                    print_msg(MSG_INFO, "    LJ92: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_size, compressed_size, ((float)compressed_size * 100.0f) / (float)frame_size);
+                                    print_msg(MSG_ERROR, "    LJ92: Failed to allocate encoder\n");
+                                    goto abort;
                                 }
-                                
+
+                                ret = compress_frame_lj92(lj92_enc, lj92_components, compress_buffer, compress_buffer_size, video_xRes, video_yRes, old_depth, frame_size, verbose, &compressed, &compressed_size);
+                            }
+
+                            if(ret == LJ92_ERROR_NONE)
+                            {
                                 /* set new compressed size and copy buffers */
                                 frame_buffer = realloc(frame_buffer, compressed_size);
                                 assert(frame_buffer);
@@ -3593,11 +5099,8 @@ read_headers:
                             }
                             else
                             {
-                                print_msg(MSG_ERROR, "    LJ92: Failed (%d)\n", ret);
                                 goto abort;
                             }
-                            
-                            free(compressed);
 #else
                             print_msg(MSG_INFO, "    no compression type compiled into this release, aborting.\n");
                             if(relaxed)
@@ -3618,13 +5121,44 @@ read_headers:
                             }
                         }
 
+#ifdef MLV_USE_LZMA
+                        /* --lzma without worker threads */
+                        if(lzma_level >= 0 && write_block)
+                        {
+                            uint8_t *lzma_buffer = malloc(lzma_frame_bound(frame_size));
+                            size_t lzma_size = lzma_buffer ? lzma_frame_compress(frame_buffer, frame_size, lzma_level, lzma_buffer) : 0;
+
+                            if(!lzma_size)
+                            {
+                                print_msg(MSG_ERROR, "    LZMA: Failed to compress VIDF #%d\n", block_hdr.frameNumber);
+                                free(lzma_buffer);
+                                goto abort;
+                            }
+
+                            free(frame_buffer);
+                            frame_buffer = lzma_buffer;
+                            frame_buffer_size = lzma_size;
+
+                            if(!verbose && show_progress)
+                            {
+                                static int first_time = 1;
+                                if(first_time)
+                                {
+                                    print_msg(MSG_INFO, "\nWriting LZMA compressed frames...\n");
+                                    first_time = 0;
+                                }
+                                print_msg(MSG_INFO, "  saving: "FMT_SIZE" -> "FMT_SIZE"  (%2.2f%% ratio)\n", frame_size, frame_buffer_size, ((float)frame_buffer_size * 100.0f) / (float)frame_size);
+                            }
+                        }
+#endif
+
                         /* save DNG frame */
-                        if(dng_output)
+                        if(dng_output && !pipelined)
                         {
                             int frame_filename_len = strlen(output_filename) + 32;
                             char *frame_filename = malloc(frame_filename_len);
                             snprintf(frame_filename, frame_filename_len, "%s%06d.dng", output_filename, block_hdr.frameNumber);
-                            lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_write_dng", &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
+                            lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_WRITE_DNG, &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
                             frame_info.dng_filename = frame_filename;
 
                             dng_init_header(&frame_info, &dng_data);
@@ -3639,27 +5173,40 @@ read_headers:
                                 goto abort;
                             }
 
+                            /* the single threaded path primes the worker threads, see above */
+                            if(dng_pipeline)
+                            {
+                                dng_pipeline->frames_saved++;
+                            }
+
                             /* callout for a saved dng file */
-                            lua_call_va(lua_state, "dng_saved", "si", frame_filename, block_hdr.frameNumber);
+                            lua_hooks_dng_saved(lua_hooks, frame_filename, block_hdr.frameNumber);
 
                             free(frame_filename);
                         }
 
                         if(write_block)
                         {
-                            lua_handle_hdr_data(lua_state, mlv_block->blockType, "_data_write_mlv", &block_hdr, sizeof(block_hdr), frame_buffer, frame_buffer_size);
+                            /* frame_buffer can be larger than its content (it starts with 1 MiB), only compressed output fills it exactly */
+                            uint32_t write_size = frame_buffer_size;
+                            if(!run_compressor && lzma_level < 0)
+                            {
+                                write_size = (compressed && !run_decompressor) ? (uint32_t)read_size : (uint32_t)frame_size;
+                            }
+
+                            lua_hooks_call(lua_hooks, mlv_block->blockType, LUA_HOOK_DATA_WRITE_MLV, &block_hdr, sizeof(block_hdr), frame_buffer, write_size);
 
                             /* delete free space and correct header size if needed */
-                            block_hdr.blockSize = sizeof(mlv_vidf_hdr_t) + frame_buffer_size;
+                            block_hdr.blockSize = sizeof(mlv_vidf_hdr_t) + write_size;
                             block_hdr.frameSpace = 0;
                             block_hdr.frameNumber -= frame_start;
 
-                            if(fwrite(&block_hdr, sizeof(mlv_vidf_hdr_t), 1, out_file) != 1)
+                            if(!mlv_pipeline_write(mlv_pipeline, out_file, &block_hdr, sizeof(mlv_vidf_hdr_t)))
                             {
                                 print_msg(MSG_ERROR, "VIDF: Failed writing into .MLV file\n");
                                 goto abort;
                             }
-                            if(fwrite(frame_buffer, frame_buffer_size, 1, out_file) != 1)
+                            if(!mlv_pipeline_write(mlv_pipeline, out_file, frame_buffer, write_size))
                             {
                                 print_msg(MSG_ERROR, "VIDF: Failed writing into .MLV file\n");
                                 goto abort;
@@ -3915,11 +5462,15 @@ read_headers:
                 int frame_size = MAX(bit_depth, block_hdr.raw_info.bits_per_pixel) * block_hdr.raw_info.height * block_hdr.raw_info.width / 8;
                 
                 /* resolution change, old data will be thrown away */
-                if(frame_arith_buffer)
+                if(stacker)
                 {
                     print_msg(MSG_INFO, "Got a new RAWI, throwing away average buffers etc.\n");
-                    free(frame_arith_buffer);
-                    frame_arith_buffer = NULL;
+                    stacker_free(stacker);
+                    stacker = NULL;
+                    free(stack_frame);
+                    stack_frame = NULL;
+                    free(stack_noise);
+                    stack_noise = NULL;
                 }
                 
                 if(prev_frame_buffer)
@@ -3929,13 +5480,6 @@ read_headers:
                     prev_frame_buffer = NULL;
                 }
                 
-                frame_arith_buffer = malloc(frame_size * sizeof(uint32_t));
-                if(!frame_arith_buffer)
-                {
-                    print_msg(MSG_ERROR, "Failed to allocate %d byte for frame_arith_buffer\n", frame_size * sizeof(uint32_t));
-                    goto abort;
-                }
-                
                 prev_frame_buffer = malloc(frame_size);
                 if(!prev_frame_buffer)
                 {
@@ -3943,7 +5487,6 @@ read_headers:
                     goto abort;
                 }
                 
-                memset(frame_arith_buffer, 0x00, frame_size * sizeof(uint32_t));
                 memset(prev_frame_buffer, 0x00, frame_size);
 
                 /* always output RAWI blocks, its not just metadata, but important frame format data */
@@ -3956,7 +5499,7 @@ read_headers:
                     /* patch raw info if black and/or white fix specified or bit depth changed */
                     fix_black_white_level(&block_hdr.raw_info.black_level, &block_hdr.raw_info.white_level, &block_hdr.raw_info.bits_per_pixel, bit_depth, black_fix, white_fix, verbose);
 
-                    if(fwrite(&block_hdr, block_hdr.blockSize, 1, out_file) != 1)
+                    if(!mlv_pipeline_write(mlv_pipeline, out_file, &block_hdr, block_hdr.blockSize))
                     {
                         print_msg(MSG_ERROR, "Failed writing into .MLV file\n");
                         goto abort;
@@ -3989,7 +5532,8 @@ read_headers:
 
                 memcpy(&wavi_info, &block_hdr, sizeof(mlv_wavi_hdr_t));
 
-                if(output_filename && out_file_wav == NULL && !extract_block)
+                /* no .wav next to a proxy video written to stdout */
+                if(output_filename && out_file_wav == NULL && !extract_block && out_file != stdout)
                 {
                     size_t name_len = strlen(output_filename) + 5;  // + .wav\0
                     char* wav_file_name = malloc(name_len);
@@ -4097,8 +5641,6 @@ read_headers:
                 {
                     print_msg(MSG_INFO, "Unknown Block: %c%c%c%c, skipping\n", mlv_block->blockType[0], mlv_block->blockType[1], mlv_block->blockType[2], mlv_block->blockType[3]);
                 }
-
-                lua_handle_hdr(lua_state, mlv_block->blockType, "", 0);
             }
         }
 
@@ -4110,7 +5652,7 @@ read_headers:
             (!extract_block || !strncasecmp(extract_block, (char *)mlv_block->blockType, 4)) /* when block extraction was requested, only write those */
             )
         {
-            if(fwrite(mlv_block, mlv_block->blockSize, 1, out_file) != 1)
+            if(!mlv_pipeline_write(mlv_pipeline, out_file, mlv_block, mlv_block->blockSize))
             { 
                 print_msg(MSG_ERROR, "Failed writing into .MLV file\n");
                 goto abort;
@@ -4127,7 +5669,7 @@ skip_block:
         if(block_xref)
         {
             block_xref_pos++;
-            if(block_xref_pos >= block_xref->entryCount)
+            if(block_xref_pos >= mlv_index_count(block_xref))
             {
                 print_msg(MSG_INFO, "\n");
                 print_msg(MSG_INFO, "Reached end of all files after %i blocks\n", blocks_processed);
@@ -4139,13 +5681,36 @@ skip_block:
 
 abort:
 
-    /* free block buffer */
-    if(mlv_block)
+    /* wait for DNG frames still being processed */
+    if(dng_pipeline)
+    {
+        dng_pipeline_finish(dng_pipeline);
+        dng_pipeline = NULL;
+    }
+
+#ifdef MLV_USE_LJ92
+    /* write the compressed frames still in flight, before the main header gets updated */
+    if(mlv_pipeline)
     {
-        free(mlv_block);
-        mlv_block = NULL;
+        mlv_pipeline_finish(mlv_pipeline);
+        mlv_pipeline = NULL;
     }
 
+    lj92_encoder_close(lj92_enc);
+    lj92_enc = NULL;
+
+    inter_encoder_close(inter_enc);
+    inter_enc = NULL;
+    inter_ref_free(&inter_enc_ref);
+    inter_ref_free(&inter_dec.refs[0]);
+    inter_ref_free(&inter_dec.refs[1]);
+#endif
+
+    /* free block buffer */
+    free(mlv_block_buf);
+    mlv_block_buf = NULL;
+    mlv_block = NULL;
+
     {
         float fps = main_header.sourceFpsNom / (float)main_header.sourceFpsDenom;
 
@@ -4159,16 +5724,24 @@ abort:
         {
             print_msg(MSG_ERROR, "Averaged image, but no out file specified\n");
         }
-        else if(!average_samples)
+        else if(!stacker || !stacker_frames(stacker))
         {
             print_msg(MSG_ERROR, "Number of averaged frames is zero. Cannot continue.\n");
         }
+        else if(stacker_finish(stacker, stack_frame, stack_noise))
+        {
+            print_msg(MSG_ERROR, "Failed to stack frames, out of memory or disk space\n");
+        }
         else
         {
             int old_depth = lv_rec_footer.raw_info.bits_per_pixel;
             int new_depth = bit_depth ? bit_depth : old_depth;
             int new_pitch = video_xRes * new_depth / 8;
+            uint16_t *master = stack_frame;
             
+            print_msg(MSG_INFO, "Stacked %d frames (%s)\n", stacker_frames(stacker), stack_mode == STACK_SIGMA ? "sigma clipped mean" : stack_mode == STACK_MEDIAN ? "median of blocks" : "mean");
+            save_stack_maps(output_filename, master, stack_noise, video_xRes, video_yRes, last_vidf.panPosX, last_vidf.panPosY, stacker_frames(stacker));
+
             print_msg(MSG_INFO, "Writing averaged frame with %dbpp\n", new_depth);
             
             /* average the pixels in vertical direction, so we will extract vertical banding noise */
@@ -4180,12 +5753,12 @@ abort:
                     
                     for(int y = 0; y < video_yRes; y++)
                     {
-                        column += frame_arith_buffer[y * video_xRes + x];
+                        column += master[y * video_xRes + x];
                     }
                     column /= video_yRes;
                     for(int y = 0; y < video_yRes; y++)
                     {
-                        frame_arith_buffer[y * video_xRes + x] = column;
+                        master[y * video_xRes + x] = column;
                     }
                 }
             }
@@ -4197,13 +5770,13 @@ abort:
                     
                     for(int x = 0; x < video_xRes; x++)
                     {
-                        line += frame_arith_buffer[y * video_xRes + x];
+                        line += master[y * video_xRes + x];
                     }
-                    line /= video_yRes;
+                    line /= video_xRes;
                     for(int x = 0; x < video_xRes; x++)
                     {
 
-                        frame_arith_buffer[y * video_xRes + x] = line;
+                        master[y * video_xRes + x] = line;
                     }
                 }
             }
@@ -4213,16 +5786,7 @@ abort:
                 uint16_t *dst_line = (uint16_t *)&frame_buffer[y * new_pitch];
                 for(int x = 0; x < video_xRes; x++)
                 {
-                    uint32_t value = frame_arith_buffer[y * video_xRes + x];
-                    
-                    /* complete the averaging, minimizing the roundoff error */
-                    value = (value + average_samples/2) / average_samples;
-                    static int countz = 1;
-                    if(countz)
-                    {
-                        printf("avg[0] = %u samples = %u\n", value, average_samples);
-                        countz = 0;
-                    }
+                    uint32_t value = master[y * video_xRes + x];
                     
                     /* scale value when bit depth changed according to depth conversion in VIDF block */
                     if(old_depth != new_depth)
@@ -4272,9 +5836,12 @@ abort:
 
     if(xref_mode && !autopsy_mode && !visualize)
     {
-        print_msg(MSG_INFO, "XREF table contains %d entries\n", frame_xref_entries);
-        xref_sort(frame_xref_table, frame_xref_entries);
-        save_index(input_filename, &main_header, in_file_count, frame_xref_table, frame_xref_entries);
+        print_msg(MSG_INFO, "XREF table contains %d entries\n", mlv_index_count(frame_xref_index));
+
+        if(mlv_index_save(frame_xref_index, input_filename))
+        {
+            print_msg(MSG_ERROR, "Failed writing into .IDX file\n");
+        }
     }
 
     /* fix frame count */
@@ -4304,16 +5871,28 @@ abort:
         {
             main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LJ92;
             main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LZMA;
+            main_header.audioClass &= ~MLV_AUDIO_CLASS_FLAG_LZMA;
+        }
+        if(lzma_level >= 0)
+        {
+            main_header.videoClass |= MLV_VIDEO_CLASS_FLAG_LZMA;
+            if(main_header.audioClass)
+            {
+                main_header.audioClass |= MLV_AUDIO_CLASS_FLAG_LZMA;
+            }
         }
 
-        if(delta_encode_mode)
+        if(inter_encode_mode)
         {
-            main_header.videoClass |= MLV_VIDEO_CLASS_FLAG_DELTA;
+            main_header.videoClass |= MLV_VIDEO_CLASS_FLAG_INTER;
+            main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_LJ92;
         }
-        else
+        else if(compress_output || decompress_input)
         {
-            main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_DELTA;
+            main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_INTER;
         }
+
+        main_header.videoClass &= ~MLV_VIDEO_CLASS_FLAG_DELTA;
         
         if(no_audio)
         {
@@ -4329,6 +5908,9 @@ abort:
     }
     
     
+    /* unmap before closing the files */
+    mlv_reader_close(mlv_reader);
+
     /* free list of input files */
     for(in_file_num = 0; in_file_num < in_file_count; in_file_num++)
     {
@@ -4364,14 +5946,20 @@ abort:
     {
         dng_free_data(&dng_data);
     }
+    fpn_profile_free(fpn_profile);
+    proxy_free(proxy);
+    lua_hooks_free(lua_hooks);
     
     /* passing NULL to free is absolutely legal, so no check required */
     free(lut_filename);
     free(subtract_filename);
     free(output_filename);
     free(prev_frame_buffer);
-    free(frame_arith_buffer);
-    free(block_xref);
+    stacker_free(stacker);
+    free(stack_frame);
+    free(stack_noise);
+    mlv_index_free(block_xref);
+    mlv_index_free(frame_xref_index);
 
     print_msg(MSG_INFO, "Done\n");
     print_msg(MSG_INFO, "\n");
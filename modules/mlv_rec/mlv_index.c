@@ -0,0 +1,1058 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifdef CONFIG_MAGICLANTERN
+#include <dryos.h>
+#include <string.h>
+
+#else // if we compile it for desktop
+/* fseeko() and ftello() with -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define fio_malloc malloc
+#define fio_free free
+
+#define FIO_OpenFile(name, mode) fopen(name, "rb")
+#define FIO_CreateFile(name) fopen(name, "wb")
+#define FIO_ReadFile(f, ptr, count) (int)fread(ptr, 1, count, f)
+#define FIO_WriteFile(f, ptr, count) (int)fwrite(ptr, 1, count, f)
+#define FIO_SeekSkipFile(f, offset, whence) mlv_index_seek(f, offset, whence)
+#define FIO_CloseFile(f) fclose(f)
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* same semantics as FIO_SeekSkipFile, returns the new position */
+static int64_t mlv_index_seek(FILE *file, int64_t offset, int whence)
+{
+#if defined(__WIN32)
+    fseeko64(file, offset, whence);
+    return ftello64(file);
+#else
+    fseeko(file, offset, whence);
+    return ftello(file);
+#endif
+}
+#endif
+
+#include "mlv_index.h"
+
+/* frame numbers beyond that are most likely garbage and would blow up the frame table */
+#define MLV_INDEX_MAX_FRAME(entries) ((entries) * 4 + 1024)
+
+/* blocks of one type in timestamp order, built on the first mlv_index_find_block() */
+struct mlv_index_type
+{
+    uint8_t blockType[4];
+    uint32_t count;
+    uint32_t *positions;
+};
+
+struct mlv_index
+{
+    /* block entries, sorted by timestamp after mlv_index_finalize() */
+    mlv_index_entry_t *entries;
+    uint32_t entry_count;
+    uint32_t entry_alloc;
+
+    /* VIDF frame number -> entry */
+    uint32_t *frame_table;
+    uint32_t frame_count;
+    int frames_clipped;
+
+    /* timestamp bucket -> first entry in that bucket */
+    uint32_t *time_table;
+    uint64_t bucket_duration;
+    uint32_t bucket_count;
+
+    /* bytes of each chunk that were scanned */
+    uint32_t chunk_count;
+    uint64_t *chunk_size;
+
+    /* MIDX block as loaded from the .IDX file. entries and tables point into it until the index gets modified */
+    void *file_buffer;
+
+    struct mlv_index_type *types;
+    uint32_t type_count;
+
+    int finalized;
+    int error;
+
+    mlv_file_hdr_t file_hdr;
+};
+
+static char *mlv_index_filename(char *mlv_filename)
+{
+    int len = strlen(mlv_filename);
+    char *filename = malloc(len + 1);
+
+    if(!filename || len < 3)
+    {
+        free(filename);
+        return NULL;
+    }
+
+    strcpy(filename, mlv_filename);
+    strcpy(&filename[len - 3], "IDX");
+
+    return filename;
+}
+
+static void mlv_index_free_types(mlv_index_t *index)
+{
+    for(uint32_t type = 0; type < index->type_count; type++)
+    {
+        free(index->types[type].positions);
+    }
+    free(index->types);
+    index->types = NULL;
+    index->type_count = 0;
+}
+
+static void mlv_index_free_tables(mlv_index_t *index)
+{
+    if(!index->file_buffer)
+    {
+        free(index->frame_table);
+        free(index->time_table);
+    }
+    index->frame_table = NULL;
+    index->time_table = NULL;
+    index->frame_count = 0;
+    index->bucket_count = 0;
+    index->bucket_duration = 0;
+    index->frames_clipped = 0;
+
+    mlv_index_free_types(index);
+
+    index->finalized = 0;
+}
+
+/* copy the entries out of the loaded MIDX block so they can be modified */
+static int mlv_index_detach(mlv_index_t *index)
+{
+    if(!index->file_buffer)
+    {
+        return MLV_INDEX_OK;
+    }
+
+    mlv_index_entry_t *entries = malloc(MAX(index->entry_count, 1) * sizeof(mlv_index_entry_t));
+
+    if(!entries)
+    {
+        return MLV_INDEX_ERR_MEM;
+    }
+    memcpy(entries, index->entries, index->entry_count * sizeof(mlv_index_entry_t));
+
+    mlv_index_free_tables(index);
+    fio_free(index->file_buffer);
+    index->file_buffer = NULL;
+
+    index->entries = entries;
+    index->entry_alloc = MAX(index->entry_count, 1);
+
+    return MLV_INDEX_OK;
+}
+
+static int mlv_index_set_chunks(mlv_index_t *index, uint32_t chunk_count)
+{
+    if(chunk_count <= index->chunk_count)
+    {
+        return MLV_INDEX_OK;
+    }
+
+    uint64_t *chunk_size = realloc(index->chunk_size, chunk_count * sizeof(uint64_t));
+
+    if(!chunk_size)
+    {
+        return MLV_INDEX_ERR_MEM;
+    }
+
+    memset(&chunk_size[index->chunk_count], 0x00, (chunk_count - index->chunk_count) * sizeof(uint64_t));
+    index->chunk_size = chunk_size;
+    index->chunk_count = chunk_count;
+
+    return MLV_INDEX_OK;
+}
+
+mlv_index_t *mlv_index_create()
+{
+    mlv_index_t *index = malloc(sizeof(mlv_index_t));
+
+    if(!index)
+    {
+        return NULL;
+    }
+    memset(index, 0x00, sizeof(mlv_index_t));
+
+    return index;
+}
+
+void mlv_index_free(mlv_index_t *index)
+{
+    if(!index)
+    {
+        return;
+    }
+
+    mlv_index_free_tables(index);
+
+    if(index->file_buffer)
+    {
+        fio_free(index->file_buffer);
+    }
+    else
+    {
+        free(index->entries);
+    }
+    free(index->chunk_size);
+    free(index);
+}
+
+void mlv_index_add(mlv_index_t *index, const mlv_hdr_t *block, uint16_t file_number, uint64_t offset)
+{
+    if(index->error)
+    {
+        return;
+    }
+
+    /* remember how far each chunk was indexed, also for blocks that do not get an entry */
+    index->error = mlv_index_set_chunks(index, file_number + 1);
+    if(index->error)
+    {
+        return;
+    }
+    index->chunk_size[file_number] = MAX(index->chunk_size[file_number], offset + block->blockSize);
+
+    if(!memcmp(block->blockType, "NULL", 4) || !memcmp(block->blockType, "BKUP", 4))
+    {
+        return;
+    }
+
+    index->error = mlv_index_detach(index);
+    if(index->error)
+    {
+        return;
+    }
+
+    if(index->entry_count >= index->entry_alloc)
+    {
+        uint32_t entry_alloc = MAX(index->entry_alloc * 2, 1024);
+        mlv_index_entry_t *entries = realloc(index->entries, entry_alloc * sizeof(mlv_index_entry_t));
+
+        if(!entries)
+        {
+            index->error = MLV_INDEX_ERR_MEM;
+            return;
+        }
+        index->entries = entries;
+        index->entry_alloc = entry_alloc;
+    }
+
+    mlv_index_entry_t *entry = &index->entries[index->entry_count++];
+
+    memset(entry, 0x00, sizeof(mlv_index_entry_t));
+    memcpy(entry->blockType, block->blockType, 4);
+    entry->blockSize = block->blockSize;
+    entry->offset = offset;
+    entry->fileNumber = file_number;
+    entry->frameType = MLV_FRAME_UNSPECIFIED;
+
+    if(!memcmp(block->blockType, "MLVI", 4))
+    {
+        const mlv_file_hdr_t *file_hdr = (const mlv_file_hdr_t *)block;
+
+        /* emulate timestamp zero, the version string is where other blocks have their timestamp */
+        entry->timestamp = 0;
+
+        if(file_hdr->fileNum == 0)
+        {
+            memset(&index->file_hdr, 0x00, sizeof(mlv_file_hdr_t));
+            memcpy(&index->file_hdr, file_hdr, MIN(sizeof(mlv_file_hdr_t), block->blockSize));
+        }
+    }
+    else
+    {
+        entry->timestamp = block->timestamp;
+
+        if(!memcmp(block->blockType, "VIDF", 4))
+        {
+            entry->frameType = MLV_FRAME_VIDF;
+            entry->frameNumber = ((const mlv_vidf_hdr_t *)block)->frameNumber;
+        }
+        else if(!memcmp(block->blockType, "AUDF", 4))
+        {
+            entry->frameType = MLV_FRAME_AUDF;
+            entry->frameNumber = ((const mlv_audf_hdr_t *)block)->frameNumber;
+        }
+    }
+
+    index->finalized = 0;
+}
+
+/* stable, so blocks with the same timestamp stay in file order */
+static int mlv_index_sort(mlv_index_entry_t *entries, uint32_t count)
+{
+    uint32_t pos = 1;
+
+    /* blocks get added in file order, which usually is the timestamp order already */
+    while(pos < count && entries[pos - 1].timestamp <= entries[pos].timestamp)
+    {
+        pos++;
+    }
+
+    if(pos >= count)
+    {
+        return MLV_INDEX_OK;
+    }
+
+    mlv_index_entry_t *temp = malloc(count * sizeof(mlv_index_entry_t));
+    mlv_index_entry_t *src = entries;
+    mlv_index_entry_t *dst = temp;
+
+    if(!temp)
+    {
+        return MLV_INDEX_ERR_MEM;
+    }
+
+    /* bottom-up merge sort */
+    for(uint32_t width = 1; width < count; width *= 2)
+    {
+        for(uint32_t lo = 0; lo < count; lo += 2 * width)
+        {
+            uint32_t mid = MIN(lo + width, count);
+            uint32_t hi = MIN(lo + 2 * width, count);
+            uint32_t left = lo;
+            uint32_t right = mid;
+
+            for(uint32_t out = lo; out < hi; out++)
+            {
+                if(left < mid && (right >= hi || src[left].timestamp <= src[right].timestamp))
+                {
+                    dst[out] = src[left++];
+                }
+                else
+                {
+                    dst[out] = src[right++];
+                }
+            }
+        }
+
+        mlv_index_entry_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if(src != entries)
+    {
+        memcpy(entries, src, count * sizeof(mlv_index_entry_t));
+    }
+    free(temp);
+
+    return MLV_INDEX_OK;
+}
+
+int mlv_index_finalize(mlv_index_t *index)
+{
+    if(index->error)
+    {
+        return index->error;
+    }
+
+    if(index->finalized)
+    {
+        return MLV_INDEX_OK;
+    }
+
+    int ret = mlv_index_detach(index);
+    if(ret)
+    {
+        return ret;
+    }
+
+    mlv_index_free_tables(index);
+
+    ret = mlv_index_sort(index->entries, index->entry_count);
+    if(ret)
+    {
+        return ret;
+    }
+
+    uint32_t count = index->entry_count;
+
+    /* frame table, direct lookup by VIDF frame number */
+    for(uint32_t pos = 0; pos < count; pos++)
+    {
+        if(index->entries[pos].frameType != MLV_FRAME_VIDF)
+        {
+            continue;
+        }
+
+        uint32_t frame_number = index->entries[pos].frameNumber;
+
+        if(frame_number >= MLV_INDEX_MAX_FRAME(count))
+        {
+            index->frames_clipped = 1;
+            continue;
+        }
+        index->frame_count = MAX(index->frame_count, frame_number + 1);
+    }
+
+    if(index->frame_count)
+    {
+        index->frame_table = malloc(index->frame_count * sizeof(uint32_t));
+
+        if(!index->frame_table)
+        {
+            mlv_index_free_tables(index);
+            return MLV_INDEX_ERR_MEM;
+        }
+        memset(index->frame_table, 0xFF, index->frame_count * sizeof(uint32_t));
+
+        for(uint32_t pos = 0; pos < count; pos++)
+        {
+            uint32_t frame_number = index->entries[pos].frameNumber;
+
+            if(index->entries[pos].frameType == MLV_FRAME_VIDF && frame_number < index->frame_count && index->frame_table[frame_number] == MLV_INDEX_NONE)
+            {
+                index->frame_table[frame_number] = pos;
+            }
+        }
+    }
+
+    /* time table, about one entry per bucket so a lookup only has to step over very few entries */
+    if(count)
+    {
+        uint64_t first = index->entries[0].timestamp;
+        uint64_t last = index->entries[count - 1].timestamp;
+
+        index->bucket_count = count;
+        index->bucket_duration = (last - first) / count + 1;
+        index->time_table = malloc(index->bucket_count * sizeof(uint32_t));
+
+        if(!index->time_table)
+        {
+            mlv_index_free_tables(index);
+            return MLV_INDEX_ERR_MEM;
+        }
+
+        uint32_t pos = 0;
+        for(uint32_t bucket = 0; bucket < index->bucket_count; bucket++)
+        {
+            uint64_t start = first + bucket * index->bucket_duration;
+
+            while(pos < count && index->entries[pos].timestamp < start)
+            {
+                pos++;
+            }
+            index->time_table[bucket] = pos;
+        }
+    }
+
+    index->finalized = 1;
+
+    return MLV_INDEX_OK;
+}
+
+/* index all blocks of a chunk, starting at 'position'. stops at a block that was not completely written yet */
+static int mlv_index_scan(mlv_index_t *index, FILE *file, uint32_t chunk, uint32_t chunk_count, uint64_t position, mlv_index_progress_t progress)
+{
+    uint64_t size = FIO_SeekSkipFile(file, 0, SEEK_END);
+    uint32_t last_pct = 0;
+
+    if(progress && progress(chunk, chunk_count, 0))
+    {
+        return MLV_INDEX_CANCELLED;
+    }
+
+    while(position + sizeof(mlv_hdr_t) <= size)
+    {
+        /* large enough for every header field the index needs */
+        union
+        {
+            mlv_hdr_t hdr;
+            mlv_file_hdr_t file_hdr;
+            mlv_vidf_hdr_t vidf_hdr;
+            mlv_audf_hdr_t audf_hdr;
+        } buf;
+        int32_t read_size = MIN(sizeof(buf), size - position);
+
+        if(progress)
+        {
+            uint32_t pct = (uint32_t)((position * 100) / size);
+
+            if(pct != last_pct && progress(chunk, chunk_count, pct))
+            {
+                return MLV_INDEX_CANCELLED;
+            }
+            last_pct = pct;
+        }
+
+        memset(&buf, 0x00, sizeof(buf));
+        FIO_SeekSkipFile(file, position, SEEK_SET);
+        if(FIO_ReadFile(file, &buf, read_size) != read_size)
+        {
+            return MLV_INDEX_ERR_READ;
+        }
+
+        /* unexpected block header size? */
+        if(buf.hdr.blockSize < sizeof(mlv_hdr_t) || buf.hdr.blockSize > 50 * 1024 * 1024)
+        {
+            return MLV_INDEX_ERR_BLOCK;
+        }
+
+        /* still being written */
+        if(position + buf.hdr.blockSize > size)
+        {
+            break;
+        }
+
+        /* chunks of other recordings must not get mixed in */
+        if(!memcmp(buf.hdr.blockType, "MLVI", 4) && buf.file_hdr.fileNum != 0 && index->file_hdr.fileGuid != buf.file_hdr.fileGuid)
+        {
+            return MLV_INDEX_ERR_GUID;
+        }
+
+        mlv_index_add(index, &buf.hdr, chunk, position);
+        if(index->error)
+        {
+            return index->error;
+        }
+
+        position += buf.hdr.blockSize;
+    }
+
+    /* partially written block or trailing garbage, continue there next time */
+    index->chunk_size[chunk] = position;
+
+    return MLV_INDEX_OK;
+}
+
+int mlv_index_update(mlv_index_t *index, FILE **chunk_files, uint32_t chunk_count, mlv_index_progress_t progress)
+{
+    mlv_file_hdr_t file_hdr;
+    int changed = 0;
+    int ret = 0;
+
+    if(index->error)
+    {
+        return index->error;
+    }
+
+    if(!chunk_count)
+    {
+        return MLV_INDEX_ERR_READ;
+    }
+
+    memset(&file_hdr, 0x00, sizeof(mlv_file_hdr_t));
+    FIO_SeekSkipFile(chunk_files[0], 0, SEEK_SET);
+    if(FIO_ReadFile(chunk_files[0], &file_hdr, sizeof(mlv_hdr_t)) != sizeof(mlv_hdr_t) || memcmp(file_hdr.fileMagic, "MLVI", 4))
+    {
+        return MLV_INDEX_ERR_BLOCK;
+    }
+    FIO_SeekSkipFile(chunk_files[0], 0, SEEK_SET);
+    if(FIO_ReadFile(chunk_files[0], &file_hdr, MIN(sizeof(mlv_file_hdr_t), file_hdr.blockSize)) <= 0)
+    {
+        return MLV_INDEX_ERR_READ;
+    }
+
+    /* anything that was not just appended needs a full rebuild */
+    int rebuild = (index->file_hdr.fileGuid != file_hdr.fileGuid) || (chunk_count < index->chunk_count);
+
+    for(uint32_t chunk = 0; chunk < index->chunk_count && !rebuild; chunk++)
+    {
+        if((uint64_t)FIO_SeekSkipFile(chunk_files[chunk], 0, SEEK_END) < index->chunk_size[chunk])
+        {
+            rebuild = 1;
+        }
+    }
+
+    if(rebuild)
+    {
+        ret = mlv_index_detach(index);
+        if(ret)
+        {
+            return ret;
+        }
+        mlv_index_free_tables(index);
+
+        index->entry_count = 0;
+        index->chunk_count = 0;
+        memset(&index->file_hdr, 0x00, sizeof(mlv_file_hdr_t));
+        changed = 1;
+    }
+
+    if(chunk_count > index->chunk_count)
+    {
+        ret = mlv_index_set_chunks(index, chunk_count);
+        if(ret)
+        {
+            return ret;
+        }
+        changed = 1;
+    }
+
+    for(uint32_t chunk = 0; chunk < chunk_count; chunk++)
+    {
+        uint64_t start = index->chunk_size[chunk];
+
+        if((uint64_t)FIO_SeekSkipFile(chunk_files[chunk], 0, SEEK_END) <= start)
+        {
+            continue;
+        }
+
+        ret = mlv_index_scan(index, chunk_files[chunk], chunk, chunk_count, start, progress);
+        if(ret)
+        {
+            return ret;
+        }
+
+        if(index->chunk_size[chunk] != start)
+        {
+            changed = 1;
+        }
+    }
+
+    if(!changed)
+    {
+        return MLV_INDEX_OK;
+    }
+
+    ret = mlv_index_finalize(index);
+    if(ret)
+    {
+        return ret;
+    }
+
+    return MLV_INDEX_UPDATED;
+}
+
+/* checks if the loaded MIDX block is complete and consistent, then points the tables into it */
+static int mlv_index_use_block(mlv_index_t *index, mlv_midx_hdr_t *hdr)
+{
+    uint64_t size = sizeof(mlv_midx_hdr_t);
+
+    size += (uint64_t)hdr->chunkCount * sizeof(uint64_t);
+    size += (uint64_t)hdr->entryCount * sizeof(mlv_index_entry_t);
+    size += (uint64_t)hdr->frameCount * sizeof(uint32_t);
+    size += (uint64_t)hdr->bucketCount * sizeof(uint32_t);
+
+    if(hdr->version != MLV_INDEX_VERSION || size != hdr->blockSize || hdr->bucketCount != hdr->entryCount || (hdr->entryCount && !hdr->bucketDuration))
+    {
+        return 0;
+    }
+
+    uint8_t *data = (uint8_t *)&hdr[1];
+
+    if(mlv_index_set_chunks(index, hdr->chunkCount))
+    {
+        return 0;
+    }
+    memcpy(index->chunk_size, data, hdr->chunkCount * sizeof(uint64_t));
+    data += hdr->chunkCount * sizeof(uint64_t);
+
+    index->entries = (mlv_index_entry_t *)data;
+    index->entry_count = hdr->entryCount;
+    data += hdr->entryCount * sizeof(mlv_index_entry_t);
+
+    index->frame_table = hdr->frameCount ? (uint32_t *)data : NULL;
+    index->frame_count = hdr->frameCount;
+    data += hdr->frameCount * sizeof(uint32_t);
+
+    index->time_table = hdr->bucketCount ? (uint32_t *)data : NULL;
+    index->bucket_count = hdr->bucketCount;
+    index->bucket_duration = hdr->bucketDuration;
+
+    /* frame numbers that did not fit into the table can only be found by searching */
+    for(uint32_t pos = 0; pos < index->entry_count; pos++)
+    {
+        if(index->entries[pos].frameType == MLV_FRAME_VIDF && index->entries[pos].frameNumber >= index->frame_count)
+        {
+            index->frames_clipped = 1;
+            break;
+        }
+    }
+
+    index->file_buffer = hdr;
+    index->finalized = 1;
+
+    return 1;
+}
+
+mlv_index_t *mlv_index_load(char *mlv_filename)
+{
+    char *filename = mlv_index_filename(mlv_filename);
+
+    if(!filename)
+    {
+        return NULL;
+    }
+
+    FILE *in_file = FIO_OpenFile(filename, O_RDONLY | O_SYNC);
+    free(filename);
+
+    if(!in_file)
+    {
+        return NULL;
+    }
+
+    mlv_index_t *index = mlv_index_create();
+
+    if(!index)
+    {
+        FIO_CloseFile(in_file);
+        return NULL;
+    }
+
+    int64_t position = 0;
+    while(1)
+    {
+        mlv_hdr_t buf;
+
+        FIO_SeekSkipFile(in_file, position, SEEK_SET);
+        if(FIO_ReadFile(in_file, &buf, sizeof(mlv_hdr_t)) != sizeof(mlv_hdr_t) || buf.blockSize < sizeof(mlv_hdr_t))
+        {
+            break;
+        }
+        FIO_SeekSkipFile(in_file, position, SEEK_SET);
+
+        if(!memcmp(buf.blockType, "MLVI", 4))
+        {
+            uint32_t hdr_size = MIN(sizeof(mlv_file_hdr_t), buf.blockSize);
+
+            if(FIO_ReadFile(in_file, &index->file_hdr, hdr_size) != (int32_t)hdr_size)
+            {
+                break;
+            }
+        }
+        else if(!memcmp(buf.blockType, "MIDX", 4) && buf.blockSize >= sizeof(mlv_midx_hdr_t))
+        {
+            mlv_midx_hdr_t *hdr = fio_malloc(buf.blockSize);
+
+            if(hdr && FIO_ReadFile(in_file, hdr, buf.blockSize) == (int32_t)buf.blockSize && mlv_index_use_block(index, hdr))
+            {
+                break;
+            }
+
+            /* will be rebuilt */
+            if(hdr)
+            {
+                fio_free(hdr);
+            }
+            index->chunk_count = 0;
+            break;
+        }
+
+        position += buf.blockSize;
+    }
+
+    FIO_CloseFile(in_file);
+
+    return index;
+}
+
+/* writes 'size' bytes and returns non-zero on error */
+static int mlv_index_write(FILE *out_file, void *data, uint32_t size)
+{
+    return size && FIO_WriteFile(out_file, data, size) != (int32_t)size;
+}
+
+int mlv_index_save(mlv_index_t *index, char *mlv_filename)
+{
+    int ret = mlv_index_finalize(index);
+
+    if(ret)
+    {
+        return ret;
+    }
+
+    char *filename = mlv_index_filename(mlv_filename);
+
+    if(!filename)
+    {
+        return MLV_INDEX_ERR_MEM;
+    }
+
+    FILE *out_file = FIO_CreateFile(filename);
+    free(filename);
+
+    if(!out_file)
+    {
+        return MLV_INDEX_ERR_WRITE;
+    }
+
+    /* first write MLVI header */
+    mlv_file_hdr_t file_hdr = index->file_hdr;
+
+    memcpy(file_hdr.fileMagic, "MLVI", 4);
+    file_hdr.blockSize = sizeof(mlv_file_hdr_t);
+    file_hdr.videoFrameCount = 0;
+    file_hdr.audioFrameCount = 0;
+    file_hdr.fileNum = index->chunk_count + 1;
+
+    /* then the XREF block for all readers that do not know MIDX */
+    mlv_xref_hdr_t xref_hdr;
+
+    memset(&xref_hdr, 0x00, sizeof(mlv_xref_hdr_t));
+    memcpy(xref_hdr.blockType, "XREF", 4);
+    xref_hdr.blockSize = sizeof(mlv_xref_hdr_t) + index->entry_count * sizeof(mlv_xref_t);
+    xref_hdr.entryCount = index->entry_count;
+
+    if(mlv_index_write(out_file, &file_hdr, sizeof(mlv_file_hdr_t)) || mlv_index_write(out_file, &xref_hdr, sizeof(mlv_xref_hdr_t)))
+    {
+        FIO_CloseFile(out_file);
+        return MLV_INDEX_ERR_WRITE;
+    }
+
+    /* convert the entries in small batches */
+    uint32_t batch_size = 256;
+    mlv_xref_t *batch = malloc(batch_size * sizeof(mlv_xref_t));
+
+    if(!batch)
+    {
+        FIO_CloseFile(out_file);
+        return MLV_INDEX_ERR_MEM;
+    }
+
+    for(uint32_t pos = 0; pos < index->entry_count; pos += batch_size)
+    {
+        uint32_t entries = MIN(batch_size, index->entry_count - pos);
+
+        memset(batch, 0x00, entries * sizeof(mlv_xref_t));
+        for(uint32_t entry = 0; entry < entries; entry++)
+        {
+            batch[entry].frameOffset = index->entries[pos + entry].offset;
+            batch[entry].fileNumber = index->entries[pos + entry].fileNumber;
+            batch[entry].frameType = index->entries[pos + entry].frameType;
+        }
+
+        if(mlv_index_write(out_file, batch, entries * sizeof(mlv_xref_t)))
+        {
+            free(batch);
+            FIO_CloseFile(out_file);
+            return MLV_INDEX_ERR_WRITE;
+        }
+    }
+    free(batch);
+
+    /* and finally the MIDX block with everything needed for random access */
+    mlv_midx_hdr_t midx_hdr;
+
+    memset(&midx_hdr, 0x00, sizeof(mlv_midx_hdr_t));
+    memcpy(midx_hdr.blockType, "MIDX", 4);
+    midx_hdr.version = MLV_INDEX_VERSION;
+    midx_hdr.chunkCount = index->chunk_count;
+    midx_hdr.entryCount = index->entry_count;
+    midx_hdr.frameCount = index->frame_count;
+    midx_hdr.bucketCount = index->bucket_count;
+    midx_hdr.bucketDuration = index->bucket_duration;
+    midx_hdr.blockSize = sizeof(mlv_midx_hdr_t) +
+                         index->chunk_count * sizeof(uint64_t) +
+                         index->entry_count * sizeof(mlv_index_entry_t) +
+                         index->frame_count * sizeof(uint32_t) +
+                         index->bucket_count * sizeof(uint32_t);
+
+    if(mlv_index_write(out_file, &midx_hdr, sizeof(mlv_midx_hdr_t)) ||
+       mlv_index_write(out_file, index->chunk_size, index->chunk_count * sizeof(uint64_t)) ||
+       mlv_index_write(out_file, index->entries, index->entry_count * sizeof(mlv_index_entry_t)) ||
+       mlv_index_write(out_file, index->frame_table, index->frame_count * sizeof(uint32_t)) ||
+       mlv_index_write(out_file, index->time_table, index->bucket_count * sizeof(uint32_t)))
+    {
+        FIO_CloseFile(out_file);
+        return MLV_INDEX_ERR_WRITE;
+    }
+
+    FIO_CloseFile(out_file);
+
+    return MLV_INDEX_OK;
+}
+
+const mlv_file_hdr_t *mlv_index_file_hdr(mlv_index_t *index)
+{
+    return &index->file_hdr;
+}
+
+uint32_t mlv_index_count(mlv_index_t *index)
+{
+    return index->entry_count;
+}
+
+const mlv_index_entry_t *mlv_index_entry(mlv_index_t *index, uint32_t pos)
+{
+    if(pos >= index->entry_count)
+    {
+        return NULL;
+    }
+
+    return &index->entries[pos];
+}
+
+uint32_t mlv_index_find_frame(mlv_index_t *index, uint32_t frame_number)
+{
+    if(frame_number < index->frame_count)
+    {
+        return index->frame_table[frame_number];
+    }
+
+    if(index->frames_clipped)
+    {
+        for(uint32_t pos = 0; pos < index->entry_count; pos++)
+        {
+            if(index->entries[pos].frameType == MLV_FRAME_VIDF && index->entries[pos].frameNumber == frame_number)
+            {
+                return pos;
+            }
+        }
+    }
+
+    return MLV_INDEX_NONE;
+}
+
+uint32_t mlv_index_find_time(mlv_index_t *index, uint64_t timestamp)
+{
+    if(!index->bucket_count || timestamp <= index->entries[0].timestamp)
+    {
+        return 0;
+    }
+
+    uint64_t bucket = (timestamp - index->entries[0].timestamp) / index->bucket_duration;
+
+    if(bucket >= index->bucket_count)
+    {
+        return index->entry_count;
+    }
+
+    uint32_t pos = index->time_table[bucket];
+
+    while(pos < index->entry_count && index->entries[pos].timestamp < timestamp)
+    {
+        pos++;
+    }
+
+    return pos;
+}
+
+/* sorts the positions of all entries by block type. entries are in timestamp order, so the lists are too */
+static int mlv_index_build_types(mlv_index_t *index)
+{
+    for(uint32_t pos = 0; pos < index->entry_count; pos++)
+    {
+        uint32_t type = 0;
+
+        while(type < index->type_count && memcmp(index->types[type].blockType, index->entries[pos].blockType, 4))
+        {
+            type++;
+        }
+
+        if(type == index->type_count)
+        {
+            struct mlv_index_type *types = realloc(index->types, (index->type_count + 1) * sizeof(struct mlv_index_type));
+
+            if(!types)
+            {
+                mlv_index_free_types(index);
+                return MLV_INDEX_ERR_MEM;
+            }
+            index->types = types;
+            index->type_count++;
+
+            memset(&types[type], 0x00, sizeof(struct mlv_index_type));
+            memcpy(types[type].blockType, index->entries[pos].blockType, 4);
+        }
+        index->types[type].count++;
+    }
+
+    for(uint32_t type = 0; type < index->type_count; type++)
+    {
+        index->types[type].positions = malloc(index->types[type].count * sizeof(uint32_t));
+
+        if(!index->types[type].positions)
+        {
+            mlv_index_free_types(index);
+            return MLV_INDEX_ERR_MEM;
+        }
+        index->types[type].count = 0;
+    }
+
+    for(uint32_t pos = 0; pos < index->entry_count; pos++)
+    {
+        for(uint32_t type = 0; type < index->type_count; type++)
+        {
+            if(!memcmp(index->types[type].blockType, index->entries[pos].blockType, 4))
+            {
+                index->types[type].positions[index->types[type].count++] = pos;
+                break;
+            }
+        }
+    }
+
+    return MLV_INDEX_OK;
+}
+
+uint32_t mlv_index_find_block(mlv_index_t *index, const char *type, uint64_t timestamp)
+{
+    if(!index->finalized)
+    {
+        return MLV_INDEX_NONE;
+    }
+
+    if(!index->types && mlv_index_build_types(index))
+    {
+        return MLV_INDEX_NONE;
+    }
+
+    for(uint32_t type_num = 0; type_num < index->type_count; type_num++)
+    {
+        struct mlv_index_type *list = &index->types[type_num];
+
+        if(memcmp(list->blockType, type, 4))
+        {
+            continue;
+        }
+
+        /* binary search for the first block after 'timestamp', the one before is what we want */
+        uint32_t lo = 0;
+        uint32_t hi = list->count;
+
+        while(lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if(index->entries[list->positions[mid]].timestamp <= timestamp)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        return lo ? list->positions[lo - 1] : MLV_INDEX_NONE;
+    }
+
+    return MLV_INDEX_NONE;
+}
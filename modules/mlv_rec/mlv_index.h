@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _mlv_index_h
+#define _mlv_index_h
+
+#ifdef CONFIG_MAGICLANTERN
+#include <dryos.h>
+#else
+#include <stdio.h>
+#include <stdint.h>
+#endif
+
+#include <raw.h>
+#include "mlv.h"
+
+/*
+  random access index of all blocks in a MLV file and its chunks, shared by mlv_dump and mlv_play.
+
+  the .IDX file keeps the MLVI and XREF blocks it always had, so older readers still work.
+  behind them a MIDX block stores the same entries with timestamps and frame numbers plus the
+  lookup tables, already sorted. loading it is a single read, nothing has to be sorted or rebuilt.
+*/
+
+#define MLV_INDEX_VERSION      1
+
+/* return codes, negative values are errors */
+#define MLV_INDEX_OK           0
+#define MLV_INDEX_UPDATED      1
+#define MLV_INDEX_ERR_READ    -1
+#define MLV_INDEX_ERR_BLOCK   -2
+#define MLV_INDEX_ERR_GUID    -3
+#define MLV_INDEX_ERR_MEM     -4
+#define MLV_INDEX_CANCELLED   -5
+#define MLV_INDEX_ERR_WRITE   -6
+
+#define MLV_INDEX_NONE         0xFFFFFFFF
+
+#pragma pack(push,1)
+
+typedef struct {
+    uint8_t     blockType[4];       /* type of the indexed block, e.g. VIDF, AUDF, EXPO */
+    uint32_t    blockSize;          /* size of the whole block */
+    uint64_t    timestamp;          /* block timestamp, zero for MLVI */
+    uint64_t    offset;             /* position of the block within its chunk */
+    uint16_t    fileNumber;         /* chunk number: 0 = .MLV, 1 = .M00, 2 = .M01, ... */
+    uint16_t    frameType;          /* MLV_FRAME_VIDF, MLV_FRAME_AUDF or MLV_FRAME_UNSPECIFIED */
+    uint32_t    frameNumber;        /* frame number of VIDF and AUDF blocks, zero otherwise */
+}  mlv_index_entry_t;
+
+typedef struct {
+    uint8_t     blockType[4];       /* MIDX: extended index, only found in .IDX files */
+    uint32_t    blockSize;          /* total size including all tables */
+    uint64_t    timestamp;
+    uint32_t    version;            /* MLV_INDEX_VERSION */
+    uint32_t    chunkCount;         /* number of chunk sizes that follow */
+    uint32_t    entryCount;         /* number of entries, sorted by timestamp */
+    uint32_t    frameCount;         /* size of the frame table, highest indexed VIDF frame number + 1 */
+    uint32_t    bucketCount;        /* size of the time table */
+    uint64_t    bucketDuration;     /* timestamp range covered by each time table bucket */
+ /* uint64_t    chunkSize[chunkCount]; */             /* bytes of each chunk that were indexed, used for incremental updates */
+ /* mlv_index_entry_t entries[entryCount]; */
+ /* uint32_t    frameTable[frameCount]; */            /* VIDF frame number -> entry, MLV_INDEX_NONE if missing */
+ /* uint32_t    timeTable[bucketCount]; */            /* first entry at or after the bucket start time */
+}  mlv_midx_hdr_t;
+
+#pragma pack(pop)
+
+typedef struct mlv_index mlv_index_t;
+
+/* called while scanning chunks. returning non-zero cancels the scan */
+typedef int (*mlv_index_progress_t)(uint32_t chunk, uint32_t chunk_count, uint32_t pct);
+
+/* empty index, to be filled with mlv_index_add() or mlv_index_update() */
+mlv_index_t *mlv_index_create();
+
+/* load the .IDX file that belongs to the given .MLV file. returns NULL if there is none.
+   .IDX files without MIDX block result in an empty index that mlv_index_update() will fill */
+mlv_index_t *mlv_index_load(char *mlv_filename);
+
+/* write the .IDX file. returns MLV_INDEX_OK or one of the negative error codes */
+int mlv_index_save(mlv_index_t *index, char *mlv_filename);
+
+/* scan everything that was appended to the chunks since the index was built, or all of them if
+   the index does not match the files anymore. returns MLV_INDEX_OK if nothing changed,
+   MLV_INDEX_UPDATED if the index has to be saved again or one of the negative error codes */
+int mlv_index_update(mlv_index_t *index, FILE **chunk_files, uint32_t chunk_count, mlv_index_progress_t progress);
+
+/* add a block that was read at 'offset' of chunk 'file_number'. NULL and BKUP blocks are not indexed.
+   VIDF and AUDF blocks must be passed with their frame number, everything else only needs its header */
+void mlv_index_add(mlv_index_t *index, const mlv_hdr_t *block, uint16_t file_number, uint64_t offset);
+
+/* sort added blocks and build the lookup tables. required after mlv_index_add() */
+int mlv_index_finalize(mlv_index_t *index);
+
+void mlv_index_free(mlv_index_t *index);
+
+/* main header of the indexed file */
+const mlv_file_hdr_t *mlv_index_file_hdr(mlv_index_t *index);
+
+/* entries in playback (timestamp) order */
+uint32_t mlv_index_count(mlv_index_t *index);
+const mlv_index_entry_t *mlv_index_entry(mlv_index_t *index, uint32_t pos);
+
+/* position of the VIDF block with the given frame number, MLV_INDEX_NONE if not indexed */
+uint32_t mlv_index_find_frame(mlv_index_t *index, uint32_t frame_number);
+
+/* position of the first block with a timestamp at or after 'timestamp', mlv_index_count() if none */
+uint32_t mlv_index_find_time(mlv_index_t *index, uint64_t timestamp);
+
+/* position of the last block of the given type (e.g. "AUDF", "EXPO") at or before 'timestamp', MLV_INDEX_NONE if there is none */
+uint32_t mlv_index_find_block(mlv_index_t *index, const char *type, uint64_t timestamp);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/* fileno() and posix_madvise() with -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mlv_reader.h"
+
+struct mlv_chunk_map
+{
+    const uint8_t *data;
+    uint64_t size;
+#if defined(__WIN32)
+    HANDLE mapping;
+#endif
+};
+
+struct mlv_reader
+{
+    struct mlv_chunk_map *chunks;
+    int chunk_count;
+    int reserved;   /* padding */
+};
+
+static int mlv_reader_map_file(FILE *file, struct mlv_chunk_map *chunk)
+{
+#if defined(__WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(fileno(file));
+    LARGE_INTEGER size;
+
+    if(handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size))
+    {
+        return 0;
+    }
+
+    chunk->size = size.QuadPart;
+
+    /* empty files cannot be mapped, but are valid chunks */
+    if(!chunk->size)
+    {
+        return 1;
+    }
+
+    /* a view must fit into the address space */
+    if(chunk->size > (uint64_t)(SIZE_MAX))
+    {
+        return 0;
+    }
+
+    chunk->mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!chunk->mapping)
+    {
+        return 0;
+    }
+
+    chunk->data = MapViewOfFile(chunk->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!chunk->data)
+    {
+        CloseHandle(chunk->mapping);
+        chunk->mapping = NULL;
+        return 0;
+    }
+#else
+    struct stat info;
+
+    if(fstat(fileno(file), &info))
+    {
+        return 0;
+    }
+
+    chunk->size = info.st_size;
+
+    if(!chunk->size)
+    {
+        return 1;
+    }
+
+    if(chunk->size > (uint64_t)(SIZE_MAX))
+    {
+        return 0;
+    }
+
+    void *data = mmap(NULL, chunk->size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if(data == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    /* blocks are mostly walked from start to end */
+    posix_madvise(data, chunk->size, POSIX_MADV_SEQUENTIAL);
+    chunk->data = data;
+#endif
+
+    return 1;
+}
+
+static void mlv_reader_unmap_file(struct mlv_chunk_map *chunk)
+{
+    if(!chunk->data)
+    {
+        return;
+    }
+
+#if defined(__WIN32)
+    UnmapViewOfFile(chunk->data);
+    CloseHandle(chunk->mapping);
+#else
+    munmap((void *)chunk->data, chunk->size);
+#endif
+    chunk->data = NULL;
+}
+
+mlv_reader_t *mlv_reader_open(FILE **files, int file_count)
+{
+    mlv_reader_t *reader = calloc(1, sizeof(mlv_reader_t));
+
+    if(!reader)
+    {
+        return NULL;
+    }
+
+    reader->chunks = calloc(file_count, sizeof(struct mlv_chunk_map));
+    if(!reader->chunks)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    for(int pos = 0; pos < file_count; pos++)
+    {
+        if(!mlv_reader_map_file(files[pos], &reader->chunks[pos]))
+        {
+            mlv_reader_close(reader);
+            return NULL;
+        }
+        reader->chunk_count++;
+    }
+
+    return reader;
+}
+
+void mlv_reader_close(mlv_reader_t *reader)
+{
+    if(!reader)
+    {
+        return;
+    }
+
+    for(int pos = 0; pos < reader->chunk_count; pos++)
+    {
+        mlv_reader_unmap_file(&reader->chunks[pos]);
+    }
+
+    free(reader->chunks);
+    free(reader);
+}
+
+uint64_t mlv_reader_size(mlv_reader_t *reader, int chunk)
+{
+    if(chunk < 0 || chunk >= reader->chunk_count)
+    {
+        return 0;
+    }
+
+    return reader->chunks[chunk].size;
+}
+
+const void *mlv_reader_get(mlv_reader_t *reader, int chunk, uint64_t offset, uint64_t size)
+{
+    uint64_t chunk_size = mlv_reader_size(reader, chunk);
+
+    /* written that way to not overflow with bogus offsets or sizes */
+    if(offset > chunk_size || size > chunk_size - offset)
+    {
+        return NULL;
+    }
+
+    return &reader->chunks[chunk].data[offset];
+}
+
+const mlv_hdr_t *mlv_reader_get_block(mlv_reader_t *reader, int chunk, uint64_t offset)
+{
+    const mlv_hdr_t *hdr = mlv_reader_get(reader, chunk, offset, sizeof(mlv_hdr_t));
+
+    if(!hdr || hdr->blockSize < sizeof(mlv_hdr_t))
+    {
+        return NULL;
+    }
+
+    return mlv_reader_get(reader, chunk, offset, hdr->blockSize);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _mlv_reader_h
+#define _mlv_reader_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <raw.h>
+#include "mlv.h"
+
+/* read-only memory mapping of all chunks of a MLV file (.MLV, .M00, .M01, ...).
+   blocks are accessed through pointers into the mapping, so walking blocks and
+   reading frame payloads does not need any buffer allocation or copying. */
+typedef struct mlv_reader mlv_reader_t;
+
+/* map the already opened chunk files, e.g. from load_all_chunks(). chunk numbers are the array indices.
+   returns NULL if any of the files cannot be mapped (e.g. address space exhausted on 32 bit hosts) */
+mlv_reader_t *mlv_reader_open(FILE **files, int file_count);
+
+/* unmap all chunks. pointers handed out before are invalid afterwards */
+void mlv_reader_close(mlv_reader_t *reader);
+
+/* size of the given chunk in bytes, 0 if it does not exist */
+uint64_t mlv_reader_size(mlv_reader_t *reader, int chunk);
+
+/* pointer to 'size' bytes at 'offset' of the given chunk, NULL if that range is not within the file */
+const void *mlv_reader_get(mlv_reader_t *reader, int chunk, uint64_t offset, uint64_t size);
+
+/* pointer to the block header at 'offset', NULL if there is no complete block at this position */
+const mlv_hdr_t *mlv_reader_get_block(mlv_reader_t *reader, int chunk, uint64_t offset);
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  synthetic MLV writer for the mlv_dump benchmark and regression suite (mlv_bench.sh).
+
+  writes an uncompressed raw MLV with the usual metadata blocks (RAWI, IDNT, WBAL, EXPO, RTCI),
+  optionally a 48kHz stereo WAVI/AUDF track and split into .M00, .M01 ... chunks like mlv_rec does.
+  the frames are RGGB gradients that move a little from frame to frame, with noise and a few hot
+  pixels on fixed positions. everything comes from a fixed seed, so the same parameters always
+  give the same files on every host. LJ92 and LZMA clips are made from these with mlv_dump.
+
+  mlv_synth [-s WxH] [-b bpp] [-n frames] [-k frames per chunk] [-a] [-m camera model] [-r WxH] <out.mlv>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../../src/raw.h"
+#include "mlv.h"
+#include "raw_proc/bitpack.h"
+
+#define SYNTH_BLACK         2048
+#define SYNTH_WHITE         15000
+#define SYNTH_FPS           25000
+#define SYNTH_RATE          48000
+#define SYNTH_GUID          0x4D4C5653594E5448ULL
+#define SYNTH_PI            3.14159265358979323846
+
+/* small xorshift generator, rand() differs between C libraries */
+static uint32_t synth_seed = 2463534242U;
+
+static uint32_t synth_rand()
+{
+    synth_seed ^= synth_seed << 13;
+    synth_seed ^= synth_seed >> 17;
+    synth_seed ^= synth_seed << 5;
+    return synth_seed;
+}
+
+static void synth_block(void *block, const char *type, uint32_t size, uint64_t timestamp)
+{
+    mlv_hdr_t *hdr = (mlv_hdr_t *)block;
+
+    memset(block, 0, size);
+    memcpy(hdr->blockType, type, 4);
+    hdr->blockSize = size;
+    hdr->timestamp = timestamp;
+}
+
+static int synth_write(FILE *out, const void *data, size_t size)
+{
+    return fwrite(data, size, 1, out) != 1;
+}
+
+/* 14 bit RGGB frame, scaled down to 'bpp' and packed like the camera does */
+static void synth_frame(uint16_t *line, uint16_t *packed, int width, int height, int bpp, int frame)
+{
+    int shift = 14 - bpp;
+
+    for(int y = 0; y < height; y++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            int color = (y & 1) + (x & 1);
+            int pos_x = (x + frame * 4) % width;
+            int pos_y = (y + frame * 2) % height;
+            int level = color == 0 ? pos_x * 9000 / width : color == 2 ? pos_y * 9000 / height : (pos_x + pos_y) * 5000 / (width + height) + 1500;
+            int noise = (int)(synth_rand() % 129) - 64;
+            int value = SYNTH_BLACK + 64 + level + noise;
+
+            /* hot pixels, always at the same positions so the bad pixel detection finds them */
+            if(((x * 7919 + y * 104729) % 9973) == 0)
+            {
+                value = SYNTH_WHITE - 100;
+            }
+
+            line[x + y * width] = (uint16_t)((value < 0 ? 0 : value > SYNTH_WHITE ? SYNTH_WHITE : value) >> shift);
+        }
+    }
+
+    bitpack_pack(line, packed, width * height, bpp);
+}
+
+static void synth_audio(int16_t *samples, int count, int first)
+{
+    for(int pos = 0; pos < count; pos++)
+    {
+        double phase = (double)(first + pos) * 2.0 * SYNTH_PI / SYNTH_RATE;
+        int noise = (int)(synth_rand() % 257) - 128;
+
+        samples[2 * pos + 0] = (int16_t)(6000.0 * sin(phase * 440.0) + noise);
+        samples[2 * pos + 1] = (int16_t)(6000.0 * sin(phase * 660.0) - noise);
+    }
+}
+
+static FILE *synth_open_chunk(const char *filename, int chunk)
+{
+    char *name = malloc(strlen(filename) + 1);
+
+    strcpy(name, filename);
+    if(chunk > 0)
+    {
+        /* out.MLV -> out.M00, out.M01 ... */
+        sprintf(&name[strlen(name) - 2], "%02d", chunk - 1);
+    }
+
+    FILE *out = fopen(name, "wb");
+    if(!out)
+    {
+        fprintf(stderr, "Failed to open '%s'\n", name);
+    }
+
+    free(name);
+    return out;
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 640;
+    int height = 360;
+    int raw_width = 0;
+    int raw_height = 0;
+    int bpp = 14;
+    int frames = 24;
+    int chunk_frames = 0;
+    int audio = 0;
+    uint32_t model = 0x80000285;
+    const char *filename = NULL;
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-s") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &width, &height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[pos], "-r") && pos + 1 < argc)
+        {
+            if(sscanf(argv[++pos], "%dx%d", &raw_width, &raw_height) != 2)
+            {
+                fprintf(stderr, "Invalid size '%s'\n", argv[pos]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[pos], "-b") && pos + 1 < argc)
+        {
+            bpp = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-n") && pos + 1 < argc)
+        {
+            frames = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-k") && pos + 1 < argc)
+        {
+            chunk_frames = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-m") && pos + 1 < argc)
+        {
+            model = (uint32_t)strtoul(argv[++pos], NULL, 16);
+        }
+        else if(!strcmp(argv[pos], "-a"))
+        {
+            audio = 1;
+        }
+        else if(argv[pos][0] != '-' && !filename)
+        {
+            filename = argv[pos];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s WxH] [-b bpp] [-n frames] [-k frames per chunk] [-a] [-m camera model] [-r WxH] <out.mlv>\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(!raw_width)
+    {
+        raw_width = width;
+        raw_height = height;
+    }
+
+    /* whole 32 bit words per frame, no frameSpace padding needed */
+    if(!filename || strlen(filename) < 3 || (bpp != 10 && bpp != 12 && bpp != 14) || frames < 1 || chunk_frames < 0 ||
+       width < 16 || height < 16 || width % 8 || height % 2 || raw_width < width || raw_height < height)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    int shift = 14 - bpp;
+    int chunks = chunk_frames ? (frames + chunk_frames - 1) / chunk_frames : 1;
+    uint32_t frame_size = width * height * bpp / 8;
+    int audio_samples = SYNTH_RATE * 1000 / SYNTH_FPS;
+    uint32_t audio_size = audio_samples * 2 * sizeof(int16_t);
+    uint16_t *line = malloc(width * height * sizeof(uint16_t));
+    uint8_t *vidf = malloc(sizeof(mlv_vidf_hdr_t) + frame_size);
+    uint8_t *audf = malloc(sizeof(mlv_audf_hdr_t) + audio_size);
+
+    if(!line || !vidf || !audf)
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        return 1;
+    }
+
+    if(chunks > 100)
+    {
+        fprintf(stderr, "Too many chunks\n");
+        return 1;
+    }
+
+    mlv_file_hdr_t file_hdr;
+    memset(&file_hdr, 0, sizeof(file_hdr));
+    memcpy(file_hdr.fileMagic, "MLVI", 4);
+    file_hdr.blockSize = sizeof(mlv_file_hdr_t);
+    memcpy(file_hdr.versionString, MLV_VERSION_STRING, strlen(MLV_VERSION_STRING));
+    file_hdr.fileGuid = SYNTH_GUID;
+    file_hdr.fileCount = chunks;
+    file_hdr.videoClass = MLV_VIDEO_CLASS_RAW;
+    file_hdr.audioClass = audio ? 1 : 0;
+    file_hdr.sourceFpsNom = SYNTH_FPS;
+    file_hdr.sourceFpsDenom = 1000;
+
+    mlv_rawi_hdr_t rawi;
+    synth_block(&rawi, "RAWI", sizeof(rawi), 1);
+    rawi.xRes = width;
+    rawi.yRes = height;
+    rawi.raw_info.api_version = 1;
+    rawi.raw_info.width = raw_width;
+    rawi.raw_info.height = raw_height;
+    rawi.raw_info.pitch = raw_width * bpp / 8;
+    rawi.raw_info.frame_size = raw_width * raw_height * bpp / 8;
+    rawi.raw_info.bits_per_pixel = bpp;
+    rawi.raw_info.black_level = SYNTH_BLACK >> shift;
+    rawi.raw_info.white_level = SYNTH_WHITE >> shift;
+    rawi.raw_info.jpeg.width = raw_width;
+    rawi.raw_info.jpeg.height = raw_height;
+    rawi.raw_info.active_area.y2 = raw_height;
+    rawi.raw_info.active_area.x2 = raw_width;
+    rawi.raw_info.cfa_pattern = 0x02010100;
+    rawi.raw_info.calibration_illuminant1 = 1;
+    rawi.raw_info.dynamic_range = 1100;
+    for(int pos = 0; pos < 18; pos += 2)
+    {
+        /* identity color matrix */
+        rawi.raw_info.color_matrix1[pos] = (pos == 0 || pos == 8 || pos == 16) ? 10000 : 0;
+        rawi.raw_info.color_matrix1[pos + 1] = 10000;
+    }
+
+    mlv_idnt_hdr_t idnt;
+    synth_block(&idnt, "IDNT", sizeof(idnt), 2);
+    strcpy((char *)idnt.cameraName, "Synthetic");
+    strcpy((char *)idnt.cameraSerial, "0123456789");
+    idnt.cameraModel = model;
+
+    mlv_wbal_hdr_t wbal;
+    synth_block(&wbal, "WBAL", sizeof(wbal), 3);
+    wbal.wb_mode = 9;
+    wbal.kelvin = 5500;
+    wbal.wbgain_r = wbal.wbgain_g = wbal.wbgain_b = 1024;
+
+    mlv_expo_hdr_t expo;
+    synth_block(&expo, "EXPO", sizeof(expo), 4);
+    expo.isoValue = expo.isoAnalog = 100;
+    expo.shutterValue = 20000;
+
+    mlv_rtci_hdr_t rtci;
+    synth_block(&rtci, "RTCI", sizeof(rtci), 5);
+    rtci.tm_sec = 30;
+    rtci.tm_min = 15;
+    rtci.tm_hour = 12;
+    rtci.tm_mday = 1;
+    rtci.tm_mon = 5;
+    rtci.tm_year = 114;
+
+    mlv_wavi_hdr_t wavi;
+    synth_block(&wavi, "WAVI", sizeof(wavi), 6);
+    wavi.format = 1;
+    wavi.channels = 2;
+    wavi.samplingRate = SYNTH_RATE;
+    wavi.bytesPerSecond = SYNTH_RATE * 2 * sizeof(int16_t);
+    wavi.blockAlign = 2 * sizeof(int16_t);
+    wavi.bitsPerSample = 16;
+
+    for(int chunk = 0; chunk < chunks; chunk++)
+    {
+        int first = chunk * chunk_frames;
+        int last = chunk_frames ? first + chunk_frames : frames;
+        if(last > frames)
+        {
+            last = frames;
+        }
+
+        FILE *out = synth_open_chunk(filename, chunk);
+        if(!out)
+        {
+            return 1;
+        }
+
+        file_hdr.fileNum = chunk;
+        file_hdr.videoFrameCount = last - first;
+        file_hdr.audioFrameCount = audio ? last - first : 0;
+
+        int failed = synth_write(out, &file_hdr, sizeof(file_hdr));
+
+        /* metadata only in the first chunk, like mlv_rec */
+        if(chunk == 0)
+        {
+            failed |= synth_write(out, &rawi, sizeof(rawi));
+            failed |= synth_write(out, &idnt, sizeof(idnt));
+            failed |= synth_write(out, &wbal, sizeof(wbal));
+            failed |= synth_write(out, &expo, sizeof(expo));
+            failed |= synth_write(out, &rtci, sizeof(rtci));
+            if(audio)
+            {
+                failed |= synth_write(out, &wavi, sizeof(wavi));
+            }
+        }
+
+        for(int frame = first; frame < last && !failed; frame++)
+        {
+            uint64_t timestamp = 1000 + (uint64_t)frame * 1000000000 / SYNTH_FPS;
+            mlv_vidf_hdr_t *vidf_hdr = (mlv_vidf_hdr_t *)vidf;
+
+            synth_block(vidf_hdr, "VIDF", sizeof(mlv_vidf_hdr_t) + frame_size, timestamp);
+            vidf_hdr->frameNumber = frame;
+            synth_frame(line, (uint16_t *)&vidf[sizeof(mlv_vidf_hdr_t)], width, height, bpp, frame);
+            failed |= synth_write(out, vidf, sizeof(mlv_vidf_hdr_t) + frame_size);
+
+            if(audio)
+            {
+                mlv_audf_hdr_t *audf_hdr = (mlv_audf_hdr_t *)audf;
+
+                synth_block(audf_hdr, "AUDF", sizeof(mlv_audf_hdr_t) + audio_size, timestamp + 10);
+                audf_hdr->frameNumber = frame;
+                synth_audio((int16_t *)&audf[sizeof(mlv_audf_hdr_t)], audio_samples, frame * audio_samples);
+                failed |= synth_write(out, audf, sizeof(mlv_audf_hdr_t) + audio_size);
+            }
+        }
+
+        fclose(out);
+
+        if(failed)
+        {
+            fprintf(stderr, "Failed to write '%s'\n", filename);
+            return 1;
+        }
+    }
+
+    free(line);
+    free(vidf);
+    free(audf);
+
+    return 0;
+}
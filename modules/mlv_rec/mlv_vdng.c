@@ -0,0 +1,1113 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "../../src/raw.h"
+#include "mlv.h"
+#include "mlv_reader.h"
+#include "mlv_index.h"
+#include "mlv_vdng.h"
+#include "thread_pool.h"
+#include "lj92.h"
+#include "lzma_frame.h"
+#include "interframe.h"
+#include "dng/dng.h"
+#include "raw_proc/bitpack.h"
+#include "raw_proc/pixel_proc.h"
+#include "raw_proc/stripes.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+/* metadata blocks looked up for every frame, in the order of vdng_frame.meta */
+static const char *vdng_meta_types[] = { "EXPO", "LENS", "WBAL", "RTCI", "INFO" };
+#define VDNG_META_EXPO   0
+#define VDNG_META_LENS   1
+#define VDNG_META_WBAL   2
+#define VDNG_META_RTCI   3
+#define VDNG_META_INFO   4
+#define VDNG_META_COUNT  5
+
+enum vdng_slot_state
+{
+    SLOT_EMPTY = 0,
+    SLOT_BUSY,
+    SLOT_READY,
+};
+
+/* one processed DNG in the cache */
+struct vdng_slot
+{
+    uint32_t pos;
+    enum vdng_slot_state state;
+    uint64_t last_used;
+    uint8_t *data;
+};
+
+struct vdng_frame
+{
+    uint32_t entry;                     /* index entry of the VIDF block */
+    uint32_t meta[VDNG_META_COUNT];     /* index entries of the metadata blocks before it, MLV_INDEX_NONE if missing */
+    uint32_t header_size;               /* depends on the strings in the header, e.g. the INFO block */
+    uint32_t file_size;
+};
+
+/* buffers for rendering one frame, owned by one thread at a time */
+struct vdng_context
+{
+    struct vdng_context *next;
+    struct dng_data dng;
+    uint8_t *frame;                     /* packed frame, for compressed and 16 bit frames */
+    uint16_t *unpacked;                 /* decoder output before packing */
+    inter_ref_t ref;                    /* last keyframe of predicted frames */
+    char info[1024];
+};
+
+/* read ahead job, handed to the thread pool */
+struct vdng_job
+{
+    pool_job_t job;
+    vdng_clip_t *clip;
+    uint32_t pos;
+    int slot;
+    int active;
+    int reserved;       /* padding */
+};
+
+struct vdng_clip
+{
+    char *filename;
+    char *name;
+    struct vdng_options options;
+
+    FILE **files;
+    mlv_reader_t *reader;
+    mlv_index_t *index;
+
+    /* everything but the per frame blocks, copied for every frame */
+    struct frame_info info;
+    struct vdng_frame *frames;
+    size_t max_file_size;
+    uint32_t frame_count;
+    int frame_size;
+    int file_count;
+    int has_audio;
+
+    /* protects everything below */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct vdng_slot *slots;
+    struct vdng_context *contexts;
+    uint64_t use_count;
+
+    thread_pool_t *pool;
+    struct vdng_job *jobs;
+
+    uint32_t last_pos;
+    uint32_t reserved;  /* padding */
+};
+
+/*
+  the focus and bad pixel maps and the vertical stripes correction in raw_proc are global and get
+  set up by the first processed frame. only frames of one clip may be processed at the same time,
+  and the first one of each clip runs alone, so the maps are complete before the others use them.
+*/
+static pthread_mutex_t vdng_proc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vdng_proc_cond = PTHREAD_COND_INITIALIZER;
+static vdng_clip_t *vdng_proc_clip = NULL;
+static int vdng_proc_ready = 0;
+static int vdng_proc_active = 0;
+
+void vdng_default_options(struct vdng_options *options)
+{
+    memset(options, 0, sizeof(struct vdng_options));
+
+    options->vertical_stripes = 1;
+    options->focus_pixels = 1;
+    options->bad_pixels = 1;
+    options->cache_frames = 16;
+    options->read_ahead = 4;
+}
+
+static char *vdng_strdup(const char *str)
+{
+    char *copy = malloc(strlen(str) + 1);
+
+    if(copy)
+    {
+        strcpy(copy, str);
+    }
+    return copy;
+}
+
+/* the .MLV and its .M00, .M01, ... chunks */
+static int vdng_open_chunks(vdng_clip_t *clip)
+{
+    size_t name_len = strlen(clip->filename);
+    char *chunk_name = vdng_strdup(clip->filename);
+
+    clip->files = calloc(100, sizeof(FILE *));
+    if(!chunk_name || !clip->files)
+    {
+        free(chunk_name);
+        return 0;
+    }
+
+    clip->files[0] = fopen(clip->filename, "rb");
+    if(!clip->files[0])
+    {
+        free(chunk_name);
+        return 0;
+    }
+    clip->file_count = 1;
+
+    int is_mlv = name_len > 4 && !strcasecmp(&chunk_name[name_len - 4], ".mlv");
+
+    for(int seq_number = 0; is_mlv && seq_number < 99; seq_number++)
+    {
+        sprintf(&chunk_name[name_len - 2], "%02d", seq_number);
+
+        clip->files[clip->file_count] = fopen(chunk_name, "rb");
+        if(!clip->files[clip->file_count])
+        {
+            break;
+        }
+        clip->file_count++;
+    }
+
+    free(chunk_name);
+    return 1;
+}
+
+static int vdng_frame_compare(const void *a, const void *b)
+{
+    const uint32_t *frame_a = a;
+    const uint32_t *frame_b = b;
+
+    /* frame number first, then the position in the index, so duplicates keep their order */
+    if(frame_a[0] != frame_b[0])
+    {
+        return (frame_a[0] > frame_b[0]) ? 1 : -1;
+    }
+    return (frame_a[1] > frame_b[1]) - (frame_a[1] < frame_b[1]);
+}
+
+/* sorted VIDF blocks with their metadata, duplicate frame numbers only get their first block */
+static int vdng_build_frames(vdng_clip_t *clip)
+{
+    uint32_t entries = mlv_index_count(clip->index);
+    uint32_t *sorted = malloc(entries * 2 * sizeof(uint32_t) + 1);
+    uint32_t count = 0;
+
+    if(!sorted)
+    {
+        return 0;
+    }
+
+    for(uint32_t pos = 0; pos < entries; pos++)
+    {
+        const mlv_index_entry_t *entry = mlv_index_entry(clip->index, pos);
+
+        if(!memcmp(entry->blockType, "VIDF", 4))
+        {
+            sorted[count * 2 + 0] = entry->frameNumber;
+            sorted[count * 2 + 1] = pos;
+            count++;
+        }
+    }
+
+    qsort(sorted, count, 2 * sizeof(uint32_t), &vdng_frame_compare);
+
+    clip->frames = calloc(count + 1, sizeof(struct vdng_frame));
+    if(!clip->frames)
+    {
+        free(sorted);
+        return 0;
+    }
+
+    for(uint32_t pos = 0; pos < count; pos++)
+    {
+        if(clip->frame_count && sorted[pos * 2] == sorted[(pos - 1) * 2])
+        {
+            continue;
+        }
+
+        struct vdng_frame *frame = &clip->frames[clip->frame_count++];
+        uint64_t timestamp = mlv_index_entry(clip->index, sorted[pos * 2 + 1])->timestamp;
+
+        frame->entry = sorted[pos * 2 + 1];
+        for(int type = 0; type < VDNG_META_COUNT; type++)
+        {
+            frame->meta[type] = mlv_index_find_block(clip->index, vdng_meta_types[type], timestamp);
+        }
+    }
+
+    free(sorted);
+    return clip->frame_count > 0;
+}
+
+/* copy a block into a header struct, zeroed if there is none */
+static void vdng_copy_block(vdng_clip_t *clip, uint32_t entry_pos, void *dst, size_t size)
+{
+    memset(dst, 0, size);
+
+    if(entry_pos == MLV_INDEX_NONE)
+    {
+        return;
+    }
+
+    const mlv_index_entry_t *entry = mlv_index_entry(clip->index, entry_pos);
+    const mlv_hdr_t *block = mlv_reader_get_block(clip->reader, entry->fileNumber, entry->offset);
+
+    if(block)
+    {
+        memcpy(dst, block, MIN(block->blockSize, size));
+    }
+}
+
+/* clip wide blocks, the ones before the first frame or else the last one of the clip */
+static void vdng_copy_clip_block(vdng_clip_t *clip, const char *type, void *dst, size_t size)
+{
+    uint64_t timestamp = mlv_index_entry(clip->index, clip->frames[0].entry)->timestamp;
+    uint32_t entry_pos = mlv_index_find_block(clip->index, type, timestamp);
+
+    if(entry_pos == MLV_INDEX_NONE)
+    {
+        entry_pos = mlv_index_find_block(clip->index, type, UINT64_MAX);
+    }
+
+    vdng_copy_block(clip, entry_pos, dst, size);
+}
+
+static const mlv_vidf_hdr_t *vdng_get_vidf(vdng_clip_t *clip, uint32_t pos, const uint8_t **payload, uint32_t *payload_size)
+{
+    const mlv_index_entry_t *entry = mlv_index_entry(clip->index, clip->frames[pos].entry);
+    const mlv_vidf_hdr_t *vidf = (const mlv_vidf_hdr_t *)mlv_reader_get_block(clip->reader, entry->fileNumber, entry->offset);
+
+    if(!vidf || vidf->blockSize < sizeof(mlv_vidf_hdr_t) || vidf->frameSpace > vidf->blockSize - sizeof(mlv_vidf_hdr_t))
+    {
+        return NULL;
+    }
+
+    *payload = (const uint8_t *)vidf + sizeof(mlv_vidf_hdr_t) + vidf->frameSpace;
+    *payload_size = vidf->blockSize - sizeof(mlv_vidf_hdr_t) - vidf->frameSpace;
+    return vidf;
+}
+
+/* the frame_info of one frame, what mlv_dump would have seen when reaching its VIDF block */
+static int vdng_frame_info(vdng_clip_t *clip, struct vdng_context *context, uint32_t pos, struct frame_info *frame_info)
+{
+    const struct vdng_frame *frame = &clip->frames[pos];
+    const uint8_t *payload = NULL;
+    uint32_t payload_size = 0;
+    const mlv_vidf_hdr_t *vidf = vdng_get_vidf(clip, pos, &payload, &payload_size);
+
+    if(!vidf)
+    {
+        return 0;
+    }
+
+    *frame_info = clip->info;
+    frame_info->vidf_hdr = *vidf;
+
+    vdng_copy_block(clip, frame->meta[VDNG_META_EXPO], &frame_info->expo_hdr, sizeof(mlv_expo_hdr_t));
+    vdng_copy_block(clip, frame->meta[VDNG_META_LENS], &frame_info->lens_hdr, sizeof(mlv_lens_hdr_t));
+    vdng_copy_block(clip, frame->meta[VDNG_META_WBAL], &frame_info->wbal_hdr, sizeof(mlv_wbal_hdr_t));
+    vdng_copy_block(clip, frame->meta[VDNG_META_RTCI], &frame_info->rtci_hdr, sizeof(mlv_rtci_hdr_t));
+
+    context->info[0] = '\000';
+    if(frame->meta[VDNG_META_INFO] != MLV_INDEX_NONE)
+    {
+        const mlv_index_entry_t *entry = mlv_index_entry(clip->index, frame->meta[VDNG_META_INFO]);
+        const mlv_hdr_t *block = mlv_reader_get_block(clip->reader, entry->fileNumber, entry->offset);
+
+        if(block && block->blockSize > sizeof(mlv_info_hdr_t))
+        {
+            int str_length = MIN(block->blockSize - sizeof(mlv_info_hdr_t), sizeof(context->info) - 1);
+
+            memcpy(context->info, (const uint8_t *)block + sizeof(mlv_info_hdr_t), str_length);
+            context->info[str_length] = '\000';
+        }
+    }
+    frame_info->info_str = context->info;
+
+    return 1;
+}
+
+/* decode a compressed payload into the packed context->frame */
+static int vdng_decode(vdng_clip_t *clip, struct vdng_context *context, const uint8_t *payload, uint32_t payload_size, uint32_t frame_number)
+{
+    int xRes = clip->info.rawi_hdr.xRes;
+    int yRes = clip->info.rawi_hdr.yRes;
+    int bpp = clip->info.rawi_hdr.raw_info.bits_per_pixel;
+    uint32_t video_class = clip->info.file_hdr.videoClass;
+
+    if(video_class & MLV_VIDEO_CLASS_FLAG_LZMA)
+    {
+        if(lzma_frame_size(payload, payload_size) != (size_t)clip->frame_size)
+        {
+            return 0;
+        }
+        return !lzma_frame_decompress(payload, payload_size, context->frame, clip->frame_size);
+    }
+
+    if(!context->unpacked)
+    {
+        context->unpacked = malloc(xRes * yRes * sizeof(uint16_t));
+        if(!context->unpacked)
+        {
+            return 0;
+        }
+    }
+
+    if(video_class & MLV_VIDEO_CLASS_FLAG_INTER)
+    {
+        int frame_type = 0;
+        uint32_t key_frame = 0;
+
+        if(inter_frame_info(payload, payload_size, frame_number, &frame_type, &key_frame) != LJ92_ERROR_NONE)
+        {
+            return 0;
+        }
+
+        /* predicted frames need their keyframe, consecutive frames mostly share it */
+        if(frame_type == INTER_FRAME_PRED && !(context->ref.valid && context->ref.frame_number == key_frame))
+        {
+            uint32_t key_pos = vdng_find(clip, key_frame);
+            const uint8_t *key_payload = NULL;
+            uint32_t key_size = 0;
+
+            if(key_pos >= clip->frame_count || !vdng_get_vidf(clip, key_pos, &key_payload, &key_size))
+            {
+                return 0;
+            }
+            if(inter_decode_key(key_payload, key_size, key_frame, &context->ref, xRes, yRes) != LJ92_ERROR_NONE)
+            {
+                return 0;
+            }
+        }
+
+        if(inter_decode(payload, payload_size, frame_number, &context->ref, context->unpacked, xRes, yRes) != LJ92_ERROR_NONE)
+        {
+            return 0;
+        }
+    }
+    else if(video_class & MLV_VIDEO_CLASS_FLAG_LJ92)
+    {
+        lj92 handle;
+        int lj92_width = 0;
+        int lj92_height = 0;
+        int lj92_bitdepth = 0;
+        int lj92_components = 0;
+
+        if(lj92_open(&handle, (uint8_t *)payload, payload_size, &lj92_width, &lj92_height, &lj92_bitdepth, &lj92_components) != LJ92_ERROR_NONE)
+        {
+            return 0;
+        }
+
+        int ret = LJ92_ERROR_CORRUPT;
+
+        if(lj92_width * lj92_height * lj92_components == xRes * yRes)
+        {
+            ret = lj92_decode(handle, context->unpacked, xRes * yRes, 0, NULL, 0);
+        }
+        lj92_close(handle);
+
+        if(ret != LJ92_ERROR_NONE)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+
+    /* repack the 16 bit words containing values with max 14 bit */
+    int pitch = xRes * bpp / 8;
+
+    for(int y = 0; y < yRes; y++)
+    {
+        bitpack_pack(&context->unpacked[y * xRes], (uint16_t *)&context->frame[y * pitch], xRes, bpp);
+    }
+
+    return 1;
+}
+
+/* decode and process the image data of one frame into context->dng */
+static int vdng_process(vdng_clip_t *clip, struct vdng_context *context, uint32_t pos, struct frame_info *frame_info)
+{
+    const uint8_t *payload = NULL;
+    uint32_t payload_size = 0;
+    const uint8_t *frame_data = NULL;
+    int compressed = clip->info.file_hdr.videoClass & (MLV_VIDEO_CLASS_FLAG_LZMA | MLV_VIDEO_CLASS_FLAG_LJ92 | MLV_VIDEO_CLASS_FLAG_INTER);
+    int bpp = clip->info.rawi_hdr.raw_info.bits_per_pixel;
+
+    if(!vdng_get_vidf(clip, pos, &payload, &payload_size))
+    {
+        return 0;
+    }
+
+    /* 16 bit frames get processed in place, so they must not be the read only mapping */
+    if((compressed || bpp == 16) && !context->frame)
+    {
+        context->frame = malloc(clip->frame_size);
+        if(!context->frame)
+        {
+            return 0;
+        }
+    }
+
+    if(compressed)
+    {
+        if(!vdng_decode(clip, context, payload, payload_size, frame_info->vidf_hdr.frameNumber))
+        {
+            return 0;
+        }
+        frame_data = context->frame;
+    }
+    else if(payload_size < (uint32_t)clip->frame_size)
+    {
+        return 0;
+    }
+    else if(bpp == 16)
+    {
+        memcpy(context->frame, payload, clip->frame_size);
+        frame_data = context->frame;
+    }
+    else
+    {
+        frame_data = payload;
+    }
+
+    /* dng_init_data() only reads packed frames */
+    frame_info->frame_buffer = (void *)frame_data;
+    frame_info->frame_buffer_size = clip->frame_size;
+    dng_init_data(frame_info, &context->dng);
+    dng_process_data(frame_info, &context->dng);
+
+    return 1;
+}
+
+/* render the whole DNG of a frame into 'out', which holds vdng_file_size() bytes */
+static int vdng_render(vdng_clip_t *clip, struct vdng_context *context, uint32_t pos, uint8_t *out)
+{
+    struct frame_info frame_info;
+    int exclusive = 0;
+    int ok = 1;
+
+    if(!vdng_frame_info(clip, context, pos, &frame_info))
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&vdng_proc_lock);
+    while(1)
+    {
+        if(vdng_proc_clip == clip && vdng_proc_ready)
+        {
+            break;
+        }
+        if(!vdng_proc_active)
+        {
+            exclusive = 1;
+            vdng_proc_clip = clip;
+            vdng_proc_ready = 0;
+            break;
+        }
+        pthread_cond_wait(&vdng_proc_cond, &vdng_proc_lock);
+    }
+    vdng_proc_active++;
+    pthread_mutex_unlock(&vdng_proc_lock);
+
+    if(exclusive)
+    {
+        free_pixel_maps();
+        reset_vertical_stripes();
+
+        /* the stripes detection adds noise with rand(). start like a new mlv_dump process does, which
+           takes one number for the WAV file before the first frame if there is audio */
+        srand(1);
+        if(clip->has_audio)
+        {
+            rand();
+        }
+
+        /* like mlv_dump, set up the maps from the first frame. that way a DNG does not depend on the order of reads */
+        if(pos)
+        {
+            struct frame_info first_info;
+
+            ok = vdng_frame_info(clip, context, 0, &first_info) && vdng_process(clip, context, 0, &first_info);
+            ok = ok && vdng_frame_info(clip, context, pos, &frame_info);
+        }
+    }
+
+    ok = ok && vdng_process(clip, context, pos, &frame_info);
+
+    pthread_mutex_lock(&vdng_proc_lock);
+    vdng_proc_active--;
+    if(exclusive && ok && vdng_proc_clip == clip)
+    {
+        vdng_proc_ready = 1;
+    }
+    pthread_cond_broadcast(&vdng_proc_cond);
+    pthread_mutex_unlock(&vdng_proc_lock);
+
+    if(!ok)
+    {
+        return 0;
+    }
+
+    dng_init_header(&frame_info, &context->dng);
+    return dng_save_buffer(&frame_info, &context->dng, out);
+}
+
+/* the following helpers must be called with clip->lock held */
+static struct vdng_context *vdng_get_context(vdng_clip_t *clip)
+{
+    struct vdng_context *context = clip->contexts;
+
+    if(context)
+    {
+        clip->contexts = context->next;
+        return context;
+    }
+
+    return calloc(1, sizeof(struct vdng_context));
+}
+
+static void vdng_put_context(vdng_clip_t *clip, struct vdng_context *context)
+{
+    context->next = clip->contexts;
+    clip->contexts = context;
+}
+
+static int vdng_lookup(vdng_clip_t *clip, uint32_t pos)
+{
+    for(int slot = 0; slot < clip->options.cache_frames; slot++)
+    {
+        if(clip->slots[slot].state != SLOT_EMPTY && clip->slots[slot].pos == pos)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/* least recently used slot that is not being rendered, -1 if all are */
+static int vdng_evict(vdng_clip_t *clip)
+{
+    int oldest = -1;
+
+    for(int slot = 0; slot < clip->options.cache_frames; slot++)
+    {
+        if(clip->slots[slot].state == SLOT_BUSY)
+        {
+            continue;
+        }
+        if(oldest < 0 || clip->slots[slot].last_used < clip->slots[oldest].last_used)
+        {
+            oldest = slot;
+        }
+    }
+
+    if(oldest >= 0 && !clip->slots[oldest].data)
+    {
+        clip->slots[oldest].data = malloc(clip->max_file_size);
+        if(!clip->slots[oldest].data)
+        {
+            return -1;
+        }
+    }
+
+    return oldest;
+}
+
+/* render into a claimed slot. drops the lock while rendering */
+static int vdng_fill_slot(vdng_clip_t *clip, int slot, uint32_t pos)
+{
+    struct vdng_context *context = vdng_get_context(clip);
+
+    clip->slots[slot].pos = pos;
+    clip->slots[slot].state = SLOT_BUSY;
+
+    pthread_mutex_unlock(&clip->lock);
+    int ok = context && vdng_render(clip, context, pos, clip->slots[slot].data);
+    pthread_mutex_lock(&clip->lock);
+
+    if(context)
+    {
+        vdng_put_context(clip, context);
+    }
+
+    clip->slots[slot].state = ok ? SLOT_READY : SLOT_EMPTY;
+    clip->slots[slot].last_used = ok ? ++clip->use_count : 0;
+    pthread_cond_broadcast(&clip->cond);
+
+    return ok;
+}
+
+/* the cached DNG of a frame, rendered if needed. -1 on error */
+static int vdng_acquire(vdng_clip_t *clip, uint32_t pos)
+{
+    while(1)
+    {
+        int slot = vdng_lookup(clip, pos);
+
+        if(slot >= 0 && clip->slots[slot].state == SLOT_READY)
+        {
+            clip->slots[slot].last_used = ++clip->use_count;
+            return slot;
+        }
+
+        /* being rendered by someone else, or no slot free right now */
+        if(slot < 0)
+        {
+            slot = vdng_evict(clip);
+            if(slot >= 0)
+            {
+                return vdng_fill_slot(clip, slot, pos) ? slot : -1;
+            }
+        }
+
+        pthread_cond_wait(&clip->cond, &clip->lock);
+    }
+}
+
+static void vdng_worker(pool_job_t *pool_job, int worker, void *ctx)
+{
+    struct vdng_job *job = (struct vdng_job *)pool_job;
+    vdng_clip_t *clip = job->clip;
+
+    (void)worker;
+    (void)ctx;
+
+    pthread_mutex_lock(&clip->lock);
+    vdng_fill_slot(clip, job->slot, job->pos);
+    job->active = 0;
+    pthread_mutex_unlock(&clip->lock);
+}
+
+/* claim slots for the frames following 'pos' when reading in order. returns the jobs to submit */
+static int vdng_read_ahead(vdng_clip_t *clip, uint32_t pos, struct vdng_job **submit)
+{
+    int count = 0;
+
+    if(!clip->pool || pos == clip->last_pos)
+    {
+        return 0;
+    }
+
+    int sequential = (pos == clip->last_pos + 1);
+    clip->last_pos = pos;
+
+    if(!sequential)
+    {
+        return 0;
+    }
+
+    for(uint32_t next = pos + 1; next <= pos + clip->options.read_ahead && next < clip->frame_count; next++)
+    {
+        if(vdng_lookup(clip, next) >= 0)
+        {
+            continue;
+        }
+
+        struct vdng_job *job = NULL;
+        for(int num = 0; num < clip->options.read_ahead; num++)
+        {
+            if(!clip->jobs[num].active)
+            {
+                job = &clip->jobs[num];
+                break;
+            }
+        }
+
+        int slot = job ? vdng_evict(clip) : -1;
+        if(slot < 0)
+        {
+            break;
+        }
+
+        clip->slots[slot].pos = next;
+        clip->slots[slot].state = SLOT_BUSY;
+
+        job->active = 1;
+        job->pos = next;
+        job->slot = slot;
+        submit[count++] = job;
+    }
+
+    return count;
+}
+
+vdng_clip_t *vdng_open(const char *mlv_filename, const struct vdng_options *options)
+{
+    vdng_clip_t *clip = calloc(1, sizeof(vdng_clip_t));
+
+    if(!clip)
+    {
+        return NULL;
+    }
+
+    clip->options = *options;
+    clip->options.read_ahead = MAX(clip->options.read_ahead, 0);
+    /* the frame being read and the ones in advance must fit */
+    clip->options.cache_frames = MAX(clip->options.cache_frames, clip->options.read_ahead + 2);
+    clip->last_pos = UINT32_MAX;
+
+    pthread_mutex_init(&clip->lock, NULL);
+    pthread_cond_init(&clip->cond, NULL);
+
+    clip->filename = vdng_strdup(mlv_filename);
+    if(!clip->filename || !vdng_open_chunks(clip))
+    {
+        goto error;
+    }
+
+    /* name without path and extension */
+    const char *base = strrchr(clip->filename, '/');
+    base = base ? base + 1 : clip->filename;
+    clip->name = vdng_strdup(base);
+    if(!clip->name)
+    {
+        goto error;
+    }
+    char *dot = strrchr(clip->name, '.');
+    if(dot)
+    {
+        *dot = '\000';
+    }
+
+    /* the same index mlv_dump uses. it only gets saved if there was one, a new one is kept in memory */
+    clip->index = mlv_index_load(clip->filename);
+    int loaded = clip->index != NULL;
+
+    if(!clip->index)
+    {
+        clip->index = mlv_index_create();
+    }
+    if(!clip->index)
+    {
+        goto error;
+    }
+
+    int ret = mlv_index_update(clip->index, clip->files, clip->file_count, NULL);
+    if(ret == MLV_INDEX_UPDATED && loaded)
+    {
+        mlv_index_save(clip->index, clip->filename);
+    }
+    else if(ret != MLV_INDEX_OK && ret != MLV_INDEX_UPDATED)
+    {
+        goto error;
+    }
+
+    clip->reader = mlv_reader_open(clip->files, clip->file_count);
+    if(!clip->reader || !vdng_build_frames(clip))
+    {
+        goto error;
+    }
+
+    /* delta frames depend on all the frames before */
+    struct frame_info *info = &clip->info;
+
+    info->file_hdr = *mlv_index_file_hdr(clip->index);
+    if(info->file_hdr.videoClass & MLV_VIDEO_CLASS_FLAG_DELTA)
+    {
+        goto error;
+    }
+
+    vdng_copy_clip_block(clip, "RAWI", &info->rawi_hdr, sizeof(mlv_rawi_hdr_t));
+    vdng_copy_clip_block(clip, "IDNT", &info->idnt_hdr, sizeof(mlv_idnt_hdr_t));
+    vdng_copy_clip_block(clip, "RAWC", &info->rawc_hdr, sizeof(mlv_rawc_hdr_t));
+    clip->has_audio = mlv_index_find_block(clip->index, "WAVI", UINT64_MAX) != MLV_INDEX_NONE;
+
+    int bpp = info->rawi_hdr.raw_info.bits_per_pixel;
+    if(!info->rawi_hdr.xRes || !info->rawi_hdr.yRes || bpp < 8 || bpp > 16)
+    {
+        goto error;
+    }
+
+    info->mlv_filename       = clip->filename;
+    info->fps_override       = options->fps_override;
+    info->deflicker_target   = options->deflicker_target;
+    info->vertical_stripes   = options->vertical_stripes;
+    info->focus_pixels       = options->focus_pixels;
+    info->bad_pixels         = options->bad_pixels;
+    info->dual_iso           = options->dual_iso;
+    info->chroma_smooth      = options->chroma_smooth;
+    info->pattern_noise      = options->pattern_noise;
+    info->fpi_method         = options->fpi_method;
+    info->bpi_method         = options->bpi_method;
+    info->crop_rec           = options->crop_rec;
+    info->pixel_cache        = options->pixel_cache;
+    info->raw_state          = UNCOMPRESSED_RAW;
+    /* dng_init_data() turns it off for 16 bit frames, do it here already so headers are the same without image data */
+    info->pack_bits          = bpp < 16;
+
+    clip->frame_size = (info->rawi_hdr.xRes * info->rawi_hdr.yRes * bpp + 7) / 8;
+
+    /* format every header once for the file sizes, that also checks the blocks of all frames */
+    struct vdng_context *context = vdng_get_context(clip);
+    int headers_ok = context != NULL;
+
+    for(uint32_t pos = 0; headers_ok && pos < clip->frame_count; pos++)
+    {
+        struct frame_info frame_info;
+
+        headers_ok = vdng_frame_info(clip, context, pos, &frame_info);
+        if(headers_ok)
+        {
+            dng_init_header(&frame_info, &context->dng);
+            headers_ok = context->dng.header_buf != NULL;
+        }
+        if(headers_ok)
+        {
+            clip->frames[pos].header_size = context->dng.header_size;
+            clip->frames[pos].file_size = dng_get_file_size(&frame_info, &context->dng);
+            clip->max_file_size = MAX(clip->max_file_size, clip->frames[pos].file_size);
+        }
+    }
+
+    if(context)
+    {
+        vdng_put_context(clip, context);
+    }
+    if(!headers_ok)
+    {
+        goto error;
+    }
+
+    clip->slots = calloc(clip->options.cache_frames, sizeof(struct vdng_slot));
+    if(!clip->slots)
+    {
+        goto error;
+    }
+
+    if(clip->options.read_ahead)
+    {
+        clip->jobs = calloc(clip->options.read_ahead, sizeof(struct vdng_job));
+        if(!clip->jobs)
+        {
+            goto error;
+        }
+        for(int num = 0; num < clip->options.read_ahead; num++)
+        {
+            clip->jobs[num].clip = clip;
+        }
+
+        clip->pool = pool_create(clip->options.threads ? clip->options.threads : pool_cpu_count(), &vdng_worker, NULL);
+        if(!clip->pool)
+        {
+            goto error;
+        }
+    }
+
+    return clip;
+
+error:
+    vdng_close(clip);
+    return NULL;
+}
+
+void vdng_close(vdng_clip_t *clip)
+{
+    if(!clip)
+    {
+        return;
+    }
+
+    /* finishes the read ahead jobs */
+    if(clip->pool)
+    {
+        pool_destroy(clip->pool);
+    }
+
+    pthread_mutex_lock(&vdng_proc_lock);
+    if(vdng_proc_clip == clip)
+    {
+        vdng_proc_clip = NULL;
+        vdng_proc_ready = 0;
+    }
+    pthread_mutex_unlock(&vdng_proc_lock);
+
+    while(clip->contexts)
+    {
+        struct vdng_context *context = clip->contexts;
+
+        clip->contexts = context->next;
+        /* not dng_free_data(), the pixel maps may be in use for another clip */
+        dng_free_buffers(&context->dng);
+        inter_ref_free(&context->ref);
+        free(context->frame);
+        free(context->unpacked);
+        free(context);
+    }
+
+    if(clip->slots)
+    {
+        for(int slot = 0; slot < clip->options.cache_frames; slot++)
+        {
+            free(clip->slots[slot].data);
+        }
+    }
+
+    if(clip->reader)
+    {
+        mlv_reader_close(clip->reader);
+    }
+    if(clip->index)
+    {
+        mlv_index_free(clip->index);
+    }
+    for(int file = 0; file < clip->file_count; file++)
+    {
+        fclose(clip->files[file]);
+    }
+
+    pthread_mutex_destroy(&clip->lock);
+    pthread_cond_destroy(&clip->cond);
+
+    free(clip->slots);
+    free(clip->jobs);
+    free(clip->frames);
+    free(clip->files);
+    free(clip->name);
+    free(clip->filename);
+    free(clip);
+}
+
+uint32_t vdng_frame_count(vdng_clip_t *clip)
+{
+    return clip->frame_count;
+}
+
+uint32_t vdng_frame_number(vdng_clip_t *clip, uint32_t pos)
+{
+    return mlv_index_entry(clip->index, clip->frames[pos].entry)->frameNumber;
+}
+
+uint32_t vdng_find(vdng_clip_t *clip, uint32_t frame_number)
+{
+    uint32_t lo = 0;
+    uint32_t hi = clip->frame_count;
+
+    while(lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if(vdng_frame_number(clip, mid) < frame_number)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return (lo < clip->frame_count && vdng_frame_number(clip, lo) == frame_number) ? lo : clip->frame_count;
+}
+
+void vdng_filename(vdng_clip_t *clip, uint32_t pos, char *name, size_t name_size)
+{
+    snprintf(name, name_size, "%s_%06d.dng", clip->name, vdng_frame_number(clip, pos));
+}
+
+size_t vdng_file_size(vdng_clip_t *clip, uint32_t pos)
+{
+    return clip->frames[pos].file_size;
+}
+
+ssize_t vdng_read(vdng_clip_t *clip, uint32_t pos, uint8_t *buffer, size_t size, size_t offset)
+{
+    if(pos >= clip->frame_count)
+    {
+        return -1;
+    }
+    const struct vdng_frame *frame = &clip->frames[pos];
+
+    if(offset >= frame->file_size)
+    {
+        return 0;
+    }
+
+    size = MIN(size, frame->file_size - offset);
+
+    pthread_mutex_lock(&clip->lock);
+
+    /* header only, e.g. when scanning the files. nothing gets decoded unless it is cached already */
+    int slot = vdng_lookup(clip, pos);
+
+    if(offset + size <= frame->header_size && (slot < 0 || clip->slots[slot].state != SLOT_READY))
+    {
+        struct frame_info frame_info;
+        struct vdng_context *context = vdng_get_context(clip);
+        pthread_mutex_unlock(&clip->lock);
+
+        int ok = context && vdng_frame_info(clip, context, pos, &frame_info);
+        if(ok)
+        {
+            dng_init_header(&frame_info, &context->dng);
+            memcpy(buffer, &context->dng.header_buf[offset], size);
+        }
+
+        pthread_mutex_lock(&clip->lock);
+        if(context)
+        {
+            vdng_put_context(clip, context);
+        }
+        pthread_mutex_unlock(&clip->lock);
+
+        return ok ? (ssize_t)size : -1;
+    }
+
+    struct vdng_job *submit[clip->options.read_ahead + 1];
+    int submit_count = 0;
+
+    slot = vdng_acquire(clip, pos);
+    if(slot >= 0)
+    {
+        memcpy(buffer, &clip->slots[slot].data[offset], size);
+        submit_count = vdng_read_ahead(clip, pos, submit);
+    }
+    pthread_mutex_unlock(&clip->lock);
+
+    /* a job can only be submitted again when the pool is done with it */
+    for(int num = 0; num < submit_count; num++)
+    {
+        pool_wait(clip->pool, &submit[num]->job);
+        pool_submit(clip->pool, &submit[num]->job);
+    }
+
+    return (slot >= 0) ? (ssize_t)size : -1;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _mlv_vdng_h
+#define _mlv_vdng_h
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+  virtual DNG files of a MLV clip, generated on demand with the same code as "mlv_dump --dng".
+  the clip gets indexed and mapped once, the metadata blocks of every frame are looked up in advance.
+  reading the header of a DNG only formats it, the image data gets decoded and processed on the first
+  read behind the header. processed DNGs are kept in a LRU cache and when the frames are read in order,
+  the following ones get processed on worker threads in advance.
+
+  the DNGs are the uncompressed bit packed ones of "mlv_dump --dng". their headers are formatted once
+  when opening the clip, for the file sizes, which differ with the strings in the header (e.g. INFO).
+  the focus and bad pixel maps and the vertical stripes correction of raw_proc are global. they always get
+  set up from the first frame of a clip like in mlv_dump, so reading two clips alternately is slow.
+  all functions are thread safe.
+*/
+
+struct vdng_options
+{
+    /* raw processing, the same meaning as in struct frame_info */
+    char *pixel_cache;
+    int vertical_stripes;
+    int focus_pixels;
+    int bad_pixels;
+    int dual_iso;
+    int chroma_smooth;
+    int pattern_noise;
+    int deflicker_target;
+    int fpi_method;
+    int bpi_method;
+    int crop_rec;
+    int fps_override;
+
+    int cache_frames;       /* processed DNGs kept in memory per clip */
+    int read_ahead;         /* frames processed in advance when reading in order, 0 to disable */
+    int threads;            /* worker threads for read ahead, 0 for one per CPU core */
+};
+
+typedef struct vdng_clip vdng_clip_t;
+
+/* the defaults of mlv_dump: stripes, focus and cold pixels get fixed */
+void vdng_default_options(struct vdng_options *options);
+
+/* open a .MLV file and its chunks. the .IDX file gets used and updated if there is one. returns NULL on error */
+vdng_clip_t *vdng_open(const char *mlv_filename, const struct vdng_options *options);
+
+/* waits for the read ahead workers and frees everything */
+void vdng_close(vdng_clip_t *clip);
+
+/* frames are numbered from 0 in frame number order */
+uint32_t vdng_frame_count(vdng_clip_t *clip);
+
+/* VIDF frame number of a frame, it is used for the file name like in mlv_dump */
+uint32_t vdng_frame_number(vdng_clip_t *clip, uint32_t pos);
+
+/* position of the frame with that VIDF frame number, or vdng_frame_count() if there is none */
+uint32_t vdng_find(vdng_clip_t *clip, uint32_t frame_number);
+
+/* "<clip name>_<frame number>.dng", e.g. M12-3456_000042.dng */
+void vdng_filename(vdng_clip_t *clip, uint32_t pos, char *name, size_t name_size);
+
+/* size of the DNG of a frame */
+size_t vdng_file_size(vdng_clip_t *clip, uint32_t pos);
+
+/* read a part of a DNG. returns the number of bytes read, or -1 on error */
+ssize_t vdng_read(vdng_clip_t *clip, uint32_t pos, uint8_t *buffer, size_t size, size_t offset);
+
+#endif
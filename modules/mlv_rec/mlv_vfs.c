@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  read only FUSE file system (libfuse 2.x) that shows every .MLV file of a directory as a folder
+  of DNG files, generated on demand by mlv_vdng. a clip gets opened on first access and stays open.
+
+  mlv_vfs <mlv dir> <mountpoint> [--cache=frames] [--read-ahead=frames] [--threads=count]
+          [--no-stripes] [--no-fixfp] [--no-fixcp] [--fixcp2] [--cs2x2|--cs3x3|--cs5x5] [fuse options]
+*/
+
+#define FUSE_USE_VERSION 26
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 700
+
+#include <fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "mlv_vdng.h"
+
+struct vfs_clip
+{
+    struct vfs_clip *next;
+    char *name;
+    char *filename;
+    struct stat mlv_stat;
+    vdng_clip_t *clip;
+};
+
+static char *vfs_mlv_dir = NULL;
+static struct vdng_options vfs_options;
+static struct vfs_clip *vfs_clips = NULL;
+static pthread_mutex_t vfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* clip name of a .MLV file name, NULL if it is something else */
+static int vfs_clip_name(const char *filename, char *name, size_t name_size)
+{
+    size_t len = strlen(filename);
+
+    if(len <= 4 || len - 4 >= name_size || strcasecmp(&filename[len - 4], ".mlv"))
+    {
+        return 0;
+    }
+
+    memcpy(name, filename, len - 4);
+    name[len - 4] = '\000';
+    return 1;
+}
+
+/* the opened clip with that name, opened on first use. NULL if there is no such .MLV */
+static struct vfs_clip *vfs_get_clip(const char *name, size_t name_len)
+{
+    struct vfs_clip *entry = NULL;
+
+    pthread_mutex_lock(&vfs_lock);
+
+    for(entry = vfs_clips; entry; entry = entry->next)
+    {
+        if(strlen(entry->name) == name_len && !strncmp(entry->name, name, name_len))
+        {
+            pthread_mutex_unlock(&vfs_lock);
+            return entry;
+        }
+    }
+
+    /* the extension may be .MLV or .mlv, so look for it */
+    DIR *dir = opendir(vfs_mlv_dir);
+    struct dirent *dirent;
+
+    while(dir && (dirent = readdir(dir)))
+    {
+        char clip_name[256];
+
+        if(!vfs_clip_name(dirent->d_name, clip_name, sizeof(clip_name)) || strlen(clip_name) != name_len || strncmp(clip_name, name, name_len))
+        {
+            continue;
+        }
+
+        entry = calloc(1, sizeof(struct vfs_clip));
+        if(!entry)
+        {
+            break;
+        }
+
+        entry->name = malloc(name_len + 1);
+        entry->filename = malloc(strlen(vfs_mlv_dir) + strlen(dirent->d_name) + 2);
+        if(entry->name && entry->filename)
+        {
+            strcpy(entry->name, clip_name);
+            sprintf(entry->filename, "%s/%s", vfs_mlv_dir, dirent->d_name);
+
+            if(!stat(entry->filename, &entry->mlv_stat))
+            {
+                entry->clip = vdng_open(entry->filename, &vfs_options);
+            }
+        }
+
+        if(!entry->clip)
+        {
+            fprintf(stderr, "Failed to open '%s'\n", entry->filename ? entry->filename : dirent->d_name);
+            free(entry->name);
+            free(entry->filename);
+            free(entry);
+            entry = NULL;
+            break;
+        }
+
+        entry->next = vfs_clips;
+        vfs_clips = entry;
+        break;
+    }
+
+    if(dir)
+    {
+        closedir(dir);
+    }
+
+    pthread_mutex_unlock(&vfs_lock);
+    return entry;
+}
+
+/* splits "/CLIP/CLIP_000042.dng" into the clip and the frame, *pos is the frame count for the folder itself */
+static struct vfs_clip *vfs_parse_path(const char *path, uint32_t *pos)
+{
+    const char *name = path + 1;
+    const char *slash = strchr(name, '/');
+    size_t name_len = slash ? (size_t)(slash - name) : strlen(name);
+    struct vfs_clip *entry = vfs_get_clip(name, name_len);
+
+    if(!entry)
+    {
+        return NULL;
+    }
+
+    *pos = vdng_frame_count(entry->clip);
+    if(!slash)
+    {
+        return entry;
+    }
+
+    /* the frame number is behind the last underscore, the whole name must match though */
+    const char *underscore = strrchr(slash + 1, '_');
+    unsigned int frame_number = 0;
+
+    if(!underscore || sscanf(underscore + 1, "%u", &frame_number) != 1)
+    {
+        return NULL;
+    }
+
+    uint32_t frame = vdng_find(entry->clip, frame_number);
+    char frame_name[512];
+
+    if(frame >= vdng_frame_count(entry->clip))
+    {
+        return NULL;
+    }
+
+    vdng_filename(entry->clip, frame, frame_name, sizeof(frame_name));
+    if(strcmp(frame_name, slash + 1))
+    {
+        return NULL;
+    }
+
+    *pos = frame;
+    return entry;
+}
+
+static int vfs_getattr(const char *path, struct stat *stbuf)
+{
+    memset(stbuf, 0, sizeof(struct stat));
+
+    if(!strcmp(path, "/"))
+    {
+        stbuf->st_mode = S_IFDIR | 0555;
+        stbuf->st_nlink = 2;
+        return 0;
+    }
+
+    uint32_t pos = 0;
+    struct vfs_clip *entry = vfs_parse_path(path, &pos);
+
+    if(!entry)
+    {
+        return -ENOENT;
+    }
+
+    stbuf->st_mtime = entry->mlv_stat.st_mtime;
+    stbuf->st_atime = entry->mlv_stat.st_atime;
+    stbuf->st_ctime = entry->mlv_stat.st_ctime;
+    stbuf->st_uid = entry->mlv_stat.st_uid;
+    stbuf->st_gid = entry->mlv_stat.st_gid;
+
+    if(pos >= vdng_frame_count(entry->clip))
+    {
+        stbuf->st_mode = S_IFDIR | 0555;
+        stbuf->st_nlink = 2;
+    }
+    else
+    {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+        stbuf->st_size = vdng_file_size(entry->clip, pos);
+    }
+
+    return 0;
+}
+
+static int vfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi)
+{
+    (void)offset;
+    (void)fi;
+
+    filler(buf, ".", NULL, 0);
+    filler(buf, "..", NULL, 0);
+
+    /* the root lists the .MLV files without opening them */
+    if(!strcmp(path, "/"))
+    {
+        DIR *dir = opendir(vfs_mlv_dir);
+        struct dirent *dirent;
+
+        if(!dir)
+        {
+            return -errno;
+        }
+
+        while((dirent = readdir(dir)))
+        {
+            char clip_name[256];
+
+            if(vfs_clip_name(dirent->d_name, clip_name, sizeof(clip_name)))
+            {
+                filler(buf, clip_name, NULL, 0);
+            }
+        }
+
+        closedir(dir);
+        return 0;
+    }
+
+    uint32_t pos = 0;
+    struct vfs_clip *entry = vfs_parse_path(path, &pos);
+
+    if(!entry || pos < vdng_frame_count(entry->clip))
+    {
+        return -ENOENT;
+    }
+
+    for(uint32_t frame = 0; frame < vdng_frame_count(entry->clip); frame++)
+    {
+        char frame_name[512];
+
+        vdng_filename(entry->clip, frame, frame_name, sizeof(frame_name));
+        if(filler(buf, frame_name, NULL, 0))
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int vfs_open(const char *path, struct fuse_file_info *fi)
+{
+    uint32_t pos = 0;
+    struct vfs_clip *entry = vfs_parse_path(path, &pos);
+
+    if(!entry || pos >= vdng_frame_count(entry->clip))
+    {
+        return -ENOENT;
+    }
+
+    if((fi->flags & O_ACCMODE) != O_RDONLY)
+    {
+        return -EACCES;
+    }
+
+    /* frame position, so reads do not have to parse the name again */
+    fi->fh = pos;
+    return 0;
+}
+
+static int vfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+    uint32_t pos = 0;
+    struct vfs_clip *entry = vfs_parse_path(path, &pos);
+
+    if(!entry || pos >= vdng_frame_count(entry->clip))
+    {
+        return -ENOENT;
+    }
+
+    ssize_t ret = vdng_read(entry->clip, (uint32_t)fi->fh, (uint8_t *)buf, size, offset);
+
+    return (ret < 0) ? -EIO : (int)ret;
+}
+
+static void vfs_destroy(void *private_data)
+{
+    (void)private_data;
+
+    while(vfs_clips)
+    {
+        struct vfs_clip *entry = vfs_clips;
+
+        vfs_clips = entry->next;
+        vdng_close(entry->clip);
+        free(entry->name);
+        free(entry->filename);
+        free(entry);
+    }
+}
+
+static struct fuse_operations vfs_operations =
+{
+    .getattr = vfs_getattr,
+    .readdir = vfs_readdir,
+    .open    = vfs_open,
+    .read    = vfs_read,
+    .destroy = vfs_destroy,
+};
+
+static void vfs_usage(char *executable)
+{
+    fprintf(stderr, "Usage: %s <mlv dir> <mountpoint> [options] [fuse options]\n", executable);
+    fprintf(stderr, "  --cache=frames      processed DNGs kept in memory per clip (default %d)\n", vfs_options.cache_frames);
+    fprintf(stderr, "  --read-ahead=frames frames processed in advance when reading in order (default %d)\n", vfs_options.read_ahead);
+    fprintf(stderr, "  --threads=count     read ahead threads per clip (default: one per CPU core)\n");
+    fprintf(stderr, "  --no-stripes        do not fix vertical stripes\n");
+    fprintf(stderr, "  --no-fixfp          do not fix focus pixels\n");
+    fprintf(stderr, "  --no-fixcp          do not fix cold pixels\n");
+    fprintf(stderr, "  --fixcp2            fix non-static (moving) cold pixels too\n");
+    fprintf(stderr, "  --cs2x2, --cs3x3, --cs5x5\n");
+    fprintf(stderr, "                      chroma smoothing\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char **fuse_argv = calloc(argc + 1, sizeof(char *));
+    int fuse_argc = 0;
+
+    vdng_default_options(&vfs_options);
+
+    if(!fuse_argv || argc < 3)
+    {
+        vfs_usage(argv[0]);
+        return 1;
+    }
+
+    /* our options are taken out, everything else goes to FUSE */
+    fuse_argv[fuse_argc++] = argv[0];
+    for(int pos = 1; pos < argc; pos++)
+    {
+        char *arg = argv[pos];
+
+        if(!strncmp(arg, "--cache=", 8))
+        {
+            vfs_options.cache_frames = atoi(&arg[8]);
+        }
+        else if(!strncmp(arg, "--read-ahead=", 13))
+        {
+            vfs_options.read_ahead = atoi(&arg[13]);
+        }
+        else if(!strncmp(arg, "--threads=", 10))
+        {
+            vfs_options.threads = atoi(&arg[10]);
+        }
+        else if(!strcmp(arg, "--no-stripes"))
+        {
+            vfs_options.vertical_stripes = 0;
+        }
+        else if(!strcmp(arg, "--no-fixfp"))
+        {
+            vfs_options.focus_pixels = 0;
+        }
+        else if(!strcmp(arg, "--no-fixcp"))
+        {
+            vfs_options.bad_pixels = 0;
+        }
+        else if(!strcmp(arg, "--fixcp2"))
+        {
+            vfs_options.bad_pixels = 2;
+        }
+        else if(!strcmp(arg, "--cs2x2") || !strcmp(arg, "--cs3x3") || !strcmp(arg, "--cs5x5"))
+        {
+            vfs_options.chroma_smooth = arg[4] - '0';
+        }
+        else if(!vfs_mlv_dir && arg[0] != '-')
+        {
+            vfs_mlv_dir = realpath(arg, NULL);
+            if(!vfs_mlv_dir)
+            {
+                fprintf(stderr, "Cannot access '%s'\n", arg);
+                return 1;
+            }
+        }
+        else
+        {
+            fuse_argv[fuse_argc++] = arg;
+        }
+    }
+
+    if(!vfs_mlv_dir || fuse_argc < 2 || vfs_options.cache_frames < 1 || vfs_options.read_ahead < 0 || vfs_options.threads < 0)
+    {
+        vfs_usage(argv[0]);
+        return 1;
+    }
+
+    int ret = fuse_main(fuse_argc, fuse_argv, &vfs_operations, NULL);
+
+    free(fuse_argv);
+    free(vfs_mlv_dir);
+    return ret;
+}
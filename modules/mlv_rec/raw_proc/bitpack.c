@@ -0,0 +1,488 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitpack.h"
+
+/* the vector kernels are built with per function target attributes and picked at runtime,
+   so the default (plain i386/x86_64) build still gets them */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define BITPACK_X86
+#include <immintrin.h>
+/* 32 bit windows only keeps the stack 4 byte aligned, vector spills need more */
+#define BITPACK_TARGET(isa) __attribute__((target(isa), force_align_arg_pointer))
+#endif
+
+/* conversion buffer size of bitpack_convert in pixels, a multiple of 16 keeps every chunk word aligned */
+#define BITPACK_CHUNK 512
+
+static enum bitpack_isa bitpack_isa_limit = BITPACK_AVX2;
+
+/* 8 pixels always take exactly 'bpp' bytes, so with a constant 'bpp' every group unrolls without branches.
+   for odd depths the groups are not word aligned, but the bits left over in 'data' carry into the next group */
+static inline void unpack_pixels(const uint16_t *packed, uint16_t *unpacked, uint32_t count, const uint32_t bpp)
+{
+    const uint32_t mask = (1 << bpp) - 1;
+    uint64_t data = 0;
+    uint32_t bits = 0;
+
+    for(uint32_t group = 0; group < count / 8; group++)
+    {
+        for(uint32_t pixel = 0; pixel < 8; pixel++)
+        {
+            if(bits < bpp)
+            {
+                data = (data << 16) | *packed++;
+                bits += 16;
+            }
+            bits -= bpp;
+            unpacked[pixel] = (uint16_t)((data >> bits) & mask);
+        }
+        unpacked += 8;
+    }
+
+    for(uint32_t pixel = 0; pixel < count % 8; pixel++)
+    {
+        if(bits < bpp)
+        {
+            data = (data << 16) | *packed++;
+            bits += 16;
+        }
+        bits -= bpp;
+        unpacked[pixel] = (uint16_t)((data >> bits) & mask);
+    }
+}
+
+static inline void pack_pixels(const uint16_t *unpacked, uint16_t *packed, uint32_t count, const uint32_t bpp)
+{
+    const uint32_t mask = (1 << bpp) - 1;
+    uint64_t data = 0;
+    uint32_t bits = 0;
+
+    for(uint32_t group = 0; group < count / 8; group++)
+    {
+        for(uint32_t pixel = 0; pixel < 8; pixel++)
+        {
+            data = (data << bpp) | (unpacked[pixel] & mask);
+            bits += bpp;
+            if(bits >= 16)
+            {
+                bits -= 16;
+                *packed++ = (uint16_t)(data >> bits);
+            }
+        }
+        unpacked += 8;
+    }
+
+    for(uint32_t pixel = 0; pixel < count % 8; pixel++)
+    {
+        data = (data << bpp) | (unpacked[pixel] & mask);
+        bits += bpp;
+        if(bits >= 16)
+        {
+            bits -= 16;
+            *packed++ = (uint16_t)(data >> bits);
+        }
+    }
+
+    if(bits)
+    {
+        *packed = (uint16_t)(data << (16 - bits));
+    }
+}
+
+static inline void pack_pixels_be(const uint16_t *unpacked, uint8_t *packed, uint32_t count, const uint32_t bpp)
+{
+    const uint32_t mask = (1 << bpp) - 1;
+    uint64_t data = 0;
+    uint32_t bits = 0;
+
+    for(uint32_t group = 0; group < count / 8; group++)
+    {
+        for(uint32_t pixel = 0; pixel < 8; pixel++)
+        {
+            data = (data << bpp) | (unpacked[pixel] & mask);
+            bits += bpp;
+            if(bits >= 16)
+            {
+                bits -= 16;
+                packed[0] = (uint8_t)(data >> (bits + 8));
+                packed[1] = (uint8_t)(data >> bits);
+                packed += 2;
+            }
+        }
+        unpacked += 8;
+    }
+
+    for(uint32_t pixel = 0; pixel < count % 8; pixel++)
+    {
+        data = (data << bpp) | (unpacked[pixel] & mask);
+        bits += bpp;
+        while(bits >= 8)
+        {
+            bits -= 8;
+            *packed++ = (uint8_t)(data >> bits);
+        }
+    }
+
+    if(bits)
+    {
+        *packed = (uint8_t)(data << (8 - bits));
+    }
+}
+
+static void unpack_scalar(const uint16_t *packed, uint16_t *unpacked, uint32_t count, uint32_t bpp)
+{
+    /* the common bit depths get their own unrolled copy */
+    switch(bpp)
+    {
+        case 10: unpack_pixels(packed, unpacked, count, 10); break;
+        case 12: unpack_pixels(packed, unpacked, count, 12); break;
+        case 14: unpack_pixels(packed, unpacked, count, 14); break;
+        default: unpack_pixels(packed, unpacked, count, bpp); break;
+    }
+}
+
+static void pack_scalar(const uint16_t *unpacked, uint16_t *packed, uint32_t count, uint32_t bpp)
+{
+    switch(bpp)
+    {
+        case 10: pack_pixels(unpacked, packed, count, 10); break;
+        case 12: pack_pixels(unpacked, packed, count, 12); break;
+        case 14: pack_pixels(unpacked, packed, count, 14); break;
+        default: pack_pixels(unpacked, packed, count, bpp); break;
+    }
+}
+
+static void pack_be_scalar(const uint16_t *unpacked, uint8_t *packed, uint32_t count, uint32_t bpp)
+{
+    switch(bpp)
+    {
+        case 10: pack_pixels_be(unpacked, packed, count, 10); break;
+        case 12: pack_pixels_be(unpacked, packed, count, 12); break;
+        case 14: pack_pixels_be(unpacked, packed, count, 14); break;
+        default: pack_pixels_be(unpacked, packed, count, bpp); break;
+    }
+}
+
+#ifdef BITPACK_X86
+
+/* shuffle and multiplier tables for one group of 8 pixels. everything is done on the big endian
+   bit stream, pixel i starts at bit 'i * bpp', that is byte 'b = i * bpp / 8' at bit offset 'off'.
+   for the camera format the byte positions within the group just get their lowest bit flipped,
+   which only works if the groups start at a word boundary, hence the even 'bpp' requirement.
+
+   unpacking, per 16 bit lane:
+     hi   = stream bytes b, b+1 as 16 bit value
+     lo   = stream byte b+2 in the upper half
+     top  = (hi << off) | (lo >> (16 - off))        the 16 bits starting at the pixel
+     out  = top >> (16 - bpp)
+   both variable shifts are done with 16 bit multiplies by (1 << off).
+
+   packing, per 16 bit lane:
+     left = value << (16 - bpp)
+     high = (left * (1 << (8 - off))) >> 16         byte b
+     low  = (left * (1 << (8 - off))) & 0xFFFF      bytes b+1 and b+2
+   every output byte is covered by at most two pixels (bpp >= 8), the one that starts in it and
+   contributes through 'high' and the one before it, that contributes through 'low'. */
+typedef struct
+{
+    uint8_t shuf_hi[16];
+    uint8_t shuf_lo[16];
+    uint16_t mul[8];
+} bitpack_tables_t;
+
+static int bitpack_simd_depth(uint32_t bpp)
+{
+    return bpp >= 8 && bpp <= 14 && !(bpp & 1);
+}
+
+static void unpack_tables(bitpack_tables_t *tab, uint32_t bpp, int swap)
+{
+    for(uint32_t i = 0; i < 8; i++)
+    {
+        uint32_t b = i * bpp / 8;
+        uint32_t off = i * bpp % 8;
+
+        tab->shuf_hi[2 * i] = (uint8_t)((b + 1) ^ swap);
+        tab->shuf_hi[2 * i + 1] = (uint8_t)(b ^ swap);
+        tab->shuf_lo[2 * i] = 0x80;
+        tab->shuf_lo[2 * i + 1] = (uint8_t)((b + 2) ^ swap);
+        tab->mul[i] = (uint16_t)(1 << off);
+    }
+}
+
+static void pack_tables(bitpack_tables_t *tab, uint32_t bpp, int swap)
+{
+    memset(tab->shuf_hi, 0x80, sizeof(tab->shuf_hi));
+    memset(tab->shuf_lo, 0x80, sizeof(tab->shuf_lo));
+
+    for(uint32_t i = 0; i < 8; i++)
+    {
+        uint32_t b = i * bpp / 8;
+        uint32_t off = i * bpp % 8;
+        uint32_t last = (i * bpp + bpp - 1) / 8;
+
+        tab->mul[i] = (uint16_t)(1 << (8 - off));
+
+        /* the byte the pixel starts in */
+        tab->shuf_hi[b ^ swap] = (uint8_t)(2 * i);
+
+        /* the following one or two bytes, 'low' keeps b+1 in its upper and b+2 in its lower half */
+        for(uint32_t k = b + 1; k <= last; k++)
+        {
+            tab->shuf_lo[k ^ swap] = (uint8_t)(2 * i + (k == b + 1 ? 1 : 0));
+        }
+    }
+}
+
+BITPACK_TARGET("ssse3")
+static void unpack_ssse3(const uint16_t *packed, uint16_t *unpacked, uint32_t count, uint32_t bpp)
+{
+    bitpack_tables_t tab;
+    unpack_tables(&tab, bpp, 1);
+
+    const __m128i shuf_hi = _mm_loadu_si128((const __m128i *)tab.shuf_hi);
+    const __m128i shuf_lo = _mm_loadu_si128((const __m128i *)tab.shuf_lo);
+    const __m128i mul = _mm_loadu_si128((const __m128i *)tab.mul);
+    const uint8_t *src = (const uint8_t *)packed;
+    uint32_t pos = 0;
+
+    /* every group loads 16 bytes, so leave the last ones to the scalar code */
+    for(; pos + 16 <= count; pos += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)src);
+        __m128i hi = _mm_mullo_epi16(_mm_shuffle_epi8(in, shuf_hi), mul);
+        __m128i lo = _mm_mulhi_epu16(_mm_shuffle_epi8(in, shuf_lo), mul);
+        __m128i out = _mm_srli_epi16(_mm_or_si128(hi, lo), 16 - bpp);
+
+        _mm_storeu_si128((__m128i *)&unpacked[pos], out);
+        src += bpp;
+    }
+
+    unpack_scalar((const uint16_t *)src, &unpacked[pos], count - pos, bpp);
+}
+
+BITPACK_TARGET("avx2")
+static void unpack_avx2(const uint16_t *packed, uint16_t *unpacked, uint32_t count, uint32_t bpp)
+{
+    bitpack_tables_t tab;
+    unpack_tables(&tab, bpp, 1);
+
+    const __m256i shuf_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.shuf_hi));
+    const __m256i shuf_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.shuf_lo));
+    const __m256i mul = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.mul));
+    const uint8_t *src = (const uint8_t *)packed;
+    uint32_t pos = 0;
+
+    /* two groups per iteration, one in each 128 bit lane */
+    for(; pos + 24 <= count; pos += 16)
+    {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)src)), _mm_loadu_si128((const __m128i *)(src + bpp)), 1);
+        __m256i hi = _mm256_mullo_epi16(_mm256_shuffle_epi8(in, shuf_hi), mul);
+        __m256i lo = _mm256_mulhi_epu16(_mm256_shuffle_epi8(in, shuf_lo), mul);
+        __m256i out = _mm256_srli_epi16(_mm256_or_si256(hi, lo), 16 - bpp);
+
+        _mm256_storeu_si256((__m256i *)&unpacked[pos], out);
+        src += 2 * bpp;
+    }
+
+    unpack_scalar((const uint16_t *)src, &unpacked[pos], count - pos, bpp);
+}
+
+/* 'swap' selects the camera format (1) or the big endian stream (0). the output is always written
+   as 16 bytes per group, the next group or the scalar tail overwrites what is beyond 'bpp' bytes */
+BITPACK_TARGET("ssse3")
+static uint32_t pack_ssse3(const uint16_t *unpacked, uint8_t *packed, uint32_t count, uint32_t bpp, int swap)
+{
+    bitpack_tables_t tab;
+    pack_tables(&tab, bpp, swap);
+
+    const __m128i shuf_hi = _mm_loadu_si128((const __m128i *)tab.shuf_hi);
+    const __m128i shuf_lo = _mm_loadu_si128((const __m128i *)tab.shuf_lo);
+    const __m128i mul = _mm_loadu_si128((const __m128i *)tab.mul);
+    uint32_t pos = 0;
+
+    for(; pos + 16 <= count; pos += 8)
+    {
+        __m128i left = _mm_slli_epi16(_mm_loadu_si128((const __m128i *)&unpacked[pos]), 16 - bpp);
+        __m128i hi = _mm_shuffle_epi8(_mm_mulhi_epu16(left, mul), shuf_hi);
+        __m128i lo = _mm_shuffle_epi8(_mm_mullo_epi16(left, mul), shuf_lo);
+
+        _mm_storeu_si128((__m128i *)packed, _mm_or_si128(hi, lo));
+        packed += bpp;
+    }
+
+    return pos;
+}
+
+BITPACK_TARGET("avx2")
+static uint32_t pack_avx2(const uint16_t *unpacked, uint8_t *packed, uint32_t count, uint32_t bpp, int swap)
+{
+    bitpack_tables_t tab;
+    pack_tables(&tab, bpp, swap);
+
+    const __m256i shuf_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.shuf_hi));
+    const __m256i shuf_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.shuf_lo));
+    const __m256i mul = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tab.mul));
+    uint32_t pos = 0;
+
+    for(; pos + 24 <= count; pos += 16)
+    {
+        __m256i left = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i *)&unpacked[pos]), 16 - bpp);
+        __m256i hi = _mm256_shuffle_epi8(_mm256_mulhi_epu16(left, mul), shuf_hi);
+        __m256i lo = _mm256_shuffle_epi8(_mm256_mullo_epi16(left, mul), shuf_lo);
+        __m256i out = _mm256_or_si256(hi, lo);
+
+        /* in order, the upper lane overwrites the unused tail of the lower one */
+        _mm_storeu_si128((__m128i *)packed, _mm256_castsi256_si128(out));
+        _mm_storeu_si128((__m128i *)(packed + bpp), _mm256_extracti128_si256(out, 1));
+        packed += 2 * bpp;
+    }
+
+    return pos;
+}
+
+static enum bitpack_isa bitpack_isa(uint32_t bpp)
+{
+    if(!bitpack_simd_depth(bpp))
+    {
+        return BITPACK_SCALAR;
+    }
+    if(bitpack_isa_limit >= BITPACK_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        return BITPACK_AVX2;
+    }
+    if(bitpack_isa_limit >= BITPACK_SSSE3 && __builtin_cpu_supports("ssse3"))
+    {
+        return BITPACK_SSSE3;
+    }
+    return BITPACK_SCALAR;
+}
+
+#else
+
+static enum bitpack_isa bitpack_isa(uint32_t bpp)
+{
+    (void)bpp;
+    return BITPACK_SCALAR;
+}
+
+#endif
+
+void bitpack_unpack(const uint16_t *packed, uint16_t *unpacked, uint32_t count, uint32_t bpp)
+{
+    switch(bitpack_isa(bpp))
+    {
+#ifdef BITPACK_X86
+        case BITPACK_AVX2: unpack_avx2(packed, unpacked, count, bpp); break;
+        case BITPACK_SSSE3: unpack_ssse3(packed, unpacked, count, bpp); break;
+#endif
+        default: unpack_scalar(packed, unpacked, count, bpp); break;
+    }
+}
+
+void bitpack_pack(const uint16_t *unpacked, uint16_t *packed, uint32_t count, uint32_t bpp)
+{
+    uint32_t pos = 0;
+
+    switch(bitpack_isa(bpp))
+    {
+#ifdef BITPACK_X86
+        case BITPACK_AVX2: pos = pack_avx2(unpacked, (uint8_t *)packed, count, bpp, 1); break;
+        case BITPACK_SSSE3: pos = pack_ssse3(unpacked, (uint8_t *)packed, count, bpp, 1); break;
+#endif
+        default: break;
+    }
+
+    /* whole groups of an even depth end on a word boundary */
+    pack_scalar(&unpacked[pos], &packed[pos * bpp / 16], count - pos, bpp);
+}
+
+void bitpack_pack_be(const uint16_t *unpacked, uint8_t *packed, uint32_t count, uint32_t bpp)
+{
+    uint32_t pos = 0;
+
+    switch(bitpack_isa(bpp))
+    {
+#ifdef BITPACK_X86
+        case BITPACK_AVX2: pos = pack_avx2(unpacked, packed, count, bpp, 0); break;
+        case BITPACK_SSSE3: pos = pack_ssse3(unpacked, packed, count, bpp, 0); break;
+#endif
+        default: break;
+    }
+
+    pack_be_scalar(&unpacked[pos], &packed[pos * bpp / 8], count - pos, bpp);
+}
+
+void bitpack_convert(const uint16_t *src, uint32_t src_bpp, uint16_t *dst, uint32_t dst_bpp, uint32_t count)
+{
+    uint16_t buf[BITPACK_CHUNK];
+
+    /* normalize the old value to 16 bits, minimizing the roundoff error */
+    /* assume the bit depth reduction simply discarded the lower bits */
+    /* => we have a bias of 0.5 LSB that can be corrected here. */
+    const uint32_t bias = src_bpp < 16 ? 1 << (15 - src_bpp) : 0;
+
+    for(uint32_t pos = 0; pos < count; pos += BITPACK_CHUNK)
+    {
+        uint32_t chunk = count - pos < BITPACK_CHUNK ? count - pos : BITPACK_CHUNK;
+
+        bitpack_unpack(&src[pos * src_bpp / 16], buf, chunk, src_bpp);
+
+        for(uint32_t x = 0; x < chunk; x++)
+        {
+            buf[x] = (uint16_t)(((uint32_t)(buf[x] << (16 - src_bpp)) + bias) >> (16 - dst_bpp));
+        }
+
+        bitpack_pack(buf, &dst[pos * dst_bpp / 16], chunk, dst_bpp);
+    }
+}
+
+enum bitpack_isa bitpack_set_isa(enum bitpack_isa isa)
+{
+    bitpack_isa_limit = isa;
+
+#ifdef BITPACK_X86
+    if(isa >= BITPACK_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        return BITPACK_AVX2;
+    }
+    if(isa >= BITPACK_SSSE3 && __builtin_cpu_supports("ssse3"))
+    {
+        return BITPACK_SSSE3;
+    }
+#endif
+    return BITPACK_SCALAR;
+}
+
+const char *bitpack_isa_name(enum bitpack_isa isa)
+{
+    switch(isa)
+    {
+        case BITPACK_AVX2: return "AVX2";
+        case BITPACK_SSSE3: return "SSSE3";
+        default: return "scalar";
+    }
+}
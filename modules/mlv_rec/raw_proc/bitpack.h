@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _bitpack_h
+#define _bitpack_h
+
+#include <stdint.h>
+
+/* packed raw data as the camera writes it is a stream of 16 bit little endian words, filled from the MSB.
+   DNG wants a plain big endian bit stream instead, which is the same thing with the bytes of every word swapped.
+   all functions work on whole lines or frames, 'count' is the number of pixels. the last partial word or byte
+   written by the pack functions is padded with zeros. */
+
+/* packed camera data -> 16 bit per pixel */
+void bitpack_unpack(const uint16_t *packed, uint16_t *unpacked, uint32_t count, uint32_t bpp);
+
+/* 16 bit per pixel -> packed camera data, values are masked to 'bpp' bits */
+void bitpack_pack(const uint16_t *unpacked, uint16_t *packed, uint32_t count, uint32_t bpp);
+
+/* 16 bit per pixel -> big endian bit stream (raw payload DNG spec) */
+void bitpack_pack_be(const uint16_t *unpacked, uint8_t *packed, uint32_t count, uint32_t bpp);
+
+/* packed camera data from one bit depth to another. the values are scaled like the lower bits were
+   simply discarded when reducing the depth, i.e. with a 0.5 LSB bias correction */
+void bitpack_convert(const uint16_t *src, uint32_t src_bpp, uint16_t *dst, uint32_t dst_bpp, uint32_t count);
+
+/* instruction sets the kernels can use. SSSE3 and AVX2 are detected at runtime on x86 and only
+   cover the even bit depths from 8 to 14, everything else always takes the portable code */
+enum bitpack_isa
+{
+    BITPACK_SCALAR = 0,
+    BITPACK_SSSE3,
+    BITPACK_AVX2,
+};
+
+/* limit the kernels to 'isa' (for benchmarks), returns what will actually be used */
+enum bitpack_isa bitpack_set_isa(enum bitpack_isa isa);
+const char *bitpack_isa_name(enum bitpack_isa isa);
+
+#endif
@@ -2,146 +2,182 @@
 #define CHROMA_SMOOTH_FUNC chroma_smooth_2x2
 #define CHROMA_SMOOTH_MAX_XY_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 5
-#define CHROMA_SMOOTH_MEDIAN opt_med5
 #elif defined(CHROMA_SMOOTH_3X3)
 #define CHROMA_SMOOTH_FUNC chroma_smooth_3x3
 #define CHROMA_SMOOTH_MAX_XY_IJ 2
 #define CHROMA_SMOOTH_FILTER_SIZE 9
-#define CHROMA_SMOOTH_MEDIAN opt_med9
 #else
 #define CHROMA_SMOOTH_FUNC chroma_smooth_5x5
 #define CHROMA_SMOOTH_MAX_XY_IJ 4
 #define CHROMA_SMOOTH_FILTER_SIZE 25
-#define CHROMA_SMOOTH_MEDIAN opt_med25
 #endif
 
 #ifndef CHROMA_SMOOTH_TYPE
 #define CHROMA_SMOOTH_TYPE uint16_t
 #endif
 
+#ifndef CHROMA_SMOOTH_CELLS
+#define CHROMA_SMOOTH_CELLS
+
+/**
+ * the red and blue differences from green and the interpolation errors only depend on one RG/GB cell,
+ * so they are computed once per cell instead of once for every window the cell is part of.
+ * a window needs CHROMA_SMOOTH_MAX_XY_IJ + 1 rows of cells, they are kept in a ring of cell rows.
+ */
+struct chroma_cells
+{
+    int32_t * rh;   /* red - green, horizontal interpolation */
+    int32_t * bh;   /* blue - green, horizontal interpolation */
+    int32_t * eh;   /* horizontal interpolation error */
+    int32_t * rv;   /* same for vertical interpolation */
+    int32_t * bv;
+    int32_t * ev;
+};
+
+/* cells of row 'y' with their red pixel at x0, x0 + 2, ... */
+static void chroma_smooth_cells(int w, CHROMA_SMOOTH_TYPE * inp, int* raw2ev, int x0, int y, int count, struct chroma_cells * cells)
+{
+    for (int n = 0; n < count; n++)
+    {
+        int x = x0 + 2 * n;
+        int r  = raw2ev[inp[x   +   y * w]];
+        int b  = raw2ev[inp[x+1 + (y+1) * w]];
+                                                    /*  for R      for B      */
+        int g1 = raw2ev[inp[x+1 +   y * w]];        /*  Right      Top        */
+        int g2 = raw2ev[inp[x   + (y+1) * w]];      /*  Bottom     Left       */
+        int g3 = raw2ev[inp[x-1 +   y * w]];        /*  Left                  */
+        int g4 = raw2ev[inp[x   + (y-1) * w]];      /*  Top                   */
+        int g5 = raw2ev[inp[x+2 + (y+1) * w]];      /*             Right      */
+        int g6 = raw2ev[inp[x+1 + (y+2) * w]];      /*             Bottom     */
+
+        cells->rh[n] = r - (g1+g3)/2;
+        cells->bh[n] = b - (g2+g5)/2;
+        cells->eh[n] = ABS(g1-g3) + ABS(g2-g5);
+        cells->rv[n] = r - (g2+g4)/2;
+        cells->bv[n] = b - (g1+g6)/2;
+        cells->ev[n] = ABS(g2-g4) + ABS(g1-g6);
+    }
+}
+
+#endif
+
 static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SMOOTH_TYPE * out, int* raw2ev, int* ev2raw, int black, int white)
 {
-    int x,y;
+    /**
+     * for each red pixel, compute the median value of red minus interpolated green at the same location
+     * the median value is then considered the "true" difference between red and green
+     * same for blue vs green
+     * 
+     *
+     * each red pixel has 4 green neighbours, so we may interpolate as follows:
+     * - mean or median(t,b,l,r)
+     * - choose between mean(t,b) and mean(l,r) (idea from AHD)
+     * 
+     * same for blue; note that a RG/GB cell has 6 green pixels that we need to analyze
+     * 2 only for red, 2 only for blue, and 2 shared
+     *    g
+     *   gRg
+     *    gBg
+     *     g
+     *
+     * choosing the interpolation direction seems to give cleaner results
+     * the direction is choosen over the entire filtered area (so we do two passes, one for each direction, 
+     * and at the end choose the one for which total interpolation error is smaller)
+     * 
+     * error = sum(abs(t-b)) or sum(abs(l-r))
+     * 
+     * interpolation in EV space (rather than linear) seems to have less color artifacts in high-contrast areas
+     * 
+     * we can use this filter for 3x3 RG/GB cells or 5x5
+     *
+     * the medians of a whole row of cells are computed at once, see median_rows()
+     */
+    const int m = CHROMA_SMOOTH_MAX_XY_IJ;
+    const int ring = CHROMA_SMOOTH_MAX_XY_IJ + 1;
+    int x0 = 2+m;
+    int y0 = 2+m;
+    int count = (w-2-m - x0 + 1) / 2;
+    int cell_count = count + m;
+    int x,y,i,j,n;
+
+    if (count <= 0 || y0 >= h-3-m)
+        return;
+
+    int32_t * buf = malloc((6 * ring * cell_count + 6 * count) * sizeof(int32_t));
+    if (!buf)
+    {
+        err_printf("malloc error\n");
+        return;
+    }
+
+    struct chroma_cells cells[CHROMA_SMOOTH_MAX_XY_IJ + 1];
+    for (n = 0; n < ring; n++)
+    {
+        int32_t * row = buf + 6 * n * cell_count;
+        struct chroma_cells c = { row, row + cell_count, row + 2 * cell_count, row + 3 * cell_count, row + 4 * cell_count, row + 5 * cell_count };
+        cells[n] = c;
+    }
 
-    for (y = 2+CHROMA_SMOOTH_MAX_XY_IJ; y < h-3-CHROMA_SMOOTH_MAX_XY_IJ; y += 2)
+    /* per output cell: medians for both directions and the total interpolation errors */
+    int32_t * drh = buf + 6 * ring * cell_count;
+    int32_t * dbh = drh + count;
+    int32_t * drv = dbh + count;
+    int32_t * dbv = drv + count;
+    int32_t * eh  = dbv + count;
+    int32_t * ev  = eh + count;
+
+    const int32_t * med_rh[CHROMA_SMOOTH_FILTER_SIZE];
+    const int32_t * med_bh[CHROMA_SMOOTH_FILTER_SIZE];
+    const int32_t * med_rv[CHROMA_SMOOTH_FILTER_SIZE];
+    const int32_t * med_bv[CHROMA_SMOOTH_FILTER_SIZE];
+
+    /* cell rows are computed once, when the first window reaches them */
+    int next = y0 - m;
+
+    for (y = y0; y < h-3-m; y += 2)
     {
-        for (x = 2+CHROMA_SMOOTH_MAX_XY_IJ; x < w-2-CHROMA_SMOOTH_MAX_XY_IJ; x += 2)
+        for (; next <= y + m; next += 2)
         {
-            /**
-             * for each red pixel, compute the median value of red minus interpolated green at the same location
-             * the median value is then considered the "true" difference between red and green
-             * same for blue vs green
-             * 
-             *
-             * each red pixel has 4 green neighbours, so we may interpolate as follows:
-             * - mean or median(t,b,l,r)
-             * - choose between mean(t,b) and mean(l,r) (idea from AHD)
-             * 
-             * same for blue; note that a RG/GB cell has 6 green pixels that we need to analyze
-             * 2 only for red, 2 only for blue, and 2 shared
-             *    g
-             *   gRg
-             *    gBg
-             *     g
-             *
-             * choosing the interpolation direction seems to give cleaner results
-             * the direction is choosen over the entire filtered area (so we do two passes, one for each direction, 
-             * and at the end choose the one for which total interpolation error is smaller)
-             * 
-             * error = sum(abs(t-b)) or sum(abs(l-r))
-             * 
-             * interpolation in EV space (rather than linear) seems to have less color artifacts in high-contrast areas
-             * 
-             * we can use this filter for 3x3 RG/GB cells or 5x5
-             */
-            int i,j;
-            int k = 0;
-            int med_r[CHROMA_SMOOTH_FILTER_SIZE];
-            int med_b[CHROMA_SMOOTH_FILTER_SIZE];
-            
-            /* first try to interpolate in horizontal direction */
-            int eh = 0;
-            for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
-            {
-                for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
-                {
-                    #ifdef CHROMA_SMOOTH_2X2
-                    if (ABS(i) + ABS(j) == 4)
-                        continue;
-                    #endif
-                    
-                    int r  = inp[x+i   +   (y+j) * w];
-                    int b  = inp[x+i+1 + (y+j+1) * w];
-                                                        /*  for R      for B      */
-                    int g1 = inp[x+i+1 +   (y+j) * w];  /*  Right      Top        */
-                    int g2 = inp[x+i   + (y+j+1) * w];  /*  Bottom     Left       */
-                    int g3 = inp[x+i-1 +   (y+j) * w];  /*  Left                  */ 
-                  //int g4 = inp[x+i   + (y+j-1) * w];  /*  Top                   */
-                    int g5 = inp[x+i+2 + (y+j+1) * w];  /*             Right      */
-                  //int g6 = inp[x+i+1 + (y+j+2) * w];  /*             Bottom     */
-                    
-                    g1 = raw2ev[g1];
-                    g2 = raw2ev[g2];
-                    g3 = raw2ev[g3];
-                  //g4 = raw2ev[g4];
-                    g5 = raw2ev[g5];
-                  //g6 = raw2ev[g6];
-                    
-                    int gr = (g1+g3)/2;
-                    int gb = (g2+g5)/2;
-                    eh += ABS(g1-g3) + ABS(g2-g5);
-                    med_r[k] = raw2ev[r] - gr;
-                    med_b[k] = raw2ev[b] - gb;
-                    k++;
-                }
-            }
+            chroma_smooth_cells(w, inp, raw2ev, x0 - m, next, cell_count, &cells[(next / 2) % ring]);
+        }
 
-            /* difference from green, with horizontal interpolation */
-            int drh = CHROMA_SMOOTH_MEDIAN(med_r);
-            int dbh = CHROMA_SMOOTH_MEDIAN(med_b);
-            
-            /* next, try to interpolate in vertical direction */
-            int ev = 0;
-            k = 0;
-            for (i = -CHROMA_SMOOTH_MAX_XY_IJ; i <= CHROMA_SMOOTH_MAX_XY_IJ; i += 2)
+        memset(eh, 0, 2 * count * sizeof(int32_t));
+
+        int k = 0;
+        for (i = -m; i <= m; i += 2)
+        {
+            for (j = -m; j <= m; j += 2)
             {
-                for (j = -CHROMA_SMOOTH_MAX_XY_IJ; j <= CHROMA_SMOOTH_MAX_XY_IJ; j += 2)
+                #ifdef CHROMA_SMOOTH_2X2
+                if (ABS(i) + ABS(j) == 4)
+                    continue;
+                #endif
+
+                struct chroma_cells * c = &cells[((y + j) / 2) % ring];
+                int offset = (i + m) / 2;
+
+                med_rh[k] = c->rh + offset;
+                med_bh[k] = c->bh + offset;
+                med_rv[k] = c->rv + offset;
+                med_bv[k] = c->bv + offset;
+                k++;
+
+                for (n = 0; n < count; n++)
                 {
-                    #ifdef CHROMA_SMOOTH_2X2
-                    if (ABS(i) + ABS(j) == 4)
-                        continue;
-                    #endif
-
-                    int r  = inp[x+i   +   (y+j) * w];
-                    int b  = inp[x+i+1 + (y+j+1) * w];
-                                                        /*  for R      for B      */
-                    int g1 = inp[x+i+1 +   (y+j) * w];  /*  Right      Top        */
-                    int g2 = inp[x+i   + (y+j+1) * w];  /*  Bottom     Left       */
-                  //int g3 = inp[x+i-1 +   (y+j) * w];  /*  Left                  */ 
-                    int g4 = inp[x+i   + (y+j-1) * w];  /*  Top                   */
-                  //int g5 = inp[x+i+2 + (y+j+1) * w];  /*             Right      */
-                    int g6 = inp[x+i+1 + (y+j+2) * w];  /*             Bottom     */
-                    
-                    g1 = raw2ev[g1];
-                    g2 = raw2ev[g2];
-                  //g3 = raw2ev[g3];
-                    g4 = raw2ev[g4];
-                  //g5 = raw2ev[g5];
-                    g6 = raw2ev[g6];
-                    
-                    int gr = (g2+g4)/2;
-                    int gb = (g1+g6)/2;
-                    ev += ABS(g2-g4) + ABS(g1-g6);
-                    med_r[k] = raw2ev[r] - gr;
-                    med_b[k] = raw2ev[b] - gb;
-                    k++;
+                    eh[n] += c->eh[n + offset];
+                    ev[n] += c->ev[n + offset];
                 }
             }
+        }
 
-            /* difference from green, with vertical interpolation */
-            int drv = CHROMA_SMOOTH_MEDIAN(med_r);
-            int dbv = CHROMA_SMOOTH_MEDIAN(med_b);
+        /* difference from green, with horizontal and with vertical interpolation */
+        median_rows(med_rh, k, count, drh);
+        median_rows(med_bh, k, count, dbh);
+        median_rows(med_rv, k, count, drv);
+        median_rows(med_bv, k, count, dbv);
 
+        for (n = 0, x = x0; n < count; n++, x += 2)
+        {
             /* back to our filtered pixels (RG/GB cell) */
             int g1 = inp[x+1 +     y * w];
             int g2 = inp[x   + (y+1) * w];
@@ -162,10 +198,10 @@ static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SM
             int grh = (g1+g3)/2;
             int gbv = (g1+g6)/2;
             int gbh = (g2+g5)/2;
-            int gr = ev < eh ? grv : grh;
-            int gb = ev < eh ? gbv : gbh;
-            int dr = ev < eh ? drv : drh;
-            int db = ev < eh ? dbv : dbh;
+            int gr = ev[n] < eh[n] ? grv : grh;
+            int gb = ev[n] < eh[n] ? gbv : gbh;
+            int dr = ev[n] < eh[n] ? drv[n] : drh[n];
+            int db = ev[n] < eh[n] ? dbv[n] : dbh[n];
             
             int r0 = inp[x   +     y * w];
             int b0 = inp[x+1 + (y+1) * w];
@@ -173,10 +209,10 @@ static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SM
             /* if we are close to the noise floor, use both directions, beacuse otherwise it will affect the noise structure and introduce false detail */
             /* todo: smooth transition between the two methods? better thresholding condition? */
             int thr = 64;
-            if (r0 < black+thr || b0 < black+thr || ABS(drv - drh) < thr || ABS(grv-grh) < thr || ABS(gbv-gbh) < thr)
+            if (r0 < black+thr || b0 < black+thr || ABS(drv[n] - drh[n]) < thr || ABS(grv-grh) < thr || ABS(gbv-gbh) < thr)
             {
-                dr = (drv+drh)/2;
-                db = (dbv+dbh)/2;
+                dr = (drv[n]+drh[n])/2;
+                db = (dbv[n]+dbh[n])/2;
                 gr = (g1+g2+g3+g4)/4;
                 gb = (g1+g2+g5+g6)/4;
             }
@@ -190,9 +226,10 @@ static void CHROMA_SMOOTH_FUNC(int w, int h, CHROMA_SMOOTH_TYPE * inp, CHROMA_SM
                 out[x+1 + (y+1) * w] = ev2raw[COERCE(gb + db, -10*EV_RESOLUTION, 14*EV_RESOLUTION-1)];
         }
     }
+
+    free(buf);
 }
 
 #undef CHROMA_SMOOTH_FUNC
 #undef CHROMA_SMOOTH_MAX_XY_IJ
 #undef CHROMA_SMOOTH_FILTER_SIZE
-#undef CHROMA_SMOOTH_MEDIAN
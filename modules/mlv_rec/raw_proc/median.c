@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "median.h"
+#include "opt_med.h"
+#include "wirth.h"
+
+/* the vector kernels are built with per function target attributes and picked at runtime,
+   so the default (plain i386/x86_64) build still gets them */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define MEDIAN_X86
+#include <immintrin.h>
+/* 32 bit windows only keeps the stack 4 byte aligned, vector spills need more */
+#define MEDIAN_TARGET(isa) __attribute__((target(isa), force_align_arg_pointer))
+#endif
+
+static enum median_isa median_isa_limit = MEDIAN_AVX2;
+
+/* the compare and swap steps of opt_med3(), opt_med5(), opt_med9() and opt_med25(), in the same order.
+   S(a,b) leaves the smaller value in 'a' and the larger one in 'b' */
+#define MEDIAN_NET_3(S) \
+    S(0,1) S(1,2) S(0,1)
+
+#define MEDIAN_NET_5(S) \
+    S(0,1) S(3,4) S(0,3) S(1,4) S(1,2) S(2,3) S(1,2)
+
+#define MEDIAN_NET_9(S) \
+    S(1,2) S(4,5) S(7,8) S(0,1) S(3,4) S(6,7) S(1,2) S(4,5) \
+    S(7,8) S(0,3) S(5,8) S(4,7) S(3,6) S(1,4) S(2,5) S(4,7) \
+    S(4,2) S(6,4) S(4,2)
+
+#define MEDIAN_NET_25(S) \
+    S(0,1) S(3,4) S(2,4) S(2,3) S(6,7) S(5,7) S(5,6) S(9,10) \
+    S(8,10) S(8,9) S(12,13) S(11,13) S(11,12) S(15,16) S(14,16) S(14,15) \
+    S(18,19) S(17,19) S(17,18) S(21,22) S(20,22) S(20,21) S(23,24) S(2,5) \
+    S(3,6) S(0,6) S(0,3) S(4,7) S(1,7) S(1,4) S(11,14) S(8,14) \
+    S(8,11) S(12,15) S(9,15) S(9,12) S(13,16) S(10,16) S(10,13) S(20,23) \
+    S(17,23) S(17,20) S(21,24) S(18,24) S(18,21) S(19,22) S(8,17) S(9,18) \
+    S(0,18) S(0,9) S(10,19) S(1,19) S(1,10) S(11,20) S(2,20) S(2,11) \
+    S(12,21) S(3,21) S(3,12) S(13,22) S(4,22) S(4,13) S(14,23) S(5,23) \
+    S(5,14) S(15,24) S(6,24) S(6,15) S(7,16) S(7,19) S(13,21) S(15,23) \
+    S(7,13) S(7,15) S(1,9) S(3,11) S(5,17) S(11,17) S(9,17) S(4,10) \
+    S(6,12) S(7,14) S(4,6) S(4,7) S(12,14) S(10,14) S(6,7) S(10,12) \
+    S(6,10) S(6,17) S(12,17) S(7,17) S(7,10) S(12,18) S(7,12) S(10,18) \
+    S(12,20) S(10,20) S(10,12)
+
+static void median_rows_scalar(const int32_t ** rows, int size, int count, int32_t * result)
+{
+    int values[64];
+    int * window = size <= 64 ? values : malloc(size * sizeof(int));
+
+    if(!window)
+    {
+        return;
+    }
+
+    for (int n = 0; n < count; n++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            window[i] = rows[i][n];
+        }
+
+        switch(size)
+        {
+            case 3: result[n] = opt_med3(window); break;
+            case 5: result[n] = opt_med5(window); break;
+            case 9: result[n] = opt_med9(window); break;
+            case 25: result[n] = opt_med25(window); break;
+            default: result[n] = median_int_wirth(window, size); break;
+        }
+    }
+
+    if(window != values)
+    {
+        free(window);
+    }
+}
+
+#ifdef MEDIAN_X86
+
+/* one network over 'lanes' windows per step, as far as whole steps go */
+#define MEDIAN_CASE(size, center, vec_t, lanes, load, store, sort) \
+    case size: \
+        for (; n + lanes <= count; n += lanes) \
+        { \
+            vec_t v[size]; \
+            for (int i = 0; i < size; i++) v[i] = load(&rows[i][n]); \
+            MEDIAN_NET_##size(sort) \
+            store(&result[n], v[center]); \
+        } \
+        break;
+
+#define MEDIAN_LOAD_SSE41(p) _mm_loadu_si128((const __m128i *)(p))
+#define MEDIAN_STORE_SSE41(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define MEDIAN_SORT_SSE41(a,b) { __m128i t = _mm_min_epi32(v[a], v[b]); v[b] = _mm_max_epi32(v[a], v[b]); v[a] = t; }
+
+MEDIAN_TARGET("sse4.1")
+static int median_rows_sse41(const int32_t ** rows, int size, int count, int32_t * result)
+{
+    int n = 0;
+
+    switch(size)
+    {
+        MEDIAN_CASE(3, 1, __m128i, 4, MEDIAN_LOAD_SSE41, MEDIAN_STORE_SSE41, MEDIAN_SORT_SSE41)
+        MEDIAN_CASE(5, 2, __m128i, 4, MEDIAN_LOAD_SSE41, MEDIAN_STORE_SSE41, MEDIAN_SORT_SSE41)
+        MEDIAN_CASE(9, 4, __m128i, 4, MEDIAN_LOAD_SSE41, MEDIAN_STORE_SSE41, MEDIAN_SORT_SSE41)
+        MEDIAN_CASE(25, 12, __m128i, 4, MEDIAN_LOAD_SSE41, MEDIAN_STORE_SSE41, MEDIAN_SORT_SSE41)
+        default: break;
+    }
+
+    return n;
+}
+
+#define MEDIAN_LOAD_AVX2(p) _mm256_loadu_si256((const __m256i *)(p))
+#define MEDIAN_STORE_AVX2(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define MEDIAN_SORT_AVX2(a,b) { __m256i t = _mm256_min_epi32(v[a], v[b]); v[b] = _mm256_max_epi32(v[a], v[b]); v[a] = t; }
+
+MEDIAN_TARGET("avx2")
+static int median_rows_avx2(const int32_t ** rows, int size, int count, int32_t * result)
+{
+    int n = 0;
+
+    switch(size)
+    {
+        MEDIAN_CASE(3, 1, __m256i, 8, MEDIAN_LOAD_AVX2, MEDIAN_STORE_AVX2, MEDIAN_SORT_AVX2)
+        MEDIAN_CASE(5, 2, __m256i, 8, MEDIAN_LOAD_AVX2, MEDIAN_STORE_AVX2, MEDIAN_SORT_AVX2)
+        MEDIAN_CASE(9, 4, __m256i, 8, MEDIAN_LOAD_AVX2, MEDIAN_STORE_AVX2, MEDIAN_SORT_AVX2)
+        MEDIAN_CASE(25, 12, __m256i, 8, MEDIAN_LOAD_AVX2, MEDIAN_STORE_AVX2, MEDIAN_SORT_AVX2)
+        default: break;
+    }
+
+    return n;
+}
+
+static enum median_isa median_isa()
+{
+    if(median_isa_limit >= MEDIAN_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        return MEDIAN_AVX2;
+    }
+    if(median_isa_limit >= MEDIAN_SSE41 && __builtin_cpu_supports("sse4.1"))
+    {
+        return MEDIAN_SSE41;
+    }
+    return MEDIAN_SCALAR;
+}
+
+#else
+
+static enum median_isa median_isa()
+{
+    return MEDIAN_SCALAR;
+}
+
+#endif
+
+void median_rows(const int32_t ** rows, int size, int count, int32_t * result)
+{
+    int n = 0;
+
+    switch(median_isa())
+    {
+#ifdef MEDIAN_X86
+        case MEDIAN_AVX2: n = median_rows_avx2(rows, size, count, result); break;
+        case MEDIAN_SSE41: n = median_rows_sse41(rows, size, count, result); break;
+#endif
+        default: break;
+    }
+
+    /* the windows left over */
+    if(n < count)
+    {
+        const int32_t * tail[64];
+        const int32_t ** rest = size <= 64 ? tail : malloc(size * sizeof(int32_t *));
+
+        if(!rest)
+        {
+            return;
+        }
+        for (int i = 0; i < size; i++)
+        {
+            rest[i] = rows[i] + n;
+        }
+        median_rows_scalar(rest, size, count - n, result + n);
+
+        if(rest != tail)
+        {
+            free(rest);
+        }
+    }
+}
+
+enum median_isa median_set_isa(enum median_isa isa)
+{
+    median_isa_limit = isa;
+    return median_isa();
+}
+
+const char *median_isa_name(enum median_isa isa)
+{
+    switch(isa)
+    {
+        case MEDIAN_AVX2: return "AVX2";
+        case MEDIAN_SSE41: return "SSE4.1";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _median_h
+#define _median_h
+
+#include <stdint.h>
+
+/* medians of many small windows at once, e.g. one for every pixel of a row: the values of all windows
+   are passed as 'size' rows, the n-th window is rows[0][n], rows[1][n] ... rows[size - 1][n].
+   for sizes 3, 5, 9 and 25 the windows go through the sorting networks of opt_med.h, 4 or 8 windows at
+   a time with SSE4.1 or AVX2, so the results are exactly those of opt_med3() ... opt_med25().
+   other sizes use median_int_wirth(). */
+void median_rows(const int32_t ** rows, int size, int count, int32_t * result);
+
+/* instruction sets, detected at runtime on x86 */
+enum median_isa
+{
+    MEDIAN_SCALAR = 0,
+    MEDIAN_SSE41,
+    MEDIAN_AVX2,
+};
+
+/* limit the kernels to 'isa' (for benchmarks), returns what will actually be used */
+enum median_isa median_set_isa(enum median_isa isa);
+const char *median_isa_name(enum median_isa isa);
+
+#endif
@@ -25,6 +25,7 @@
 #include "wirth.h"
 #include "math.h"
 #include "patternnoise.h"
+#include "../thread_pool.h"
 
 static int g_debug_flags;
 #ifndef WIN32
@@ -64,15 +65,26 @@ static void average(int16_t * a, int16_t * b, int16_t * out, int w, int h)
 }
 
 /* w and h are the size of input buffer; the output buffer will have the dimensions swapped */
+/* done in 32x32 tiles, so both the rows read and the columns written stay in cache */
 static void transpose(int16_t * in, int16_t * out, int w, int h)
 {
-    for (int y = 0; y < h; y++)
+    #define TILE 32
+    for (int y0 = 0; y0 < h; y0 += TILE)
     {
-        for (int x = 0; x < w; x++)
+        for (int x0 = 0; x0 < w; x0 += TILE)
         {
-            out[y + x*h] = in[x + y*w];
+            int y1 = MIN(y0 + TILE, h);
+            int x1 = MIN(x0 + TILE, w);
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    out[y + x*h] = in[x + y*w];
+                }
+            }
         }
     }
+    #undef TILE
 }
 
 static void horizontal_gradient(int16_t * in, int16_t * out, int w, int h)
@@ -85,10 +97,11 @@ static void horizontal_gradient(int16_t * in, int16_t * out, int w, int h)
     out[0] = out[1] = out[w*h-1] = out[w*h-2] = 0;
 }
 
+/* processes rows y_start ... y_end - 1, so bands of rows can be blurred in parallel */
 static void horizontal_edge_aware_blur_rggb(
                                             int16_t * in_r,  int16_t * in_g1,  int16_t * in_g2,  int16_t * in_b,
                                             int16_t * out_r, int16_t * out_g1, int16_t * out_g2, int16_t * out_b,
-                                            int w, int h, int strength, int thr)
+                                            int w, int y_start, int y_end, int strength, int thr)
 {
     #define NMAX 128
     int16_t g1[NMAX];
@@ -103,6 +116,12 @@ static void horizontal_edge_aware_blur_rggb(
     
     strength /= 2;
     
+    /* only the rows of this band are used from here on */
+    int h = y_end - y_start;
+    int offset = y_start * w;
+    in_r += offset; in_g1 += offset; in_g2 += offset; in_b += offset;
+    out_r += offset; out_g1 += offset; out_g2 += offset; out_b += offset;
+    
     /* precompute average green, red-green and blue-green */
     int16_t * avg_g  = malloc(w * h * sizeof(avg_g[0]));
     int16_t * dif_rg = malloc(w * h * sizeof(dif_rg[0]));
@@ -182,16 +201,20 @@ static void horizontal_edge_aware_blur_rggb(
 /* Find and apply a scalar offset to each column, to reduce pattern noise */
 /* original: input and output */
 /* denoised: input only */
-static void fix_column_noise(int16_t * original, int16_t * denoised, int w, int h, int white)
+/* offsets: output, the offset applied to each column (optional) */
+static void fix_column_noise(int16_t * original, int16_t * denoised, int w, int h, int white, int * offsets)
 {
     /* let's say the difference between original and denoised is mostly noise */
     int16_t * noise = malloc(w * h * sizeof(noise[0]));
     subtract(original, denoised, noise, w, h);
     
     /* from this noise, keep the FPN part (constant offset for each line/column) */
+    /* the columns are gathered in tiles of COL_TILE, walking down the rows of the tile */
+    #define COL_TILE 64
     int* col_offsets = malloc(w * sizeof(col_offsets[0]));
-    int* noise_row = malloc(MAX(w,h) * sizeof(noise_row[0]));
-    int  noise_row_num = 0;
+    int* sorted_offsets = malloc(w * sizeof(sorted_offsets[0]));
+    int* noise_cols = malloc(COL_TILE * h * sizeof(noise_cols[0]));
+    int  noise_col_num[COL_TILE];
     
     /* certain areas will give false readings, mask them out */
     int16_t * mask  = malloc(w * h * sizeof(mask[0]));
@@ -238,141 +261,415 @@ static void fix_column_noise(int16_t * original, int16_t * denoised, int w, int
     }
     
     /* take the median value for each column, in the noise image */
-    for (int x = 0; x < w; x++)
+    for (int x0 = 0; x0 < w; x0 += COL_TILE)
     {
-        noise_row_num = 0;
+        int tw = MIN(COL_TILE, w - x0);
+        memset(noise_col_num, 0, sizeof(noise_col_num));
+        
         for (int y = 0; y < h; y++)
         {
-            if (mask[x + y*w] == 0)
+            for (int t = 0; t < tw; t++)
             {
-                noise_row[noise_row_num++] = noise[x + y*w];
+                if (mask[x0 + t + y*w] == 0)
+                {
+                    noise_cols[t*h + noise_col_num[t]++] = noise[x0 + t + y*w];
+                }
             }
         }
         
-        int offset = (noise_row_num < 10) ? 0 : -median_int_wirth(noise_row, noise_row_num);
-        
-        col_offsets[x] = offset;
+        for (int t = 0; t < tw; t++)
+        {
+            int offset = (noise_col_num[t] < 10) ? 0 : -median_int_wirth(&noise_cols[t*h], noise_col_num[t]);
+            
+            col_offsets[x0 + t] = offset;
+        }
     }
     
+    /* remove median from offsets, to prevent color cast */
+    /* note: median modifies the array, so it works on a copy */
+    memcpy(sorted_offsets, col_offsets, w * sizeof(col_offsets[0]));
+    int mc = median_int_wirth(sorted_offsets, w);
+    
     /* almost done, now apply the offsets */
     for (int y = 0; y < h; y++)
     {
         for (int x = 0; x < w; x++)
         {
-            original[x + y*w] = COERCE((int)original[x + y*w] + col_offsets[x], -32767, 32767);
+            int p = COERCE((int)original[x + y*w] + col_offsets[x], -32767, 32767);
+            /* FIXME: clamping to 32766 causes overflow */
+            original[x + y*w] = COERCE(p - mc, 0, 32760);
         }
     }
     
-    /* remove median from offsets, to prevent color cast */
-    /* note: median modifies the array, so we do this after applying the offsets to the image */
-    int mc = median_int_wirth(col_offsets, w);
-    
-    for (int i = 0; i < w*h; i++)
+    if (offsets)
     {
-        /* FIXME: clamping to 32766 causes overflow */
-        original[i] = COERCE((int)original[i] - mc, 0, 32760);
+        for (int x = 0; x < w; x++)
+        {
+            offsets[x] = col_offsets[x] - mc;
+        }
     }
     
 end:
     free(noise);
     free(col_offsets);
-    free(noise_row);
+    free(sorted_offsets);
+    free(noise_cols);
     free(mask);
     free(hgrad);
+    #undef COL_TILE
 }
 
-/* extract a color channel from a Bayer image */
-/* w and h are the size of the input buffer; output will be half-res */
-/* dx and dy can be 0 or 1 */
-static void extract_channel(int16_t * in, int16_t * out, int w, int h, int dx, int dy)
+/* extract the 4 color channels from a Bayer image, in one pass */
+/* w and h are the size of the input buffer; outputs will be half-res */
+/* channel c is at dx = c & 1, dy = c >> 1 */
+static void extract_channels(int16_t * in, int16_t * out[4], int w, int h)
 {
-    for (int y = dy; y < h; y += 2)
+    for (int y = 0; y < h/2*2; y++)
     {
-        for (int x = dx; x < w; x += 2)
+        int16_t * even = out[(y & 1) * 2] + (y/2)*(w/2);
+        int16_t * odd  = out[(y & 1) * 2 + 1] + (y/2)*(w/2);
+        for (int x = 0; x < w/2; x++)
         {
-            out[(x/2) + (y/2)*(w/2)] = in[x + y*w];
+            even[x] = in[2*x + y*w];
+            odd[x]  = in[2*x + 1 + y*w];
         }
     }
 }
 
-/* set a color channel into a Bayer image */
-/* w and h are the size of the output buffer (full-size image); input will be half-res */
-/* dx and dy can be 0 or 1 */
-static void set_channel(int16_t * out, int16_t * in, int w, int h, int dx, int dy)
+/* set the 4 color channels into a Bayer image, in one pass */
+/* w and h are the size of the output buffer (full-size image); inputs are half-res */
+static void set_channels(int16_t * out, int16_t * in[4], int w, int h)
 {
-    for (int y = dy; y < h; y += 2)
+    for (int y = 0; y < h/2*2; y++)
     {
-        for (int x = dx; x < w; x += 2)
+        int16_t * even = in[(y & 1) * 2] + (y/2)*(w/2);
+        int16_t * odd  = in[(y & 1) * 2 + 1] + (y/2)*(w/2);
+        for (int x = 0; x < w/2; x++)
         {
-            out[x + y*w] = in[(x/2) + (y/2)*(w/2)];
+            out[2*x + y*w]     = even[x];
+            out[2*x + 1 + y*w] = odd[x];
         }
     }
 }
 
-static void fix_column_noise_rggb(int16_t * raw, int w, int h, int white)
+/* the heavy steps run as jobs on a thread pool, when there is one */
+enum fpn_job_type
+{
+    FPN_JOB_BLUR,
+    FPN_JOB_COLUMNS,
+};
+
+struct fpn_job
+{
+    pool_job_t job;
+    int16_t * channels[4];
+    int16_t * smooth[4];
+    int * offsets;
+    enum fpn_job_type type;
+    int w;
+    int h;
+    int y_start;        /* FPN_JOB_BLUR: band of rows of all channels */
+    int y_end;
+    int channel;        /* FPN_JOB_COLUMNS: one channel */
+    int white;
+    int reserved;       /* padding */
+};
+
+static void fpn_run_job(pool_job_t * job, int worker, void * arg)
+{
+    struct fpn_job * fpn = (struct fpn_job *)job;
+    (void)worker;
+    (void)arg;
+    
+    if (fpn->type == FPN_JOB_BLUR)
+    {
+        horizontal_edge_aware_blur_rggb(fpn->channels[0], fpn->channels[1], fpn->channels[2], fpn->channels[3],
+                                        fpn->smooth[0], fpn->smooth[1], fpn->smooth[2], fpn->smooth[3],
+                                        fpn->w, fpn->y_start, fpn->y_end, 50, 500);
+    }
+    else
+    {
+        fix_column_noise(fpn->channels[fpn->channel], fpn->smooth[fpn->channel], fpn->w, fpn->h, fpn->white, fpn->offsets);
+    }
+}
+
+static void fpn_run_jobs(thread_pool_t * pool, struct fpn_job * jobs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (pool)
+        {
+            pool_submit(pool, &jobs[i].job);
+        }
+        else
+        {
+            fpn_run_job(&jobs[i].job, 0, NULL);
+        }
+    }
+    
+    if (pool)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            pool_wait(pool, &jobs[i].job);
+        }
+    }
+}
+
+/* offsets: output, the offset applied to each column, 2*w values: columns of even rows, then of odd rows (optional) */
+static void fix_column_noise_rggb(int16_t * raw, int w, int h, int white, thread_pool_t * pool, int bands, int * offsets)
 {
     /* assume Bayer order [RGGB] */
-    int16_t * r        = malloc(w/2 * h/2 * sizeof(r[0]));   /* red channel (bottom left) */
-    int16_t * g1       = malloc(w/2 * h/2 * sizeof(r[0]));   /* top-left green */
-    int16_t * g2       = malloc(w/2 * h/2 * sizeof(r[0]));   /* bottom-right green */
-    int16_t * b        = malloc(w/2 * h/2 * sizeof(r[0]));   /* blue channel (top right) */
-    int16_t * rs       = malloc(w/2 * h/2 * sizeof(r[0]));   /* r  after smoothing */
-    int16_t * g1s      = malloc(w/2 * h/2 * sizeof(r[0]));   /* g1 after smoothing */
-    int16_t * g2s      = malloc(w/2 * h/2 * sizeof(r[0]));   /* g2 after smoothing */
-    int16_t * bs       = malloc(w/2 * h/2 * sizeof(r[0]));   /* b  after smoothing */
+    /* r (top left), g1 (top right), g2 (bottom left), b (bottom right), each also after smoothing */
+    int16_t * channels[4];
+    int16_t * smooth[4];
+    for (int c = 0; c < 4; c++)
+    {
+        channels[c] = malloc(w/2 * h/2 * sizeof(raw[0]));
+        smooth[c]   = malloc(w/2 * h/2 * sizeof(raw[0]));
+    }
+    
+    int * col_offsets = offsets ? malloc(4 * (w/2) * sizeof(col_offsets[0])) : NULL;
+    bands = COERCE(bands, 1, MAX(h/2, 1));
+    struct fpn_job * jobs = calloc(MAX(bands, 4), sizeof(struct fpn_job));
     
     /* extract half-res color channels from Bayer data */
-    extract_channel(raw, r,  w, h, 0, 0);
-    extract_channel(raw, g1, w, h, 1, 0);
-    extract_channel(raw, g2, w, h, 0, 1);
-    extract_channel(raw, b,  w, h, 1, 1);
+    extract_channels(raw, channels, w, h);
     
     /* strong horizontal denoising (1-D median blur on G, R-G and B-G, stop on edge */
-    /* (this step takes a lot of time) */
-    horizontal_edge_aware_blur_rggb(r, g1, g2, b, rs, g1s, g2s, bs, w/2, h/2, 50, 500);
+    /* (this step takes a lot of time, so it runs in bands of rows) */
+    for (int i = 0; i < bands; i++)
+    {
+        jobs[i].type = FPN_JOB_BLUR;
+        jobs[i].w = w/2;
+        jobs[i].y_start = h/2 * i / bands;
+        jobs[i].y_end = h/2 * (i + 1) / bands;
+        memcpy(jobs[i].channels, channels, sizeof(channels));
+        memcpy(jobs[i].smooth, smooth, sizeof(smooth));
+    }
+    fpn_run_jobs(pool, jobs, bands);
     
     /* after blurring horizontally, the difference reveals vertical FPN */
-    fix_column_noise(r,  rs,  w/2, h/2, white);
-    fix_column_noise(g1, g1s, w/2, h/2, white);
-    fix_column_noise(g2, g2s, w/2, h/2, white);
-    fix_column_noise(b,  bs,  w/2, h/2, white);
+    for (int c = 0; c < 4; c++)
+    {
+        jobs[c].type = FPN_JOB_COLUMNS;
+        jobs[c].w = w/2;
+        jobs[c].h = h/2;
+        memcpy(jobs[c].channels, channels, sizeof(channels));
+        memcpy(jobs[c].smooth, smooth, sizeof(smooth));
+        jobs[c].channel = c;
+        jobs[c].white = white;
+        jobs[c].offsets = col_offsets ? col_offsets + c * (w/2) : NULL;
+    }
+    fpn_run_jobs(pool, jobs, 4);
     
     /* commit changes */
-    set_channel(raw, r,  w, h, 0, 0);
-    set_channel(raw, g1, w, h, 1, 0);
-    set_channel(raw, g2, w, h, 0, 1);
-    set_channel(raw, b,  w, h, 1, 1);
+    set_channels(raw, channels, w, h);
+    
+    if (col_offsets)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            for (int x = 0; x < w/2; x++)
+            {
+                offsets[(c >> 1) * w + 2*x + (c & 1)] = col_offsets[c * (w/2) + x];
+            }
+        }
+        free(col_offsets);
+    }
     
     /* cleanup */
-    free(r);
-    free(g1);
-    free(g2);
-    free(b);
-    free(rs);
-    free(g1s);
-    free(g2s);
-    free(bs);
+    for (int c = 0; c < 4; c++)
+    {
+        free(channels[c]);
+        free(smooth[c]);
+    }
+    free(jobs);
 }
 
-void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags)
+/* column and row pass; offsets (optional) gets the 2*w column offsets, then the 2*h row offsets */
+static void estimate_pattern_noise(int16_t * raw, int w, int h, int white, thread_pool_t * pool, int bands, int * offsets)
 {
-    g_debug_flags = debug_flags;
-    
     /* fix vertical noise, then transpose and repeat for the horizontal one */
     /* not very efficient, but at least avoids duplicate code */
     /* note: when debugging, we process only one direction */
     if (!g_debug_flags || !(g_debug_flags & FIXPN_DBG_ROWNOISE))
     {
-        fix_column_noise_rggb(raw, w, h, white);
+        fix_column_noise_rggb(raw, w, h, white, pool, bands, offsets);
     }
     
     if (!g_debug_flags || (g_debug_flags & FIXPN_DBG_ROWNOISE))
     {
         /* transpose, process just like before, then transpose back */
+        /* the columns of even rows in the transposed image are the rows of even columns here */
         int16_t * raw_t = malloc(w * h * sizeof(raw[0]));
         transpose(raw, raw_t, w, h);
-        fix_column_noise_rggb(raw_t, h, w, white);
+        fix_column_noise_rggb(raw_t, h, w, white, pool, bands, offsets ? offsets + 2 * w : NULL);
         transpose(raw_t, raw, h, w);
         free(raw_t);
     }
-}
\ No newline at end of file
+}
+
+void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags)
+{
+    g_debug_flags = debug_flags;
+    estimate_pattern_noise(raw, w, h, white, NULL, 1, NULL);
+}
+
+/* per clip pattern noise profile */
+struct fpn_profile
+{
+    thread_pool_t * pool;
+    int * estimates;        /* ring of the last 'samples' estimates */
+    int * offsets;          /* the profile, median of the estimates */
+    int16_t * scratch;      /* refining estimates on a copy of the frame */
+
+    int samples;            /* frames the profile is the median of */
+    int refine;             /* take another sample every 'refine' frames, 0 = never */
+    int threads;
+
+    int w;
+    int h;
+    int size;               /* values per estimate: 2*w column offsets, 2*h row offsets */
+    int estimate_count;     /* estimates taken so far */
+    int reserved;           /* padding */
+};
+
+fpn_profile_t * fpn_profile_create(int samples, int refine, int threads)
+{
+    fpn_profile_t * profile = calloc(1, sizeof(fpn_profile_t));
+    if (!profile)
+    {
+        return NULL;
+    }
+    
+    profile->samples = COERCE(samples, 1, 256);
+    profile->refine = MAX(refine, 0);
+    profile->threads = MAX(threads, 1);
+    return profile;
+}
+
+int fpn_profile_is_sample(fpn_profile_t * profile, uint32_t frame)
+{
+    if (frame < (uint32_t)profile->samples)
+    {
+        return 1;
+    }
+    
+    return profile->refine && (frame - profile->samples + 1) % profile->refine == 0;
+}
+
+static void fpn_profile_update(fpn_profile_t * profile)
+{
+    int count = MIN(profile->estimate_count, profile->samples);
+    int values[count];
+    
+    for (int i = 0; i < profile->size; i++)
+    {
+        for (int n = 0; n < count; n++)
+        {
+            values[n] = profile->estimates[n * profile->size + i];
+        }
+        profile->offsets[i] = median_int_wirth(values, count);
+    }
+}
+
+/* add the profile offsets to every pixel, rows go through in one pass */
+static void fpn_profile_apply(fpn_profile_t * profile, int16_t * raw)
+{
+    int w = profile->w;
+    int h = profile->h;
+    
+    for (int y = 0; y < h; y++)
+    {
+        int16_t * line = raw + y*w;
+        const int * col = profile->offsets + (y & 1) * w;
+        int row_even = profile->offsets[2*w + y];
+        int row_odd  = profile->offsets[2*w + h + y];
+        
+        for (int x = 0; x + 1 < w; x += 2)
+        {
+            line[x]     = COERCE(line[x] + col[x] + row_even, 0, 32760);
+            line[x + 1] = COERCE(line[x + 1] + col[x + 1] + row_odd, 0, 32760);
+        }
+        if (w & 1)
+        {
+            line[w - 1] = COERCE(line[w - 1] + col[w - 1] + row_even, 0, 32760);
+        }
+    }
+}
+
+static int fpn_profile_alloc(fpn_profile_t * profile, int w, int h)
+{
+    free(profile->estimates);
+    free(profile->offsets);
+    free(profile->scratch);
+    
+    profile->w = w;
+    profile->h = h;
+    profile->size = 2 * (w + h);
+    profile->estimate_count = 0;
+    profile->estimates = calloc((size_t)profile->samples * profile->size, sizeof(int));
+    profile->offsets = calloc(profile->size, sizeof(int));
+    profile->scratch = profile->refine ? malloc(w * h * sizeof(int16_t)) : NULL;
+    
+    if (!profile->pool && profile->threads > 1)
+    {
+        profile->pool = pool_create(profile->threads, &fpn_run_job, NULL);
+    }
+    
+    return profile->estimates && profile->offsets && (profile->scratch || !profile->refine);
+}
+
+void fpn_profile_process(fpn_profile_t * profile, int16_t * raw, int w, int h, int white, int sample)
+{
+    if (w != profile->w || h != profile->h || !profile->estimates)
+    {
+        if (!fpn_profile_alloc(profile, w, h))
+        {
+            printf("fpn_profile_process: malloc error\n");
+            return;
+        }
+    }
+    
+    g_debug_flags = 0;
+    
+    /* no profile yet: this frame is corrected just like fix_pattern_noise does */
+    if (!profile->estimate_count || (sample && profile->estimate_count < profile->samples))
+    {
+        int * estimate = &profile->estimates[(profile->estimate_count % profile->samples) * profile->size];
+        estimate_pattern_noise(raw, w, h, white, profile->pool, 4 * profile->threads, estimate);
+        profile->estimate_count++;
+        fpn_profile_update(profile);
+        return;
+    }
+    
+    /* refine: estimate on a copy, then correct with the updated profile */
+    if (sample)
+    {
+        int * estimate = &profile->estimates[(profile->estimate_count % profile->samples) * profile->size];
+        memcpy(profile->scratch, raw, w * h * sizeof(int16_t));
+        estimate_pattern_noise(profile->scratch, w, h, white, profile->pool, 4 * profile->threads, estimate);
+        profile->estimate_count++;
+        fpn_profile_update(profile);
+    }
+    
+    fpn_profile_apply(profile, raw);
+}
+
+void fpn_profile_free(fpn_profile_t * profile)
+{
+    if (!profile)
+    {
+        return;
+    }
+    
+    if (profile->pool)
+    {
+        pool_destroy(profile->pool);
+    }
+    free(profile->estimates);
+    free(profile->offsets);
+    free(profile->scratch);
+    free(profile);
+}
@@ -15,6 +15,23 @@
 
 void fix_pattern_noise(int16_t * raw, int w, int h, int white, int debug_flags);
 
+/**
+ * Per clip correction: the row and column offsets are estimated like above on the
+ * first 'samples' frames (which get the full correction meanwhile), and their median
+ * is then applied to every other frame with one cheap pass. With 'refine', every
+ * refine-th frame after that is sampled too, and the profile follows the last
+ * 'samples' estimates. The estimation runs on 'threads' threads.
+ *
+ * Sample frames update the profile, so they must be processed one at a time, after
+ * all previous frames; the other frames may be processed in parallel.
+ */
+typedef struct fpn_profile fpn_profile_t;
+
+fpn_profile_t * fpn_profile_create(int samples, int refine, int threads);
+int fpn_profile_is_sample(fpn_profile_t * profile, uint32_t frame);
+void fpn_profile_process(fpn_profile_t * profile, int16_t * raw, int w, int h, int white, int sample);
+void fpn_profile_free(fpn_profile_t * profile);
+
 /* debug flags */
 #define FIXPN_DBG_COLNOISE  0
 #define FIXPN_DBG_ROWNOISE  1
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/* fileno() with -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__WIN32)
+#include <windows.h>
+#include <io.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "pixel_map.h"
+
+static int compare_pixels(const void *a, const void *b)
+{
+    const struct pixel_xy *pa = (const struct pixel_xy *)a;
+    const struct pixel_xy *pb = (const struct pixel_xy *)b;
+
+    if(pa->y != pb->y)
+    {
+        return pa->y < pb->y ? -1 : 1;
+    }
+    if(pa->x != pb->x)
+    {
+        return pa->x < pb->x ? -1 : 1;
+    }
+    return 0;
+}
+
+int pixel_runs_build(pixel_runs_t *runs, const struct pixel_xy *pixels, size_t count)
+{
+    memset(runs, 0, sizeof(pixel_runs_t));
+
+    if(!count)
+    {
+        return 0;
+    }
+
+    struct pixel_xy *sorted = malloc(count * sizeof(struct pixel_xy));
+    pixel_run_t *list = malloc(count * sizeof(pixel_run_t));
+
+    if(!sorted || !list)
+    {
+        free(sorted);
+        free(list);
+        return -1;
+    }
+
+    memcpy(sorted, pixels, count * sizeof(struct pixel_xy));
+    qsort(sorted, count, sizeof(struct pixel_xy), &compare_pixels);
+
+    uint32_t run_count = 0;
+    uint32_t pixel_count = 0;
+    pixel_run_t *run = NULL;
+
+    for(size_t pos = 0; pos < count; pos++)
+    {
+        int x = sorted[pos].x;
+        int y = sorted[pos].y;
+
+        if(x < 0 || y < 0 || x > 0xFFFF || y > 0xFFFF || (pos && !compare_pixels(&sorted[pos], &sorted[pos - 1])))
+        {
+            continue;
+        }
+        pixel_count++;
+
+        /* continue the run if the pixel is on the same row with the same distance */
+        if(run && run->y == y && run->count < 0xFFFF)
+        {
+            int last = run->x + (run->count - 1) * run->step;
+
+            if(run->count == 1 && x - last <= 0xFFFF)
+            {
+                run->step = x - last;
+                run->count++;
+                continue;
+            }
+            if(x - last == run->step)
+            {
+                run->count++;
+                continue;
+            }
+        }
+
+        run = &list[run_count++];
+        run->y = y;
+        run->x = x;
+        run->count = 1;
+        run->step = 0;
+    }
+
+    free(sorted);
+
+    runs->buffer = list;
+    runs->runs = list;
+    runs->run_count = run_count;
+    runs->pixel_count = pixel_count;
+
+    return 0;
+}
+
+/* FNV-1a, to keep the file names short */
+static uint32_t pixel_cache_hash(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t hash = 2166136261u;
+
+    for(size_t pos = 0; pos < size; pos++)
+    {
+        hash = (hash ^ bytes[pos]) * 16777619u;
+    }
+    return hash;
+}
+
+void pixel_cache_file_name(char *file_name, size_t size, const char *dir, const pixel_cache_hdr_t *hdr)
+{
+    char serial[sizeof(hdr->camera_serial) + 1];
+    size_t length = 0;
+
+    /* the serial number goes into the file name, only keep the harmless characters */
+    for(size_t pos = 0; pos < sizeof(hdr->camera_serial) && hdr->camera_serial[pos]; pos++)
+    {
+        if(isalnum((unsigned char)hdr->camera_serial[pos]))
+        {
+            serial[length++] = hdr->camera_serial[pos];
+        }
+    }
+    serial[length] = '\000';
+
+    snprintf(file_name, size, "%s/%08X_%s_%dx%d_%08X.%s", dir, hdr->camera_id, length ? serial : "any",
+             hdr->raw_width, hdr->raw_height, pixel_cache_hash(hdr->mode, sizeof(hdr->mode)), hdr->type ? "bpmc" : "fpmc");
+}
+
+int pixel_cache_save(const char *dir, pixel_cache_hdr_t *hdr, const pixel_runs_t *runs)
+{
+    char file_name[1024];
+
+    /* create the directory and its parents, e.g. ~/.cache may not exist yet */
+    snprintf(file_name, sizeof(file_name), "%s/", dir);
+    for(char *sep = file_name + 1; *sep; sep++)
+    {
+        if(*sep != '/' && *sep != '\\')
+        {
+            continue;
+        }
+        char c = *sep;
+        *sep = '\000';
+#if defined(__WIN32)
+        _mkdir(file_name);
+#else
+        mkdir(file_name, 0755);
+#endif
+        *sep = c;
+    }
+
+    memcpy(hdr->magic, "PXMC", 4);
+    hdr->version = PIXEL_CACHE_VERSION;
+    hdr->pixel_count = runs->pixel_count;
+    hdr->run_count = runs->run_count;
+
+    pixel_cache_file_name(file_name, sizeof(file_name), dir, hdr);
+
+    /* write to a temporary name first, another process may map the file at the same time */
+    char temp_name[1040];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+
+    FILE *f = fopen(temp_name, "wb");
+    if(!f)
+    {
+        return -1;
+    }
+
+    int ok = fwrite(hdr, sizeof(pixel_cache_hdr_t), 1, f) == 1;
+    if(ok && runs->run_count)
+    {
+        ok = fwrite(runs->runs, sizeof(pixel_run_t), runs->run_count, f) == runs->run_count;
+    }
+    ok = !fclose(f) && ok;
+
+#if defined(__WIN32)
+    /* rename does not replace existing files there */
+    remove(file_name);
+#endif
+    if(!ok || rename(temp_name, file_name))
+    {
+        remove(temp_name);
+        return -1;
+    }
+
+    return 0;
+}
+
+int pixel_cache_load(const char *dir, const pixel_cache_hdr_t *hdr, pixel_runs_t *runs)
+{
+    char file_name[1024];
+
+    memset(runs, 0, sizeof(pixel_runs_t));
+    pixel_cache_file_name(file_name, sizeof(file_name), dir, hdr);
+
+    FILE *f = fopen(file_name, "rb");
+    if(!f)
+    {
+        return -1;
+    }
+
+    const uint8_t *data = NULL;
+    size_t size = 0;
+
+#if defined(__WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(fileno(f));
+    LARGE_INTEGER file_size;
+
+    if(handle != INVALID_HANDLE_VALUE && GetFileSizeEx(handle, &file_size) && file_size.QuadPart >= (LONGLONG)sizeof(pixel_cache_hdr_t))
+    {
+        HANDLE mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+        if(mapping)
+        {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if(data)
+            {
+                size = file_size.QuadPart;
+                runs->mapping_handle = mapping;
+            }
+            else
+            {
+                CloseHandle(mapping);
+            }
+        }
+    }
+#else
+    struct stat info;
+
+    if(!fstat(fileno(f), &info) && info.st_size >= (off_t)sizeof(pixel_cache_hdr_t))
+    {
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+
+        if(mapping != MAP_FAILED)
+        {
+            data = mapping;
+            size = info.st_size;
+        }
+    }
+#endif
+
+    /* the mapping stays valid after closing the file */
+    fclose(f);
+
+    if(!data)
+    {
+        return -1;
+    }
+
+    runs->mapping = data;
+    runs->mapping_size = size;
+
+    const pixel_cache_hdr_t *cached = (const pixel_cache_hdr_t *)data;
+
+    /* same camera and mode, and complete */
+    if(memcmp(cached->magic, "PXMC", 4) || cached->version != PIXEL_CACHE_VERSION || cached->type != hdr->type ||
+       cached->camera_id != hdr->camera_id || memcmp(cached->camera_serial, hdr->camera_serial, sizeof(hdr->camera_serial)) ||
+       cached->raw_width != hdr->raw_width || cached->raw_height != hdr->raw_height || memcmp(cached->mode, hdr->mode, sizeof(hdr->mode)) ||
+       size != sizeof(pixel_cache_hdr_t) + (size_t)cached->run_count * sizeof(pixel_run_t))
+    {
+        pixel_runs_free(runs);
+        return -1;
+    }
+
+    runs->runs = (const pixel_run_t *)(data + sizeof(pixel_cache_hdr_t));
+    runs->run_count = cached->run_count;
+    runs->pixel_count = cached->pixel_count;
+
+    return 0;
+}
+
+void pixel_runs_free(pixel_runs_t *runs)
+{
+    if(runs->mapping)
+    {
+#if defined(__WIN32)
+        UnmapViewOfFile(runs->mapping);
+        CloseHandle(runs->mapping_handle);
+#else
+        munmap((void *)runs->mapping, runs->mapping_size);
+#endif
+    }
+    free(runs->buffer);
+    memset(runs, 0, sizeof(pixel_runs_t));
+}
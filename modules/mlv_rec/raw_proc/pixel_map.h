@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _pixel_map_h
+#define _pixel_map_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  bad and focus pixel maps as sorted runs: the pixels are sorted by row and column, and consecutive pixels of
+  a row with the same distance form a run. focus pixels come in long regular rows, so a map of ~100k pixels
+  needs a few hundred runs. the runs are stored as they are in cache files, so a cached map is used straight
+  from a read-only memory mapping.
+*/
+
+#define PIXEL_CACHE_VERSION     1
+
+struct pixel_xy
+{
+    int x;
+    int y;
+};
+
+typedef struct
+{
+    uint16_t    y;
+    uint16_t    x;
+    uint16_t    count;
+    uint16_t    step;           /* distance of the pixels, 0 for single pixels */
+} pixel_run_t;
+
+/* identifies the camera and video mode a cached map belongs to */
+typedef struct
+{
+    char        magic[4];       /* "PXMC" */
+    uint16_t    version;
+    uint16_t    type;           /* focus or bad pixels, as in pixel_proc.c */
+    uint32_t    camera_id;
+    char        camera_serial[32];
+    int32_t     raw_width;
+    int32_t     raw_height;
+    int32_t     mode[6];        /* whatever else the map depends on */
+    uint32_t    pixel_count;
+    uint32_t    run_count;
+} pixel_cache_hdr_t;
+
+typedef struct
+{
+    const pixel_run_t  *runs;
+    uint32_t            run_count;
+    uint32_t            pixel_count;
+
+    /* either allocated runs or a mapped cache file */
+    void               *buffer;
+    const void         *mapping;
+    size_t              mapping_size;
+#if defined(__WIN32)
+    void               *mapping_handle;
+#endif
+} pixel_runs_t;
+
+/* build runs from 'count' pixels in any order, duplicates and pixels outside 0..65535 are dropped. returns 0 on success */
+int pixel_runs_build(pixel_runs_t *runs, const struct pixel_xy *pixels, size_t count);
+
+/* file name of the cache entry for 'hdr' in directory 'dir' */
+void pixel_cache_file_name(char *file_name, size_t size, const char *dir, const pixel_cache_hdr_t *hdr);
+
+/* write the runs to the cache, the directory is created if missing. returns 0 on success */
+int pixel_cache_save(const char *dir, pixel_cache_hdr_t *hdr, const pixel_runs_t *runs);
+
+/* map the cached runs for 'hdr', only if camera and mode match exactly. returns 0 on success */
+int pixel_cache_load(const char *dir, const pixel_cache_hdr_t *hdr, pixel_runs_t *runs);
+
+void pixel_runs_free(pixel_runs_t *runs);
+
+#endif
@@ -29,6 +29,9 @@
 #include "opt_med.h"
 #include "wirth.h"
 #include "pixel_proc.h"
+#include "pixel_map.h"
+#include "median.h"
+#include "../thread_pool.h"
 
 #define EV_RESOLUTION 65536
 
@@ -262,6 +265,63 @@ static inline void interpolate_around(uint16_t * image_data, int i, int w, int *
     }
 }
 
+/* interpolate_around() for 'count' pixels of a row, 'step' apart, starting at index 'i'.
+   with step > 3 no pixel is a neighbour of another one, so the order does not matter. the table lookups
+   are done for a whole batch first, then the arithmetic runs on plain arrays and gets vectorized.
+   the divisions are done in double precision, that is exact here and vectorizes unlike integer division */
+#define RUN_BATCH 64
+static void interpolate_around_run(uint16_t * image_data, int i, int count, int step, int w, int * raw2ev, int * ev2raw)
+{
+    int dv1[RUN_BATCH], dv2[RUN_BATCH], dh1[RUN_BATCH], dh2[RUN_BATCH];
+    int ev_v1[RUN_BATCH], ev_v2[RUN_BATCH], ev_h1[RUN_BATCH], ev_h2[RUN_BATCH];
+    int ev_corr[RUN_BATCH];
+
+    for (int start = 0; start < count; start += RUN_BATCH)
+    {
+        int n = MIN(RUN_BATCH, count - start);
+        uint16_t * first = &image_data[i + start * step];
+
+        for (int k = 0; k < n; k++)
+        {
+            const uint16_t * p = &first[k * step];
+            dv1[k] = raw2ev[p[w * 3]] - raw2ev[p[w]];
+            dv2[k] = raw2ev[p[-w]] - raw2ev[p[-w * 3]];
+            dh1[k] = raw2ev[p[3]] - raw2ev[p[1]];
+            dh2[k] = raw2ev[p[-1]] - raw2ev[p[-3]];
+            ev_v1[k] = raw2ev[p[w * 2]];
+            ev_v2[k] = raw2ev[p[-w * 2]];
+            ev_h1[k] = raw2ev[p[2]];
+            ev_h2[k] = raw2ev[p[-2]];
+        }
+
+        for (int k = 0; k < n; k++)
+        {
+            int a_v1 = ABS(dv1[k]);
+            int a_v2 = ABS(dv2[k]);
+            int a_h1 = ABS(dh1[k]);
+            int a_h2 = ABS(dh2[k]);
+            int sum = a_h1 + a_h2 + a_v1 + a_v2;
+            double div = 3.0 * (sum ? sum : 1);
+
+            int cv1 = (int)(((sum - a_v1) << 8) / div);
+            int cv2 = (int)(((sum - a_v2) << 8) / div);
+            int ch1 = (int)(((sum - a_h1) << 8) / div);
+            int ch2 = (int)(((sum - a_h2) << 8) / div);
+
+            int ev = ((ev_v1[k] * cv1) >> 8) + ((ev_v2[k] * cv2) >> 8) + ((ev_h1[k] * ch1) >> 8) + ((ev_h2[k] * ch2) >> 8);
+
+            /* -1 marks flat surroundings, the right neighbour is copied then */
+            ev_corr[k] = sum ? COERCE(ev, 0, 14*EV_RESOLUTION-1) : -1;
+        }
+
+        for (int k = 0; k < n; k++)
+        {
+            uint16_t * p = &first[k * step];
+            *p = ev_corr[k] < 0 ? p[2] : ev2raw[ev_corr[k]];
+        }
+    }
+}
+
 /* following code is for bad/focus pixel processing **********************************************/
 
 /* focus pixel helper enums */
@@ -278,22 +338,22 @@ enum video_mode { MV_NONE, MV_720,   MV_1080,   MV_1080CROP,   MV_ZOOM,   MV_CRO
 /* pixel map type */
 enum { PIX_FOCUS, PIX_BAD };
 
-struct pixel_xy
-{
-    int x;
-    int y;
-};
-
+/* the pixels are collected in 'pixels' and then turned into sorted 'runs', which are used for interpolation */
 struct pixel_map
 {
     int type;
     size_t count;
     size_t capacity;
     struct pixel_xy * pixels;
+    pixel_runs_t runs;
 };
 
-static struct pixel_map focus_pixel_map = { PIX_FOCUS, 0, 0, NULL };
-static struct pixel_map bad_pixel_map = { PIX_BAD, 0, 0, NULL };
+static struct pixel_map focus_pixel_map = { PIX_FOCUS, 0, 0, NULL, { 0 } };
+static struct pixel_map bad_pixel_map = { PIX_BAD, 0, 0, NULL, { 0 } };
+
+/* 0 = not loaded yet, see fix_focus_pixels() and fix_bad_pixels() */
+static int fpm_status = 0;
+static int bpm_status = 0;
 
 static int add_pixel_to_map(struct pixel_map * map, int x, int y)
 {
@@ -412,6 +472,116 @@ static void save_pixel_map(struct pixel_map * map, char * mlv_name, int show_pro
     fclose(f);
 }
 
+/* turn the collected pixels into runs and put them into the cache, if there is one */
+static void finish_pixel_map(struct pixel_map * map, pixel_cache_hdr_t * key, char * cache_dir)
+{
+    if(pixel_runs_build(&map->runs, map->pixels, map->count))
+    {
+        err_printf("malloc error\n");
+    }
+
+    free(map->pixels);
+    map->pixels = NULL;
+    map->count = 0;
+    map->capacity = 0;
+
+    if(cache_dir && pixel_cache_save(cache_dir, key, &map->runs))
+    {
+        err_printf("Can not write pixel map cache to '%s'\n", cache_dir);
+    }
+}
+
+static int load_cached_pixel_map(struct pixel_map * map, pixel_cache_hdr_t * key, char * cache_dir, int show_progress)
+{
+    if(!cache_dir || pixel_cache_load(cache_dir, key, &map->runs))
+    {
+        return 0;
+    }
+
+    if (show_progress)
+    {
+        printf("\nUsing cached %s pixel map: %u pixels in %u runs\n", map->type ? "bad" : "focus", map->runs.pixel_count, map->runs.run_count);
+    }
+    return 1;
+}
+
+/* camera and sensor area a map is valid for */
+static void pixel_cache_key(pixel_cache_hdr_t * key, int type, struct parameter_list * par)
+{
+    memset(key, 0, sizeof(pixel_cache_hdr_t));
+    key->type = type;
+    key->camera_id = par->camera_id;
+    key->raw_width = par->raw_width;
+    key->raw_height = par->raw_height;
+}
+
+/* interpolate one pixel of a map, x and y are image coordinates */
+static inline void interpolate_map_pixel(uint16_t * image_data, int x, int y, int w, int h, int dual_iso, int method, int * raw2ev, int * ev2raw)
+{
+    int i = x + y*w;
+    if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
+    {
+        if(dual_iso)
+        {
+            interpolate_horizontal(image_data, i, raw2ev, ev2raw);
+        }
+        else if(method)
+        {
+            interpolate_pixel(image_data, x, y, w, h);
+        }
+        else
+        {
+            interpolate_around(image_data, i, w, raw2ev, ev2raw);
+        }
+    }
+    else if(i > 0 && i < w * h)
+    {
+        // handle edge pixels
+        int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
+        int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
+
+        if (horizontal_edge && !vertical_edge && !dual_iso)
+        {
+            interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
+        }
+        else if (vertical_edge && !horizontal_edge)
+        {
+            interpolate_horizontal(image_data, i, raw2ev, ev2raw);
+        }
+        else if(x >= 0 && x <= 3)
+        {
+            image_data[i] = image_data[i + 2];
+        }
+        else if(x >= w - 3 && x < w)
+        {
+            image_data[i] = image_data[i - 2];
+        }
+    }
+}
+
+/* walk the sorted runs in order. runs that are completely inside the image take the batch path */
+static void interpolate_pixel_map(struct pixel_map * map, uint16_t * image_data, int w, int h, int cropX, int cropY, int dual_iso, int method, int * raw2ev, int * ev2raw)
+{
+    for (uint32_t r = 0; r < map->runs.run_count; r++)
+    {
+        const pixel_run_t * run = &map->runs.runs[r];
+        int x = run->x - cropX;
+        int y = run->y - cropY;
+        int last = x + (run->count - 1) * run->step;
+
+        if (!dual_iso && !method && run->step > 3 && x > 2 && last < w - 3 && y > 2 && y < h - 3)
+        {
+            interpolate_around_run(image_data, x + y*w, run->count, run->step, w, raw2ev, ev2raw);
+            continue;
+        }
+
+        for (int k = 0; k < run->count; k++)
+        {
+            interpolate_map_pixel(image_data, x + k * run->step, y, w, h, dual_iso, method, raw2ev, ev2raw);
+        }
+    }
+}
+
 /* normal mode pattern generators ****************************************************************/
 
 /* generate the focus pixel pattern for mv720 video mode */
@@ -1019,14 +1189,26 @@ void fix_focus_pixels(uint16_t * image_data, struct parameter_list par)
         return;
     }
 
-    static int fpm_status = 0;
+    /* focus pixels only depend on the camera model and the video mode */
+    enum pattern pattern = fpm_get_pattern(par.camera_id);
+    enum video_mode video_mode = fpm_get_video_mode(par.raw_width, par.raw_height, par.crop_rec, par.unified);
+    pixel_cache_hdr_t key;
+    pixel_cache_key(&key, PIX_FOCUS, &par);
+    key.mode[0] = pattern;
+    key.mode[1] = video_mode;
+
 fpm_check:
     // fpm_status: 0 = not loaded, 1 = not exists (generate), 2 = loaded/generated (interpolate), 3 = no focus pixel map is generated (unsupported camera)
     switch(fpm_status)
     {
-        case 0: // load fpm
+        case 0: // load fpm, or the cached map
         {
             if(load_pixel_map(&focus_pixel_map, par.mlv_name, par.camera_id, par.raw_width, par.raw_height, par.dual_iso, par.show_progress))
+            {
+                finish_pixel_map(&focus_pixel_map, &key, NULL);
+                fpm_status = 2;
+            }
+            else if(pattern != PATTERN_NONE && load_cached_pixel_map(&focus_pixel_map, &key, par.cache_dir, par.show_progress))
             {
                 fpm_status = 2;
             }
@@ -1039,14 +1221,12 @@ fpm_check:
         
         case 1: // generate pixel pattern
         {
-            enum pattern pattern = fpm_get_pattern(par.camera_id);
             if(pattern == PATTERN_NONE)
             {
                 fpm_status = 3;
             }
             else
             {
-                enum video_mode video_mode = fpm_get_video_mode(par.raw_width, par.raw_height, par.crop_rec, par.unified);
                 if (par.show_progress) printf("\nGenerating focus pixel map for ");
                 switch(video_mode)
                 {
@@ -1105,6 +1285,7 @@ fpm_check:
                 }
                 if (par.show_progress) printf(""FMT_SIZE" pixels generated\n", focus_pixel_map.count);
 
+                finish_pixel_map(&focus_pixel_map, &key, par.cache_dir);
                 fpm_status = 2;
             }
             goto fpm_check;
@@ -1112,56 +1293,93 @@ fpm_check:
 
         case 2: // interpolate pixels
         {
-            for (size_t m = 0; m < focus_pixel_map.count; m++)
-            {
-                int x = focus_pixel_map.pixels[m].x - cropX;
-                int y = focus_pixel_map.pixels[m].y - cropY;
+            interpolate_pixel_map(&focus_pixel_map, image_data, w, h, cropX, cropY, par.dual_iso, par.fpi_method, raw2ev, ev2raw);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+/* search hot and cold pixels in a band of rows, the bands are scanned in parallel */
+struct bad_pixel_scan
+{
+    pool_job_t job;
+    int y_start;
+    int y_end;
+    struct pixel_map found;
+};
+
+struct bad_pixel_scan_ctx
+{
+    uint16_t * image_data;
+    int w;
+    int dark_min;
+    int dark_max;
+    int aggressive;
+    int cropX;
+    int cropY;
+    int * raw2ev;
+};
 
-                int i = x + y*w;
-                if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
+static void scan_bad_pixels(pool_job_t * job, int worker, void * arg)
+{
+    struct bad_pixel_scan * scan = (struct bad_pixel_scan *)job;
+    struct bad_pixel_scan_ctx * ctx = (struct bad_pixel_scan_ctx *)arg;
+    uint16_t * image_data = ctx->image_data;
+    int * raw2ev = ctx->raw2ev;
+    int w = ctx->w;
+    int x,y;
+
+    (void)worker;
+
+    for (y = scan->y_start; y < scan->y_end; y ++)
+    {
+        for (x = 6; x < w - 6; x ++)
+        {
+            int p = image_data[x + y * w];
+            
+            int neighbours[10];
+            int max1 = 0;
+            int max2 = 0;
+            int k = 0;
+            for (int i = -2; i <= 2; i+=2)
+            {
+                for (int j = -2; j <= 2; j+=2)
                 {
-                    if(par.dual_iso)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(par.fpi_method)
+                    if (i == 0 && j == 0) continue;
+                    int q = -(int)image_data[(x + j) + (y + i) * w];
+                    neighbours[k++] = q;
+                    if(q <= max1)
                     {
-                        interpolate_pixel(image_data, x, y, w, h);
+                        max2 = max1;
+                        max1 = q;
                     }
-                    else
+                    else if(q <= max2)
                     {
-                        interpolate_around(image_data, i, w, raw2ev, ev2raw);
+                        max2 = q;
                     }
                 }
-                else if(i > 0 && i < w * h)
+            }
+            
+            if (p < ctx->dark_min) //cold pixel
+            {
+                add_pixel_to_map(&scan->found, x + ctx->cropX, y + ctx->cropY);
+            }
+            else if ((raw2ev[p] - raw2ev[-max2] > 2 * EV_RESOLUTION) && (p > ctx->dark_max)) //hot pixel
+            {
+                add_pixel_to_map(&scan->found, x + ctx->cropX, y + ctx->cropY);
+            }
+            else if (ctx->aggressive)
+            {
+                int max3 = kth_smallest_int(neighbours, k, 2);
+                if(((raw2ev[p] - raw2ev[-max2] > EV_RESOLUTION) || (raw2ev[p] - raw2ev[-max3] > EV_RESOLUTION)) && (p > ctx->dark_max))
                 {
-                    // handle edge pixels
-                    int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
-                    int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
-                    
-                    if (horizontal_edge && !vertical_edge && !par.dual_iso)
-                    {
-                        interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
-                    }
-                    else if (vertical_edge && !horizontal_edge)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(x >= 0 && x <= 3)
-                    {
-                        image_data[i] = image_data[i + 2];
-                    }
-                    else if(x >= w - 3 && x < w)
-                    {
-                        image_data[i] = image_data[i - 2];
-                    }
+                    add_pixel_to_map(&scan->found, x + ctx->cropX, y + ctx->cropY);
                 }
             }
-            break;
-        }
-        default:
-        {
-            break;
         }
     }
 }
@@ -1182,17 +1400,40 @@ void fix_bad_pixels(uint16_t * image_data, struct parameter_list par)
         return;
     }
 
-    static int bpm_status = 0;
+    pixel_cache_hdr_t key;
+
+    /* bad pixels belong to the camera body and are searched in the recorded area only */
+    if(bpm_status < 2)
+    {
+        pixel_cache_key(&key, PIX_BAD, &par);
+        if(par.camera_serial)
+        {
+            strncpy(key.camera_serial, par.camera_serial, sizeof(key.camera_serial) - 1);
+            key.camera_serial[sizeof(key.camera_serial) - 1] = '\0';
+        }
+        key.mode[0] = cropX;
+        key.mode[1] = cropY;
+        key.mode[2] = w;
+        key.mode[3] = h;
+        key.mode[4] = black;
+        key.mode[5] = par.aggressive;
+    }
+
 bpm_check:
     // bpm_status: 0 = not loaded, 1 = not exists (search), 2 = loaded/found (interpolate), 3 = no bad pixels found
     switch(bpm_status)
     {
-        case 0: // load bpm
+        case 0: // load bpm, or the cached map
         {
             if(load_pixel_map(&bad_pixel_map, par.mlv_name, par.camera_id, par.raw_width, par.raw_height, par.dual_iso, par.show_progress))
             {
+                finish_pixel_map(&bad_pixel_map, &key, NULL);
                 bpm_status = 2;
             }
+            else if(load_cached_pixel_map(&bad_pixel_map, &key, par.cache_dir, par.show_progress))
+            {
+                bpm_status = bad_pixel_map.runs.pixel_count ? 2 : 3;
+            }
             else
             {
                 bpm_status = 1;
@@ -1203,56 +1444,61 @@ bpm_check:
         {
             //just guess the dark noise for speed reasons
             int dark_noise = 12 ;
-            int dark_min = black - (dark_noise * 8);
-            int dark_max = black + (dark_noise * 8);
-            int x,y;
-            for (y = 6; y < h - 6; y ++)
+            struct bad_pixel_scan_ctx ctx =
+            {
+                image_data, w,
+                black - (dark_noise * 8),
+                black + (dark_noise * 8),
+                par.aggressive, cropX, cropY, raw2ev
+            };
+
+            /* bands of rows, in parallel if possible. the pixels of all bands are in row order afterwards */
+            int threads = pool_cpu_count();
+            int bands = MAX(1, MIN(4 * threads, (h - 12) / 16));
+            struct bad_pixel_scan * scans = calloc(bands, sizeof(struct bad_pixel_scan));
+            thread_pool_t * pool = (scans && threads > 1 && bands > 1) ? pool_create(threads, &scan_bad_pixels, &ctx) : NULL;
+
+            if(!scans)
+            {
+                err_printf("malloc error\n");
+                bpm_status = 3;
+                goto bpm_check;
+            }
+
+            for (int band = 0; band < bands; band++)
             {
-                for (x = 6; x < w - 6; x ++)
+                scans[band].y_start = 6 + (h - 12) * band / bands;
+                scans[band].y_end = 6 + (h - 12) * (band + 1) / bands;
+                scans[band].found.type = PIX_BAD;
+
+                if(pool)
                 {
-                    int p = image_data[x + y * w];
-                    
-                    int neighbours[10];
-                    int max1 = 0;
-                    int max2 = 0;
-                    int k = 0;
-                    for (int i = -2; i <= 2; i+=2)
-                    {
-                        for (int j = -2; j <= 2; j+=2)
-                        {
-                            if (i == 0 && j == 0) continue;
-                            int q = -(int)image_data[(x + j) + (y + i) * w];
-                            neighbours[k++] = q;
-                            if(q <= max1)
-                            {
-                                max2 = max1;
-                                max1 = q;
-                            }
-                            else if(q <= max2)
-                            {
-                                max2 = q;
-                            }
-                        }
-                    }
-                    
-                    if (p < dark_min) //cold pixel
-                    {
-                        add_pixel_to_map(&bad_pixel_map, x + cropX, y + cropY);
-                    }
-                    else if ((raw2ev[p] - raw2ev[-max2] > 2 * EV_RESOLUTION) && (p > dark_max)) //hot pixel
-                    {
-                        add_pixel_to_map(&bad_pixel_map, x + cropX, y + cropY);
-                    }
-                    else if (par.aggressive)
-                    {
-                        int max3 = kth_smallest_int(neighbours, k, 2);
-                        if(((raw2ev[p] - raw2ev[-max2] > EV_RESOLUTION) || (raw2ev[p] - raw2ev[-max3] > EV_RESOLUTION)) && (p > dark_max))
-                        {
-                            add_pixel_to_map(&bad_pixel_map, x + cropX, y + cropY);
-                        }
-                    }
+                    pool_submit(pool, &scans[band].job);
+                }
+                else
+                {
+                    scan_bad_pixels(&scans[band].job, 0, &ctx);
                 }
             }
+
+            for (int band = 0; band < bands; band++)
+            {
+                if(pool)
+                {
+                    pool_wait(pool, &scans[band].job);
+                }
+                for (size_t m = 0; m < scans[band].found.count; m++)
+                {
+                    add_pixel_to_map(&bad_pixel_map, scans[band].found.pixels[m].x, scans[band].found.pixels[m].y);
+                }
+                free(scans[band].found.pixels);
+            }
+
+            if(pool)
+            {
+                pool_destroy(pool);
+            }
+            free(scans);
             
             if (par.show_progress)
             {
@@ -1272,69 +1518,21 @@ bpm_check:
                 if (!bad_pixel_map.count && par.save_bpm) printf("Bad pixel map file not written\n");
             }
 
-            if (bad_pixel_map.count)
-            {
-                if (par.save_bpm)
-                {
-                    /* if save_bpm is non zero - save bad pixels to a file */
-                    save_pixel_map(&bad_pixel_map, par.mlv_name, par.show_progress);
-                }
-                bpm_status = 2; // bad pixels found, goto interpolation stage
-            }
-            else
+            if (bad_pixel_map.count && par.save_bpm)
             {
-                bpm_status = 3; // bad pixels not found, interpolation not needed
+                /* if save_bpm is non zero - save bad pixels to a file */
+                save_pixel_map(&bad_pixel_map, par.mlv_name, par.show_progress);
             }
 
+            /* also cache an empty map, so the next run does not search again */
+            bpm_status = bad_pixel_map.count ? 2 : 3; // bad pixels found, goto interpolation stage, otherwise interpolation not needed
+            finish_pixel_map(&bad_pixel_map, &key, par.cache_dir);
+
             goto bpm_check;
         }
         case 2: // interpolate pixels
         {
-            for (size_t m = 0; m < bad_pixel_map.count; m++)
-            {
-                int x = bad_pixel_map.pixels[m].x - cropX;
-                int y = bad_pixel_map.pixels[m].y - cropY;
-               
-                int i = x + y*w;
-                if (x > 2 && x < w - 3 && y > 2 && y < h - 3)
-                {
-                    if(par.dual_iso)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(par.bpi_method)
-                    {
-                        interpolate_pixel(image_data, x, y, w, h);
-                    }
-                    else
-                    {
-                        interpolate_around(image_data, i, w, raw2ev, ev2raw);
-                    }
-                }
-                else if(i > 0 && i < w * h)
-                {
-                    // handle edge pixels
-                    int horizontal_edge = (x >= w - 3 && x < w) || (x >= 0 && x <= 3);
-                    int vertical_edge = (y >= h - 3 && y < h) || (y >= 0 && y <= 3);
-
-                    if (horizontal_edge && !vertical_edge && !par.dual_iso)
-                    {
-                        interpolate_vertical(image_data, i, w, raw2ev, ev2raw);
-                    }
-                    else if (vertical_edge && !horizontal_edge)
-                    {
-                        interpolate_horizontal(image_data, i, raw2ev, ev2raw);
-                    }
-                    else if(x >= 0 && x <= 3)
-                    {
-                        image_data[i] = image_data[i + 2];
-                    }
-                    else if(x >= w - 3 && x < w)
-                    {
-                        image_data[i] = image_data[i - 2];
-                    }
-                }
-            }
+            interpolate_pixel_map(&bad_pixel_map, image_data, w, h, cropX, cropY, par.dual_iso, par.bpi_method, raw2ev, ev2raw);
             break;
         }
         default:
@@ -1348,4 +1546,14 @@ void free_pixel_maps()
 {
     if(focus_pixel_map.pixels) free(focus_pixel_map.pixels);
     if(bad_pixel_map.pixels) free(bad_pixel_map.pixels);
+    pixel_runs_free(&focus_pixel_map.runs);
+    pixel_runs_free(&bad_pixel_map.runs);
+
+    /* the next frame loads or generates them again, e.g. for another clip */
+    focus_pixel_map.count = focus_pixel_map.capacity = 0;
+    focus_pixel_map.pixels = NULL;
+    bad_pixel_map.count = bad_pixel_map.capacity = 0;
+    bad_pixel_map.pixels = NULL;
+    fpm_status = 0;
+    bpm_status = 0;
 }
@@ -44,6 +44,8 @@ struct parameter_list
 	int32_t raw_width;
 	int32_t raw_height;
 	int32_t black_level;
+	char * camera_serial; // bad pixel maps are cached per camera body
+	char * cache_dir; // cache precomputed pixel maps here, NULL = no cache
 };
 
 /* do chroma smoothing with methods: 2x2, 3x3 and 5x5 */
@@ -52,7 +54,7 @@ void chroma_smooth(uint16_t * image_data, int width, int height, int black, int
 void fix_focus_pixels(uint16_t * image_data, struct parameter_list par);
 /* fix all kind of bad raw pixels */
 void fix_bad_pixels(uint16_t * image_data, struct parameter_list par);
-/* free bufers used for raw processing */
+/* free bufers used for raw processing, the maps get loaded or generated again for the next frame */
 void free_pixel_maps();
 
 #endif
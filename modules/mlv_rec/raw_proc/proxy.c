@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "proxy.h"
+#include "bitpack.h"
+#include "../thread_pool.h"
+
+/* unpacked raw rows get mirrored pixels on both sides, so the bilinear debayer needs no border checks */
+#define PROXY_PAD       2
+
+/* bands per thread, frames with busy and calm areas still keep all threads busy */
+#define PROXY_BANDS     4
+
+struct proxy_job
+{
+    pool_job_t job;                 /* must be first, see thread_pool.h */
+    proxy_t * proxy;
+    const uint8_t * frame;
+    int y_start;                    /* output rows, even */
+    int y_end;
+};
+
+struct proxy_worker
+{
+    uint16_t * rows[4];             /* ring of unpacked raw rows, slot is the row number & 3 */
+    int row_numbers[4];
+    uint8_t * rgb;                  /* two output rows */
+};
+
+struct proxy
+{
+    struct proxy_params params;
+
+    uint8_t * lut[3];               /* raw value to 8 bit output per color */
+    uint8_t * out;
+    size_t out_size;
+
+    thread_pool_t * pool;
+    struct proxy_worker * workers;
+    struct proxy_job * jobs;
+
+    int out_width;
+    int out_height;
+    int pitch;                      /* bytes per packed raw row */
+
+    int color[4];                   /* color of the cell (y & 1) * 2 + (x & 1): 0 red, 1 green, 2 blue */
+    int red;                        /* cells of the colors */
+    int green[2];
+    int blue;
+
+    int header_written;
+    int threads;
+    int job_count;
+};
+
+/* the raw row 'y', reflected at the borders so the colors stay in place */
+static const uint16_t * proxy_row(proxy_t * proxy, struct proxy_worker * work, const uint8_t * frame, int y)
+{
+    int w = proxy->params.width;
+    int h = proxy->params.height;
+
+    if(y < 0)
+    {
+        y = -y;
+    }
+    if(y >= h)
+    {
+        y = 2 * (h - 1) - y;
+    }
+
+    int slot = y & 3;
+    uint16_t * row = work->rows[slot] + PROXY_PAD;
+
+    if(work->row_numbers[slot] != y)
+    {
+        bitpack_unpack((const uint16_t *)&frame[(size_t)y * proxy->pitch], row, w, proxy->params.bpp);
+
+        for (int x = 1; x <= PROXY_PAD; x++)
+        {
+            row[-x] = row[x];
+            row[w - 1 + x] = row[w - 1 - x];
+        }
+        work->row_numbers[slot] = y;
+    }
+
+    return row;
+}
+
+/* every 2x2 cell becomes one pixel, the greens get averaged */
+static void proxy_half_row(proxy_t * proxy, const uint16_t * r0, const uint16_t * r1, uint8_t * rgb)
+{
+    const uint8_t * lut_r = proxy->lut[0];
+    const uint8_t * lut_g = proxy->lut[1];
+    const uint8_t * lut_b = proxy->lut[2];
+    int red = proxy->red;
+    int green0 = proxy->green[0];
+    int green1 = proxy->green[1];
+    int blue = proxy->blue;
+
+    for (int x = 0; x < proxy->out_width; x++)
+    {
+        uint32_t cell[4] = { r0[2 * x], r0[2 * x + 1], r1[2 * x], r1[2 * x + 1] };
+
+        rgb[0] = lut_r[cell[red]];
+        rgb[1] = lut_g[(cell[green0] + cell[green1]) >> 1];
+        rgb[2] = lut_b[cell[blue]];
+        rgb += 3;
+    }
+}
+
+/* the missing colors are the mean of the nearest pixels of that color */
+static void proxy_bilinear_row(proxy_t * proxy, const uint16_t * up, const uint16_t * mid, const uint16_t * down, int y, uint8_t * rgb)
+{
+    const int * color = &proxy->color[(y & 1) * 2];
+
+    for (int x = 0; x < proxy->out_width; x++)
+    {
+        int c = color[x & 1];
+        uint32_t value[3];
+
+        if(c == 1)
+        {
+            /* green: the row's other color left and right, the third one above and below */
+            int row_color = color[(x + 1) & 1];
+
+            value[1] = mid[x];
+            value[row_color] = (mid[x - 1] + mid[x + 1]) >> 1;
+            value[2 - row_color] = (up[x] + down[x]) >> 1;
+        }
+        else
+        {
+            value[c] = mid[x];
+            value[1] = (mid[x - 1] + mid[x + 1] + up[x] + down[x]) >> 2;
+            value[2 - c] = (up[x - 1] + up[x + 1] + down[x - 1] + down[x + 1]) >> 2;
+        }
+
+        rgb[0] = proxy->lut[0][value[0]];
+        rgb[1] = proxy->lut[1][value[1]];
+        rgb[2] = proxy->lut[2][value[2]];
+        rgb += 3;
+    }
+}
+
+/* BT.709 limited range, chroma of the 2x2 block */
+static void proxy_yuv_rows(const uint8_t * rgb0, const uint8_t * rgb1, int w, uint8_t * y0, uint8_t * y1, uint8_t * u, uint8_t * v)
+{
+    for (int x = 0; x < w; x++)
+    {
+        y0[x] = (uint8_t)(16 + ((47 * rgb0[3 * x] + 157 * rgb0[3 * x + 1] + 16 * rgb0[3 * x + 2] + 128) >> 8));
+        y1[x] = (uint8_t)(16 + ((47 * rgb1[3 * x] + 157 * rgb1[3 * x + 1] + 16 * rgb1[3 * x + 2] + 128) >> 8));
+    }
+
+    for (int x = 0; x < w / 2; x++)
+    {
+        int r = rgb0[6 * x] + rgb0[6 * x + 3] + rgb1[6 * x] + rgb1[6 * x + 3];
+        int g = rgb0[6 * x + 1] + rgb0[6 * x + 4] + rgb1[6 * x + 1] + rgb1[6 * x + 4];
+        int b = rgb0[6 * x + 2] + rgb0[6 * x + 5] + rgb1[6 * x + 2] + rgb1[6 * x + 5];
+
+        u[x] = (uint8_t)((-26 * r - 86 * g + 112 * b + (128 << 10) + 512) >> 10);
+        v[x] = (uint8_t)((112 * r - 102 * g - 10 * b + (128 << 10) + 512) >> 10);
+    }
+}
+
+static void proxy_run_job(pool_job_t * job, int worker, void * arg)
+{
+    struct proxy_job * band = (struct proxy_job *)job;
+    proxy_t * proxy = band->proxy;
+    struct proxy_worker * work = &proxy->workers[worker];
+    int w = proxy->out_width;
+    int h = proxy->out_height;
+    (void)arg;
+
+    /* a new frame, nothing in the ring is valid */
+    for (int slot = 0; slot < 4; slot++)
+    {
+        work->row_numbers[slot] = -1;
+    }
+
+    for (int y = band->y_start; y < band->y_end; y += 2)
+    {
+        uint8_t * rgb[2];
+
+        for (int row = 0; row < 2; row++)
+        {
+            int out_y = y + row;
+
+            rgb[row] = proxy->params.format == PROXY_RGB ? &proxy->out[(size_t)out_y * w * 3] : &work->rgb[row * w * 3];
+
+            if(proxy->params.debayer == PROXY_HALF)
+            {
+                const uint16_t * r0 = proxy_row(proxy, work, band->frame, 2 * out_y);
+                const uint16_t * r1 = proxy_row(proxy, work, band->frame, 2 * out_y + 1);
+
+                proxy_half_row(proxy, r0, r1, rgb[row]);
+            }
+            else
+            {
+                const uint16_t * up = proxy_row(proxy, work, band->frame, out_y - 1);
+                const uint16_t * mid = proxy_row(proxy, work, band->frame, out_y);
+                const uint16_t * down = proxy_row(proxy, work, band->frame, out_y + 1);
+
+                proxy_bilinear_row(proxy, up, mid, down, out_y, rgb[row]);
+            }
+        }
+
+        if(proxy->params.format != PROXY_RGB)
+        {
+            uint8_t * plane_y = proxy->out;
+            uint8_t * plane_u = plane_y + (size_t)w * h;
+            uint8_t * plane_v = plane_u + (size_t)(w / 2) * (h / 2);
+
+            proxy_yuv_rows(rgb[0], rgb[1], w, &plane_y[(size_t)y * w], &plane_y[(size_t)(y + 1) * w],
+                           &plane_u[(size_t)(y / 2) * (w / 2)], &plane_v[(size_t)(y / 2) * (w / 2)]);
+        }
+    }
+}
+
+proxy_t * proxy_create(const struct proxy_params * params, int threads)
+{
+    if(params->width < 4 || params->height < 4 || params->bpp < 10 || params->bpp > 16 ||
+       params->white <= params->black || params->gamma <= 0 || (params->width * params->bpp) % 16)
+    {
+        return NULL;
+    }
+
+    proxy_t * proxy = calloc(1, sizeof(proxy_t));
+
+    if(!proxy)
+    {
+        return NULL;
+    }
+
+    proxy->params = *params;
+    proxy->threads = threads > 1 ? threads : 1;
+    proxy->pitch = params->width * params->bpp / 8;
+
+    if(params->debayer == PROXY_HALF)
+    {
+        proxy->out_width = (params->width / 2) & ~1;
+        proxy->out_height = (params->height / 2) & ~1;
+    }
+    else
+    {
+        proxy->out_width = params->width & ~1;
+        proxy->out_height = params->height & ~1;
+    }
+
+    /* one red, two green and one blue cell, else this is no bayer pattern */
+    int counts[3] = { 0, 0, 0 };
+
+    for (int cell = 0; cell < 4; cell++)
+    {
+        int c = (params->cfa_pattern >> (8 * cell)) & 0xFF;
+
+        if(c > 2)
+        {
+            free(proxy);
+            return NULL;
+        }
+        proxy->color[cell] = c;
+        if(c == 0)
+        {
+            proxy->red = cell;
+        }
+        else if(c == 1)
+        {
+            proxy->green[counts[1] & 1] = cell;
+        }
+        else
+        {
+            proxy->blue = cell;
+        }
+        counts[c]++;
+    }
+
+    if(counts[0] != 1 || counts[1] != 2 || counts[2] != 1)
+    {
+        free(proxy);
+        return NULL;
+    }
+
+    size_t pixels = (size_t)proxy->out_width * proxy->out_height;
+    proxy->out_size = params->format == PROXY_RGB ? pixels * 3 : pixels * 3 / 2;
+    proxy->out = malloc(proxy->out_size);
+
+    /* levels, white balance and gamma in one table per color */
+    int ok = proxy->out != NULL;
+    int values = 1 << params->bpp;
+
+    for (int c = 0; ok && c < 3; c++)
+    {
+        proxy->lut[c] = malloc(values);
+        ok = proxy->lut[c] != NULL;
+
+        for (int value = 0; ok && value < values; value++)
+        {
+            double level = (double)(value - params->black) / (params->white - params->black) * params->wb[c];
+
+            level = level < 0 ? 0 : level > 1 ? 1 : level;
+            proxy->lut[c][value] = (uint8_t)(pow(level, 1.0 / params->gamma) * 255.0 + 0.5);
+        }
+    }
+
+    proxy->workers = calloc(proxy->threads, sizeof(struct proxy_worker));
+    ok = ok && proxy->workers;
+
+    for (int i = 0; ok && i < proxy->threads; i++)
+    {
+        for (int slot = 0; ok && slot < 4; slot++)
+        {
+            proxy->workers[i].rows[slot] = malloc((params->width + 2 * PROXY_PAD) * sizeof(uint16_t));
+            ok = proxy->workers[i].rows[slot] != NULL;
+        }
+        proxy->workers[i].rgb = malloc((size_t)proxy->out_width * 3 * 2);
+        ok = ok && proxy->workers[i].rgb;
+    }
+
+    /* bands of output rows, in pairs for the 4:2:0 chroma */
+    int pairs = proxy->out_height / 2;
+
+    proxy->job_count = proxy->threads > 1 ? proxy->threads * PROXY_BANDS : 1;
+    proxy->job_count = proxy->job_count < pairs ? proxy->job_count : pairs;
+    proxy->jobs = calloc(proxy->job_count, sizeof(struct proxy_job));
+    ok = ok && proxy->jobs;
+
+    for (int i = 0; ok && i < proxy->job_count; i++)
+    {
+        proxy->jobs[i].proxy = proxy;
+        proxy->jobs[i].y_start = 2 * (pairs * i / proxy->job_count);
+        proxy->jobs[i].y_end = 2 * (pairs * (i + 1) / proxy->job_count);
+    }
+
+    if(ok && proxy->threads > 1)
+    {
+        proxy->pool = pool_create(proxy->threads, &proxy_run_job, NULL);
+        ok = proxy->pool != NULL;
+    }
+
+    if(!ok)
+    {
+        proxy_free(proxy);
+        return NULL;
+    }
+
+    return proxy;
+}
+
+void proxy_size(proxy_t * proxy, int * width, int * height)
+{
+    *width = proxy->out_width;
+    *height = proxy->out_height;
+}
+
+int proxy_write_frame(proxy_t * proxy, const uint8_t * frame, FILE * out)
+{
+    for (int i = 0; i < proxy->job_count; i++)
+    {
+        proxy->jobs[i].frame = frame;
+
+        if(proxy->pool)
+        {
+            pool_submit(proxy->pool, &proxy->jobs[i].job);
+        }
+        else
+        {
+            proxy_run_job(&proxy->jobs[i].job, 0, NULL);
+        }
+    }
+
+    if(proxy->pool)
+    {
+        for (int i = 0; i < proxy->job_count; i++)
+        {
+            pool_wait(proxy->pool, &proxy->jobs[i].job);
+        }
+    }
+
+    if(proxy->params.format == PROXY_Y4M)
+    {
+        if(!proxy->header_written)
+        {
+            uint32_t fps_nom = proxy->params.fps_nom ? proxy->params.fps_nom : 25;
+            uint32_t fps_denom = proxy->params.fps_denom ? proxy->params.fps_denom : 1;
+
+            if(fprintf(out, "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C420jpeg\n", proxy->out_width, proxy->out_height, fps_nom, fps_denom) < 0)
+            {
+                return -1;
+            }
+            proxy->header_written = 1;
+        }
+        if(fputs("FRAME\n", out) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return fwrite(proxy->out, proxy->out_size, 1, out) == 1 ? 0 : -1;
+}
+
+void proxy_free(proxy_t * proxy)
+{
+    if(!proxy)
+    {
+        return;
+    }
+
+    if(proxy->pool)
+    {
+        pool_destroy(proxy->pool);
+    }
+
+    for (int i = 0; proxy->workers && i < proxy->threads; i++)
+    {
+        for (int slot = 0; slot < 4; slot++)
+        {
+            free(proxy->workers[i].rows[slot]);
+        }
+        free(proxy->workers[i].rgb);
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        free(proxy->lut[c]);
+    }
+
+    free(proxy->workers);
+    free(proxy->jobs);
+    free(proxy->out);
+    free(proxy);
+}
+
+const char * proxy_format_name(enum proxy_format format)
+{
+    switch(format)
+    {
+        case PROXY_YUV: return "YUV 4:2:0";
+        case PROXY_RGB: return "RGB24";
+        default: return "YUV4MPEG2";
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _proxy_h
+#define _proxy_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+  8 bit proxy video from packed raw frames, for piping into an encoder:
+  black/white level and white balance (one lookup table per color, along with the gamma curve),
+  then either a half resolution debayer (every 2x2 cell becomes one pixel) or a full resolution
+  bilinear one. written as YUV4MPEG2 or raw 4:2:0 YUV (BT.709, limited range) or as raw RGB24.
+  the output is cropped to even sizes. the rows get converted in bands on 'threads' threads.
+*/
+
+enum proxy_format
+{
+    PROXY_Y4M = 0,
+    PROXY_YUV,
+    PROXY_RGB,
+};
+
+enum proxy_debayer
+{
+    PROXY_HALF = 0,
+    PROXY_BILINEAR,
+};
+
+struct proxy_params
+{
+    int width;
+    int height;
+    int bpp;
+    int black;
+    int white;
+    uint32_t cfa_pattern;           /* as in raw_info, 0x02010100 is RGGB */
+    double wb[3];                   /* R, G and B multipliers */
+    double gamma;
+    enum proxy_format format;
+    enum proxy_debayer debayer;
+    uint32_t fps_nom;               /* only for the YUV4MPEG2 header */
+    uint32_t fps_denom;
+};
+
+typedef struct proxy proxy_t;
+
+proxy_t * proxy_create(const struct proxy_params * params, int threads);
+
+/* output size */
+void proxy_size(proxy_t * proxy, int * width, int * height);
+
+/* convert one packed frame and write it. returns 0 on success */
+int proxy_write_frame(proxy_t * proxy, const uint8_t * frame, FILE * out);
+
+void proxy_free(proxy_t * proxy);
+
+const char * proxy_format_name(enum proxy_format format);
+
+#endif
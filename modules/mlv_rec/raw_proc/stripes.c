@@ -345,6 +345,16 @@ static void apply_vertical_stripes_correction(stripes_correction * correction,
     }
 }
 
+/* detected from the first frame, see fix_vertical_stripes() */
+static stripes_correction correction;
+static int first_time = 1;
+
+void reset_vertical_stripes()
+{
+    memset(&correction, 0, sizeof(correction));
+    first_time = 1;
+}
+
 void fix_vertical_stripes(uint16_t * image_data,
                           int32_t black_level,
                           int32_t white_level,
@@ -354,10 +364,7 @@ void fix_vertical_stripes(uint16_t * image_data,
                           int vertical_stripes,
                           int show_progress)
 {
-    static stripes_correction correction;
-
     /* for speed: only detect correction factors from the first frame if not --force-stripes specified */
-    static int first_time = 1;
     if (first_time || vertical_stripes == 2)
     {
         detect_vertical_stripes_coeffs(&correction, image_data, black_level, white_level, raw_info_frame_size, width, height);
@@ -39,4 +39,7 @@ void fix_vertical_stripes(uint16_t * image_data,
                           uint16_t height,
                           int vertical_stripes,
                           int show_progress);
+
+/* forget the correction, the next frame gets analyzed again, e.g. for another clip */
+void reset_vertical_stripes();
 #endif
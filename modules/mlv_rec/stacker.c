@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread_pool.h"
+#include "raw_proc/wirth.h"
+#include "stacker.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* jobs per thread, rows take different time in the median modes */
+#define STACK_JOBS_PER_THREAD   4
+
+/* the samples are a multiple of this many frames when growing in memory */
+#define STACK_SAMPLES_GROW      16
+
+enum stacker_step
+{
+    STEP_ADD,
+    STEP_REDUCE,
+};
+
+typedef struct
+{
+    pool_job_t job;
+    int y_start;
+    int y_end;
+} stacker_job_t;
+
+struct stacker
+{
+    stacker_params_t params;
+    int xRes;
+    int yRes;
+    uint32_t pixels;
+    uint32_t frames;
+
+    /* of all frames, for the mean and the noise */
+    uint64_t *sum;
+    uint64_t *sum_sq;
+
+    /* frames or block means, 'pixels' each. in memory until the budget is exceeded, then all in 'spool' */
+    uint16_t *samples;
+    uint32_t sample_count;
+    uint32_t sample_capacity;
+    FILE *spool;
+
+    /* STACK_MEDIAN: sums of the block being collected and its mean when complete */
+    uint32_t *block_sum;
+    uint16_t *block_mean;
+    uint32_t block_count;
+
+    /* arguments of the step running on the workers */
+    enum stacker_step step;
+    const uint16_t *frame;
+    const uint16_t *band;
+    int band_start;
+    uint32_t band_stride;
+    uint16_t *master;
+    uint16_t *noise;
+
+    /* one sample array per worker */
+    uint16_t *scratch;
+
+    thread_pool_t *pool;
+    stacker_job_t *jobs;
+    int job_count;
+    int reserved;               /* padding */
+};
+
+static int spool_seek(FILE *stream, uint64_t offset)
+{
+#if defined(__WIN32)
+    return fseeko64(stream, offset, SEEK_SET);
+#else
+    return fseeko(stream, offset, SEEK_SET);
+#endif
+}
+
+static void stacker_add_rows(stacker_t *stacker, int y_start, int y_end)
+{
+    uint32_t start = y_start * stacker->xRes;
+    uint32_t end = y_end * stacker->xRes;
+    const uint16_t *frame = stacker->frame;
+    uint64_t *sum = stacker->sum;
+    uint64_t *sum_sq = stacker->sum_sq;
+
+    for(uint32_t pos = start; pos < end; pos++)
+    {
+        uint32_t value = frame[pos];
+
+        sum[pos] += value;
+        sum_sq[pos] += value * value;
+    }
+
+    if(stacker->block_sum)
+    {
+        uint32_t *block_sum = stacker->block_sum;
+
+        for(uint32_t pos = start; pos < end; pos++)
+        {
+            block_sum[pos] += frame[pos];
+        }
+
+        /* the frame completes the block */
+        if(stacker->block_count + 1 == (uint32_t)stacker->params.block_frames)
+        {
+            uint32_t count = stacker->block_count + 1;
+
+            for(uint32_t pos = start; pos < end; pos++)
+            {
+                stacker->block_mean[pos] = (block_sum[pos] + count / 2) / count;
+                block_sum[pos] = 0;
+            }
+        }
+    }
+}
+
+/* median of 'count' samples, the mean of both middle ones when the count is even */
+static uint16_t stacker_median(uint16_t *values, int count)
+{
+    int lower = kth_smallest_ushort(values, count, (count - 1) / 2);
+
+    if(count & 1)
+    {
+        return lower;
+    }
+
+    /* after the selection everything above the lower middle is at least as large */
+    int upper = values[count / 2];
+    for(int pos = count / 2 + 1; pos < count; pos++)
+    {
+        upper = MIN(upper, values[pos]);
+    }
+
+    return (lower + upper + 1) / 2;
+}
+
+/* kappa-sigma clipping around the median, sigma estimated from the median absolute deviation at first */
+static double stacker_clip(const uint16_t *values, uint16_t *scratch, int count, float kappa, int iterations, double *sigma_out)
+{
+    memcpy(scratch, values, count * sizeof(uint16_t));
+    double center = stacker_median(scratch, count);
+
+    for(int pos = 0; pos < count; pos++)
+    {
+        scratch[pos] = (uint16_t)fabs(values[pos] - center);
+    }
+    /* 1.4826 * MAD is sigma for normal distributed data. at least one raw unit, the data is integer */
+    double sigma = MAX(1.0, 1.4826 * stacker_median(scratch, count));
+    int kept_last = -1;
+
+    for(int iteration = 0; iteration < iterations; iteration++)
+    {
+        double low = center - kappa * sigma;
+        double high = center + kappa * sigma;
+        uint64_t sum = 0;
+        uint64_t sum_sq = 0;
+        int kept = 0;
+
+        for(int pos = 0; pos < count; pos++)
+        {
+            uint32_t value = values[pos];
+
+            if(value >= low && value <= high)
+            {
+                sum += value;
+                sum_sq += value * value;
+                kept++;
+            }
+        }
+
+        if(!kept)
+        {
+            break;
+        }
+
+        center = (double)sum / kept;
+        sigma = sqrt(MAX(0.0, (double)sum_sq / kept - center * center));
+
+        if(kept == kept_last)
+        {
+            break;
+        }
+        kept_last = kept;
+    }
+
+    *sigma_out = sigma;
+    return center;
+}
+
+static void stacker_reduce_rows(stacker_t *stacker, int worker, int y_start, int y_end)
+{
+    int xRes = stacker->xRes;
+    uint32_t frames = stacker->frames;
+    uint32_t count = stacker->sample_count;
+    uint16_t *values = stacker->scratch ? &stacker->scratch[2 * count * worker] : NULL;
+
+    for(int y = y_start; y < y_end; y++)
+    {
+        for(int x = 0; x < xRes; x++)
+        {
+            uint32_t pos = y * xRes + x;
+            double mean = (double)stacker->sum[pos] / frames;
+            double sigma = sqrt(MAX(0.0, (double)stacker->sum_sq[pos] / frames - mean * mean));
+            double master = 0;
+
+            if(stacker->params.mode == STACK_MEAN)
+            {
+                /* integer rounding like the plain average always did */
+                master = (uint32_t)((stacker->sum[pos] + frames / 2) / frames);
+            }
+            else
+            {
+                const uint16_t *src = &stacker->band[(y - stacker->band_start) * xRes + x];
+
+                for(uint32_t sample = 0; sample < count; sample++)
+                {
+                    values[sample] = src[(size_t)sample * stacker->band_stride];
+                }
+
+                if(stacker->params.mode == STACK_MEDIAN)
+                {
+                    master = stacker_median(values, count);
+                }
+                else
+                {
+                    master = floor(stacker_clip(values, &values[count], count, stacker->params.kappa, stacker->params.iterations, &sigma) + 0.5);
+                }
+            }
+
+            stacker->master[pos] = (uint16_t)MIN(master, 65535.0);
+            if(stacker->noise)
+            {
+                stacker->noise[pos] = (uint16_t)MIN(sigma * STACK_NOISE_SCALE + 0.5, 65535.0);
+            }
+        }
+    }
+}
+
+static void stacker_job(pool_job_t *job, int worker, void *ctx)
+{
+    stacker_t *stacker = (stacker_t *)ctx;
+    stacker_job_t *rows = (stacker_job_t *)job;
+
+    if(stacker->step == STEP_ADD)
+    {
+        stacker_add_rows(stacker, rows->y_start, rows->y_end);
+    }
+    else
+    {
+        stacker_reduce_rows(stacker, worker, rows->y_start, rows->y_end);
+    }
+}
+
+/* run the current step on rows y_start to y_end, split over all workers */
+static void stacker_run(stacker_t *stacker, enum stacker_step step, int y_start, int y_end)
+{
+    stacker->step = step;
+
+    if(!stacker->pool)
+    {
+        stacker_job_t job = { { NULL, 0, 0 }, y_start, y_end };
+        stacker_job(&job.job, 0, stacker);
+        return;
+    }
+
+    int rows = (y_end - y_start + stacker->job_count - 1) / stacker->job_count;
+    int used = 0;
+
+    for(int y = y_start; y < y_end; y += rows)
+    {
+        stacker_job_t *job = &stacker->jobs[used++];
+
+        job->y_start = y;
+        job->y_end = MIN(y + rows, y_end);
+        pool_submit(stacker->pool, &job->job);
+    }
+
+    for(int pos = 0; pos < used; pos++)
+    {
+        pool_wait(stacker->pool, &stacker->jobs[pos].job);
+    }
+}
+
+static int stacker_store(stacker_t *stacker, const uint16_t *data)
+{
+    size_t frame_bytes = stacker->pixels * sizeof(uint16_t);
+
+    if(!stacker->spool)
+    {
+        if(stacker->sample_count < stacker->sample_capacity)
+        {
+            memcpy(&stacker->samples[(size_t)stacker->sample_count * stacker->pixels], data, frame_bytes);
+            stacker->sample_count++;
+            return 0;
+        }
+
+        uint32_t capacity = stacker->sample_capacity + STACK_SAMPLES_GROW;
+        uint16_t *samples = NULL;
+
+        if((uint64_t)capacity * frame_bytes <= stacker->params.memory)
+        {
+            samples = realloc(stacker->samples, capacity * frame_bytes);
+        }
+
+        if(samples)
+        {
+            stacker->samples = samples;
+            stacker->sample_capacity = capacity;
+            return stacker_store(stacker, data);
+        }
+
+        /* out of budget, move everything to disk */
+        stacker->spool = tmpfile();
+        if(!stacker->spool)
+        {
+            return -1;
+        }
+        if(stacker->sample_count && fwrite(stacker->samples, frame_bytes, stacker->sample_count, stacker->spool) != stacker->sample_count)
+        {
+            return -1;
+        }
+        free(stacker->samples);
+        stacker->samples = NULL;
+        stacker->sample_capacity = 0;
+    }
+
+    if(fwrite(data, frame_bytes, 1, stacker->spool) != 1)
+    {
+        return -1;
+    }
+    stacker->sample_count++;
+
+    return 0;
+}
+
+stacker_t *stacker_create(const stacker_params_t *params, int xRes, int yRes)
+{
+    stacker_t *stacker = calloc(1, sizeof(stacker_t));
+
+    if(!stacker || xRes <= 0 || yRes <= 0)
+    {
+        free(stacker);
+        return NULL;
+    }
+
+    stacker->params = *params;
+    stacker->params.block_frames = MAX(1, params->block_frames);
+    stacker->params.iterations = MAX(1, params->iterations);
+    stacker->params.threads = MAX(1, params->threads);
+    stacker->xRes = xRes;
+    stacker->yRes = yRes;
+    stacker->pixels = xRes * yRes;
+
+    stacker->sum = calloc(stacker->pixels, sizeof(uint64_t));
+    stacker->sum_sq = calloc(stacker->pixels, sizeof(uint64_t));
+    int ok = stacker->sum && stacker->sum_sq;
+
+    if(ok && params->mode == STACK_MEDIAN)
+    {
+        stacker->block_sum = calloc(stacker->pixels, sizeof(uint32_t));
+        stacker->block_mean = malloc(stacker->pixels * sizeof(uint16_t));
+        ok = stacker->block_sum && stacker->block_mean;
+    }
+
+    if(ok && stacker->params.threads > 1)
+    {
+        stacker->job_count = stacker->params.threads * STACK_JOBS_PER_THREAD;
+        stacker->jobs = calloc(stacker->job_count, sizeof(stacker_job_t));
+        stacker->pool = stacker->jobs ? pool_create(stacker->params.threads, &stacker_job, stacker) : NULL;
+        ok = stacker->pool != NULL;
+    }
+
+    if(!ok)
+    {
+        stacker_free(stacker);
+        return NULL;
+    }
+
+    return stacker;
+}
+
+int stacker_add(stacker_t *stacker, const uint16_t *frame)
+{
+    stacker->frame = frame;
+    stacker_run(stacker, STEP_ADD, 0, stacker->yRes);
+    stacker->frame = NULL;
+    stacker->frames++;
+
+    if(stacker->params.mode == STACK_SIGMA)
+    {
+        return stacker_store(stacker, frame);
+    }
+
+    if(stacker->params.mode == STACK_MEDIAN && ++stacker->block_count == (uint32_t)stacker->params.block_frames)
+    {
+        stacker->block_count = 0;
+        return stacker_store(stacker, stacker->block_mean);
+    }
+
+    return 0;
+}
+
+uint32_t stacker_frames(stacker_t *stacker)
+{
+    return stacker->frames;
+}
+
+int stacker_spooled(stacker_t *stacker)
+{
+    return stacker->spool != NULL;
+}
+
+int stacker_finish(stacker_t *stacker, uint16_t *master, uint16_t *noise)
+{
+    if(!stacker->frames)
+    {
+        return -1;
+    }
+
+    /* an incomplete last block counts as well */
+    if(stacker->params.mode == STACK_MEDIAN && stacker->block_count)
+    {
+        uint32_t count = stacker->block_count;
+
+        for(uint32_t pos = 0; pos < stacker->pixels; pos++)
+        {
+            stacker->block_mean[pos] = (stacker->block_sum[pos] + count / 2) / count;
+            stacker->block_sum[pos] = 0;
+        }
+        stacker->block_count = 0;
+
+        if(stacker_store(stacker, stacker->block_mean))
+        {
+            return -1;
+        }
+    }
+
+    stacker->master = master;
+    stacker->noise = noise;
+
+    if(stacker->params.mode == STACK_MEAN)
+    {
+        stacker_run(stacker, STEP_REDUCE, 0, stacker->yRes);
+        return 0;
+    }
+
+    /* every worker needs room for the samples of one pixel and for clipping */
+    uint32_t count = stacker->sample_count;
+    stacker->scratch = malloc(2 * (size_t)count * stacker->params.threads * sizeof(uint16_t));
+    if(!stacker->scratch)
+    {
+        return -1;
+    }
+
+    if(!stacker->spool)
+    {
+        stacker->band = stacker->samples;
+        stacker->band_start = 0;
+        stacker->band_stride = stacker->pixels;
+        stacker_run(stacker, STEP_REDUCE, 0, stacker->yRes);
+        return 0;
+    }
+
+    /* out of core: as many rows of all samples as fit into the memory budget */
+    size_t line_bytes = (size_t)stacker->xRes * sizeof(uint16_t);
+    int band_rows = MIN(stacker->yRes, MAX(1, (int)(stacker->params.memory / (line_bytes * count))));
+    uint16_t *band = malloc(band_rows * line_bytes * count);
+
+    if(!band)
+    {
+        return -1;
+    }
+
+    int ret = 0;
+    for(int y = 0; !ret && y < stacker->yRes; y += band_rows)
+    {
+        int rows = MIN(band_rows, stacker->yRes - y);
+
+        for(uint32_t sample = 0; sample < count; sample++)
+        {
+            uint64_t offset = ((uint64_t)sample * stacker->pixels + (uint64_t)y * stacker->xRes) * sizeof(uint16_t);
+
+            if(spool_seek(stacker->spool, offset) || fread(&band[(size_t)sample * rows * stacker->xRes], line_bytes, rows, stacker->spool) != (size_t)rows)
+            {
+                ret = -1;
+                break;
+            }
+        }
+
+        if(!ret)
+        {
+            stacker->band = band;
+            stacker->band_start = y;
+            stacker->band_stride = rows * stacker->xRes;
+            stacker_run(stacker, STEP_REDUCE, y, y + rows);
+        }
+    }
+
+    stacker->band = NULL;
+    free(band);
+
+    return ret;
+}
+
+int stacker_bad_pixels(const uint16_t *master, const uint16_t *noise, int xRes, int yRes, float threshold, stacker_pixel_t **pixels)
+{
+    uint32_t *histogram = calloc(65536, sizeof(uint32_t));
+    uint32_t pixel_count = xRes * yRes;
+    int noise_level = STACK_NOISE_SCALE;
+    int found = 0;
+    int capacity = 0;
+
+    *pixels = NULL;
+
+    if(!histogram)
+    {
+        return 0;
+    }
+
+    /* typical noise of a pixel, at least one raw unit */
+    if(noise)
+    {
+        uint32_t seen = 0;
+        int level = 0;
+
+        for(uint32_t pos = 0; pos < pixel_count; pos++)
+        {
+            histogram[noise[pos]]++;
+        }
+        while(level < 65535 && (seen += histogram[level]) < pixel_count / 2)
+        {
+            level++;
+        }
+        noise_level = MAX(noise_level, level);
+    }
+    free(histogram);
+
+    double max_deviation = threshold * noise_level / STACK_NOISE_SCALE;
+    double max_noise = threshold * noise_level;
+
+    for(int y = 0; y < yRes; y++)
+    {
+        for(int x = 0; x < xRes; x++)
+        {
+            int neighbors[8];
+            int count = 0;
+
+            /* same bayer color, two pixels away */
+            for(int dy = -2; dy <= 2; dy += 2)
+            {
+                for(int dx = -2; dx <= 2; dx += 2)
+                {
+                    if((dx || dy) && x + dx >= 0 && x + dx < xRes && y + dy >= 0 && y + dy < yRes)
+                    {
+                        neighbors[count++] = master[(y + dy) * xRes + x + dx];
+                    }
+                }
+            }
+
+            int value = master[y * xRes + x];
+            int deviation = count ? abs(value - median_int_wirth(neighbors, count)) : 0;
+
+            if(deviation > max_deviation || (noise && noise[y * xRes + x] > max_noise))
+            {
+                if(found == capacity)
+                {
+                    capacity = MAX(32, 2 * capacity);
+                    stacker_pixel_t *list = realloc(*pixels, capacity * sizeof(stacker_pixel_t));
+
+                    if(!list)
+                    {
+                        return found;
+                    }
+                    *pixels = list;
+                }
+
+                (*pixels)[found].x = x;
+                (*pixels)[found].y = y;
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+void stacker_free(stacker_t *stacker)
+{
+    if(!stacker)
+    {
+        return;
+    }
+
+    if(stacker->pool)
+    {
+        pool_destroy(stacker->pool);
+    }
+    if(stacker->spool)
+    {
+        fclose(stacker->spool);
+    }
+
+    free(stacker->jobs);
+    free(stacker->scratch);
+    free(stacker->samples);
+    free(stacker->block_mean);
+    free(stacker->block_sum);
+    free(stacker->sum_sq);
+    free(stacker->sum);
+    free(stacker);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _stacker_h
+#define _stacker_h
+
+#include <stdint.h>
+
+/*
+  streaming frame stacker for master dark and flat frames (mlv_dump -a / --stack).
+
+  frames are added one by one and every input frame is only seen once. per pixel sums and sums of squares
+  are kept for all modes, they give the mean and the temporal noise. the median modes also need the samples:
+    - median of blocks: the mean of every 'block_frames' frames is kept, the master is their median
+    - sigma clipping:   all frames are kept, the master is the mean of the samples within kappa * sigma
+  samples stay in memory up to 'memory' bytes and are spooled to a temporary file beyond that.
+  the master is then computed in row bands that fit into the budget. both steps run on 'threads' cores.
+*/
+
+#define STACK_MEAN      0
+#define STACK_MEDIAN    1
+#define STACK_SIGMA     2
+
+/* the noise map holds the standard deviation in 1/STACK_NOISE_SCALE raw units */
+#define STACK_NOISE_SCALE   16
+
+/* pixels this many median sigmas off are bad, a single frame shows them clearly */
+#define STACK_BAD_PIXEL_SIGMA   5.0f
+
+typedef struct
+{
+    int         mode;           /* STACK_* */
+    int         block_frames;   /* STACK_MEDIAN: frames averaged into one block */
+    float       kappa;          /* STACK_SIGMA: reject samples further than kappa * sigma from the center */
+    int         iterations;     /* STACK_SIGMA: clipping rounds at most */
+    uint64_t    memory;         /* bytes for samples kept in memory */
+    int         threads;
+    int         reserved;       /* padding */
+} stacker_params_t;
+
+typedef struct
+{
+    int x;
+    int y;
+} stacker_pixel_t;
+
+typedef struct stacker stacker_t;
+
+/* returns NULL on error */
+stacker_t *stacker_create(const stacker_params_t *params, int xRes, int yRes);
+
+/* add an unpacked frame. returns 0 on success */
+int stacker_add(stacker_t *stacker, const uint16_t *frame);
+
+uint32_t stacker_frames(stacker_t *stacker);
+
+/* is the input bigger than the memory budget and spooled to disk */
+int stacker_spooled(stacker_t *stacker);
+
+/* compute the master frame and the noise map (can be NULL), both xRes * yRes. returns 0 on success */
+int stacker_finish(stacker_t *stacker, uint16_t *master, uint16_t *noise);
+
+/*
+  find hot, cold and noisy pixels: pixels that differ from their same color neighbors in the master,
+  or whose noise is above the typical noise, by more than 'threshold' times the median noise of all pixels.
+  returns the number of pixels found, the list must be freed by the caller.
+*/
+int stacker_bad_pixels(const uint16_t *master, const uint16_t *noise, int xRes, int yRes, float threshold, stacker_pixel_t **pixels);
+
+void stacker_free(stacker_t *stacker);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined(__WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "thread_pool.h"
+
+/* simple FIFO worker pool for the host tools. no job priorities, no cancellation. */
+struct thread_pool
+{
+    pthread_t *threads;
+
+    pool_func_t func;
+    void *ctx;
+
+    /* jobs waiting for a worker, single linked list */
+    pool_job_t *head;
+    pool_job_t *tail;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_queued;
+    pthread_cond_t job_done;
+
+    int thread_count;
+    int shutdown;
+};
+
+/* pthread_create only passes one pointer, so every thread gets its index this way */
+struct worker_arg
+{
+    thread_pool_t *pool;
+    int worker;
+    int reserved;   /* padding */
+};
+
+static void *pool_worker(void *arg)
+{
+    struct worker_arg *info = (struct worker_arg *)arg;
+    thread_pool_t *pool = info->pool;
+    int worker = info->worker;
+
+    free(info);
+
+    while(1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while(!pool->head && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->job_queued, &pool->lock);
+        }
+
+        /* only leave when the queue is drained */
+        if(!pool->head)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        pool_job_t *job = pool->head;
+        pool->head = job->next;
+        if(!pool->head)
+        {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->func(job, worker, pool->ctx);
+
+        pthread_mutex_lock(&pool->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&pool->job_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+thread_pool_t *pool_create(int threads, pool_func_t func, void *ctx)
+{
+    thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
+
+    if(!pool || threads < 1)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if(!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pool->func = func;
+    pool->ctx = ctx;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_queued, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+
+    for(int pos = 0; pos < threads; pos++)
+    {
+        struct worker_arg *arg = malloc(sizeof(struct worker_arg));
+
+        if(!arg)
+        {
+            break;
+        }
+
+        arg->pool = pool;
+        arg->worker = pos;
+
+        if(pthread_create(&pool->threads[pos], NULL, &pool_worker, arg))
+        {
+            free(arg);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if(!pool->thread_count)
+    {
+        pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void pool_submit(thread_pool_t *pool, pool_job_t *job)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    job->next = NULL;
+    job->queued = 1;
+    job->done = 0;
+
+    if(pool->tail)
+    {
+        pool->tail->next = job;
+    }
+    else
+    {
+        pool->head = job;
+    }
+    pool->tail = job;
+
+    pthread_cond_signal(&pool->job_queued);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(thread_pool_t *pool, pool_job_t *job)
+{
+    pthread_mutex_lock(&pool->lock);
+    while(job->queued && !job->done)
+    {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    job->queued = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int pool_cpu_count()
+{
+#if defined(__WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = info.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return count > 0 ? count : 1;
+}
+
+void pool_destroy(thread_pool_t *pool)
+{
+    if(!pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_queued);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(int pos = 0; pos < pool->thread_count; pos++)
+    {
+        pthread_join(pool->threads[pos], NULL);
+    }
+
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_queued);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->threads);
+    free(pool);
+}
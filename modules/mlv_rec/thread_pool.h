@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2026 Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _thread_pool_h
+#define _thread_pool_h
+
+#include <stdint.h>
+
+/* every job handed to the pool must start with this struct.
+   the pool only touches these fields, the rest belongs to the caller. */
+typedef struct pool_job
+{
+    struct pool_job *next;
+    int queued;
+    int done;
+} pool_job_t;
+
+/* called in worker context. 'worker' is the index of the calling thread (0..threads-1)
+   and can be used to address per-thread scratch buffers */
+typedef void (*pool_func_t)(pool_job_t *job, int worker, void *ctx);
+
+typedef struct thread_pool thread_pool_t;
+
+/* start 'threads' workers that call 'func' for every submitted job. returns NULL on error */
+thread_pool_t *pool_create(int threads, pool_func_t func, void *ctx);
+
+/* queue a job. jobs are started in submission order, but may finish in any order */
+void pool_submit(thread_pool_t *pool, pool_job_t *job);
+
+/* block until the given job was processed. returns immediately for jobs never submitted */
+void pool_wait(thread_pool_t *pool, pool_job_t *job);
+
+/* number of CPU cores available, at least 1 */
+int pool_cpu_count();
+
+/* finish all queued jobs, stop workers and free the pool */
+void pool_destroy(thread_pool_t *pool);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  virtual DNG benchmark, reads the DNGs of a clip through mlv_vdng like a player would through mlv_vfs.
+
+  first only the headers of all frames (what a NLE does when scanning a folder), then all DNGs in order,
+  in pieces of 'read_size' bytes like FUSE hands them over. prints frames per second and a checksum
+  of all DNGs. with -o the DNGs are written into a directory too, they must be the same as the ones
+  of "mlv_dump --dng".
+
+  vdng_bench [-t threads] [-c cache_frames] [-r read_ahead] [-b read_size] [-o dir] <file.MLV>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "mlv_vdng.h"
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t checksum_update(uint32_t checksum, const uint8_t *data, size_t size)
+{
+    for(size_t pos = 0; pos < size; pos++)
+    {
+        checksum = (checksum ^ data[pos]) * 16777619;
+    }
+    return checksum;
+}
+
+int main(int argc, char *argv[])
+{
+    struct vdng_options options;
+    size_t read_size = 128 * 1024;
+    char *out_dir = NULL;
+    char *mlv_filename = NULL;
+
+    vdng_default_options(&options);
+
+    for(int pos = 1; pos < argc; pos++)
+    {
+        if(!strcmp(argv[pos], "-t") && pos + 1 < argc)
+        {
+            options.threads = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-c") && pos + 1 < argc)
+        {
+            options.cache_frames = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-r") && pos + 1 < argc)
+        {
+            options.read_ahead = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-b") && pos + 1 < argc)
+        {
+            read_size = atoi(argv[++pos]);
+        }
+        else if(!strcmp(argv[pos], "-o") && pos + 1 < argc)
+        {
+            out_dir = argv[++pos];
+        }
+        else if(argv[pos][0] != '-' && !mlv_filename)
+        {
+            mlv_filename = argv[pos];
+        }
+        else
+        {
+            mlv_filename = NULL;
+            break;
+        }
+    }
+
+    if(!mlv_filename)
+    {
+        fprintf(stderr, "Usage: %s [-t threads] [-c cache_frames] [-r read_ahead] [-b read_size] [-o dir] <file.MLV>\n", argv[0]);
+        return 1;
+    }
+
+    if(options.threads < 0 || options.cache_frames < 1 || options.read_ahead < 0 || read_size < 1)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    double start = get_time();
+    vdng_clip_t *clip = vdng_open(mlv_filename, &options);
+
+    if(!clip)
+    {
+        fprintf(stderr, "Failed to open '%s'\n", mlv_filename);
+        return 1;
+    }
+
+    uint32_t frames = vdng_frame_count(clip);
+    size_t max_size = 0;
+    double total_size = 0;
+
+    for(uint32_t pos = 0; pos < frames; pos++)
+    {
+        size_t file_size = vdng_file_size(clip, pos);
+
+        max_size = (file_size > max_size) ? file_size : max_size;
+        total_size += file_size;
+    }
+
+    uint8_t *dng = malloc(max_size);
+
+    if(!dng)
+    {
+        fprintf(stderr, "Failed to allocate buffers\n");
+        vdng_close(clip);
+        return 1;
+    }
+
+    printf("Clip:     %s, %d frames, %.1f MB of DNGs\n", mlv_filename, frames, total_size / 1e6);
+    printf("Open:     %8.3f s\n", get_time() - start);
+
+    /* the first bytes of every file, no image data gets processed */
+    start = get_time();
+    for(uint32_t pos = 0; pos < frames; pos++)
+    {
+        if(vdng_read(clip, pos, dng, 512, 0) != 512)
+        {
+            fprintf(stderr, "Failed reading the header of frame %d\n", pos);
+            return 1;
+        }
+    }
+    double elapsed = get_time() - start;
+    printf("Headers:  %8.3f s, %10.1f files/s\n", elapsed, frames / (elapsed > 0 ? elapsed : 1e-9));
+
+    uint32_t checksum = 2166136261u;
+
+    start = get_time();
+    for(uint32_t pos = 0; pos < frames; pos++)
+    {
+        size_t file_size = vdng_file_size(clip, pos);
+
+        for(size_t offset = 0; offset < file_size; offset += read_size)
+        {
+            size_t size = (file_size - offset < read_size) ? file_size - offset : read_size;
+
+            if(vdng_read(clip, pos, &dng[offset], size, offset) != (ssize_t)size)
+            {
+                fprintf(stderr, "Failed reading frame %d\n", pos);
+                return 1;
+            }
+        }
+
+        checksum = checksum_update(checksum, dng, file_size);
+
+        if(out_dir)
+        {
+            char name[256];
+            char path[1024];
+
+            vdng_filename(clip, pos, name, sizeof(name));
+            snprintf(path, sizeof(path), "%s/%s", out_dir, name);
+
+            FILE *out = fopen(path, "wb");
+            if(!out || fwrite(dng, file_size, 1, out) != 1)
+            {
+                fprintf(stderr, "Failed writing '%s'\n", path);
+                return 1;
+            }
+            fclose(out);
+        }
+    }
+    elapsed = get_time() - start;
+    printf("DNGs:     %8.3f s, %10.2f fps, %8.1f MB/s\n", elapsed, frames / (elapsed > 0 ? elapsed : 1e-9), total_size / (elapsed > 0 ? elapsed : 1e-9) / 1e6);
+    printf("Checksum: %08X\n", checksum);
+
+    free(dng);
+    vdng_close(clip);
+    return 0;
+}
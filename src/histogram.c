@@ -12,6 +12,8 @@
 #include "imgconv.h"
 
 #include "histogram.h"
+#include "raw_stats.h"
+#include "raw_plane.h"
 #include "module.h"
 
 #include "zebra.h"
@@ -64,6 +66,12 @@ void FAST hist_build_raw()
         qprintf("[HIST] RAW %d => %d (white=%d)\n", i, r2ev[i], raw_info.white_level);
     }
 
+    struct raw_plane * plane = raw_plane_get();
+    if (!plane) return;
+    const uint16_t * red = plane->ch[RAW_PLANE_RED_DARK];
+    const uint16_t * green = plane->ch[RAW_PLANE_GREEN_DARK];
+    const uint16_t * blue = plane->ch[RAW_PLANE_BLUE_DARK];
+
     for (int i = os.y0; i < os.y_max; i += step)
     {
         int y = BM2RAW_Y(i);
@@ -74,9 +82,10 @@ void FAST hist_build_raw()
             int x = BM2RAW_X(j);
             if (x < raw_info.active_area.x1+8 || x > raw_info.active_area.x2-8) continue;
 
-            int r = raw_red_pixel_dark(x, y);
-            int g = raw_green_pixel_dark(x, y);
-            int b = raw_blue_pixel_dark(x, y);
+            int k = raw_plane_index(plane, x, y);
+            int r = red[k];
+            int g = green[k];
+            int b = blue[k];
 
             /* ignore bad pixels */
             if (r == 0 || g == 0 || b == 0) continue;
@@ -91,6 +100,8 @@ void FAST hist_build_raw()
             histogram.total_px++;
         }
     }
+
+    raw_plane_put();
     
     /* in dark areas, spread the histogram count to show solid histogram instead of isolated bars */
     for (int i = 0; i < 5000; i++)
@@ -429,80 +440,69 @@ MENU_UPDATE_FUNC(hist_warn_display)
  * 2 = LiveView resolution downsampled by 2 on each axis
  * 3 = LiveView resolution downsampled by 3 on each axis
  * and so on, until 16
+ * -1 = downsample as needed for about RAW_STATS_AUTO_SAMPLES pixels
+ *
+ * The histograms are cached for the current frame (raw_stats.c), so further
+ * percentiles or overexposure checks on the same frame are almost free.
+ * The cache is freed again once nobody asks for a few seconds.
  */
 
-int FAST raw_hist_get_percentile_levels(int* percentiles_x10, int* output_raw_values, int n, int gray_projection, int speed)
+#define RAW_STATS_AUTO_SAMPLES 20000
+
+/* the cache holds up to 3 x 64K; free it after this long without requests */
+#define RAW_STATS_IDLE_MS 3000
+
+static struct semaphore * raw_stats_sem = 0;
+static int raw_stats_last_request = 0;
+
+static int raw_stats_auto_step()
 {
-    if (!raw_update_params()) goto err;
-    get_yuv422_vram();
+    int step = 1;
+    while (step < 16 && (os.x_ex / step) * (os.y_ex / step) > RAW_STATS_AUTO_SAMPLES)
+    {
+        step++;
+    }
+    return step;
+}
 
-    int* hist = malloc(16384*4);
-    if (!hist) goto err;
-    memset(hist, 0, 16384*4);
+/* returns the statistics of the current frame; call with raw_stats_sem taken */
+static struct raw_stats * FAST raw_stats_get(int gray_projection, int step, int y_off)
+{
+    struct raw_stats_key key = {
+        .frame_id           = raw_get_frame_id(),
+        .buffer             = raw_info.buffer,
+        .gray_projection    = gray_projection,
+        .step               = step,
+        .y_off              = y_off,
+    };
+
+    raw_stats_last_request = get_ms_clock();
+
+    struct raw_stats * stats = raw_stats_lookup(&key);
+    if (stats)
+    {
+        return stats;
+    }
 
-    int off = get_y_skip_offset_for_histogram();
-    if (speed == 0 && gray_projection == GRAY_PROJECTION_GREEN)
+    stats = raw_stats_alloc(&key);
+    if (!stats)
     {
-        /* time: 1-2 seconds on full raw 5D3 */
-        //~ int t0 = get_ms_clock();
-        for (struct raw_pixblock * row = (struct raw_pixblock *) raw_info.buffer + raw_info.active_area.y1 * raw_info.width / 8 + (raw_info.active_area.x1 + 7) / 8; (void*)row < (void*)raw_info.buffer + raw_info.pitch * raw_info.active_area.y2; row += 2 * raw_info.width / 8)
-        {
-            struct raw_pixblock * row2 = row + raw_info.pitch / sizeof(struct raw_pixblock);
+        return 0;
+    }
 
-            struct raw_pixblock * p;
-            struct raw_pixblock * q;
-            for (p = row, q = row2; (void*)p < (void*)row + raw_info.jpeg.width * 14/8; p++, q++)
-            {
+    /* the histogram is built in place, then made cumulative */
+    uint32_t * hist = stats->cum;
 
-                /**
-                 *  p: abcdefgh abcdefgh
-                 *  q: abcdefgh abcdefgh
-                 *
-                 *     rgrgrgrg rgrgrgrg
-                 *     gbgbgbgb gbgbgbgb
-                 */
-
-                //~ int pa = ((int)(p->a));
-                int pb = ((int)(p->b_lo | (p->b_hi << 12)));
-                //~ int pc = ((int)(p->c_lo | (p->c_hi << 10)));
-                int pd = ((int)(p->d_lo | (p->d_hi << 8)));
-                //~ int pe = ((int)(p->e_lo | (p->e_hi << 6)));
-                int pf = ((int)(p->f_lo | (p->f_hi << 4)));
-                //~ int pg = ((int)(p->g_lo | (p->g_hi << 2)));
-                int ph = ((int)(p->h));
-                int qa = ((int)(q->a));
-                //~ int qb = ((int)(q->b_lo | (q->b_hi << 12)));
-                int qc = ((int)(q->c_lo | (q->c_hi << 10)));
-                //~ int qd = ((int)(q->d_lo | (q->d_hi << 8)));
-                int qe = ((int)(q->e_lo | (q->e_hi << 6)));
-                //~ int qf = ((int)(q->f_lo | (q->f_hi << 4)));
-                int qg = ((int)(q->g_lo | (q->g_hi << 2)));
-                //~ int qh = ((int)(q->h));
-
-                hist[pb]++;
-                hist[pd]++;
-                hist[pf]++;
-                hist[ph]++;
-                hist[qa]++;
-                hist[qc]++;
-                hist[qe]++;
-                hist[qg]++;
-
-                /* to check if we sample only the active area */
-                //~ p->a = rand();
-            }
-        }
-        //~ int t1 = get_ms_clock();
-        //~ NotifyBox(5000, "%d ", t1 - t0);
-        //~ save_dng("A:/foo.dng");
+    if (step == 0)
+    {
+        raw_stats_add_green_full(&raw_info, hist);
     }
     else
     {
-        speed = COERCE(speed, 1, 16);
-        for (int i = os.y0 + off; i < os.y_max - off; i += speed)
+        for (int i = os.y0 + y_off; i < os.y_max - y_off; i += step)
         {
             int y = BM2RAW_Y(i);
-            for (int j = os.x0; j < os.x_max; j += speed)
+            for (int j = os.x0; j < os.x_max; j += step)
             {
                 int x = BM2RAW_X(j);
                 int px = raw_get_gray_pixel(x, y, gray_projection);
@@ -511,31 +511,35 @@ int FAST raw_hist_get_percentile_levels(int* percentiles_x10, int* output_raw_va
         }
     }
 
-    int total = 0;
-    int i;
-    for( i=0 ; i < 16384 ; i++ )
-        total += hist[i];
+    raw_stats_finish(stats);
+    return stats;
+}
 
-    for (int k = 0; k < n; k++)
-    {
-        int thr = (uint64_t)total * percentiles_x10[k] / 1000 - 2;  // 50% => median; allow up to 2 stuck pixels
-        int n = 0;
-        int ans = -1;
+int FAST raw_hist_get_percentile_levels(int* percentiles_x10, int* output_raw_values, int n, int gray_projection, int speed)
+{
+    if (!raw_update_params()) goto err;
+    get_yuv422_vram();
 
-        for( i=0 ; i < 16384; i++ )
-        {
-            n += hist[i];
-            if (n >= thr)
-            {
-                ans = i;
-                break;
-            }
-        }
+    int off = get_y_skip_offset_for_histogram();
+    int step =
+        (speed == 0 && gray_projection == GRAY_PROJECTION_GREEN) ? 0 :
+        (speed < 0) ? raw_stats_auto_step() : COERCE(speed, 1, 16);
 
-        output_raw_values[k] = ans;
+    take_semaphore(raw_stats_sem, 0);
+
+    struct raw_stats * stats = raw_stats_get(gray_projection, step, off);
+    if (!stats)
+    {
+        give_semaphore(raw_stats_sem);
+        goto err;
     }
 
-    free(hist);
+    for (int k = 0; k < n; k++)
+    {
+        output_raw_values[k] = raw_stats_percentile(stats, percentiles_x10[k]);
+    }
+
+    give_semaphore(raw_stats_sem);
     return 1;
 
 err:
@@ -546,6 +550,21 @@ err:
     return -1;
 }
 
+void raw_hist_free_if_idle()
+{
+    if (!raw_stats_sem)
+    {
+        return;
+    }
+
+    take_semaphore(raw_stats_sem, 0);
+    if (get_ms_clock() - raw_stats_last_request > RAW_STATS_IDLE_MS)
+    {
+        raw_stats_flush();
+    }
+    give_semaphore(raw_stats_sem);
+}
+
 int raw_hist_get_percentile_level(int percentile_x10, int gray_projection, int speed)
 {
     int ans;
@@ -561,25 +580,23 @@ int raw_hist_get_overexposure_percentage(int gray_projection)
 
     /* use some tolerance when checking for overexposure, because white level might vary a little */
     int white = raw_info.white_level * 80 / 100;
-    int over = 0;
-    int total = 0;
 
     int step = lv ? 4 : 2;
 
-    for (int i = os.y0; i < os.y_max; i += step)
+    take_semaphore(raw_stats_sem, 0);
+
+    struct raw_stats * stats = raw_stats_get(gray_projection, step, 0);
+    if (!stats || !stats->total)
     {
-        int y = BM2RAW_Y(i);
-        for (int j = os.x0; j < os.x_max; j += step)
-        {
-            int x = BM2RAW_X(j);
-            int px = raw_get_gray_pixel(x, y, gray_projection);
-            if (px >= white) over++;
-            total++;
-        }
+        give_semaphore(raw_stats_sem);
+        return -1;
     }
 
     /* percentage x100 */
-    return over * 10000 / total;
+    int ans = raw_stats_count_above(stats, white) * 10000 / stats->total;
+
+    give_semaphore(raw_stats_sem);
+    return ans;
 }
 
 #include "lvinfo.h"
@@ -791,6 +808,7 @@ static struct lvinfo_item info_items[] = {
 
 static void hist_init()
 {
+    raw_stats_sem = create_named_semaphore("raw_stats_sem", 1);
     lvinfo_add_items(info_items, COUNT(info_items));
 }
 
@@ -48,6 +48,9 @@ int raw_hist_get_percentile_level(int percentile, int gray_projection, int speed
 int raw_hist_get_percentile_levels(int* percentiles_x10, int* output_raw_values, int n, int gray_projection, int speed);
 int raw_hist_get_overexposure_percentage(int gray_projection);
 
+/* frees the statistics cached by the two above, if they were not used for a few seconds */
+void raw_hist_free_if_idle();
+
 extern struct menu_entry hist_menu_entry;
 
 extern int hist_type;
@@ -0,0 +1,256 @@
+/**
+ * Single pass LiveView analysis: histogram, waveform and vectorscope
+ * from one read of the YUV422 image.
+ *
+ * Every pixel pair is read once and added to all enabled accumulators.
+ * The inner loop is specialized for each combination of accumulators,
+ * so it has no per pixel feature checks. The only branches left are
+ * for magic zoom borders and U/V outside the vectorscope circle, which
+ * are rare and well predicted; counters saturate without branches.
+ */
+
+#include <string.h>
+#include "lv_analysis.h"
+
+#ifndef FAST
+#define FAST __attribute__((optimize("-O3")))
+#endif
+
+#define LVA_HIST    1
+#define LVA_RGB     2
+#define LVA_WAVE    4
+#define LVA_SCOPE   8
+
+/* counters saturate here, same as in vectorscope.c */
+#define LVA_SCOPE_MAX   (0x2A << 2)
+#define LVA_SCOPE_R     124
+
+static inline __attribute__((always_inline))
+void lv_analysis_rows(struct lv_analysis * a, const int flags)
+{
+    const uint32_t * buf = a->buf;
+    const uint32_t * col_offsets = a->col_offsets;
+    const uint32_t mz = a->skip_mz ? 1 : 0;
+
+    uint32_t * hist = a->hist;
+    uint32_t * hist_r = a->hist_r;
+    uint32_t * hist_g = a->hist_g;
+    uint32_t * hist_b = a->hist_b;
+    const int * rv = a->yuv2rgb_rv;
+    const int * gu = a->yuv2rgb_gu;
+    const int * gv = a->yuv2rgb_gv;
+    const int * bu = a->yuv2rgb_bu;
+    const uint32_t uv_xor = a->uv_xor;
+    const uint8_t * levels = a->rgb_levels + 256;
+
+    uint8_t * waveform = a->waveform;
+    const uint16_t * col_waveform = a->col_waveform;
+    const uint16_t * waveform_rows = a->waveform_rows;
+
+    uint8_t * scope = a->vectorscope;
+    uint32_t * outside = a->scope_outside;
+    const int gain = a->vectorscope_gain;
+    const int scale = 1 << gain;
+    uint32_t dither = a->dither;
+
+    uint32_t total = 0;
+
+    for (int j = 0; j < a->rows; j++)
+    {
+        const uint32_t row = a->row_offsets[j];
+
+        for (int i = 0; i < a->cols; i++)
+        {
+            const uint32_t pixel = buf[(row + col_offsets[i]) >> 2];
+
+            /* magic zoom borders are rare, and mz does not change within the pass */
+            if (mz && (pixel == LV_ANALYSIS_MZ_WHITE || pixel == LV_ANALYSIS_MZ_BLACK || pixel == LV_ANALYSIS_MZ_GREEN))
+            {
+                continue;
+            }
+
+            /* both luma samples in one register (bits 0-7 and 16-23), then averaged */
+            const uint32_t yy = (pixel >> 8) & 0x00FF00FF;
+            const uint32_t Y = ((yy + (yy >> 16)) & 0x1FF) >> 1;
+
+            if (flags & LVA_HIST)
+            {
+                hist[(Y * LV_ANALYSIS_HIST_BINS) >> 8]++;
+                total++;
+            }
+
+            if (flags & LVA_RGB)
+            {
+                /* levels[] does the COERCE(0, 255) and the scaling to histogram bins */
+                const uint32_t u = (pixel & 0xFF) ^ uv_xor;
+                const uint32_t v = ((pixel >> 16) & 0xFF) ^ uv_xor;
+                hist_r[levels[(int)Y + rv[v]]]++;
+                hist_g[levels[(int)Y + gu[u] + gv[v]]]++;
+                hist_b[levels[(int)Y + bu[u]]]++;
+            }
+
+            if (flags & LVA_WAVE)
+            {
+                uint8_t * c = &waveform[col_waveform[i] + waveform_rows[Y]];
+                *c += (*c < 250);
+            }
+
+            if (flags & LVA_SCOPE)
+            {
+                /* U and V are taken as signed bytes, as vectorscope_addpixel always did */
+                int U = (int8_t)(pixel & 0xFF) * scale;
+                int V = -(int8_t)((pixel >> 16) & 0xFF) * scale;
+
+                if (U * U + V * V > LVA_SCOPE_R * LVA_SCOPE_R)
+                {
+                    /* the red marks outside the circle only depend on U/V, they get drawn once after the pass */
+                    const uint32_t uv = (pixel & 0xFF) | ((pixel >> 8) & 0xFF00);
+                    outside[uv >> 5] |= 1u << (uv & 31);
+                    continue;
+                }
+
+                if (gain)
+                {
+                    /* simulate better resolution */
+                    dither ^= dither << 13;
+                    dither ^= dither >> 17;
+                    dither ^= dither << 5;
+                    U += dither & 1;
+                    V += (dither >> 1) & 1;
+                }
+
+                uint8_t * c = &scope[(U + 128) + (V + 128) * LV_ANALYSIS_SCOPE_SIZE];
+                *c += (*c < LVA_SCOPE_MAX);
+            }
+        }
+    }
+
+    a->total_px += total;
+    a->dither = dither;
+}
+
+static int isqrt(int r)
+{
+    int root = 0;
+
+    for (int bit = 1 << 14; bit; bit >>= 1)
+    {
+        if ((root + bit) * (root + bit) <= r)
+        {
+            root += bit;
+        }
+    }
+    return root;
+}
+
+/* U/V values outside the circle are marked in red at its border */
+static void lv_analysis_scope_outside(struct lv_analysis * a)
+{
+    const int scale = 1 << a->vectorscope_gain;
+
+    for (int word = 0; word < (int)(sizeof(a->scope_outside) / sizeof(a->scope_outside[0])); word++)
+    {
+        uint32_t bits = a->scope_outside[word];
+        if (!bits)
+        {
+            continue;
+        }
+        a->scope_outside[word] = 0;
+
+        for (int bit = 0; bit < 32; bit++)
+        {
+            if (!(bits & (1u << bit)))
+            {
+                continue;
+            }
+
+            int uv = word * 32 + bit;
+            int U = (int8_t)(uv & 0xFF) * scale;
+            int V = -(int8_t)(uv >> 8) * scale;
+            int r_sqrt = isqrt(U * U + V * V);
+
+            for (int R = LVA_SCOPE_R; R < 128; R++)
+            {
+                int c = U * R / r_sqrt;
+                int s = V * R / r_sqrt;
+                a->vectorscope[(c + 128) + (s + 128) * LV_ANALYSIS_SCOPE_SIZE] = a->vectorscope_red;
+            }
+        }
+    }
+}
+
+void FAST lv_analysis_run(struct lv_analysis * a)
+{
+    int flags = 0;
+
+    if (a->hist)
+    {
+        flags |= LVA_HIST;
+
+        if (a->hist_r && a->hist_g && a->hist_b)
+        {
+            flags |= LVA_RGB;
+
+            for (int v = -256; v < 512; v++)
+            {
+                int c = v < 0 ? 0 : v > 255 ? 255 : v;
+                a->rgb_levels[v + 256] = (c * LV_ANALYSIS_HIST_BINS) >> 8;
+            }
+        }
+    }
+
+    if (a->waveform)
+    {
+        flags |= LVA_WAVE;
+
+        for (int Y = 0; Y < 256; Y++)
+        {
+            int y = (Y * a->waveform_height) >> 8;
+            a->waveform_rows[Y] = (y < a->waveform_height ? y : a->waveform_height - 1) * a->waveform_width;
+        }
+    }
+
+    if (a->vectorscope)
+    {
+        flags |= LVA_SCOPE;
+
+        if (!a->dither)
+        {
+            a->dither = 2463534242u;
+        }
+    }
+
+    switch (flags)
+    {
+        #define LVA_CASE(f) case (f): lv_analysis_rows(a, (f)); break;
+        LVA_CASE(LVA_HIST)
+        LVA_CASE(LVA_HIST | LVA_RGB)
+        LVA_CASE(LVA_WAVE)
+        LVA_CASE(LVA_HIST | LVA_WAVE)
+        LVA_CASE(LVA_HIST | LVA_RGB | LVA_WAVE)
+        LVA_CASE(LVA_SCOPE)
+        LVA_CASE(LVA_HIST | LVA_SCOPE)
+        LVA_CASE(LVA_HIST | LVA_RGB | LVA_SCOPE)
+        LVA_CASE(LVA_WAVE | LVA_SCOPE)
+        LVA_CASE(LVA_HIST | LVA_WAVE | LVA_SCOPE)
+        LVA_CASE(LVA_HIST | LVA_RGB | LVA_WAVE | LVA_SCOPE)
+        #undef LVA_CASE
+        default:
+            return;
+    }
+
+    if (flags & LVA_SCOPE)
+    {
+        lv_analysis_scope_outside(a);
+    }
+
+    if (flags & LVA_HIST)
+    {
+        /* bin 0 is ignored, it generates too much noise */
+        a->hist_max = 0;
+        for (int i = 1; i < LV_ANALYSIS_HIST_BINS; i++)
+        {
+            a->hist_max = a->hist[i] > a->hist_max ? a->hist[i] : a->hist_max;
+        }
+    }
+}
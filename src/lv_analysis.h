@@ -0,0 +1,75 @@
+/**
+ * Single pass LiveView analysis: histogram, waveform and vectorscope
+ * from one read of the YUV422 image.
+ *
+ * Plain C without camera dependencies, so it also builds on the host
+ * (tools/lv_bench).
+ */
+
+#ifndef _lv_analysis_h_
+#define _lv_analysis_h_
+
+#include <stdint.h>
+
+#define LV_ANALYSIS_HIST_BINS    128
+#define LV_ANALYSIS_SCOPE_SIZE   256
+
+/* magic zoom borders, those colors are skipped (see histogram.h) */
+#define LV_ANALYSIS_MZ_WHITE 0xFE12FE34
+#define LV_ANALYSIS_MZ_BLACK 0x00120034
+#define LV_ANALYSIS_MZ_GREEN 0xB68DB69E
+
+struct lv_analysis
+{
+    /* UYVY image, two pixels per word */
+    const uint32_t * buf;
+
+    /* byte offsets of the analyzed rows and of the pixel pairs within a row,
+     * i.e. what BM2LV(x,y) gives for the sampled bitmap coordinates */
+    const uint32_t * row_offsets;
+    const uint32_t * col_offsets;
+    int rows;
+    int cols;
+
+    /* skip magic zoom border colors */
+    int skip_mz;
+
+    /* luma histogram with LV_ANALYSIS_HIST_BINS bins, NULL to skip */
+    uint32_t * hist;
+
+    /* RGB histograms, NULL to skip; need hist and the yuv2rgb tables from imgconv.h */
+    uint32_t * hist_r;
+    uint32_t * hist_g;
+    uint32_t * hist_b;
+    const int * yuv2rgb_rv;
+    const int * yuv2rgb_gu;
+    const int * yuv2rgb_gv;
+    const int * yuv2rgb_bu;
+    int uv_xor;                 /* 0x80 on DIGIC 6 and later, see UYVY_GET_U */
+
+    /* waveform, width x height counters saturating at 250, NULL to skip */
+    uint8_t * waveform;
+    const uint16_t * col_waveform;  /* waveform column of each pixel pair */
+    int waveform_width;
+    int waveform_height;
+
+    /* vectorscope, LV_ANALYSIS_SCOPE_SIZE squared counters, NULL to skip */
+    uint8_t * vectorscope;
+    int vectorscope_gain;
+    uint8_t vectorscope_red;    /* color marking U/V values outside the circle */
+
+    /* results */
+    uint32_t hist_max;          /* largest histogram bin, without bin 0 */
+    uint32_t total_px;          /* pixel pairs added to the histogram */
+
+    /* internal */
+    uint32_t dither;
+    uint16_t waveform_rows[256];
+    uint8_t rgb_levels[768];
+    uint32_t scope_outside[256 * 256 / 32];
+};
+
+/* adds the image to all enabled accumulators, which are not cleared */
+void lv_analysis_run(struct lv_analysis * a);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * Focus peaking engine: edge energy of a YUV422 image, one or both pixels
+ * of each 32-bit word, and the edge histogram the threshold is picked from.
+ *
+ * For both pixels, the two luma samples of a word are kept in 16-bit lanes of one register
+ * (bits 0-15 and 16-31). With a bias, the Laplacian 4*C - L - R - U - D
+ * of both pixels is computed with a few adds and never borrows across
+ * lanes; a table then gives the clipped absolute value of each lane.
+ */
+
+#include "peaking.h"
+
+#ifndef FAST
+#define FAST __attribute__((optimize("-O3")))
+#endif
+
+/* 4*C - L - R - U - D is in -1020 ... 1020; with this bias, each lane stays in 0 ... 2040 */
+#define LAP_BIAS    1020
+#define LAP_BIAS2   ((LAP_BIAS << 16) | LAP_BIAS)
+
+/* same for R - L and D - U, in -255 ... 255 */
+#define D1_BIAS     255
+#define D1_BIAS2    ((D1_BIAS << 16) | D1_BIAS)
+
+/* biased Laplacian => MIN(ABS(e), 255) */
+static uint8_t lap_abs[2 * LAP_BIAS + 1];
+
+/* for filter_edges: biased Laplacian => ABS(e), biased first derivative => its penalty,
+ * and the difference of the two (biased) => the final edge value */
+static uint16_t lap_mag[2 * LAP_BIAS + 1];
+static uint16_t d1_pen[2 * D1_BIAS + 1];
+static uint8_t filtered[2 * LAP_BIAS + 1];
+static int d1_pen_filter = -1;
+
+static void peaking_init_tables(int filter_edges)
+{
+    if (!lap_abs[0])
+    {
+        for (int i = 0; i <= 2 * LAP_BIAS; i++)
+        {
+            int e = i < LAP_BIAS ? LAP_BIAS - i : i - LAP_BIAS;
+            lap_abs[i] = e < 255 ? e : 255;
+            lap_mag[i] = e;
+
+            /* same as calc_peak in zebra.c: MAX(e - penalty, 0) * 2 */
+            int f = i > LAP_BIAS ? (i - LAP_BIAS) * 2 : 0;
+            filtered[i] = f < 255 ? f : 255;
+        }
+    }
+
+    if (filter_edges != d1_pen_filter)
+    {
+        for (int i = 0; i <= 2 * D1_BIAS; i++)
+        {
+            int d1 = i < D1_BIAS ? D1_BIAS - i : i - D1_BIAS;
+            d1_pen[i] = (d1 << filter_edges) >> 2;
+        }
+        d1_pen_filter = filter_edges;
+    }
+}
+
+/* one lane, from the biased Laplacian and first derivatives */
+static inline int filtered_edge(int lap, int d1x, int d1y)
+{
+    int px = d1_pen[d1x];
+    int py = d1_pen[d1y];
+    int pen = px > py ? px : py;
+
+    /* |lap| <= 1020 and pen <= 510, so this stays in range */
+    return filtered[lap_mag[lap] - pen + LAP_BIAS];
+}
+
+static inline __attribute__((always_inline))
+void peaking_row(const uint32_t * p, int pitch_words, int cols, int filter_edges, int both, uint8_t * edges, uint32_t * hist)
+{
+    const uint32_t * up = p - pitch_words;
+    const uint32_t * down = p + pitch_words;
+
+    for (int i = 0; i < cols; i++)
+    {
+        const uint32_t w = p[i];
+        int e;
+
+        if (both)
+        {
+            /* Y0 in the low lane, Y1 in the high lane; left of Y0 is Y1 of the previous word and so on */
+            const uint32_t C = (w >> 8) & 0x00FF00FF;
+            const uint32_t L = (p[i-1] >> 24) | ((w << 8) & 0x00FF0000);
+            const uint32_t R = (w >> 24) | ((p[i+1] << 8) & 0x00FF0000);
+            const uint32_t U = (up[i] >> 8) & 0x00FF00FF;
+            const uint32_t D = (down[i] >> 8) & 0x00FF00FF;
+            const uint32_t lap = (C << 2) + LAP_BIAS2 - (L + R + U + D);
+
+            if (filter_edges)
+            {
+                const uint32_t dx = R + D1_BIAS2 - L;
+                const uint32_t dy = D + D1_BIAS2 - U;
+                int e0 = filtered_edge(lap & 0xFFFF, dx & 0xFFFF, dy & 0xFFFF);
+                int e1 = filtered_edge(lap >> 16, dx >> 16, dy >> 16);
+                e = e0 > e1 ? e0 : e1;
+            }
+            else
+            {
+                int e0 = lap_abs[lap & 0xFFFF];
+                int e1 = lap_abs[lap >> 16];
+                e = e0 > e1 ? e0 : e1;
+            }
+        }
+        else
+        {
+            /* first pixel only, as the old display filter */
+            const int c  = (w >> 8) & 0xFF;
+            const int l  = p[i-1] >> 24;
+            const int r  = w >> 24;
+            const int u  = (up[i] >> 8) & 0xFF;
+            const int d  = (down[i] >> 8) & 0xFF;
+            const int lap = 4 * c - l - r - u - d + LAP_BIAS;
+
+            if (filter_edges)
+            {
+                e = filtered_edge(lap, r - l + D1_BIAS, d - u + D1_BIAS);
+            }
+            else
+            {
+                e = lap_abs[lap];
+            }
+        }
+
+        edges[i] = e;
+        if (hist) hist[e]++;
+    }
+}
+
+/* expands to the peaking_row variants, so filter_edges, both and hist are constants in each of them */
+#define PEAKING_ROW(hist) \
+    if (both) \
+    { \
+        if (filter_edges) peaking_row(p, pitch_words, cols, filter_edges, 1, edges, hist); \
+        else              peaking_row(p, pitch_words, cols, 0, 1, edges, hist); \
+    } \
+    else \
+    { \
+        if (filter_edges) peaking_row(p, pitch_words, cols, filter_edges, 0, edges, hist); \
+        else              peaking_row(p, pitch_words, cols, 0, 0, edges, hist); \
+    }
+
+void FAST peaking_edges(const uint32_t * src, int pitch, int cols, int filter_edges, int both, uint8_t * edges)
+{
+    peaking_init_tables(filter_edges);
+
+    const int pitch_words = pitch / 4;
+    const uint32_t * p = src;
+    PEAKING_ROW((uint32_t *) 0)
+}
+
+void FAST peaking_hist(const uint32_t * src, int pitch, int rows, int cols, int filter_edges, int both, int row_step, uint8_t * edges, uint32_t * hist)
+{
+    peaking_init_tables(filter_edges);
+
+    const int pitch_words = pitch / 4;
+
+    for (int y = row_step / 2; y < rows; y += row_step, edges += cols)
+    {
+        const uint32_t * p = src + y * pitch_words;
+        PEAKING_ROW(hist)
+    }
+}
+
+#undef PEAKING_ROW
+
+int peaking_threshold(const uint32_t * hist, int pthr, int thr_min)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        total += hist[i];
+    }
+
+    /* walk down from the strongest edges while at most pthr/1000 of the pixels are above */
+    uint32_t over = 0;
+    int thr = 256;
+    while (thr > thr_min)
+    {
+        over += hist[thr - 1];
+        if ((uint64_t)over * 1000 > (uint64_t)total * pthr)
+        {
+            break;
+        }
+        thr--;
+    }
+
+    return thr < 255 ? thr : 255;
+}
@@ -0,0 +1,34 @@
+/**
+ * Focus peaking engine: edge energy of a YUV422 image, one or both pixels
+ * of each 32-bit word, and an edge histogram from a subset of its rows, so the
+ * threshold for a given percentage of "focused" pixels is taken from the
+ * current frame instead of converging over several frames.
+ *
+ * Plain C without camera dependencies, so it also builds on the host
+ * (tools/lv_bench).
+ */
+
+#ifndef _peaking_h_
+#define _peaking_h_
+
+#include <stdint.h>
+
+/* edge energy of one row of 'cols' UYVY words, starting at 'src' (rows are 'pitch' bytes apart);
+ * the neighbors above, below, left and right of the row are read, too.
+ *
+ * edges: one byte per word, the absolute Laplacian of the luma (as calc_peak in zebra.c), clipped to 255
+ * filter_edges: 0-2, attenuate strong edges (focus.peaking.filter.edges)
+ * both: 0 = first pixel of each word, as the old display filter; 1 = the larger of the two pixels,
+ *       which is about 2x slower on the host (tools/lv_bench/peaking_bench)
+ */
+void peaking_edges(const uint32_t * src, int pitch, int cols, int filter_edges, int both, uint8_t * edges);
+
+/* the same for rows row_step/2, row_step/2 + row_step and so on of 'rows' rows, one after the other
+ * in 'edges' (PEAKING_HIST_ROWS of them), and added to hist (256 counters) to pick the threshold */
+#define PEAKING_HIST_ROWS(rows, row_step) (((rows) - (row_step) / 2 + (row_step) - 1) / (row_step))
+void peaking_hist(const uint32_t * src, int pitch, int rows, int cols, int filter_edges, int both, int row_step, uint8_t * edges, uint32_t * hist);
+
+/* smallest threshold >= thr_min with at most pthr/1000 of the counted values at or above it */
+int peaking_threshold(const uint32_t * hist, int pthr, int thr_min);
+
+#endif
@@ -20,6 +20,8 @@
 
 #include "dryos.h"
 #include "raw.h"
+#include "raw_plane.h"
+#include "raw_preview.h"
 #include "property.h"
 #include "math.h"
 #include "bmp.h"
@@ -50,6 +52,9 @@ static struct semaphore * raw_sem = 0;
 /* whether to recompute all the raw parameters (1), or just use cached values(0) */
 static int dirty = 0;
 
+/* changes whenever the raw settings were marked dirty, see raw_get_frame_id */
+static uint32_t dirty_count = 0;
+
 /* if get_ms_clock() is less than this, assume the raw data is invalid */
 static int next_retry_lv = 0;
 
@@ -58,12 +63,27 @@ static void raw_set_dirty_with_timeout(int timeout_ms)
 {
     next_retry_lv = get_ms_clock() + timeout_ms;
     dirty = 1;
+    dirty_count++;
 }
 
 /* call this to force an update of all raw parameters */
 void raw_set_dirty(void)
 {
     dirty = 1;
+    dirty_count++;
+}
+
+uint32_t raw_get_frame_id()
+{
+    /* LiveView: one id per frame; photo mode: one per picture */
+    uint32_t frame = lv ? get_lv_frame_counter() : QR_MODE ? (uint32_t) file_number : 0;
+
+    if (!frame)
+    {
+        return 0;
+    }
+
+    return (frame << 8) | (dirty_count & 0xFF);
 }
 
 /* dual ISO interface */
@@ -1573,6 +1593,73 @@ int FAST raw_blue_pixel_bright(int x, int y)
     return MAX(buf[i].h, buf[i - raw_info.width*2/8].h);
 }
 
+/* decimated raw plane, shared by raw zebras and the raw histogram */
+static struct raw_plane plane;
+static struct semaphore * raw_plane_sem = 0;
+
+/* images without a frame id (playback) are identified by the dirty count, the buffer and its size */
+static uint32_t plane_dirty_count = 0;
+
+/* free it after this long without requests */
+#define RAW_PLANE_IDLE_MS 3000
+static int plane_last_request = 0;
+
+struct raw_plane * raw_plane_get()
+{
+    take_semaphore(raw_plane_sem, 0);
+    plane_last_request = get_ms_clock();
+
+    uint32_t frame_id = raw_get_frame_id();
+    int same_image = frame_id ? frame_id == plane.frame_id
+                              : !plane.frame_id && dirty_count == plane_dirty_count;
+
+    if (same_image && raw_info.buffer == plane.buffer &&
+        raw_info.width == plane.raw_width && raw_info.height == plane.raw_height)
+    {
+        return &plane;
+    }
+
+    int ok = lv ? raw_plane_build(&plane, &raw_info, RAW_PLANE_LV_MAX_W, RAW_PLANE_LV_MAX_H)
+                : raw_plane_build(&plane, &raw_info, RAW_PLANE_MAX_W, RAW_PLANE_MAX_H);
+
+    if (!ok)
+    {
+        give_semaphore(raw_plane_sem);
+        return 0;
+    }
+
+    plane.frame_id = frame_id;
+    plane_dirty_count = dirty_count;
+    return &plane;
+}
+
+void raw_plane_put()
+{
+    give_semaphore(raw_plane_sem);
+}
+
+void raw_plane_flush()
+{
+    take_semaphore(raw_plane_sem, 0);
+    raw_plane_free(&plane);
+    give_semaphore(raw_plane_sem);
+}
+
+void raw_plane_free_if_idle()
+{
+    if (!raw_plane_sem)
+    {
+        return;
+    }
+
+    take_semaphore(raw_plane_sem, 0);
+    if (plane.allocated && get_ms_clock() - plane_last_request > RAW_PLANE_IDLE_MS)
+    {
+        raw_plane_free(&plane);
+    }
+    give_semaphore(raw_plane_sem);
+}
+
 
 int FAST raw_get_pixel(int x, int y) {
     struct raw_pixblock * p = (void*)raw_info.buffer + y * raw_info.pitch + (x/8)*14;
@@ -2065,228 +2152,199 @@ int raw_lv_settings_still_valid()
 }
 #endif // CONFIG_RAW_LIVEVIEW
 
-/* For accessing the pixels in a struct raw_pixblock, faster than via raw_get_pixel */
-/* todo: move in raw.h? */
-#define PA ((int)(p->a))
-#define PB ((int)(p->b_lo | (p->b_hi << 12)))
-#define PC ((int)(p->c_lo | (p->c_hi << 10)))
-#define PD ((int)(p->d_lo | (p->d_hi << 8)))
-#define PE ((int)(p->e_lo | (p->e_hi << 6)))
-#define PF ((int)(p->f_lo | (p->f_hi << 4)))
-#define PG ((int)(p->g_lo | (p->g_hi << 2)))
-#define PH ((int)(p->h))
-
-/* a second set of pixels */
-#define QA ((int)(q->a))
-#define QB ((int)(q->b_lo | (q->b_hi << 12)))
-#define QC ((int)(q->c_lo | (q->c_hi << 10)))
-#define QD ((int)(q->d_lo | (q->d_hi << 8)))
-#define QE ((int)(q->e_lo | (q->e_hi << 6)))
-#define QF ((int)(q->f_lo | (q->f_hi << 4)))
-#define QG ((int)(q->g_lo | (q->g_hi << 2)))
-#define QH ((int)(q->h))
-
-static void FAST raw_preview_color_work(void* raw_buffer, void* lv_buffer, int y1, int y2)
-{
-    dbg_printf("Raw color preview...\n");
-
-    uint16_t* lv16 = CACHEABLE(lv_buffer);
-    uint32_t* lv32 = (uint32_t*) lv16;
-    if (!lv16)
-    {
-        dbg_printf("No YUV buffer\n");
-        return;
-    }
+/* raw to YUV tables (raw_preview.c), rebuilt only when the black or white level change */
+static struct raw_preview_lut preview_lut;
 
-    struct raw_pixblock * raw = CACHEABLE(raw_buffer);
-    if (!raw)
-    {
-        dbg_printf("No RAW buffer\n");
-        return;
-    }
+/* white balance 2,1,2: red and blue one stop brighter than green; 10 stops shown */
+#define PREVIEW_EV_RB   11
+#define PREVIEW_EV_G    10
 
-    /* scale useful range (black...white) to 0...1023 or less */
-    int black = raw_info.black_level;
-    int white = raw_info.white_level;
-    int div = 0;
-    while (((white-black) >> div) >= 1024)
-    {
-        div++;
-    }
+/* column descriptors for the preview lines (two per RGGB cell in color modes) */
+static int * preview_cols = 0;
+static int preview_cols_size = 0;
+static int preview_x1 = 0;
+static int preview_x2 = 0;
+static int preview_n = 0;
+
+/* measured CPU time of each preview quality on this camera, in microseconds per 100 lines; 0 = not measured yet */
+static int preview_cost[RAW_PREVIEW_QUALITIES];
 
-    /* white balance 2,1,2 => use two gamma curves to simplify code */
-    uint8_t gamma_rb[1024];
-    uint8_t gamma_g[1024];
+/* CPU time for one adaptive preview frame, see raw_preview_set_budget */
+static int preview_budget_us = 20000;
 
-    for (int i = 0; i < 1024; i++)
+/* LUTs and column descriptors for this quality and preview rectangle; returns 0 on failure */
+static int raw_preview_setup(int quality)
+{
+    if (!raw_preview_lut_update(&preview_lut, raw_info.black_level, raw_info.white_level, PREVIEW_EV_RB, PREVIEW_EV_G, PREVIEW_EV_RB))
     {
-        /* only show 10 bits */
-        int g_rb = COERCE(raw_to_ev((i << div) + black) + 11, 0, 10) * 255 / 10;
-        int g_g  = COERCE(raw_to_ev((i << div) + black) + 10, 0, 10) * 255 / 10;
-        /* gamma 2 */
-        gamma_rb[i] = COERCE(g_rb * g_rb / 255, 0, 255);
-        gamma_g[i]  = COERCE(g_g  * g_g  / 255, 0, 255);
+        dbg_printf("No memory for preview LUT\n");
+        return 0;
     }
 
     int x1 = COERCE(RAW2LV_X(preview_rect_x), 0, vram_lv.width);
     int x2 = COERCE(RAW2LV_X(preview_rect_x + preview_rect_w), 0, vram_lv.width);
-    if (x2 < x1) return;
+    if (x2 < x1) return 0;
 
-    /* cache the LV to RAW transformation for the inner loop to make it faster */
-    /* we will always choose a green pixel */
+    /* LiveView pixels per sample: 2 (one UYVY word) at half resolution, 4 in the faster modes */
+    const int x_step = (quality == RAW_PREVIEW_COLOR_HALFRES) ? 2 : 4;
+    const int n = (x2 - x1 + x_step - 1) / x_step;
 
-    int* lv2rx = malloc(x2 * 4);
-    if (!lv2rx) return;
-    for (int x = x1; x < x2; x++)
-        lv2rx[x] = LV2RAW_X(x) & ~1;
+    if (2 * n > preview_cols_size)
+    {
+        free(preview_cols);
+        preview_cols = malloc(2 * n * sizeof(int));
+        preview_cols_size = preview_cols ? 2 * n : 0;
+        if (!preview_cols) return 0;
+    }
 
-    /* full-res vertically */
-    for (int y = y1; y < y2; y++)
+    /* cache the LV to RAW transformation for the inner loop to make it faster */
+    for (int i = 0, x = x1; i < n; i++, x += x_step)
     {
-        int yr = LV2RAW_Y(y) & ~1;
+        int xr = LV2RAW_X(x) & ~1;
 
-        if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+        if (quality == RAW_PREVIEW_GRAY_ULTRA_FAST)
+        {
+            /* first pixel of the 8-pixel block; green on odd lines */
+            preview_cols[i] = raw_preview_column(xr & ~7);
+        }
+        else
         {
-            /* out of range, just fill with black */
-            memset(&lv32[LV(0,y)/4], 0, vram_lv.pitch);
-            continue;
+            /* RGGB cell */
+            /* note: at 1920 horizontal resolution in raw, downsampling by 8 would result in 240px horizontally => looks ugly */
+            preview_cols[2*i]   = raw_preview_column(xr);
+            preview_cols[2*i+1] = raw_preview_column(xr + 1);
         }
+    }
 
-        /* fill left/right borders with black */
-        memset(&lv32[LV(0,y)/4],  0, LV(x1,y) - LV(0,y)/4*4);
-        memset(&lv32[LV(x2,y)/4], 0, LV(0,1) - LV(x2,0)/4*4);
+    preview_x1 = x1;
+    preview_x2 = x2;
+    preview_n = n;
+    return 1;
+}
 
-        struct raw_pixblock * row = (void*)raw + yr * raw_info.pitch;
+/* converts LiveView lines y1...y2, after raw_preview_setup */
+static void FAST raw_preview_lines(void* raw_buffer, void* lv_buffer, int y1, int y2, int quality)
+{
+    uint32_t* lv32 = CACHEABLE(lv_buffer);
+    uint64_t* lv64 = (uint64_t*) lv32;
+    const uint16_t* raw = CACHEABLE(raw_buffer);
+    const int raw_pitch = raw_info.pitch / 2;
+    const int x1 = preview_x1;
+    const int x2 = preview_x2;
 
-        /* half-res horizontally, to simplify YUV422 math */
-        for (int x = x1; x < x2; x += 2)
+    for (int y = y1; y < y2; y++)
+    {
+        if (quality == RAW_PREVIEW_COLOR_HALFRES)
         {
-            int xr = lv2rx[x];
-            struct raw_pixblock * p = row + (xr/8);                 /* RG (xr and yr are multiples of 2) */
-            struct raw_pixblock * q = (void*) p + raw_info.pitch;   /* GB, next line */
-            int r,g,b;
+            /* full-res vertically, half-res horizontally, to simplify YUV422 math */
+            int yr = LV2RAW_Y(y) & ~1;
 
-            /* RGGB cell */
-            /* note: at 1920 horizontal resolution in raw, downsampling by 8 would result in 240px horizontally => looks ugly */
-            switch (xr%8)
+            if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
             {
-                case 0:
-                    r = PA;
-                    g = (PB + QA) >> 1;
-                    b = QB;
-                    break;
-                case 2:
-                    r = PC;
-                    g = (PD + QC) >> 1;
-                    b = QD;
-                    break;
-                case 4:
-                    r = PE;
-                    g = (PF + QE) >> 1;
-                    b = QF;
-                    break;
-                case 6:
-                    r = PG;
-                    g = (PH + QG) >> 1;
-                    b = QH;
-                    break;
-                default:
-                    r = g = b = 0;
+                /* out of range, just fill with black */
+                memset(&lv32[LV(0,y)/4], 0, vram_lv.pitch);
+                continue;
             }
-            
-            /* div is chosen so that ((white-black) >> div) < 1024 */
-            r = gamma_rb[COERCE(r - black, 0, white-black) >> div];
-            g = gamma_g [COERCE(g - black, 0, white-black) >> div];
-            b = gamma_rb[COERCE(b - black, 0, white-black) >> div];
-
-            uint32_t yuv = rgb2yuv422(r,g,b);
-            lv32[LV(x,y)/4] = yuv;
+
+            /* fill left/right borders with black */
+            memset(&lv32[LV(0,y)/4],  0, LV(x1,y) - LV(0,y)/4*4);
+            memset(&lv32[LV(x2,y)/4], 0, LV(0,1) - LV(x2,0)/4*4);
+
+            const uint16_t * rg = raw + yr * raw_pitch;
+            raw_preview_color_line(&preview_lut, rg, rg + raw_pitch, preview_cols, preview_n, &lv32[LV(x1,y)/4], 0);
+        }
+        else
+        {
+            /* quarter resolution: every other line, copied to the next one */
+            int yr = (quality == RAW_PREVIEW_GRAY_ULTRA_FAST) ? LV2RAW_Y(y) | 1 : LV2RAW_Y(y) & ~1;
+
+            if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+            {
+                /* out of range, just fill with black */
+                memset(&lv64[LV(0,y)/8], 0, vram_lv.pitch);
+                continue;
+            }
+
+            /* fill left/right borders with black */
+            memset(&lv64[LV(0,y)/8],  0, LV(x1,y) - LV(0,y)/8*8);
+            memset(&lv64[LV(x2,y)/8], 0, LV(0,1) - LV(x2,0)/8*8);
+
+            if (y%2) continue;
+
+            const uint16_t * line = raw + yr * raw_pitch;
+            uint64_t * out = &lv64[LV(x1,y)/8];
+
+            if (quality == RAW_PREVIEW_GRAY_ULTRA_FAST)
+            {
+                raw_preview_gray_line(&preview_lut, line, preview_cols, preview_n, out);
+            }
+            else
+            {
+                raw_preview_color_line(&preview_lut, line, line + raw_pitch, preview_cols, preview_n, (uint32_t*) out, 1);
+            }
+
+            memcpy(out + vram_lv.pitch/8, out, preview_n * 8);
         }
     }
-    free(lv2rx);
 }
 
-static void FAST raw_preview_fast_work(void* raw_buffer, void* lv_buffer, int y1, int y2)
+/* converts lines y1...y2; returns the CPU time used, in microseconds, or -1 on failure */
+static int raw_preview_work(void* raw_buffer, void* lv_buffer, int y1, int y2, int quality)
 {
-    dbg_printf("Raw grayscale preview...\n");
-
-    uint16_t* lv16 = CACHEABLE(lv_buffer);
-    uint64_t* lv64 = (uint64_t*) lv16;
-    if (!lv16)
+    if (!CACHEABLE(lv_buffer))
     {
         dbg_printf("No YUV buffer\n");
-        return;
+        return -1;
     }
 
-    struct raw_pixblock * raw = CACHEABLE(raw_buffer);
-    if (!raw)
+    if (!CACHEABLE(raw_buffer))
     {
         dbg_printf("No RAW buffer\n");
-        return;
-    }
-
-    /* scale useful range (black...white) to 0...1023 or less */
-    int black = raw_info.black_level;
-    int white = raw_info.white_level;
-    int div = 0;
-    while (((white-black) >> div) >= 1024)
-    {
-        div++;
+        return -1;
     }
 
-    uint8_t gamma[1024];
-
-    for (int i = 0; i < 1024; i++)
+    uint64_t t0 = get_us_clock();
+    if (!raw_preview_setup(quality))
     {
-        /* only show 10 bits */
-        int g = COERCE(raw_to_ev((i << div) + black) + 10, 0, 10) * 255 / 10;
-        gamma[i] = g * g / 255; /* gamma 2 */
+        return -1;
     }
 
-    int x1 = COERCE(RAW2LV_X(preview_rect_x), 0, vram_lv.width);
-    int x2 = COERCE(RAW2LV_X(preview_rect_x + preview_rect_w), 0, vram_lv.width);
-    if (x2 < x1) return;
+    raw_preview_lines(raw_buffer, lv_buffer, y1, y2, quality);
+    return get_us_clock() - t0;
+}
 
-    /* cache the LV to RAW transformation for the inner loop to make it faster */
-    /* we will always choose a green pixel */
+/* best quarter resolution quality whose measured cost fits the budget; an unmeasured one is tried when the previous one used less than half of it */
+static int raw_preview_choose_quality(int lines)
+{
+    /* half resolution color is never picked: adaptive mode is for when the recorder needs the CPU */
+    static const int by_cost[] = { RAW_PREVIEW_GRAY_ULTRA_FAST, RAW_PREVIEW_COLOR_QUARTERRES };
 
-    int* lv2rx = malloc(x2 * 4);
-    if (!lv2rx) return;
-    for (int x = x1; x < x2; x++)
-        lv2rx[x] = LV2RAW_X(x) & ~1;
+    int best = by_cost[0];
+    int best_cost = 0;
 
-    for (int y = y1; y < y2; y++)
+    for (int i = 0; i < COUNT(by_cost); i++)
     {
-        int yr = LV2RAW_Y(y) | 1;
+        int q = by_cost[i];
 
-        if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+        if (!preview_cost[q])
         {
-            /* out of range, just fill with black */
-            memset(&lv64[LV(0,y)/8], 0, vram_lv.pitch);
-            continue;
+            if (i == 0 || best_cost * 2 < preview_budget_us) best = q;
+            break;
         }
 
-        /* fill left/right borders with black */
-        memset(&lv64[LV(0,y)/8],  0, LV(x1,y) - LV(0,y)/8*8);
-        memset(&lv64[LV(x2,y)/8], 0, LV(0,1) - LV(x2,0)/8*8);
+        int cost = preview_cost[q] * lines / 100;
+        if (i > 0 && cost > preview_budget_us) break;
 
-        struct raw_pixblock * row = (void*)raw + yr * raw_info.pitch;
+        best = q;
+        best_cost = cost;
+    }
 
-        if (y%2) continue;
+    return best;
+}
 
-        for (int x = x1; x < x2; x += 4)
-        {
-            int xr = lv2rx[x];
-            struct raw_pixblock * p = row + (xr/8);
-            int c = p->a;
-            uint64_t Y = gamma[COERCE(c - black, 0, white-black) >> div];
-            Y = (Y << 8) | (Y << 24) | (Y << 40) | (Y << 56);
-            int idx = LV(x,y)/8;
-            lv64[idx] = Y;
-            lv64[idx + vram_lv.pitch/8] = Y;
-        }
-    }
-    free(lv2rx);
+void raw_preview_set_budget(int budget_us)
+{
+    preview_budget_us = budget_us;
 }
 
 void FAST raw_preview_fast_ex(void* raw_buffer, void* lv_buffer, int y1, int y2, int quality)
@@ -2311,17 +2369,28 @@ void FAST raw_preview_fast_ex(void* raw_buffer, void* lv_buffer, int y1, int y2,
     if (quality == -1)
         quality = 0;
 
-    switch (quality)
-    {
-        case RAW_PREVIEW_GRAY_ULTRA_FAST:
-            raw_preview_fast_work(raw_buffer, lv_buffer, y1, y2);
-            break;
+    if (y2 <= y1)
+        return;
 
-        case RAW_PREVIEW_COLOR_HALFRES:
-        default:
-            raw_preview_color_work(raw_buffer, lv_buffer, y1, y2);
-            break;
+    int adaptive = (quality == RAW_PREVIEW_ADAPTIVE);
+    if (adaptive)
+    {
+        quality = raw_preview_choose_quality(y2 - y1);
+    }
+    else if (quality < 0 || quality >= RAW_PREVIEW_QUALITIES)
+    {
+        quality = RAW_PREVIEW_COLOR_HALFRES;
     }
+
+    dbg_printf("Raw preview (quality %d)...\n", quality);
+
+    int used = raw_preview_work(raw_buffer, lv_buffer, y1, y2, quality);
+    if (used < 0)
+        return;
+
+    /* remember how long it takes on this camera, for the adaptive mode */
+    int cost = MAX(used * 100 / (y2 - y1), 1);
+    preview_cost[quality] = preview_cost[quality] ? (3 * preview_cost[quality] + cost) / 4 : cost;
 }
 
 void FAST raw_preview_fast()
@@ -2737,6 +2806,7 @@ static struct menu_entry debug_menus[] = {
 static void raw_init()
 {
     raw_sem = create_named_semaphore("raw_sem", 1);
+    raw_plane_sem = create_named_semaphore("raw_plane_sem", 1);
 
     #ifdef RAW_DEBUG_TYPE
     menu_add("Debug", debug_menus, COUNT(debug_menus));
@@ -137,6 +137,12 @@ void raw_preview_fast();
 void raw_preview_fast_ex(void* raw_buffer, void* lv_buffer, int start_line, int end_line, int quality);
 #define RAW_PREVIEW_COLOR_HALFRES   0   /* 360x480 color, pretty slow */
 #define RAW_PREVIEW_GRAY_ULTRA_FAST 1   /* 180x240, aims to be real-time */
+#define RAW_PREVIEW_COLOR_QUARTERRES 2  /* 180x240 color */
+#define RAW_PREVIEW_QUALITIES       3
+#define RAW_PREVIEW_ADAPTIVE        -2  /* gray or quarter resolution color, whichever fits the CPU budget, measured on this camera */
+
+/* CPU time for one RAW_PREVIEW_ADAPTIVE frame, in microseconds */
+void raw_preview_set_budget(int budget_us);
 
 /* request/release/check LiveView RAW flag (lv_save_raw) */
 /* you have to call request/release in pairs (be careful not to request once and release twice) */
@@ -163,6 +169,19 @@ void raw_set_preview_rect(int x, int y, int w, int h, int obey_info_bars);
 /* call this after you have altered the preview settings, and you want to restore the original ones */
 void raw_set_dirty(void);
 
+/* identifies the image in the raw buffer (LiveView frame or picture), for caching results computed from it */
+/* 0 = unknown, do not cache */
+uint32_t raw_get_frame_id();
+
+/* per-channel samples of the current image (see raw_plane.h), decoded once per frame */
+/* call raw_update_params first; returns NULL if out of memory, otherwise release it with raw_plane_put */
+struct raw_plane * raw_plane_get();
+void raw_plane_put();
+
+/* frees the plane buffers; raw_plane_free_if_idle only if nobody asked for the plane in the last few seconds */
+void raw_plane_flush();
+void raw_plane_free_if_idle();
+
 /* for x5 crop mode: get the offset (in pixels) between raw and yuv frames. Return: 1=OK, 0=failed. */
 int focus_box_get_raw_crop_offset(int* delta_x, int* delta_y); /* this is in shoot.c */
 
@@ -0,0 +1,130 @@
+/**
+ * Decimated raw plane: per-channel 16-bit samples of the raw buffer, decoded once per frame.
+ */
+
+#ifdef CONFIG_MAGICLANTERN
+#include "dryos.h"
+#else
+#include <stdlib.h>
+#endif
+
+#include <string.h>
+#include "raw_plane.h"
+
+#ifndef FAST
+#define FAST __attribute__((optimize("-O3")))
+#endif
+
+void raw_plane_free(struct raw_plane * plane)
+{
+    for (int c = 0; c < RAW_PLANE_CHANNELS; c++)
+    {
+        free(plane->ch[c]);
+        plane->ch[c] = 0;
+    }
+    plane->allocated = 0;
+    plane->frame_id = 0;
+    plane->buffer = 0;
+    plane->raw_width = 0;
+    plane->raw_height = 0;
+}
+
+static int raw_plane_alloc(struct raw_plane * plane, int samples)
+{
+    if (samples <= plane->allocated)
+    {
+        return 1;
+    }
+
+    raw_plane_free(plane);
+
+    for (int c = 0; c < RAW_PLANE_CHANNELS; c++)
+    {
+        plane->ch[c] = malloc(samples * sizeof(uint16_t));
+        if (!plane->ch[c])
+        {
+            raw_plane_free(plane);
+            return 0;
+        }
+    }
+
+    plane->allocated = samples;
+    return 1;
+}
+
+int FAST raw_plane_build(struct raw_plane * plane, struct raw_info * raw_info, int max_w, int max_h)
+{
+    const int blocks = raw_info->width / 8;
+    const int pairs = raw_info->height / 2;
+
+    /* one sample per block and line pair, unless that's more than requested;
+     * power of 2 steps, so the lookups can use shifts */
+    int bx_step = 1, py_step = 1;
+    plane->x_shift = 3;
+    plane->y_shift = 1;
+    while (blocks > max_w * bx_step) { bx_step *= 2; plane->x_shift++; }
+    while (pairs  > max_h * py_step) { py_step *= 2; plane->y_shift++; }
+
+    plane->width = (blocks + bx_step - 1) / bx_step;
+    plane->height = (pairs + py_step - 1) / py_step;
+    plane->frame_id = 0;
+    plane->buffer = 0;
+
+    if (!raw_plane_alloc(plane, plane->width * plane->height))
+    {
+        return 0;
+    }
+
+    const int line = raw_info->width / 8;   /* blocks per line */
+
+    uint16_t * rd = plane->ch[RAW_PLANE_RED_DARK];
+    uint16_t * gd = plane->ch[RAW_PLANE_GREEN_DARK];
+    uint16_t * bd = plane->ch[RAW_PLANE_BLUE_DARK];
+    uint16_t * rb = plane->ch[RAW_PLANE_RED_BRIGHT];
+    uint16_t * gb = plane->ch[RAW_PLANE_GREEN_BRIGHT];
+    uint16_t * bb = plane->ch[RAW_PLANE_BLUE_BRIGHT];
+
+    for (int sy = 0; sy < plane->height; sy++)
+    {
+        const int y = sy << plane->y_shift;
+        const int i0 = sy * plane->width;
+
+        if (y < 4)
+        {
+            /* the lines above (for blue and for the dual ISO pair) are outside the buffer */
+            for (int c = 0; c < RAW_PLANE_CHANNELS; c++)
+            {
+                memset(plane->ch[c] + i0, 0, plane->width * sizeof(uint16_t));
+            }
+            continue;
+        }
+
+        /* same lines as raw_red_pixel_dark & co.: red and green from y and y-2, blue from y-1 and y-3;
+         * each raw_pixblock is 7 halfwords, with 'a' in the top 14 bits of the first one
+         * and 'h' in the low 14 bits of the last one */
+        const uint16_t * rg0 = (const uint16_t *) raw_info->buffer + y * line * 7;
+        const uint16_t * rg1 = rg0 - 2 * line * 7;
+        const uint16_t * gb0 = rg0 - line * 7;
+        const uint16_t * gb1 = gb0 - 2 * line * 7;
+
+        for (int sx = 0, b = 0; sx < plane->width; sx++, b += bx_step * 7)
+        {
+            const int i = i0 + sx;
+            int r0 = rg0[b] >> 2, r1 = rg1[b] >> 2;
+            int g0 = rg0[b + 6] & 0x3FFF, g1 = rg1[b + 6] & 0x3FFF;
+            int b0 = gb0[b + 6] & 0x3FFF, b1 = gb1[b + 6] & 0x3FFF;
+
+            rd[i] = r0 < r1 ? r0 : r1;
+            rb[i] = r0 < r1 ? r1 : r0;
+            gd[i] = g0 < g1 ? g0 : g1;
+            gb[i] = g0 < g1 ? g1 : g0;
+            bd[i] = b0 < b1 ? b0 : b1;
+            bb[i] = b0 < b1 ? b1 : b0;
+        }
+    }
+
+    plane->buffer = raw_info->buffer;
+    plane->raw_width = raw_info->width;
+    plane->raw_height = raw_info->height;
+    return 1;
+}
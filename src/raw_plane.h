@@ -0,0 +1,72 @@
+/**
+ * Decimated raw plane: one red, green and blue sample per 8-pixel block
+ * and per line pair (or per 2x2, 4x4... of those, if the image is large),
+ * decoded once per frame into separate 16-bit buffers.
+ *
+ * Raw zebras and the raw histogram read these buffers instead of
+ * unpacking 14-bit pixels with raw_red_pixel_dark & co. for every sample.
+ * The values are the same as returned by those functions for the
+ * same coordinates (at full sampling; coarser grids pick the nearest sample).
+ *
+ * Plain C (only raw.h), so it also builds on the host (tools/lv_bench).
+ */
+
+#ifndef _raw_plane_h_
+#define _raw_plane_h_
+
+#include <stdint.h>
+#include "raw.h"
+
+/* for dual ISO, each color is kept from the dark and from the bright exposure,
+ * as with raw_red_pixel_dark / raw_red_pixel_bright */
+#define RAW_PLANE_RED_DARK      0
+#define RAW_PLANE_GREEN_DARK    1
+#define RAW_PLANE_BLUE_DARK     2
+#define RAW_PLANE_RED_BRIGHT    3
+#define RAW_PLANE_GREEN_BRIGHT  4
+#define RAW_PLANE_BLUE_BRIGHT   5
+#define RAW_PLANE_CHANNELS      6
+
+/* grid limits: at most one sample per bitmap pixel in playback.
+ * The steps are powers of 2, so a grid has more than half of these samples;
+ * in LiveView that's still more than the overlays display (raw zebras use
+ * every 8th bitmap column and every other line, i.e. 90 x 240) */
+#define RAW_PLANE_MAX_W         720
+#define RAW_PLANE_MAX_H         480
+#define RAW_PLANE_LV_MAX_W      180
+#define RAW_PLANE_LV_MAX_H      480
+
+struct raw_plane
+{
+    uint32_t frame_id;          /* raw_get_frame_id() when it was built; 0 = unknown */
+    void * buffer;              /* raw buffer it was built from */
+    int raw_width;              /* and its size */
+    int raw_height;
+    int width;                  /* samples per line */
+    int height;                 /* lines */
+    int x_shift;                /* samples are 1 << x_shift raw pixels apart (at least 8) */
+    int y_shift;                /* and 1 << y_shift raw lines apart (at least 2) */
+    int allocated;              /* samples allocated for each channel */
+    uint16_t * ch[RAW_PLANE_CHANNELS];
+};
+
+/* decodes raw_info->buffer into the plane, with at most max_w x max_h samples;
+ * (re)allocates as needed; returns 0 if out of memory */
+int raw_plane_build(struct raw_plane * plane, struct raw_info * raw_info, int max_w, int max_h);
+
+/* frees the buffers */
+void raw_plane_free(struct raw_plane * plane);
+
+/* index of the sample nearest to raw coordinates (x,y), clipped to the plane */
+static inline int raw_plane_index(struct raw_plane * plane, int x, int y)
+{
+    int sx = x >> plane->x_shift;
+    int sy = y >> plane->y_shift;
+    if (sx < 0) sx = 0;
+    if (sy < 0) sy = 0;
+    if (sx >= plane->width) sx = plane->width - 1;
+    if (sy >= plane->height) sy = plane->height - 1;
+    return sy * plane->width + sx;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * Raw to YUV conversion for the LiveView raw preview, with cached per-channel lookup tables.
+ */
+
+#ifdef CONFIG_MAGICLANTERN
+#include "dryos.h"
+#else
+#include <stdlib.h>
+#endif
+
+#include "raw_preview.h"
+#include "imgconv.h"
+
+#ifndef FAST
+#define FAST __attribute__((optimize("-O3")))
+#endif
+
+void raw_preview_lut_free(struct raw_preview_lut * lut)
+{
+    free(lut->r);
+    lut->r = lut->g = lut->b = 0;
+    lut->size = 0;
+}
+
+/* same curve as the old raw_preview_color_work: 10 stops, gamma 2 */
+static void raw_preview_fill(struct raw_preview_lut * lut, uint8_t * table, int ev)
+{
+    const int bias = (lut->black + lut->offset) >> lut->div;
+    const int qmax = (lut->white - lut->black) >> lut->div;
+
+    for (int i = 0, q_prev = -1; i < lut->size; i++)
+    {
+        int q = i - bias;
+        if (q < 0) q = 0;
+        if (q > qmax) q = qmax;
+
+        if (q == q_prev)
+        {
+            /* below black or above white: same as the previous one */
+            table[i] = table[i-1];
+            continue;
+        }
+        q_prev = q;
+
+        float e = raw_to_ev((q << lut->div) + lut->black) + ev;
+        if (e < 0) e = 0;
+        if (e > 10) e = 10;
+        int g = e * 255 / 10;
+        g = g * g / 255;
+        table[i] = g < 0 ? 0 : g > 255 ? 255 : g;
+    }
+}
+
+int raw_preview_lut_update(struct raw_preview_lut * lut, int black, int white, int ev_r, int ev_g, int ev_b)
+{
+    if (lut->size && lut->black == black && lut->white == white &&
+        lut->ev_r == ev_r && lut->ev_g == ev_g && lut->ev_b == ev_b)
+    {
+        return 1;
+    }
+
+    raw_preview_lut_free(lut);
+
+    /* scale useful range (black...white) to 0...1023 or less */
+    int div = 0;
+    while (((white - black) >> div) >= 1024)
+    {
+        div++;
+    }
+
+    /* index = floor((v - black) / 2^div) + bias, without negative numbers */
+    const int bias = (black + (1 << div) - 1) >> div;
+    lut->div = div;
+    lut->offset = (bias << div) - black;
+    lut->black = black;
+    lut->white = white;
+    lut->ev_r = ev_r;
+    lut->ev_g = ev_g;
+    lut->ev_b = ev_b;
+
+    int size = ((16383 + lut->offset) >> div) + 1;
+    uint8_t * mem = malloc(size * 3);
+    if (!mem)
+    {
+        return 0;
+    }
+
+    lut->size = size;
+    lut->r = mem;
+    lut->g = mem + size;
+    lut->b = mem + size * 2;
+
+    raw_preview_fill(lut, lut->r, ev_r);
+    raw_preview_fill(lut, lut->g, ev_g);
+    raw_preview_fill(lut, lut->b, ev_b);
+    return 1;
+}
+
+/* 14-bit pixel at a column descriptor from raw_preview_column; reads the halfword before it, too */
+static inline int raw_px(const uint16_t * line, int col)
+{
+    const int o = col >> 4;
+    return ((((uint32_t) line[o-1] << 16) | line[o]) >> (col & 15)) & 0x3FFF;
+}
+
+/* same as rgb2yuv422 in imgconv.c; no clipping needed for 0-255 inputs */
+static inline uint32_t raw_preview_yuv(int R, int G, int B)
+{
+#if defined(CONFIG_REC709)
+    int Y = ((217) * R + (732) * G + (73) * B) / 1024;
+    int U = ((-117) * R + (-394) * G + (512) * B) / 1024;
+    int V = ((512) * R + (-465) * G + (-46) * B) / 1024;
+#else
+    int Y = ((306) * R + (601) * G + (116) * B) / 1024;
+    int U = ((-172) * R + (-337) * G + (509) * B) / 1024;
+    int V = ((509) * R + (-427) * G + (-82) * B) / 1024;
+#endif
+    return UYVY_PACK(U,Y,V,Y);
+}
+
+void FAST raw_preview_color_line(struct raw_preview_lut * lut, const uint16_t * rg, const uint16_t * gb, const int * cols, int n, uint32_t * out, int dup)
+{
+    const uint8_t * lr = lut->r;
+    const uint8_t * lg = lut->g;
+    const uint8_t * lb = lut->b;
+    const int offset = lut->offset;
+    const int div = lut->div;
+
+    for (int i = 0; i < n; i++)
+    {
+        /* RGGB cell */
+        const int c = cols[2*i];
+        const int c1 = cols[2*i+1];
+        int r = raw_px(rg, c);
+        int g = (raw_px(rg, c1) + raw_px(gb, c)) >> 1;
+        int b = raw_px(gb, c1);
+
+        uint32_t yuv = raw_preview_yuv(
+            lr[(r + offset) >> div],
+            lg[(g + offset) >> div],
+            lb[(b + offset) >> div]
+        );
+
+        if (dup)
+        {
+            out[2*i] = out[2*i+1] = yuv;
+        }
+        else
+        {
+            out[i] = yuv;
+        }
+    }
+}
+
+void FAST raw_preview_gray_line(struct raw_preview_lut * lut, const uint16_t * gb, const int * cols, int n, uint64_t * out)
+{
+    const uint8_t * lg = lut->g;
+    const int offset = lut->offset;
+    const int div = lut->div;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t Y = lg[(raw_px(gb, cols[i]) + offset) >> div];
+        out[i] = (Y << 8) | (Y << 24) | (Y << 40) | (Y << 56);
+    }
+}
@@ -0,0 +1,58 @@
+/**
+ * Raw to YUV conversion for the LiveView raw preview (raw_preview_fast_ex in raw.c).
+ *
+ * The gamma curves are kept in per-channel lookup tables, rebuilt only when
+ * the black level, white level or white balance change, and the lines are
+ * converted from precomputed column offsets, without bitfield decoding.
+ *
+ * Plain C (only raw.h and imgconv.h), so it also builds on the host (tools/lv_bench).
+ */
+
+#ifndef _raw_preview_h_
+#define _raw_preview_h_
+
+#include <stdint.h>
+#include <string.h>
+#include "raw.h"
+
+struct raw_preview_lut
+{
+    /* what the tables were built for */
+    int black;
+    int white;
+    int ev_r, ev_g, ev_b;       /* white balance: EV added to each channel before the 10-stop gamma curve */
+
+    /* table index for a raw value v: (v + offset) >> div */
+    int div;
+    int offset;
+    int size;
+
+    uint8_t * r;
+    uint8_t * g;
+    uint8_t * b;
+};
+
+/* rebuilds the tables if the levels or the white balance changed; returns 0 if out of memory */
+int raw_preview_lut_update(struct raw_preview_lut * lut, int black, int white, int ev_r, int ev_g, int ev_b);
+
+/* frees the tables */
+void raw_preview_lut_free(struct raw_preview_lut * lut);
+
+/* column descriptor for raw_preview_*_line: where pixel x of a raw line is, in 16-bit words */
+static inline int raw_preview_column(int x)
+{
+    /* 8 pixels in 7 halfwords (see struct raw_pixblock): pixel k < 7 starts in halfword k-1
+     * and ends 2k+2 bits into halfword k; pixel 7 is the low 14 bits of halfword 6 */
+    int k = x % 8;
+    return k < 7 ? ((x / 8 * 7 + k) << 4) | (2 * k + 2)
+                 : ((x / 8 * 7 + 6) << 4);
+}
+
+/* color: one UYVY word from each RGGB cell, rg = red/green line, gb = the green/blue line below;
+ * cols has two descriptors per cell, for x (even) and x+1; if dup, each word is written twice (quarter resolution) */
+void raw_preview_color_line(struct raw_preview_lut * lut, const uint16_t * rg, const uint16_t * gb, const int * cols, int n, uint32_t * out, int dup);
+
+/* grayscale: green from the first pixel of the 8-pixel block at cols[i], on a green/blue line, as 4 identical pixels */
+void raw_preview_gray_line(struct raw_preview_lut * lut, const uint16_t * gb, const int * cols, int n, uint64_t * out);
+
+#endif
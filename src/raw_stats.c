@@ -0,0 +1,189 @@
+/**
+ * Raw statistics: cumulative histograms of 14-bit raw values, cached per frame.
+ */
+
+#ifdef CONFIG_MAGICLANTERN
+#include "dryos.h"
+#else
+#include <stdlib.h>
+#endif
+
+#include "raw_stats.h"
+
+#ifndef FAST
+#define FAST __attribute__((optimize("-O3")))
+#endif
+
+static struct raw_stats * cache[RAW_STATS_CACHE_SIZE];
+static uint32_t use_counter = 0;
+
+void FAST raw_stats_add_green_full(struct raw_info * raw_info, uint32_t * hist)
+{
+    /* time: 1-2 seconds on full raw 5D3 */
+    for (struct raw_pixblock * row = (struct raw_pixblock *) raw_info->buffer + raw_info->active_area.y1 * raw_info->width / 8 + (raw_info->active_area.x1 + 7) / 8; (void*)row < (void*)raw_info->buffer + raw_info->pitch * raw_info->active_area.y2; row += 2 * raw_info->width / 8)
+    {
+        struct raw_pixblock * row2 = row + raw_info->pitch / sizeof(struct raw_pixblock);
+
+        struct raw_pixblock * p;
+        struct raw_pixblock * q;
+        for (p = row, q = row2; (void*)p < (void*)row + raw_info->jpeg.width * 14/8; p++, q++)
+        {
+            /**
+             *  p: abcdefgh abcdefgh
+             *  q: abcdefgh abcdefgh
+             *
+             *     rgrgrgrg rgrgrgrg
+             *     gbgbgbgb gbgbgbgb
+             */
+            hist[p->b_lo | (p->b_hi << 12)]++;
+            hist[p->d_lo | (p->d_hi << 8)]++;
+            hist[p->f_lo | (p->f_hi << 4)]++;
+            hist[p->h]++;
+            hist[q->a]++;
+            hist[q->c_lo | (q->c_hi << 10)]++;
+            hist[q->e_lo | (q->e_hi << 6)]++;
+            hist[q->g_lo | (q->g_hi << 2)]++;
+        }
+    }
+}
+
+void raw_stats_finish(struct raw_stats * stats)
+{
+    uint32_t total = 0;
+
+    for (int i = 0; i < RAW_STATS_LEVELS; i++)
+    {
+        total += stats->cum[i];
+        stats->cum[i] = total;
+    }
+
+    stats->total = total;
+}
+
+int raw_stats_percentile(struct raw_stats * stats, int percentile_x10)
+{
+    int thr = (uint64_t)stats->total * percentile_x10 / 1000 - 2;  // 50% => median; allow up to 2 stuck pixels
+
+    if (thr > (int)stats->total)
+    {
+        return -1;
+    }
+
+    /* first level with cum >= thr */
+    int lo = 0;
+    int hi = RAW_STATS_LEVELS - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if ((int)stats->cum[mid] >= thr)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+uint32_t raw_stats_count_above(struct raw_stats * stats, int level)
+{
+    if (level <= 0)
+    {
+        return stats->total;
+    }
+
+    if (level >= RAW_STATS_LEVELS)
+    {
+        return 0;
+    }
+
+    return stats->total - stats->cum[level - 1];
+}
+
+static int same_image(struct raw_stats_key * a, struct raw_stats_key * b)
+{
+    return a->frame_id == b->frame_id &&
+           a->buffer == b->buffer &&
+           a->gray_projection == b->gray_projection;
+}
+
+struct raw_stats * raw_stats_lookup(struct raw_stats_key * key)
+{
+    if (!key->frame_id)
+    {
+        return 0;
+    }
+
+    struct raw_stats * best = 0;
+
+    for (int i = 0; i < RAW_STATS_CACHE_SIZE; i++)
+    {
+        struct raw_stats * stats = cache[i];
+        if (!stats || !same_image(&stats->key, key))
+        {
+            continue;
+        }
+
+        /* a finer sampling answers coarser requests, too; the exact green one answers all of them */
+        int usable = stats->key.step == 0 ||
+                     (key->step && stats->key.step <= key->step && stats->key.y_off == key->y_off);
+
+        if (usable && (!best || stats->key.step < best->key.step))
+        {
+            best = stats;
+        }
+    }
+
+    if (best)
+    {
+        best->last_used = ++use_counter;
+    }
+
+    return best;
+}
+
+struct raw_stats * raw_stats_alloc(struct raw_stats_key * key)
+{
+    int slot = 0;
+
+    for (int i = 0; i < RAW_STATS_CACHE_SIZE; i++)
+    {
+        if (!cache[i])
+        {
+            slot = i;
+            break;
+        }
+
+        if (cache[i]->last_used < cache[slot]->last_used)
+        {
+            slot = i;
+        }
+    }
+
+    if (!cache[slot])
+    {
+        cache[slot] = malloc(sizeof(struct raw_stats));
+        if (!cache[slot])
+        {
+            return 0;
+        }
+    }
+
+    struct raw_stats * stats = cache[slot];
+    memset(stats, 0, sizeof(struct raw_stats));
+    stats->key = *key;
+    stats->last_used = ++use_counter;
+    return stats;
+}
+
+void raw_stats_flush()
+{
+    for (int i = 0; i < RAW_STATS_CACHE_SIZE; i++)
+    {
+        free(cache[i]);
+        cache[i] = 0;
+    }
+}
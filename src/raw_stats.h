@@ -0,0 +1,60 @@
+/**
+ * Raw statistics: cumulative histograms of 14-bit raw values, cached per frame.
+ *
+ * One pass over the raw buffer fills a histogram, which is turned into a
+ * cumulative one; any number of percentiles and overexposure percentages
+ * are then answered from it without touching the image again.
+ *
+ * Plain C (only raw.h), so it also builds on the host (tools/lv_bench).
+ */
+
+#ifndef _raw_stats_h_
+#define _raw_stats_h_
+
+#include <stdint.h>
+#include <string.h>
+#include "raw.h"
+
+#define RAW_STATS_LEVELS        16384
+#define RAW_STATS_CACHE_SIZE    3
+
+/* what was sampled, from which image */
+struct raw_stats_key
+{
+    uint32_t frame_id;          /* raw_get_frame_id(); 0 = unknown, never reused */
+    void * buffer;
+    int gray_projection;
+    int step;                   /* 0 = every green pixel (exact), otherwise bitmap pixels skipped */
+    int y_off;                  /* rows skipped at top and bottom (letterbox) */
+};
+
+struct raw_stats
+{
+    struct raw_stats_key key;
+    uint32_t last_used;
+    uint32_t total;                     /* number of samples */
+    uint32_t cum[RAW_STATS_LEVELS];     /* samples at or below each raw level */
+};
+
+/* exact green histogram: every green pixel from the active area, added to hist[RAW_STATS_LEVELS] */
+void raw_stats_add_green_full(struct raw_info * raw_info, uint32_t * hist);
+
+/* turns the histogram in stats->cum into a cumulative one */
+void raw_stats_finish(struct raw_stats * stats);
+
+/* raw level at percentile_x10 (500 = median); 2 stuck pixels are tolerated */
+int raw_stats_percentile(struct raw_stats * stats, int percentile_x10);
+
+/* number of samples at 'level' or above */
+uint32_t raw_stats_count_above(struct raw_stats * stats, int level);
+
+/* cached statistics for this key, or for the same image sampled with a smaller step; NULL if none */
+struct raw_stats * raw_stats_lookup(struct raw_stats_key * key);
+
+/* cache entry for new statistics (the least recently used one), with a zeroed histogram; NULL if out of memory */
+struct raw_stats * raw_stats_alloc(struct raw_stats_key * key);
+
+/* frees the cache */
+void raw_stats_flush();
+
+#endif
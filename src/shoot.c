@@ -353,6 +353,11 @@ static void do_this_every_second() // called every second
     
     reset_pre_shutdown_flag_step();
     
+    #ifdef FEATURE_RAW_HISTOGRAM
+    raw_hist_free_if_idle();
+    #endif
+    raw_plane_free_if_idle();
+
     #ifdef FEATURE_SHOW_CPU_USAGE
     task_update_loads();
     #endif
@@ -45,6 +45,15 @@ static void stateobj_install_hook(struct state_object * stateobj, int input, int
 */
 
 static volatile int vsync_counter = 0;
+
+/* never reset, unlike vsync_counter */
+static volatile uint32_t lv_frame_counter = 0;
+
+uint32_t get_lv_frame_counter()
+{
+    return lv_frame_counter;
+}
+
 #ifndef CONFIG_7D_MASTER
 /* waits for N LiveView frames */
 int wait_lv_frames(int num_frames)
@@ -78,6 +87,7 @@ extern void digic_iso_step();
 static void FAST vsync_func() // called once per frame.. in theory :)
 {
     vsync_counter++;
+    lv_frame_counter++;
 
     #if defined(CONFIG_MODULES)
     module_exec_cbr(CBR_VSYNC);
@@ -73,4 +73,7 @@ SIZE_CHECK_STRUCT( state_object, 0x20 );
 /* waits for N LiveView frames (using state object vsync) */
 int wait_lv_frames(int num_frames);
 
+/* LiveView frames since startup (0 until the first vsync) */
+uint32_t get_lv_frame_counter();
+
 #endif
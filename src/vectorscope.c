@@ -156,6 +156,13 @@ void vectorscope_addpixel(uint8_t y, int8_t u, int8_t v)
     }
 }
 
+/* the counters, filled by the single pass LiveView analysis in zebra.c (lv_analysis.c) */
+uint8_t * vectorscope_get_buffer(int * gain)
+{
+    *gain = vectorscope_gain;
+    return vectorscope;
+}
+
 /* memcpy the second part of vectorscope buffer. uses only few resources */
 static void
 vectorscope_draw_image(uint32_t x_origin, uint32_t y_origin)
@@ -4,5 +4,6 @@ int vectorscope_should_draw();
 void vectorscope_request_draw(int flag);
 void vectorscope_start();
 void vectorscope_addpixel(int Y, int U, int V);
+uint8_t * vectorscope_get_buffer(int * gain);
 void vectorscope_redraw();
 #endif
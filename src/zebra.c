@@ -44,6 +44,9 @@
 #include "imgconv.h"
 #include "falsecolor.h"
 #include "histogram.h"
+#include "lv_analysis.h"
+#include "peaking.h"
+#include "raw_plane.h"
 
 /* todo: move battery stuff in battery.c */
 #include "battery.h"
@@ -481,52 +484,18 @@ static uint8_t* waveform = 0;
  *
  * Average two adjacent pixels to try to reduce noise slightly.
  *
- * Update the hist_max for the largest number of bin entries found
- * to scale the histogram to fit the display box from top to
- * bottom.
+ * Histogram, waveform and vectorscope are filled in a single pass
+ * by lv_analysis_run(); here we only compute the sampled positions.
  */
 
 #if defined(FEATURE_HISTOGRAM) || defined(FEATURE_WAVEFORM) || defined(FEATURE_VECTORSCOPE)
-#ifdef FEATURE_HISTOGRAM
-static void hist_add_pixel(uint32_t pixel, int Y)
-{
-    if (histogram.is_rgb)
-    {
-        int R, G, B;
-        //~ uyvy2yrgb(pixel, &Y, &R, &G, &B);
-        COMPUTE_UYVY2YRGB(pixel, Y, R, G, B);
-        // YRGB range: 0-255
-        uint32_t R_level = (R * HIST_WIDTH) >> 8;
-        uint32_t G_level = (G * HIST_WIDTH) >> 8;
-        uint32_t B_level = (B * HIST_WIDTH) >> 8;
-        
-        histogram.hist_r[R_level & (HIST_WIDTH-1)]++;
-        histogram.hist_g[G_level & (HIST_WIDTH-1)]++;
-        histogram.hist_b[B_level & (HIST_WIDTH-1)]++;
-    }
-    
-    /* luma component is always computed, since we need histogram.max */
-    /* and it's much less expensive than RGB anyway */
-    histogram.total_px++;
-    uint32_t hist_level = (Y * HIST_WIDTH) >> 8;
-
-    // Ignore the 0 bin.  It generates too much noise
-    unsigned count = ++ (histogram.hist[ hist_level & (HIST_WIDTH-1)]);
-    if( hist_level && count > histogram.max )
-        histogram.max = count;
-}
-#endif
-
-#ifdef FEATURE_WAVEFORM
-static inline void waveform_add_pixel(int x, int Y)
-{
-    if (!waveform) return;
-    uint8_t* w = &WAVEFORM(((x-os.x0) * WAVEFORM_WIDTH) / os.x_ex, (Y * WAVEFORM_HEIGHT) >> 8);
-    if ((*w) < 250) (*w)++;
-}
-#endif
-
 #if defined(FEATURE_HISTOGRAM)
+/* BM2LV offsets of the sampled rows and pixel pairs */
+static uint32_t hist_row_offsets[(BMP_H_PLUS - BMP_H_MINUS) / 2 + 1];
+static uint32_t hist_col_offsets[(BMP_W_PLUS - BMP_W_MINUS) / 2 + 1];
+static uint16_t hist_col_waveform[(BMP_W_PLUS - BMP_W_MINUS) / 2 + 1];
+static struct lv_analysis lv_analysis;
+
 static void
 hist_build()
 {
@@ -574,41 +543,70 @@ hist_build()
         return;
     }
     
-    int mz = nondigic_zoom_overlay_enabled();
+    struct lv_analysis * a = &lv_analysis;
     int off = get_y_skip_offset_for_histogram();
+
+    /* BM2LV(x,y) is the row offset plus the column offset */
+    a->rows = 0;
     for( y = os.y0 + off; y < os.y_max - off; y += 2 )
     {
-        for( x = os.x0 ; x < os.x_max ; x += 2 )
-        {
-            uint32_t pixel = buf[BM2LV(x,y) >> 2];
+        hist_row_offsets[a->rows++] = BM2LV_R(y);
+    }
 
-            // ignore magic zoom borders
-            if (mz && (pixel == MZ_WHITE || pixel == MZ_BLACK || pixel == MZ_GREEN))
-                continue;
+    a->cols = 0;
+    for( x = os.x0 ; x < os.x_max ; x += 2 )
+    {
+        hist_col_offsets[a->cols] = BM2LV_X(x) << 1;
+        hist_col_waveform[a->cols] = COERCE(((x-os.x0) * WAVEFORM_WIDTH) / os.x_ex, 0, WAVEFORM_WIDTH-1);
+        a->cols++;
+    }
 
-            int Y = UYVY_GET_AVG_Y(pixel);
-            
-            if (hist_draw && !histogram.is_raw)
-            {
-                hist_add_pixel(pixel, Y);
-            }
-            
-            #ifdef FEATURE_WAVEFORM
-            if (waveform_draw) 
-            {
-                waveform_add_pixel(x, Y);
-            }
-            #endif
-            
-            #ifdef FEATURE_VECTORSCOPE
-            if (vectorscope_draw)
-            {
-                int8_t U = (pixel >>  0) & 0xFF;
-                int8_t V = (pixel >> 16) & 0xFF;
-                vectorscope_addpixel(Y, U, V);
-            }
-            #endif
-        }
+    a->buf = buf;
+    a->row_offsets = hist_row_offsets;
+    a->col_offsets = hist_col_offsets;
+    a->skip_mz = nondigic_zoom_overlay_enabled();
+
+    a->hist = (hist_draw && !histogram.is_raw) ? histogram.hist : NULL;
+    a->hist_r = histogram.is_rgb ? histogram.hist_r : NULL;
+    a->hist_g = histogram.is_rgb ? histogram.hist_g : NULL;
+    a->hist_b = histogram.is_rgb ? histogram.hist_b : NULL;
+    a->yuv2rgb_rv = yuv2rgb_RV;
+    a->yuv2rgb_gu = yuv2rgb_GU;
+    a->yuv2rgb_gv = yuv2rgb_GV;
+    a->yuv2rgb_bu = yuv2rgb_BU;
+    #ifdef CONFIG_DIGIC_678X
+    a->uv_xor = 0x80;
+    #else
+    a->uv_xor = 0;
+    #endif
+
+    a->waveform = NULL;
+    #ifdef FEATURE_WAVEFORM
+    if (waveform_draw)
+    {
+        a->waveform = waveform;
+        a->col_waveform = hist_col_waveform;
+        a->waveform_width = WAVEFORM_WIDTH;
+        a->waveform_height = WAVEFORM_HEIGHT;
+    }
+    #endif
+
+    a->vectorscope = NULL;
+    #ifdef FEATURE_VECTORSCOPE
+    if (vectorscope_draw)
+    {
+        a->vectorscope = vectorscope_get_buffer(&a->vectorscope_gain);
+        a->vectorscope_red = 255 - COLOR_RED;
+    }
+    #endif
+
+    a->total_px = 0;
+    lv_analysis_run(a);
+
+    if (a->hist)
+    {
+        histogram.max = a->hist_max;
+        histogram.total_px = a->total_px;
     }
 }
 #endif // FEATURE_HISTOGRAM
@@ -633,6 +631,10 @@ static void FAST draw_zebras_raw()
     
     int zoom0 = (int32_t)MEM(IMGPLAY_ZOOM_LEVEL_ADDR); /* stop when zooming in playback */
 
+    /* raw samples decoded once, instead of unpacking them for every bitmap pixel */
+    struct raw_plane * plane = raw_plane_get();
+    if (!plane) return;
+
     for (int i = os.y0; i < os.y_max; i ++)
     {
         int y = BM2RAW_Y(i);
@@ -640,15 +642,16 @@ static void FAST draw_zebras_raw()
         for (int j = os.x0; j < os.x_max; j ++)
         {
             int x = BM2RAW_X(j);
+            int k = raw_plane_index(plane, x, y);
 
             /* for dual ISO: show solid zebras if both sub-images are overexposed */
             /* show semitransparent zebras if only one is overexposed */
             /* impact on normal ISOs should be minimal */
             int dark = (i + j) % 4;
-            int r = dark ? raw_red_pixel_dark(x, y) : raw_red_pixel_bright(x, y);
-            int g = dark ? raw_green_pixel_dark(x, y) : raw_green_pixel_bright(x, y);
-            int b = dark ? raw_blue_pixel_dark(x, y) : raw_blue_pixel_bright(x, y);
-            int u = raw_green_pixel_bright(x, y);
+            int r = plane->ch[dark ? RAW_PLANE_RED_DARK   : RAW_PLANE_RED_BRIGHT][k];
+            int g = plane->ch[dark ? RAW_PLANE_GREEN_DARK : RAW_PLANE_GREEN_BRIGHT][k];
+            int b = plane->ch[dark ? RAW_PLANE_BLUE_DARK  : RAW_PLANE_BLUE_BRIGHT][k];
+            int u = plane->ch[RAW_PLANE_GREEN_BRIGHT][k];
 
             /* define this to check if color channels are identified correctly */
             #undef RAW_ZEBRA_TEST
@@ -690,6 +693,8 @@ static void FAST draw_zebras_raw()
         if ((int)(int32_t)MEM(IMGPLAY_ZOOM_LEVEL_ADDR) != zoom0) break; /* stop when zooming */
 
     }
+
+    raw_plane_put();
 }
 
 void FAST zebra_highlight_raw_advanced(struct raw_highlight_info * raw_highlight_info)
@@ -812,6 +817,13 @@ static void FAST draw_zebras_raw_lv()
     if (white > 16383) white = 15000;
     int underexposed = zebra_raw_underexposure ? ev_to_raw(- (raw_info.dynamic_range - (zebra_raw_underexposure - 1) * 100) / 100.0) : 0;
 
+    struct raw_plane * plane = raw_plane_get();
+    if (!plane) return;
+    const uint16_t * red_dark   = plane->ch[RAW_PLANE_RED_DARK];
+    const uint16_t * green_dark = plane->ch[RAW_PLANE_GREEN_DARK];
+    const uint16_t * blue_dark  = plane->ch[RAW_PLANE_BLUE_DARK];
+    const uint16_t * green_bright = plane->ch[RAW_PLANE_GREEN_BRIGHT];
+
     int off = get_y_skip_offset_for_overlays();
     for(int i = os.y0 + off; i < os.y_max - off; i += 2 )
     {
@@ -840,10 +852,11 @@ static void FAST draw_zebras_raw_lv()
             if (x < raw_info.active_area.x1 || x > raw_info.active_area.x2) continue;
             
             /* for dual ISO: use dark lines for overexposure and bright lines for underexposure */
-            int r = raw_red_pixel_dark(x, y);
-            int g = raw_green_pixel_dark(x, y);
-            int b = raw_blue_pixel_dark(x, y);
-            int u = raw_green_pixel_bright(x, y);
+            int k = raw_plane_index(plane, x, y);
+            int r = red_dark[k];
+            int g = green_dark[k];
+            int b = blue_dark[k];
+            int u = green_bright[k];
 
             uint64_t c = zebra_rgb_solid_color(u <= underexposed, r > white, g > white, b > white);
             c = c | (c << 32);
@@ -854,6 +867,8 @@ static void FAST draw_zebras_raw_lv()
             #undef MP
         }
     }
+
+    raw_plane_put();
 }
 
 static MENU_UPDATE_FUNC(raw_zebra_update)
@@ -1470,6 +1485,22 @@ static inline int FAST peak_d2xy(const uint8_t* p8)
     return calc_peak(p8, vram_lv.pitch);
 }
 
+/* edge energy of the current frame, one byte per YUV word or bitmap sample */
+static uint8_t * peak_edges = 0;
+static int peak_edges_size = 0;
+static uint32_t peak_hist[256];
+
+static uint8_t * peak_get_edge_buffer(int size)
+{
+    if (size > peak_edges_size)
+    {
+        free(peak_edges);
+        peak_edges = malloc(size);
+        peak_edges_size = peak_edges ? size : 0;
+    }
+    return peak_edges;
+}
+
 #ifdef FEATURE_FOCUS_PEAK_DISP_FILTER
 
 //~ static inline int peak_blend_solid(uint32_t* s, int e, int thr) { return 0x4C7F4CD5; }
@@ -1501,6 +1532,9 @@ static inline int peak_blend_alpha(uint32_t* s, int e)
 
 static int peak_scaling[256];
 
+/* the threshold comes from the edge histogram of every 3rd row (an odd step, so both fields of interlaced sources count) */
+#define PEAK_HIST_ROW_STEP 3
+
 void FAST peak_disp_filter()
 {
     uint32_t* src_buf;
@@ -1525,126 +1559,129 @@ void FAST peak_disp_filter()
     else return;
 
     static int thr = 50;
-    static int thr_increment = 1;
-    static int thr_delta = 0;
     
     #define FOCUSED_THR 64
+
+    int start = 720 * (os.y0/2);
+    int cols = vram_lv.pitch / 4;
+    int rows = (720 * (os.y_max/2) - start) / cols;
+
+    /* LiveView: first pixel of each word, as always, and only every other row while recording;
+     * playback: both pixels of each word (slower, more accurate) */
+    const int half = lv && RECORDING;
+    const int both = !lv;
+
+    /* edges of the histogram rows, then one more row for the others */
+    uint8_t * hist_edges = 0;
+    uint8_t * row_buf = 0;
+    if (focus_peaking_disp != 3)
+    {
+        int hist_rows = PEAKING_HIST_ROWS(rows, PEAK_HIST_ROW_STEP);
+        hist_edges = peak_get_edge_buffer((hist_rows + 1) * cols);
+        if (!hist_edges) return;
+        row_buf = hist_edges + hist_rows * cols;
+
+        memset(peak_hist, 0, sizeof(peak_hist));
+        peaking_hist(&src_buf[start], vram_lv.pitch, rows, cols, focus_peaking_filter_edges, both, PEAK_HIST_ROW_STEP, hist_edges, peak_hist);
+        thr = peaking_threshold(peak_hist, focus_peaking_pthr, 10);
+    }
+
     // the percentage selected in menu represents how many pixels are considered in focus
     // let's say above some FOCUSED_THR
     // so, let's scale edge value so that e=thr maps to e=FOCUSED_THR
-    for (int i = 0, i_fthr = 0; i < 255; i++, i_fthr += FOCUSED_THR)
+    for (int i = 0, i_fthr = 0; i < 256; i++, i_fthr += FOCUSED_THR)
         peak_scaling[i] = MIN(i_fthr / thr, 255);
     
-    int n_over = 0;
-    int n_total = 720 * (os.y_max - os.y0) / 2;
+    #define PEAK_LOOP for (int i = row_start, max = row_start + cols; i < max; i++)
 
-    #define PEAK_LOOP for (int i = 720 * (os.y0/2), max = 720 * (os.y_max/2); i < max; i++)
-    // generic loop:
-    //~ for (int i = 720 * (os.y0/2); i < 720 * (os.y_max/2); i++)
-    //~ {
-        //~ int e = peak_compute((uint8_t*)&src_buf[i] + 1);
-        //~ dst_buf[i] = peak_blend(&src_buf[i], e, blend_thr);
-        //~ if (unlikely(e > FOCUSED_THR)) n_over++;
-    //~ }
-    
-    if (focus_peaking_disp == 4) // raw
+    const uint8_t * row_edges = row_buf;
+    for (int y = 0; y < rows; y++)
     {
-        PEAK_LOOP
-        {
-            int e = peak_d2xy((uint8_t*)&src_buf[i] + 1);
-            e = MIN(e * 4, 255);
-            dst_buf[i] = (e << 8) | (e << 24);
-        }
-    }
-    
-    else if (focus_peaking_grayscale)
-    {
-        if (focus_peaking_disp == 1) 
+        const int row_start = start + y * cols;
+        const uint8_t * edges = 0;
+
+        if (focus_peaking_disp != 3)
         {
-            PEAK_LOOP
+            /* rows from the histogram pass are not computed again; with half, odd rows reuse the one above */
+            if (y % PEAK_HIST_ROW_STEP == PEAK_HIST_ROW_STEP / 2)
             {
-                int e = peak_d2xy((uint8_t*)&src_buf[i] + 1);
-                e = peak_scaling[MIN(e, 255)];
-                if (likely(e < FOCUSED_THR)) dst_buf[i] = src_buf[i] & 0xFF00FF00;
-                else 
-                { 
-                    dst_buf[i] = 0x4C7F4CD5; // red
-                    n_over++;
-                }
+                row_edges = hist_edges + y / PEAK_HIST_ROW_STEP * cols;
             }
-        }
-        else if (focus_peaking_disp == 2) // alpha
-        {
-            PEAK_LOOP
+            else if (!half || !(y & 1))
             {
-                int e = peak_d2xy((uint8_t*)&src_buf[i] + 1);
-                e = peak_scaling[MIN(e, 255)];
-                if (likely(e < 20)) dst_buf[i] = src_buf[i] & 0xFF00FF00;
-                else dst_buf[i] = peak_blend_alpha(&src_buf[i], e);
-                if (unlikely(e > FOCUSED_THR)) n_over++;
+                peaking_edges(&src_buf[row_start], vram_lv.pitch, cols, focus_peaking_filter_edges, both, row_buf);
+                row_edges = row_buf;
             }
+            edges = row_edges - row_start;
         }
-        else if (focus_peaking_disp == 3) // sharp
+
+        if (focus_peaking_disp == 4) // raw
         {
             PEAK_LOOP
             {
-                int e = peak_d2xy_sharpen((uint8_t*)&src_buf[i] + 1);
-                dst_buf[i] = (src_buf[i] & 0xFF000000) | ((e & 0xFF) << 8);
+                int e = MIN(edges[i] * 4, 255);
+                dst_buf[i] = (e << 8) | (e << 24);
             }
         }
-    }
-    else // color
-    {
-        if (focus_peaking_disp == 1) 
+    
+        else if (focus_peaking_grayscale)
         {
-            PEAK_LOOP
+            if (focus_peaking_disp == 1) 
             {
-                int e = peak_d2xy((uint8_t*)&src_buf[i] + 1);
-                e = peak_scaling[MIN(e, 255)];
-                if (likely(e < FOCUSED_THR)) dst_buf[i] = src_buf[i];
-                else 
-                { 
-                    dst_buf[i] = 0x4C7F4CD5; // red
-                    n_over++;
+                PEAK_LOOP
+                {
+                    if (likely(edges[i] < thr)) dst_buf[i] = src_buf[i] & 0xFF00FF00;
+                    else dst_buf[i] = 0x4C7F4CD5; // red
                 }
             }
-        }
-        else if (focus_peaking_disp == 2) // alpha
-        {
-            PEAK_LOOP
+            else if (focus_peaking_disp == 2) // alpha
             {
-                int e = peak_d2xy((uint8_t*)&src_buf[i] + 1);
-                e = peak_scaling[MIN(e, 255)];
-                if (likely(e < 20)) dst_buf[i] = src_buf[i];
-                else dst_buf[i] = peak_blend_alpha(&src_buf[i], e);
-                if (unlikely(e > FOCUSED_THR)) n_over++;
+                PEAK_LOOP
+                {
+                    int e = peak_scaling[edges[i]];
+                    if (likely(e < 20)) dst_buf[i] = src_buf[i] & 0xFF00FF00;
+                    else dst_buf[i] = peak_blend_alpha(&src_buf[i], e);
+                }
+            }
+            else if (focus_peaking_disp == 3) // sharp
+            {
+                PEAK_LOOP
+                {
+                    int e = peak_d2xy_sharpen((uint8_t*)&src_buf[i] + 1);
+                    dst_buf[i] = (src_buf[i] & 0xFF000000) | ((e & 0xFF) << 8);
+                }
             }
         }
-        else if (focus_peaking_disp == 3) // sharp
+        else // color
         {
-            PEAK_LOOP
+            if (focus_peaking_disp == 1) 
+            {
+                PEAK_LOOP
+                {
+                    if (likely(edges[i] < thr)) dst_buf[i] = src_buf[i];
+                    else dst_buf[i] = 0x4C7F4CD5; // red
+                }
+            }
+            else if (focus_peaking_disp == 2) // alpha
             {
-                int e = peak_d2xy_sharpen((uint8_t*)&src_buf[i] + 1);
-                dst_buf[i] = (src_buf[i] & 0xFFFF00FF) | ((e & 0xFF) << 8);
+                PEAK_LOOP
+                {
+                    int e = peak_scaling[edges[i]];
+                    if (likely(e < 20)) dst_buf[i] = src_buf[i];
+                    else dst_buf[i] = peak_blend_alpha(&src_buf[i], e);
+                }
+            }
+            else if (focus_peaking_disp == 3) // sharp
+            {
+                PEAK_LOOP
+                {
+                    int e = peak_d2xy_sharpen((uint8_t*)&src_buf[i] + 1);
+                    dst_buf[i] = (src_buf[i] & 0xFFFF00FF) | ((e & 0xFF) << 8);
+                }
             }
         }
     }
 
-    // update threshold for next iteration
-    if (1000 * n_over / n_total > (int)focus_peaking_pthr)
-    {
-        if (thr_delta > 0) thr_increment++; else thr_increment = 1;
-        thr += thr_increment;
-    }
-    else
-    {
-        if (thr_delta < 0) thr_increment++; else thr_increment = 1;
-        thr -= thr_increment;
-    }
-
-    thr_increment = COERCE(thr_increment, -10, 10);
-    thr = COERCE(thr, 10, 255);
-    
     if (focus_peaking_disp == 3) thr = 64;
 }
 #endif
@@ -1732,7 +1769,6 @@ draw_zebra_and_focus( int Z, int F )
     }
 
     static int thr = 50;
-    static int thr_increment = 1;
     static int prev_thr = 50;
     static int thr_delta = 0;
 
@@ -1793,74 +1829,53 @@ draw_zebra_and_focus( int Z, int F )
          *  uyvy uyvy uyvy
          */
 
-        int n_total = 0;
-        if (lv) // fast, realtime
+        /* LiveView: fast, realtime; playback: can be slower and more accurate */
+        const int y_step = lv ? 3 : 1;
+        const int x_step = lv ? 2 : 1;
+        const int rows = (yEnd - yStart + y_step - 1) / y_step;
+        const int cols = (xEnd - xStart + x_step - 1) / x_step;
+
+        uint8_t * edges = peak_get_edge_buffer(rows * cols);
+        if (!edges) return 0;
+
+        /* first the edge energy of all samples, with its histogram, so the threshold is exact for this frame */
+        memset(peak_hist, 0, sizeof(peak_hist));
+        uint8_t * e8 = edges;
+        for(int y = yStart; y < yEnd; y += y_step)
         {
-            n_total = ((yEnd - yStart) * (xEnd - xStart)) / 6;
-            for(int y = yStart; y < yEnd; y += 3)
+            uint32_t row = vram + BM2LV_R(y);
+            
+            for (int x = xStart; x < xEnd; x += x_step)
             {
-                uint32_t row = vram + BM2LV_R(y);
-                
-                for (int x = xStart; x < xEnd; x += 2)
-                {
-                    p8 = (uint8_t *)(row + bm_lv_x_cache[x - BMP_W_MINUS]);
-                     
-                    int e = peak_d2xy(p8);
-                    
-                    /* executed for 1% of pixels */
-                    if (unlikely(e >= thr))
-                    {
-                        n_over++;
-                        if (unlikely(dirty_pixels_num >= MAX_DIRTY_PIXELS)) break; // threshold too low, abort
-                        focus_found_pixel(x, y, e, thr, bvram);
-                    }
-                }
+                p8 = (uint8_t *)(row + bm_lv_x_cache[x - BMP_W_MINUS]);
+                int e = MIN(peak_d2xy(p8), 255);
+                *e8++ = e;
+                peak_hist[e]++;
             }
         }
-        else // playback - can be slower and more accurate
+
+        thr = peaking_threshold(peak_hist, focus_peaking_pthr, 15);
+
+        for(int j = 0, y = yStart; j < rows; j++, y += y_step)
         {
-            n_total = ((yEnd - yStart) * (xEnd - xStart));
-            for(int y = yStart; y < yEnd; y ++)
+            e8 = edges + j * cols;
+
+            for (int i = 0, x = xStart; i < cols; i++, x += x_step)
             {
-                uint32_t row = vram + BM2LV_R(y);
-                
-                for (int x = xStart; x < xEnd; x ++)
-                {
-                    p8 = (uint8_t *)(row + bm_lv_x_cache[x - BMP_W_MINUS]);
-                    int e = peak_d2xy(p8);
-                    
-                    /* executed for 1% of pixels */
-                    if (unlikely(e >= thr))
-                    {
-                        n_over++;
+                int e = e8[i];
 
-                        if (unlikely(dirty_pixels_num >= MAX_DIRTY_PIXELS)) // threshold too low, abort
-                            break;
+                /* executed for 1% of pixels */
+                if (unlikely(e >= thr))
+                {
+                    n_over++;
+                    if (unlikely(dirty_pixels_num >= MAX_DIRTY_PIXELS)) break; // threshold too low, abort
 
-                        if (F==1) focus_found_pixel_playback(x, y, e, thr, bvram);
-                    }
+                    if (lv) focus_found_pixel(x, y, e, thr, bvram);
+                    else if (F==1) focus_found_pixel_playback(x, y, e, thr, bvram);
                 }
             }
         }
 
-        //~ bmp_printf(FONT_LARGE, 10, 50, "%d ", thr);
-        
-        if (1000 * n_over / n_total > (int)focus_peaking_pthr)
-        {
-            if (thr_delta > 0) thr_increment++; else thr_increment = 1;
-            thr += thr_increment;
-        }
-        else
-        {
-            if (thr_delta < 0) thr_increment++; else thr_increment = 1;
-            thr -= thr_increment;
-        }
-
-        thr_increment = COERCE(thr_increment, -5, 5);
-        int thr_min = 15;
-        thr = COERCE(thr, thr_min, 255);
-
-
         thr_delta = thr - prev_thr;
         prev_thr = thr;
 
@@ -4085,6 +4100,7 @@ livev_hipriority_task( void* unused )
                 #ifdef CONFIG_RAW_LIVEVIEW
                 if (raw_flag) { raw_lv_release(); raw_flag = 0; }
                 #endif
+                raw_plane_flush();
                 while (!zebra_should_run()) 
                 {
                     msleep(100);
@@ -4138,6 +4154,9 @@ livev_hipriority_task( void* unused )
             /* if we no longer need raw overlays, keep LiveView in normal mode (it does less stuff) */
             raw_lv_release();
             raw_flag = 0;
+
+            /* and free the samples they used */
+            raw_plane_flush();
         }
         #endif
 
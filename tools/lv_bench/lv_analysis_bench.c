@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  host benchmark of src/lv_analysis.c (histogram, waveform and vectorscope in one pass).
+
+  runs the old per pixel code from zebra.c/vectorscope.c and lv_analysis_run() on the same
+  LiveView image, with the same 720x480 bitmap sampling, checks that all accumulators match
+  for every combination of overlays and prints the time of both for each combination.
+
+  the image is a .422 dump (UYVY, as saved by ML) or a synthetic frame with magic zoom borders.
+
+  lv_analysis_bench [-s WxH] [-n iterations] [-g gain] [file.422]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "lv_analysis.h"
+
+#define BMP_W   720
+#define BMP_H   480
+#define WAVEFORM_WIDTH  180
+#define WAVEFORM_HEIGHT 120
+#define COERCE(x,lo,hi) ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
+
+static int yuv2rgb_RV[256];
+static int yuv2rgb_GU[256];
+static int yuv2rgb_GV[256];
+static int yuv2rgb_BU[256];
+
+static int lv_width = 1056;
+static int lv_height = 704;
+
+/* bitmap to LiveView mapping, like BM2LV in vram.h */
+static int bm2lv_x(int x) { return x * lv_width / BMP_W; }
+static int bm2lv_y(int y) { return y * lv_height / BMP_H; }
+#define BM2LV(x,y) (bm2lv_y(y) * lv_width * 2 + (bm2lv_x(x) << 1))
+
+struct results
+{
+    uint32_t hist[LV_ANALYSIS_HIST_BINS];
+    uint32_t hist_r[LV_ANALYSIS_HIST_BINS];
+    uint32_t hist_g[LV_ANALYSIS_HIST_BINS];
+    uint32_t hist_b[LV_ANALYSIS_HIST_BINS];
+    uint32_t max;
+    uint32_t total_px;
+    uint8_t waveform[WAVEFORM_WIDTH * WAVEFORM_HEIGHT];
+    uint8_t vectorscope[LV_ANALYSIS_SCOPE_SIZE * LV_ANALYSIS_SCOPE_SIZE];
+};
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void precompute_yuv2rgb()
+{
+    /* REC 601, as imgconv.c */
+    for (int u = 0; u < 256; u++)
+    {
+        int8_t U = u;
+        yuv2rgb_GU[u] = (-352 * U) >> 10;
+        yuv2rgb_BU[u] = (1812 * U) >> 10;
+    }
+
+    for (int v = 0; v < 256; v++)
+    {
+        int8_t V = v;
+        yuv2rgb_RV[v] = (1437 * V) >> 10;
+        yuv2rgb_GV[v] = (-731 * V) >> 10;
+    }
+}
+
+/* the code lv_analysis replaces, from zebra.c hist_build() and vectorscope_addpixel() */
+static void reference_scope_addpixel(struct results * r, int gain, int8_t u, int8_t v)
+{
+    int V = -v << gain;
+    int U = u << gain;
+
+    int rr = U*U + V*V;
+    const int r_sqrt = (int)sqrtf(rr);
+    if (rr > 124*124)
+    {
+        for (int R = 124; R < 128; R++)
+        {
+            int c = U * R / r_sqrt;
+            int s = V * R / r_sqrt;
+            r->vectorscope[(c + 128) + (s + 128) * LV_ANALYSIS_SCOPE_SIZE] = 255 - 8;
+        }
+    }
+    else
+    {
+        if (gain)
+        {
+            U += rand()%2;
+            V += rand()%2;
+        }
+
+        uint8_t * c = &r->vectorscope[(U + 128) + (V + 128) * LV_ANALYSIS_SCOPE_SIZE];
+        if (*c < (0x2A << 2))
+        {
+            (*c)++;
+        }
+    }
+}
+
+static void reference_run(const uint32_t * buf, struct results * r, int flags, int gain)
+{
+    int hist_draw = flags & 1, is_rgb = flags & 2, waveform_draw = flags & 4, vectorscope_draw = flags & 8;
+
+    for (int y = 0; y < BMP_H; y += 2)
+    {
+        for (int x = 0; x < BMP_W; x += 2)
+        {
+            uint32_t pixel = buf[BM2LV(x,y) >> 2];
+
+            if (pixel == LV_ANALYSIS_MZ_WHITE || pixel == LV_ANALYSIS_MZ_BLACK || pixel == LV_ANALYSIS_MZ_GREEN)
+                continue;
+
+            int Y = (((pixel >> 24) & 0xFF) + ((pixel >> 8) & 0xFF)) >> 1;
+
+            if (hist_draw)
+            {
+                if (is_rgb)
+                {
+                    int gv = (pixel >> 16) & 0xFF;
+                    int gu = pixel & 0xFF;
+                    int R = COERCE(Y + yuv2rgb_RV[gv], 0, 255);
+                    int G = COERCE(Y + yuv2rgb_GU[gu] + yuv2rgb_GV[gv], 0, 255);
+                    int B = COERCE(Y + yuv2rgb_BU[gu], 0, 255);
+                    r->hist_r[(R * LV_ANALYSIS_HIST_BINS) >> 8]++;
+                    r->hist_g[(G * LV_ANALYSIS_HIST_BINS) >> 8]++;
+                    r->hist_b[(B * LV_ANALYSIS_HIST_BINS) >> 8]++;
+                }
+
+                r->total_px++;
+                uint32_t hist_level = (Y * LV_ANALYSIS_HIST_BINS) >> 8;
+                unsigned count = ++r->hist[hist_level];
+                if (hist_level && count > r->max)
+                    r->max = count;
+            }
+
+            if (waveform_draw)
+            {
+                int wx = COERCE((x * WAVEFORM_WIDTH) / BMP_W, 0, WAVEFORM_WIDTH-1);
+                int wy = COERCE((Y * WAVEFORM_HEIGHT) >> 8, 0, WAVEFORM_HEIGHT-1);
+                uint8_t * w = &r->waveform[wx + wy * WAVEFORM_WIDTH];
+                if (*w < 250) (*w)++;
+            }
+
+            if (vectorscope_draw)
+            {
+                reference_scope_addpixel(r, gain, pixel & 0xFF, (pixel >> 16) & 0xFF);
+            }
+        }
+    }
+}
+
+static uint32_t row_offsets[BMP_H / 2];
+static uint32_t col_offsets[BMP_W / 2];
+static uint16_t col_waveform[BMP_W / 2];
+static struct lv_analysis analysis;
+
+static void fused_run(const uint32_t * buf, struct results * r, int flags, int gain)
+{
+    struct lv_analysis * a = &analysis;
+
+    /* what hist_build() does */
+    a->rows = 0;
+    for (int y = 0; y < BMP_H; y += 2)
+    {
+        row_offsets[a->rows++] = bm2lv_y(y) * lv_width * 2;
+    }
+
+    a->cols = 0;
+    for (int x = 0; x < BMP_W; x += 2)
+    {
+        col_offsets[a->cols] = bm2lv_x(x) << 1;
+        col_waveform[a->cols] = COERCE((x * WAVEFORM_WIDTH) / BMP_W, 0, WAVEFORM_WIDTH-1);
+        a->cols++;
+    }
+
+    a->buf = buf;
+    a->row_offsets = row_offsets;
+    a->col_offsets = col_offsets;
+    a->skip_mz = 1;
+    a->hist = (flags & 1) ? r->hist : NULL;
+    a->hist_r = (flags & 2) ? r->hist_r : NULL;
+    a->hist_g = (flags & 2) ? r->hist_g : NULL;
+    a->hist_b = (flags & 2) ? r->hist_b : NULL;
+    a->yuv2rgb_rv = yuv2rgb_RV;
+    a->yuv2rgb_gu = yuv2rgb_GU;
+    a->yuv2rgb_gv = yuv2rgb_GV;
+    a->yuv2rgb_bu = yuv2rgb_BU;
+    a->uv_xor = 0;
+    a->waveform = (flags & 4) ? r->waveform : NULL;
+    a->col_waveform = col_waveform;
+    a->waveform_width = WAVEFORM_WIDTH;
+    a->waveform_height = WAVEFORM_HEIGHT;
+    a->vectorscope = (flags & 8) ? r->vectorscope : NULL;
+    a->vectorscope_gain = gain;
+    a->vectorscope_red = 255 - 8;
+    a->total_px = 0;
+
+    lv_analysis_run(a);
+
+    if (a->hist)
+    {
+        r->max = a->hist_max;
+        r->total_px = a->total_px;
+    }
+}
+
+static void synth_frame(uint32_t * buf)
+{
+    srand(1);
+
+    for (int y = 0; y < lv_height; y++)
+    {
+        for (int x = 0; x < lv_width / 2; x++)
+        {
+            /* luma ramp with noise, a color wheel and some saturated patches */
+            int Y0 = COERCE(x * 2 * 255 / lv_width + rand() % 17 - 8, 0, 255);
+            int Y1 = COERCE(Y0 + rand() % 5 - 2, 0, 255);
+            int U = (int)(100 * cos(y * 6.283 / lv_height) * x * 2 / lv_width);
+            int V = (int)(100 * sin(y * 6.283 / lv_height) * x * 2 / lv_width);
+
+            if ((x / 16 + y / 32) % 11 == 0)
+            {
+                U = COERCE(U * 3, -128, 127);
+                V = COERCE(V * 3, -128, 127);
+            }
+
+            buf[x + y * lv_width / 2] = (Y1 << 24) | ((V & 0xFF) << 16) | (Y0 << 8) | (U & 0xFF);
+        }
+    }
+
+    /* magic zoom box */
+    for (int y = lv_height / 4; y < lv_height / 2; y++)
+    {
+        for (int x = lv_width / 8; x < lv_width / 4; x++)
+        {
+            buf[x + y * lv_width / 2] = (y == lv_height / 4 || x == lv_width / 8) ? LV_ANALYSIS_MZ_GREEN : ((x ^ y) & 1) ? LV_ANALYSIS_MZ_WHITE : LV_ANALYSIS_MZ_BLACK;
+        }
+    }
+}
+
+static int compare(const struct results * a, const struct results * b, int check_scope)
+{
+    int ok = 1;
+
+    #define CMP(field) if (memcmp(&a->field, &b->field, sizeof(a->field))) { printf("  %s differs\n", #field); ok = 0; }
+    CMP(hist)
+    CMP(hist_r)
+    CMP(hist_g)
+    CMP(hist_b)
+    CMP(max)
+    CMP(total_px)
+    CMP(waveform)
+    if (check_scope)
+    {
+        CMP(vectorscope)
+    }
+    #undef CMP
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = NULL;
+    int iterations = 50;
+    int gain = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &lv_width, &lv_height) != 2)
+            {
+                fprintf(stderr, "invalid size '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+        {
+            gain = atoi(argv[++i]) ? 1 : 0;
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-s WxH] [-n iterations] [-g gain] [file.422]\n", argv[0]);
+            return 1;
+        }
+        else
+        {
+            filename = argv[i];
+        }
+    }
+
+    uint32_t *buf = NULL;
+
+    if (filename)
+    {
+        FILE *f = fopen(filename, "rb");
+        if (!f)
+        {
+            fprintf(stderr, "could not open '%s'\n", filename);
+            return 1;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        if (size != (long)lv_width * lv_height * 2)
+        {
+            /* common LiveView buffer sizes */
+            static const int sizes[][2] = { { 720, 480 }, { 1056, 704 }, { 1024, 680 }, { 1280, 720 }, { 1920, 1080 }, { 960, 540 } };
+            for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                if (size == (long)sizes[s][0] * sizes[s][1] * 2)
+                {
+                    lv_width = sizes[s][0];
+                    lv_height = sizes[s][1];
+                }
+            }
+        }
+        if (size != (long)lv_width * lv_height * 2)
+        {
+            fprintf(stderr, "'%s': unknown image size, use -s WxH\n", filename);
+            fclose(f);
+            return 1;
+        }
+
+        buf = malloc(size);
+        if (!buf || fread(buf, 1, size, f) != (size_t)size)
+        {
+            fprintf(stderr, "could not read '%s'\n", filename);
+            fclose(f);
+            return 1;
+        }
+        fclose(f);
+    }
+    else
+    {
+        buf = malloc(lv_width * lv_height * 2);
+        synth_frame(buf);
+    }
+
+    precompute_yuv2rgb();
+
+    struct results *ref = calloc(1, sizeof(struct results));
+    struct results *fused = calloc(1, sizeof(struct results));
+    int failed = 0;
+
+    /* every combination hist_build() can ask for: hist, hist+rgb, waveform, vectorscope */
+    static const int combos[] = { 1, 3, 4, 5, 7, 8, 9, 11, 12, 13, 15 };
+    for (unsigned c = 0; c < sizeof(combos) / sizeof(combos[0]); c++)
+    {
+        memset(ref, 0, sizeof(*ref));
+        memset(fused, 0, sizeof(*fused));
+        reference_run(buf, ref, combos[c], gain);
+        fused_run(buf, fused, combos[c], gain);
+
+        /* with gain, both dither with different random numbers */
+        int ok = compare(ref, fused, !gain);
+        printf("%s%s%s%s: %s\n", combos[c] & 1 ? "hist " : "", combos[c] & 2 ? "rgb " : "",
+               combos[c] & 4 ? "waveform " : "", combos[c] & 8 ? "vectorscope " : "", ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+
+    printf("%dx%d, %d iterations\n", lv_width, lv_height, iterations);
+    printf("  overlays                        per pixel   one pass\n");
+
+    double ref_total = 0, fused_total = 0;
+    for (unsigned c = 0; c < sizeof(combos) / sizeof(combos[0]); c++)
+    {
+        double t0 = get_time();
+        for (int i = 0; i < iterations; i++)
+        {
+            memset(ref, 0, sizeof(*ref));
+            reference_run(buf, ref, combos[c], gain);
+        }
+        double t1 = get_time();
+        for (int i = 0; i < iterations; i++)
+        {
+            memset(fused, 0, sizeof(*fused));
+            fused_run(buf, fused, combos[c], gain);
+        }
+        double t2 = get_time();
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s%s%s%s", combos[c] & 1 ? "hist " : "", combos[c] & 2 ? "rgb " : "",
+                 combos[c] & 4 ? "waveform " : "", combos[c] & 8 ? "vectorscope " : "");
+        printf("  %-30s %7.3f ms %7.3f ms (%.2fx)\n", name, (t1 - t0) * 1000 / iterations, (t2 - t1) * 1000 / iterations, (t1 - t0) / (t2 - t1));
+        ref_total += t1 - t0;
+        fused_total += t2 - t1;
+    }
+    printf("  all combinations               %7.3f ms %7.3f ms (%.2fx)\n", ref_total * 1000 / iterations, fused_total * 1000 / iterations, ref_total / fused_total);
+
+    free(ref);
+    free(fused);
+    free(buf);
+
+    return failed;
+}
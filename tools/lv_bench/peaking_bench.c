@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  host benchmark of src/peaking.c (focus peaking display filter).
+
+  checks the edge energy of one and both pixels of every word against the Laplacian from zebra.c
+  (calc_peak), then runs the old display filter (one pixel per word, threshold adjusted by
+  a feedback loop) and the new one (threshold from every 3rd row of the same frame; one pixel
+  per word as in LiveView, every other row as while recording, both pixels as in playback)
+  on a 720x480 frame and prints:
+  - how many frames the old threshold needs to settle, and the share of "focused" pixels
+  - the share with the new threshold, which should be the one asked for from the first frame
+  - the overlap of the highlighted pixels (old settled vs new, new half rows vs new)
+  - the time per frame (the fastest of all iterations)
+
+  the frame is a .422 dump (UYVY, as saved by ML; 720x480) or a synthetic one.
+
+  peaking_bench [-p pthr] [-f filter_edges] [-n iterations] [file.422]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "peaking.h"
+
+#define W       720
+#define H       480
+#define PITCH   (W * 2)
+#define WORDS   (W / 2)
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define ABS(a)   ((a) < 0 ? -(a) : (a))
+#define COERCE(x,lo,hi) ((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
+
+/* as in zebra.c */
+#define PEAK_HIST_ROW_STEP 3
+
+static int filter_edges = 0;
+static int pthr = 10;
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* calc_peak from zebra.c */
+static int calc_peak(const uint8_t* p8, const int pitch)
+{
+    const int p8_xmin1 = (int)(*(p8 - 2));
+    const int p8_xplus1 = (int)(*(p8 + 2));
+    const int p8_ymin1 = (int)(*(p8 - pitch));
+    const int p8_yplus1 = (int)(*(p8 + pitch));
+
+    int result = ((int)(*p8) * 4);
+    result -= p8_xplus1 + p8_xmin1 + p8_yplus1 + p8_ymin1;
+
+    int e = ABS(result);
+
+    if (filter_edges)
+    {
+        int d1x = ABS(p8_xplus1 - p8_xmin1);
+        int d1y = ABS(p8_yplus1 - p8_ymin1);
+        int d1 = MAX(d1x, d1y);
+        e = MAX(e - ((d1 << filter_edges) >> 2), 0) * 2;
+    }
+    return e;
+}
+
+/* peak_disp_filter from zebra.c before peaking.c, solid color mode */
+static void old_filter(uint32_t * src_buf, uint32_t * dst_buf, int * thr_out)
+{
+    static int peak_scaling[256];
+    static int thr = 50;
+    static int thr_increment = 1;
+    static int thr_delta = 0;
+
+    #define FOCUSED_THR 64
+    for (int i = 0, i_fthr = 0; i < 255; i++, i_fthr += FOCUSED_THR)
+        peak_scaling[i] = MIN(i_fthr / thr, 255);
+
+    int n_over = 0;
+    int n_total = WORDS * (H - 2);
+
+    for (int i = WORDS, max = WORDS * (H - 1); i < max; i++)
+    {
+        int e = calc_peak((uint8_t*)&src_buf[i] + 1, PITCH);
+        e = peak_scaling[MIN(e, 255)];
+        if (e < FOCUSED_THR) dst_buf[i] = src_buf[i];
+        else
+        {
+            dst_buf[i] = 0x4C7F4CD5;
+            n_over++;
+        }
+    }
+
+    if (1000 * n_over / n_total > pthr)
+    {
+        if (thr_delta > 0) thr_increment++; else thr_increment = 1;
+        thr += thr_increment;
+    }
+    else
+    {
+        if (thr_delta < 0) thr_increment++; else thr_increment = 1;
+        thr -= thr_increment;
+    }
+
+    thr_increment = COERCE(thr_increment, -10, 10);
+    thr = COERCE(thr, 10, 255);
+    *thr_out = thr;
+}
+
+/* what peak_disp_filter does now, solid color mode */
+#define MODE_LV     0   /* first pixel of each word, every row */
+#define MODE_HALF   1   /* same, every other row (while recording) */
+#define MODE_BOTH   2   /* both pixels of each word (playback) */
+
+static uint8_t edges[WORDS * H];
+
+static void new_filter(uint32_t * src_buf, uint32_t * dst_buf, int mode, int * thr_out)
+{
+    const int both = (mode == MODE_BOTH);
+    const int half = (mode == MODE_HALF);
+
+    uint32_t hist[256];
+    memset(hist, 0, sizeof(hist));
+
+    int start = WORDS;
+    int rows = H - 2;
+    peaking_hist(&src_buf[start], PITCH, rows, WORDS, filter_edges, both, PEAK_HIST_ROW_STEP, edges, hist);
+    int thr = peaking_threshold(hist, pthr, 10);
+
+    uint8_t row_buf[WORDS];
+    const uint8_t * row_edges = row_buf;
+    for (int y = 0; y < rows; y++)
+    {
+        int row_start = start + y * WORDS;
+        if (y % PEAK_HIST_ROW_STEP == PEAK_HIST_ROW_STEP / 2)
+        {
+            row_edges = edges + y / PEAK_HIST_ROW_STEP * WORDS;
+        }
+        else if (!half || !(y & 1))
+        {
+            peaking_edges(&src_buf[row_start], PITCH, WORDS, filter_edges, both, row_buf);
+            row_edges = row_buf;
+        }
+
+        for (int i = row_start, max = row_start + WORDS; i < max; i++)
+        {
+            if (row_edges[i - row_start] < thr) dst_buf[i] = src_buf[i];
+            else dst_buf[i] = 0x4C7F4CD5;
+        }
+    }
+
+    *thr_out = thr;
+}
+
+static int count_marked(uint32_t * buf)
+{
+    int n = 0;
+    for (int i = WORDS; i < WORDS * (H - 1); i++)
+    {
+        n += (buf[i] == 0x4C7F4CD5);
+    }
+    return n;
+}
+
+/* marked in both / marked in any */
+static double overlap(uint32_t * a, uint32_t * b)
+{
+    int both = 0, any = 0;
+    for (int i = WORDS; i < WORDS * (H - 1); i++)
+    {
+        int ma = (a[i] == 0x4C7F4CD5);
+        int mb = (b[i] == 0x4C7F4CD5);
+        both += ma && mb;
+        any += ma || mb;
+    }
+    return any ? (double)both / any : 1;
+}
+
+static void synth_frame(uint32_t * buf)
+{
+    srand(1);
+
+    for (int y = 0; y < H; y++)
+    {
+        for (int x = 0; x < WORDS; x++)
+        {
+            double fx = x * 2.0 / W, fy = (double)y / H;
+            int Y0, Y1;
+
+            if (fx > 0.3 && fx < 0.6 && fy > 0.3 && fy < 0.7)
+            {
+                /* in focus: fine texture */
+                Y0 = 128 + (int)(60 * sin(x * 1.7) * cos(y * 1.3)) + rand() % 20;
+                Y1 = 128 + (int)(60 * sin(x * 1.7 + 0.8) * cos(y * 1.3)) + rand() % 20;
+            }
+            else if (fx > 0.75 && fx < 0.8)
+            {
+                /* strong edge */
+                Y0 = Y1 = (y / 40) % 2 ? 230 : 20;
+            }
+            else
+            {
+                /* out of focus: smooth gradient with a bit of noise */
+                Y0 = 60 + (int)(80 * fx + 40 * sin(fy * 3)) + rand() % 6;
+                Y1 = Y0 + rand() % 3;
+            }
+
+            Y0 = COERCE(Y0, 0, 255);
+            Y1 = COERCE(Y1, 0, 255);
+            int U = (int)(30 * fx) & 0xFF;
+            int V = (int)(-20 * fy) & 0xFF;
+            buf[x + y * WORDS] = ((uint32_t)Y1 << 24) | (V << 16) | (Y0 << 8) | U;
+        }
+    }
+}
+
+/* edge energy of the first pixel / both pixels of every word, same as calc_peak?
+ * are the rows from peaking_hist the same, and does the histogram count them? */
+static int check_edges(uint32_t * buf)
+{
+    static uint8_t hist_edges[WORDS * H];
+    uint32_t hist[256];
+    uint32_t ref_hist[256];
+    int ok = 1;
+
+    for (int both = 0; both <= 1; both++)
+    {
+        memset(hist, 0, sizeof(hist));
+        memset(ref_hist, 0, sizeof(ref_hist));
+        peaking_hist(&buf[WORDS], PITCH, H - 2, WORDS, filter_edges, both, PEAK_HIST_ROW_STEP, hist_edges, hist);
+
+        int hist_rows = 0;
+        for (int y = 1; y < H - 1; y++)
+        {
+            peaking_edges(&buf[y * WORDS], PITCH, WORDS, filter_edges, both, edges);
+
+            if ((y - 1) % PEAK_HIST_ROW_STEP == PEAK_HIST_ROW_STEP / 2)
+            {
+                for (int x = 0; x < WORDS; x++)
+                {
+                    ref_hist[edges[x]]++;
+                }
+                ok &= !memcmp(edges, hist_edges + hist_rows * WORDS, WORDS);
+                hist_rows++;
+            }
+
+            for (int x = 0; x < WORDS; x++)
+            {
+                if (y == 1 && x == 0) continue;     /* reads one word before the buffer */
+                if (y == H - 2 && x == WORDS - 1) continue;
+
+                uint8_t * p8 = (uint8_t*)&buf[x + y * WORDS] + 1;
+                int e = MIN(calc_peak(p8, PITCH), 255);
+                if (both)
+                {
+                    e = MAX(e, MIN(calc_peak(p8 + 2, PITCH), 255));
+                }
+
+                if (edges[x] != e)
+                {
+                    ok = 0;
+                }
+            }
+        }
+
+        ok &= (hist_rows == PEAKING_HIST_ROWS(H - 2, PEAK_HIST_ROW_STEP));
+        ok &= !memcmp(hist, ref_hist, sizeof(hist));
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = NULL;
+    int iterations = 50;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            pthr = atoi(argv[++i]);
+            pthr = COERCE(pthr, 1, 50);
+        }
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+        {
+            filter_edges = atoi(argv[++i]);
+            filter_edges = COERCE(filter_edges, 0, 2);
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-p pthr] [-f filter_edges] [-n iterations] [file.422]\n", argv[0]);
+            return 1;
+        }
+        else
+        {
+            filename = argv[i];
+        }
+    }
+
+    uint32_t * src = malloc(PITCH * H);
+    uint32_t * dst_old = malloc(PITCH * H);
+    uint32_t * dst_new = malloc(PITCH * H);
+    uint32_t * dst_half = malloc(PITCH * H);
+    uint32_t * dst_both = malloc(PITCH * H);
+
+    if (filename)
+    {
+        FILE *f = fopen(filename, "rb");
+        if (!f || fread(src, 1, PITCH * H, f) != PITCH * H)
+        {
+            fprintf(stderr, "could not read 720x480 UYVY from '%s'\n", filename);
+            return 1;
+        }
+        fclose(f);
+    }
+    else
+    {
+        synth_frame(src);
+    }
+
+    int failed = 0;
+    int ok = check_edges(src);
+    printf("edge energy, filter %d: %s\n", filter_edges, ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    int total = WORDS * (H - 2);
+    int thr_old = 0, thr_new = 0, thr_half = 0, thr_both = 0;
+    int settled = -1;
+    int history[400];
+
+    for (int k = 0; k < 400; k++)
+    {
+        old_filter(src, dst_old, &thr_old);
+        history[k] = thr_old;
+        if (k < 3)
+        {
+            printf("old, frame %3d: thr %3d, focused %.2f%%\n", k, thr_old, count_marked(dst_old) * 100.0 / total);
+        }
+    }
+
+    /* settled: within 2 of the final threshold from there on */
+    for (int k = 399; k >= 0 && ABS(history[k] - thr_old) <= 2; k--)
+    {
+        settled = k;
+    }
+    printf("old, frame %3d: thr %3d, focused %.2f%% (settled after %d frames)\n", 399, thr_old, count_marked(dst_old) * 100.0 / total, settled);
+
+    new_filter(src, dst_new, MODE_LV, &thr_new);
+    new_filter(src, dst_half, MODE_HALF, &thr_half);
+    new_filter(src, dst_both, MODE_BOTH, &thr_both);
+    printf("new, frame  0: thr %3d, focused %.2f%% (asked for %.1f%%)\n", thr_new, count_marked(dst_new) * 100.0 / total, pthr / 10.0);
+    printf("new half rows: thr %3d, focused %.2f%%\n", thr_half, count_marked(dst_half) * 100.0 / total);
+    printf("new both px  : thr %3d, focused %.2f%%\n", thr_both, count_marked(dst_both) * 100.0 / total);
+    printf("overlap old/new %.2f, new half/full %.2f\n", overlap(dst_old, dst_new), overlap(dst_half, dst_new));
+
+    /* the filters take turns and the fastest run of each one counts, so a busy machine slows down all of them alike */
+    double best_old = 1e9, best_new = 1e9, best_half = 1e9, best_both = 1e9;
+    for (int i = 0; i < iterations; i++)
+    {
+        double t0 = get_time();
+        old_filter(src, dst_old, &thr_old);
+        double t1 = get_time();
+        new_filter(src, dst_new, MODE_LV, &thr_new);
+        double t2 = get_time();
+        new_filter(src, dst_half, MODE_HALF, &thr_half);
+        double t3 = get_time();
+        new_filter(src, dst_both, MODE_BOTH, &thr_both);
+        double t4 = get_time();
+
+        best_old = MIN(best_old, t1 - t0);
+        best_new = MIN(best_new, t2 - t1);
+        best_half = MIN(best_half, t3 - t2);
+        best_both = MIN(best_both, t4 - t3);
+    }
+
+    printf("720x480, best of %d iterations\n", iterations);
+    printf("  old:            %7.3f ms/frame\n", best_old * 1000);
+    printf("  new:            %7.3f ms/frame (%.2fx)\n", best_new * 1000, best_old / best_new);
+    printf("  new, half rows: %7.3f ms/frame (%.2fx)\n", best_half * 1000, best_old / best_half);
+    printf("  new, both px:   %7.3f ms/frame (%.2fx)\n", best_both * 1000, best_old / best_both);
+
+    free(src);
+    free(dst_old);
+    free(dst_new);
+    free(dst_half);
+    free(dst_both);
+    return failed;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  host benchmark of src/raw_stats.c (cached raw histograms for percentiles and overexposure).
+
+  builds a synthetic 14-bit raw frame, then compares the old raw_hist_get_percentile_levels()
+  and raw_hist_get_overexposure_percentage() (exact green pass and sampled pass) with the
+  answers from the cached cumulative histograms, for many percentiles and white levels.
+  also checks which cache entries get reused, and times a typical ETTR-like sequence of calls.
+
+  raw_hist_bench [-s WxH] [-n iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "raw_stats.h"
+
+struct raw_info raw_info;
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* raw_get_pixel from raw.c */
+int raw_get_pixel(int x, int y)
+{
+    struct raw_pixblock * p = (void*)raw_info.buffer + y * raw_info.pitch + (x/8)*14;
+    switch (x%8) {
+        case 0: return p->a;
+        case 1: return p->b_lo | (p->b_hi << 12);
+        case 2: return p->c_lo | (p->c_hi << 10);
+        case 3: return p->d_lo | (p->d_hi << 8);
+        case 4: return p->e_lo | (p->e_hi << 6);
+        case 5: return p->f_lo | (p->f_hi << 4);
+        case 6: return p->g_lo | (p->g_hi << 2);
+        case 7: return p->h;
+    }
+    return p->a;
+}
+
+void raw_set_pixel(int x, int y, int value)
+{
+    struct raw_pixblock * p = (void*)raw_info.buffer + y * raw_info.pitch + (x/8)*14;
+    switch (x%8) {
+        case 0: p->a = value; break;
+        case 1: p->b_lo = value; p->b_hi = value >> 12; break;
+        case 2: p->c_lo = value; p->c_hi = value >> 10; break;
+        case 3: p->d_lo = value; p->d_hi = value >> 8; break;
+        case 4: p->e_lo = value; p->e_hi = value >> 6; break;
+        case 5: p->f_lo = value; p->f_hi = value >> 4; break;
+        case 6: p->g_lo = value; p->g_hi = value >> 2; break;
+        case 7: p->h = value; break;
+    }
+}
+
+/* what the sampled pass reads: 720x480 bitmap coordinates mapped on the active area, green channel */
+#define BMP_W 720
+#define BMP_H 480
+static int bm2raw_x(int x) { return raw_info.active_area.x1 + x * (raw_info.active_area.x2 - raw_info.active_area.x1) / BMP_W; }
+static int bm2raw_y(int y) { return raw_info.active_area.y1 + y * (raw_info.active_area.y2 - raw_info.active_area.y1) / BMP_H; }
+static int gray_pixel(int x, int y) { return raw_get_pixel((x & ~1) + !(y & 1), y); }
+
+/* the old code from histogram.c: a new histogram on every call */
+static void reference_percentiles(int* percentiles_x10, int* output_raw_values, int n, int speed, int off)
+{
+    int* hist = malloc(16384*4);
+    memset(hist, 0, 16384*4);
+
+    if (speed == 0)
+    {
+        for (struct raw_pixblock * row = (struct raw_pixblock *) raw_info.buffer + raw_info.active_area.y1 * raw_info.width / 8 + (raw_info.active_area.x1 + 7) / 8; (void*)row < (void*)raw_info.buffer + raw_info.pitch * raw_info.active_area.y2; row += 2 * raw_info.width / 8)
+        {
+            struct raw_pixblock * row2 = row + raw_info.pitch / sizeof(struct raw_pixblock);
+
+            struct raw_pixblock * p;
+            struct raw_pixblock * q;
+            for (p = row, q = row2; (void*)p < (void*)row + raw_info.jpeg.width * 14/8; p++, q++)
+            {
+                int pb = ((int)(p->b_lo | (p->b_hi << 12)));
+                int pd = ((int)(p->d_lo | (p->d_hi << 8)));
+                int pf = ((int)(p->f_lo | (p->f_hi << 4)));
+                int ph = ((int)(p->h));
+                int qa = ((int)(q->a));
+                int qc = ((int)(q->c_lo | (q->c_hi << 10)));
+                int qe = ((int)(q->e_lo | (q->e_hi << 6)));
+                int qg = ((int)(q->g_lo | (q->g_hi << 2)));
+
+                hist[pb]++;
+                hist[pd]++;
+                hist[pf]++;
+                hist[ph]++;
+                hist[qa]++;
+                hist[qc]++;
+                hist[qe]++;
+                hist[qg]++;
+            }
+        }
+    }
+    else
+    {
+        for (int i = off; i < BMP_H - off; i += speed)
+        {
+            int y = bm2raw_y(i);
+            for (int j = 0; j < BMP_W; j += speed)
+            {
+                int x = bm2raw_x(j);
+                int px = gray_pixel(x, y);
+                hist[px & 16383]++;
+            }
+        }
+    }
+
+    int total = 0;
+    int i;
+    for( i=0 ; i < 16384 ; i++ )
+        total += hist[i];
+
+    for (int k = 0; k < n; k++)
+    {
+        int thr = (uint64_t)total * percentiles_x10[k] / 1000 - 2;
+        int n = 0;
+        int ans = -1;
+
+        for( i=0 ; i < 16384; i++ )
+        {
+            n += hist[i];
+            if (n >= thr)
+            {
+                ans = i;
+                break;
+            }
+        }
+
+        output_raw_values[k] = ans;
+    }
+
+    free(hist);
+}
+
+static int reference_overexposure(int white_level, int step)
+{
+    int white = white_level * 80 / 100;
+    int over = 0;
+    int total = 0;
+
+    for (int i = 0; i < BMP_H; i += step)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j += step)
+        {
+            int x = bm2raw_x(j);
+            int px = gray_pixel(x, y);
+            if (px >= white) over++;
+            total++;
+        }
+    }
+
+    return over * 10000 / total;
+}
+
+/* the new code: raw_stats_get() from histogram.c */
+static uint32_t frame_id = 1;
+
+static struct raw_stats * stats_get(int step, int y_off)
+{
+    struct raw_stats_key key = {
+        .frame_id           = frame_id,
+        .buffer             = raw_info.buffer,
+        .gray_projection    = 1,
+        .step               = step,
+        .y_off              = y_off,
+    };
+
+    struct raw_stats * stats = raw_stats_lookup(&key);
+    if (stats)
+    {
+        return stats;
+    }
+
+    stats = raw_stats_alloc(&key);
+    uint32_t * hist = stats->cum;
+
+    if (step == 0)
+    {
+        raw_stats_add_green_full(&raw_info, hist);
+    }
+    else
+    {
+        for (int i = y_off; i < BMP_H - y_off; i += step)
+        {
+            int y = bm2raw_y(i);
+            for (int j = 0; j < BMP_W; j += step)
+            {
+                int x = bm2raw_x(j);
+                hist[gray_pixel(x, y) & 16383]++;
+            }
+        }
+    }
+
+    raw_stats_finish(stats);
+    return stats;
+}
+
+static void synth_frame(int width, int height)
+{
+    raw_info.width = width;
+    raw_info.height = height;
+    raw_info.pitch = width * 14 / 8;
+    raw_info.frame_size = raw_info.pitch * height;
+    raw_info.bits_per_pixel = 14;
+    raw_info.black_level = 2048;
+    raw_info.white_level = 15000;
+    raw_info.active_area.x1 = 146;
+    raw_info.active_area.y1 = 72;
+    raw_info.active_area.x2 = width;
+    raw_info.active_area.y2 = height;
+    raw_info.jpeg.x = 0;
+    raw_info.jpeg.y = 0;
+    raw_info.jpeg.width = width - 146;
+    raw_info.jpeg.height = height - 72;
+    raw_info.buffer = malloc(raw_info.frame_size + 16);
+
+    srand(1);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            /* dark optical black, a gradient with noise, clipped highlights on the right */
+            int v = 2048 + rand() % 16;
+            if (x >= raw_info.active_area.x1 && y >= raw_info.active_area.y1)
+            {
+                v += (x * 11000 / width) * (1 + (y & 1)) / 2 + rand() % 64;
+                if (x > width * 9 / 10 && y < height / 3)
+                {
+                    v = 15000 + rand() % 100;
+                }
+            }
+            raw_set_pixel(x, y, v > 16383 ? 16383 : v);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 1808, height = 1190;
+    int iterations = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width % 8 || height % 2)
+            {
+                fprintf(stderr, "invalid size '%s' (width must be a multiple of 8, height even)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s WxH] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    synth_frame(width, height);
+
+    static int percentiles[] = { 0, 1, 5, 10, 50, 100, 250, 500, 750, 900, 950, 990, 999, 1000 };
+    int n = sizeof(percentiles) / sizeof(percentiles[0]);
+    int failed = 0;
+
+    /* exact and sampled percentiles */
+    static const int speeds[] = { 0, 1, 2, 3, 4, 8, 16 };
+    for (unsigned s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++)
+    {
+        for (int off = 0; off <= 40; off += 40)
+        {
+            int ref[32], new[32];
+            reference_percentiles(percentiles, ref, n, speeds[s], off);
+
+            /* new frame: nothing cached */
+            frame_id++;
+            struct raw_stats * stats = stats_get(speeds[s], off);
+            for (int k = 0; k < n; k++)
+            {
+                new[k] = raw_stats_percentile(stats, percentiles[k]);
+            }
+
+            int ok = !memcmp(ref, new, n * sizeof(int));
+            printf("percentiles, speed %2d, offset %2d: %s (median %d)\n", speeds[s], off, ok ? "ok" : "FAILED", new[7]);
+            failed |= !ok;
+        }
+    }
+
+    /* overexposure for various white levels */
+    for (int step = 2; step <= 4; step += 2)
+    {
+        int ok = 1;
+        frame_id++;
+        for (int white = 1000; white <= 20000; white += 250)
+        {
+            struct raw_stats * stats = stats_get(step, 0);
+            int new = raw_stats_count_above(stats, white * 80 / 100) * 10000 / stats->total;
+            ok &= (new == reference_overexposure(white, step));
+        }
+        printf("overexposure, step %d: %s\n", step, ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+
+    /* cache: finer samplings answer coarser requests on the same frame, nothing survives a new frame */
+    {
+        frame_id++;
+        struct raw_stats * s2 = stats_get(2, 10);
+        int ok = stats_get(4, 10) == s2 && stats_get(2, 10) == s2;
+        struct raw_stats * s1 = stats_get(1, 0);
+        ok &= s1 != s2 && stats_get(4, 0) == s1 && stats_get(4, 10) == s2;
+        struct raw_stats * s0 = stats_get(0, 0);
+        ok &= stats_get(3, 10) == s0;
+        frame_id++;
+        ok &= stats_get(2, 10) != s2 || s2->key.frame_id == frame_id;
+        printf("cache reuse: %s\n", ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+
+    /* typical ETTR/deflicker sequence on one frame: a few percentile queries and an overexposure check */
+    int out[32];
+    double t0 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        reference_percentiles(percentiles, out, 3, 2, 0);
+        reference_percentiles(percentiles, out, 1, 4, 0);
+        reference_percentiles(percentiles, out, 1, 2, 0);
+        reference_overexposure(raw_info.white_level, 4);
+        reference_percentiles(percentiles, out, 1, 0, 0);
+        reference_percentiles(percentiles + 7, out, 1, 0, 0);
+    }
+    double t1 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        frame_id++;
+        struct raw_stats * stats;
+        stats = stats_get(2, 0); for (int k = 0; k < 3; k++) out[k] = raw_stats_percentile(stats, percentiles[k]);
+        stats = stats_get(4, 0); out[0] = raw_stats_percentile(stats, percentiles[0]);
+        stats = stats_get(2, 0); out[0] = raw_stats_percentile(stats, percentiles[0]);
+        stats = stats_get(4, 0); out[0] = raw_stats_count_above(stats, raw_info.white_level * 80 / 100);
+        stats = stats_get(0, 0); out[0] = raw_stats_percentile(stats, percentiles[0]);
+        stats = stats_get(0, 0); out[0] = raw_stats_percentile(stats, percentiles[7]);
+    }
+    double t2 = get_time();
+
+    printf("%dx%d, %d iterations of 6 queries per frame\n", width, height, iterations);
+    printf("  uncached: %8.3f ms/frame\n", (t1 - t0) * 1000 / iterations);
+    printf("  cached:   %8.3f ms/frame (%.2fx)\n", (t2 - t1) * 1000 / iterations, (t1 - t0) / (t2 - t1));
+
+    raw_stats_flush();
+    free(raw_info.buffer);
+    return failed;
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  host benchmark of src/raw_plane.c (decimated raw plane for raw zebras and the raw histogram).
+
+  builds a synthetic 14-bit raw frame, checks every sample of the plane against
+  raw_red_pixel_dark & co. from raw.c, then times the LiveView raw zebras and the
+  raw histogram reading the raw buffer directly (old) or the plane (new, built once per frame).
+
+  raw_plane_bench [-s WxH] [-g WxH] [-n iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "raw_plane.h"
+
+struct raw_info raw_info;
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* from raw.c */
+void raw_set_pixel(int x, int y, int value)
+{
+    struct raw_pixblock * p = (void*)raw_info.buffer + y * raw_info.pitch + (x/8)*14;
+    switch (x%8) {
+        case 0: p->a = value; break;
+        case 1: p->b_lo = value; p->b_hi = value >> 12; break;
+        case 2: p->c_lo = value; p->c_hi = value >> 10; break;
+        case 3: p->d_lo = value; p->d_hi = value >> 8; break;
+        case 4: p->e_lo = value; p->e_hi = value >> 6; break;
+        case 5: p->f_lo = value; p->f_hi = value >> 4; break;
+        case 6: p->g_lo = value; p->g_hi = value >> 2; break;
+        case 7: p->h = value; break;
+    }
+}
+
+int raw_red_pixel_dark(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2;
+    int i = ((y * raw_info.width + x) / 8);
+    return MIN(buf[i].a, buf[i - raw_info.width*2/8].a);
+}
+
+int raw_green_pixel_dark(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2;
+    int i = ((y * raw_info.width + x) / 8);
+    return MIN(buf[i].h, buf[i - raw_info.width*2/8].h);
+}
+
+int raw_blue_pixel_dark(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2 - 1;
+    int i = ((y * raw_info.width + x) / 8);
+    return MIN(buf[i].h, buf[i - raw_info.width*2/8].h);
+}
+
+int raw_red_pixel_bright(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2;
+    int i = ((y * raw_info.width + x) / 8);
+    return MAX(buf[i].a, buf[i - raw_info.width*2/8].a);
+}
+
+int raw_green_pixel_bright(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2;
+    int i = ((y * raw_info.width + x) / 8);
+    return MAX(buf[i].h, buf[i - raw_info.width*2/8].h);
+}
+
+int raw_blue_pixel_bright(int x, int y)
+{
+    struct raw_pixblock * buf = (void*)raw_info.buffer;
+    y = (y/2) * 2 - 1;
+    int i = ((y * raw_info.width + x) / 8);
+    return MAX(buf[i].h, buf[i - raw_info.width*2/8].h);
+}
+
+/* 720x480 bitmap coordinates mapped on the active area, with a scale factor as BM2RAW_X/Y in vram.h */
+#define BMP_W 720
+#define BMP_H 480
+static int bm2raw_sx, bm2raw_sy;
+static int bm2raw_x(int x) { return raw_info.active_area.x1 + ((x * bm2raw_sx) >> 10); }
+static int bm2raw_y(int y) { return raw_info.active_area.y1 + ((y * bm2raw_sy) >> 10); }
+
+/* the sampling of draw_zebras_raw_lv (every other line, every 8 pixels) and of hist_build_raw in LiveView (step 4) */
+static volatile int sink;
+
+static int zebras_old(int white)
+{
+    int n = 0;
+    for (int i = 0; i < BMP_H; i += 2)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j += 8)
+        {
+            int x = bm2raw_x(j);
+            int r = raw_red_pixel_dark(x, y);
+            int g = raw_green_pixel_dark(x, y);
+            int b = raw_blue_pixel_dark(x, y);
+            int u = raw_green_pixel_bright(x, y);
+            n += (r > white) + (g > white) + (b > white) + (u <= 2100);
+        }
+    }
+    return n;
+}
+
+static int zebras_new(struct raw_plane * plane, int white)
+{
+    int n = 0;
+    for (int i = 0; i < BMP_H; i += 2)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j += 8)
+        {
+            int x = bm2raw_x(j);
+            int k = raw_plane_index(plane, x, y);
+            int r = plane->ch[RAW_PLANE_RED_DARK][k];
+            int g = plane->ch[RAW_PLANE_GREEN_DARK][k];
+            int b = plane->ch[RAW_PLANE_BLUE_DARK][k];
+            int u = plane->ch[RAW_PLANE_GREEN_BRIGHT][k];
+            n += (r > white) + (g > white) + (b > white) + (u <= 2100);
+        }
+    }
+    return n;
+}
+
+/* draw_zebras_raw in playback: every bitmap pixel, dark or bright exposure in a diagonal pattern */
+static int zebras_playback_old(int white)
+{
+    int n = 0;
+    for (int i = 0; i < BMP_H; i++)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j++)
+        {
+            int x = bm2raw_x(j);
+            int dark = (i + j) % 4;
+            int r = dark ? raw_red_pixel_dark(x, y) : raw_red_pixel_bright(x, y);
+            int g = dark ? raw_green_pixel_dark(x, y) : raw_green_pixel_bright(x, y);
+            int b = dark ? raw_blue_pixel_dark(x, y) : raw_blue_pixel_bright(x, y);
+            int u = raw_green_pixel_bright(x, y);
+            n += (r > white) + (g > white) + (b > white) + (u <= 2100);
+        }
+    }
+    return n;
+}
+
+static int zebras_playback_new(struct raw_plane * plane, int white)
+{
+    int n = 0;
+    for (int i = 0; i < BMP_H; i++)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j++)
+        {
+            int x = bm2raw_x(j);
+            int k = raw_plane_index(plane, x, y);
+            int dark = (i + j) % 4;
+            int r = plane->ch[dark ? RAW_PLANE_RED_DARK   : RAW_PLANE_RED_BRIGHT][k];
+            int g = plane->ch[dark ? RAW_PLANE_GREEN_DARK : RAW_PLANE_GREEN_BRIGHT][k];
+            int b = plane->ch[dark ? RAW_PLANE_BLUE_DARK  : RAW_PLANE_BLUE_BRIGHT][k];
+            int u = plane->ch[RAW_PLANE_GREEN_BRIGHT][k];
+            n += (r > white) + (g > white) + (b > white) + (u <= 2100);
+        }
+    }
+    return n;
+}
+
+static void hist_old(uint32_t * hist)
+{
+    for (int i = 0; i < BMP_H; i += 4)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j += 8)
+        {
+            int x = bm2raw_x(j);
+            hist[raw_red_pixel_dark(x, y)]++;
+            hist[raw_green_pixel_dark(x, y)]++;
+            hist[raw_blue_pixel_dark(x, y)]++;
+        }
+    }
+}
+
+static void hist_new(struct raw_plane * plane, uint32_t * hist)
+{
+    for (int i = 0; i < BMP_H; i += 4)
+    {
+        int y = bm2raw_y(i);
+        for (int j = 0; j < BMP_W; j += 8)
+        {
+            int x = bm2raw_x(j);
+            int k = raw_plane_index(plane, x, y);
+            hist[plane->ch[RAW_PLANE_RED_DARK][k]]++;
+            hist[plane->ch[RAW_PLANE_GREEN_DARK][k]]++;
+            hist[plane->ch[RAW_PLANE_BLUE_DARK][k]]++;
+        }
+    }
+}
+
+static void synth_frame(int width, int height)
+{
+    raw_info.width = width;
+    raw_info.height = height;
+    raw_info.pitch = width * 14 / 8;
+    raw_info.frame_size = raw_info.pitch * height;
+    raw_info.bits_per_pixel = 14;
+    raw_info.black_level = 2048;
+    raw_info.white_level = 15000;
+    raw_info.active_area.x1 = 144;
+    raw_info.active_area.y1 = 24;
+    raw_info.active_area.x2 = width;
+    raw_info.active_area.y2 = height;
+    raw_info.buffer = malloc(raw_info.frame_size + 16);
+    bm2raw_sx = (raw_info.active_area.x2 - raw_info.active_area.x1) * 1024 / BMP_W;
+    bm2raw_sy = (raw_info.active_area.y2 - raw_info.active_area.y1) * 1024 / BMP_H;
+
+    srand(1);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            /* a gradient with noise, dual ISO-like bright lines, clipped highlights on the right */
+            int v = 2048 + rand() % 16;
+            if (x >= raw_info.active_area.x1 && y >= raw_info.active_area.y1)
+            {
+                v += (x * 9000 / width) * (1 + ((y >> 1) & 1)) + rand() % 64;
+                if (x > width * 9 / 10 && y < height / 3)
+                {
+                    v = 15000 + rand() % 100;
+                }
+            }
+            raw_set_pixel(x, y, v > 16383 ? 16383 : v);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 1808, height = 727;
+    int iterations = 100;
+    int max_w = RAW_PLANE_LV_MAX_W, max_h = RAW_PLANE_LV_MAX_H;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width % 8 || width < 16 || height < 16)
+            {
+                fprintf(stderr, "invalid size '%s' (width must be a multiple of 8)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &max_w, &max_h) != 2 || max_w < 1 || max_h < 1)
+            {
+                fprintf(stderr, "invalid grid '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s WxH] [-g WxH] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    synth_frame(width, height);
+
+    struct raw_plane plane;
+    memset(&plane, 0, sizeof(plane));
+    if (!raw_plane_build(&plane, &raw_info, max_w, max_h))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* every sample is what the raw.c functions return at its coordinates */
+    int failed = 0;
+    for (int sy = 0; sy < plane.height; sy++)
+    {
+        int y = sy << plane.y_shift;
+        if (y < 4) continue;
+
+        for (int sx = 0; sx < plane.width; sx++)
+        {
+            int x = sx << plane.x_shift;
+            int k = raw_plane_index(&plane, x, y);
+            failed |= k != sy * plane.width + sx
+                || plane.ch[RAW_PLANE_RED_DARK][k]     != raw_red_pixel_dark(x, y)
+                || plane.ch[RAW_PLANE_GREEN_DARK][k]   != raw_green_pixel_dark(x, y)
+                || plane.ch[RAW_PLANE_BLUE_DARK][k]    != raw_blue_pixel_dark(x, y)
+                || plane.ch[RAW_PLANE_RED_BRIGHT][k]   != raw_red_pixel_bright(x, y)
+                || plane.ch[RAW_PLANE_GREEN_BRIGHT][k] != raw_green_pixel_bright(x, y)
+                || plane.ch[RAW_PLANE_BLUE_BRIGHT][k]  != raw_blue_pixel_bright(x, y);
+        }
+    }
+    printf("%dx%d raw => %dx%d plane (step %dx%d): %s\n", width, height, plane.width, plane.height, 1 << plane.x_shift, 1 << plane.y_shift, failed ? "FAILED" : "ok");
+
+    /* at full sampling, the overlays see exactly the same values */
+    if (plane.x_shift == 3 && plane.y_shift == 1)
+    {
+        uint32_t * h1 = calloc(16384, 4);
+        uint32_t * h2 = calloc(16384, 4);
+        hist_old(h1);
+        hist_new(&plane, h2);
+        int ok = zebras_old(raw_info.white_level) == zebras_new(&plane, raw_info.white_level) && !memcmp(h1, h2, 16384 * 4)
+              && zebras_playback_old(raw_info.white_level) == zebras_playback_new(&plane, raw_info.white_level);
+        printf("zebras and histogram: %s\n", ok ? "ok" : "FAILED");
+        failed |= !ok;
+        free(h1);
+        free(h2);
+    }
+
+    /* LiveView, per frame: raw zebras and raw histogram */
+    uint32_t * hist = calloc(16384, 4);
+    double t0 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = zebras_old(raw_info.white_level);
+        hist_old(hist);
+    }
+    double t1 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        raw_plane_build(&plane, &raw_info, max_w, max_h);
+    }
+    double t2 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = zebras_new(&plane, raw_info.white_level);
+        hist_new(&plane, hist);
+    }
+    double t3 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = zebras_playback_old(raw_info.white_level);
+    }
+    double t4 = get_time();
+    for (int i = 0; i < iterations; i++)
+    {
+        sink = zebras_playback_new(&plane, raw_info.white_level);
+    }
+    double t5 = get_time();
+
+    double old = (t1 - t0) / iterations, build = (t2 - t1) / iterations, read = (t3 - t2) / iterations;
+    double pb_old = (t4 - t3) / iterations, pb_read = (t5 - t4) / iterations;
+    printf("%d iterations\n", iterations);
+    printf("  plane build:                       %8.3f ms\n", build * 1000);
+    printf("  LiveView zebras + histogram, old:  %8.3f ms\n", old * 1000);
+    printf("  LiveView zebras + histogram, new:  %8.3f ms (%.2fx; %.2fx including the build)\n", read * 1000, old / read, old / (build + read));
+    printf("  playback zebras, old:              %8.3f ms\n", pb_old * 1000);
+    printf("  playback zebras, new:              %8.3f ms (%.2fx; %.2fx including the build)\n", pb_read * 1000, pb_old / pb_read, pb_old / (build + pb_read));
+
+    free(hist);
+    raw_plane_free(&plane);
+    free(raw_info.buffer);
+    return failed;
+}
@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2026 The Magic Lantern Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+  host benchmark of src/raw_preview.c (raw to YUV conversion for the LiveView raw preview).
+
+  builds a synthetic 14-bit raw frame and converts it to a 720x480 UYVY image with the old
+  raw_preview_color_work / raw_preview_fast_work from raw.c (gamma tables rebuilt on every call)
+  and with the cached tables and line kernels, as raw_preview_fast_ex calls them now.
+  checks that color and grayscale outputs are identical, that the quarter resolution color
+  matches the half resolution one at its samples, and prints the time per frame of each.
+
+  raw_preview_bench [-s WxH] [-n iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "raw_preview.h"
+#include "imgconv.h"
+
+struct raw_info raw_info;
+
+#define MIN(a,b) \
+   ({ __typeof__ ((a)+(b)) _a = (a); \
+      __typeof__ ((a)+(b)) _b = (b); \
+     _a < _b ? _a : _b; })
+
+#define MAX(a,b) \
+   ({ __typeof__ ((a)+(b)) _a = (a); \
+       __typeof__ ((a)+(b)) _b = (b); \
+     _a > _b ? _a : _b; })
+
+#define COERCE(x,lo,hi) MAX(MIN((x),(hi)),(lo))
+#define CACHEABLE(x) (x)
+#define dbg_printf(...)
+
+static double get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* from raw.c */
+float raw_to_ev(int raw)
+{
+    int raw_max = raw_info.white_level - raw_info.black_level;
+    float raw_ev = -log2f(raw_max) + log2f(COERCE(raw - raw_info.black_level, 1, raw_max));
+    return raw_ev;
+}
+
+void raw_set_pixel(int x, int y, int value)
+{
+    struct raw_pixblock * p = (void*)raw_info.buffer + y * raw_info.pitch + (x/8)*14;
+    switch (x%8) {
+        case 0: p->a = value; break;
+        case 1: p->b_lo = value; p->b_hi = value >> 12; break;
+        case 2: p->c_lo = value; p->c_hi = value >> 10; break;
+        case 3: p->d_lo = value; p->d_hi = value >> 8; break;
+        case 4: p->e_lo = value; p->e_hi = value >> 6; break;
+        case 5: p->f_lo = value; p->f_hi = value >> 4; break;
+        case 6: p->g_lo = value; p->g_hi = value >> 2; break;
+        case 7: p->h = value; break;
+    }
+}
+
+/* rgb2yuv422_rec601 from imgconv.c */
+uint32_t rgb2yuv422(int R, int G, int B)
+{
+    int Y = COERCE(((306) * R + (601) * G + (116) * B) / 1024, 0, 255);
+    int U = COERCE(((-172) * R + (-337) * G + (509) * B) / 1024, -128, 127);
+    int V = COERCE(((509) * R + (-427) * G + (-82) * B) / 1024, -128, 127);
+    return UYVY_PACK(U,Y,V,Y);
+}
+
+/* 720x480 LiveView buffer, raw active area stretched over it (LV2RAW in vram.h) */
+static struct { int width, height, pitch; } vram_lv = { 720, 480, 1440 };
+static struct { int sx, sy, tx, ty; } lv2raw;
+#define LV(x,y) ((x) * 2 + (y) * vram_lv.pitch)
+#define LV2RAW_X(x) ((((x) * lv2raw.sx) >> 10) + lv2raw.tx)
+#define LV2RAW_Y(y) ((((y) * lv2raw.sy) >> 10) + lv2raw.ty)
+#define RAW2LV_X(x) (((x) << 10) / lv2raw.sx - (lv2raw.tx << 10) / lv2raw.sx)
+static int preview_rect_x, preview_rect_y, preview_rect_w, preview_rect_h;
+
+#define PA ((int)(p->a))
+#define PB ((int)(p->b_lo | (p->b_hi << 12)))
+#define PC ((int)(p->c_lo | (p->c_hi << 10)))
+#define PD ((int)(p->d_lo | (p->d_hi << 8)))
+#define PF ((int)(p->f_lo | (p->f_hi << 4)))
+#define PH ((int)(p->h))
+#define QA ((int)(q->a))
+#define QB ((int)(q->b_lo | (q->b_hi << 12)))
+#define QC ((int)(q->c_lo | (q->c_hi << 10)))
+#define QD ((int)(q->d_lo | (q->d_hi << 8)))
+#define QE ((int)(q->e_lo | (q->e_hi << 6)))
+#define QF ((int)(q->f_lo | (q->f_hi << 4)))
+#define QG ((int)(q->g_lo | (q->g_hi << 2)))
+#define QH ((int)(q->h))
+#define PE ((int)(p->e_lo | (p->e_hi << 6)))
+#define PG ((int)(p->g_lo | (p->g_hi << 2)))
+
+/* the old code from raw.c */
+static void old_color_work(void* raw_buffer, void* lv_buffer, int y1, int y2)
+{
+    uint16_t* lv16 = CACHEABLE(lv_buffer);
+    uint32_t* lv32 = (uint32_t*) lv16;
+    struct raw_pixblock * raw = CACHEABLE(raw_buffer);
+
+    int black = raw_info.black_level;
+    int white = raw_info.white_level;
+    int div = 0;
+    while (((white-black) >> div) >= 1024)
+    {
+        div++;
+    }
+
+    uint8_t gamma_rb[1024];
+    uint8_t gamma_g[1024];
+
+    for (int i = 0; i < 1024; i++)
+    {
+        int g_rb = COERCE(raw_to_ev((i << div) + black) + 11, 0, 10) * 255 / 10;
+        int g_g  = COERCE(raw_to_ev((i << div) + black) + 10, 0, 10) * 255 / 10;
+        gamma_rb[i] = COERCE(g_rb * g_rb / 255, 0, 255);
+        gamma_g[i]  = COERCE(g_g  * g_g  / 255, 0, 255);
+    }
+
+    int x1 = COERCE(RAW2LV_X(preview_rect_x), 0, vram_lv.width);
+    int x2 = COERCE(RAW2LV_X(preview_rect_x + preview_rect_w), 0, vram_lv.width);
+    if (x2 < x1) return;
+
+    int* lv2rx = malloc(x2 * 4);
+    if (!lv2rx) return;
+    for (int x = x1; x < x2; x++)
+        lv2rx[x] = LV2RAW_X(x) & ~1;
+
+    for (int y = y1; y < y2; y++)
+    {
+        int yr = LV2RAW_Y(y) & ~1;
+
+        if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+        {
+            memset(&lv32[LV(0,y)/4], 0, vram_lv.pitch);
+            continue;
+        }
+
+        memset(&lv32[LV(0,y)/4],  0, LV(x1,y) - LV(0,y)/4*4);
+        memset(&lv32[LV(x2,y)/4], 0, LV(0,1) - LV(x2,0)/4*4);
+
+        struct raw_pixblock * row = (void*)raw + yr * raw_info.pitch;
+
+        for (int x = x1; x < x2; x += 2)
+        {
+            int xr = lv2rx[x];
+            struct raw_pixblock * p = row + (xr/8);
+            struct raw_pixblock * q = (void*) p + raw_info.pitch;
+            int r,g,b;
+
+            switch (xr%8)
+            {
+                case 0: r = PA; g = (PB + QA) >> 1; b = QB; break;
+                case 2: r = PC; g = (PD + QC) >> 1; b = QD; break;
+                case 4: r = PE; g = (PF + QE) >> 1; b = QF; break;
+                case 6: r = PG; g = (PH + QG) >> 1; b = QH; break;
+                default: r = g = b = 0;
+            }
+
+            r = gamma_rb[COERCE(r - black, 0, white-black) >> div];
+            g = gamma_g [COERCE(g - black, 0, white-black) >> div];
+            b = gamma_rb[COERCE(b - black, 0, white-black) >> div];
+
+            uint32_t yuv = rgb2yuv422(r,g,b);
+            lv32[LV(x,y)/4] = yuv;
+        }
+    }
+    free(lv2rx);
+}
+
+static void old_fast_work(void* raw_buffer, void* lv_buffer, int y1, int y2)
+{
+    uint16_t* lv16 = CACHEABLE(lv_buffer);
+    uint64_t* lv64 = (uint64_t*) lv16;
+    struct raw_pixblock * raw = CACHEABLE(raw_buffer);
+
+    int black = raw_info.black_level;
+    int white = raw_info.white_level;
+    int div = 0;
+    while (((white-black) >> div) >= 1024)
+    {
+        div++;
+    }
+
+    uint8_t gamma[1024];
+
+    for (int i = 0; i < 1024; i++)
+    {
+        int g = COERCE(raw_to_ev((i << div) + black) + 10, 0, 10) * 255 / 10;
+        gamma[i] = g * g / 255;
+    }
+
+    int x1 = COERCE(RAW2LV_X(preview_rect_x), 0, vram_lv.width);
+    int x2 = COERCE(RAW2LV_X(preview_rect_x + preview_rect_w), 0, vram_lv.width);
+    if (x2 < x1) return;
+
+    int* lv2rx = malloc(x2 * 4);
+    if (!lv2rx) return;
+    for (int x = x1; x < x2; x++)
+        lv2rx[x] = LV2RAW_X(x) & ~1;
+
+    for (int y = y1; y < y2; y++)
+    {
+        int yr = LV2RAW_Y(y) | 1;
+
+        if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+        {
+            memset(&lv64[LV(0,y)/8], 0, vram_lv.pitch);
+            continue;
+        }
+
+        memset(&lv64[LV(0,y)/8],  0, LV(x1,y) - LV(0,y)/8*8);
+        memset(&lv64[LV(x2,y)/8], 0, LV(0,1) - LV(x2,0)/8*8);
+
+        struct raw_pixblock * row = (void*)raw + yr * raw_info.pitch;
+
+        if (y%2) continue;
+
+        for (int x = x1; x < x2; x += 4)
+        {
+            int xr = lv2rx[x];
+            struct raw_pixblock * p = row + (xr/8);
+            int c = p->a;
+            uint64_t Y = gamma[COERCE(c - black, 0, white-black) >> div];
+            Y = (Y << 8) | (Y << 24) | (Y << 40) | (Y << 56);
+            int idx = LV(x,y)/8;
+            lv64[idx] = Y;
+            lv64[idx + vram_lv.pitch/8] = Y;
+        }
+    }
+    free(lv2rx);
+}
+
+/* the new code: raw_preview_setup and raw_preview_lines from raw.c */
+#define RAW_PREVIEW_COLOR_HALFRES    0
+#define RAW_PREVIEW_GRAY_ULTRA_FAST  1
+#define RAW_PREVIEW_COLOR_QUARTERRES 2
+
+static struct raw_preview_lut preview_lut;
+static int preview_cols[2048];
+static int preview_x1, preview_x2, preview_n;
+
+static int new_setup(int quality)
+{
+    if (!raw_preview_lut_update(&preview_lut, raw_info.black_level, raw_info.white_level, 11, 10, 11))
+        return 0;
+
+    int x1 = COERCE(RAW2LV_X(preview_rect_x), 0, vram_lv.width);
+    int x2 = COERCE(RAW2LV_X(preview_rect_x + preview_rect_w), 0, vram_lv.width);
+    if (x2 < x1) return 0;
+
+    const int x_step = (quality == RAW_PREVIEW_COLOR_HALFRES) ? 2 : 4;
+    const int n = (x2 - x1 + x_step - 1) / x_step;
+
+    for (int i = 0, x = x1; i < n; i++, x += x_step)
+    {
+        int xr = LV2RAW_X(x) & ~1;
+        if (quality == RAW_PREVIEW_GRAY_ULTRA_FAST)
+        {
+            preview_cols[i] = raw_preview_column(xr & ~7);
+        }
+        else
+        {
+            preview_cols[2*i]   = raw_preview_column(xr);
+            preview_cols[2*i+1] = raw_preview_column(xr + 1);
+        }
+    }
+
+    preview_x1 = x1;
+    preview_x2 = x2;
+    preview_n = n;
+    return 1;
+}
+
+static void new_lines(void* raw_buffer, void* lv_buffer, int y1, int y2, int quality)
+{
+    uint32_t* lv32 = CACHEABLE(lv_buffer);
+    uint64_t* lv64 = (uint64_t*) lv32;
+    const uint16_t* raw = CACHEABLE(raw_buffer);
+    const int raw_pitch = raw_info.pitch / 2;
+    const int x1 = preview_x1;
+    const int x2 = preview_x2;
+
+    for (int y = y1; y < y2; y++)
+    {
+        if (quality == RAW_PREVIEW_COLOR_HALFRES)
+        {
+            int yr = LV2RAW_Y(y) & ~1;
+
+            if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+            {
+                memset(&lv32[LV(0,y)/4], 0, vram_lv.pitch);
+                continue;
+            }
+
+            memset(&lv32[LV(0,y)/4],  0, LV(x1,y) - LV(0,y)/4*4);
+            memset(&lv32[LV(x2,y)/4], 0, LV(0,1) - LV(x2,0)/4*4);
+
+            const uint16_t * rg = raw + yr * raw_pitch;
+            raw_preview_color_line(&preview_lut, rg, rg + raw_pitch, preview_cols, preview_n, &lv32[LV(x1,y)/4], 0);
+        }
+        else
+        {
+            int yr = (quality == RAW_PREVIEW_GRAY_ULTRA_FAST) ? LV2RAW_Y(y) | 1 : LV2RAW_Y(y) & ~1;
+
+            if (yr <= preview_rect_y || yr >= preview_rect_y + preview_rect_h)
+            {
+                memset(&lv64[LV(0,y)/8], 0, vram_lv.pitch);
+                continue;
+            }
+
+            memset(&lv64[LV(0,y)/8],  0, LV(x1,y) - LV(0,y)/8*8);
+            memset(&lv64[LV(x2,y)/8], 0, LV(0,1) - LV(x2,0)/8*8);
+
+            if (y%2) continue;
+
+            const uint16_t * line = raw + yr * raw_pitch;
+            uint64_t * out = &lv64[LV(x1,y)/8];
+
+            if (quality == RAW_PREVIEW_GRAY_ULTRA_FAST)
+            {
+                raw_preview_gray_line(&preview_lut, line, preview_cols, preview_n, out);
+            }
+            else
+            {
+                raw_preview_color_line(&preview_lut, line, line + raw_pitch, preview_cols, preview_n, (uint32_t*) out, 1);
+            }
+
+            memcpy(out + vram_lv.pitch/8, out, preview_n * 8);
+        }
+    }
+}
+
+static void new_work(void* raw_buffer, void* lv_buffer, int y1, int y2, int quality)
+{
+    if (new_setup(quality))
+    {
+        new_lines(raw_buffer, lv_buffer, y1, y2, quality);
+    }
+}
+
+static void synth_frame(int width, int height)
+{
+    raw_info.width = width;
+    raw_info.height = height;
+    raw_info.pitch = width * 14 / 8;
+    raw_info.frame_size = raw_info.pitch * height;
+    raw_info.bits_per_pixel = 14;
+    raw_info.black_level = 2047;
+    raw_info.white_level = 15000;
+    raw_info.active_area.x1 = 144;
+    raw_info.active_area.y1 = 28;
+    raw_info.active_area.x2 = width;
+    raw_info.active_area.y2 = height;
+    raw_info.buffer = malloc(raw_info.frame_size + 16);
+
+    srand(1);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            /* colored gradients with noise, some pixels below black and clipped highlights */
+            int v = 2000 + rand() % 64;
+            if (x >= raw_info.active_area.x1 && y >= raw_info.active_area.y1)
+            {
+                int c = (x & 1) + (y & 1);
+                v += ((x * 13000 / width) >> (c == 1 ? 0 : 1)) * (y * 3 / height + 1) / 2 + rand() % 128;
+            }
+            raw_set_pixel(x, y, v > 16383 ? 16383 : v);
+        }
+    }
+
+    /* preview rectangle: the active area, stretched over the LiveView buffer */
+    preview_rect_x = raw_info.active_area.x1;
+    preview_rect_y = raw_info.active_area.y1;
+    preview_rect_w = raw_info.active_area.x2 - raw_info.active_area.x1;
+    preview_rect_h = raw_info.active_area.y2 - raw_info.active_area.y1;
+    lv2raw.sx = 1024 * preview_rect_w / vram_lv.width;
+    lv2raw.sy = 1024 * preview_rect_h / vram_lv.height;
+    lv2raw.tx = preview_rect_x;
+    lv2raw.ty = preview_rect_y;
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 1808, height = 727;
+    int iterations = 50;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width % 8 || width < 256 || height < 64)
+            {
+                fprintf(stderr, "invalid size '%s' (width must be a multiple of 8)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s WxH] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    synth_frame(width, height);
+
+    int size = vram_lv.pitch * vram_lv.height;
+    uint32_t * lv_old = calloc(size + vram_lv.pitch, 1);
+    uint32_t * lv_new = calloc(size + vram_lv.pitch, 1);
+    uint32_t * lv_quarter = calloc(size + vram_lv.pitch, 1);
+    int failed = 0;
+
+    /* the whole frame, then in bands of lines (raw_preview_fast_ex takes any range) */
+    old_color_work(raw_info.buffer, lv_old, 0, vram_lv.height);
+    new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_COLOR_HALFRES);
+    int ok = !memcmp(lv_old, lv_new, size);
+    memset(lv_new, 0, size);
+    for (int y = 0; y < vram_lv.height; y += 32)
+    {
+        new_work(raw_info.buffer, lv_new, y, MIN(y + 32, vram_lv.height), RAW_PREVIEW_COLOR_HALFRES);
+    }
+    ok &= !memcmp(lv_old, lv_new, size);
+    printf("color, half resolution: %s\n", ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    /* quarter resolution: every other sample and line of the above, doubled */
+    new_work(raw_info.buffer, lv_quarter, 0, vram_lv.height, RAW_PREVIEW_COLOR_QUARTERRES);
+    ok = 1;
+    for (int y = 0; y < vram_lv.height - 1; y += 2)
+    {
+        for (int x = preview_x1; x < preview_x2; x += 4)
+        {
+            uint32_t ref = lv_old[LV(x,y)/4];
+            ok &= lv_quarter[LV(x,y)/8*2] == ref && lv_quarter[LV(x,y)/8*2+1] == ref;
+            ok &= lv_quarter[LV(x,y+1)/8*2] == ref;
+        }
+    }
+    printf("color, quarter resolution: %s\n", ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    old_fast_work(raw_info.buffer, lv_old, 0, vram_lv.height);
+    new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_GRAY_ULTRA_FAST);
+    ok = !memcmp(lv_old, lv_new, size);
+    printf("grayscale: %s\n", ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    /* different levels rebuild the tables */
+    raw_info.black_level = 2048;
+    raw_info.white_level = 16200;
+    old_color_work(raw_info.buffer, lv_old, 0, vram_lv.height);
+    new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_COLOR_HALFRES);
+    ok = !memcmp(lv_old, lv_new, size);
+    printf("color, other levels: %s\n", ok ? "ok" : "FAILED");
+    failed |= !ok;
+
+    double t[6];
+    t[0] = get_time();
+    for (int i = 0; i < iterations; i++) old_color_work(raw_info.buffer, lv_old, 0, vram_lv.height);
+    t[1] = get_time();
+    for (int i = 0; i < iterations; i++) new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_COLOR_HALFRES);
+    t[2] = get_time();
+    for (int i = 0; i < iterations; i++) new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_COLOR_QUARTERRES);
+    t[3] = get_time();
+    for (int i = 0; i < iterations; i++) old_fast_work(raw_info.buffer, lv_old, 0, vram_lv.height);
+    t[4] = get_time();
+    for (int i = 0; i < iterations; i++) new_work(raw_info.buffer, lv_new, 0, vram_lv.height, RAW_PREVIEW_GRAY_ULTRA_FAST);
+    t[5] = get_time();
+
+    printf("%dx%d raw => %dx%d YUV, %d iterations\n", width, height, vram_lv.width, vram_lv.height, iterations);
+    printf("  color 360x480, old:     %8.3f ms\n", (t[1] - t[0]) * 1000 / iterations);
+    printf("  color 360x480, new:     %8.3f ms (%.2fx)\n", (t[2] - t[1]) * 1000 / iterations, (t[1] - t[0]) / (t[2] - t[1]));
+    printf("  color 180x240, new:     %8.3f ms (%.2fx)\n", (t[3] - t[2]) * 1000 / iterations, (t[1] - t[0]) / (t[3] - t[2]));
+    printf("  gray 180x240, old:      %8.3f ms\n", (t[4] - t[3]) * 1000 / iterations);
+    printf("  gray 180x240, new:      %8.3f ms (%.2fx)\n", (t[5] - t[4]) * 1000 / iterations, (t[4] - t[3]) / (t[5] - t[4]));
+
+    raw_preview_lut_free(&preview_lut);
+    free(lv_old);
+    free(lv_new);
+    free(lv_quarter);
+    free(raw_info.buffer);
+    return failed;
+}